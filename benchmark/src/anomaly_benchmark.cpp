@@ -0,0 +1,35 @@
+#include <benchmark/benchmark.h>
+
+#include "anomaly.h"
+#include "settings.h"
+#include "stats.h"
+
+#include "fixtures.h"
+
+namespace {
+
+// One collection's worth of updates for a group, the per drive cost should stay flat as the group grows
+void BM_AnomalyDetectorUpdate(benchmark::State& state)
+{
+  const std::vector<lumberjill::cDevice> devices = lumberjill::bench::GenerateDevices(size_t(state.range(0)));
+  lumberjill::cMountStats mountStats = lumberjill::bench::GenerateMountStats(devices);
+  const lumberjill::cBtrfsVolumeStats btrfsVolumeStats = lumberjill::bench::GenerateBtrfsVolumeStats(devices);
+
+  lumberjill::cAnomalySettings settings;
+  settings.bEnabled = true;
+
+  lumberjill::cAnomalyDetector detector;
+  int64_t nTimestamp = 1700000000;
+
+  for (auto _ : state) {
+    nTimestamp += 60;
+    detector.Update(settings, nTimestamp, mountStats, &btrfsVolumeStats);
+    benchmark::DoNotOptimize(mountStats.mapDrivePathToDriveStats.begin()->second.anomalies.size());
+  }
+
+  state.SetItemsProcessed(int64_t(state.iterations()) * state.range(0));
+}
+
+}
+
+BENCHMARK(BM_AnomalyDetectorUpdate)->Arg(lumberjill::bench::SMALL_DEVICE_COUNT)->Arg(lumberjill::bench::MEDIUM_DEVICE_COUNT)->Arg(lumberjill::bench::LARGE_DEVICE_COUNT)->Unit(benchmark::kMicrosecond);
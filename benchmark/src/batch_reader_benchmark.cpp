@@ -0,0 +1,108 @@
+#include <cstdlib>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+
+#include "batch_reader.h"
+
+#include "fixtures.h"
+
+namespace {
+
+// A fake sysfs tree with a temp1_input for each drive, opened like the temperature collector keeps them open
+class cFakeSysTree {
+public:
+  explicit cFakeSysTree(size_t nDrives)
+  {
+    char szFolder[] = "/tmp/lumber-jill-bench-batch-reader-XXXXXX";
+    if (mkdtemp(szFolder) == nullptr) return;
+
+    sFolder = szFolder;
+
+    std::error_code ec;
+    for (size_t i = 0; i < nDrives; i++) {
+      const std::string sHwmonFolder = sFolder + "/class/block/sd" + std::to_string(i) + "/device/hwmon/hwmon" + std::to_string(i);
+      std::filesystem::create_directories(sHwmonFolder, ec);
+
+      const std::string sInputPath = sHwmonFolder + "/temp1_input";
+      std::ofstream(sInputPath)<<std::to_string(30000 + (i * 125))<<"\n";
+
+      const int fd = open(sInputPath.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0) break;
+      fds.push_back(fd);
+    }
+  }
+
+  ~cFakeSysTree()
+  {
+    for (int fd : fds) close(fd);
+
+    std::error_code ec;
+    if (!sFolder.empty()) std::filesystem::remove_all(sFolder, ec);
+  }
+
+  std::string sFolder;
+  std::vector<int> fds;
+};
+
+void RunBatchFileReader(benchmark::State& state, bool bUseIOUring)
+{
+  // One tick of the daemon's temperature sampling, every file is read and parsed in place
+  const size_t nDrives = size_t(state.range(0));
+  const cFakeSysTree tree(nDrives);
+  if (tree.fds.size() != nDrives) {
+    state.SkipWithError("Failed to create the fake sysfs tree");
+    return;
+  }
+
+  lumberjill::cBatchFileReader reader(32, bUseIOUring);
+  std::vector<size_t> slots;
+  for (int fd : tree.fds) {
+    slots.push_back(reader.Add(fd));
+  }
+
+  // Register the files and set up the ring before timing
+  reader.Read(slots);
+  if (bUseIOUring && !reader.IsUsingIOUring()) {
+    state.SkipWithError("io_uring is not available");
+    return;
+  }
+
+  size_t nSyscalls = 0;
+  int64_t nTotal = 0;
+  std::string_view contents;
+  for (auto _ : state) {
+    nSyscalls += reader.Read(slots);
+    for (size_t slot : slots) {
+      if (reader.GetContents(slot, contents)) nTotal += int64_t(contents.length());
+    }
+    benchmark::DoNotOptimize(nTotal);
+  }
+
+  state.counters["syscalls_per_tick"] = benchmark::Counter(double(nSyscalls), benchmark::Counter::kAvgIterations);
+  state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(nDrives));
+}
+
+void BM_BatchFileReaderPread(benchmark::State& state)
+{
+  RunBatchFileReader(state, false);
+}
+
+void BM_BatchFileReaderIOUring(benchmark::State& state)
+{
+  RunBatchFileReader(state, true);
+}
+
+}
+
+// 60 drives is a typical 4U storage server, the large device count would need more file descriptors than the default limit
+BENCHMARK(BM_BatchFileReaderPread)->Unit(benchmark::kMicrosecond)->Arg(lumberjill::bench::SMALL_DEVICE_COUNT)->Arg(60)->Arg(lumberjill::bench::MEDIUM_DEVICE_COUNT);
+BENCHMARK(BM_BatchFileReaderIOUring)->Unit(benchmark::kMicrosecond)->Arg(lumberjill::bench::SMALL_DEVICE_COUNT)->Arg(60)->Arg(lumberjill::bench::MEDIUM_DEVICE_COUNT);
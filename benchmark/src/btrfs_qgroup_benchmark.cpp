@@ -0,0 +1,67 @@
+#include <cstring>
+#include <vector>
+
+#include <endian.h>
+#include <linux/btrfs.h>
+#include <linux/btrfs_tree.h>
+
+#include <benchmark/benchmark.h>
+
+#include "btrfs_qgroup.h"
+
+namespace {
+
+// What BTRFS_IOC_TREE_SEARCH_V2 returns for a volume with nSubvolumes subvolumes, each with an info item
+std::vector<uint8_t> GenerateSearchResult(size_t nSubvolumes)
+{
+  std::vector<uint8_t> buffer;
+  buffer.reserve(nSubvolumes * (sizeof(btrfs_ioctl_search_header) + sizeof(btrfs_qgroup_info_item)));
+
+  for (size_t i = 0; i < nSubvolumes; i++) {
+    btrfs_ioctl_search_header header;
+    memset(&header, 0, sizeof(header));
+    header.type = BTRFS_QGROUP_INFO_KEY;
+    header.offset = BTRFS_FIRST_FREE_OBJECTID + i;
+    header.len = sizeof(btrfs_qgroup_info_item);
+
+    // Spread the sizes out so the top few aren't just the first or last ones
+    btrfs_qgroup_info_item item;
+    memset(&item, 0, sizeof(item));
+    item.rfer = htole64(((i * 7919) % nSubvolumes) * 1024 * 1024);
+    item.excl = htole64(((i * 104729) % nSubvolumes) * 1024);
+
+    const uint8_t* pHeader = reinterpret_cast<const uint8_t*>(&header);
+    buffer.insert(buffer.end(), pHeader, pHeader + sizeof(header));
+    const uint8_t* pItem = reinterpret_cast<const uint8_t*>(&item);
+    buffer.insert(buffer.end(), pItem, pItem + sizeof(item));
+  }
+
+  return buffer;
+}
+
+// Decoding one search result and picking the top 10, the cost per subvolume should stay flat as the volume grows
+void BM_BtrfsQgroupDecodeAndTop(benchmark::State& state)
+{
+  const size_t nSubvolumes = size_t(state.range(0));
+  const std::vector<uint8_t> buffer = GenerateSearchResult(nSubvolumes);
+
+  std::vector<lumberjill::cBtrfsQgroup> qgroups;
+  std::vector<lumberjill::cBtrfsQgroup> previous;
+  lumberjill::cBtrfsSearchKey lastKey;
+  lumberjill::DecodeBtrfsQgroupSearchResult(buffer.data(), buffer.size(), nSubvolumes, previous, lastKey);
+
+  lumberjill::cBtrfsQgroupStats qgroupStats;
+
+  for (auto _ : state) {
+    qgroups.clear();
+    lumberjill::DecodeBtrfsQgroupSearchResult(buffer.data(), buffer.size(), nSubvolumes, qgroups, lastKey);
+    lumberjill::GetBtrfsQgroupStats(qgroups, previous, 10, qgroupStats);
+    benchmark::DoNotOptimize(qgroupStats.topReferenced.data());
+  }
+
+  state.SetItemsProcessed(int64_t(state.iterations()) * state.range(0));
+}
+
+}
+
+BENCHMARK(BM_BtrfsQgroupDecodeAndTop)->Arg(100)->Arg(1000)->Arg(10000)->Unit(benchmark::kMicrosecond);
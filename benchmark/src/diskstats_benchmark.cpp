@@ -0,0 +1,103 @@
+#include <cstdlib>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "diskstats.h"
+
+#include "fixtures.h"
+
+namespace {
+
+// Generate /proc/diskstats for nDisks disks, each with two partitions like a real machine
+std::string GenerateDiskStats(size_t nDisks)
+{
+  std::string contents;
+  for (size_t i = 0; i < nDisks; i++) {
+    const std::string sDisk = "sd" + std::to_string(i);
+    for (const std::string& sNode : { sDisk, sDisk + "1", sDisk + "2" }) {
+      contents += "   8      " + std::to_string(i * 16) + " " + sNode;
+      for (size_t field = 0; field < 17; field++) {
+        contents += " " + std::to_string((i + 1) * (field + 1) * 7919);
+      }
+      contents += "\n";
+    }
+  }
+
+  return contents;
+}
+
+std::vector<std::string> GenerateDiskNodes(size_t nDisks)
+{
+  std::vector<std::string> nodes;
+  for (size_t i = 0; i < nDisks; i++) {
+    nodes.push_back("sd" + std::to_string(i));
+  }
+
+  std::sort(nodes.begin(), nodes.end());
+  return nodes;
+}
+
+void BM_ParseDiskStats(benchmark::State& state)
+{
+  // Every disk is monitored, the partitions are skipped
+  const size_t nDisks = size_t(state.range(0));
+  const std::string contents = GenerateDiskStats(nDisks);
+  const std::vector<std::string> nodes = GenerateDiskNodes(nDisks);
+
+  std::vector<lumberjill::cDiskStatsCounters> counters;
+
+  for (auto _ : state) {
+    const bool result = lumberjill::ParseDiskStats(contents, nodes, counters);
+    benchmark::DoNotOptimize(result);
+    benchmark::DoNotOptimize(counters.data());
+  }
+
+  state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(nDisks));
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(contents.length()));
+}
+
+void BM_DiskStatsCollectorSample(benchmark::State& state)
+{
+  // Read the file and work out the stats like a daemon sweep does
+  const size_t nDisks = size_t(state.range(0));
+
+  char szFolder[] = "/tmp/lumber-jill-bench-diskstats-XXXXXX";
+  if (mkdtemp(szFolder) == nullptr) {
+    state.SkipWithError("Failed to create folder");
+    return;
+  }
+
+  const std::string sFolder(szFolder);
+  const std::string sDiskStatsFilePath = sFolder + "/diskstats";
+  std::ofstream(sDiskStatsFilePath)<<GenerateDiskStats(nDisks);
+
+  const std::vector<std::string> nodes = GenerateDiskNodes(nDisks);
+
+  lumberjill::cDiskStatsCollector collector(sDiskStatsFilePath);
+
+  uint64_t nNowMS = 1000;
+  for (auto _ : state) {
+    if (!collector.Sample(nodes, nNowMS)) {
+      state.SkipWithError("Failed to sample diskstats");
+      break;
+    }
+    nNowMS += 1000;
+  }
+
+  std::error_code ec;
+  std::filesystem::remove_all(sFolder, ec);
+
+  state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(nDisks));
+}
+
+}
+
+BENCHMARK(BM_ParseDiskStats)->Arg(lumberjill::bench::SMALL_DEVICE_COUNT)->Arg(lumberjill::bench::MEDIUM_DEVICE_COUNT)->Arg(lumberjill::bench::LARGE_DEVICE_COUNT);
+BENCHMARK(BM_DiskStatsCollectorSample)->Unit(benchmark::kMicrosecond)->Arg(lumberjill::bench::SMALL_DEVICE_COUNT)->Arg(lumberjill::bench::MEDIUM_DEVICE_COUNT)->Arg(lumberjill::bench::LARGE_DEVICE_COUNT);
@@ -0,0 +1,132 @@
+#include <sstream>
+
+#include "fixtures.h"
+
+namespace lumberjill {
+
+namespace bench {
+
+std::vector<cDevice> GenerateDevices(size_t nDevices)
+{
+  std::vector<cDevice> devices;
+  devices.reserve(nDevices);
+
+  for (size_t i = 0; i < nDevices; i++) {
+    cDevice device;
+    device.sName = "Bench " + std::to_string(i);
+    device.sPath = "/dev/bench" + std::to_string(i);
+    devices.push_back(device);
+  }
+
+  return devices;
+}
+
+std::string GenerateSmartCtlOutput(size_t index)
+{
+  std::ostringstream o;
+  o<<"smartctl 7.1 2019-12-30 r5022 [x86_64-linux-5.8.18-100.fc31.x86_64] (local build)\n";
+  o<<"Copyright (C) 2002-19, Bruce Allen, Christian Franke, www.smartmontools.org\n";
+  o<<"\n";
+  o<<"=== START OF READ SMART DATA SECTION ===\n";
+  o<<"SMART Attributes Data Structure revision number: 16\n";
+  o<<"Vendor Specific SMART Attributes with Thresholds:\n";
+  o<<"ID# ATTRIBUTE_NAME          FLAG     VALUE WORST THRESH TYPE      UPDATED  WHEN_FAILED RAW_VALUE\n";
+  o<<"  1 Raw_Read_Error_Rate     0x002f   200   200   051    Pre-fail  Always       -       "<<(index * 3)<<"\n";
+  o<<"  3 Spin_Up_Time            0x0027   170   166   021    Pre-fail  Always       -       2458\n";
+  o<<"  4 Start_Stop_Count        0x0032   099   099   000    Old_age   Always       -       1692\n";
+  o<<"  5 Reallocated_Sector_Ct   0x0033   200   200   140    Pre-fail  Always       -       0\n";
+  o<<"  7 Seek_Error_Rate         0x002e   200   200   000    Old_age   Always       -       "<<(index * 5)<<"\n";
+  o<<"  9 Power_On_Hours          0x0032   077   077   000    Old_age   Always       -       17078\n";
+  o<<" 10 Spin_Retry_Count        0x0032   100   100   000    Old_age   Always       -       0\n";
+  o<<" 11 Calibration_Retry_Count 0x0032   100   100   000    Old_age   Always       -       0\n";
+  o<<" 12 Power_Cycle_Count       0x0032   099   099   000    Old_age   Always       -       1605\n";
+  o<<"192 Power-Off_Retract_Count 0x0032   200   200   000    Old_age   Always       -       93\n";
+  o<<"193 Load_Cycle_Count        0x0032   200   200   000    Old_age   Always       -       1614\n";
+  o<<"194 Temperature_Celsius     0x0022   122   087   000    Old_age   Always       -       21\n";
+  o<<"196 Reallocated_Event_Count 0x0032   200   200   000    Old_age   Always       -       0\n";
+  o<<"197 Current_Pending_Sector  0x0032   200   200   000    Old_age   Always       -       0\n";
+  o<<"198 Offline_Uncorrectable   0x0030   200   200   000    Old_age   Offline      -       "<<(index * 7)<<"\n";
+  o<<"199 UDMA_CRC_Error_Count    0x0032   200   200   000    Old_age   Always       -       0\n";
+  o<<"200 Multi_Zone_Error_Rate   0x0008   200   200   000    Old_age   Offline      -       0\n";
+  o<<"\n";
+  return o.str();
+}
+
+std::string GenerateBtrfsDeviceStatsOutput(const std::vector<cDevice>& devices)
+{
+  std::ostringstream o;
+  size_t value = 0;
+  for (auto& device : devices) {
+    o<<"["<<device.sPath<<"].write_io_errs    "<<value++<<"\n";
+    o<<"["<<device.sPath<<"].read_io_errs     "<<value++<<"\n";
+    o<<"["<<device.sPath<<"].flush_io_errs    "<<value++<<"\n";
+    o<<"["<<device.sPath<<"].corruption_errs  "<<value++<<"\n";
+    o<<"["<<device.sPath<<"].generation_errs  "<<value++<<"\n";
+  }
+  return o.str();
+}
+
+cMountStats GenerateMountStats(const std::vector<cDevice>& devices)
+{
+  cMountStats mountStats;
+  mountStats.sMountPoint = "/data1";
+  mountStats.nFreeBytes = 567 * size_t(1000000000); // 567 GB
+  mountStats.nTotalBytes = 1234 * size_t(1000000000); // 1.234 TB
+
+  size_t value = 0;
+  for (auto& device : devices) {
+    cDriveStats driveStats;
+    driveStats.sName = device.sName;
+    driveStats.bIsPresent = true;
+    driveStats.smartCtlStats.nRaw_Read_Error_Rate = value++;
+    driveStats.smartCtlStats.nSeek_Error_Rate = value++;
+    driveStats.smartCtlStats.nOffline_Uncorrectable = value++;
+    mountStats.mapDrivePathToDriveStats[device.sPath] = driveStats;
+  }
+
+  return mountStats;
+}
+
+cBtrfsVolumeStats GenerateBtrfsVolumeStats(const std::vector<cDevice>& devices)
+{
+  cBtrfsVolumeStats btrfsVolumeStats;
+
+  size_t value = 0;
+  for (auto& device : devices) {
+    cBtrfsDriveStats btrfsDriveStats;
+    btrfsDriveStats.sName = device.sName;
+    btrfsDriveStats.nWrite_io_errs = value++;
+    btrfsDriveStats.nRead_io_errs = value++;
+    btrfsDriveStats.nFlush_io_errs = value++;
+    btrfsDriveStats.nCorruption_errs = value++;
+    btrfsDriveStats.nGeneration_errs = value++;
+    btrfsVolumeStats.mapDrivePathToBtrfsDriveStats[device.sPath] = btrfsDriveStats;
+  }
+
+  return btrfsVolumeStats;
+}
+
+std::string GenerateSettingsJSON(const std::vector<cDevice>& devices)
+{
+  std::ostringstream o;
+  o<<"{\n";
+  o<<"  \"settings\": {\n";
+  o<<"    \"groups\": [\n";
+  o<<"      {\n";
+  o<<"        \"type\": \"btrfs\",\n";
+  o<<"        \"mount_point\": \"/data1\",\n";
+  o<<"        \"devices\": [\n";
+  for (size_t i = 0; i < devices.size(); i++) {
+    o<<"          { \"name\": \""<<devices[i].sName<<"\", \"path\": \""<<devices[i].sPath<<"\" }"<<((i + 1 < devices.size()) ? "," : "")<<"\n";
+  }
+  o<<"        ]\n";
+  o<<"      }\n";
+  o<<"    ]\n";
+  o<<"  }\n";
+  o<<"}\n";
+  return o.str();
+}
+
+}
+
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "settings.h"
+#include "stats.h"
+
+namespace lumberjill {
+
+namespace bench {
+
+// Device counts that every scaled benchmark is run at
+constexpr int64_t SMALL_DEVICE_COUNT = 1;
+constexpr int64_t MEDIUM_DEVICE_COUNT = 100;
+constexpr int64_t LARGE_DEVICE_COUNT = 10000;
+
+// Generate a list of fake devices named "Bench 0", "Bench 1", ... with paths "/dev/bench0", "/dev/bench1", ...
+std::vector<cDevice> GenerateDevices(size_t nDevices);
+
+// Generate the output of "smartctl -A /dev/benchN" for one drive, the raw values are derived from the index
+std::string GenerateSmartCtlOutput(size_t index);
+
+// Generate the output of "btrfs device stats /data1" for a volume made up of these devices
+std::string GenerateBtrfsDeviceStatsOutput(const std::vector<cDevice>& devices);
+
+// Generate mount stats with fully populated smartctl stats for each device
+cMountStats GenerateMountStats(const std::vector<cDevice>& devices);
+
+// Generate btrfs stats with every counter populated for each device
+cBtrfsVolumeStats GenerateBtrfsVolumeStats(const std::vector<cDevice>& devices);
+
+// Generate a settings.json file with a single btrfs group containing these devices
+std::string GenerateSettingsJSON(const std::vector<cDevice>& devices);
+
+}
+
+}
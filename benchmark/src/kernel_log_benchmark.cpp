@@ -0,0 +1,106 @@
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "kernel_log.h"
+
+namespace {
+
+// A busy storage server's kernel log is mostly noise, with the odd storage error mixed in
+const std::vector<std::string_view> SAMPLE_MESSAGES = {
+  "usb 1-4: new high-speed USB device number 5 using xhci_hcd",
+  "EXT4-fs (sda2): mounted filesystem with ordered data mode. Quota mode: none.",
+  "IPv6: ADDRCONF(NETDEV_CHANGE): eno1: link becomes ready",
+  "audit: type=1400 audit(1700000000.123:456): apparmor=\"STATUS\" operation=\"profile_replace\" name=\"/usr/sbin/ntpd\" pid=1234 comm=\"apparmor_parser\"",
+  "igb 0000:03:00.0 eno1: igb: eno1 NIC Link is Up 1000 Mbps Full Duplex, Flow Control: RX/TX",
+  "BTRFS info (device sdb): scrub: started on devid 1",
+  "sd 2:0:0:0: [sdc] 7814037168 512-byte logical blocks: (4.00 TB/3.64 TiB)",
+  "nf_conntrack: default automatic helper assignment has been turned off for security reasons",
+  "perf: interrupt took too long (2503 > 2500), lowering kernel.perf_event_max_sample_rate to 79800",
+  "ata3.00: exception Emask 0x0 SAct 0x800000 SErr 0x0 action 0x0",
+  "systemd-journald[321]: Received client request to flush runtime journal.",
+  "kauditd_printk_skb: 12 callbacks suppressed",
+  "I/O error, dev sdc, sector 1953520 op 0x0:(READ) flags 0x0 phys_seg 1 prio class 0",
+  "BTRFS info (device sdb): scrub: finished on devid 1 with status: 0",
+  "TCP: request_sock_TCP: Possible SYN flooding on port 22. Sending cookies.",
+  "nvme nvme0: I/O 24 QID 1 timeout, aborting",
+};
+
+// At least this much text, so that the benchmark measures the scan and not the loop overhead
+const size_t CORPUS_SIZE_BYTES = 16 * 1024 * 1024;
+
+std::vector<std::string> GenerateCorpus()
+{
+  std::vector<std::string> messages;
+  size_t nBytes = 0;
+  for (size_t i = 0; nBytes < CORPUS_SIZE_BYTES; i++) {
+    std::string sMessage(SAMPLE_MESSAGES[i % SAMPLE_MESSAGES.size()]);
+    sMessage += " seq=" + std::to_string(i);
+    nBytes += sMessage.length();
+    messages.push_back(sMessage);
+  }
+
+  return messages;
+}
+
+size_t GetCorpusSizeBytes(const std::vector<std::string>& messages)
+{
+  size_t nBytes = 0;
+  for (auto& sMessage : messages) {
+    nBytes += sMessage.length();
+  }
+
+  return nBytes;
+}
+
+void BM_KernelErrorMatcher(benchmark::State& state)
+{
+  // Every message goes through the single pass matcher
+  const std::vector<std::string> messages = GenerateCorpus();
+  const lumberjill::cKernelErrorMatcher matcher;
+
+  for (auto _ : state) {
+    size_t nMatches = 0;
+    lumberjill::cKernelError error;
+    for (auto& sMessage : messages) {
+      if (matcher.Match(sMessage, error)) nMatches++;
+    }
+    benchmark::DoNotOptimize(nMatches);
+  }
+
+  state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(messages.size()));
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(GetCorpusSizeBytes(messages)));
+}
+
+void BM_KernelErrorNaiveFind(benchmark::State& state)
+{
+  // The obvious alternative, search each message once for every pattern, for comparison
+  const std::vector<std::string> messages = GenerateCorpus();
+  const std::vector<std::string_view> patterns = {
+    "I/O error, dev ", "Buffer I/O error on dev ", "critical medium error, dev ", "Sense Key : Medium Error", "exception Emask", "hard resetting link",
+    "timing out command", " timeout, aborting", "I/O Cmd(", "BTRFS error (device ", "BTRFS critical (device ",
+  };
+
+  for (auto _ : state) {
+    size_t nMatches = 0;
+    for (auto& sMessage : messages) {
+      for (auto& pattern : patterns) {
+        if (sMessage.find(pattern) != std::string::npos) {
+          nMatches++;
+          break;
+        }
+      }
+    }
+    benchmark::DoNotOptimize(nMatches);
+  }
+
+  state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(messages.size()));
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(GetCorpusSizeBytes(messages)));
+}
+
+}
+
+BENCHMARK(BM_KernelErrorMatcher)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_KernelErrorNaiveFind)->Unit(benchmark::kMillisecond);
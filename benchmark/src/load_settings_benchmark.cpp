@@ -0,0 +1,53 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+
+#include "settings.h"
+
+#include "fixtures.h"
+
+namespace {
+
+void BM_LoadFromFile(benchmark::State& state)
+{
+  const std::vector<lumberjill::cDevice> devices = lumberjill::bench::GenerateDevices(size_t(state.range(0)));
+
+  char szFilePath[] = "/tmp/lumber-jill-bench-settings-XXXXXX";
+  const int fd = mkstemp(szFilePath);
+  if (fd < 0) {
+    state.SkipWithError("Failed to create temporary settings file");
+    return;
+  }
+  close(fd);
+
+  {
+    std::ofstream f(szFilePath);
+    f<<lumberjill::bench::GenerateSettingsJSON(devices);
+  }
+
+  lumberjill::cSettings settings;
+
+  for (auto _ : state) {
+    if (!settings.LoadFromFile(szFilePath)) {
+      state.SkipWithError("Failed to load settings file");
+      break;
+    }
+    benchmark::DoNotOptimize(settings.GetGroups().data());
+  }
+
+  unlink(szFilePath);
+
+  state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(devices.size()));
+}
+
+}
+
+// NOTE: The large device count produces a settings file bigger than the maximum size cSettings::LoadFromFile accepts, so it is not benchmarked
+BENCHMARK(BM_LoadFromFile)->Arg(lumberjill::bench::SMALL_DEVICE_COUNT)->Arg(lumberjill::bench::MEDIUM_DEVICE_COUNT);
@@ -0,0 +1,93 @@
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+
+#include <zlib.h>
+
+#include "log_analyzer.h"
+#include "stats.h"
+
+#include "fixtures.h"
+
+namespace {
+
+// About what a busy server's syslog looks like, most lines aren't ours
+const size_t CORPUS_BYTES = 64 * 1024 * 1024;
+const size_t NOISE_LINES_PER_RECORD = 50;
+
+std::string GenerateCorpus(size_t nDevices)
+{
+  const std::vector<lumberjill::cDevice> devices = lumberjill::bench::GenerateDevices(nDevices);
+  const lumberjill::cMountStats mountStats = lumberjill::bench::GenerateMountStats(devices);
+  const lumberjill::cBtrfsVolumeStats btrfsVolumeStats = lumberjill::bench::GenerateBtrfsVolumeStats(devices);
+
+  const std::string sDriveRecord = "Oct 19 08:15:02 nas1 lumber-jill[4242]: Mount " + mountStats.sMountPoint + " drive stats json @cee: " + lumberjill::GetJSONMountStats(mountStats) + "\n";
+  const std::string sBtrfsRecord = "Oct 19 08:15:02 nas1 lumber-jill[4242]: Mount " + mountStats.sMountPoint + " btrfs stats json @cee: " + lumberjill::GetJSONBtrfsStats(mountStats, btrfsVolumeStats) + "\n";
+  const std::string sNoise[] = {
+    "Oct 19 08:15:02 nas1 sshd[999]: Accepted publickey for backup@nas1 from 10.0.0.2 port 50022 ssh2\n",
+    "Oct 19 08:15:02 nas1 systemd[1]: Started Session 4242 of User backup.\n",
+    "Oct 19 08:15:02 nas1 kernel: [123456.789012] IPv4: martian source 10.0.0.255 from 10.0.0.7, on dev eth0\n",
+    "Oct 19 08:15:02 nas1 postfix/qmgr[1234]: 4F3A21E0C1: from=<root@nas1>, size=1024, nrcpt=1 (queue active)\n",
+    "Oct 19 08:15:02 nas1 CRON[31337]: (root) CMD (command -v debian-sa1 > /dev/null && debian-sa1 1 1)\n",
+  };
+
+  std::string sCorpus;
+  sCorpus.reserve(CORPUS_BYTES + sDriveRecord.length() + sBtrfsRecord.length());
+  size_t i = 0;
+  while (sCorpus.length() < CORPUS_BYTES) {
+    sCorpus += sNoise[i % (sizeof(sNoise) / sizeof(sNoise[0]))];
+    i++;
+    if ((i % NOISE_LINES_PER_RECORD) == 0) {
+      sCorpus += sDriveRecord;
+      sCorpus += sBtrfsRecord;
+    }
+  }
+
+  return sCorpus;
+}
+
+// Scanning for records and parsing them, bytes per second is the scan throughput
+void BM_LogAnalyzerBuffer(benchmark::State& state)
+{
+  const std::string sCorpus = GenerateCorpus(size_t(state.range(0)));
+
+  for (auto _ : state) {
+    lumberjill::cLogAnalyzer analyzer;
+    analyzer.AnalyzeBuffer(sCorpus, 0);
+    benchmark::DoNotOptimize(analyzer.GetAnalysis().nRecords);
+  }
+
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(sCorpus.length()));
+}
+
+// A rotated file, decompressing is the bottleneck
+void BM_LogAnalyzerGzipFile(benchmark::State& state)
+{
+  const std::string sCorpus = GenerateCorpus(size_t(state.range(0)));
+
+  const std::filesystem::path path = std::filesystem::temp_directory_path() / ("lumber-jill-bench-syslog-" + std::to_string(getpid()) + ".gz");
+  gzFile file = gzopen(path.c_str(), "wb");
+  gzwrite(file, sCorpus.data(), unsigned(sCorpus.length()));
+  gzclose(file);
+
+  for (auto _ : state) {
+    lumberjill::cLogAnalyzer analyzer;
+    analyzer.AnalyzeFile(path.string());
+    benchmark::DoNotOptimize(analyzer.GetAnalysis().nRecords);
+  }
+
+  std::error_code ec;
+  std::filesystem::remove(path, ec);
+
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(sCorpus.length()));
+}
+
+}
+
+BENCHMARK(BM_LogAnalyzerBuffer)->Arg(lumberjill::bench::SMALL_DEVICE_COUNT)->Arg(lumberjill::bench::MEDIUM_DEVICE_COUNT)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LogAnalyzerGzipFile)->Arg(lumberjill::bench::SMALL_DEVICE_COUNT)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,36 @@
+#include <cstring>
+
+#include <string>
+#include <vector>
+
+// Google benchmark headers
+#include <benchmark/benchmark.h>
+
+int main(int argc, char** argv)
+{
+  // Write JSON results by default so that runs can be compared across commits with Google benchmark's tools/compare.py
+  bool bHasOutputFile = false;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--benchmark_out=", strlen("--benchmark_out=")) == 0) bHasOutputFile = true;
+  }
+
+  std::string sOutputFile = "--benchmark_out=bench_output.json";
+  std::string sOutputFormat = "--benchmark_out_format=json";
+
+  std::vector<char*> arguments(argv, argv + argc);
+  if (!bHasOutputFile) {
+    arguments.push_back(sOutputFile.data());
+    arguments.push_back(sOutputFormat.data());
+  }
+
+  int nArguments = int(arguments.size());
+  arguments.push_back(nullptr);
+
+  ::benchmark::Initialize(&nArguments, arguments.data());
+  if (::benchmark::ReportUnrecognizedArguments(nArguments, arguments.data())) return 1;
+
+  ::benchmark::RunSpecifiedBenchmarks();
+  ::benchmark::Shutdown();
+
+  return 0;
+}
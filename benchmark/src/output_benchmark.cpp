@@ -0,0 +1,89 @@
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+
+#include "output.h"
+#include "remote_sink.h"
+#include "stats.h"
+
+#include "fixtures.h"
+
+namespace {
+
+// What a collector used to pay for each record, serialising it and writing it out before carrying on
+void BM_OutputSynchronous(benchmark::State& state)
+{
+  const std::vector<lumberjill::cDevice> devices = lumberjill::bench::GenerateDevices(size_t(state.range(0)));
+  const lumberjill::cMountStats mountStats = lumberjill::bench::GenerateMountStats(devices);
+
+  const int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+  for (auto _ : state) {
+    const std::string sLine = lumberjill::GetJSONMountStats(mountStats) + "\n";
+    benchmark::DoNotOptimize(write(fd, sLine.data(), sLine.length()));
+  }
+
+  close(fd);
+
+  state.SetItemsProcessed(int64_t(state.iterations()));
+}
+
+// What a collector pays with the pipeline, copying the stats into a record and queueing it, the sink thread does the rest
+void BM_OutputPipelinePush(benchmark::State& state)
+{
+  const std::vector<lumberjill::cDevice> devices = lumberjill::bench::GenerateDevices(size_t(state.range(0)));
+  const lumberjill::cMountStats mountStats = lumberjill::bench::GenerateMountStats(devices);
+
+  lumberjill::cOutputSettings settings;
+  settings.bStdout = false;
+  settings.bSyslog = false;
+  settings.sFilePath = "/dev/null";
+  settings.policy = lumberjill::OUTPUT_POLICY::DROP_OLDEST;
+
+  lumberjill::cOutputPipeline pipeline;
+  pipeline.Start(settings);
+
+  for (auto _ : state) {
+    lumberjill::cOutputRecord record;
+    record.sMessage = "Mount /data1 drive stats";
+    record.sCoalesceKey = "mount /data1";
+    record.fnGetJSON = [mountStats]() { return lumberjill::GetJSONMountStats(mountStats); };
+    pipeline.Push(std::move(record));
+  }
+
+  pipeline.Stop();
+  lumberjill::cOutputStats stats;
+  pipeline.GetStatsAndReset(stats);
+  state.counters["dropped"] = double(stats.nDropped);
+
+  state.SetItemsProcessed(int64_t(state.iterations()));
+}
+
+// Wrapping an already serialised record for the remote collector, this is on top of the serialisation that every sink shares
+void BM_OutputRemoteFrame(benchmark::State& state)
+{
+  const std::vector<lumberjill::cDevice> devices = lumberjill::bench::GenerateDevices(size_t(state.range(0)));
+  const std::string sMessage = "Mount /data1 drive stats json @cee: " + lumberjill::GetJSONMountStats(lumberjill::bench::GenerateMountStats(devices));
+  const std::chrono::system_clock::time_point time = std::chrono::system_clock::now();
+
+  size_t nBytes = 0;
+  for (auto _ : state) {
+    const std::string sFrame = lumberjill::GetOctetCountedFrame(lumberjill::FormatRFC5424Message(134, time, "nas1", "lumber-jill", 1234, sMessage));
+    nBytes += sFrame.length();
+    benchmark::DoNotOptimize(sFrame.data());
+  }
+
+  state.SetItemsProcessed(int64_t(state.iterations()));
+  state.SetBytesProcessed(int64_t(nBytes));
+}
+
+}
+
+BENCHMARK(BM_OutputSynchronous)->Arg(lumberjill::bench::SMALL_DEVICE_COUNT)->Arg(lumberjill::bench::MEDIUM_DEVICE_COUNT);
+BENCHMARK(BM_OutputPipelinePush)->Arg(lumberjill::bench::SMALL_DEVICE_COUNT)->Arg(lumberjill::bench::MEDIUM_DEVICE_COUNT);
+BENCHMARK(BM_OutputRemoteFrame)->Arg(lumberjill::bench::SMALL_DEVICE_COUNT)->Arg(lumberjill::bench::MEDIUM_DEVICE_COUNT);
@@ -0,0 +1,83 @@
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "btrfs.h"
+#include "smartctl.h"
+#include "utils.h"
+
+#include "fixtures.h"
+
+namespace {
+
+void BM_ParseDriveSmartControlData(benchmark::State& state)
+{
+  // One smartctl output per device, parsed one after the other like a full sweep
+  const size_t nDevices = size_t(state.range(0));
+  std::vector<std::string> outputs;
+  outputs.reserve(nDevices);
+  size_t nBytes = 0;
+  for (size_t i = 0; i < nDevices; i++) {
+    outputs.push_back(lumberjill::bench::GenerateSmartCtlOutput(i));
+    nBytes += outputs.back().length();
+  }
+
+  lumberjill::cSmartCtlStats smartctlStats;
+
+  for (auto _ : state) {
+    for (auto& output : outputs) {
+      const bool result = lumberjill::smartctl::ParseDriveSmartControlData(output, smartctlStats);
+      benchmark::DoNotOptimize(result);
+      benchmark::DoNotOptimize(smartctlStats);
+    }
+  }
+
+  state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(nDevices));
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(nBytes));
+}
+
+void BM_ParseBtrfsVolumeDeviceStats(benchmark::State& state)
+{
+  const std::vector<lumberjill::cDevice> devices = lumberjill::bench::GenerateDevices(size_t(state.range(0)));
+  const std::string output = lumberjill::bench::GenerateBtrfsDeviceStatsOutput(devices);
+
+  lumberjill::cBtrfsVolumeStats btrfsVolumeStats;
+
+  for (auto _ : state) {
+    const bool result = lumberjill::btrfs::ParseBtrfsVolumeDeviceStats(output, devices, btrfsVolumeStats);
+    benchmark::DoNotOptimize(result);
+    benchmark::DoNotOptimize(btrfsVolumeStats);
+  }
+
+  state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(devices.size()));
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(output.length()));
+}
+
+void BM_StringParseValue(benchmark::State& state)
+{
+  // One raw value per device
+  const size_t nValues = size_t(state.range(0));
+  std::vector<std::string> values;
+  values.reserve(nValues);
+  for (size_t i = 0; i < nValues; i++) {
+    values.push_back(std::to_string(i * 7919));
+  }
+
+  for (auto _ : state) {
+    for (auto& text : values) {
+      size_t value = 0;
+      const bool result = lumberjill::StringParseValue(text, value);
+      benchmark::DoNotOptimize(result);
+      benchmark::DoNotOptimize(value);
+    }
+  }
+
+  state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(nValues));
+}
+
+}
+
+BENCHMARK(BM_ParseDriveSmartControlData)->Arg(lumberjill::bench::SMALL_DEVICE_COUNT)->Arg(lumberjill::bench::MEDIUM_DEVICE_COUNT)->Arg(lumberjill::bench::LARGE_DEVICE_COUNT);
+BENCHMARK(BM_ParseBtrfsVolumeDeviceStats)->Arg(lumberjill::bench::SMALL_DEVICE_COUNT)->Arg(lumberjill::bench::MEDIUM_DEVICE_COUNT)->Arg(lumberjill::bench::LARGE_DEVICE_COUNT);
+BENCHMARK(BM_StringParseValue)->Arg(lumberjill::bench::SMALL_DEVICE_COUNT)->Arg(lumberjill::bench::MEDIUM_DEVICE_COUNT)->Arg(lumberjill::bench::LARGE_DEVICE_COUNT);
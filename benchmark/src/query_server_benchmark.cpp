@@ -0,0 +1,106 @@
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+
+#include "query_server.h"
+#include "snapshot.h"
+
+#include "fixtures.h"
+
+namespace {
+
+lumberjill::cStatsSnapshot GenerateSnapshot(size_t nDevices)
+{
+  const std::vector<lumberjill::cDevice> devices = lumberjill::bench::GenerateDevices(nDevices);
+
+  lumberjill::cGroupStats group;
+  group.mountStats = lumberjill::bench::GenerateMountStats(devices);
+  group.bHasBtrfsStats = true;
+  group.btrfsVolumeStats = lumberjill::bench::GenerateBtrfsVolumeStats(devices);
+
+  lumberjill::cStatsSnapshot snapshot;
+  snapshot.nTimestamp = 1700000000;
+  snapshot.groups.push_back(group);
+  return snapshot;
+}
+
+// One server shared by every benchmark thread, started by the first thread and stopped by the first thread when they are all done
+lumberjill::cSnapshotStore benchStore;
+lumberjill::cQueryServer benchServer(benchStore);
+
+std::string GetBenchSocketPath()
+{
+  return "/tmp/lumber-jill-bench-" + std::to_string(getpid()) + "/query.sock";
+}
+
+void BM_QueryServerSnapshot(benchmark::State& state)
+{
+  const std::string sSocketPath = GetBenchSocketPath();
+  if (state.thread_index() == 0) {
+    benchStore.Publish(GenerateSnapshot(lumberjill::bench::MEDIUM_DEVICE_COUNT));
+    if (!benchServer.Start(sSocketPath)) {
+      state.SkipWithError("Failed to start the query server");
+    }
+  }
+
+  // The response is the prebuilt OpenMetrics text so this is mostly the cost of the connection
+  lumberjill::cQueryRequest request;
+  request.format = lumberjill::QUERY_FORMAT::OPENMETRICS;
+
+  size_t nBytes = 0;
+  for (auto _ : state) {
+    std::string sResponse;
+    if (!lumberjill::QueryDaemon(sSocketPath, request, sResponse)) {
+      state.SkipWithError("Query failed");
+      break;
+    }
+    nBytes += sResponse.length();
+  }
+
+  state.SetItemsProcessed(int64_t(state.iterations()));
+  state.SetBytesProcessed(int64_t(nBytes));
+
+  if (state.thread_index() == 0) {
+    benchServer.Stop();
+    rmdir(sSocketPath.substr(0, sSocketPath.find_last_of('/')).c_str());
+  }
+}
+
+void BM_QueryServerDevice(benchmark::State& state)
+{
+  const std::string sSocketPath = GetBenchSocketPath();
+  if (state.thread_index() == 0) {
+    benchStore.Publish(GenerateSnapshot(lumberjill::bench::MEDIUM_DEVICE_COUNT));
+    if (!benchServer.Start(sSocketPath)) {
+      state.SkipWithError("Failed to start the query server");
+    }
+  }
+
+  // A single device response is built on demand from the snapshot
+  lumberjill::cQueryRequest request;
+  request.sDevicePath = "/dev/bench50";
+
+  for (auto _ : state) {
+    std::string sResponse;
+    if (!lumberjill::QueryDaemon(sSocketPath, request, sResponse)) {
+      state.SkipWithError("Query failed");
+      break;
+    }
+    benchmark::DoNotOptimize(sResponse.data());
+  }
+
+  state.SetItemsProcessed(int64_t(state.iterations()));
+
+  if (state.thread_index() == 0) {
+    benchServer.Stop();
+    rmdir(sSocketPath.substr(0, sSocketPath.find_last_of('/')).c_str());
+  }
+}
+
+}
+
+BENCHMARK(BM_QueryServerSnapshot)->Threads(1)->Threads(8)->UseRealTime();
+BENCHMARK(BM_QueryServerDevice)->Threads(1)->Threads(8)->UseRealTime();
@@ -0,0 +1,82 @@
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+
+#include "result_cache.h"
+
+#include "fixtures.h"
+
+namespace {
+
+void BM_ResultCacheLoadAndGet(benchmark::State& state)
+{
+  // What a --max-age run does when every drive is fresh, map the cache and look up each drive
+  const std::vector<lumberjill::cDevice> devices = lumberjill::bench::GenerateDevices(size_t(state.range(0)));
+  const lumberjill::cMountStats mountStats = lumberjill::bench::GenerateMountStats(devices);
+
+  const std::string sFilePath = (std::filesystem::temp_directory_path() / ("lumber-jill-bench-" + std::to_string(getpid()) + ".cache")).string();
+  const int64_t nNow = 1700000000;
+
+  {
+    lumberjill::cResultCache cache;
+    for (auto& item : mountStats.mapDrivePathToDriveStats) {
+      cache.Set(item.first, nNow, item.second.smartCtlStats);
+    }
+    if (!cache.Save(sFilePath)) {
+      state.SkipWithError("Failed to save the cache");
+      return;
+    }
+  }
+
+  for (auto _ : state) {
+    lumberjill::cResultCache cache;
+    cache.Load(sFilePath);
+
+    size_t nFound = 0;
+    lumberjill::cSmartCtlStats smartctlStats;
+    for (auto& device : devices) {
+      if (cache.Get(device.sPath, nNow, 60, smartctlStats)) nFound++;
+    }
+    benchmark::DoNotOptimize(nFound);
+  }
+
+  state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(devices.size()));
+
+  std::error_code ec;
+  std::filesystem::remove(sFilePath, ec);
+}
+
+void BM_ResultCacheSave(benchmark::State& state)
+{
+  const std::vector<lumberjill::cDevice> devices = lumberjill::bench::GenerateDevices(size_t(state.range(0)));
+  const lumberjill::cMountStats mountStats = lumberjill::bench::GenerateMountStats(devices);
+
+  const std::string sFilePath = (std::filesystem::temp_directory_path() / ("lumber-jill-bench-" + std::to_string(getpid()) + ".cache")).string();
+
+  lumberjill::cResultCache cache;
+  for (auto& item : mountStats.mapDrivePathToDriveStats) {
+    cache.Set(item.first, 1700000000, item.second.smartCtlStats);
+  }
+
+  for (auto _ : state) {
+    if (!cache.Save(sFilePath)) {
+      state.SkipWithError("Failed to save the cache");
+      break;
+    }
+  }
+
+  state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(devices.size()));
+
+  std::error_code ec;
+  std::filesystem::remove(sFilePath, ec);
+}
+
+}
+
+BENCHMARK(BM_ResultCacheLoadAndGet)->Arg(lumberjill::bench::MEDIUM_DEVICE_COUNT)->Arg(lumberjill::bench::LARGE_DEVICE_COUNT);
+BENCHMARK(BM_ResultCacheSave)->Arg(lumberjill::bench::MEDIUM_DEVICE_COUNT)->Arg(lumberjill::bench::LARGE_DEVICE_COUNT);
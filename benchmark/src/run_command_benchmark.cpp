@@ -0,0 +1,46 @@
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "run_command.h"
+
+namespace {
+
+void BM_RunCommandTrue(benchmark::State& state)
+{
+  std::string out_standard;
+  std::string out_error;
+
+  for (auto _ : state) {
+    if (!lumberjill::RunCommand("/bin/true", std::vector<std::string> {}, out_standard, out_error)) {
+      state.SkipWithError("Failed to run /bin/true");
+      break;
+    }
+  }
+
+  state.SetItemsProcessed(int64_t(state.iterations()));
+}
+
+void BM_RunCommandLargeOutput(benchmark::State& state)
+{
+  // Roughly the output of smartctl -x for this many devices
+  const size_t nBytes = size_t(state.range(0));
+
+  std::string out_standard;
+  std::string out_error;
+
+  for (auto _ : state) {
+    if (!lumberjill::RunCommand("/usr/bin/head", std::vector<std::string> { "-c", std::to_string(nBytes), "/dev/zero" }, out_standard, out_error) || (out_standard.length() != nBytes)) {
+      state.SkipWithError("Failed to run /usr/bin/head");
+      break;
+    }
+  }
+
+  state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(nBytes));
+}
+
+}
+
+BENCHMARK(BM_RunCommandTrue)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_RunCommandLargeOutput)->Unit(benchmark::kMicrosecond)->Arg(64 * 1024)->Arg(1024 * 1024)->Arg(16 * 1024 * 1024);
@@ -0,0 +1,153 @@
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "snapshot.h"
+
+#include "fixtures.h"
+
+namespace {
+
+lumberjill::cStatsSnapshot GenerateSnapshot()
+{
+  const std::vector<lumberjill::cDevice> devices = lumberjill::bench::GenerateDevices(lumberjill::bench::MEDIUM_DEVICE_COUNT);
+
+  lumberjill::cGroupStats group;
+  group.mountStats = lumberjill::bench::GenerateMountStats(devices);
+  group.bHasBtrfsStats = true;
+  group.btrfsVolumeStats = lumberjill::bench::GenerateBtrfsVolumeStats(devices);
+
+  lumberjill::cStatsSnapshot snapshot;
+  snapshot.groups.push_back(group);
+  return snapshot;
+}
+
+// The obvious alternative, a mutex around the latest snapshot, for comparison
+class cMutexSnapshotStore {
+public:
+  void Publish(const std::shared_ptr<const lumberjill::cPublishedSnapshot>& published)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    latest = published;
+  }
+
+  std::shared_ptr<const lumberjill::cPublishedSnapshot> GetLatest() const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return latest;
+  }
+
+private:
+  mutable std::mutex mutex;
+  std::shared_ptr<const lumberjill::cPublishedSnapshot> latest;
+};
+
+// Readers hammer the store while a collector publishes as fast as it can, which is far more often than a real collector ever would
+lumberjill::cSnapshotStore benchStore;
+cMutexSnapshotStore benchMutexStore;
+std::atomic<bool> bIsPublishing(false);
+std::thread publisher;
+
+template <class P>
+void StartPublisher(P publish)
+{
+  bIsPublishing = true;
+  publisher = std::thread([publish]() {
+    while (bIsPublishing.load(std::memory_order_relaxed)) {
+      publish();
+    }
+  });
+}
+
+void StopPublisher()
+{
+  bIsPublishing = false;
+  publisher.join();
+}
+
+void BM_SnapshotStoreGetLatest(benchmark::State& state)
+{
+  if (state.thread_index() == 0) {
+    benchStore.Publish(GenerateSnapshot());
+
+    // Only the swap is measured here, the snapshot is serialised once up front
+    const lumberjill::cStatsSnapshot snapshot = GenerateSnapshot();
+    StartPublisher([snapshot]() {
+      lumberjill::cStatsSnapshot copy = snapshot;
+      benchStore.Publish(std::move(copy));
+    });
+  }
+
+  for (auto _ : state) {
+    const std::shared_ptr<const lumberjill::cPublishedSnapshot> latest = benchStore.GetLatest();
+    benchmark::DoNotOptimize(latest->sJSON.data());
+  }
+
+  state.SetItemsProcessed(int64_t(state.iterations()));
+
+  if (state.thread_index() == 0) {
+    StopPublisher();
+  }
+}
+
+void BM_SnapshotReaderGet(benchmark::State& state)
+{
+  if (state.thread_index() == 0) {
+    benchStore.Publish(GenerateSnapshot());
+
+    const lumberjill::cStatsSnapshot snapshot = GenerateSnapshot();
+    StartPublisher([snapshot]() {
+      lumberjill::cStatsSnapshot copy = snapshot;
+      benchStore.Publish(std::move(copy));
+    });
+  }
+
+  // Each thread has its own reader, like the query server does
+  lumberjill::cSnapshotReader reader(benchStore);
+
+  for (auto _ : state) {
+    const std::shared_ptr<const lumberjill::cPublishedSnapshot>& latest = reader.Get();
+    benchmark::DoNotOptimize(latest->sJSON.data());
+  }
+
+  state.SetItemsProcessed(int64_t(state.iterations()));
+
+  if (state.thread_index() == 0) {
+    StopPublisher();
+  }
+}
+
+void BM_SnapshotStoreGetLatestMutex(benchmark::State& state)
+{
+  if (state.thread_index() == 0) {
+    std::shared_ptr<const lumberjill::cPublishedSnapshot> published = std::make_shared<const lumberjill::cPublishedSnapshot>(GenerateSnapshot());
+    benchMutexStore.Publish(published);
+
+    const lumberjill::cStatsSnapshot snapshot = GenerateSnapshot();
+    StartPublisher([snapshot]() {
+      lumberjill::cStatsSnapshot copy = snapshot;
+      benchMutexStore.Publish(std::make_shared<const lumberjill::cPublishedSnapshot>(std::move(copy)));
+    });
+  }
+
+  for (auto _ : state) {
+    const std::shared_ptr<const lumberjill::cPublishedSnapshot> latest = benchMutexStore.GetLatest();
+    benchmark::DoNotOptimize(latest->sJSON.data());
+  }
+
+  state.SetItemsProcessed(int64_t(state.iterations()));
+
+  if (state.thread_index() == 0) {
+    StopPublisher();
+  }
+}
+
+}
+
+BENCHMARK(BM_SnapshotStoreGetLatest)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(BM_SnapshotReaderGet)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(BM_SnapshotStoreGetLatestMutex)->ThreadRange(1, 8)->UseRealTime();
@@ -0,0 +1,48 @@
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "stats.h"
+
+#include "fixtures.h"
+
+namespace {
+
+void BM_GetJSONMountStats(benchmark::State& state)
+{
+  const std::vector<lumberjill::cDevice> devices = lumberjill::bench::GenerateDevices(size_t(state.range(0)));
+  const lumberjill::cMountStats mountStats = lumberjill::bench::GenerateMountStats(devices);
+
+  size_t nBytes = 0;
+  for (auto _ : state) {
+    const std::string output = lumberjill::GetJSONMountStats(mountStats);
+    nBytes += output.length();
+    benchmark::DoNotOptimize(output.data());
+  }
+
+  state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(devices.size()));
+  state.SetBytesProcessed(int64_t(nBytes));
+}
+
+void BM_GetJSONBtrfsStats(benchmark::State& state)
+{
+  const std::vector<lumberjill::cDevice> devices = lumberjill::bench::GenerateDevices(size_t(state.range(0)));
+  const lumberjill::cMountStats mountStats = lumberjill::bench::GenerateMountStats(devices);
+  const lumberjill::cBtrfsVolumeStats btrfsVolumeStats = lumberjill::bench::GenerateBtrfsVolumeStats(devices);
+
+  size_t nBytes = 0;
+  for (auto _ : state) {
+    const std::string output = lumberjill::GetJSONBtrfsStats(mountStats, btrfsVolumeStats);
+    nBytes += output.length();
+    benchmark::DoNotOptimize(output.data());
+  }
+
+  state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(devices.size()));
+  state.SetBytesProcessed(int64_t(nBytes));
+}
+
+}
+
+BENCHMARK(BM_GetJSONMountStats)->Arg(lumberjill::bench::SMALL_DEVICE_COUNT)->Arg(lumberjill::bench::MEDIUM_DEVICE_COUNT)->Arg(lumberjill::bench::LARGE_DEVICE_COUNT);
+BENCHMARK(BM_GetJSONBtrfsStats)->Arg(lumberjill::bench::SMALL_DEVICE_COUNT)->Arg(lumberjill::bench::MEDIUM_DEVICE_COUNT)->Arg(lumberjill::bench::LARGE_DEVICE_COUNT);
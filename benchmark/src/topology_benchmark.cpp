@@ -0,0 +1,76 @@
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+
+#include <benchmark/benchmark.h>
+
+#include "topology.h"
+
+namespace {
+
+// Create a fake /sys, /dev and mountinfo with nDisks disks, each with one partition, in btrfs file systems of 8 disks each
+std::string CreateFakeMachine(size_t nDisks)
+{
+  char szFolder[] = "/tmp/lumber-jill-bench-topology-XXXXXX";
+  if (mkdtemp(szFolder) == nullptr) return "";
+
+  const std::string sFolder(szFolder);
+  std::error_code ec;
+  std::filesystem::create_directories(sFolder + "/dev/disk/by-id", ec);
+
+  std::ofstream mountinfo(sFolder + "/mountinfo");
+
+  for (size_t i = 0; i < nDisks; i++) {
+    const std::string sDisk = "sd" + std::to_string(i);
+    const std::string sPartition = sDisk + "p1";
+    const std::string sFSID = "fsid-" + std::to_string(i / 8);
+
+    std::filesystem::create_directories(sFolder + "/sys/block/" + sDisk + "/queue", ec);
+    std::filesystem::create_directories(sFolder + "/sys/block/" + sDisk + "/" + sPartition, ec);
+    std::ofstream(sFolder + "/sys/block/" + sDisk + "/queue/rotational")<<"1\n";
+
+    std::filesystem::create_directories(sFolder + "/sys/fs/btrfs/" + sFSID + "/devices", ec);
+    std::ofstream(sFolder + "/sys/fs/btrfs/" + sFSID + "/devices/" + sDisk);
+
+    std::filesystem::create_symlink("../../" + sDisk, sFolder + "/dev/disk/by-id/ata-BENCH_" + std::to_string(i), ec);
+    std::filesystem::create_symlink("../../" + sDisk, sFolder + "/dev/disk/by-id/wwn-0x" + std::to_string(i), ec);
+    std::filesystem::create_symlink("../../" + sPartition, sFolder + "/dev/disk/by-id/ata-BENCH_" + std::to_string(i) + "-part1", ec);
+
+    if ((i % 8) == 0) {
+      mountinfo<<(40 + i)<<" 29 0:"<<(35 + i)<<" / /data"<<(i / 8)<<" rw,relatime shared:24 - btrfs /dev/"<<sDisk<<" rw,space_cache=v2\n";
+    }
+  }
+
+  return sFolder;
+}
+
+void BM_TopologyScan(benchmark::State& state)
+{
+  const size_t nDisks = size_t(state.range(0));
+  const std::string sFolder = CreateFakeMachine(nDisks);
+  if (sFolder.empty()) {
+    state.SkipWithError("Failed to create fake machine");
+    return;
+  }
+
+  lumberjill::cTopology topology(sFolder + "/sys", sFolder + "/dev", sFolder + "/mountinfo");
+
+  for (auto _ : state) {
+    if (!topology.Scan()) {
+      state.SkipWithError("Failed to scan topology");
+      break;
+    }
+    benchmark::DoNotOptimize(topology.GetBlockDevices().data());
+  }
+
+  std::error_code ec;
+  std::filesystem::remove_all(sFolder, ec);
+
+  state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(nDisks));
+}
+
+}
+
+BENCHMARK(BM_TopologyScan)->Unit(benchmark::kMicrosecond)->Arg(1)->Arg(128)->Arg(1024);
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "settings.h"
+#include "stats.h"
+
+namespace lumberjill {
+
+// The metrics that each drive keeps a baseline for
+enum class ANOMALY_METRIC {
+  SMART_RAW_READ_ERROR_RATE,
+  SMART_SEEK_ERROR_RATE,
+  SMART_OFFLINE_UNCORRECTABLE,
+  BTRFS_WRITE_IO_ERRS,
+  BTRFS_READ_IO_ERRS,
+  BTRFS_FLUSH_IO_ERRS,
+  BTRFS_CORRUPTION_ERRS,
+  BTRFS_GENERATION_ERRS,
+  READ_AWAIT_MS,
+  WRITE_AWAIT_MS,
+  UTILISATION_PERCENT,
+  COUNT
+};
+
+constexpr size_t ANOMALY_METRIC_COUNT = size_t(ANOMALY_METRIC::COUNT);
+
+// The name used in the JSON records, such as "read_io_errs"
+const char* GetAnomalyMetricName(ANOMALY_METRIC metric);
+
+// The exponentially weighted mean and variance of one metric of one drive
+// Counters such as read_io_errs are turned into a rate per day first, so the baseline is how fast the counter normally goes up
+// Plain data so that it can be written straight to the state file
+class cAnomalyBaseline {
+public:
+  cAnomalyBaseline() : dLastValue(0.0), nLastTimestamp(0), nSamples(0), bHasLastValue(0), dMean(0.0), dVariance(0.0) {}
+
+  // Add a sample in O(1), returns how many standard deviations above the mean it was, or 0 while there are fewer than nWarmupSamples
+  double Add(double dSample, double dAlpha, double dMinDeviation, size_t nWarmupSamples);
+
+  double dLastValue;       // The previous counter value
+  int64_t nLastTimestamp;  // When the previous counter value was read
+  uint32_t nSamples;
+  uint32_t bHasLastValue;
+  double dMean;
+  double dVariance;
+};
+
+static_assert(sizeof(cAnomalyBaseline) == 40);
+
+// Finds drives whose error counters or latency are rising faster than their own history says they should, or much faster than the other drives in their group
+// The state is a constant size per drive and is kept between runs in a file, so one shot runs from cron build up the same history as the daemon
+class cAnomalyDetector {
+public:
+  cAnomalyDetector();
+  ~cAnomalyDetector();
+
+  // Read the state saved by a previous run, returns false if there isn't any, in which case every drive starts out with an empty baseline
+  bool Load(const std::string& sFilePath);
+  bool Save(const std::string& sFilePath) const;
+
+  bool IsLoaded() const { return bIsLoaded; }
+  size_t GetDriveCount() const { return drives.size(); }
+
+  // Add this collection's samples for each drive in the mount and fill in each drive's anomalies, pBtrfsVolumeStats is nullptr if the mount isn't btrfs
+  void Update(const cAnomalySettings& settings, int64_t nTimestamp, cMountStats& mountStats, const cBtrfsVolumeStats* pBtrfsVolumeStats);
+
+  class cDriveState {
+  public:
+    cDriveState() : nUpdated(0) {}
+
+    int64_t nUpdated;
+    std::array<cAnomalyBaseline, ANOMALY_METRIC_COUNT> baselines;
+  };
+
+private:
+  std::map<std::string, cDriveState> drives;
+  bool bIsLoaded;
+
+private:
+  cAnomalyDetector(const cAnomalyDetector&) = delete;
+  cAnomalyDetector& operator=(const cAnomalyDetector&) = delete;
+};
+
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace lumberjill {
+
+// Reads a set of small long lived files such as sysfs attributes from offset 0, all of them at once
+// By default each file is read with pread, which is the quickest for a few dozen sysfs files
+// With io_uring the files are registered once and each batch of reads is submitted and waited for with a single io_uring_enter, which makes far fewer syscalls but takes longer because the kernel hands sysfs reads to its worker threads
+// If io_uring isn't available, it is disabled with the kernel.io_uring_disabled sysctl or blocked by seccomp for example, pread is used instead
+class cBatchFileReader {
+public:
+  // Each file gets a buffer of nMaxBytes, longer files are cut short
+  explicit cBatchFileReader(size_t nMaxBytes);
+  cBatchFileReader(size_t nMaxBytes, bool bUseIOUring);
+
+  ~cBatchFileReader();
+
+  // Add an open file and return its slot, the file is still owned by the caller and must be removed before it is closed
+  size_t Add(int fd);
+  void Remove(size_t slot);
+
+  // Read the files in these slots, returns the number of syscalls that were made
+  size_t Read(const std::vector<size_t>& slots);
+
+  // The contents of a slot from the last Read that included it, returns false if the read failed
+  // The view is into our buffer and is only valid until the next Read
+  bool GetContents(size_t slot, std::string_view& contents) const;
+
+  // Switch between io_uring and pread, this does nothing if it is already set this way so that a failed io_uring isn't tried again
+  void SetUseIOUring(bool bUseIOUring);
+
+  // Returns true once a Read has been done with io_uring, false before the first Read or if we fell back to pread
+  bool IsUsingIOUring() const;
+
+private:
+  class cRing;
+
+  class cSlot {
+  public:
+    cSlot() : fd(-1), nResult(-1), nRegisteredIndex(0) {}
+
+    int fd;                   // -1 if the slot is free
+    int32_t nResult;          // Bytes read or a negative errno
+    uint32_t nRegisteredIndex;
+  };
+
+  bool SetupRing();
+  size_t RegisterFiles();  // Returns the number of syscalls
+  size_t ReadWithRing(const std::vector<size_t>& slots);
+  size_t ReadWithPread(const std::vector<size_t>& slots);
+
+  const size_t nMaxBytes;
+  bool bWantIOUring;              // What we were asked for
+  bool bUseIOUring;               // Cleared if io_uring turns out not to work
+  bool bAreRegisteredFilesDirty;  // A file has been added or removed since the files were last registered
+
+  std::unique_ptr<cRing> pRing;   // Set up on the first Read so that nothing is done for readers that are never used
+
+  std::vector<cSlot> slots;
+  std::vector<size_t> freeSlots;
+  std::vector<char> buffer;       // nMaxBytes for each slot
+  std::vector<int> registeredFiles;
+
+private:
+  cBatchFileReader(const cBatchFileReader&) = delete;
+  cBatchFileReader& operator=(const cBatchFileReader&) = delete;
+};
+
+}
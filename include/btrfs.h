@@ -15,10 +15,15 @@ namespace btrfs {
 bool ParseBtrfsVolumeDeviceStats(std::string_view view, const std::vector<cDevice>& devices, cBtrfsVolumeStats& btrfsVolumeStats);
 
 // Runs "btrfs device stats /data1" to collect BTRFS stats for a volume
-bool GetBtrfsVolumeDeviceStats(const std::string& sMountPoint, const std::vector<cDevice>& devices, cBtrfsVolumeStats& btrfsVolumeStats);
+bool GetBtrfsVolumeDeviceStats(const std::string& sBtrfsPath, const std::string& sMountPoint, const std::vector<cDevice>& devices, cBtrfsVolumeStats& btrfsVolumeStats);
+
+// Parse the output of "btrfs filesystem usage -b /data1" to get the space that isn't allocated to any chunk yet
+bool ParseBtrfsFilesystemUsage(std::string_view view, size_t& nUnallocatedBytes);
+
+// Runs "btrfs filesystem usage -b /data1" to get the unallocated space on a volume
+bool GetBtrfsFilesystemUsage(const std::string& sBtrfsPath, const std::string& sMountPoint, size_t& nUnallocatedBytes);
 
 // TODO: We could also call "btrfs filesystem show /data1" to get volume and drive sizes and free space
-// TODO: We could also call "btrfs filesystem usage -T /data1" to get volume and drive sizes and free space
 
 }
 
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "stats.h"
+
+namespace lumberjill {
+
+// One subvolume's qgroup as it is in the quota tree, kept in a flat array sorted by id
+class cBtrfsQgroup {
+public:
+  uint64_t nSubvolumeId;
+  uint64_t nReferencedBytes;
+  uint64_t nExclusiveBytes;
+  uint64_t nMaxReferencedBytes;  // 0 if there is no limit
+  uint64_t nMaxExclusiveBytes;
+};
+
+// The key of a btrfs tree item, the search continues from the one after the last item returned
+class cBtrfsSearchKey {
+public:
+  cBtrfsSearchKey() : nObjectId(0), nType(0), nOffset(0) {}
+
+  uint64_t nObjectId;
+  uint32_t nType;
+  uint64_t nOffset;
+};
+
+// Decode nItems items returned by BTRFS_IOC_TREE_SEARCH_V2 from the quota tree
+// Info items for subvolumes are appended to qgroups, which stays sorted because the items come back in key order, limit items are merged into the matching qgroup
+// Returns false if the buffer ends part way through an item
+bool DecodeBtrfsQgroupSearchResult(const uint8_t* pBuffer, size_t nBufferBytes, size_t nItems, std::vector<cBtrfsQgroup>& qgroups, cBtrfsSearchKey& lastKey);
+
+// Pick the nTop subvolumes with the most referenced bytes and the most exclusive bytes, with the change since previous if it isn't empty
+// Both arrays are sorted largest first, the names are left for the caller to fill in
+void GetBtrfsQgroupStats(const std::vector<cBtrfsQgroup>& qgroups, const std::vector<cBtrfsQgroup>& previous, size_t nTop, cBtrfsQgroupStats& qgroupStats);
+
+// Reads the qgroups of btrfs volumes with BTRFS_IOC_TREE_SEARCH_V2 instead of running "btrfs qgroup show", which is slow and prints a line per qgroup
+// The search buffer and the qgroup arrays are reused between collections, so the memory used only depends on the number of subvolumes
+class cBtrfsQgroupCollector {
+public:
+  cBtrfsQgroupCollector();
+  ~cBtrfsQgroupCollector();
+
+  // Read every subvolume's qgroup of the volume mounted at sMountPoint, returns false if quotas aren't enabled or the search failed
+  bool Collect(const std::string& sMountPoint, size_t nTop, cBtrfsQgroupStats& qgroupStats);
+
+private:
+  bool SearchQgroups(int fd, const std::string& sMountPoint, std::vector<cBtrfsQgroup>& qgroups);
+  bool GetSubvolumeName(int fd, uint64_t nSubvolumeId, std::string& sName);
+
+  std::vector<uint64_t> searchBuffer;  // The search arguments followed by the results
+  std::vector<cBtrfsQgroup> qgroups;
+  std::map<std::string, std::vector<cBtrfsQgroup>> previousQgroups;  // From the previous collection of each mount
+  std::set<std::string> quotasDisabledMounts;  // Only complain once about each mount
+
+private:
+  cBtrfsQgroupCollector(const cBtrfsQgroupCollector&) = delete;
+  cBtrfsQgroupCollector& operator=(const cBtrfsQgroupCollector&) = delete;
+};
+
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "settings.h"
+#include "stats.h"
+
+namespace lumberjill {
+
+// The fill rate of one mount, Holt's linear trend method with the level taken straight from the latest sample because statvfs is exact
+// The trend is smoothed over time rather than over samples, so the daemon and hourly or daily runs from cron give the same forecast
+// Plain data so that it can be written straight to the state file
+class cCapacityTrend {
+public:
+  cCapacityTrend() : nLastTimestamp(0), dLastBytes(0.0), dRateBytesPerSecond(0.0), nSamples(0), nBasis(0) {}
+
+  // Add a sample of the free or unallocated space in O(1)
+  void Add(int64_t nTimestamp, double dAvailableBytes, double dHalfLifeSeconds);
+
+  int64_t nLastTimestamp;
+  double dLastBytes;
+  double dRateBytesPerSecond;  // Positive when the mount is filling up
+  uint32_t nSamples;           // How many rates have gone into the trend
+  uint32_t nBasis;             // The CAPACITY_BASIS of the samples, the trend starts again if this changes
+};
+
+static_assert(sizeof(cCapacityTrend) == 32);
+
+// Forecasts when each mount will be full from how fast its free space, or unallocated space for btrfs, has been going down
+// The state is a constant size per mount and is kept between runs in a file
+class cCapacityForecaster {
+public:
+  cCapacityForecaster();
+  ~cCapacityForecaster();
+
+  // Read the state saved by a previous run, returns false if there isn't any
+  bool Load(const std::string& sFilePath);
+  bool Save(const std::string& sFilePath) const;
+
+  bool IsLoaded() const { return bIsLoaded; }
+  size_t GetMountCount() const { return mounts.size(); }
+
+  // Add this collection's sample and set the mount's forecast once the trend has enough samples
+  void Update(const cCapacitySettings& settings, int64_t nTimestamp, cMountStats& mountStats);
+
+private:
+  std::map<std::string, cCapacityTrend> mounts;
+  bool bIsLoaded;
+
+private:
+  cCapacityForecaster(const cCapacityForecaster&) = delete;
+  cCapacityForecaster& operator=(const cCapacityForecaster&) = delete;
+};
+
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "anomaly.h"
+#include "btrfs_qgroup.h"
+#include "capacity_forecast.h"
+#include "cycle_arena.h"
+#include "diskstats.h"
+#include "drive_temperature.h"
+#include "latency_probe.h"
+#include "mount_query.h"
+#include "result_cache.h"
+#include "self_test.h"
+#include "settings.h"
+#include "smart_scheduler.h"
+#include "smartctl.h"
+#include "snapshot.h"
+
+namespace lumberjill {
+
+bool IsDrivePresent(const std::string& sDevicePath);
+
+// Get the kernel name for a device path, /dev/disk/by-id/ata-ST6000VN001-2BB186_ZR10KNTX -> sdb
+bool GetDeviceNode(const std::string& sDevicePath, std::string& sNode);
+
+// What we keep between collections, the daemon keeps this for as long as it runs
+class cCollectorState {
+public:
+  cCollectorState();
+  ~cCollectorState();
+
+  // Set by the daemon when it is stopping, the SMART queries that are waiting for their slot are skipped so that the collection finishes quickly
+  std::atomic<bool> bStopRequested;
+
+  // The drives with a smartctl call still running, a drive whose call was abandoned at the deadline is skipped until that call returns
+  std::shared_ptr<cSmartDevicesInFlight> smartDevicesInFlight;
+
+  // The temporary containers of a collection, reused by every collection so that they don't go to the heap once it has grown to fit
+  cCycleArena arena;
+
+  // Keeps the counters from the previous collection so that the I/O stats cover the interval between collections
+  cDiskStatsCollector diskStatsCollector;
+
+  // The last SMART values of each drive, reported again while a drive is in standby
+  cSmartCtlSampleCache smartctlSampleCache;
+
+  // Temperature samples taken since the previous collection, the daemon also samples these on its event loop while a collection is running
+  cDriveTemperatureCollector temperatureCollector;
+
+  // Each drive's probe latencies over the recent collections
+  cDeviceLatencyHistograms latencyHistograms;
+
+  // The baseline of each drive's error rates and latency, loaded from the state file on the first collection
+  cAnomalyDetector anomalyDetector;
+
+  // The fill rate of each mount, loaded from the state file on the first collection
+  cCapacityForecaster capacityForecaster;
+
+  // When each drive was last self-tested and the tests that are running, loaded from the state file on the first collection
+  cSelfTestScheduler selfTestScheduler;
+
+  // Keeps the search buffer and each mount's qgroups from the previous collection
+  cBtrfsQgroupCollector qgroupCollector;
+
+  // The results of the latest full collection, served by the daemon's query API
+  cSnapshotStore snapshotStore;
+
+  // Only set for one shot runs with --max-age, smartctl results younger than nResultCacheMaxAgeSeconds are taken from here instead of running smartctl again and new ones are added
+  cResultCache* pResultCache;
+  uint64_t nResultCacheMaxAgeSeconds;
+};
+
+// Collect the mount, smartctl, diskstats, temperature and btrfs stats for every group and log them
+bool QueryAndLogGroups(const cSettings& settings, const std::vector<cGroup>& groups, cMountQueryPool& mountQueryPool, cCollectorState& state);
+
+// Collect the smartctl stats for a single device in a group and log them, used to react to a drive being added or removed
+// smartctl is abandoned like a scheduled query, after deadline_seconds or when state.bStopRequested is set, and it is skipped while the drive has another call in flight
+bool QueryAndLogDevice(const cSettings& settings, const cGroup& group, const cDevice& device, cCollectorState& state);
+
+// Collect the smartctl stats for a single device, and the btrfs device stats if it is in a btrfs group, used to react to errors in the kernel log
+// smartctl is abandoned and skipped like in QueryAndLogDevice, "btrfs device stats" is skipped if the mount doesn't respond
+bool QueryAndLogDeviceErrors(const cSettings& settings, const cGroup& group, const cDevice& device, cMountQueryPool& mountQueryPool, cCollectorState& state);
+
+}
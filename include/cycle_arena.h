@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+namespace lumberjill {
+
+// A bump allocator for the temporary containers of one collection, everything is freed at once by Reset at the end of the collection
+// Unlike std::pmr::monotonic_buffer_resource the memory is kept between collections, if a collection needed more than the arena had the next Reset grows it to fit
+// So after the first few collections the daemon doesn't go to the heap for these at all and its RSS stays flat
+class cCycleArena : public std::pmr::memory_resource {
+public:
+  cCycleArena();
+  explicit cCycleArena(size_t nInitialBytes);
+  ~cCycleArena();
+
+  // Free everything allocated since the last Reset, nothing allocated from the arena may be used after this
+  void Reset();
+
+  size_t GetCapacityBytes() const { return buffer.size(); }
+  size_t GetUsedBytes() const { return nUsedBytes; }
+  size_t GetHighWaterBytes() const { return nHighWaterBytes; }
+
+  // How many allocations didn't fit and went to the heap since the last Reset
+  size_t GetOverflowCount() const { return overflows.size(); }
+
+protected:
+  void* do_allocate(size_t nBytes, size_t nAlignment) override;
+  void do_deallocate(void* p, size_t nBytes, size_t nAlignment) override;
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+private:
+  class cOverflow {
+  public:
+    void* p;
+    size_t nBytes;
+    size_t nAlignment;
+  };
+
+  void FreeOverflows();
+
+  std::vector<std::byte> buffer;
+  size_t nUsedBytes;
+  size_t nHighWaterBytes;  // Including the overflows, what the arena would have needed to hold everything
+  std::vector<cOverflow> overflows;
+
+private:
+  cCycleArena(const cCycleArena&) = delete;
+  cCycleArena& operator=(const cCycleArena&) = delete;
+};
+
+}
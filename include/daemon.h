@@ -0,0 +1,115 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "collector.h"
+#include "kernel_log.h"
+#include "mount_query.h"
+#include "query_server.h"
+#include "scrub.h"
+#include "settings.h"
+#include "topology.h"
+#include "uevent.h"
+
+namespace lumberjill {
+
+// Block SIGINT and SIGTERM so that only the daemon's signalfd receives them
+// This has to be called before any thread is started, threads inherit the mask and otherwise the kernel can deliver the signal to one of them and kill the process
+bool BlockDaemonSignals();
+
+// Long running mode, collects everything at a regular interval and reacts straight away to drives being added or removed and to storage errors in the kernel log
+class cDaemon {
+public:
+  explicit cDaemon(const cSettings& settings);
+  ~cDaemon();
+
+  // Run the event loop until we get SIGINT or SIGTERM
+  bool Run();
+
+  // Log the event and collect the stats again for the device, returns false if the device is not one that we monitor
+  bool HandleUEvent(const cUEvent& event);
+
+  // Count a kernel log message if it is a storage error on a device that we monitor, and collect the stats for the device if it has reached the threshold
+  // Returns false if the message is not a storage error on a device that we monitor
+  bool HandleKernelLogMessage(std::string_view message, uint64_t nNowMS);
+
+private:
+  bool Open();
+  void Close();
+
+  void StartCollection();
+  bool OnCollectionDone();
+  void StopCollection();
+
+  void StartDeviceQuery(const std::string& sDevicePath, std::function<void()> query);
+  void OnDeviceQueriesDone();
+  void StopDeviceQueries();
+
+  void OnTimer();
+  void OnTemperatureTimer();
+  void OnScrubTimer();
+  void OnUEvents();
+  void OnKernelLog();
+
+  void ResolveGroups();
+  void UpdateDeviceNodes();
+
+  const cSettings& settings;
+
+  // The groups with any auto discovered devices filled in
+  std::vector<cGroup> groups;
+
+  // The kernel name of each device in each group, such as "sdb", this is kept when a device disappears so that we can still match its remove event
+  std::vector<std::vector<std::string>> deviceNodes;
+
+  // The group and device index for each name the kernel might use in an error about a device, the disk, its ATA port or its NVMe controller
+  std::map<std::string, std::vector<std::pair<size_t, size_t>>, std::less<>> mapKernelNameToDevices;
+
+  cTopology topology;
+  cMountQueryPool mountQueryPool;
+
+  cCollectorState collectorState;
+
+  // Full collections run on their own thread so that the event loop keeps handling signals, hotplug events, the kernel log and the temperature and scrub timers
+  // The collection gets its own copy of the groups and signals collection_done_fd when it has finished
+  std::thread collectionThread;
+  bool bCollectionResult;  // Only read after collectionThread has been joined
+
+  // Queries for a single device, after a hotplug event or kernel errors, also run on their own threads so that a hung drive can't stall the event loop
+  // Only one runs for each device at a time, each one adds its device to finishedDeviceQueries and signals device_query_done_fd when it has finished
+  std::mutex deviceQueriesMutex;
+  std::map<std::string, std::thread> mapDevicePathToQueryThread;
+  std::vector<std::string> finishedDeviceQueries;
+
+  cUEventSocket ueventSocket;
+
+  cKernelLogReader kernelLogReader;
+  const cKernelErrorMatcher kernelErrorMatcher;
+  cKernelErrorTracker kernelErrorTracker;
+
+  cScrubOrchestrator scrubOrchestrator;
+
+  // Serves collectorState's snapshots, so it has to come after it
+  cQueryServer queryServer;
+
+  int epoll_fd;
+  int timer_fd;
+  int temperature_timer_fd;
+  int scrub_timer_fd;
+  int signal_fd;
+  int collection_done_fd;
+  int device_query_done_fd;
+
+private:
+  cDaemon(const cDaemon&) = delete;
+  cDaemon& operator=(const cDaemon&) = delete;
+};
+
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "stats.h"
+
+namespace lumberjill {
+
+// The cumulative counters for one device from a line of /proc/diskstats
+// https://www.kernel.org/doc/html/latest/admin-guide/iostats.html
+class cDiskStatsCounters {
+public:
+  cDiskStatsCounters() { Clear(); }
+
+  void Clear()
+  {
+    bIsValid = false;
+    nReadsCompleted = 0;
+    nSectorsRead = 0;
+    nReadTimeMS = 0;
+    nWritesCompleted = 0;
+    nSectorsWritten = 0;
+    nWriteTimeMS = 0;
+    nInFlight = 0;
+    nIOTimeMS = 0;
+    nWeightedIOTimeMS = 0;
+  }
+
+  bool bIsValid;
+
+  uint64_t nReadsCompleted;
+  uint64_t nSectorsRead;      // Always 512 byte sectors regardless of the drive's sector size
+  uint64_t nReadTimeMS;
+  uint64_t nWritesCompleted;
+  uint64_t nSectorsWritten;
+  uint64_t nWriteTimeMS;
+  uint64_t nInFlight;
+  uint64_t nIOTimeMS;
+  uint64_t nWeightedIOTimeMS;
+};
+
+// Parse the contents of /proc/diskstats in a single pass without allocating
+// nodes must be sorted, counters is resized to match and filled in for each node that was found
+// Returns false if no lines could be parsed
+bool ParseDiskStats(std::string_view contents, const std::vector<std::string>& nodes, std::vector<cDiskStatsCounters>& counters);
+
+// Work out the rates between two samples taken nIntervalMS apart
+// Returns false if the counters went backwards, for example because the device was removed and a different one added with the same name
+bool GetDiskIOStats(const cDiskStatsCounters& before, const cDiskStatsCounters& after, uint64_t nIntervalMS, cDiskIOStats& outStats);
+
+// Samples /proc/diskstats and keeps the previous sample of each device so that the rates can be worked out over the interval between calls
+// The first sample of a device is compared against zero at boot, so it gives the average since boot like the first report from iostat
+class cDiskStatsCollector {
+public:
+  cDiskStatsCollector();
+  explicit cDiskStatsCollector(const std::string& sDiskStatsFilePath);
+  ~cDiskStatsCollector();
+
+  // Read the counters for these devices ("sdb", "nvme0n1") and update their stats
+  bool Sample(std::span<const std::string> nodes);
+
+  // For testing, sample with the time since boot provided by the caller
+  bool Sample(std::span<const std::string> nodes, uint64_t nNowMS);
+
+  // Get the stats worked out by the last Sample call, returns false if the device was not found
+  bool GetDiskIOStats(const std::string& sNode, cDiskIOStats& outStats) const;
+
+private:
+  class cDevice {
+  public:
+    cDevice() : nTimeMS(0), bHasStats(false) {}
+
+    cDiskStatsCounters counters;
+    uint64_t nTimeMS;
+    bool bHasStats;
+    cDiskIOStats stats;
+  };
+
+  bool ReadDiskStats();
+
+  std::string sDiskStatsFilePath;
+  int fd;
+
+  // Reused between samples so that we don't allocate once we have warmed up
+  std::string buffer;
+  std::vector<std::string> sortedNodes;
+  std::vector<cDiskStatsCounters> counters;
+
+  std::map<std::string, cDevice, std::less<>> devices;
+
+private:
+  cDiskStatsCollector(const cDiskStatsCollector&) = delete;
+  cDiskStatsCollector& operator=(const cDiskStatsCollector&) = delete;
+};
+
+}
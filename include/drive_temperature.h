@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "batch_reader.h"
+#include "stats.h"
+
+namespace lumberjill {
+
+// Find the temperature input of the hwmon device for a drive, such as "/sys/class/block/sdb/device/hwmon/hwmon3/temp1_input"
+// SATA and SAS drives need the drivetemp module, NVMe drives have their own hwmon device
+bool FindDriveTemperatureInput(const std::string& sSysFolder, const std::string& sNode, std::string& sInputPath);
+
+// Parse the contents of a tempN_input file, which is in millidegrees Celsius
+bool ParseTemperatureInput(std::string_view contents, int32_t& nMilliCelsius);
+
+// The most recent temperature samples of a drive, once it is full the oldest samples are overwritten
+class cTemperatureRing {
+public:
+  static constexpr size_t CAPACITY = 64;
+
+  cTemperatureRing();
+
+  void Clear();
+  void Record(int32_t nMilliCelsius);
+
+  size_t GetCount() const { return nCount; }
+
+  // The min, max and average of the samples, returns false if there aren't any
+  bool GetStats(cDriveTemperatureStats& outStats) const;
+
+private:
+  std::array<int32_t, CAPACITY> samples;
+  size_t nNext;
+  size_t nCount;
+};
+
+// Samples the hwmon temperature of each drive much more often than we can afford to run smartctl
+// The tempN_input files are kept open and all of them are read in one batch, each drive's samples are kept until the next report
+class cDriveTemperatureCollector {
+public:
+  cDriveTemperatureCollector();
+  explicit cDriveTemperatureCollector(const std::string& sSysFolder);
+  ~cDriveTemperatureCollector();
+
+  // Open the temperature inputs for these devices ("sdb", "nvme0n1"), devices that aren't listed any more are closed
+  // Devices without a hwmon device are looked for again on every call in case the module has been loaded since
+  void Update(std::span<const std::string> nodes);
+
+  // Stop sampling a device while it is in standby, reading drivetemp can spin some drives up or reset their standby timer
+  void SetStandby(const std::string& sNode, bool bIsInStandby);
+
+  // Read the inputs with io_uring instead of pread, see cBatchFileReader
+  void SetUseIOUring(bool bUseIOUring);
+
+  // Read the current temperature of every open device
+  void Sample();
+
+  // Get the stats since the last report and start a new window, returns false if there were no samples for this device
+  bool GetStatsAndReset(const std::string& sNode, cDriveTemperatureStats& outStats);
+
+private:
+  class cDevice {
+  public:
+    cDevice() : fd(-1), nSlot(0), bIsInStandby(false) {}
+
+    int fd;
+    size_t nSlot;  // In the reader while the file is open
+    bool bIsInStandby;
+    cTemperatureRing ring;
+  };
+
+  void CloseDevice(cDevice& device);
+
+  std::string sSysFolder;
+
+  // The daemon samples on its event loop while a collection is running on another thread
+  std::mutex mutex;
+
+  std::map<std::string, cDevice, std::less<>> devices;
+
+  cBatchFileReader reader;
+  std::vector<size_t> readSlots;  // Reused between samples
+
+private:
+  cDriveTemperatureCollector(const cDriveTemperatureCollector&) = delete;
+  cDriveTemperatureCollector& operator=(const cDriveTemperatureCollector&) = delete;
+};
+
+}
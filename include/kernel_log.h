@@ -0,0 +1,188 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "stats.h"
+
+namespace lumberjill {
+
+// Finds any of a fixed set of strings in a single pass over the text (Aho-Corasick)
+// The automaton is built up front as a DFA with the bytes that don't appear in any pattern folded into one class, so matching is one table lookup per byte
+class cMultiPatternMatcher {
+public:
+  explicit cMultiPatternMatcher(const std::vector<std::string_view>& patterns);
+  ~cMultiPatternMatcher();
+
+  // Find the match that ends first, returns false if none of the patterns are in the text
+  // outEnd is the offset just past the end of the match
+  bool FindFirst(std::string_view text, size_t& outPattern, size_t& outEnd) const;
+
+  size_t GetStateCount() const { return nStates; }
+
+private:
+  static constexpr int32_t NO_MATCH = -1;
+
+  // Each transition is the offset of the next state's row rather than its number, with this bit set if a pattern ends in that state
+  // That saves a multiply and a lookup in the matches table for every byte
+  static constexpr uint32_t MATCH_FLAG = 0x80000000u;
+
+  std::array<uint8_t, 256> byteClass;
+  size_t nClasses;
+  size_t nStates;
+  std::vector<uint32_t> transitions;  // nStates * nClasses
+  std::vector<int32_t> matches;       // The pattern that ends at each state, or NO_MATCH
+
+private:
+  cMultiPatternMatcher(const cMultiPatternMatcher&) = delete;
+  cMultiPatternMatcher& operator=(const cMultiPatternMatcher&) = delete;
+};
+
+
+// A /dev/kmsg record, "3,1234,5678901234,-;blk_update_request: I/O error, dev sdc, sector 1234 op 0x0:(READ) flags 0x0 phys_seg 1 prio class 0"
+class cKernelLogRecord {
+public:
+  cKernelLogRecord() : nPriority(0), nSequence(0), nTimestampUS(0) {}
+
+  int nPriority;          // The syslog priority, without the facility
+  uint64_t nSequence;
+  uint64_t nTimestampUS;  // Since boot
+  std::string_view message;
+};
+
+// Parse a record read from /dev/kmsg, the message points into the buffer that was parsed
+// The " KEY=value" dictionary lines after the message are not included
+bool ParseKernelLogRecord(std::string_view buffer, cKernelLogRecord& record);
+
+
+enum class KERNEL_ERROR {
+  IO_ERROR,      // Block layer I/O errors
+  MEDIUM_ERROR,  // Unreadable sectors
+  ATA_ERROR,     // ATA command exceptions
+  LINK_RESET,    // SATA link resets, often a bad cable or backplane
+  TIMEOUT,       // Commands that timed out
+  BTRFS_ERROR,   // Errors reported by btrfs for a device
+};
+
+constexpr size_t KERNEL_ERROR_COUNT = size_t(KERNEL_ERROR::BTRFS_ERROR) + 1;
+
+// A kernel message about a storage error, and the kernel's name for the device it is about
+// sName can be a disk ("sdc"), a partition ("sdc1"), an ATA port ("ata3") or an NVMe controller ("nvme0")
+class cKernelError {
+public:
+  cKernelError() : type(KERNEL_ERROR::IO_ERROR) {}
+
+  KERNEL_ERROR type;
+  std::string_view sName;
+};
+
+// Recognises the kernel messages about storage errors
+class cKernelErrorMatcher {
+public:
+  cKernelErrorMatcher();
+
+  // Returns false if the message isn't a storage error we know about
+  bool Match(std::string_view message, cKernelError& error) const;
+
+private:
+  cMultiPatternMatcher matcher;
+};
+
+const char* GetKernelErrorName(KERNEL_ERROR type);
+
+// Get the disk a partition is on from its name, "sdc1" -> "sdc", "nvme0n1p2" -> "nvme0n1", anything else is returned as it is
+std::string_view GetDiskNameFromPartitionName(std::string_view sName);
+
+
+// Counts the kernel errors for each device and decides when there are enough to collect its stats straight away
+class cKernelErrorTracker {
+public:
+  cKernelErrorTracker(size_t nThreshold, uint64_t nWindowMS, uint64_t nCooldownMS);
+
+  // Count an error, returns true if this takes the device to the threshold within the window and it hasn't been triggered recently
+  bool Record(const std::string& sDevicePath, KERNEL_ERROR type, uint64_t nNowMS);
+
+  // The totals and the number of errors in the window ending at nNowMS, returns false if there haven't been any errors for this device
+  bool GetStats(const std::string& sDevicePath, uint64_t nNowMS, cKernelErrorStats& outStats);
+
+private:
+  class cDevice {
+  public:
+    cDevice() : totals{}, nRecent(0), nLastTriggerMS(0), bHasTriggered(false) {}
+
+    std::array<uint64_t, KERNEL_ERROR_COUNT> totals;
+    std::deque<std::pair<uint64_t, uint64_t>> recent; // The number of errors in each second of the window, so a flood of errors doesn't use more memory
+    uint64_t nRecent;
+    uint64_t nLastTriggerMS;
+    bool bHasTriggered;
+  };
+
+  void ExpireOld(cDevice& device, uint64_t nNowMS) const;
+
+  const size_t nThreshold;
+  const uint64_t nWindowMS;
+  const uint64_t nCooldownMS;
+
+  std::map<std::string, cDevice> devices;
+};
+
+
+// Reads /dev/kmsg without blocking, starting from the messages logged after it was opened
+class cKernelLogReader {
+public:
+  cKernelLogReader();
+  ~cKernelLogReader();
+
+  bool Open(const std::string& sFilePath = "/dev/kmsg");
+
+  // Use an existing file descriptor instead, for example one end of a socketpair in the unit tests
+  void Attach(int fd);
+
+  void Close();
+
+  int GetFD() const { return fd; }
+
+  // Call the function for each record that is waiting, the record's message is only valid during the call
+  template <class F>
+  bool ReadRecords(F&& onRecord);
+
+private:
+  // Read one record, returns 0 when there is nothing left to read and -1 on error
+  ssize_t ReadRecord();
+
+  int fd;
+
+  // Records are at most 8 KiB including the dictionary
+  std::array<char, 8192> buffer;
+
+private:
+  cKernelLogReader(const cKernelLogReader&) = delete;
+  cKernelLogReader& operator=(const cKernelLogReader&) = delete;
+};
+
+template <class F>
+bool cKernelLogReader::ReadRecords(F&& onRecord)
+{
+  cKernelLogRecord record;
+  while (true) {
+    const ssize_t len = ReadRecord();
+    if (len < 0) return false;
+    else if (len == 0) break;
+
+    if (ParseKernelLogRecord(std::string_view(buffer.data(), size_t(len)), record)) {
+      onRecord(record);
+    }
+  }
+
+  return true;
+}
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "settings.h"
+#include "stats.h"
+
+namespace lumberjill {
+
+// A fixed size log bucketed histogram of latencies in microseconds, in the style of HdrHistogram
+// Values below 16 are exact, above that each power of 2 is split into 16 buckets so the error is at most 1/16th
+class cLatencyHistogram {
+public:
+  cLatencyHistogram();
+
+  void Clear();
+
+  void Record(uint64_t nValueUS);
+
+  // Add the values recorded in another histogram to this one
+  void Add(const cLatencyHistogram& other);
+
+  // Halve every count so that older values count for less, the max comes down to the highest bucket that is still used
+  void Halve();
+
+  size_t GetCount() const { return nCount; }
+  uint64_t GetMaxUS() const { return nMaxUS; }
+
+  // Get the value that percentile% of the recorded values are at or below, for example 99.0
+  uint64_t GetPercentileUS(double percentile) const;
+
+  static constexpr size_t SUB_BUCKET_BITS = 4;
+  static constexpr size_t SUB_BUCKET_COUNT = size_t(1) << SUB_BUCKET_BITS;
+  static constexpr size_t MAX_EXPONENT = 40; // About 12 days in microseconds, anything larger goes in the last bucket
+  static constexpr size_t BUCKET_COUNT = SUB_BUCKET_COUNT + ((MAX_EXPONENT - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT);
+
+  static size_t GetBucketIndex(uint64_t nValueUS);
+  static uint64_t GetBucketHighestValue(size_t index);
+
+private:
+  std::array<uint32_t, BUCKET_COUNT> buckets;
+  size_t nCount;
+  uint64_t nMaxUS;
+};
+
+// The latency distribution of each drive accumulated over collections, a single probe's few reads are too few for a meaningful p99 on their own
+// Once a drive has more than nMaxReads reads every count is halved, so older probes fade out and the distribution follows the drive as it changes
+class cDeviceLatencyHistograms {
+public:
+  cDeviceLatencyHistograms();
+  explicit cDeviceLatencyHistograms(size_t nMaxReads);
+
+  // Add a probe's reads to the drive's distribution and return the distribution
+  const cLatencyHistogram& Add(const std::string& sDevicePath, const cLatencyHistogram& probe);
+
+private:
+  const size_t nMaxReads;
+  std::map<std::string, cLatencyHistogram> mapDevicePathToHistogram;
+};
+
+// Time nReads random aligned O_DIRECT reads of a block device or file at idle I/O priority, rate limited to nReadsPerSecond
+// Returns false if the device could not be opened or read, or doesn't support O_DIRECT
+bool ProbeDeviceLatency(const std::string& sDevicePath, const cLatencyProbeSettings& settings, cLatencyHistogram& histogram);
+
+// Set bIsOutlier on the drives whose p50 or p99 latency is more than nOutlierFactor times the median of the other drives in the mount
+// At least two other drives must have latency stats to compare against
+void FlagLatencyOutliers(cMountStats& mountStats, size_t nOutlierFactor);
+
+}
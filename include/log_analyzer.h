@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lumberjill {
+
+class cLogSample {
+public:
+  cLogSample() : nTimestamp(0), dValue(0.0) {}
+  cLogSample(int64_t _nTimestamp, double _dValue) : nTimestamp(_nTimestamp), dValue(_dValue) {}
+
+  int64_t nTimestamp;  // Unix time from the syslog line, 0 if the line didn't have one we understand
+  double dValue;
+};
+
+// The history of a mount or a drive, each numeric field in its records becomes a time series
+class cLogHistory {
+public:
+  std::string sName;
+  std::string sMountPoint;
+  std::map<std::string, std::vector<cLogSample>, std::less<>> series;
+};
+
+// What was found in the log files
+class cLogAnalysis {
+public:
+  cLogAnalysis() : nFiles(0), nBytes(0), nRecords(0), nInvalidRecords(0) {}
+
+  uint64_t nFiles;
+  uint64_t nBytes;           // Uncompressed bytes scanned
+  uint64_t nRecords;         // Mount and btrfs stats records parsed
+  uint64_t nInvalidRecords;  // Records whose JSON could not be parsed, usually cut short by the syslog daemon's line length limit
+
+  std::map<std::string, cLogHistory, std::less<>> mounts;  // By mount point
+  std::map<std::string, cLogHistory, std::less<>> drives;  // By device path
+};
+
+// How the growth of one counter over the whole history is summarised
+class cLogSeriesSummary {
+public:
+  cLogSeriesSummary() : nSamples(0), nFirstTimestamp(0), nLastTimestamp(0), dFirst(0.0), dLast(0.0), dMin(0.0), dMax(0.0), dGrowth(0.0), nResets(0) {}
+
+  size_t nSamples;
+  int64_t nFirstTimestamp;
+  int64_t nLastTimestamp;
+  double dFirst;
+  double dLast;
+  double dMin;
+  double dMax;
+  double dGrowth;  // How much it went up in total, a reset (such as a replaced drive) starts counting again from the new value
+  size_t nResets;  // How many times it went down
+};
+
+cLogSeriesSummary GetLogSeriesSummary(const std::vector<cLogSample>& samples);
+
+// Finds the "Mount ... drive stats json @cee: " and "Mount ... btrfs stats json @cee: " records in syslog files and collects the values in them
+// Plain files are mmap'd and scanned in place, files ending in .gz are decompressed in chunks
+class cLogAnalyzer {
+public:
+  cLogAnalyzer();
+  ~cLogAnalyzer();
+
+  bool AnalyzeFile(const std::string& sFilePath);
+
+  // Scan whole lines, traditional syslog timestamps don't have a year so they are taken to be in the year before reference if they are later in the year than it
+  void AnalyzeBuffer(std::string_view data, time_t reference);
+
+  // Sort each series by time, the files can be given in any order
+  void Finish();
+
+  const cLogAnalysis& GetAnalysis() const { return analysis; }
+
+private:
+  // The fields of a record are collected first and only added once the whole record has been read, so a record that was cut short adds nothing
+  class cRecordField {
+  public:
+    size_t nDrive;  // Index into recordDrives, or SIZE_MAX for the mount itself
+    std::string_view sName;  // Points into the record
+    double dValue;
+  };
+
+  class cRecordDrive {
+  public:
+    std::string sPath;
+    std::string sName;
+    bool bIsPresent;
+    cLogHistory* pHistory;
+  };
+
+  int64_t GetTimestamp(std::string_view line, time_t reference);
+  bool ReadRecord(std::string_view json);
+  void AnalyzeRecord(std::string_view line, std::string_view json, bool bIsBtrfs, time_t reference);
+
+  cLogAnalysis analysis;
+
+  // The last traditional timestamp's "Mmm dd HH" and the time at the start of that hour
+  std::string sCachedHour;
+  time_t cachedReference;
+  int64_t nCachedHourTimestamp;
+
+  // Reused for each record
+  std::string sRecordMountPoint;
+  std::vector<cRecordField> recordFields;
+  std::vector<cRecordDrive> recordDrives;
+  size_t nRecordDrives;
+
+private:
+  cLogAnalyzer(const cLogAnalyzer&) = delete;
+  cLogAnalyzer& operator=(const cLogAnalyzer&) = delete;
+};
+
+// Parse the timestamp at the start of a syslog line, either RFC 3339 "2026-10-19T08:15:02.123456+01:00" or traditional "Oct 19 08:15:02"
+bool ParseSyslogTimestamp(std::string_view line, time_t reference, int64_t& nTimestamp);
+
+// A summary of each counter for each mount and drive
+std::string GetJSONLogAnalysis(const cLogAnalysis& analysis);
+
+// Every sample as "timestamp,type,id,counter,value" lines for plotting
+std::string GetCSVLogAnalysis(const cLogAnalysis& analysis);
+
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+
+#include <sched.h>
+
+#include "settings.h"
+
+namespace lumberjill {
+
+// Runs the calling thread at idle I/O priority until this goes out of scope, then restores the previous priority
+class cIdleIOPriority {
+public:
+  cIdleIOPriority();
+  ~cIdleIOPriority();
+
+private:
+  const int nPreviousIOPriority;
+
+private:
+  cIdleIOPriority(const cIdleIOPriority&) = delete;
+  cIdleIOPriority& operator=(const cIdleIOPriority&) = delete;
+};
+
+// The low impact settings prepared so that they can be applied between fork and exec, where only async-signal-safe calls are allowed
+class cLowImpact {
+public:
+  cLowImpact();
+  ~cLowImpact();
+
+  // Work out the CPU mask, create the cgroup and write its io.max limits
+  bool Prepare(const cLowImpactSettings& settings);
+
+  bool IsEnabled() const { return bEnabled; }
+
+  // Apply idle I/O priority, SCHED_IDLE, nice and CPU affinity to the calling thread, threads and processes created afterwards inherit them
+  bool ApplyToCurrentProcess() const;
+
+  // Apply everything to a child process, including moving it into the cgroup, this is called in the child between fork and exec
+  void ApplyToChildProcess() const;
+
+private:
+  bool ApplyPriorityAndAffinity(int& error_code) const;
+
+  bool bEnabled;
+  bool bSchedIdle;
+  int nNice;
+  bool bRestrictCPUs;
+  cpu_set_t cpus;
+  std::string sCgroupProcsFilePath;
+
+private:
+  cLowImpact(const cLowImpact&) = delete;
+  cLowImpact& operator=(const cLowImpact&) = delete;
+};
+
+// Set the limits that RunCommand applies to every child process, nullptr to run them normally
+// NOTE: The cLowImpact must outlive any calls to RunCommand
+void SetChildProcessLowImpact(const cLowImpact* pLowImpact);
+const cLowImpact* GetChildProcessLowImpact();
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include <sys/statvfs.h>
+
+#include "stats.h"
+
+namespace lumberjill {
+
+enum class MOUNT_QUERY_RESULT {
+  OK,
+  ERROR,
+  UNRESPONSIVE
+};
+
+// Runs statvfs on helper threads so that a dead NFS/CIFS mount or a wedged USB drive can't hang the main thread
+// A mount that doesn't respond before its deadline is abandoned, and it is skipped until the stuck statvfs call returns, so at most one thread is ever stuck on each mount
+class cMountQueryPool {
+public:
+  typedef int (*StatVFSFunction)(const char* path, struct statvfs* buf);
+
+  cMountQueryPool();
+  explicit cMountQueryPool(StatVFSFunction pStatVFS);
+  ~cMountQueryPool();
+
+  // Something similar to "df -h /data1", fills in the total and free space
+  MOUNT_QUERY_RESULT GetMountTotalAndFreeSpace(const std::string& sMountPoint, std::chrono::milliseconds timeout, cMountStats& outStats);
+
+  // Returns true if there is still a statvfs call in progress for this mount
+  bool IsMountBusy(const std::string& sMountPoint) const;
+
+  // The number of helper threads that have been started, idle or stuck
+  size_t GetThreadCount() const;
+
+private:
+  class cState;
+  std::shared_ptr<cState> state;
+
+private:
+  cMountQueryPool(const cMountQueryPool&) = delete;
+  cMountQueryPool& operator=(const cMountQueryPool&) = delete;
+};
+
+}
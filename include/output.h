@@ -0,0 +1,96 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "remote_sink.h"
+#include "settings.h"
+#include "stats.h"
+
+namespace lumberjill {
+
+// One record to log, the JSON is created later on the sink thread so the collector only pays for copying the stats
+class cOutputRecord {
+public:
+  cOutputRecord() : nPriority(0) {}
+
+  int nPriority;             // The syslog priority
+  std::string sMessage;      // Goes before the JSON in the syslog message, such as "Mount /data drive stats"
+  std::string sCoalesceKey;  // A queued record with the same key is replaced by this one when coalescing, empty to never replace one
+  std::function<std::string()> fnGetJSON;  // Owns copies of everything it needs
+  std::chrono::steady_clock::time_point queued;
+  std::chrono::system_clock::time_point created;  // The timestamp sent to the remote collector
+};
+
+// A bounded queue of records and a thread that writes them to each sink
+// Each record is serialised once and the same JSON goes to stdout, syslog (and journald through it), the optional file and the optional remote collector, the query API serves the snapshots separately
+class cOutputPipeline {
+public:
+  cOutputPipeline();
+  ~cOutputPipeline();
+
+  bool Start(const cOutputSettings& settings);
+
+  // Write everything that is still queued and stop the sink thread, records pushed after this are written straight away
+  void Stop();
+
+  // Queue a record, what happens when the queue is full depends on the policy
+  void Push(cOutputRecord&& record);
+
+  // Wait until everything pushed so far has been written or thrown away
+  void Flush();
+
+  // The stats since the last call
+  void GetStatsAndReset(cOutputStats& outputStats);
+
+private:
+  enum class SINK {
+    STDOUT,
+    SYSLOG,
+    FILE,
+    REMOTE
+  };
+
+  void Run();
+  void WriteBatch(std::vector<cOutputRecord>& batch);
+  void UpdateRemoteSpooledStats();  // Called with the mutex held
+
+  cOutputSettings settings;
+  std::vector<SINK> sinks;
+  int fdFile;
+  cRemoteSink remoteSink;
+
+  std::mutex mutex;
+  std::condition_variable cvQueued;
+  std::condition_variable cvWritten;
+  std::deque<cOutputRecord> queue;
+  bool bRunning;
+  bool bStop;
+  uint64_t nPushed;
+  uint64_t nDone;  // Written, dropped or coalesced
+  cOutputStats stats;
+
+  std::thread thread;
+
+private:
+  cOutputPipeline(const cOutputPipeline&) = delete;
+  cOutputPipeline& operator=(const cOutputPipeline&) = delete;
+};
+
+// Set the pipeline that the Log*ToSyslog functions push to, nullptr to write synchronously to stdout and syslog
+// NOTE: The pipeline must outlive any calls to the Log*ToSyslog functions
+void SetOutputPipeline(cOutputPipeline* pPipeline);
+cOutputPipeline* GetOutputPipeline();
+
+// Push a record to the pipeline if there is one, otherwise serialise and write it now
+// Returns false if the record was written now and the JSON could not be created, errors on the sink thread are counted in the sink stats instead
+bool WriteOutput(int nPriority, const std::string& sMessage, const std::string& sCoalesceKey, std::function<std::string()>&& fnGetJSON);
+
+}
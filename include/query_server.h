@@ -0,0 +1,85 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "snapshot.h"
+
+namespace lumberjill {
+
+enum class QUERY_FORMAT {
+  JSON,
+  OPENMETRICS
+};
+
+// A request is a single line, the format followed by what to get:
+// "json snapshot\n"
+// "openmetrics device /dev/disk/by-id/ata-ST6000VN001-2BB186_ZR10KNTX\n"
+class cQueryRequest {
+public:
+  cQueryRequest() : format(QUERY_FORMAT::JSON) {}
+
+  QUERY_FORMAT format;
+  std::string sDevicePath; // Empty for the whole snapshot
+};
+
+bool ParseQueryRequest(std::string_view line, cQueryRequest& request);
+std::string GetQueryRequestLine(const cQueryRequest& request);
+
+// The response is a status line, "OK\n" or "ERROR <reason>\n", followed by the body
+// sBody is only filled in when the body isn't one of the snapshot's prebuilt forms, body points at whichever one it is
+bool GetQueryResponse(const cPublishedSnapshot* pSnapshot, const cQueryRequest& request, std::string& sStatus, std::string& sBody, std::string_view& body);
+
+// Serves the latest snapshot on a Unix domain socket from its own thread
+// Answering a query never touches a disk or waits for a collection, the snapshot's prebuilt JSON or OpenMetrics is written straight out
+class cQueryServer {
+public:
+  explicit cQueryServer(const cSnapshotStore& store);
+  ~cQueryServer();
+
+  bool Start(const std::string& sSocketPath);
+  void Stop();
+
+  bool IsRunning() const { return thread.joinable(); }
+
+private:
+  class cConnection;
+
+  // Bind the listening socket at sSocketPath with its permissions already set, sFolder is the folder that it is in
+  bool BindPrivately(const std::string& sFolder);
+
+  void Run();
+  void AcceptConnections();
+  void OnConnectionReady(int fd);
+  void CloseConnection(int fd);
+  void CloseIdleConnections();
+
+  // Returns false when the connection is finished with
+  bool ReadRequest(cConnection& connection);
+  bool WriteResponse(cConnection& connection);
+
+  // Only used from the server's thread
+  cSnapshotReader snapshotReader;
+
+  std::string sSocketPath;
+
+  int listen_fd;
+  int epoll_fd;
+  int stop_fd;
+
+  std::map<int, std::unique_ptr<cConnection>> connections;
+
+  std::thread thread;
+
+private:
+  cQueryServer(const cQueryServer&) = delete;
+  cQueryServer& operator=(const cQueryServer&) = delete;
+};
+
+// The client side, send a request to the daemon and get the body of the response
+bool QueryDaemon(const std::string& sSocketPath, const cQueryRequest& request, std::string& sResponse);
+
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "settings.h"
+
+namespace lumberjill {
+
+// An RFC 5424 syslog message, nPRI is the facility and severity combined, the structured data is left empty
+// <134>1 2026-10-19T08:15:02.123456Z nas1 lumber-jill 1234 - - Mount /data1 drive stats json @cee: { ... }
+std::string FormatRFC5424Message(int nPRI, std::chrono::system_clock::time_point time, const std::string& sHostName, const std::string& sAppName, int nProcessID, const std::string& sMessage);
+
+// Octet counting framing from RFC 6587, "<length> <message>", so that messages can contain newlines
+std::string GetOctetCountedFrame(const std::string& sMessage);
+
+// A bounded ring buffer of messages in a file, so that records survive while the collector is unreachable and across restarts
+// The file is a small header followed by the ring, each message is a native 32 bit length and then the message
+// When a new message doesn't fit the oldest messages are dropped to make room
+class cRemoteSpool {
+public:
+  cRemoteSpool();
+  ~cRemoteSpool();
+
+  // Open the spool, picking up the messages left in it by a previous run if it is the same size, otherwise it starts out empty
+  bool Open(const std::string& sFilePath, size_t nCapacityBytes);
+  void Close();
+
+  bool IsOpen() const { return (fd >= 0); }
+
+  // Append messages after the ones already in the spool, returns how many messages were dropped to make room
+  size_t Push(const std::vector<std::string>& messages);
+
+  // Read up to nMaxMessages of the oldest messages without removing them
+  bool Peek(size_t nMaxMessages, std::vector<std::string>& messages) const;
+
+  // Remove the oldest nMessages, once they have been sent
+  void Pop(size_t nMessages);
+
+  size_t GetMessageCount() const { return nCount; }
+  size_t GetUsedBytes() const { return nUsed; }
+
+private:
+  // Positions are offsets into the ring and wrap around at the end of it
+  bool ReadAt(uint64_t nPosition, void* pData, size_t nBytes) const;
+  bool WriteAt(uint64_t nPosition, const void* pData, size_t nBytes);
+  bool WriteHeader();
+  bool PopOne();
+
+  int fd;
+  uint64_t nCapacity;
+  uint64_t nStart;
+  uint64_t nUsed;
+  uint64_t nCount;
+
+private:
+  cRemoteSpool(const cRemoteSpool&) = delete;
+  cRemoteSpool& operator=(const cRemoteSpool&) = delete;
+};
+
+// Sends messages to a remote syslog collector, spooling them while it can't be reached and sending the spool in order once it can
+// This is only used from the output pipeline's sink thread
+class cRemoteSink {
+public:
+  cRemoteSink();
+  ~cRemoteSink();
+
+  // Open the spool, the connection is made on the first write
+  bool Open(const cRemoteSettings& settings);
+  void Close();
+
+  // An RFC 5424 message from this host
+  std::string FormatMessage(int nPRI, std::chrono::system_clock::time_point time, const std::string& sMessage) const;
+
+  // Send the messages after anything that is spooled, returns false if they had to be spooled or dropped instead
+  bool Write(const std::vector<std::string>& messages);
+
+  // Reconnect and send the spool, if a retry is due
+  void Retry();
+
+  bool HasSpooled() const { return (spool.GetMessageCount() != 0); }
+  size_t GetSpooledCount() const { return spool.GetMessageCount(); }
+  std::chrono::steady_clock::time_point GetNextRetry() const { return nextRetry; }
+
+private:
+  bool IsConnected();
+  bool Connect();
+  void Disconnect();
+  bool Send(const std::vector<std::string>& messages);
+  bool SendSpool();
+  void Spool(const std::vector<std::string>& messages);
+
+  cRemoteSettings settings;
+  std::string sHostName;
+  int nProcessID;
+
+  int fd;
+  std::chrono::milliseconds reconnectDelay;
+  std::chrono::steady_clock::time_point nextRetry;
+  bool bIsUnreachable;  // So that being unreachable is only logged once
+
+  cRemoteSpool spool;
+
+private:
+  cRemoteSink(const cRemoteSink&) = delete;
+  cRemoteSink& operator=(const cRemoteSink&) = delete;
+};
+
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "stats.h"
+
+namespace lumberjill {
+
+// Where one shot runs with --max-age share their smartctl results, /run is a tmpfs so the cache never outlives a reboot
+const std::string RESULT_CACHE_FOLDER = "/run/lumber-jill";
+const std::string RESULT_CACHE_FILE_PATH = RESULT_CACHE_FOLDER + "/smartctl.cache";
+const std::string RESULT_CACHE_LOCK_FILE_PATH = RESULT_CACHE_FOLDER + "/smartctl.lock";
+
+// The smartctl results of each drive, shared between one shot runs so that cron, a monitoring check and an admin's manual run close together don't all run smartctl on every drive
+// The file is a small header followed by fixed size entries sorted by device path, it is mmap'd and searched in place
+// It is only ever replaced as a whole with an atomic rename, so a reader never sees a partly written file
+class cResultCache {
+public:
+  cResultCache();
+  ~cResultCache();
+
+  // Map the cache file, returns false if it is missing or is not a cache file of this version, in which case the cache starts out empty
+  bool Load(const std::string& sFilePath);
+
+  // Get the results for a drive if they were collected no more than nMaxAgeSeconds before nNow
+  bool Get(const std::string& sDevicePath, int64_t nNow, uint64_t nMaxAgeSeconds, cSmartCtlStats& smartctlStats) const;
+
+  // Add or replace the results for a drive, these are written out by Save
+  void Set(const std::string& sDevicePath, int64_t nTimestamp, const cSmartCtlStats& smartctlStats);
+
+  // Write the loaded entries along with any new ones to a temporary file and rename it over the cache file
+  bool Save(const std::string& sFilePath) const;
+
+  size_t GetEntryCount() const;
+
+  // The layout of one drive's results in the file
+  class cEntry;
+
+private:
+  const cEntry* Find(const std::string& sDevicePath) const;
+  void Unmap();
+
+  // The loaded file
+  const uint8_t* pMapping;
+  size_t nMappingSizeBytes;
+  const cEntry* pEntries;
+  size_t nEntries;
+
+  // Results collected by this run
+  std::map<std::string, std::pair<int64_t, cSmartCtlStats>> updates;
+
+private:
+  cResultCache(const cResultCache&) = delete;
+  cResultCache& operator=(const cResultCache&) = delete;
+};
+
+// An exclusive lock on the cache, so that when several runs start together one of them collects while the others wait and then use its results
+class cResultCacheLock {
+public:
+  cResultCacheLock();
+  ~cResultCacheLock();
+
+  // Wait up to timeout for the lock, creating the lock file if needed
+  bool Lock(const std::string& sFilePath, std::chrono::milliseconds timeout);
+  void Unlock();
+
+private:
+  int fd;
+
+private:
+  cResultCacheLock(const cResultCacheLock&) = delete;
+  cResultCacheLock& operator=(const cResultCacheLock&) = delete;
+};
+
+}
@@ -7,4 +7,9 @@ namespace lumberjill {
 
 bool RunCommand(const std::string& executable, const std::vector<std::string>& arguments, std::string& out_standard, std::string& out_error);
 
+// Run a command that leaves a process running in the background, such as "btrfs scrub start" without -B
+// Its stdin, stdout and stderr are /dev/null so we only wait for the command itself to exit and not for the background process to close our pipes
+// Returns true if the command exited with 0
+bool RunCommandDetached(const std::string& executable, const std::vector<std::string>& arguments);
+
 }
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "diskstats.h"
+#include "mount_query.h"
+#include "settings.h"
+#include "stats.h"
+
+namespace lumberjill {
+
+// The last scrub of a volume as btrfs-progs records it in /var/lib/btrfs/scrub.status.<fsid>, which is also updated by scrubs started by hand
+class cScrubStatusFile {
+public:
+  cScrubStatusFile() : bFound(false), nStartTimestamp(0), bIsFinished(false), bIsCanceled(false) {}
+
+  bool bFound;
+  int64_t nStartTimestamp;  // Unix time, a resumed scrub keeps the time it was first started
+  bool bIsFinished;         // On every device
+  bool bIsCanceled;         // Stopped part way through, "btrfs scrub resume" carries on from where it got to
+};
+
+// Parse the lines for the volume with this fsid from a status file, returns false if it isn't a status file
+bool ParseScrubStatusFile(std::string_view contents, const std::string& sFSID, cScrubStatusFile& status);
+
+// Returns true if there are no windows or nMinuteOfDay is in one of them
+bool IsInScrubWindow(const std::vector<cScrubWindow>& windows, size_t nMinuteOfDay);
+
+// Work out the throughput, the time remaining and the errors found since the previous poll nIntervalMS ago
+// The kernel's counters start again from zero when a scrub is resumed
+void UpdateScrubThroughput(const cScrubDeviceProgress& previous, uint64_t nIntervalMS, cScrubDeviceProgress& progress);
+
+enum class SCRUB_ACTION {
+  NONE,
+  START,
+  RESUME,
+  PAUSE
+};
+
+// What we remember about the scrub of a volume between polls
+class cScrubGroupState {
+public:
+  cScrubGroupState() : bIsRunning(false), bIsOurs(false), nPausedTimestamp(0), nLastPollMS(0) {}
+
+  bool bIsRunning;
+  bool bIsOurs;                               // Started or resumed by us, scrubs started by hand are logged but left alone
+  int64_t nPausedTimestamp;                   // When we last paused it, 0 if we haven't
+  uint64_t nLastPollMS;
+  std::vector<cScrubDeviceProgress> devices;  // From the last poll
+};
+
+// Decide what to do with a volume's scrub, sReason is set to why it should be paused
+SCRUB_ACTION DecideScrubAction(const cScrubSettings& settings, int64_t nNow, size_t nMinuteOfDay, const cScrubGroupState& state, bool bIsRunning, const cScrubStatusFile& status, double dMaxAwaitMS, std::string& sReason);
+
+// Starts, throttles and pauses scrubs on the btrfs groups and logs their progress, this is only done by the daemon
+// Progress is read per device with BTRFS_IOC_SCRUB_PROGRESS, the scrubs themselves are run by "btrfs scrub start" and "btrfs scrub resume" because each device's scrub ioctl blocks until it is done
+class cScrubOrchestrator {
+public:
+  cScrubOrchestrator();
+  cScrubOrchestrator(const std::string& sSysFolder, const std::string& sStatusFolder);
+  ~cScrubOrchestrator();
+
+  // Mounts that don't respond to mountQueryPool before their deadline are skipped, the ioctls would hang the daemon's event loop too
+  void Poll(const cSettings& settings, const std::vector<cGroup>& groups, cMountQueryPool& mountQueryPool);
+
+private:
+  void PollGroup(const cSettings& settings, const cGroup& group, int64_t nNow, size_t nMinuteOfDay, uint64_t nNowMS, cScrubGroupState& state);
+  double GetMaxAwaitMS(const cGroup& group) const;
+  void SetSpeedLimit(const std::string& sMountPoint, const std::string& sFSID, const std::vector<cScrubDeviceProgress>& devices, size_t nBytesPerSecond);
+
+  std::string sSysFolder;
+  std::string sStatusFolder;
+
+  // Separate from the collection's so that the await covers the interval between polls
+  cDiskStatsCollector diskStatsCollector;
+
+  std::map<std::string, cScrubGroupState> mapMountPointToState;
+  std::set<std::string> speedLimitUnsupportedMounts;  // Only complain once about each mount
+  std::set<std::string> unresponsiveMounts;           // Only complain once each time a mount stops responding
+
+private:
+  cScrubOrchestrator(const cScrubOrchestrator&) = delete;
+  cScrubOrchestrator& operator=(const cScrubOrchestrator&) = delete;
+};
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "settings.h"
+#include "smartctl.h"
+#include "stats.h"
+
+namespace lumberjill {
+
+// Work out how a finished self-test went from its status in the self-test log
+SELF_TEST_RESULT GetSelfTestResult(const std::string& sStatus);
+
+// When a drive was last tested and the test that is running on it, plain data so that it can be written straight to the state file
+class cSelfTestDriveState {
+public:
+  cSelfTestDriveState() : nLastShortTimestamp(0), nLastLongTimestamp(0), nRunningStartTimestamp(0), nLastSeenTimestamp(0), nRunningType(0), nReserved(0) {}
+
+  int64_t nLastShortTimestamp;     // When the last test was started, a long test sets both
+  int64_t nLastLongTimestamp;
+  int64_t nRunningStartTimestamp;  // 0 if no test is running
+  int64_t nLastSeenTimestamp;
+  uint32_t nRunningType;           // The SELF_TEST_TYPE of the running test
+  uint32_t nReserved;
+};
+
+static_assert(sizeof(cSelfTestDriveState) == 40);
+
+class cSelfTestRequest {
+public:
+  cSelfTestRequest() : nGroup(0), bIsInStandby(false) {}
+
+  std::string sDevicePath;
+  std::string sController;  // Empty if unknown, then only the group limit applies
+  size_t nGroup;            // The index of the group the drive is in
+  bool bIsInStandby;        // A self-test would spin the drive up, it waits until the drive is active
+};
+
+// Starts SMART self-tests when they are due and checks on them in each collection
+// Only a few drives in each group and on each controller are tested at once, a long test reads the whole drive and slows down the array for hours
+class cSelfTestScheduler {
+public:
+  typedef std::function<bool(const std::string& sDevicePath, SELF_TEST_TYPE type)> StartFunction;
+  typedef std::function<bool(const std::string& sDevicePath, cSmartSelfTestStatus& status)> PollFunction;
+
+  cSelfTestScheduler();
+  ~cSelfTestScheduler();
+
+  // Read the state saved by a previous run, returns false if there isn't any
+  bool Load(const std::string& sFilePath);
+  bool Save(const std::string& sFilePath) const;
+
+  bool IsLoaded() const { return bIsLoaded; }
+
+  // Check on the running tests, then start the tests that are due with the most overdue first
+  // results is filled in for each drive with a test running, or that finished since the last update
+  void Update(const cSelfTestSettings& settings, int64_t nNow, const std::vector<cSelfTestRequest>& requests, const StartFunction& start, const PollFunction& poll, std::map<std::string, cDriveSelfTestStats>& results);
+
+private:
+  std::map<std::string, cSelfTestDriveState> drives;
+  bool bIsLoaded;
+
+private:
+  cSelfTestScheduler(const cSelfTestScheduler&) = delete;
+  cSelfTestScheduler& operator=(const cSelfTestScheduler&) = delete;
+};
+
+}
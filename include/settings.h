@@ -18,15 +18,194 @@ public:
 
 class cGroup {
 public:
-  cGroup() : type(GROUP_TYPE::SINGLE) {}
+  cGroup() : type(GROUP_TYPE::SINGLE), nMountTimeoutMS(5000), bAutoDiscoverDevices(false) {}
 
   GROUP_TYPE type;
   std::string sMountPoint;
+  size_t nMountTimeoutMS; // How long to wait for statvfs before giving up and marking the mount unresponsive
   std::vector<cDevice> devices;
+  bool bAutoDiscoverDevices; // "devices": "auto", the devices are found from the mount point at start up
+};
+
+// Optional active latency probe, a few small random O_DIRECT reads on each drive at idle I/O priority
+class cLatencyProbeSettings {
+public:
+  cLatencyProbeSettings() : bEnabled(false), nReads(32), nReadSizeBytes(4096), nReadsPerSecond(100), nOutlierFactor(3) {}
+
+  bool bEnabled;
+  size_t nReads;           // Reads per drive per collection
+  size_t nReadSizeBytes;   // Rounded up to the logical block size of the drive
+  size_t nReadsPerSecond;  // Rate limit for the reads on each drive
+  size_t nOutlierFactor;   // A drive is an outlier if its latency is this many times the median of the other drives in its group
+};
+
+// Optional low impact mode, the collector and every tool it runs get idle I/O and CPU priority so they don't disturb other work on the machine
+class cLowImpactSettings {
+public:
+  cLowImpactSettings() : bEnabled(false), bSchedIdle(true), nNice(19) {}
+
+  bool bEnabled;
+  bool bSchedIdle;                  // Use SCHED_IDLE as well as idle I/O priority
+  size_t nNice;                     // 0 to 19, 0 leaves the nice value alone
+  std::vector<size_t> cpus;         // Restrict to these CPUs, empty for any CPU
+  std::string sCgroupPath;          // A cgroup v2 folder such as "/sys/fs/cgroup/lumber-jill" to put child processes in, empty for none
+  std::vector<std::string> ioMax;   // Lines to write to io.max in the cgroup, such as "8:16 rbps=10485760 riops=200"
+};
+
+// How the smartctl queries in a collection are spread out, so that we don't send SMART commands to every disk behind an HBA or SAS expander at once
+class cSmartScheduleSettings {
+public:
+  cSmartScheduleSettings() : nWindowSeconds(0), nMaxPerController(1), nDeadlineSeconds(0), bSkipStandby(false) {}
+
+  size_t nWindowSeconds;     // Spread the queries over this long, 0 to start them as soon as possible
+  size_t nMaxPerController;  // How many queries can run at the same time on each controller
+  size_t nDeadlineSeconds;   // Queries that haven't started by this long after the collection started are skipped, 0 for no deadline
+  bool bSkipStandby;         // Don't spin up drives that are in standby, they are queried the next time they are active
+};
+
+// Optional regular SMART self-tests, staggered so that only a few drives in each group and on each controller are testing at once
+class cSelfTestSettings {
+public:
+  cSelfTestSettings() : bEnabled(false), sStateFilePath("/var/lib/lumber-jill/self_test.state"), nShortIntervalDays(7), nLongIntervalDays(30), nMaxPerGroup(1), nMaxPerController(1) {}
+
+  bool bEnabled;
+  std::string sStateFilePath;  // When each drive was last tested and the tests that are running, so that a restart doesn't start them again
+  size_t nShortIntervalDays;
+  size_t nLongIntervalDays;    // A long test counts as a short test too
+  size_t nMaxPerGroup;         // How many drives in a group can be testing at the same time
+  size_t nMaxPerController;
+};
+
+// How often the daemon samples drive temperatures between collections
+class cTemperatureSettings {
+public:
+  cTemperatureSettings() : nSampleIntervalSeconds(10), bUseIOUring(false) {}
+
+  size_t nSampleIntervalSeconds;
+  bool bUseIOUring;  // One io_uring submission per sample instead of a pread per drive, fewer syscalls but slower for sysfs
+};
+
+// Optional watching of the kernel log, a device with enough storage errors in a short time is collected straight away
+class cKernelLogSettings {
+public:
+  cKernelLogSettings() : bEnabled(false), nThreshold(5), nWindowSeconds(60), nCooldownSeconds(3600) {}
+
+  bool bEnabled;
+  size_t nThreshold;        // How many errors within the window trigger a collection
+  size_t nWindowSeconds;
+  size_t nCooldownSeconds;  // Don't trigger again for the same device until this long after the last time
+};
+
+// Optional detection of drives whose error counters or latency are rising unusually fast, compared to their own history and to the other drives in their group
+class cAnomalySettings {
+public:
+  cAnomalySettings() : bEnabled(false), sStateFilePath("/var/lib/lumber-jill/anomaly.state"), nHalfLifeSamples(14), nWarmupSamples(5), nThresholdSigma(4) {}
+
+  bool bEnabled;
+  std::string sStateFilePath;  // The baselines are kept here between runs
+  size_t nHalfLifeSamples;     // How many collections it takes for a sample's weight in a baseline to halve
+  size_t nWarmupSamples;       // Nothing is flagged until a drive has this many samples of a metric
+  size_t nThresholdSigma;      // How many standard deviations above its baseline, or above the group's median, a drive has to be
+};
+
+// Optional forecast of when each mount will be full, from how fast its free space has been going down
+class cCapacitySettings {
+public:
+  cCapacitySettings() : bEnabled(false), sStateFilePath("/var/lib/lumber-jill/capacity.state"), nHorizonDays(30), nTrendHalfLifeHours(72) {}
+
+  bool bEnabled;
+  std::string sStateFilePath;   // The fill rates are kept here between runs
+  size_t nHorizonDays;          // Warn when a mount is forecast to be full within this many days
+  size_t nTrendHalfLifeHours;   // How long it takes for a fill rate's weight in the trend to halve
+};
+
+// Optional per subvolume space accounting for btrfs groups, read natively from the quota tree, quotas have to be enabled with "btrfs quota enable"
+class cQgroupSettings {
+public:
+  cQgroupSettings() : bEnabled(false), nTop(10) {}
+
+  bool bEnabled;
+  size_t nTop;  // How many of the largest subvolumes to report, by referenced and by exclusive bytes
+};
+
+// A time of day that scrubs may run in, in minutes since local midnight, the end can be before the start for a window that spans midnight
+class cScrubWindow {
+public:
+  cScrubWindow() : nStartMinute(0), nEndMinute(0) {}
+
+  size_t nStartMinute;
+  size_t nEndMinute;
+};
+
+// Optional scrubbing of btrfs groups by the daemon, started in the windows and paused while the drives are busy with other work
+class cScrubSettings {
+public:
+  cScrubSettings() : bEnabled(false), nIntervalDays(30), nBandwidthLimitBytesPerSecond(0), nMaxAwaitMS(0), nPauseMinutes(15), nPollIntervalSeconds(60) {}
+
+  bool bEnabled;
+  size_t nIntervalDays;                  // Start a scrub this long after the last one started
+  size_t nBandwidthLimitBytesPerSecond;  // Per device limit written to scrub_speed_max in sysfs, 0 to leave it alone
+  std::vector<cScrubWindow> windows;     // Empty to scrub at any time
+  size_t nMaxAwaitMS;                    // Pause when a drive's read or write await goes above this, 0 to never pause for latency
+  size_t nPauseMinutes;                  // Wait at least this long after pausing before resuming
+  size_t nPollIntervalSeconds;           // How often the progress is checked and logged
+};
+
+// Optional Unix socket that the daemon serves the latest stats on, so that other local tools don't have to run smartctl themselves
+class cQuerySettings {
+public:
+  cQuerySettings() : bEnabled(false), sSocketPath("/run/lumber-jill/query.sock") {}
+
+  bool bEnabled;
+  std::string sSocketPath;
+};
+
+// What happens when records are logged faster than the sinks can write them
+enum class OUTPUT_POLICY {
+  BLOCK,        // Wait for space in the queue, nothing is lost
+  DROP_OLDEST,  // Throw away the oldest queued record
+  COALESCE,     // Replace a queued record of the same kind with the newer one, otherwise drop the oldest
+};
+
+enum class REMOTE_PROTOCOL {
+  TCP,  // Octet counted frames over a persistent connection, RFC 6587
+  UDP   // One message per datagram, RFC 5426
+};
+
+// Optional shipping of records straight to a remote syslog collector as RFC 5424 messages, so that a local rsyslog isn't needed to forward them
+class cRemoteSettings {
+public:
+  cRemoteSettings() : bEnabled(false), nPort(514), protocol(REMOTE_PROTOCOL::TCP), sSpoolFilePath("/var/spool/lumber-jill/remote.spool"), nSpoolSizeBytes(16 * 1024 * 1024), nReconnectMinMS(1000), nReconnectMaxMS(60 * 1000) {}
+
+  bool bEnabled;
+  std::string sHost;
+  size_t nPort;
+  REMOTE_PROTOCOL protocol;
+  std::string sSpoolFilePath;  // Records are kept here while the collector can't be reached, empty to drop them instead
+  size_t nSpoolSizeBytes;      // The oldest records are dropped when the spool is full
+  size_t nReconnectMinMS;      // The wait before reconnecting doubles after each failure, up to the max
+  size_t nReconnectMaxMS;
+};
+
+// Where log records are written, they are queued by the collectors and written by a separate thread so that a slow sink doesn't hold up a collection
+class cOutputSettings {
+public:
+  cOutputSettings() : nQueueSize(1024), policy(OUTPUT_POLICY::BLOCK), nBatchSize(64), bStdout(true), bSyslog(true) {}
+
+  size_t nQueueSize;
+  OUTPUT_POLICY policy;
+  size_t nBatchSize;      // The most records written to a sink at once
+  bool bStdout;
+  bool bSyslog;           // Also how records reach journald
+  std::string sFilePath;  // Append a JSON line per record to this file, empty for none
+  cRemoteSettings remote;
 };
 
 class cSettings {
 public:
+  cSettings();
+  ~cSettings();
+
   bool LoadFromFile(const std::string& sFilePath);
 
   bool IsValid() const;
@@ -34,8 +213,46 @@ public:
 
   const std::vector<cGroup>& GetGroups() const { return groups; }
 
+  // The executables to run, these can be overridden to point at other versions or the simulation tools
+  const std::string& GetSmartCtlPath() const { return sSmartCtlPath; }
+  const std::string& GetBtrfsPath() const { return sBtrfsPath; }
+
+  // How often the daemon does a full collection of every group
+  size_t GetDaemonIntervalSeconds() const { return nDaemonIntervalSeconds; }
+
+  const cLatencyProbeSettings& GetLatencyProbeSettings() const { return latencyProbeSettings; }
+  const cLowImpactSettings& GetLowImpactSettings() const { return lowImpactSettings; }
+  const cSmartScheduleSettings& GetSmartScheduleSettings() const { return smartScheduleSettings; }
+  const cSelfTestSettings& GetSelfTestSettings() const { return selfTestSettings; }
+  const cTemperatureSettings& GetTemperatureSettings() const { return temperatureSettings; }
+  const cKernelLogSettings& GetKernelLogSettings() const { return kernelLogSettings; }
+  const cAnomalySettings& GetAnomalySettings() const { return anomalySettings; }
+  const cCapacitySettings& GetCapacitySettings() const { return capacitySettings; }
+  const cQgroupSettings& GetQgroupSettings() const { return qgroupSettings; }
+  const cScrubSettings& GetScrubSettings() const { return scrubSettings; }
+  const cQuerySettings& GetQuerySettings() const { return querySettings; }
+  const cOutputSettings& GetOutputSettings() const { return outputSettings; }
+
 private:
   std::vector<cGroup> groups;
+
+  std::string sSmartCtlPath;
+  std::string sBtrfsPath;
+
+  size_t nDaemonIntervalSeconds;
+
+  cLatencyProbeSettings latencyProbeSettings;
+  cLowImpactSettings lowImpactSettings;
+  cSmartScheduleSettings smartScheduleSettings;
+  cSelfTestSettings selfTestSettings;
+  cTemperatureSettings temperatureSettings;
+  cKernelLogSettings kernelLogSettings;
+  cAnomalySettings anomalySettings;
+  cCapacitySettings capacitySettings;
+  cQgroupSettings qgroupSettings;
+  cScrubSettings scrubSettings;
+  cQuerySettings querySettings;
+  cOutputSettings outputSettings;
 };
 
 }
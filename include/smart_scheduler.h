@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "stats.h"
+
+namespace lumberjill {
+
+class cSmartQueryRequest {
+public:
+  std::string sDevicePath;
+  std::string sController; // Queries on the same controller are limited, empty if unknown
+};
+
+// The devices that still have a smartctl call running, shared by every collection for as long as the daemon runs
+// A call that is abandoned at a deadline carries on in the background, its device stays in here until it returns so that at most one call is ever stuck on each drive
+class cSmartDevicesInFlight {
+public:
+  cSmartDevicesInFlight();
+  ~cSmartDevicesInFlight();
+
+  // Returns false if the device already has a call running
+  bool TryAdd(const std::string& sDevicePath);
+  void Remove(const std::string& sDevicePath);
+
+  bool IsInFlight(const std::string& sDevicePath) const;
+
+private:
+  mutable std::mutex mutex;
+  std::set<std::string> devices;
+
+private:
+  cSmartDevicesInFlight(const cSmartDevicesInFlight&) = delete;
+  cSmartDevicesInFlight& operator=(const cSmartDevicesInFlight&) = delete;
+};
+
+// Run one smartctl call for a device on its own thread, such as starting a self-test, and wait for it until the timeout or until bStopRequested is set
+// A timeout of 0 waits for as long as the call takes, a call that is still running when we stop waiting is left to finish on its own and call must only use its own copies
+// Returns SKIPPED if the device already has a call in flight, TIMED_OUT if we stopped waiting, and OK or ERROR for what call returned
+SMART_QUERY_RESULT RunSmartCall(const std::shared_ptr<cSmartDevicesInFlight>& devicesInFlight, const std::string& sDevicePath, std::chrono::milliseconds timeout, const std::atomic<bool>& bStopRequested, std::function<bool()> call);
+
+// Spreads the smartctl queries for a collection across a window, with a limit on how many run at once on each controller
+// The start times are deterministic, each controller's drives are evenly spaced across the window in an order based on a hash of their paths
+class cSmartScheduler {
+public:
+  typedef std::function<bool(const std::string& sDevicePath, cSmartCtlStats& smartctlStats)> QueryFunction;
+
+  cSmartScheduler(std::chrono::milliseconds window, size_t nMaxPerController, std::chrono::milliseconds deadline, QueryFunction query);
+  cSmartScheduler(std::chrono::milliseconds window, size_t nMaxPerController, std::chrono::milliseconds deadline, QueryFunction query, std::shared_ptr<cSmartDevicesInFlight> devicesInFlight);
+  ~cSmartScheduler();
+
+  // Work out when each query should start
+  void Plan(const std::vector<cSmartQueryRequest>& requests, cSmartSchedule& schedule) const;
+
+  // Run the queries in the schedule, filling in when they actually ran and the results for each device path
+  // Queries that haven't started by the deadline are skipped, queries that are still running at the deadline are timed out and left to finish on their own
+  // Devices that still have a call running from an earlier run are skipped
+  void Run(cSmartSchedule& schedule, std::map<std::string, cSmartCtlStats>& results) const;
+
+  // The same, but bStopRequested being set ends the run early as if the deadline had been reached
+  void Run(cSmartSchedule& schedule, std::map<std::string, cSmartCtlStats>& results, const std::atomic<bool>& bStopRequested) const;
+
+private:
+  void RunUntil(cSmartSchedule& schedule, std::map<std::string, cSmartCtlStats>& results, const std::atomic<bool>* pStopRequested) const;
+
+  const std::chrono::milliseconds window;
+  const size_t nMaxPerController;
+  const std::chrono::milliseconds deadline;
+  const QueryFunction query;
+  const std::shared_ptr<cSmartDevicesInFlight> devicesInFlight;
+
+private:
+  cSmartScheduler(const cSmartScheduler&) = delete;
+  cSmartScheduler& operator=(const cSmartScheduler&) = delete;
+};
+
+}
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstdint>
+#include <map>
+#include <optional>
 #include <string>
 #include <string_view>
 
@@ -7,14 +10,60 @@
 
 namespace lumberjill {
 
+// Whether a drive is running a self-test and the newest entry in its self-test log
+class cSmartSelfTestStatus {
+public:
+  cSmartSelfTestStatus() : bIsInProgress(false), bHasLastEntry(false) {}
+
+  bool bIsInProgress;
+  std::optional<size_t> nRemainingPercent;  // While a test is in progress, if the drive says
+
+  bool bHasLastEntry;
+  std::string sLastDescription;             // "Short offline", "Extended offline", "Short"
+  std::string sLastStatus;                  // "Completed without error", "Completed: read failure"
+  std::optional<uint64_t> nLastPowerOnHours;
+  std::optional<uint64_t> nLastFirstErrorLBA;
+};
+
 namespace smartctl {
 
 // Parse the output of "smartctl -A /dev/sdf" to collect some important smart stats for a drive
+// The "Device is in STANDBY mode" message from "smartctl -n standby" sets bIsInStandby
 bool ParseDriveSmartControlData(std::string_view view, cSmartCtlStats& smartctlStats);
 
 // Runs "smartctl -A /dev/sdf" to collect some important smart stats for a drive
-bool GetDriveSmartControlData(const std::string& sDevicePath, cSmartCtlStats& smartctlStats);
+// If bSkipStandby is set this runs "smartctl -n standby -A /dev/sdf" instead, which checks the power mode first and doesn't spin up a drive that is in standby
+bool GetDriveSmartControlData(const std::string& sSmartCtlPath, const std::string& sDevicePath, bool bSkipStandby, cSmartCtlStats& smartctlStats);
+
+
+// Parse the output of "smartctl -c -l selftest /dev/sdf" for the self-test execution status and the newest self-test log entry, ATA and NVMe drives
+// Returns false if neither was found
+bool ParseDriveSelfTestStatus(std::string_view view, cSmartSelfTestStatus& status);
+
+// Runs "smartctl -c -l selftest /dev/sdf"
+bool GetDriveSelfTestStatus(const std::string& sSmartCtlPath, const std::string& sDevicePath, cSmartSelfTestStatus& status);
+
+// Runs "smartctl -t short /dev/sdf" or "smartctl -t long /dev/sdf", which return as soon as the drive has started the test
+bool StartDriveSelfTest(const std::string& sSmartCtlPath, const std::string& sDevicePath, SELF_TEST_TYPE type);
 
 }
 
+// Remembers the last values read from each drive, so that a drive in standby can still be reported along with how old its values are
+class cSmartCtlSampleCache {
+public:
+  // Remember the values if the drive was active, or fill in the last values we have if it was in standby
+  void Update(const std::string& sDevicePath, uint64_t nNowMS, cSmartCtlStats& smartctlStats);
+
+private:
+  class cSample {
+  public:
+    cSample() : nTimeMS(0) {}
+
+    cSmartCtlStats stats;
+    uint64_t nTimeMS;
+  };
+
+  std::map<std::string, cSample> mapDrivePathToSample;
+};
+
 }
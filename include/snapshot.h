@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "stats.h"
+
+namespace lumberjill {
+
+// A snapshot along with its JSON and OpenMetrics forms, which are built once when it is published so that answering a query is just a copy
+// This is never modified after it is published, readers can hold on to it for as long as they need it
+class cPublishedSnapshot {
+public:
+  explicit cPublishedSnapshot(cStatsSnapshot&& snapshot);
+  ~cPublishedSnapshot();
+
+  const cStatsSnapshot snapshot;
+  const std::string sJSON;
+  const std::string sOpenMetrics;
+
+private:
+  cPublishedSnapshot(const cPublishedSnapshot&) = delete;
+  cPublishedSnapshot& operator=(const cPublishedSnapshot&) = delete;
+};
+
+// Holds the latest snapshot, the collector publishes a new one after each full collection and the query server reads it
+// Publishing builds the next snapshot off to the side and swaps it in with a single atomic pointer exchange, readers never wait for a collector to finish building one
+// and a collector never waits for a slow reader, the old snapshot is freed when the last reader lets go of it
+class cSnapshotStore {
+public:
+  cSnapshotStore();
+  ~cSnapshotStore();
+
+  // Give the snapshot the next sequence number and make it the latest
+  // Safe to call from several collectors at once, if a snapshot with a later sequence number has already been published this one is dropped
+  // Returns false if it was dropped
+  bool Publish(cStatsSnapshot&& snapshot);
+
+  // The latest snapshot, or nullptr if nothing has been published yet
+  std::shared_ptr<const cPublishedSnapshot> GetLatest() const;
+
+  // The sequence number of the latest snapshot, 0 if nothing has been published yet
+  uint64_t GetLatestSequence() const { return nLatestSequence.load(std::memory_order_acquire); }
+
+private:
+  std::atomic<std::shared_ptr<const cPublishedSnapshot>> latest;
+  std::atomic<uint64_t> nLatestSequence;
+  std::atomic<uint64_t> nNextSequence;
+
+private:
+  cSnapshotStore(const cSnapshotStore&) = delete;
+  cSnapshotStore& operator=(const cSnapshotStore&) = delete;
+};
+
+// One per reading thread, keeps a reference to the snapshot it last read
+// Loading the shared pointer from the store touches its reference count, which every reader would otherwise be fighting over, this only does that when a new snapshot has been published
+class cSnapshotReader {
+public:
+  explicit cSnapshotReader(const cSnapshotStore& store);
+  ~cSnapshotReader();
+
+  // The latest snapshot, or nullptr if nothing has been published yet
+  const std::shared_ptr<const cPublishedSnapshot>& Get();
+
+private:
+  const cSnapshotStore& store;
+  std::shared_ptr<const cPublishedSnapshot> current;
+  uint64_t nCurrentSequence;
+
+private:
+  cSnapshotReader(const cSnapshotReader&) = delete;
+  cSnapshotReader& operator=(const cSnapshotReader&) = delete;
+};
+
+}
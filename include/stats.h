@@ -1,28 +1,138 @@
 #pragma once
 
+#include <cstdint>
 #include <map>
 #include <optional>
 #include <string>
+#include <vector>
 
 namespace lumberjill {
 
 class cSmartCtlStats {
 public:
+  cSmartCtlStats() : bIsInStandby(false) {}
+
   void Clear()
   {
+    bIsInStandby = false;
+    nSampleAgeSeconds.reset();
     nRaw_Read_Error_Rate.reset();
     nSeek_Error_Rate.reset();
     nOffline_Uncorrectable.reset();
+    nTemperature_Celsius.reset();
+  }
+
+  bool HasValues() const
+  {
+    return (nRaw_Read_Error_Rate.has_value() || nSeek_Error_Rate.has_value() || nOffline_Uncorrectable.has_value() || nTemperature_Celsius.has_value());
   }
 
+  bool bIsInStandby;                          // The drive was spun down so it was left alone, the values are from the last time it was active
+  std::optional<uint64_t> nSampleAgeSeconds;  // How old the values are if the drive was in standby
+
   std::optional<size_t> nRaw_Read_Error_Rate;
   std::optional<size_t> nSeek_Error_Rate;
   std::optional<size_t> nOffline_Uncorrectable;
+  std::optional<size_t> nTemperature_Celsius; // Reported through cDriveTemperatureStats when the drive has no hwmon device
+};
+
+// I/O performance of a drive averaged over the sampling interval, similar to "iostat -x"
+class cDiskIOStats {
+public:
+  cDiskIOStats() : dReadIOPS(0.0), dWriteIOPS(0.0), dReadBytesPerSecond(0.0), dWriteBytesPerSecond(0.0), dReadAwaitMS(0.0), dWriteAwaitMS(0.0), dQueueDepth(0.0), dUtilisationPercent(0.0) {}
+
+  double dReadIOPS;
+  double dWriteIOPS;
+  double dReadBytesPerSecond;
+  double dWriteBytesPerSecond;
+  double dReadAwaitMS;         // Average time for a read request to complete, including time in the queue
+  double dWriteAwaitMS;
+  double dQueueDepth;          // Average number of requests in flight
+  double dUtilisationPercent;  // Percentage of the interval that the drive was busy
+};
+
+// Results of the active latency probe for a drive
+class cDriveLatencyStats {
+public:
+  cDriveLatencyStats() : nReads(0), nP50US(0), nP99US(0), nMaxUS(0), bIsOutlier(false) {}
+
+  size_t nReads;    // In the drive's distribution, which covers the recent collections
+  uint64_t nP50US;
+  uint64_t nP99US;
+  uint64_t nMaxUS;
+  bool bIsOutlier; // Much slower than the other drives in the same group
+};
+
+enum class TEMPERATURE_SOURCE {
+  HWMON, // Sampled from the drive's hwmon device between collections
+  SMART  // A single reading from the smartctl attributes
+};
+
+// Drive temperature over the reporting window
+class cDriveTemperatureStats {
+public:
+  cDriveTemperatureStats() : source(TEMPERATURE_SOURCE::HWMON), nSamples(0), dCurrentCelsius(0.0), dMinCelsius(0.0), dMaxCelsius(0.0), dAverageCelsius(0.0) {}
+
+  TEMPERATURE_SOURCE source;
+  size_t nSamples;
+  double dCurrentCelsius;
+  double dMinCelsius;
+  double dMaxCelsius;
+  double dAverageCelsius;
+};
+
+enum class ANOMALY_KIND {
+  SELF,  // Rising faster than the drive's own history
+  PEERS  // Rising faster than the other drives in its group
+};
+
+// A metric of a drive that is well outside what is expected of it
+class cDriveAnomaly {
+public:
+  cDriveAnomaly() : kind(ANOMALY_KIND::SELF), dValue(0.0), dExpected(0.0), dScore(0.0) {}
+
+  std::string sMetric;  // The name of the value in the record, such as "read_io_errs"
+  ANOMALY_KIND kind;
+  double dValue;        // The latest rate for SELF, the drive's average rate for PEERS, counters are per day
+  double dExpected;     // The drive's average rate for SELF, the group's median for PEERS
+  double dScore;        // How many standard deviations above what was expected
+};
+
+enum class SELF_TEST_TYPE {
+  SHORT,
+  LONG
+};
+
+enum class SELF_TEST_RESULT {
+  RUNNING,
+  PASSED,
+  FAILED,
+  ABORTED  // Interrupted by a reset or a command from the host, it is run again
+};
+
+// A SMART self-test that we started, reported while it runs and in the collection after it finishes
+class cDriveSelfTestStats {
+public:
+  cDriveSelfTestStats() : type(SELF_TEST_TYPE::SHORT), result(SELF_TEST_RESULT::RUNNING), nStartTimestamp(0) {}
+
+  SELF_TEST_TYPE type;
+  SELF_TEST_RESULT result;
+  int64_t nStartTimestamp;
+  std::optional<size_t> nRemainingPercent;  // While it is running
+  std::string sStatus;                      // From the self-test log once it has finished, "Completed: read failure"
+  std::optional<uint64_t> nPowerOnHours;
+  std::optional<uint64_t> nFirstErrorLBA;
 };
 
 class cDriveStats {
 public:
-  cDriveStats() : bIsPresent(true) {}
+  cDriveStats();
+  cDriveStats(const cDriveStats& rhs);
+  cDriveStats(cDriveStats&& rhs);
+  ~cDriveStats();
+
+  cDriveStats& operator=(const cDriveStats& rhs);
+  cDriveStats& operator=(cDriveStats&& rhs);
 
   std::string sName;
   std::string sDevicePath;
@@ -30,11 +140,38 @@ public:
   bool bIsPresent;
 
   cSmartCtlStats smartCtlStats;
+
+  std::optional<cDiskIOStats> diskIOStats;
+
+  std::optional<cDriveLatencyStats> latencyStats;
+
+  std::optional<cDriveTemperatureStats> temperatureStats;
+
+  std::vector<cDriveAnomaly> anomalies;  // Only filled in when anomaly detection is enabled
+
+  std::optional<cDriveSelfTestStats> selfTestStats;
+};
+
+enum class CAPACITY_BASIS {
+  FREE,        // The free space from statvfs
+  UNALLOCATED  // Space on the btrfs devices that isn't allocated to a data or metadata chunk yet, btrfs runs out of space when this does even if statvfs shows free space
+};
+
+// How fast a mount is filling up and when it will be full at that rate
+class cCapacityForecast {
+public:
+  cCapacityForecast() : basis(CAPACITY_BASIS::FREE), nAvailableBytes(0), dFillRateBytesPerDay(0.0), bIsAlert(false) {}
+
+  CAPACITY_BASIS basis;
+  size_t nAvailableBytes;               // The free or unallocated space that the forecast is for
+  double dFillRateBytesPerDay;          // Negative if space is being freed
+  std::optional<double> dDaysToFull;    // Only if the mount is filling up
+  bool bIsAlert;                        // Forecast to be full within the horizon
 };
 
 class cMountStats {
 public:
-  cMountStats() : nFreeBytes(0), nTotalBytes(0) {}
+  cMountStats() : bIsResponsive(true), nFreeBytes(0), nTotalBytes(0) {}
 
   void ClearSpaceStats()
   {
@@ -44,8 +181,14 @@ public:
 
   std::string sMountPoint;
 
+  // False if the mount did not respond to statvfs in time, for example a dead network mount
+  bool bIsResponsive;
+
   std::optional<size_t> nFreeBytes;
   std::optional<size_t> nTotalBytes;
+  std::optional<size_t> nUnallocatedBytes;  // Only for btrfs mounts with capacity forecasting enabled
+
+  std::optional<cCapacityForecast> capacityForecast;
 
   std::map<std::string, cDriveStats> mapDrivePathToDriveStats;
 };
@@ -76,12 +219,215 @@ public:
   std::map<std::string, cBtrfsDriveStats> mapDrivePathToBtrfsDriveStats;
 };
 
+// The space used by one subvolume, from its level 0 qgroup
+class cBtrfsSubvolumeUsage {
+public:
+  cBtrfsSubvolumeUsage() : nSubvolumeId(0), nReferencedBytes(0), nExclusiveBytes(0), nMaxReferencedBytes(0), nMaxExclusiveBytes(0) {}
+
+  uint64_t nSubvolumeId;
+  std::string sName;                             // Empty if the subvolume has been deleted but its qgroup is still there
+  uint64_t nReferencedBytes;                     // All of the data the subvolume can see, including data shared with snapshots
+  uint64_t nExclusiveBytes;                      // Only in this subvolume, what deleting it would free
+  std::optional<int64_t> nReferencedChangeBytes; // Since the previous collection, not set for the first collection or a new subvolume
+  std::optional<int64_t> nExclusiveChangeBytes;
+  uint64_t nMaxReferencedBytes;                  // 0 if there is no limit
+  uint64_t nMaxExclusiveBytes;
+};
+
+class cBtrfsQgroupStats {
+public:
+  cBtrfsQgroupStats() : nSubvolumes(0) {}
+
+  size_t nSubvolumes;
+  std::vector<cBtrfsSubvolumeUsage> topReferenced;  // The largest first
+  std::vector<cBtrfsSubvolumeUsage> topExclusive;
+};
+
+enum class SCRUB_STATE {
+  RUNNING,
+  PAUSED,   // Cancelled by us, it is resumed from where it got to
+  FINISHED
+};
+
+// The progress of a scrub on one device of a btrfs volume, from BTRFS_IOC_SCRUB_PROGRESS
+class cScrubDeviceProgress {
+public:
+  cScrubDeviceProgress() : nDeviceId(0), nBytesScrubbed(0), nBytesToScrub(0), nReadErrors(0), nCsumErrors(0), nVerifyErrors(0), nSuperErrors(0), nUncorrectableErrors(0), nCorrectedErrors(0), nNewErrors(0) {}
+
+  // The errors found so far that could mean latent corruption
+  uint64_t GetErrors() const { return nReadErrors + nCsumErrors + nVerifyErrors + nSuperErrors; }
+
+  uint64_t nDeviceId;
+  std::string sPath;
+  uint64_t nBytesScrubbed;
+  uint64_t nBytesToScrub;                 // Allocated on the device, the scrub reads every chunk
+  std::optional<double> dBytesPerSecond;  // Since the previous poll, not set for the first poll
+  std::optional<double> dETASeconds;      // Not set while there is no throughput
+  uint64_t nReadErrors;
+  uint64_t nCsumErrors;
+  uint64_t nVerifyErrors;
+  uint64_t nSuperErrors;
+  uint64_t nUncorrectableErrors;
+  uint64_t nCorrectedErrors;
+  uint64_t nNewErrors;                    // Found since the previous poll
+};
+
+class cScrubStats {
+public:
+  cScrubStats() : state(SCRUB_STATE::RUNNING) {}
 
+  SCRUB_STATE state;
+  std::string sReason;  // Why it was paused
+  std::vector<cScrubDeviceProgress> devices;
+};
+
+
+// The stats for one group from a full collection
+class cGroupStats {
+public:
+  cGroupStats() : bHasBtrfsStats(false) {}
+
+  cMountStats mountStats;
+  bool bHasBtrfsStats;
+  cBtrfsVolumeStats btrfsVolumeStats;
+};
+
+// Everything from one full collection, this is what the daemon serves to other local tools
+class cStatsSnapshot {
+public:
+  cStatsSnapshot() : nSequence(0), nTimestamp(0) {}
+
+  uint64_t nSequence;  // Counts up from 1 with each collection
+  int64_t nTimestamp;  // Unix time when the collection finished
+  std::vector<cGroupStats> groups;
+};
+
+
+// How one output sink kept up since the last collection, the latency is from a record being queued to it being written
+class cOutputSinkStats {
+public:
+  cOutputSinkStats() : nRecords(0), nBatches(0), nErrors(0), nTotalLatencyUS(0), nMaxLatencyUS(0), nSpooled(0) {}
+
+  std::string sName;
+  uint64_t nRecords;
+  uint64_t nBatches;
+  uint64_t nErrors;
+  uint64_t nTotalLatencyUS;
+  uint64_t nMaxLatencyUS;
+  uint64_t nSpooled;  // Records waiting for the remote collector to come back
+};
+
+// How the output queue kept up since the last collection
+class cOutputStats {
+public:
+  cOutputStats() : bEnabled(false), nQueued(0), nDropped(0), nCoalesced(0), nMaxQueueDepth(0), nBlockedUS(0), nSerialiseUS(0) {}
+
+  bool bEnabled;
+  uint64_t nQueued;
+  uint64_t nDropped;        // Thrown away because the queue was full
+  uint64_t nCoalesced;      // Replaced by a newer record of the same kind
+  uint64_t nMaxQueueDepth;
+  uint64_t nBlockedUS;      // Time the collectors spent waiting for space in the queue
+  uint64_t nSerialiseUS;    // Time spent creating the JSON, once per record however many sinks there are
+  std::vector<cOutputSinkStats> sinks;
+};
+
+// What a full collection cost, so that the impact of low impact mode can be measured
+class cCollectionStats {
+public:
+  cCollectionStats() : bIsLowImpact(false), nDurationMS(0), nCPUMS(0), nChildCPUMS(0), nChildReadBytes(0), nChildWriteBytes(0) {}
+
+  bool bIsLowImpact;
+  uint64_t nDurationMS;
+  uint64_t nCPUMS;            // User and system time of lumber-jill itself
+  uint64_t nChildCPUMS;       // User and system time of smartctl, btrfs, etc.
+  uint64_t nChildReadBytes;   // Read from storage by the child processes
+  uint64_t nChildWriteBytes;
+  cOutputStats outputStats;
+};
+
+enum class SMART_QUERY_RESULT {
+  OK,
+  ERROR,
+  STANDBY,   // The drive was spun down so smartctl left it alone
+  SKIPPED,   // Not started before the deadline
+  TIMED_OUT  // Still running at the deadline, its result is ignored
+};
+
+// When a smartctl query was planned to run and when it actually ran, relative to the start of the collection
+class cSmartScheduleEntry {
+public:
+  cSmartScheduleEntry() : nOffsetMS(0), nStartMS(0), nDurationMS(0), result(SMART_QUERY_RESULT::SKIPPED) {}
+
+  std::string sDevicePath;
+  std::string sController;
+  uint64_t nOffsetMS;
+  uint64_t nStartMS;
+  uint64_t nDurationMS;
+  SMART_QUERY_RESULT result;
+};
+
+class cSmartSchedule {
+public:
+  cSmartSchedule() : nWindowMS(0), nDeadlineMS(0), nMaxPerController(1), nDurationMS(0) {}
+
+  uint64_t nWindowMS;
+  uint64_t nDeadlineMS;
+  size_t nMaxPerController;
+  uint64_t nDurationMS;
+  std::vector<cSmartScheduleEntry> entries; // In the order they were planned to start
+};
+
+// The storage errors the kernel has logged for a device, counted by the daemon from /dev/kmsg
+class cKernelErrorStats {
+public:
+  cKernelErrorStats() : nIOErrors(0), nMediumErrors(0), nATAErrors(0), nLinkResets(0), nTimeouts(0), nBtrfsErrors(0), nErrorsInWindow(0), nWindowSeconds(0) {}
+
+  uint64_t nIOErrors;
+  uint64_t nMediumErrors;
+  uint64_t nATAErrors;
+  uint64_t nLinkResets;
+  uint64_t nTimeouts;
+  uint64_t nBtrfsErrors;
+  uint64_t nErrorsInWindow;
+  uint64_t nWindowSeconds;
+};
 
 std::string GetJSONMountStats(const cMountStats& mountStats);
 std::string GetJSONBtrfsStats(const cMountStats& mountStats, const cBtrfsVolumeStats& btrfsVolumeStats);
+std::string GetJSONDriveEvent(const std::string& sEvent, const std::string& sMountPoint, const std::string& sName, const std::string& sDevicePath);
+std::string GetJSONCollectionStats(const cCollectionStats& collectionStats);
+std::string GetJSONSmartSchedule(const cSmartSchedule& schedule);
+std::string GetJSONStatsSnapshot(const cStatsSnapshot& snapshot);
+
+// The entry for one drive, empty if the drive is not in the snapshot
+std::string GetJSONStatsSnapshotDrive(const cStatsSnapshot& snapshot, const std::string& sDrivePath);
+
+// The OpenMetrics text format, for one drive and its mount if sDrivePath is not empty
+// Empty if the drive is not in the snapshot
+std::string GetOpenMetricsStatsSnapshot(const cStatsSnapshot& snapshot, const std::string& sDrivePath);
+
+std::string GetJSONKernelErrors(const std::string& sMountPoint, const std::string& sName, const std::string& sDevicePath, const cKernelErrorStats& kernelErrorStats, const std::string& sMessage);
+std::string GetJSONDriveAnomalies(const std::string& sMountPoint, const std::string& sName, const std::string& sDevicePath, const std::vector<cDriveAnomaly>& anomalies);
+std::string GetJSONCapacityAlert(const cMountStats& mountStats, size_t nHorizonDays);
+std::string GetJSONBtrfsQgroupStats(const std::string& sMountPoint, const cBtrfsQgroupStats& qgroupStats);
+std::string GetJSONDriveSelfTest(const std::string& sMountPoint, const std::string& sName, const std::string& sDevicePath, const cDriveSelfTestStats& selfTestStats);
+std::string GetJSONScrubStats(const std::string& sMountPoint, const cScrubStats& scrubStats);
 
 bool LogStatsToSyslogMountStats(const cMountStats& mountStats);
 bool LogStatsToSyslogMountStatsAndBtrfsStats(const cMountStats& mountStats, const cBtrfsVolumeStats& btrfsVolumeStats);
 
+// The same records for a mount with only sDevicePath in it, these are coalesced separately from the records of the whole mount
+bool LogStatsToSyslogDeviceStats(const cMountStats& mountStats, const std::string& sDevicePath);
+bool LogStatsToSyslogDeviceStatsAndBtrfsStats(const cMountStats& mountStats, const cBtrfsVolumeStats& btrfsVolumeStats, const std::string& sDevicePath);
+bool LogDriveEventToSyslog(const std::string& sEvent, const std::string& sMountPoint, const std::string& sName, const std::string& sDevicePath);
+bool LogCollectionStatsToSyslog(const cCollectionStats& collectionStats);
+bool LogSmartScheduleToSyslog(const cSmartSchedule& schedule);
+bool LogKernelErrorsToSyslog(const std::string& sMountPoint, const std::string& sName, const std::string& sDevicePath, const cKernelErrorStats& kernelErrorStats, const std::string& sMessage);
+bool LogDriveAnomaliesToSyslog(const std::string& sMountPoint, const std::string& sName, const std::string& sDevicePath, const std::vector<cDriveAnomaly>& anomalies);
+bool LogCapacityAlertToSyslog(const cMountStats& mountStats, size_t nHorizonDays);
+bool LogBtrfsQgroupStatsToSyslog(const std::string& sMountPoint, const cBtrfsQgroupStats& qgroupStats);
+bool LogDriveSelfTestToSyslog(const std::string& sMountPoint, const std::string& sName, const std::string& sDevicePath, const cDriveSelfTestStats& selfTestStats);
+bool LogScrubStatsToSyslog(const std::string& sMountPoint, const cScrubStats& scrubStats);
+
 }
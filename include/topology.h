@@ -0,0 +1,94 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "settings.h"
+
+namespace lumberjill {
+
+// A disk or partition found in sysfs
+class cBlockDevice {
+public:
+  cBlockDevice() : bIsPartition(false), bIsRotational(false) {}
+
+  std::string sNode;        // "sdb1"
+  std::string sDiskNode;    // "sdb", the same as sNode for whole disks
+  std::string sStableName;  // "ata-ST6000VN001-2BB186_ZR10KNTX-part1" from /dev/disk/by-id, empty if there isn't one
+  bool bIsPartition;
+  bool bIsRotational;
+  std::string sBtrfsFSID;   // Empty if this device is not part of a btrfs file system
+  std::string sController;  // The PCI address of the HBA or host the disk is attached to, "0000:03:00.0", empty if unknown
+};
+
+class cMountInfo {
+public:
+  std::string sFileSystemType; // "btrfs"
+  std::string sSource;         // "/dev/sdb"
+};
+
+// An index of the block devices, btrfs file systems and mounts on this machine
+// This is built once and kept until Invalidate is called (For example when a drive is plugged in or removed)
+class cTopology {
+public:
+  cTopology();
+  cTopology(const std::string& sSysFolder, const std::string& sDevFolder, const std::string& sMountInfoFilePath);
+  ~cTopology();
+
+  // Scan /sys/block, /sys/fs/btrfs/*/devices, /dev/disk/by-id and /proc/self/mountinfo
+  bool Scan();
+
+  // Mark the topology as out of date, the next RefreshIfStale will scan again
+  void Invalidate() { bIsStale = true; }
+  bool IsStale() const { return bIsStale; }
+  bool RefreshIfStale();
+
+  const std::vector<cBlockDevice>& GetBlockDevices() const { return blockDevices; }
+  const cBlockDevice* FindBlockDevice(std::string_view node) const;
+
+  // Get the devices to monitor for a mount, all of the btrfs devices for a btrfs mount or the disk that the mount is on for any other mount
+  // Each device's path is its /dev/disk/by-id link if it has one, so that it stays the same across reboots
+  bool GetDevicesForMountPoint(const std::string& sMountPoint, GROUP_TYPE type, std::vector<cDevice>& devices) const;
+
+  // Fill in the devices for groups that have "devices": "auto", other groups are copied as is
+  bool ResolveGroups(const std::vector<cGroup>& groups, std::vector<cGroup>& outGroups) const;
+
+private:
+  void Clear();
+  bool ScanBlockDevices();
+  void ScanStableNames();
+  void ScanBtrfsFileSystems();
+  bool ScanMountInfo();
+  std::string GetDevicePath(const cBlockDevice& blockDevice) const;
+
+  std::string sSysFolder;
+  std::string sDevFolder;
+  std::string sMountInfoFilePath;
+
+  bool bIsStale;
+
+  std::vector<cBlockDevice> blockDevices;
+  std::map<std::string, size_t, std::less<>> mapNodeToBlockDeviceIndex;
+  std::map<std::string, cMountInfo> mapMountPointToMountInfo;
+};
+
+// Get the controller from the sysfs path of a block device, this is the PCI address closest to the disk, or the SCSI host if there is no PCI address
+// "../devices/pci0000:00/0000:00:01.0/0000:03:00.0/host7/port-7:0/expander-7:0/port-7:0:3/end_device-7:0:3/target7:0:3/7:0:3:0/block/sdd" -> "0000:03:00.0"
+std::string GetControllerFromSysfsPath(std::string_view path);
+
+// Get the controller of a block device such as "sdd" from /sys/class/block
+std::string GetBlockDeviceController(const std::string& sSysFolder, const std::string& sNode);
+
+// Get the names the kernel uses in its log for the port or controller a disk is attached to, "ata3" for a SATA port and "nvme0" for an NVMe controller
+// "../devices/pci0000:00/0000:00:17.0/ata3/host2/target2:0:0/2:0:0:0/block/sdc" -> { "ata3" }
+std::vector<std::string> GetKernelNamesFromSysfsPath(std::string_view path);
+
+// Get the kernel log names of the port or controller of a block device such as "sdc" from /sys/class/block
+std::vector<std::string> GetBlockDeviceKernelNames(const std::string& sSysFolder, const std::string& sNode);
+
+// Unescape a mount point from /proc/self/mountinfo, spaces, tabs, newlines and backslashes are octal escaped
+std::string UnescapeMountInfoPath(std::string_view path);
+
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lumberjill {
+
+// A kernel uevent, something like this for a drive being unplugged:
+// remove@/devices/pci0000:00/0000:00:17.0/ata3/host2/target2:0:0/2:0:0:0/block/sdc
+// ACTION=remove
+// DEVPATH=/devices/pci0000:00/0000:00:17.0/ata3/host2/target2:0:0/2:0:0:0/block/sdc
+// SUBSYSTEM=block
+// DEVNAME=sdc
+// DEVTYPE=disk
+// SEQNUM=4123
+class cUEvent {
+public:
+  cUEvent();
+  cUEvent(const cUEvent& rhs);
+  cUEvent(cUEvent&& rhs);
+  ~cUEvent();
+
+  cUEvent& operator=(const cUEvent& rhs);
+  cUEvent& operator=(cUEvent&& rhs);
+
+  void Clear();
+
+  bool IsBlockDevice() const { return (sSubsystem == "block"); }
+
+  std::string sAction;    // "add", "remove", "change", ...
+  std::string sDevPath;   // The sysfs path
+  std::string sSubsystem; // "block"
+  std::string sDevName;   // "sdc"
+  std::string sDevType;   // "disk" or "partition"
+};
+
+// Parse a uevent message, the fields are separated by null characters
+bool ParseUEvent(std::string_view message, cUEvent& event);
+
+// A NETLINK_KOBJECT_UEVENT socket that receives uevents from the kernel
+class cUEventSocket {
+public:
+  cUEventSocket();
+  ~cUEventSocket();
+
+  // Open a non blocking netlink socket subscribed to kernel uevents
+  bool Open();
+
+  // Use an existing datagram socket instead, for example one end of a socketpair in the unit tests
+  void Attach(int fd);
+
+  void Close();
+
+  int GetFD() const { return fd; }
+
+  // Read all of the events that are waiting without blocking
+  bool ReadEvents(std::vector<cUEvent>& events);
+
+private:
+  int fd;
+
+private:
+  cUEventSocket(const cUEventSocket&) = delete;
+  cUEventSocket& operator=(const cUEventSocket&) = delete;
+};
+
+}
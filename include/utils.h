@@ -1,7 +1,11 @@
 #pragma once
 
+#include <cstdint>
+
 #include <string>
 #include <string_view>
+#include <type_traits>
+#include <vector>
 
 namespace lumberjill {
 
@@ -12,6 +16,9 @@ bool ReadFileIntoString(const std::string& sFilePath, size_t nMaxFileSizeBytes,
 
 bool StringParseValue(std::string_view view, size_t& value);
 
+// Milliseconds since boot including time spent suspended, for measuring intervals between collections
+uint64_t GetTimeSinceBootMS();
+
 std::string GetConfigFolder(const std::string& sApplicationNameLower);
 
 
@@ -24,4 +31,57 @@ enum class POLL_READ_RESULT {
 POLL_READ_RESULT PollRead(int timeout_ms, int fd, bool& fd_ready);
 POLL_READ_RESULT PollRead(int timeout_ms, int fd0, int fd1, bool& fd0_ready, bool& fd1_ready);
 
+
+// The files that state is kept in between runs, a small header followed by fixed size entries that are written just as they are in memory
+class cStateFileHeader {
+public:
+  char szMagic[8];
+  uint32_t nVersion;
+  uint32_t nEntrySizeBytes;
+  uint64_t nEntries;
+};
+
+static_assert(sizeof(cStateFileHeader) == 24);
+
+// Returns true if the header has this magic, version and entry size and its entries exactly fill the rest of a file of nFileSizeBytes
+bool IsStateFileHeaderValid(const cStateFileHeader& header, const char szMagic[8], uint32_t nVersion, size_t nEntrySizeBytes, size_t nFileSizeBytes);
+
+// Open a state file and check its header, returns the fd positioned at the first entry, or -1 if there is no file or it isn't valid
+int OpenStateFile(const std::string& sFilePath, const char szMagic[8], uint32_t nVersion, size_t nEntrySizeBytes, size_t& nEntries);
+
+// Read the entries from an fd returned by OpenStateFile and close it
+bool ReadStateFileEntries(int fd, const std::string& sFilePath, void* pEntries, size_t nSizeBytes);
+
+// Write the header and entries to a temporary file and rename it over the state file, so a crash part way through leaves the old state rather than a broken file
+// bSync is for files on persistent storage that are worth keeping across a power cut
+bool SaveStateFile(const std::string& sFilePath, const char szMagic[8], uint32_t nVersion, size_t nEntrySizeBytes, const void* pEntries, size_t nEntries, bool bSync);
+
+template <class T>
+bool LoadStateFile(const std::string& sFilePath, const char szMagic[8], uint32_t nVersion, std::vector<T>& entries)
+{
+  static_assert(std::is_trivially_copyable_v<T>);
+
+  entries.clear();
+
+  size_t nEntries = 0;
+  const int fd = OpenStateFile(sFilePath, szMagic, nVersion, sizeof(T), nEntries);
+  if (fd < 0) return false;
+
+  entries.resize(nEntries);
+  if (!ReadStateFileEntries(fd, sFilePath, entries.data(), nEntries * sizeof(T))) {
+    entries.clear();
+    return false;
+  }
+
+  return true;
+}
+
+template <class T>
+bool SaveStateFile(const std::string& sFilePath, const char szMagic[8], uint32_t nVersion, const std::vector<T>& entries, bool bSync)
+{
+  static_assert(std::is_trivially_copyable_v<T>);
+
+  return SaveStateFile(sFilePath, szMagic, nVersion, sizeof(T), entries.data(), entries.size(), bSync);
+}
+
 }
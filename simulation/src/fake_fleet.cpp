@@ -0,0 +1,91 @@
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <system_error>
+
+#include "fake_fleet.h"
+
+namespace lumberjill {
+
+namespace simulation {
+
+uint64_t FakeHash(uint64_t seed, uint64_t key)
+{
+  // splitmix64
+  uint64_t z = seed + key * 0x9e3779b97f4a7c15ull;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+bool GenerateFakeFleet(const std::string& sFolder, const std::string& sFakeToolPath, size_t nDrives, size_t nDrivesPerGroup)
+{
+  if ((nDrives == 0) || (nDrivesPerGroup == 0)) {
+    return false;
+  }
+
+  std::error_code ec;
+  std::filesystem::create_directories(sFolder + "/bin", ec);
+  if (ec) return false;
+  std::filesystem::create_directories(sFolder + "/dev", ec);
+  if (ec) return false;
+  std::filesystem::create_directories(sFolder + "/mnt", ec);
+  if (ec) return false;
+
+  // The fake tool works out what to pretend to be from the name it was run as
+  for (auto& sToolName : { "smartctl", "btrfs" }) {
+    const std::string sLinkPath = sFolder + "/bin/" + sToolName;
+    std::filesystem::remove(sLinkPath, ec);
+    std::filesystem::create_symlink(sFakeToolPath, sLinkPath, ec);
+    if (ec) {
+      std::cerr<<"GenerateFakeFleet Failed to create symlink \""<<sLinkPath<<"\": "<<ec.message()<<std::endl;
+      return false;
+    }
+  }
+
+  std::ofstream settings(sFolder + "/settings.json");
+  settings<<"{\n";
+  settings<<"  \"settings\": {\n";
+  settings<<"    \"tools\": {\n";
+  settings<<"      \"smartctl\": \""<<sFolder<<"/bin/smartctl\",\n";
+  settings<<"      \"btrfs\": \""<<sFolder<<"/bin/btrfs\"\n";
+  settings<<"    },\n";
+  settings<<"    \"groups\": [\n";
+
+  const size_t nGroups = (nDrives + nDrivesPerGroup - 1) / nDrivesPerGroup;
+  for (size_t group = 0; group < nGroups; group++) {
+    const std::string sMountPoint = sFolder + "/mnt/volume" + std::to_string(group);
+    std::filesystem::create_directories(sMountPoint, ec);
+    if (ec) return false;
+
+    const size_t nFirstDrive = group * nDrivesPerGroup;
+    const size_t nLastDrive = std::min(nDrives, nFirstDrive + nDrivesPerGroup);
+
+    std::ofstream devices(sMountPoint + "/" + std::string(FAKE_BTRFS_DEVICES_FILE_NAME));
+
+    settings<<"      {\n";
+    settings<<"        \"type\": \""<<((nDrivesPerGroup == 1) ? "single" : "btrfs")<<"\",\n";
+    settings<<"        \"mount_point\": \""<<sMountPoint<<"\",\n";
+    settings<<"        \"devices\": [\n";
+    for (size_t drive = nFirstDrive; drive < nLastDrive; drive++) {
+      const std::string sDevicePath = sFolder + "/dev/fake" + std::to_string(drive);
+      std::ofstream device(sDevicePath);
+
+      devices<<sDevicePath<<"\n";
+
+      settings<<"          { \"name\": \"Fake drive "<<drive<<"\", \"path\": \""<<sDevicePath<<"\" }"<<(((drive + 1) < nLastDrive) ? "," : "")<<"\n";
+    }
+    settings<<"        ]\n";
+    settings<<"      }"<<(((group + 1) < nGroups) ? "," : "")<<"\n";
+  }
+
+  settings<<"    ]\n";
+  settings<<"  }\n";
+  settings<<"}\n";
+
+  return settings.good();
+}
+
+}
+
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+
+#include <string>
+
+namespace lumberjill {
+
+namespace simulation {
+
+// Environment variables that control the behaviour of the fake smartctl and btrfs executables
+// NOTE: These are passed through lumber-jill to the fake tools because RunCommand inherits the environment
+constexpr const char* FAKE_ENV_LATENCY_MS = "LUMBER_JILL_FAKE_LATENCY_MS";
+constexpr const char* FAKE_ENV_FAILURE_PERCENT = "LUMBER_JILL_FAKE_FAILURE_PERCENT";
+constexpr const char* FAKE_ENV_HANG_PERCENT = "LUMBER_JILL_FAKE_HANG_PERCENT";
+constexpr const char* FAKE_ENV_OUTPUT_BYTES = "LUMBER_JILL_FAKE_OUTPUT_BYTES";
+constexpr const char* FAKE_ENV_STANDBY_PERCENT = "LUMBER_JILL_FAKE_STANDBY_PERCENT";
+constexpr const char* FAKE_ENV_SEED = "LUMBER_JILL_FAKE_SEED";
+
+// Each fake btrfs mount point lists its devices in this file, one path per line
+constexpr const char* FAKE_BTRFS_DEVICES_FILE_NAME = ".lumber-jill-fake-devices";
+
+// Create a fake fleet under sFolder:
+// sFolder/bin/smartctl and sFolder/bin/btrfs are symlinks to the fake tool executable
+// sFolder/dev/fakeN are empty files so that the drives are "present"
+// sFolder/mnt/volumeN are the mount points, each group of nDrivesPerGroup drives is a btrfs volume (Or a single drive if nDrivesPerGroup is 1)
+// sFolder/settings.json is a settings file pointing at all of the above
+bool GenerateFakeFleet(const std::string& sFolder, const std::string& sFakeToolPath, size_t nDrives, size_t nDrivesPerGroup);
+
+// Returns a deterministic pseudo random number for this key, used so that the same drives fail on every run
+uint64_t FakeHash(uint64_t seed, uint64_t key);
+
+}
+
+}
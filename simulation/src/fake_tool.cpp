@@ -0,0 +1,275 @@
+// A stand in for smartctl and btrfs so that the whole pipeline can be run without real drives
+//
+// Usage:
+// lumber-jill-fake-tool generate <folder> <drives> [drives per group]
+// <folder>/bin/smartctl [-n standby] -A <folder>/dev/fakeN
+// <folder>/bin/btrfs device stats <folder>/mnt/volumeN
+
+#include <cstdlib>
+#include <cstring>
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <limits.h>
+#include <unistd.h>
+
+#include "utils.h"
+
+#include "fake_fleet.h"
+
+namespace lumberjill {
+
+namespace simulation {
+
+class cFakeToolSettings {
+public:
+  cFakeToolSettings() : nLatencyMS(0), nFailurePercent(0), nHangPercent(0), nOutputBytes(0), nStandbyPercent(0), nSeed(0) {}
+
+  void LoadFromEnvironment();
+
+  size_t nLatencyMS;
+  size_t nFailurePercent;
+  size_t nHangPercent;
+  size_t nOutputBytes;
+  size_t nStandbyPercent;
+  size_t nSeed;
+};
+
+void GetEnvironmentValue(const char* szName, size_t& value)
+{
+  const char* szValue = getenv(szName);
+  if (szValue != nullptr) {
+    StringParseValue(szValue, value);
+  }
+}
+
+void cFakeToolSettings::LoadFromEnvironment()
+{
+  GetEnvironmentValue(FAKE_ENV_LATENCY_MS, nLatencyMS);
+  GetEnvironmentValue(FAKE_ENV_FAILURE_PERCENT, nFailurePercent);
+  GetEnvironmentValue(FAKE_ENV_HANG_PERCENT, nHangPercent);
+  GetEnvironmentValue(FAKE_ENV_OUTPUT_BYTES, nOutputBytes);
+  GetEnvironmentValue(FAKE_ENV_STANDBY_PERCENT, nStandbyPercent);
+  GetEnvironmentValue(FAKE_ENV_SEED, nSeed);
+}
+
+// Get the index from the end of a path like "/tmp/fleet/dev/fake123" or "/tmp/fleet/mnt/volume12"
+size_t GetIndexFromPath(std::string_view path)
+{
+  size_t start = path.length();
+  while ((start != 0) && (path[start - 1] >= '0') && (path[start - 1] <= '9')) {
+    start--;
+  }
+
+  size_t index = 0;
+  StringParseValue(path.substr(start), index);
+  return index;
+}
+
+// Simulate the latency, failures and hangs for this device or volume, returns false if the tool should fail
+bool SimulateBehaviour(const cFakeToolSettings& settings, size_t index)
+{
+  // Jitter the latency by +-25% so that the drives don't all finish at the same time
+  if (settings.nLatencyMS != 0) {
+    const size_t nJitterRange = (settings.nLatencyMS / 2) + 1;
+    const size_t nLatencyMS = settings.nLatencyMS - (settings.nLatencyMS / 4) + (FakeHash(settings.nSeed, (index * 4) + 0) % nJitterRange);
+    usleep(useconds_t(nLatencyMS * 1000));
+  }
+
+  if ((FakeHash(settings.nSeed, (index * 4) + 1) % 100) < settings.nHangPercent) {
+    // Hang forever like a drive that has stopped responding
+    while (true) {
+      pause();
+    }
+  }
+
+  return ((FakeHash(settings.nSeed, (index * 4) + 2) % 100) >= settings.nFailurePercent);
+}
+
+// Pad the output with extra lines until it is at least nOutputBytes long
+void PadOutput(std::ostringstream& o, size_t nOutputBytes, const std::string& sPaddingLine)
+{
+  size_t nLength = size_t(o.tellp());
+  while (nLength < nOutputBytes) {
+    o<<sPaddingLine;
+    nLength += sPaddingLine.length();
+  }
+}
+
+int FakeSmartCtl(const cFakeToolSettings& settings, int argc, char** argv)
+{
+  // "-n standby" asks smartctl to leave a drive in standby alone
+  const bool bSkipStandby = ((argc == 5) && (strcmp(argv[1], "-n") == 0) && (strcmp(argv[2], "standby") == 0));
+  if (bSkipStandby) {
+    argc -= 2;
+    argv += 2;
+  }
+
+  if ((argc != 3) || (strcmp(argv[1], "-A") != 0)) {
+    std::cerr<<"Usage: smartctl [-n standby] -A <device>"<<std::endl;
+    return 1;
+  }
+
+  const std::string sDevicePath = argv[2];
+  if (!TestFileExists(sDevicePath)) {
+    std::cerr<<"Smartctl open device: "<<sDevicePath<<" failed: No such device"<<std::endl;
+    return 2;
+  }
+
+  const size_t index = GetIndexFromPath(sDevicePath);
+
+  // Spun down archive drives, without "-n standby" we pretend to spin them up
+  if (bSkipStandby && ((FakeHash(settings.nSeed ^ 0x5354414e4442ull, index) % 100) < settings.nStandbyPercent)) {
+    std::cout<<"smartctl 7.1 2019-12-30 r5022 [x86_64-linux-5.8.18-100.fc31.x86_64] (local build)\n";
+    std::cout<<"Copyright (C) 2002-19, Bruce Allen, Christian Franke, www.smartmontools.org\n";
+    std::cout<<"\n";
+    std::cout<<"Device is in STANDBY mode, exit(2)\n";
+    return 2;
+  }
+  if (!SimulateBehaviour(settings, index)) {
+    std::cerr<<"Smartctl open device: "<<sDevicePath<<" failed: Input/output error"<<std::endl;
+    return 2;
+  }
+
+  // Roughly 1 in 50 drives is dying
+  const bool bIsDying = ((FakeHash(settings.nSeed, (index * 4) + 3) % 50) == 0);
+  const size_t nRawReadErrorRate = bIsDying ? (FakeHash(settings.nSeed, index) % 100000) : 0;
+  const size_t nSeekErrorRate = bIsDying ? (FakeHash(settings.nSeed, index + 1) % 10000) : 0;
+  const size_t nOfflineUncorrectable = bIsDying ? (FakeHash(settings.nSeed, index + 2) % 10000) : 0;
+
+  std::ostringstream o;
+  o<<"smartctl 7.1 2019-12-30 r5022 [x86_64-linux-5.8.18-100.fc31.x86_64] (local build)\n";
+  o<<"Copyright (C) 2002-19, Bruce Allen, Christian Franke, www.smartmontools.org\n";
+  o<<"\n";
+  o<<"=== START OF READ SMART DATA SECTION ===\n";
+  o<<"SMART Attributes Data Structure revision number: 16\n";
+  o<<"Vendor Specific SMART Attributes with Thresholds:\n";
+  o<<"ID# ATTRIBUTE_NAME          FLAG     VALUE WORST THRESH TYPE      UPDATED  WHEN_FAILED RAW_VALUE\n";
+  o<<"  1 Raw_Read_Error_Rate     0x002f   200   200   051    Pre-fail  Always       -       "<<nRawReadErrorRate<<"\n";
+  o<<"  3 Spin_Up_Time            0x0027   170   166   021    Pre-fail  Always       -       2458\n";
+  o<<"  4 Start_Stop_Count        0x0032   099   099   000    Old_age   Always       -       1692\n";
+  o<<"  5 Reallocated_Sector_Ct   0x0033   200   200   140    Pre-fail  Always       -       0\n";
+  o<<"  7 Seek_Error_Rate         0x002e   200   200   000    Old_age   Always       -       "<<nSeekErrorRate<<"\n";
+  o<<"  9 Power_On_Hours          0x0032   077   077   000    Old_age   Always       -       "<<(10000 + (index * 37))<<"\n";
+  o<<" 10 Spin_Retry_Count        0x0032   100   100   000    Old_age   Always       -       0\n";
+  o<<" 11 Calibration_Retry_Count 0x0032   100   100   000    Old_age   Always       -       0\n";
+  o<<" 12 Power_Cycle_Count       0x0032   099   099   000    Old_age   Always       -       1605\n";
+  o<<"192 Power-Off_Retract_Count 0x0032   200   200   000    Old_age   Always       -       93\n";
+  o<<"193 Load_Cycle_Count        0x0032   200   200   000    Old_age   Always       -       1614\n";
+  o<<"194 Temperature_Celsius     0x0022   122   087   000    Old_age   Always       -       "<<(25 + (index % 20))<<"\n";
+  o<<"196 Reallocated_Event_Count 0x0032   200   200   000    Old_age   Always       -       0\n";
+  o<<"197 Current_Pending_Sector  0x0032   200   200   000    Old_age   Always       -       0\n";
+  o<<"198 Offline_Uncorrectable   0x0030   200   200   000    Old_age   Offline      -       "<<nOfflineUncorrectable<<"\n";
+  o<<"199 UDMA_CRC_Error_Count    0x0032   200   200   000    Old_age   Always       -       0\n";
+  o<<"200 Multi_Zone_Error_Rate   0x0008   200   200   000    Old_age   Offline      -       0\n";
+  PadOutput(o, settings.nOutputBytes, "240 Head_Flying_Hours       0x0000   100   253   000    Old_age   Offline      -       0\n");
+  o<<"\n";
+
+  std::cout<<o.str();
+  return 0;
+}
+
+int FakeBtrfs(const cFakeToolSettings& settings, int argc, char** argv)
+{
+  if ((argc != 4) || (strcmp(argv[1], "device") != 0) || (strcmp(argv[2], "stats") != 0)) {
+    std::cerr<<"Usage: btrfs device stats <path>"<<std::endl;
+    return 1;
+  }
+
+  const std::string sMountPoint = argv[3];
+
+  std::ifstream f(sMountPoint + "/" + std::string(FAKE_BTRFS_DEVICES_FILE_NAME));
+  if (!f.good()) {
+    std::cerr<<"ERROR: not a btrfs filesystem: "<<sMountPoint<<std::endl;
+    return 1;
+  }
+
+  // Offset the volume index so that volumes don't share behaviour with the drive of the same index
+  if (!SimulateBehaviour(settings, 1000000 + GetIndexFromPath(sMountPoint))) {
+    std::cerr<<"ERROR: getting device info for "<<sMountPoint<<" failed: Input/output error"<<std::endl;
+    return 1;
+  }
+
+  std::ostringstream o;
+
+  std::string sDevicePath;
+  while (std::getline(f, sDevicePath)) {
+    if (sDevicePath.empty()) continue;
+
+    const size_t index = GetIndexFromPath(sDevicePath);
+    const bool bIsDying = ((FakeHash(settings.nSeed, (index * 4) + 3) % 50) == 0);
+
+    o<<"["<<sDevicePath<<"].write_io_errs    "<<(bIsDying ? (FakeHash(settings.nSeed, index + 3) % 100) : 0)<<"\n";
+    o<<"["<<sDevicePath<<"].read_io_errs     "<<(bIsDying ? (FakeHash(settings.nSeed, index + 4) % 1000000) : 0)<<"\n";
+    o<<"["<<sDevicePath<<"].flush_io_errs    "<<(bIsDying ? (FakeHash(settings.nSeed, index + 5) % 10) : 0)<<"\n";
+    o<<"["<<sDevicePath<<"].corruption_errs  0\n";
+    o<<"["<<sDevicePath<<"].generation_errs  0\n";
+  }
+
+  std::cout<<o.str();
+  return 0;
+}
+
+std::string GetExecutablePath()
+{
+  char szPath[PATH_MAX];
+  const ssize_t len = readlink("/proc/self/exe", szPath, sizeof(szPath) - 1);
+  if (len <= 0) return "";
+
+  return std::string(szPath, size_t(len));
+}
+
+int Generate(int argc, char** argv)
+{
+  if ((argc != 4) && (argc != 5)) {
+    std::cerr<<"Usage: lumber-jill-fake-tool generate <folder> <drives> [drives per group]"<<std::endl;
+    return 1;
+  }
+
+  const std::string sFolder = argv[2];
+  if (!IsFilePathAbsolute(sFolder)) {
+    std::cerr<<"lumber-jill-fake-tool The folder must be an absolute path"<<std::endl;
+    return 1;
+  }
+
+  size_t nDrives = 0;
+  size_t nDrivesPerGroup = 1;
+  if (!StringParseValue(argv[3], nDrives) || ((argc == 5) && !StringParseValue(argv[4], nDrivesPerGroup))) {
+    std::cerr<<"lumber-jill-fake-tool Invalid number of drives"<<std::endl;
+    return 1;
+  }
+
+  if (!GenerateFakeFleet(sFolder, GetExecutablePath(), nDrives, nDrivesPerGroup)) {
+    std::cerr<<"lumber-jill-fake-tool Failed to generate the fake fleet in \""<<sFolder<<"\""<<std::endl;
+    return 1;
+  }
+
+  std::cout<<"Generated "<<nDrives<<" fake drives, run: lumber-jill --settings "<<sFolder<<"/settings.json"<<std::endl;
+  return 0;
+}
+
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  const std::string_view executable(argv[0]);
+  const size_t last_slash = executable.find_last_of('/');
+  const std::string_view name = (last_slash == std::string_view::npos) ? executable : executable.substr(last_slash + 1);
+
+  lumberjill::simulation::cFakeToolSettings settings;
+  settings.LoadFromEnvironment();
+
+  if (name == "smartctl") return lumberjill::simulation::FakeSmartCtl(settings, argc, argv);
+  else if (name == "btrfs") return lumberjill::simulation::FakeBtrfs(settings, argc, argv);
+  else if ((argc >= 2) && (strcmp(argv[1], "generate") == 0)) return lumberjill::simulation::Generate(argc, argv);
+
+  std::cerr<<"Usage: lumber-jill-fake-tool generate <folder> <drives> [drives per group]"<<std::endl;
+  return 1;
+}
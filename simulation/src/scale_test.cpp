@@ -0,0 +1,225 @@
+// Runs the whole lumber-jill pipeline against a fake fleet and reports the sweep latency, memory usage and log volume
+//
+// Usage:
+// lumber-jill-scale-test <lumber-jill executable> [--drives N] [--drives-per-group N] [--latency-ms N] [--failure-percent N] [--hang-percent N] [--output-bytes N] [--timeout-seconds N] [--keep]
+
+#include <cstdlib>
+#include <cstring>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "utils.h"
+
+#include "fake_fleet.h"
+
+namespace lumberjill {
+
+namespace simulation {
+
+class cScaleTestSettings {
+public:
+  cScaleTestSettings() : nDrives(500), nDrivesPerGroup(5), nTimeoutSeconds(600), bKeep(false) {}
+
+  std::string sLumberJillPath;
+
+  size_t nDrives;
+  size_t nDrivesPerGroup;
+  size_t nTimeoutSeconds;
+  bool bKeep;
+};
+
+class cScaleTestResult {
+public:
+  cScaleTestResult() : bTimedOut(false), nExitStatus(-1), nDurationMS(0), nMaxRSSKB(0), nStandardOutputBytes(0), nStandardOutputLines(0) {}
+
+  bool bTimedOut;
+  int nExitStatus;
+  size_t nDurationMS;
+  size_t nMaxRSSKB;
+  size_t nStandardOutputBytes;
+  size_t nStandardOutputLines;
+};
+
+std::string GetFakeToolPath()
+{
+  // The fake tool is built next to this executable
+  char szPath[PATH_MAX];
+  const ssize_t len = readlink("/proc/self/exe", szPath, sizeof(szPath) - 1);
+  if (len <= 0) return "";
+
+  return std::filesystem::path(std::string(szPath, size_t(len))).parent_path().string() + "/lumber-jill-fake-tool";
+}
+
+bool RunLumberJill(const cScaleTestSettings& settings, const std::string& sFolder, cScaleTestResult& result)
+{
+  const std::string sSettingsFilePath = sFolder + "/settings.json";
+  const std::string sStandardOutputFilePath = sFolder + "/stdout.txt";
+
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  const pid_t pid = fork();
+  if (pid < 0) {
+    std::cerr<<"RunLumberJill fork failed: "<<strerror(errno)<<std::endl;
+    return false;
+  } else if (pid == 0) {
+    // Put lumber-jill and the fake tools in their own process group so that hung fake tools can be killed too
+    setpgid(0, 0);
+
+    // Capture stdout so that we can measure the log volume
+    const int fd = open(sStandardOutputFilePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+      dup2(fd, STDOUT_FILENO);
+      close(fd);
+    }
+
+    execl(settings.sLumberJillPath.c_str(), settings.sLumberJillPath.c_str(), "--settings", sSettingsFilePath.c_str(), nullptr);
+
+    std::cerr<<"RunLumberJill exec failed: "<<strerror(errno)<<std::endl;
+    _exit(EXIT_FAILURE);
+  }
+
+  // Wait for lumber-jill to finish, killing it if it takes too long
+  int status = 0;
+  struct rusage usage;
+  memset(&usage, 0, sizeof(usage));
+  while (true) {
+    const pid_t waited = wait4(pid, &status, WNOHANG, &usage);
+    if (waited == pid) {
+      break;
+    } else if (waited < 0) {
+      std::cerr<<"RunLumberJill wait failed: "<<strerror(errno)<<std::endl;
+      return false;
+    }
+
+    if (std::chrono::steady_clock::now() - start > std::chrono::seconds(settings.nTimeoutSeconds)) {
+      result.bTimedOut = true;
+      kill(-pid, SIGKILL);
+      wait4(pid, &status, 0, &usage);
+      break;
+    }
+
+    usleep(1000);
+  }
+
+  result.nDurationMS = size_t(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+  result.nMaxRSSKB = size_t(usage.ru_maxrss);
+  result.nExitStatus = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+
+  std::ifstream f(sStandardOutputFilePath);
+  std::string sLine;
+  while (std::getline(f, sLine)) {
+    result.nStandardOutputBytes += sLine.length() + 1;
+    result.nStandardOutputLines++;
+  }
+
+  return true;
+}
+
+void PrintResult(const cScaleTestSettings& settings, const cScaleTestResult& result)
+{
+  std::cout<<"drives: "<<settings.nDrives<<std::endl;
+  std::cout<<"drives per group: "<<settings.nDrivesPerGroup<<std::endl;
+  std::cout<<"timed out: "<<(result.bTimedOut ? "true" : "false")<<std::endl;
+  std::cout<<"exit status: "<<result.nExitStatus<<std::endl;
+  std::cout<<"sweep duration ms: "<<result.nDurationMS<<std::endl;
+  std::cout<<"sweep duration per drive ms: "<<(double(result.nDurationMS) / double(settings.nDrives))<<std::endl;
+  std::cout<<"max rss KB: "<<result.nMaxRSSKB<<std::endl;
+  std::cout<<"log bytes: "<<result.nStandardOutputBytes<<std::endl;
+  std::cout<<"log lines: "<<result.nStandardOutputLines<<std::endl;
+}
+
+bool ParseArguments(int argc, char** argv, cScaleTestSettings& settings)
+{
+  if (argc < 2) {
+    return false;
+  }
+
+  settings.sLumberJillPath = argv[1];
+  if (!IsFilePathAbsolute(settings.sLumberJillPath)) {
+    settings.sLumberJillPath = std::filesystem::absolute(settings.sLumberJillPath).string();
+  }
+
+  for (int i = 2; i < argc; i++) {
+    const std::string sArgument = argv[i];
+    if (sArgument == "--keep") {
+      settings.bKeep = true;
+      continue;
+    }
+
+    if ((i + 1) >= argc) {
+      return false;
+    }
+
+    const char* szValue = argv[++i];
+    size_t value = 0;
+    if (!StringParseValue(szValue, value)) {
+      return false;
+    }
+
+    if (sArgument == "--drives") settings.nDrives = value;
+    else if (sArgument == "--drives-per-group") settings.nDrivesPerGroup = value;
+    else if (sArgument == "--timeout-seconds") settings.nTimeoutSeconds = value;
+    // The rest are passed to the fake tools through the environment
+    else if (sArgument == "--latency-ms") setenv(FAKE_ENV_LATENCY_MS, szValue, 1);
+    else if (sArgument == "--failure-percent") setenv(FAKE_ENV_FAILURE_PERCENT, szValue, 1);
+    else if (sArgument == "--hang-percent") setenv(FAKE_ENV_HANG_PERCENT, szValue, 1);
+    else if (sArgument == "--output-bytes") setenv(FAKE_ENV_OUTPUT_BYTES, szValue, 1);
+    else if (sArgument == "--seed") setenv(FAKE_ENV_SEED, szValue, 1);
+    else return false;
+  }
+
+  return true;
+}
+
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  lumberjill::simulation::cScaleTestSettings settings;
+  if (!lumberjill::simulation::ParseArguments(argc, argv, settings)) {
+    std::cerr<<"Usage: lumber-jill-scale-test <lumber-jill executable> [--drives N] [--drives-per-group N] [--latency-ms N] [--failure-percent N] [--hang-percent N] [--output-bytes N] [--seed N] [--timeout-seconds N] [--keep]"<<std::endl;
+    return EXIT_FAILURE;
+  }
+
+  char szFolder[] = "/tmp/lumber-jill-scale-test-XXXXXX";
+  if (mkdtemp(szFolder) == nullptr) {
+    std::cerr<<"lumber-jill-scale-test Failed to create temporary folder"<<std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const std::string sFolder(szFolder);
+  if (!lumberjill::simulation::GenerateFakeFleet(sFolder, lumberjill::simulation::GetFakeToolPath(), settings.nDrives, settings.nDrivesPerGroup)) {
+    std::cerr<<"lumber-jill-scale-test Failed to generate the fake fleet"<<std::endl;
+    return EXIT_FAILURE;
+  }
+
+  lumberjill::simulation::cScaleTestResult result;
+  const bool bRan = lumberjill::simulation::RunLumberJill(settings, sFolder, result);
+  if (bRan) {
+    lumberjill::simulation::PrintResult(settings, result);
+  }
+
+  if (settings.bKeep) {
+    std::cout<<"fleet folder: "<<sFolder<<std::endl;
+  } else {
+    std::error_code ec;
+    std::filesystem::remove_all(sFolder, ec);
+  }
+
+  return ((bRan && !result.bTimedOut && (result.nExitStatus == 0)) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,299 @@
+#include <cmath>
+#include <cstring>
+#include <ctime>
+
+#include <algorithm>
+#include <optional>
+#include <vector>
+
+#include "anomaly.h"
+#include "utils.h"
+
+namespace lumberjill {
+
+namespace {
+
+const char ANOMALY_STATE_MAGIC[8] = { 'L', 'J', 'A', 'N', 'O', 'M', 'L', '\0' };
+
+// Bump this whenever the header, the entry layout or the list of metrics changes, older files are then ignored and the baselines start again
+const uint32_t ANOMALY_STATE_VERSION = 2;
+
+const size_t MAX_DEVICE_PATH_LENGTH = 223;
+
+// Drives that haven't been seen for this long are dropped from the state file, they were most likely replaced
+const int64_t EXPIRE_SECONDS = 90 * 24 * 60 * 60;
+
+const double SECONDS_PER_DAY = 24.0 * 60.0 * 60.0;
+
+// A baseline's standard deviation is at least this fraction of its mean, so that a very steady metric isn't flagged for a tiny change
+const double MIN_RELATIVE_DEVIATION = 0.1;
+
+// Comparing drives with their group needs enough drives for the median to mean something
+const size_t MIN_PEER_DRIVES = 3;
+
+// Scales the median absolute deviation to a standard deviation for normally distributed values
+const double MAD_TO_STANDARD_DEVIATION = 1.4826;
+
+enum class METRIC_TYPE {
+  COUNTER,  // Only ever goes up, the baseline is of its rate per day
+  GAUGE     // Already a rate or an average over the interval
+};
+
+class cMetricInfo {
+public:
+  const char* szName;
+  METRIC_TYPE type;
+  double dMinDeviation;  // The smallest standard deviation a baseline is allowed to have, in the metric's units
+};
+
+const cMetricInfo METRICS[ANOMALY_METRIC_COUNT] = {
+  { "smartRaw_Read_Error_Rate", METRIC_TYPE::COUNTER, 1.0 },
+  { "smartSeek_Error_Rate", METRIC_TYPE::COUNTER, 1.0 },
+  { "smartOffline_Uncorrectable", METRIC_TYPE::COUNTER, 1.0 },
+  { "write_io_errs", METRIC_TYPE::COUNTER, 1.0 },
+  { "read_io_errs", METRIC_TYPE::COUNTER, 1.0 },
+  { "flush_io_errs", METRIC_TYPE::COUNTER, 1.0 },
+  { "corruption_errs", METRIC_TYPE::COUNTER, 1.0 },
+  { "generation_errs", METRIC_TYPE::COUNTER, 1.0 },
+  { "readAwaitMS", METRIC_TYPE::GAUGE, 1.0 },
+  { "writeAwaitMS", METRIC_TYPE::GAUGE, 1.0 },
+  { "utilisationPercent", METRIC_TYPE::GAUGE, 5.0 },
+};
+
+// One drive in the file
+class cEntry {
+public:
+  char szDevicePath[MAX_DEVICE_PATH_LENGTH + 1];
+  int64_t nUpdated;
+  cAnomalyBaseline baselines[ANOMALY_METRIC_COUNT];
+};
+
+static_assert(sizeof(cEntry) == (224 + 8 + (40 * ANOMALY_METRIC_COUNT)));
+
+void SetValue(std::array<std::optional<double>, ANOMALY_METRIC_COUNT>& values, ANOMALY_METRIC metric, const std::optional<size_t>& value)
+{
+  if (value.has_value()) values[size_t(metric)] = double(value.value());
+}
+
+void GetMetricValues(const cDriveStats& driveStats, const cBtrfsDriveStats* pBtrfsDriveStats, std::array<std::optional<double>, ANOMALY_METRIC_COUNT>& values)
+{
+  // The SMART values of a drive in standby are left over from before it spun down
+  const cSmartCtlStats& smart = driveStats.smartCtlStats;
+  if (!smart.bIsInStandby) {
+    SetValue(values, ANOMALY_METRIC::SMART_RAW_READ_ERROR_RATE, smart.nRaw_Read_Error_Rate);
+    SetValue(values, ANOMALY_METRIC::SMART_SEEK_ERROR_RATE, smart.nSeek_Error_Rate);
+    SetValue(values, ANOMALY_METRIC::SMART_OFFLINE_UNCORRECTABLE, smart.nOffline_Uncorrectable);
+  }
+
+  if (pBtrfsDriveStats != nullptr) {
+    SetValue(values, ANOMALY_METRIC::BTRFS_WRITE_IO_ERRS, pBtrfsDriveStats->nWrite_io_errs);
+    SetValue(values, ANOMALY_METRIC::BTRFS_READ_IO_ERRS, pBtrfsDriveStats->nRead_io_errs);
+    SetValue(values, ANOMALY_METRIC::BTRFS_FLUSH_IO_ERRS, pBtrfsDriveStats->nFlush_io_errs);
+    SetValue(values, ANOMALY_METRIC::BTRFS_CORRUPTION_ERRS, pBtrfsDriveStats->nCorruption_errs);
+    SetValue(values, ANOMALY_METRIC::BTRFS_GENERATION_ERRS, pBtrfsDriveStats->nGeneration_errs);
+  }
+
+  if (driveStats.diskIOStats.has_value()) {
+    values[size_t(ANOMALY_METRIC::READ_AWAIT_MS)] = driveStats.diskIOStats->dReadAwaitMS;
+    values[size_t(ANOMALY_METRIC::WRITE_AWAIT_MS)] = driveStats.diskIOStats->dWriteAwaitMS;
+    values[size_t(ANOMALY_METRIC::UTILISATION_PERCENT)] = driveStats.diskIOStats->dUtilisationPercent;
+  }
+}
+
+double GetMedian(std::vector<double>& values)
+{
+  const size_t middle = values.size() / 2;
+  std::nth_element(values.begin(), values.begin() + std::ptrdiff_t(middle), values.end());
+  return values[middle];
+}
+
+}
+
+const char* GetAnomalyMetricName(ANOMALY_METRIC metric)
+{
+  return (size_t(metric) < ANOMALY_METRIC_COUNT) ? METRICS[size_t(metric)].szName : "";
+}
+
+double cAnomalyBaseline::Add(double dSample, double dAlpha, double dMinDeviation, size_t nWarmupSamples)
+{
+  if (nSamples == 0) {
+    dMean = dSample;
+    dVariance = 0.0;
+    nSamples = 1;
+    return 0.0;
+  }
+
+  // Only rising is a problem, fewer errors or lower latency than usual is fine
+  double dScore = 0.0;
+  if (nSamples >= nWarmupSamples) {
+    const double dDeviation = std::max({ std::sqrt(dVariance), dMinDeviation, MIN_RELATIVE_DEVIATION * std::fabs(dMean) });
+    dScore = std::max(0.0, (dSample - dMean) / dDeviation);
+  }
+
+  // The incremental form of the exponentially weighted mean and variance, no history is needed
+  // Until there are enough samples for the weights to settle this is the plain mean and variance, otherwise the first sample would count for far too much
+  const double dWeight = std::max(dAlpha, 1.0 / double(nSamples + 1));
+  const double dDifference = dSample - dMean;
+  const double dIncrement = dWeight * dDifference;
+  dMean += dIncrement;
+  dVariance = (1.0 - dWeight) * (dVariance + (dDifference * dIncrement));
+  if (nSamples < UINT32_MAX) nSamples++;
+
+  return dScore;
+}
+
+cAnomalyDetector::cAnomalyDetector() :
+  bIsLoaded(false)
+{
+}
+
+cAnomalyDetector::~cAnomalyDetector()
+{
+}
+
+bool cAnomalyDetector::Load(const std::string& sFilePath)
+{
+  drives.clear();
+
+  // Even if there is nothing to load we don't want to try again and throw away what has been collected since
+  bIsLoaded = true;
+
+  std::vector<cEntry> entries;
+  if (!LoadStateFile(sFilePath, ANOMALY_STATE_MAGIC, ANOMALY_STATE_VERSION, entries)) {
+    return false;
+  }
+
+  for (auto& entry : entries) {
+    cDriveState& state = drives[std::string(entry.szDevicePath, strnlen(entry.szDevicePath, sizeof(entry.szDevicePath)))];
+    state.nUpdated = entry.nUpdated;
+    std::copy(std::begin(entry.baselines), std::end(entry.baselines), state.baselines.begin());
+  }
+
+  return true;
+}
+
+bool cAnomalyDetector::Save(const std::string& sFilePath) const
+{
+  const int64_t nNow = int64_t(time(nullptr));
+
+  std::vector<cEntry> entries;
+  entries.reserve(drives.size());
+  for (auto& item : drives) {
+    // Not worth handling, device paths are never anywhere near this long
+    if (item.first.empty() || (item.first.length() > MAX_DEVICE_PATH_LENGTH)) continue;
+
+    if ((nNow - item.second.nUpdated) > EXPIRE_SECONDS) continue;
+
+    cEntry entry {};
+    memcpy(entry.szDevicePath, item.first.c_str(), item.first.length());
+    entry.nUpdated = item.second.nUpdated;
+    std::copy(item.second.baselines.begin(), item.second.baselines.end(), std::begin(entry.baselines));
+    entries.push_back(entry);
+  }
+
+  // Unlike the result cache this is on persistent storage and is worth keeping across a power cut
+  return SaveStateFile(sFilePath, ANOMALY_STATE_MAGIC, ANOMALY_STATE_VERSION, entries, true);
+}
+
+void cAnomalyDetector::Update(const cAnomalySettings& settings, int64_t nTimestamp, cMountStats& mountStats, const cBtrfsVolumeStats* pBtrfsVolumeStats)
+{
+  const double dAlpha = 1.0 - std::pow(0.5, 1.0 / double(std::max<size_t>(1, settings.nHalfLifeSamples)));
+  const double dThreshold = double(settings.nThresholdSigma);
+
+  // The drives that were updated, to compare with each other afterwards
+  std::vector<std::pair<cDriveStats*, const cDriveState*>> group;
+  group.reserve(mountStats.mapDrivePathToDriveStats.size());
+
+  std::array<std::optional<double>, ANOMALY_METRIC_COUNT> values;
+
+  for (auto& item : mountStats.mapDrivePathToDriveStats) {
+    cDriveStats& driveStats = item.second;
+    driveStats.anomalies.clear();
+    if (!driveStats.bIsPresent) continue;
+
+    const cBtrfsDriveStats* pBtrfsDriveStats = nullptr;
+    if (pBtrfsVolumeStats != nullptr) {
+      const auto found = pBtrfsVolumeStats->mapDrivePathToBtrfsDriveStats.find(item.first);
+      if (found != pBtrfsVolumeStats->mapDrivePathToBtrfsDriveStats.end()) pBtrfsDriveStats = &found->second;
+    }
+
+    values.fill(std::nullopt);
+    GetMetricValues(driveStats, pBtrfsDriveStats, values);
+
+    cDriveState& state = drives[item.first];
+    state.nUpdated = nTimestamp;
+
+    for (size_t m = 0; m < ANOMALY_METRIC_COUNT; m++) {
+      if (!values[m].has_value()) continue;
+
+      cAnomalyBaseline& baseline = state.baselines[m];
+      double dSample = values[m].value();
+
+      if (METRICS[m].type == METRIC_TYPE::COUNTER) {
+        const bool bHasPrevious = (baseline.bHasLastValue != 0) && (nTimestamp > baseline.nLastTimestamp) && (dSample >= baseline.dLastValue);
+        const double dPreviousValue = baseline.dLastValue;
+        const int64_t nPreviousTimestamp = baseline.nLastTimestamp;
+
+        baseline.dLastValue = dSample;
+        baseline.nLastTimestamp = nTimestamp;
+        baseline.bHasLastValue = 1;
+
+        // The first reading, a counter that went down because it was reset, or a clock that went backwards don't give us a rate
+        if (!bHasPrevious) continue;
+
+        dSample = (dSample - dPreviousValue) * SECONDS_PER_DAY / double(nTimestamp - nPreviousTimestamp);
+      }
+
+      const double dExpected = baseline.dMean;
+      const double dScore = baseline.Add(dSample, dAlpha, METRICS[m].dMinDeviation, settings.nWarmupSamples);
+      if (dScore >= dThreshold) {
+        cDriveAnomaly anomaly;
+        anomaly.sMetric = METRICS[m].szName;
+        anomaly.kind = ANOMALY_KIND::SELF;
+        anomaly.dValue = dSample;
+        anomaly.dExpected = dExpected;
+        anomaly.dScore = dScore;
+        driveStats.anomalies.push_back(anomaly);
+      }
+    }
+
+    group.push_back(std::make_pair(&driveStats, &state));
+  }
+
+  // Compare each drive's average rate with the rest of the group, a drive wearing out faster than its identical neighbours stands out even if it has always been like that
+  std::vector<double> means;
+  std::vector<double> deviations;
+  for (size_t m = 0; m < ANOMALY_METRIC_COUNT; m++) {
+    means.clear();
+    for (auto& drive : group) {
+      const cAnomalyBaseline& baseline = drive.second->baselines[m];
+      if ((baseline.nSamples != 0) && (baseline.nSamples >= settings.nWarmupSamples)) means.push_back(baseline.dMean);
+    }
+
+    if (means.size() < MIN_PEER_DRIVES) continue;
+
+    // The median and median absolute deviation aren't thrown off by the drive that is failing
+    const double dMedian = GetMedian(means);
+    deviations.clear();
+    for (auto& dMean : means) deviations.push_back(std::fabs(dMean - dMedian));
+    const double dDeviation = std::max({ MAD_TO_STANDARD_DEVIATION * GetMedian(deviations), METRICS[m].dMinDeviation, MIN_RELATIVE_DEVIATION * std::fabs(dMedian) });
+
+    for (auto& drive : group) {
+      const cAnomalyBaseline& baseline = drive.second->baselines[m];
+      if ((baseline.nSamples == 0) || (baseline.nSamples < settings.nWarmupSamples)) continue;
+
+      const double dScore = (baseline.dMean - dMedian) / dDeviation;
+      if (dScore >= dThreshold) {
+        cDriveAnomaly anomaly;
+        anomaly.sMetric = METRICS[m].szName;
+        anomaly.kind = ANOMALY_KIND::PEERS;
+        anomaly.dValue = baseline.dMean;
+        anomaly.dExpected = dMedian;
+        anomaly.dScore = dScore;
+        drive.first->anomalies.push_back(anomaly);
+      }
+    }
+  }
+}
+
+}
@@ -0,0 +1,427 @@
+#include <cerrno>
+#include <cstring>
+
+#include <algorithm>
+#include <iostream>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define LUMBERJILL_HAS_IO_URING 1
+#endif
+
+#include "batch_reader.h"
+
+namespace lumberjill {
+
+namespace {
+
+// Enough for a large array in a single submission, bigger batches are split up
+const unsigned QUEUE_DEPTH = 64;
+
+}
+
+#ifdef LUMBERJILL_HAS_IO_URING
+
+// A minimal io_uring, we only need to submit a batch of reads and wait for all of them so we use the system calls directly rather than adding liburing
+class cBatchFileReader::cRing {
+public:
+  cRing();
+  ~cRing();
+
+  bool Open();
+
+  // Returns the result of io_uring_enter, -1 with errno set on failure
+  int Enter(unsigned nToSubmit, unsigned nMinComplete);
+  int Register(unsigned nOpcode, const void* pArguments, unsigned nArguments);
+
+  io_uring_sqe* GetSQE(unsigned nIndex) { return &pSQEs[nIndex & nSQMask]; }
+
+  int fd;
+  bool bHasRegisteredFiles;
+  unsigned nEntries;
+
+  // Only we write the submission tail and the completion head, the kernel writes the others
+  unsigned* pSQTail;
+  unsigned* pSQArray;
+  unsigned nSQMask;
+  io_uring_sqe* pSQEs;
+
+  unsigned* pCQHead;
+  unsigned* pCQTail;
+  unsigned nCQMask;
+  io_uring_cqe* pCQEs;
+
+private:
+  void* pSQRing;
+  size_t nSQRingBytes;
+  void* pCQRing;
+  size_t nCQRingBytes;
+  size_t nSQEBytes;
+
+private:
+  cRing(const cRing&) = delete;
+  cRing& operator=(const cRing&) = delete;
+};
+
+cBatchFileReader::cRing::cRing() :
+  fd(-1),
+  bHasRegisteredFiles(false),
+  nEntries(0),
+  pSQTail(nullptr),
+  pSQArray(nullptr),
+  nSQMask(0),
+  pSQEs(nullptr),
+  pCQHead(nullptr),
+  pCQTail(nullptr),
+  nCQMask(0),
+  pCQEs(nullptr),
+  pSQRing(MAP_FAILED),
+  nSQRingBytes(0),
+  pCQRing(MAP_FAILED),
+  nCQRingBytes(0),
+  nSQEBytes(0)
+{
+}
+
+cBatchFileReader::cRing::~cRing()
+{
+  if (pSQEs != nullptr) munmap(pSQEs, nSQEBytes);
+  if ((pCQRing != MAP_FAILED) && (pCQRing != pSQRing)) munmap(pCQRing, nCQRingBytes);
+  if (pSQRing != MAP_FAILED) munmap(pSQRing, nSQRingBytes);
+
+  // Closing the ring also unregisters the files
+  if (fd >= 0) close(fd);
+}
+
+bool cBatchFileReader::cRing::Open()
+{
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+
+  fd = int(syscall(__NR_io_uring_setup, QUEUE_DEPTH, &params));
+  if (fd < 0) return false;
+
+  // IORING_OP_READ arrived in 5.6 along with this feature flag, on older kernels the reads would all fail with EINVAL
+  if ((params.features & IORING_FEAT_RW_CUR_POS) == 0) {
+    errno = EINVAL;
+    return false;
+  }
+
+  nEntries = params.sq_entries;
+
+  nSQRingBytes = params.sq_off.array + (params.sq_entries * sizeof(unsigned));
+  nCQRingBytes = params.cq_off.cqes + (params.cq_entries * sizeof(io_uring_cqe));
+
+  // Since 5.4 both rings are in one mapping
+  const bool bIsSingleMapping = ((params.features & IORING_FEAT_SINGLE_MMAP) != 0);
+  if (bIsSingleMapping) {
+    nSQRingBytes = std::max(nSQRingBytes, nCQRingBytes);
+    nCQRingBytes = nSQRingBytes;
+  }
+
+  pSQRing = mmap(nullptr, nSQRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (pSQRing == MAP_FAILED) return false;
+
+  if (bIsSingleMapping) {
+    pCQRing = pSQRing;
+  } else {
+    pCQRing = mmap(nullptr, nCQRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (pCQRing == MAP_FAILED) return false;
+  }
+
+  nSQEBytes = params.sq_entries * sizeof(io_uring_sqe);
+  void* pMapped = mmap(nullptr, nSQEBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (pMapped == MAP_FAILED) return false;
+  pSQEs = static_cast<io_uring_sqe*>(pMapped);
+
+  uint8_t* pSQ = static_cast<uint8_t*>(pSQRing);
+  pSQTail = reinterpret_cast<unsigned*>(pSQ + params.sq_off.tail);
+  pSQArray = reinterpret_cast<unsigned*>(pSQ + params.sq_off.array);
+  nSQMask = *reinterpret_cast<unsigned*>(pSQ + params.sq_off.ring_mask);
+
+  uint8_t* pCQ = static_cast<uint8_t*>(pCQRing);
+  pCQHead = reinterpret_cast<unsigned*>(pCQ + params.cq_off.head);
+  pCQTail = reinterpret_cast<unsigned*>(pCQ + params.cq_off.tail);
+  nCQMask = *reinterpret_cast<unsigned*>(pCQ + params.cq_off.ring_mask);
+  pCQEs = reinterpret_cast<io_uring_cqe*>(pCQ + params.cq_off.cqes);
+
+  return true;
+}
+
+int cBatchFileReader::cRing::Enter(unsigned nToSubmit, unsigned nMinComplete)
+{
+  return int(syscall(__NR_io_uring_enter, fd, nToSubmit, nMinComplete, IORING_ENTER_GETEVENTS, nullptr, 0));
+}
+
+int cBatchFileReader::cRing::Register(unsigned nOpcode, const void* pArguments, unsigned nArguments)
+{
+  return int(syscall(__NR_io_uring_register, fd, nOpcode, pArguments, nArguments));
+}
+
+#else
+
+// Without the io_uring header we always use pread
+class cBatchFileReader::cRing {
+};
+
+#endif
+
+cBatchFileReader::cBatchFileReader(size_t _nMaxBytes) :
+  cBatchFileReader(_nMaxBytes, false)
+{
+}
+
+cBatchFileReader::cBatchFileReader(size_t _nMaxBytes, bool _bUseIOUring) :
+  nMaxBytes(_nMaxBytes),
+  bWantIOUring(_bUseIOUring),
+  bUseIOUring(_bUseIOUring),
+  bAreRegisteredFilesDirty(false)
+{
+#ifndef LUMBERJILL_HAS_IO_URING
+  bUseIOUring = false;
+#endif
+}
+
+cBatchFileReader::~cBatchFileReader()
+{
+}
+
+size_t cBatchFileReader::Add(int fd)
+{
+  size_t slot = slots.size();
+  if (!freeSlots.empty()) {
+    slot = freeSlots.back();
+    freeSlots.pop_back();
+  } else {
+    slots.resize(slots.size() + 1);
+    buffer.resize(slots.size() * nMaxBytes);
+  }
+
+  slots[slot] = cSlot();
+  slots[slot].fd = fd;
+  bAreRegisteredFilesDirty = true;
+  return slot;
+}
+
+void cBatchFileReader::Remove(size_t slot)
+{
+  if ((slot >= slots.size()) || (slots[slot].fd < 0)) return;
+
+  slots[slot] = cSlot();
+  freeSlots.push_back(slot);
+  bAreRegisteredFilesDirty = true;
+}
+
+bool cBatchFileReader::GetContents(size_t slot, std::string_view& contents) const
+{
+  if ((slot >= slots.size()) || (slots[slot].nResult <= 0)) {
+    contents = std::string_view();
+    return false;
+  }
+
+  contents = std::string_view(&buffer[slot * nMaxBytes], size_t(slots[slot].nResult));
+  return true;
+}
+
+void cBatchFileReader::SetUseIOUring(bool _bUseIOUring)
+{
+  if (_bUseIOUring == bWantIOUring) return;
+
+  bWantIOUring = _bUseIOUring;
+  bUseIOUring = _bUseIOUring;
+  if (!bUseIOUring) pRing.reset();
+
+#ifndef LUMBERJILL_HAS_IO_URING
+  bUseIOUring = false;
+#endif
+}
+
+bool cBatchFileReader::IsUsingIOUring() const
+{
+  return bUseIOUring && (pRing != nullptr);
+}
+
+size_t cBatchFileReader::Read(const std::vector<size_t>& readSlots)
+{
+  for (size_t slot : readSlots) {
+    if (slot < slots.size()) slots[slot].nResult = -EBADF;
+  }
+
+  if (bUseIOUring && (pRing == nullptr) && !SetupRing()) {
+    bUseIOUring = false;
+  }
+
+  if (bUseIOUring) return ReadWithRing(readSlots);
+
+  return ReadWithPread(readSlots);
+}
+
+size_t cBatchFileReader::ReadWithPread(const std::vector<size_t>& readSlots)
+{
+  size_t nSyscalls = 0;
+  for (size_t slot : readSlots) {
+    if ((slot >= slots.size()) || (slots[slot].fd < 0)) continue;
+
+    // sysfs regenerates the value on every read from offset 0
+    ssize_t len = 0;
+    do {
+      len = pread(slots[slot].fd, &buffer[slot * nMaxBytes], nMaxBytes, 0);
+      nSyscalls++;
+    } while ((len < 0) && (errno == EINTR));
+
+    slots[slot].nResult = (len < 0) ? -errno : int32_t(len);
+  }
+
+  return nSyscalls;
+}
+
+#ifdef LUMBERJILL_HAS_IO_URING
+
+bool cBatchFileReader::SetupRing()
+{
+  pRing = std::make_unique<cRing>();
+  if (!pRing->Open()) {
+    // Quietly use pread, io_uring is commonly disabled in containers
+    syslog(LOG_INFO, "cBatchFileReader::SetupRing io_uring is not available, using pread: %s", strerror(errno));
+    pRing.reset();
+    return false;
+  }
+
+  bAreRegisteredFilesDirty = true;
+  return true;
+}
+
+size_t cBatchFileReader::RegisterFiles()
+{
+  size_t nSyscalls = 0;
+  bAreRegisteredFilesDirty = false;
+
+  if (pRing->bHasRegisteredFiles) {
+    pRing->Register(IORING_UNREGISTER_FILES, nullptr, 0);
+    pRing->bHasRegisteredFiles = false;
+    nSyscalls++;
+  }
+
+  registeredFiles.clear();
+  for (auto& slot : slots) {
+    if (slot.fd < 0) continue;
+
+    slot.nRegisteredIndex = uint32_t(registeredFiles.size());
+    registeredFiles.push_back(slot.fd);
+  }
+
+  if (registeredFiles.empty()) return nSyscalls;
+
+  // If the files can't be registered the reads still work, the kernel just has to look up each file for each read
+  pRing->bHasRegisteredFiles = (pRing->Register(IORING_REGISTER_FILES, registeredFiles.data(), unsigned(registeredFiles.size())) == 0);
+  return nSyscalls + 1;
+}
+
+size_t cBatchFileReader::ReadWithRing(const std::vector<size_t>& readSlots)
+{
+  size_t nSyscalls = 0;
+
+  if (bAreRegisteredFilesDirty) {
+    nSyscalls += RegisterFiles();
+  }
+
+  cRing& ring = *pRing;
+
+  size_t next = 0;
+  while (next < readSlots.size()) {
+    // Fill the submission queue
+    unsigned nTail = *ring.pSQTail;
+    unsigned n = 0;
+    while ((next < readSlots.size()) && (n < ring.nEntries)) {
+      const size_t slot = readSlots[next++];
+      if ((slot >= slots.size()) || (slots[slot].fd < 0)) continue;
+
+      io_uring_sqe* pSQE = ring.GetSQE(nTail);
+      memset(pSQE, 0, sizeof(*pSQE));
+      pSQE->opcode = IORING_OP_READ;
+      if (ring.bHasRegisteredFiles) {
+        pSQE->fd = int32_t(slots[slot].nRegisteredIndex);
+        pSQE->flags = IOSQE_FIXED_FILE;
+      } else {
+        pSQE->fd = slots[slot].fd;
+      }
+      pSQE->addr = uint64_t(reinterpret_cast<uintptr_t>(&buffer[slot * nMaxBytes]));
+      pSQE->len = uint32_t(nMaxBytes);
+      pSQE->off = 0;
+      pSQE->user_data = uint64_t(slot);
+
+      ring.pSQArray[nTail & ring.nSQMask] = nTail & ring.nSQMask;
+      nTail++;
+      n++;
+    }
+
+    if (n == 0) break;
+
+    __atomic_store_n(ring.pSQTail, nTail, __ATOMIC_RELEASE);
+
+    // Usually one call submits the whole batch and waits for all of it, we only go around again if a signal interrupted the wait
+    unsigned nSubmitted = 0;
+    unsigned nCompleted = 0;
+    while (true) {
+      unsigned nHead = *ring.pCQHead;
+      const unsigned nCQTail = __atomic_load_n(ring.pCQTail, __ATOMIC_ACQUIRE);
+      while (nHead != nCQTail) {
+        const io_uring_cqe& cqe = ring.pCQEs[nHead & ring.nCQMask];
+        if (cqe.user_data < slots.size()) slots[size_t(cqe.user_data)].nResult = cqe.res;
+        nHead++;
+        nCompleted++;
+      }
+      __atomic_store_n(ring.pCQHead, nHead, __ATOMIC_RELEASE);
+
+      if (nCompleted >= n) break;
+
+      const unsigned nToSubmit = n - nSubmitted;
+      const int result = ring.Enter(nToSubmit, n - nCompleted);
+      nSyscalls++;
+      if (result < 0) {
+        if ((errno == EINTR) || (errno == EAGAIN) || (errno == EBUSY)) continue;
+      } else {
+        nSubmitted += unsigned(result);
+        if ((nToSubmit == 0) || (result != 0)) continue;
+
+        // Nothing was submitted and nothing is in flight, we would wait forever
+        errno = EIO;
+      }
+
+      // The ring isn't working, read this batch and any later ones with pread instead
+      std::cerr<<"cBatchFileReader::ReadWithRing io_uring_enter failed, using pread: "<<strerror(errno)<<std::endl;
+      syslog(LOG_WARNING, "cBatchFileReader::ReadWithRing io_uring_enter failed, using pread: %s", strerror(errno));
+      pRing.reset();
+      bUseIOUring = false;
+      return nSyscalls + ReadWithPread(readSlots);
+    }
+  }
+
+  return nSyscalls;
+}
+
+#else
+
+bool cBatchFileReader::SetupRing()
+{
+  return false;
+}
+
+size_t cBatchFileReader::RegisterFiles()
+{
+  return 0;
+}
+
+size_t cBatchFileReader::ReadWithRing(const std::vector<size_t>& readSlots)
+{
+  return ReadWithPread(readSlots);
+}
+
+#endif
+
+}
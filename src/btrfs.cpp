@@ -1,6 +1,8 @@
 #include <limits>
 #include <iostream>
 #include <filesystem>
+#include <map>
+#include <system_error>
 
 #include <pwd.h>
 #include <sys/stat.h>
@@ -46,10 +48,19 @@ bool ParseBtrfsVolumeDeviceStats(std::string_view view, const std::vector<cDevic
     return false;
   }
 
+  // btrfs prints the kernel's path for each device, a device can be a /dev/disk/by-id link to it
+  std::map<std::string, std::string> mapKernelPathToDevicePath;
+
   for (auto& device : devices) {
     cBtrfsDriveStats btrfsDriveStats;
     btrfsDriveStats.sName = device.sName;
     btrfsVolumeStats.mapDrivePathToBtrfsDriveStats[device.sPath] = btrfsDriveStats;
+
+    std::error_code ec;
+    const std::filesystem::path canonical = std::filesystem::canonical(device.sPath, ec);
+    if (!ec && (canonical.string() != device.sPath)) {
+      mapKernelPathToDevicePath[canonical.string()] = device.sPath;
+    }
   }
 
   while (!view.empty()) {
@@ -90,7 +101,11 @@ bool ParseBtrfsVolumeDeviceStats(std::string_view view, const std::vector<cDevic
                     size_t value = 0;
                     if (StringParseValue(line, value)) {
 
-                      const std::string sPath(path.data(), path.length());
+                      std::string sPath(path.data(), path.length());
+                      const auto found = mapKernelPathToDevicePath.find(sPath);
+                      if (found != mapKernelPathToDevicePath.end()) {
+                        sPath = found->second;
+                      }
 
                       if (property == "write_io_errs") {
                         btrfsVolumeStats.mapDrivePathToBtrfsDriveStats[sPath].nWrite_io_errs = value;
@@ -120,14 +135,14 @@ bool ParseBtrfsVolumeDeviceStats(std::string_view view, const std::vector<cDevic
 }
 
 // Runs "btrfs device stats /data1" to collect BTRFS stats for a volume
-bool GetBtrfsVolumeDeviceStats(const std::string& sMountPoint, const std::vector<cDevice>& devices, cBtrfsVolumeStats& btrfsVolumeStats)
+bool GetBtrfsVolumeDeviceStats(const std::string& sBtrfsPath, const std::string& sMountPoint, const std::vector<cDevice>& devices, cBtrfsVolumeStats& btrfsVolumeStats)
 {
   btrfsVolumeStats.mapDrivePathToBtrfsDriveStats.clear();
 
   // Run "btrfs device stats /data1"
   std::string out_standard;
   std::string out_error;
-  const bool result = RunCommand("/usr/sbin/btrfs", std::vector<std::string> { "device", "stats", sMountPoint }, out_standard, out_error);
+  const bool result = RunCommand(sBtrfsPath, std::vector<std::string> { "device", "stats", sMountPoint }, out_standard, out_error);
   if (!result) {
     return false;
   }
@@ -136,6 +151,66 @@ bool GetBtrfsVolumeDeviceStats(const std::string& sMountPoint, const std::vector
   return ParseBtrfsVolumeDeviceStats(out_standard, devices, btrfsVolumeStats);
 }
 
+
+//$ sudo btrfs filesystem usage -b /data1/
+//Overall:
+//    Device size:                 12002371584000
+//    Device allocated:             9843720749056
+//    Device unallocated:           2158650834944
+//    ...
+
+bool ParseBtrfsFilesystemUsage(std::string_view view, size_t& nUnallocatedBytes)
+{
+  nUnallocatedBytes = 0;
+
+  const std::string_view key = "Device unallocated:";
+
+  while (!view.empty()) {
+    size_t new_line = view.find('\n');
+    std::string_view line = view.substr(0, new_line);
+
+    const size_t first = line.find_first_not_of(" \t");
+    if (first != std::string_view::npos) {
+      line.remove_prefix(first);
+
+      if (line.starts_with(key)) {
+        line.remove_prefix(key.length());
+
+        const size_t value_start = line.find_first_not_of(" \t");
+        if (value_start == std::string_view::npos) {
+          return false;
+        }
+
+        line.remove_prefix(value_start);
+        return StringParseValue(line, nUnallocatedBytes);
+      }
+    }
+
+    if (new_line == std::string_view::npos) {
+      break;
+    }
+
+    view.remove_prefix(new_line + 1);
+  }
+
+  return false;
+}
+
+// Runs "btrfs filesystem usage -b /data1" to get the unallocated space on a volume
+bool GetBtrfsFilesystemUsage(const std::string& sBtrfsPath, const std::string& sMountPoint, size_t& nUnallocatedBytes)
+{
+  nUnallocatedBytes = 0;
+
+  std::string out_standard;
+  std::string out_error;
+  const bool result = RunCommand(sBtrfsPath, std::vector<std::string> { "filesystem", "usage", "-b", sMountPoint }, out_standard, out_error);
+  if (!result) {
+    return false;
+  }
+
+  return ParseBtrfsFilesystemUsage(out_standard, nUnallocatedBytes);
+}
+
 }
 
 }
@@ -0,0 +1,275 @@
+#include <cerrno>
+#include <cstring>
+
+#include <algorithm>
+#include <iostream>
+
+#include <endian.h>
+#include <fcntl.h>
+#include <linux/btrfs.h>
+#include <linux/btrfs_tree.h>
+#include <sys/ioctl.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "btrfs_qgroup.h"
+
+namespace lumberjill {
+
+namespace {
+
+// Big enough for about 14,000 qgroups per search, so most volumes only need one
+const size_t SEARCH_BUFFER_BYTES = 1024 * 1024;
+
+// A qgroup id is the level in the top 16 bits and the subvolume id, or a number picked by the admin for higher levels
+const unsigned int QGROUP_LEVEL_SHIFT = 48;
+
+bool IsLargerReferenced(const cBtrfsQgroup& lhs, const cBtrfsQgroup& rhs)
+{
+  if (lhs.nReferencedBytes != rhs.nReferencedBytes) return (lhs.nReferencedBytes > rhs.nReferencedBytes);
+  return (lhs.nSubvolumeId < rhs.nSubvolumeId);
+}
+
+bool IsLargerExclusive(const cBtrfsQgroup& lhs, const cBtrfsQgroup& rhs)
+{
+  if (lhs.nExclusiveBytes != rhs.nExclusiveBytes) return (lhs.nExclusiveBytes > rhs.nExclusiveBytes);
+  return (lhs.nSubvolumeId < rhs.nSubvolumeId);
+}
+
+const cBtrfsQgroup* FindQgroup(const std::vector<cBtrfsQgroup>& qgroups, uint64_t nSubvolumeId)
+{
+  const auto found = std::lower_bound(qgroups.begin(), qgroups.end(), nSubvolumeId, [](const cBtrfsQgroup& qgroup, uint64_t id) { return (qgroup.nSubvolumeId < id); });
+  if ((found == qgroups.end()) || (found->nSubvolumeId != nSubvolumeId)) return nullptr;
+  return &*found;
+}
+
+void GetTop(const std::vector<cBtrfsQgroup>& qgroups, const std::vector<cBtrfsQgroup>& previous, size_t nTop, bool (*pIsLarger)(const cBtrfsQgroup&, const cBtrfsQgroup&), std::vector<cBtrfsSubvolumeUsage>& top)
+{
+  // Only the top few are kept while going through the array, this is O(n log nTop) without copying or sorting everything
+  std::vector<cBtrfsQgroup> largest(std::min(nTop, qgroups.size()));
+  std::partial_sort_copy(qgroups.begin(), qgroups.end(), largest.begin(), largest.end(), pIsLarger);
+
+  top.reserve(largest.size());
+  for (auto& qgroup : largest) {
+    cBtrfsSubvolumeUsage usage;
+    usage.nSubvolumeId = qgroup.nSubvolumeId;
+    usage.nReferencedBytes = qgroup.nReferencedBytes;
+    usage.nExclusiveBytes = qgroup.nExclusiveBytes;
+    usage.nMaxReferencedBytes = qgroup.nMaxReferencedBytes;
+    usage.nMaxExclusiveBytes = qgroup.nMaxExclusiveBytes;
+
+    const cBtrfsQgroup* pPrevious = FindQgroup(previous, qgroup.nSubvolumeId);
+    if (pPrevious != nullptr) {
+      usage.nReferencedChangeBytes = int64_t(qgroup.nReferencedBytes - pPrevious->nReferencedBytes);
+      usage.nExclusiveChangeBytes = int64_t(qgroup.nExclusiveBytes - pPrevious->nExclusiveBytes);
+    }
+
+    top.push_back(usage);
+  }
+}
+
+void InitSearchKey(btrfs_ioctl_search_key& key, uint64_t nTreeId)
+{
+  memset(&key, 0, sizeof(key));
+  key.tree_id = nTreeId;
+  key.max_objectid = UINT64_MAX;
+  key.max_offset = UINT64_MAX;
+  key.max_transid = UINT64_MAX;
+  key.max_type = UINT32_MAX;
+}
+
+}
+
+bool DecodeBtrfsQgroupSearchResult(const uint8_t* pBuffer, size_t nBufferBytes, size_t nItems, std::vector<cBtrfsQgroup>& qgroups, cBtrfsSearchKey& lastKey)
+{
+  size_t offset = 0;
+  for (size_t i = 0; i < nItems; i++) {
+    // Each item is a search header followed by the item itself, neither is aligned
+    btrfs_ioctl_search_header header;
+    if ((nBufferBytes - offset) < sizeof(header)) return false;
+    memcpy(&header, pBuffer + offset, sizeof(header));
+    offset += sizeof(header);
+
+    if ((nBufferBytes - offset) < header.len) return false;
+    const uint8_t* pItem = pBuffer + offset;
+    offset += header.len;
+
+    lastKey.nObjectId = header.objectid;
+    lastKey.nType = header.type;
+    lastKey.nOffset = header.offset;
+
+    // Higher level qgroups are groups of subvolumes, only the subvolumes themselves are reported
+    if ((header.offset >> QGROUP_LEVEL_SHIFT) != 0) continue;
+
+    // The items are little endian on disk
+    if ((header.type == BTRFS_QGROUP_INFO_KEY) && (header.len >= sizeof(btrfs_qgroup_info_item))) {
+      btrfs_qgroup_info_item item;
+      memcpy(&item, pItem, sizeof(item));
+
+      cBtrfsQgroup qgroup;
+      qgroup.nSubvolumeId = header.offset;
+      qgroup.nReferencedBytes = le64toh(item.rfer);
+      qgroup.nExclusiveBytes = le64toh(item.excl);
+      qgroup.nMaxReferencedBytes = 0;
+      qgroup.nMaxExclusiveBytes = 0;
+      qgroups.push_back(qgroup);
+    } else if ((header.type == BTRFS_QGROUP_LIMIT_KEY) && (header.len >= sizeof(btrfs_qgroup_limit_item))) {
+      btrfs_qgroup_limit_item item;
+      memcpy(&item, pItem, sizeof(item));
+
+      // The limit items come after all of the info items
+      const auto found = std::lower_bound(qgroups.begin(), qgroups.end(), header.offset, [](const cBtrfsQgroup& qgroup, uint64_t id) { return (qgroup.nSubvolumeId < id); });
+      if ((found != qgroups.end()) && (found->nSubvolumeId == header.offset)) {
+        const uint64_t flags = le64toh(item.flags);
+        if ((flags & BTRFS_QGROUP_LIMIT_MAX_RFER) != 0) found->nMaxReferencedBytes = le64toh(item.max_rfer);
+        if ((flags & BTRFS_QGROUP_LIMIT_MAX_EXCL) != 0) found->nMaxExclusiveBytes = le64toh(item.max_excl);
+      }
+    }
+  }
+
+  return true;
+}
+
+void GetBtrfsQgroupStats(const std::vector<cBtrfsQgroup>& qgroups, const std::vector<cBtrfsQgroup>& previous, size_t nTop, cBtrfsQgroupStats& qgroupStats)
+{
+  qgroupStats = cBtrfsQgroupStats();
+  qgroupStats.nSubvolumes = qgroups.size();
+
+  GetTop(qgroups, previous, nTop, IsLargerReferenced, qgroupStats.topReferenced);
+  GetTop(qgroups, previous, nTop, IsLargerExclusive, qgroupStats.topExclusive);
+}
+
+cBtrfsQgroupCollector::cBtrfsQgroupCollector() :
+  searchBuffer((sizeof(btrfs_ioctl_search_args_v2) + SEARCH_BUFFER_BYTES) / sizeof(uint64_t))
+{
+}
+
+cBtrfsQgroupCollector::~cBtrfsQgroupCollector()
+{
+}
+
+bool cBtrfsQgroupCollector::SearchQgroups(int fd, const std::string& sMountPoint, std::vector<cBtrfsQgroup>& outQgroups)
+{
+  btrfs_ioctl_search_args_v2* pArgs = reinterpret_cast<btrfs_ioctl_search_args_v2*>(searchBuffer.data());
+
+  // Every info and limit item, they are all (0, type, qgroup id)
+  InitSearchKey(pArgs->key, BTRFS_QUOTA_TREE_OBJECTID);
+  pArgs->key.max_objectid = 0;
+  pArgs->key.min_type = BTRFS_QGROUP_INFO_KEY;
+  pArgs->key.max_type = BTRFS_QGROUP_LIMIT_KEY;
+
+  while (true) {
+    pArgs->key.nr_items = UINT32_MAX;
+    pArgs->buf_size = SEARCH_BUFFER_BYTES;
+
+    if (ioctl(fd, BTRFS_IOC_TREE_SEARCH_V2, pArgs) != 0) {
+      if (errno == ENOENT) {
+        // There is no quota tree
+        if (quotasDisabledMounts.insert(sMountPoint).second) {
+          std::cerr<<"cBtrfsQgroupCollector::SearchQgroups Quotas are not enabled on \""<<sMountPoint<<"\", run \"btrfs quota enable "<<sMountPoint<<"\""<<std::endl;
+          syslog(LOG_WARNING, "cBtrfsQgroupCollector::SearchQgroups Quotas are not enabled on \"%s\", run \"btrfs quota enable %s\"", sMountPoint.c_str(), sMountPoint.c_str());
+        }
+      } else {
+        std::cerr<<"cBtrfsQgroupCollector::SearchQgroups Error searching the quota tree of \""<<sMountPoint<<"\": "<<strerror(errno)<<std::endl;
+        syslog(LOG_ERR, "cBtrfsQgroupCollector::SearchQgroups Error searching the quota tree of \"%s\": %s", sMountPoint.c_str(), strerror(errno));
+      }
+      return false;
+    }
+
+    quotasDisabledMounts.erase(sMountPoint);
+
+    // Nothing left
+    if (pArgs->key.nr_items == 0) break;
+
+    cBtrfsSearchKey lastKey;
+    if (!DecodeBtrfsQgroupSearchResult(reinterpret_cast<const uint8_t*>(pArgs->buf), SEARCH_BUFFER_BYTES, pArgs->key.nr_items, outQgroups, lastKey)) {
+      syslog(LOG_ERR, "cBtrfsQgroupCollector::SearchQgroups Truncated search result for \"%s\"", sMountPoint.c_str());
+      return false;
+    }
+
+    // Carry on from the item after the last one
+    if (lastKey.nOffset < UINT64_MAX) {
+      pArgs->key.min_type = lastKey.nType;
+      pArgs->key.min_offset = lastKey.nOffset + 1;
+    } else if (lastKey.nType < pArgs->key.max_type) {
+      pArgs->key.min_type = lastKey.nType + 1;
+      pArgs->key.min_offset = 0;
+    } else {
+      break;
+    }
+  }
+
+  return true;
+}
+
+bool cBtrfsQgroupCollector::GetSubvolumeName(int fd, uint64_t nSubvolumeId, std::string& sName)
+{
+  sName.clear();
+
+  // The top level subvolume has no name, this is what "btrfs qgroup show" calls it
+  if (nSubvolumeId == BTRFS_FS_TREE_OBJECTID) {
+    sName = "<FS_TREE>";
+    return true;
+  }
+
+  // The root backref is (subvolume id, BTRFS_ROOT_BACKREF_KEY, parent id) and holds the name in the parent
+  btrfs_ioctl_search_args_v2* pArgs = reinterpret_cast<btrfs_ioctl_search_args_v2*>(searchBuffer.data());
+  InitSearchKey(pArgs->key, BTRFS_ROOT_TREE_OBJECTID);
+  pArgs->key.min_objectid = nSubvolumeId;
+  pArgs->key.max_objectid = nSubvolumeId;
+  pArgs->key.min_type = BTRFS_ROOT_BACKREF_KEY;
+  pArgs->key.max_type = BTRFS_ROOT_BACKREF_KEY;
+  pArgs->key.nr_items = 1;
+  pArgs->buf_size = SEARCH_BUFFER_BYTES;
+
+  if ((ioctl(fd, BTRFS_IOC_TREE_SEARCH_V2, pArgs) != 0) || (pArgs->key.nr_items == 0)) {
+    // Deleted, the qgroup is left behind until it is removed by hand
+    return false;
+  }
+
+  const uint8_t* pBuffer = reinterpret_cast<const uint8_t*>(pArgs->buf);
+  btrfs_ioctl_search_header header;
+  memcpy(&header, pBuffer, sizeof(header));
+  if ((header.type != BTRFS_ROOT_BACKREF_KEY) || (header.len < sizeof(btrfs_root_ref))) return false;
+
+  btrfs_root_ref ref;
+  memcpy(&ref, pBuffer + sizeof(header), sizeof(ref));
+  const size_t nNameLength = le16toh(ref.name_len);
+  if ((sizeof(ref) + nNameLength) > header.len) return false;
+
+  sName.assign(reinterpret_cast<const char*>(pBuffer + sizeof(header) + sizeof(ref)), nNameLength);
+  return true;
+}
+
+bool cBtrfsQgroupCollector::Collect(const std::string& sMountPoint, size_t nTop, cBtrfsQgroupStats& qgroupStats)
+{
+  qgroupStats = cBtrfsQgroupStats();
+
+  const int fd = open(sMountPoint.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    std::cerr<<"cBtrfsQgroupCollector::Collect Error opening \""<<sMountPoint<<"\": "<<strerror(errno)<<std::endl;
+    syslog(LOG_ERR, "cBtrfsQgroupCollector::Collect Error opening \"%s\": %s", sMountPoint.c_str(), strerror(errno));
+    return false;
+  }
+
+  qgroups.clear();
+  if (!SearchQgroups(fd, sMountPoint, qgroups)) {
+    close(fd);
+    return false;
+  }
+
+  std::vector<cBtrfsQgroup>& previous = previousQgroups[sMountPoint];
+  GetBtrfsQgroupStats(qgroups, previous, nTop, qgroupStats);
+
+  for (auto& usage : qgroupStats.topReferenced) GetSubvolumeName(fd, usage.nSubvolumeId, usage.sName);
+  for (auto& usage : qgroupStats.topExclusive) GetSubvolumeName(fd, usage.nSubvolumeId, usage.sName);
+
+  close(fd);
+
+  // Keep these for the next collection, swapping keeps the memory of both arrays for reuse
+  previous.swap(qgroups);
+
+  return true;
+}
+
+}
@@ -0,0 +1,150 @@
+#include <cmath>
+#include <cstring>
+#include <ctime>
+
+#include <vector>
+
+#include "capacity_forecast.h"
+#include "utils.h"
+
+namespace lumberjill {
+
+namespace {
+
+const char CAPACITY_STATE_MAGIC[8] = { 'L', 'J', 'C', 'A', 'P', 'A', 'C', '\0' };
+
+// Bump this whenever the header or the entry layout changes, older files are then ignored and the trends start again
+const uint32_t CAPACITY_STATE_VERSION = 1;
+
+const size_t MAX_MOUNT_POINT_LENGTH = 239;
+
+// Mounts that haven't been seen for this long are dropped from the state file
+const int64_t EXPIRE_SECONDS = 90 * 24 * 60 * 60;
+
+const double SECONDS_PER_DAY = 24.0 * 60.0 * 60.0;
+
+// A forecast from a single pair of samples is mostly noise
+const uint32_t MIN_TREND_SAMPLES = 3;
+
+// One mount in the file
+class cEntry {
+public:
+  char szMountPoint[MAX_MOUNT_POINT_LENGTH + 1];
+  cCapacityTrend trend;
+};
+
+static_assert(sizeof(cEntry) == (240 + 32));
+
+}
+
+void cCapacityTrend::Add(int64_t nTimestamp, double dAvailableBytes, double dHalfLifeSeconds)
+{
+  const bool bHasPrevious = (nLastTimestamp != 0) && (nTimestamp > nLastTimestamp);
+  const double dSeconds = double(nTimestamp - nLastTimestamp);
+  const double dPreviousBytes = dLastBytes;
+
+  dLastBytes = dAvailableBytes;
+  nLastTimestamp = nTimestamp;
+
+  // The first sample, or a clock that went backwards, doesn't give us a rate
+  if (!bHasPrevious) return;
+
+  const double dRate = (dPreviousBytes - dAvailableBytes) / dSeconds;
+  if (nSamples == 0) {
+    dRateBytesPerSecond = dRate;
+  } else {
+    // A sample that covers a longer interval counts for more
+    const double dWeight = 1.0 - std::pow(0.5, dSeconds / dHalfLifeSeconds);
+    dRateBytesPerSecond += dWeight * (dRate - dRateBytesPerSecond);
+  }
+
+  if (nSamples < UINT32_MAX) nSamples++;
+}
+
+cCapacityForecaster::cCapacityForecaster() :
+  bIsLoaded(false)
+{
+}
+
+cCapacityForecaster::~cCapacityForecaster()
+{
+}
+
+bool cCapacityForecaster::Load(const std::string& sFilePath)
+{
+  mounts.clear();
+
+  // Even if there is nothing to load we don't want to try again and throw away what has been collected since
+  bIsLoaded = true;
+
+  std::vector<cEntry> entries;
+  if (!LoadStateFile(sFilePath, CAPACITY_STATE_MAGIC, CAPACITY_STATE_VERSION, entries)) {
+    return false;
+  }
+
+  for (auto& entry : entries) {
+    mounts[std::string(entry.szMountPoint, strnlen(entry.szMountPoint, sizeof(entry.szMountPoint)))] = entry.trend;
+  }
+
+  return true;
+}
+
+bool cCapacityForecaster::Save(const std::string& sFilePath) const
+{
+  const int64_t nNow = int64_t(time(nullptr));
+
+  std::vector<cEntry> entries;
+  entries.reserve(mounts.size());
+  for (auto& item : mounts) {
+    if (item.first.empty() || (item.first.length() > MAX_MOUNT_POINT_LENGTH)) continue;
+
+    if ((nNow - item.second.nLastTimestamp) > EXPIRE_SECONDS) continue;
+
+    cEntry entry {};
+    memcpy(entry.szMountPoint, item.first.c_str(), item.first.length());
+    entry.trend = item.second;
+    entries.push_back(entry);
+  }
+
+  return SaveStateFile(sFilePath, CAPACITY_STATE_MAGIC, CAPACITY_STATE_VERSION, entries, true);
+}
+
+void cCapacityForecaster::Update(const cCapacitySettings& settings, int64_t nTimestamp, cMountStats& mountStats)
+{
+  mountStats.capacityForecast.reset();
+
+  // On btrfs the unallocated space running out is what causes ENOSPC, often while statvfs still shows plenty free
+  CAPACITY_BASIS basis = CAPACITY_BASIS::FREE;
+  size_t nAvailableBytes = 0;
+  if (mountStats.nUnallocatedBytes.has_value()) {
+    basis = CAPACITY_BASIS::UNALLOCATED;
+    nAvailableBytes = mountStats.nUnallocatedBytes.value();
+  } else if (mountStats.nFreeBytes.has_value()) {
+    nAvailableBytes = mountStats.nFreeBytes.value();
+  } else {
+    // The mount didn't respond, wait for the next sample
+    return;
+  }
+
+  cCapacityTrend& trend = mounts[mountStats.sMountPoint];
+  if (trend.nBasis != uint32_t(basis)) {
+    trend = cCapacityTrend();
+    trend.nBasis = uint32_t(basis);
+  }
+
+  trend.Add(nTimestamp, double(nAvailableBytes), double(settings.nTrendHalfLifeHours) * 60.0 * 60.0);
+  if (trend.nSamples < MIN_TREND_SAMPLES) return;
+
+  cCapacityForecast forecast;
+  forecast.basis = basis;
+  forecast.nAvailableBytes = nAvailableBytes;
+  forecast.dFillRateBytesPerDay = trend.dRateBytesPerSecond * SECONDS_PER_DAY;
+  if (forecast.dFillRateBytesPerDay > 0.0) {
+    forecast.dDaysToFull = double(nAvailableBytes) / forecast.dFillRateBytesPerDay;
+    forecast.bIsAlert = (forecast.dDaysToFull.value() < double(settings.nHorizonDays));
+  }
+
+  mountStats.capacityForecast = forecast;
+}
+
+}
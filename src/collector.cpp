@@ -0,0 +1,497 @@
+#include <chrono>
+#include <ctime>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <set>
+#include <system_error>
+
+#include <sys/resource.h>
+
+#include "btrfs.h"
+#include "collector.h"
+#include "latency_probe.h"
+#include "output.h"
+#include "self_test.h"
+#include "smart_scheduler.h"
+#include "smartctl.h"
+#include "stats.h"
+#include "topology.h"
+#include "utils.h"
+
+namespace lumberjill {
+
+namespace {
+
+// The node of each device in each group, "" if it isn't present, allocated from the collection's arena
+typedef std::pmr::vector<std::pmr::vector<std::string>> DeviceNodes;
+
+uint64_t GetCPUTimeMS(const struct rusage& usage)
+{
+  return (uint64_t(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000) + (uint64_t(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000);
+}
+
+// Run smartctl on every drive that is present, spread out according to the SMART schedule settings
+// mapDrivePathToQueryResult is filled in with how each drive's query went, drives whose results came from the result cache aren't in it
+void QuerySmartCtlForGroups(const cSettings& settings, const std::vector<cGroup>& groups, const DeviceNodes& deviceNodes, cCollectorState& state, std::map<std::string, cSmartCtlStats>& results, std::map<std::string, SMART_QUERY_RESULT>& mapDrivePathToQueryResult)
+{
+  std::vector<cSmartQueryRequest> requests;
+  std::pmr::set<std::string> devicePaths(&state.arena);
+
+  const int64_t nNow = int64_t(time(nullptr));
+
+  for (size_t g = 0; g < groups.size(); g++) {
+    for (size_t d = 0; d < groups[g].devices.size(); d++) {
+      const std::string& sDevicePath = groups[g].devices[d].sPath;
+      if (!IsDrivePresent(sDevicePath) || !devicePaths.insert(sDevicePath).second) continue;
+
+      // Another run collected this drive recently enough
+      cSmartCtlStats cachedStats;
+      if ((state.pResultCache != nullptr) && state.pResultCache->Get(sDevicePath, nNow, state.nResultCacheMaxAgeSeconds, cachedStats)) {
+        results[sDevicePath] = cachedStats;
+        continue;
+      }
+
+      cSmartQueryRequest request;
+      request.sDevicePath = sDevicePath;
+      if (!deviceNodes[g][d].empty()) {
+        request.sController = GetBlockDeviceController("/sys", deviceNodes[g][d]);
+      }
+      requests.push_back(request);
+    }
+  }
+
+  const cSmartScheduleSettings& scheduleSettings = settings.GetSmartScheduleSettings();
+  const bool bSkipStandby = scheduleSettings.bSkipStandby;
+
+  // A query that is still running at the deadline outlives this function, so it has its own copy of the path
+  const cSmartScheduler scheduler(std::chrono::seconds(scheduleSettings.nWindowSeconds), scheduleSettings.nMaxPerController, std::chrono::seconds(scheduleSettings.nDeadlineSeconds), [sSmartCtlPath = settings.GetSmartCtlPath(), bSkipStandby](const std::string& sDevicePath, cSmartCtlStats& smartctlStats) {
+    return smartctl::GetDriveSmartControlData(sSmartCtlPath, sDevicePath, bSkipStandby, smartctlStats);
+  }, state.smartDevicesInFlight);
+
+  cSmartSchedule schedule;
+  scheduler.Plan(requests, schedule);
+  scheduler.Run(schedule, results, state.bStopRequested);
+
+  // Drives in standby are reported with the values from the last time they were active
+  const uint64_t nNowMS = GetTimeSinceBootMS();
+  for (auto& item : results) {
+    state.smartctlSampleCache.Update(item.first, nNowMS, item.second);
+  }
+
+  // Share what we collected with other runs, but not the failures so that the next run tries them again
+  // A drive in standby that we have no values for is left out too, so that it doesn't replace the values another run got while the drive was active
+  if (state.pResultCache != nullptr) {
+    for (auto& entry : schedule.entries) {
+      // Skipped and timed out queries have no results
+      const auto found = results.find(entry.sDevicePath);
+      if (found == results.end()) continue;
+
+      const cSmartCtlStats& smartctlStats = found->second;
+      if ((entry.result == SMART_QUERY_RESULT::OK) || ((entry.result == SMART_QUERY_RESULT::STANDBY) && smartctlStats.HasValues())) {
+        state.pResultCache->Set(entry.sDevicePath, nNow, smartctlStats);
+      }
+    }
+  }
+
+  for (auto& entry : schedule.entries) {
+    mapDrivePathToQueryResult[entry.sDevicePath] = entry.result;
+  }
+
+  LogSmartScheduleToSyslog(schedule);
+}
+
+// Run smartctl on a single drive outside of the SMART schedule, it is abandoned after deadline_seconds like the scheduled queries
+void QuerySmartCtlForDevice(const cSettings& settings, const std::string& sDevicePath, cCollectorState& state, cSmartCtlStats& smartctlStats)
+{
+  std::shared_ptr<cSmartCtlStats> callStats = std::make_shared<cSmartCtlStats>();
+  const SMART_QUERY_RESULT result = RunSmartCall(state.smartDevicesInFlight, sDevicePath, std::chrono::seconds(settings.GetSmartScheduleSettings().nDeadlineSeconds), state.bStopRequested, [sSmartCtlPath = settings.GetSmartCtlPath(), sDevicePath, bSkipStandby = settings.GetSmartScheduleSettings().bSkipStandby, callStats]() {
+    return smartctl::GetDriveSmartControlData(sSmartCtlPath, sDevicePath, bSkipStandby, *callStats);
+  });
+
+  // Whatever smartctl did get is still logged if it failed part way through
+  if ((result == SMART_QUERY_RESULT::OK) || (result == SMART_QUERY_RESULT::ERROR)) {
+    smartctlStats = *callStats;
+  }
+}
+
+// Check on the self-tests that are running and start the ones that are due, drives in standby are left until they are active
+// Like the SMART queries each smartctl call is abandoned after deadline_seconds, and drives whose SMART query timed out are left alone
+void UpdateSelfTestsForGroups(const cSettings& settings, const std::vector<cGroup>& groups, const DeviceNodes& deviceNodes, const std::map<std::string, cSmartCtlStats>& mapDrivePathToSmartCtlStats, const std::map<std::string, SMART_QUERY_RESULT>& mapDrivePathToQueryResult, cCollectorState& state, std::map<std::string, cDriveSelfTestStats>& results)
+{
+  const cSelfTestSettings& selfTestSettings = settings.GetSelfTestSettings();
+  if (!state.selfTestScheduler.IsLoaded()) {
+    state.selfTestScheduler.Load(selfTestSettings.sStateFilePath);
+  }
+
+  std::vector<cSelfTestRequest> requests;
+  for (size_t g = 0; g < groups.size(); g++) {
+    for (size_t d = 0; d < groups[g].devices.size(); d++) {
+      const std::string& sDevicePath = groups[g].devices[d].sPath;
+      if (!IsDrivePresent(sDevicePath)) continue;
+
+      cSelfTestRequest request;
+      request.sDevicePath = sDevicePath;
+      request.nGroup = g;
+      if (!deviceNodes[g][d].empty()) {
+        request.sController = GetBlockDeviceController("/sys", deviceNodes[g][d]);
+      }
+
+      // Drives we couldn't query are treated as in standby, we don't know that they would run a test
+      const auto found = mapDrivePathToSmartCtlStats.find(sDevicePath);
+      request.bIsInStandby = ((found == mapDrivePathToSmartCtlStats.end()) || found->second.bIsInStandby);
+      requests.push_back(request);
+    }
+  }
+
+  const std::string& sSmartCtlPath = settings.GetSmartCtlPath();
+  const std::chrono::milliseconds timeout = std::chrono::seconds(settings.GetSmartScheduleSettings().nDeadlineSeconds);
+
+  const auto hasTimedOut = [&mapDrivePathToQueryResult](const std::string& sDevicePath) {
+    const auto found = mapDrivePathToQueryResult.find(sDevicePath);
+    return ((found != mapDrivePathToQueryResult.end()) && (found->second == SMART_QUERY_RESULT::TIMED_OUT));
+  };
+
+  // The calls run on their own threads so they get their own copies of everything, a call that is abandoned outlives this function
+  state.selfTestScheduler.Update(selfTestSettings, int64_t(time(nullptr)), requests, [&](const std::string& sDevicePath, SELF_TEST_TYPE type) {
+    if (hasTimedOut(sDevicePath)) return false;
+
+    return (RunSmartCall(state.smartDevicesInFlight, sDevicePath, timeout, state.bStopRequested, [sSmartCtlPath, sDevicePath, type]() {
+      return smartctl::StartDriveSelfTest(sSmartCtlPath, sDevicePath, type);
+    }) == SMART_QUERY_RESULT::OK);
+  }, [&](const std::string& sDevicePath, cSmartSelfTestStatus& status) {
+    if (hasTimedOut(sDevicePath)) return false;
+
+    std::shared_ptr<cSmartSelfTestStatus> callStatus = std::make_shared<cSmartSelfTestStatus>();
+    if (RunSmartCall(state.smartDevicesInFlight, sDevicePath, timeout, state.bStopRequested, [sSmartCtlPath, sDevicePath, callStatus]() {
+      return smartctl::GetDriveSelfTestStatus(sSmartCtlPath, sDevicePath, *callStatus);
+    }) != SMART_QUERY_RESULT::OK) {
+      return false;
+    }
+
+    status = *callStatus;
+    return true;
+  }, results);
+
+  state.selfTestScheduler.Save(selfTestSettings.sStateFilePath);
+}
+
+}
+
+cCollectorState::cCollectorState() :
+  bStopRequested(false),
+  smartDevicesInFlight(std::make_shared<cSmartDevicesInFlight>()),
+  pResultCache(nullptr),
+  nResultCacheMaxAgeSeconds(0)
+{
+}
+
+cCollectorState::~cCollectorState()
+{
+}
+
+bool IsDrivePresent(const std::string& sDevicePath)
+{
+  const std::filesystem::path p(sDevicePath);
+  std::error_code ec;
+  return std::filesystem::exists(p, ec);
+}
+
+bool GetDeviceNode(const std::string& sDevicePath, std::string& sNode)
+{
+  std::error_code ec;
+  const std::filesystem::path canonical = std::filesystem::canonical(sDevicePath, ec);
+  if (ec) {
+    return false;
+  }
+
+  sNode = canonical.filename().string();
+  return !sNode.empty();
+}
+
+bool QueryAndLogGroups(const cSettings& settings, const std::vector<cGroup>& groups, cMountQueryPool& mountQueryPool, cCollectorState& state)
+{
+  bool result = true;
+
+  // Measure what this collection costs, the children are the smartctl and btrfs processes that we have waited for
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  struct rusage self_start;
+  struct rusage children_start;
+  getrusage(RUSAGE_SELF, &self_start);
+  getrusage(RUSAGE_CHILDREN, &children_start);
+
+  // Everything allocated from the arena by the previous collection has gone now, the arena keeps its memory for this one
+  state.arena.Reset();
+
+  // Sample the I/O counters for every drive up front, before smartctl adds its own reads to them
+  DeviceNodes deviceNodes(groups.size(), &state.arena);
+  std::pmr::vector<std::string> nodes(&state.arena);
+  for (size_t g = 0; g < groups.size(); g++) {
+    deviceNodes[g].resize(groups[g].devices.size());
+    for (size_t d = 0; d < groups[g].devices.size(); d++) {
+      if (GetDeviceNode(groups[g].devices[d].sPath, deviceNodes[g][d])) {
+        nodes.push_back(deviceNodes[g][d]);
+      }
+    }
+  }
+
+  state.diskStatsCollector.Sample(nodes);
+
+  // Take a temperature sample now as well, so that there is at least one even if this is the first collection
+  state.temperatureCollector.SetUseIOUring(settings.GetTemperatureSettings().bUseIOUring);
+  state.temperatureCollector.Update(nodes);
+  state.temperatureCollector.Sample();
+
+  std::map<std::string, cSmartCtlStats> mapDrivePathToSmartCtlStats;
+  std::map<std::string, SMART_QUERY_RESULT> mapDrivePathToQueryResult;
+  QuerySmartCtlForGroups(settings, groups, deviceNodes, state, mapDrivePathToSmartCtlStats, mapDrivePathToQueryResult);
+
+  std::map<std::string, cDriveSelfTestStats> mapDrivePathToSelfTestStats;
+  if (settings.GetSelfTestSettings().bEnabled) {
+    UpdateSelfTestsForGroups(settings, groups, deviceNodes, mapDrivePathToSmartCtlStats, mapDrivePathToQueryResult, state, mapDrivePathToSelfTestStats);
+  }
+
+  const cLatencyProbeSettings& latencyProbeSettings = settings.GetLatencyProbeSettings();
+  cLatencyHistogram latencyHistogram;
+
+  // Load the baselines and trends from the previous run the first time through, the daemon keeps them in memory after that
+  const cAnomalySettings& anomalySettings = settings.GetAnomalySettings();
+  if (anomalySettings.bEnabled && !state.anomalyDetector.IsLoaded()) {
+    state.anomalyDetector.Load(anomalySettings.sStateFilePath);
+  }
+
+  const cCapacitySettings& capacitySettings = settings.GetCapacitySettings();
+  if (capacitySettings.bEnabled && !state.capacityForecaster.IsLoaded()) {
+    state.capacityForecaster.Load(capacitySettings.sStateFilePath);
+  }
+
+  const cQgroupSettings& qgroupSettings = settings.GetQgroupSettings();
+
+  cStatsSnapshot snapshot;
+  snapshot.groups.reserve(groups.size());
+
+  for (size_t g = 0; g < groups.size(); g++) {
+    const cGroup& group = groups[g];
+
+    // Get mount usage stats
+    cMountStats mountStats;
+    mountStats.sMountPoint = group.sMountPoint;
+    mountStats.bIsResponsive = (mountQueryPool.GetMountTotalAndFreeSpace(group.sMountPoint, std::chrono::milliseconds(group.nMountTimeoutMS), mountStats) != MOUNT_QUERY_RESULT::UNRESPONSIVE);
+
+    // Now check each drive
+    for (size_t d = 0; d < group.devices.size(); d++) {
+      const cDevice& device = group.devices[d];
+
+      cDriveStats deviceStats;
+      deviceStats.sName = device.sName;
+      deviceStats.bIsPresent = IsDrivePresent(device.sPath);
+
+      cDiskIOStats diskIOStats;
+      if (!deviceNodes[g][d].empty() && state.diskStatsCollector.GetDiskIOStats(deviceNodes[g][d], diskIOStats)) {
+        deviceStats.diskIOStats = diskIOStats;
+      }
+
+      const auto found = mapDrivePathToSmartCtlStats.find(device.sPath);
+      if (found != mapDrivePathToSmartCtlStats.end()) {
+        deviceStats.smartCtlStats = found->second;
+      }
+
+      const auto foundSelfTest = mapDrivePathToSelfTestStats.find(device.sPath);
+      if (foundSelfTest != mapDrivePathToSelfTestStats.end()) {
+        deviceStats.selfTestStats = foundSelfTest->second;
+        if (foundSelfTest->second.result == SELF_TEST_RESULT::FAILED) {
+          LogDriveSelfTestToSyslog(group.sMountPoint, device.sName, device.sPath, foundSelfTest->second);
+        }
+      }
+
+      // Use the hwmon samples if we have them, otherwise the SMART attribute, unless it is an old value from before the drive went into standby
+      cDriveTemperatureStats temperatureStats;
+      if (!deviceNodes[g][d].empty() && state.temperatureCollector.GetStatsAndReset(deviceNodes[g][d], temperatureStats)) {
+        deviceStats.temperatureStats = temperatureStats;
+      } else if (deviceStats.smartCtlStats.nTemperature_Celsius.has_value() && !deviceStats.smartCtlStats.bIsInStandby) {
+        const double dCelsius = double(deviceStats.smartCtlStats.nTemperature_Celsius.value());
+        temperatureStats.source = TEMPERATURE_SOURCE::SMART;
+        temperatureStats.nSamples = 1;
+        temperatureStats.dCurrentCelsius = dCelsius;
+        temperatureStats.dMinCelsius = dCelsius;
+        temperatureStats.dMaxCelsius = dCelsius;
+        temperatureStats.dAverageCelsius = dCelsius;
+        deviceStats.temperatureStats = temperatureStats;
+      }
+
+      if (!deviceNodes[g][d].empty()) {
+        state.temperatureCollector.SetStandby(deviceNodes[g][d], deviceStats.smartCtlStats.bIsInStandby);
+      }
+
+      // Time some reads if the drive is there and responding, but not if it is in standby because the reads would spin it up
+      // A drive whose SMART query failed, timed out or was skipped could block the reads as well, drives with cached SMART values have no query result
+      const auto foundQueryResult = mapDrivePathToQueryResult.find(device.sPath);
+      const bool bIsQueryOK = ((foundQueryResult == mapDrivePathToQueryResult.end()) || (foundQueryResult->second == SMART_QUERY_RESULT::OK) || (foundQueryResult->second == SMART_QUERY_RESULT::STANDBY));
+      if (latencyProbeSettings.bEnabled && deviceStats.bIsPresent && mountStats.bIsResponsive && bIsQueryOK && !deviceStats.smartCtlStats.bIsInStandby && ProbeDeviceLatency(device.sPath, latencyProbeSettings, latencyHistogram)) {
+        // The percentiles come from the drive's reads over the recent collections, not just this probe's
+        const cLatencyHistogram& distribution = state.latencyHistograms.Add(device.sPath, latencyHistogram);
+        cDriveLatencyStats latencyStats;
+        latencyStats.nReads = distribution.GetCount();
+        latencyStats.nP50US = distribution.GetPercentileUS(50.0);
+        latencyStats.nP99US = distribution.GetPercentileUS(99.0);
+        latencyStats.nMaxUS = distribution.GetMaxUS();
+        deviceStats.latencyStats = latencyStats;
+      }
+
+      mountStats.mapDrivePathToDriveStats[device.sPath] = deviceStats;
+    }
+
+    if (latencyProbeSettings.bEnabled) {
+      FlagLatencyOutliers(mountStats, latencyProbeSettings.nOutlierFactor);
+    }
+
+    // For BTRFS mounts we can print out additional stats
+    // NOTE: We skip these if the mount is unresponsive because "btrfs device stats" would hang too
+    const bool bHasBtrfsStats = ((group.type == GROUP_TYPE::BTRFS) && mountStats.bIsResponsive);
+    cBtrfsVolumeStats btrfsVolumeStats;
+    if (bHasBtrfsStats) {
+      btrfs::GetBtrfsVolumeDeviceStats(settings.GetBtrfsPath(), group.sMountPoint, group.devices, btrfsVolumeStats);
+    }
+
+    if (bHasBtrfsStats && qgroupSettings.bEnabled) {
+      cBtrfsQgroupStats qgroupStats;
+      if (state.qgroupCollector.Collect(group.sMountPoint, qgroupSettings.nTop, qgroupStats)) {
+        LogBtrfsQgroupStatsToSyslog(group.sMountPoint, qgroupStats);
+      }
+    }
+
+    if (capacitySettings.bEnabled) {
+      size_t nUnallocatedBytes = 0;
+      if (bHasBtrfsStats && btrfs::GetBtrfsFilesystemUsage(settings.GetBtrfsPath(), group.sMountPoint, nUnallocatedBytes)) {
+        mountStats.nUnallocatedBytes = nUnallocatedBytes;
+      }
+
+      state.capacityForecaster.Update(capacitySettings, int64_t(time(nullptr)), mountStats);
+      if (mountStats.capacityForecast.has_value() && mountStats.capacityForecast->bIsAlert) {
+        LogCapacityAlertToSyslog(mountStats, capacitySettings.nHorizonDays);
+      }
+    }
+
+    if (anomalySettings.bEnabled) {
+      state.anomalyDetector.Update(anomalySettings, int64_t(time(nullptr)), mountStats, bHasBtrfsStats ? &btrfsVolumeStats : nullptr);
+
+      for (auto& device : group.devices) {
+        const auto found = mountStats.mapDrivePathToDriveStats.find(device.sPath);
+        if ((found != mountStats.mapDrivePathToDriveStats.end()) && !found->second.anomalies.empty()) {
+          LogDriveAnomaliesToSyslog(group.sMountPoint, device.sName, device.sPath, found->second.anomalies);
+        }
+      }
+    }
+
+    // Log output
+    if (bHasBtrfsStats) {
+      // Log BTRFS output
+      if (!LogStatsToSyslogMountStatsAndBtrfsStats(mountStats, btrfsVolumeStats)) {
+        result = false;
+      }
+
+      cGroupStats groupStats;
+      groupStats.mountStats = std::move(mountStats);
+      groupStats.bHasBtrfsStats = true;
+      groupStats.btrfsVolumeStats = std::move(btrfsVolumeStats);
+      snapshot.groups.push_back(std::move(groupStats));
+    } else {
+      if (!LogStatsToSyslogMountStats(mountStats)) {
+        result = false;
+      }
+
+      cGroupStats groupStats;
+      groupStats.mountStats = std::move(mountStats);
+      snapshot.groups.push_back(std::move(groupStats));
+    }
+  }
+
+  if (anomalySettings.bEnabled) {
+    state.anomalyDetector.Save(anomalySettings.sStateFilePath);
+  }
+
+  if (capacitySettings.bEnabled) {
+    state.capacityForecaster.Save(capacitySettings.sStateFilePath);
+  }
+
+  snapshot.nTimestamp = int64_t(time(nullptr));
+  state.snapshotStore.Publish(std::move(snapshot));
+
+  struct rusage self_end;
+  struct rusage children_end;
+  getrusage(RUSAGE_SELF, &self_end);
+  getrusage(RUSAGE_CHILDREN, &children_end);
+
+  // ru_inblock and ru_oublock are counted in 512 byte blocks
+  cCollectionStats collectionStats;
+  collectionStats.bIsLowImpact = settings.GetLowImpactSettings().bEnabled;
+  collectionStats.nDurationMS = uint64_t(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+  collectionStats.nCPUMS = GetCPUTimeMS(self_end) - GetCPUTimeMS(self_start);
+  collectionStats.nChildCPUMS = GetCPUTimeMS(children_end) - GetCPUTimeMS(children_start);
+  collectionStats.nChildReadBytes = uint64_t(children_end.ru_inblock - children_start.ru_inblock) * 512;
+  collectionStats.nChildWriteBytes = uint64_t(children_end.ru_oublock - children_start.ru_oublock) * 512;
+
+  // How the output kept up with everything logged since the last collection
+  cOutputPipeline* pOutputPipeline = GetOutputPipeline();
+  if (pOutputPipeline != nullptr) {
+    pOutputPipeline->GetStatsAndReset(collectionStats.outputStats);
+  }
+
+  LogCollectionStatsToSyslog(collectionStats);
+
+  return result;
+}
+
+bool QueryAndLogDevice(const cSettings& settings, const cGroup& group, const cDevice& device, cCollectorState& state)
+{
+  // Log a mount record with just this drive in it, the space stats are left out as they are not what changed
+  cMountStats mountStats;
+  mountStats.sMountPoint = group.sMountPoint;
+  mountStats.ClearSpaceStats();
+
+  cDriveStats deviceStats;
+  deviceStats.sName = device.sName;
+  deviceStats.bIsPresent = IsDrivePresent(device.sPath);
+
+  // Don't bother running smartctl on a drive that has gone
+  if (deviceStats.bIsPresent) {
+    QuerySmartCtlForDevice(settings, device.sPath, state, deviceStats.smartCtlStats);
+  }
+
+  mountStats.mapDrivePathToDriveStats[device.sPath] = deviceStats;
+
+  return LogStatsToSyslogDeviceStats(mountStats, device.sPath);
+}
+
+bool QueryAndLogDeviceErrors(const cSettings& settings, const cGroup& group, const cDevice& device, cMountQueryPool& mountQueryPool, cCollectorState& state)
+{
+  cMountStats mountStats;
+  mountStats.sMountPoint = group.sMountPoint;
+  mountStats.ClearSpaceStats();
+
+  cDriveStats deviceStats;
+  deviceStats.sName = device.sName;
+  deviceStats.bIsPresent = IsDrivePresent(device.sPath);
+
+  if (deviceStats.bIsPresent) {
+    QuerySmartCtlForDevice(settings, device.sPath, state, deviceStats.smartCtlStats);
+  }
+
+  mountStats.mapDrivePathToDriveStats[device.sPath] = deviceStats;
+
+  if (group.type == GROUP_TYPE::BTRFS) {
+    // NOTE: We skip these if the mount is unresponsive because "btrfs device stats" would hang too
+    cMountStats spaceStats;
+    mountStats.bIsResponsive = (mountQueryPool.GetMountTotalAndFreeSpace(group.sMountPoint, std::chrono::milliseconds(group.nMountTimeoutMS), spaceStats) != MOUNT_QUERY_RESULT::UNRESPONSIVE);
+    if (mountStats.bIsResponsive) {
+      cBtrfsVolumeStats btrfsVolumeStats;
+      btrfs::GetBtrfsVolumeDeviceStats(settings.GetBtrfsPath(), group.sMountPoint, { device }, btrfsVolumeStats);
+      return LogStatsToSyslogDeviceStatsAndBtrfsStats(mountStats, btrfsVolumeStats, device.sPath);
+    }
+  }
+
+  return LogStatsToSyslogDeviceStats(mountStats, device.sPath);
+}
+
+}
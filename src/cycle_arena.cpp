@@ -0,0 +1,98 @@
+#include <cstdint>
+#include <new>
+
+#include <algorithm>
+
+#include "cycle_arena.h"
+
+namespace lumberjill {
+
+namespace {
+
+// Plenty for the scratch containers of a collection of a few hundred drives
+const size_t DEFAULT_INITIAL_BYTES = 64 * 1024;
+
+// Only the first collections overflow, after that the list is empty
+const size_t INITIAL_OVERFLOW_CAPACITY = 16;
+
+}
+
+cCycleArena::cCycleArena() :
+  cCycleArena(DEFAULT_INITIAL_BYTES)
+{
+}
+
+cCycleArena::cCycleArena(size_t nInitialBytes) :
+  buffer(nInitialBytes),
+  nUsedBytes(0),
+  nHighWaterBytes(0)
+{
+  overflows.reserve(INITIAL_OVERFLOW_CAPACITY);
+}
+
+cCycleArena::~cCycleArena()
+{
+  FreeOverflows();
+}
+
+void cCycleArena::FreeOverflows()
+{
+  for (auto& overflow : overflows) {
+    ::operator delete(overflow.p, overflow.nBytes, std::align_val_t(overflow.nAlignment));
+  }
+
+  overflows.clear();
+}
+
+void cCycleArena::Reset()
+{
+  FreeOverflows();
+  nUsedBytes = 0;
+
+  // Grow with some headroom so that a slightly bigger collection next time still fits
+  if (nHighWaterBytes > buffer.size()) {
+    buffer.assign(nHighWaterBytes + (nHighWaterBytes / 4), std::byte(0));
+  }
+}
+
+void* cCycleArena::do_allocate(size_t nBytes, size_t nAlignment)
+{
+  const uintptr_t base = reinterpret_cast<uintptr_t>(buffer.data());
+  const uintptr_t aligned = (base + nUsedBytes + (nAlignment - 1)) & ~uintptr_t(nAlignment - 1);
+  const size_t nOffset = size_t(aligned - base);
+
+  if ((nOffset <= buffer.size()) && (nBytes <= (buffer.size() - nOffset))) {
+    nUsedBytes = nOffset + nBytes;
+    nHighWaterBytes = std::max(nHighWaterBytes, nUsedBytes);
+    return buffer.data() + nOffset;
+  }
+
+  // Doesn't fit, use the heap for now and remember how much we would have needed
+  void* p = ::operator new(nBytes, std::align_val_t(nAlignment));
+  overflows.push_back({ p, nBytes, nAlignment });
+
+  size_t nNeededBytes = nUsedBytes;
+  for (auto& overflow : overflows) {
+    nNeededBytes += overflow.nBytes + overflow.nAlignment;
+  }
+  nHighWaterBytes = std::max(nHighWaterBytes, nNeededBytes);
+
+  return p;
+}
+
+void cCycleArena::do_deallocate(void* p, size_t nBytes, size_t nAlignment)
+{
+  // Memory in the arena is only freed by Reset, but a container that grows can hand back an overflow straight away
+  const auto found = std::find_if(overflows.begin(), overflows.end(), [p](const cOverflow& overflow) { return (overflow.p == p); });
+  if (found != overflows.end()) {
+    ::operator delete(p, nBytes, std::align_val_t(nAlignment));
+    overflows.erase(found);
+  }
+}
+
+bool cCycleArena::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+  return (this == &other);
+}
+
+}
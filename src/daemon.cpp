@@ -0,0 +1,553 @@
+#include <cerrno>
+#include <cstring>
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <system_error>
+
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "collector.h"
+#include "daemon.h"
+#include "stats.h"
+#include "utils.h"
+
+namespace lumberjill {
+
+namespace {
+
+void GetDaemonSignals(sigset_t& mask)
+{
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+}
+
+}
+
+bool BlockDaemonSignals()
+{
+  // NOTE: Child processes unblock these again in cPipeIn::Run
+  sigset_t mask;
+  GetDaemonSignals(mask);
+  if (sigprocmask(SIG_BLOCK, &mask, nullptr) < 0) {
+    std::cerr<<"BlockDaemonSignals sigprocmask failed: "<<strerror(errno)<<std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+cDaemon::cDaemon(const cSettings& _settings) :
+  settings(_settings),
+  bCollectionResult(false),
+  kernelErrorTracker(settings.GetKernelLogSettings().nThreshold, uint64_t(settings.GetKernelLogSettings().nWindowSeconds) * 1000, uint64_t(settings.GetKernelLogSettings().nCooldownSeconds) * 1000),
+  queryServer(collectorState.snapshotStore),
+  epoll_fd(-1),
+  timer_fd(-1),
+  temperature_timer_fd(-1),
+  scrub_timer_fd(-1),
+  signal_fd(-1),
+  collection_done_fd(-1),
+  device_query_done_fd(-1)
+{
+  ResolveGroups();
+}
+
+cDaemon::~cDaemon()
+{
+  Close();
+}
+
+void cDaemon::ResolveGroups()
+{
+  const std::vector<cGroup>& settingsGroups = settings.GetGroups();
+  const bool bAutoDiscoverDevices = std::any_of(settingsGroups.begin(), settingsGroups.end(), [](const cGroup& group) { return group.bAutoDiscoverDevices; });
+  if (bAutoDiscoverDevices && topology.RefreshIfStale()) {
+    topology.ResolveGroups(settingsGroups, groups);
+  } else {
+    groups = settingsGroups;
+  }
+
+  UpdateDeviceNodes();
+}
+
+void cDaemon::UpdateDeviceNodes()
+{
+  // Groups may have changed size if they were auto discovered
+  deviceNodes.resize(groups.size());
+
+  for (size_t g = 0; g < groups.size(); g++) {
+    deviceNodes[g].resize(groups[g].devices.size());
+
+    for (size_t d = 0; d < groups[g].devices.size(); d++) {
+      const std::string& sPath = groups[g].devices[d].sPath;
+
+      // Keep the last known node if the device is missing at the moment
+      std::string sNode;
+      if (GetDeviceNode(sPath, sNode)) {
+        deviceNodes[g][d] = sNode;
+      } else if (deviceNodes[g][d].empty()) {
+        deviceNodes[g][d] = std::filesystem::path(sPath).filename().string();
+      }
+    }
+  }
+
+  mapKernelNameToDevices.clear();
+  for (size_t g = 0; g < groups.size(); g++) {
+    for (size_t d = 0; d < groups[g].devices.size(); d++) {
+      mapKernelNameToDevices[deviceNodes[g][d]].push_back(std::make_pair(g, d));
+
+      for (auto& sName : GetBlockDeviceKernelNames("/sys", deviceNodes[g][d])) {
+        mapKernelNameToDevices[sName].push_back(std::make_pair(g, d));
+      }
+    }
+  }
+}
+
+bool cDaemon::Open()
+{
+  Close();
+
+  // Handle SIGINT and SIGTERM through the event loop, main has normally blocked them already before starting any threads
+  if (!BlockDaemonSignals()) return false;
+
+  sigset_t mask;
+  GetDaemonSignals(mask);
+
+  signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (signal_fd < 0) {
+    std::cerr<<"cDaemon::Open signalfd failed: "<<strerror(errno)<<std::endl;
+    return false;
+  }
+
+  timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (timer_fd < 0) {
+    std::cerr<<"cDaemon::Open timerfd_create failed: "<<strerror(errno)<<std::endl;
+    return false;
+  }
+
+  struct itimerspec interval;
+  memset(&interval, 0, sizeof(interval));
+  interval.it_value.tv_sec = time_t(settings.GetDaemonIntervalSeconds());
+  interval.it_interval.tv_sec = time_t(settings.GetDaemonIntervalSeconds());
+  if (timerfd_settime(timer_fd, 0, &interval, nullptr) < 0) {
+    std::cerr<<"cDaemon::Open timerfd_settime failed: "<<strerror(errno)<<std::endl;
+    return false;
+  }
+
+  // Temperatures are sampled more often than the full collection
+  temperature_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (temperature_timer_fd < 0) {
+    std::cerr<<"cDaemon::Open timerfd_create failed: "<<strerror(errno)<<std::endl;
+    return false;
+  }
+
+  memset(&interval, 0, sizeof(interval));
+  interval.it_value.tv_sec = time_t(settings.GetTemperatureSettings().nSampleIntervalSeconds);
+  interval.it_interval.tv_sec = time_t(settings.GetTemperatureSettings().nSampleIntervalSeconds);
+  if (timerfd_settime(temperature_timer_fd, 0, &interval, nullptr) < 0) {
+    std::cerr<<"cDaemon::Open timerfd_settime failed: "<<strerror(errno)<<std::endl;
+    return false;
+  }
+
+  // Scrub progress is checked much more often than the full collection, scrubs take hours
+  if (settings.GetScrubSettings().bEnabled) {
+    scrub_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (scrub_timer_fd < 0) {
+      std::cerr<<"cDaemon::Open timerfd_create failed: "<<strerror(errno)<<std::endl;
+      return false;
+    }
+
+    memset(&interval, 0, sizeof(interval));
+    interval.it_value.tv_sec = time_t(settings.GetScrubSettings().nPollIntervalSeconds);
+    interval.it_interval.tv_sec = time_t(settings.GetScrubSettings().nPollIntervalSeconds);
+    if (timerfd_settime(scrub_timer_fd, 0, &interval, nullptr) < 0) {
+      std::cerr<<"cDaemon::Open timerfd_settime failed: "<<strerror(errno)<<std::endl;
+      return false;
+    }
+  }
+
+  collection_done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (collection_done_fd < 0) {
+    std::cerr<<"cDaemon::Open eventfd failed: "<<strerror(errno)<<std::endl;
+    return false;
+  }
+
+  device_query_done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (device_query_done_fd < 0) {
+    std::cerr<<"cDaemon::Open eventfd failed: "<<strerror(errno)<<std::endl;
+    return false;
+  }
+
+  // We can still do the regular collections without hotplug events, for example in a container without netlink access
+  if (!ueventSocket.Open()) {
+    syslog(LOG_WARNING, "lumber-jill Drive hotplug detection is not available");
+  }
+
+  // Likewise we can do without the kernel log, reading it needs CAP_SYSLOG when dmesg_restrict is set
+  if (settings.GetKernelLogSettings().bEnabled && !kernelLogReader.Open()) {
+    syslog(LOG_WARNING, "lumber-jill Kernel log error detection is not available");
+  }
+
+  // The query API runs on its own thread so that it can answer while we are busy with a collection
+  if (settings.GetQuerySettings().bEnabled && !queryServer.Start(settings.GetQuerySettings().sSocketPath)) {
+    syslog(LOG_WARNING, "lumber-jill Query API is not available");
+  }
+
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd < 0) {
+    std::cerr<<"cDaemon::Open epoll_create1 failed: "<<strerror(errno)<<std::endl;
+    return false;
+  }
+
+  for (const int fd : { signal_fd, timer_fd, temperature_timer_fd, scrub_timer_fd, collection_done_fd, device_query_done_fd, ueventSocket.GetFD(), kernelLogReader.GetFD() }) {
+    if (fd < 0) continue;
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+      std::cerr<<"cDaemon::Open epoll_ctl failed: "<<strerror(errno)<<std::endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void cDaemon::Close()
+{
+  // The collection and the device queries use collection_done_fd and device_query_done_fd
+  StopCollection();
+  StopDeviceQueries();
+
+  queryServer.Stop();
+  ueventSocket.Close();
+  kernelLogReader.Close();
+
+  for (int* pFD : { &epoll_fd, &timer_fd, &temperature_timer_fd, &scrub_timer_fd, &signal_fd, &collection_done_fd, &device_query_done_fd }) {
+    if (*pFD >= 0) {
+      close(*pFD);
+      *pFD = -1;
+    }
+  }
+}
+
+bool cDaemon::Run()
+{
+  if (!Open()) {
+    Close();
+    return false;
+  }
+
+  std::cout<<"lumber-jill Daemon started"<<std::endl;
+  syslog(LOG_INFO, "lumber-jill Daemon started");
+
+  // Start with a full collection, if it fails we still carry on but we return false when we stop
+  StartCollection();
+  bool bIsFirstCollection = true;
+  bool result = true;
+
+  bool bRunning = true;
+  while (bRunning) {
+    struct epoll_event events[8];
+    const int nEvents = epoll_wait(epoll_fd, events, 8, -1);
+    if (nEvents < 0) {
+      if (errno == EINTR) continue;
+
+      std::cerr<<"cDaemon::Run epoll_wait failed: "<<strerror(errno)<<std::endl;
+      syslog(LOG_ERR, "cDaemon::Run epoll_wait failed: %s", strerror(errno));
+      result = false;
+      break;
+    }
+
+    for (int i = 0; i < nEvents; i++) {
+      const int fd = events[i].data.fd;
+      if (fd == signal_fd) {
+        struct signalfd_siginfo info;
+        if (read(signal_fd, &info, sizeof(info)) == ssize_t(sizeof(info))) {
+          std::cout<<"lumber-jill Received signal "<<info.ssi_signo<<", stopping"<<std::endl;
+          bRunning = false;
+        }
+      } else if (fd == timer_fd) {
+        uint64_t expirations = 0;
+        if (read(timer_fd, &expirations, sizeof(expirations)) == ssize_t(sizeof(expirations))) {
+          OnTimer();
+        }
+      } else if (fd == collection_done_fd) {
+        uint64_t value = 0;
+        if (read(collection_done_fd, &value, sizeof(value)) == ssize_t(sizeof(value))) {
+          const bool bResult = OnCollectionDone();
+          if (bIsFirstCollection) {
+            result = bResult;
+            bIsFirstCollection = false;
+          }
+        }
+      } else if (fd == device_query_done_fd) {
+        uint64_t value = 0;
+        if (read(device_query_done_fd, &value, sizeof(value)) == ssize_t(sizeof(value))) {
+          OnDeviceQueriesDone();
+        }
+      } else if (fd == temperature_timer_fd) {
+        uint64_t expirations = 0;
+        if (read(temperature_timer_fd, &expirations, sizeof(expirations)) == ssize_t(sizeof(expirations))) {
+          OnTemperatureTimer();
+        }
+      } else if (fd == scrub_timer_fd) {
+        uint64_t expirations = 0;
+        if (read(scrub_timer_fd, &expirations, sizeof(expirations)) == ssize_t(sizeof(expirations))) {
+          OnScrubTimer();
+        }
+      } else if (fd == ueventSocket.GetFD()) {
+        OnUEvents();
+      } else if (fd == kernelLogReader.GetFD()) {
+        OnKernelLog();
+      }
+    }
+  }
+
+  syslog(LOG_INFO, "lumber-jill Daemon stopped");
+  Close();
+
+  return result;
+}
+
+void cDaemon::StartCollection()
+{
+  collectorState.bStopRequested = false;
+
+  // Hotplug events can change the groups while the collection is running
+  collectionThread = std::thread([this, collectionGroups = groups]() {
+    bCollectionResult = QueryAndLogGroups(settings, collectionGroups, mountQueryPool, collectorState);
+
+    const uint64_t value = 1;
+    if (write(collection_done_fd, &value, sizeof(value)) != ssize_t(sizeof(value))) {
+      syslog(LOG_ERR, "cDaemon::StartCollection write failed: %s", strerror(errno));
+    }
+  });
+}
+
+bool cDaemon::OnCollectionDone()
+{
+  if (!collectionThread.joinable()) return true;
+
+  collectionThread.join();
+  return bCollectionResult;
+}
+
+void cDaemon::StopCollection()
+{
+  if (!collectionThread.joinable()) return;
+
+  // The SMART queries that haven't started are skipped and the ones that are running are abandoned, the rest of the collection is bounded by the mount timeouts
+  collectorState.bStopRequested = true;
+  collectionThread.join();
+}
+
+void cDaemon::StartDeviceQuery(const std::string& sDevicePath, std::function<void()> query)
+{
+  std::lock_guard<std::mutex> lock(deviceQueriesMutex);
+
+  // A drive that keeps producing events while its query is stuck would otherwise pile up threads
+  if (mapDevicePathToQueryThread.find(sDevicePath) != mapDevicePathToQueryThread.end()) {
+    syslog(LOG_WARNING, "lumber-jill The previous query for \"%s\" is still running, skipping this one", sDevicePath.c_str());
+    return;
+  }
+
+  mapDevicePathToQueryThread[sDevicePath] = std::thread([this, sDevicePath, query]() {
+    query();
+
+    {
+      std::lock_guard<std::mutex> thread_lock(deviceQueriesMutex);
+      finishedDeviceQueries.push_back(sDevicePath);
+    }
+
+    // The event loop isn't running in the unit tests
+    if (device_query_done_fd >= 0) {
+      const uint64_t value = 1;
+      if (write(device_query_done_fd, &value, sizeof(value)) != ssize_t(sizeof(value))) {
+        syslog(LOG_ERR, "cDaemon::StartDeviceQuery write failed: %s", strerror(errno));
+      }
+    }
+  });
+}
+
+void cDaemon::OnDeviceQueriesDone()
+{
+  std::vector<std::thread> threads;
+
+  {
+    std::lock_guard<std::mutex> lock(deviceQueriesMutex);
+    for (auto& sDevicePath : finishedDeviceQueries) {
+      auto iter = mapDevicePathToQueryThread.find(sDevicePath);
+      if (iter == mapDevicePathToQueryThread.end()) continue;
+
+      threads.push_back(std::move(iter->second));
+      mapDevicePathToQueryThread.erase(iter);
+    }
+
+    finishedDeviceQueries.clear();
+  }
+
+  // These have finished, or are just about to
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+void cDaemon::StopDeviceQueries()
+{
+  std::vector<std::thread> threads;
+
+  {
+    std::lock_guard<std::mutex> lock(deviceQueriesMutex);
+    for (auto& item : mapDevicePathToQueryThread) {
+      threads.push_back(std::move(item.second));
+    }
+
+    mapDevicePathToQueryThread.clear();
+    finishedDeviceQueries.clear();
+  }
+
+  if (threads.empty()) return;
+
+  // smartctl calls that are still running are abandoned
+  collectorState.bStopRequested = true;
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+void cDaemon::OnTimer()
+{
+  // The SMART schedule's window or a slow mount can make a collection take longer than the interval
+  if (collectionThread.joinable()) {
+    std::cerr<<"lumber-jill The previous collection is still running, skipping this one"<<std::endl;
+    syslog(LOG_WARNING, "lumber-jill The previous collection is still running, skipping this one");
+    return;
+  }
+
+  StartCollection();
+}
+
+void cDaemon::OnTemperatureTimer()
+{
+  collectorState.temperatureCollector.Sample();
+}
+
+void cDaemon::OnScrubTimer()
+{
+  scrubOrchestrator.Poll(settings, groups, mountQueryPool);
+}
+
+void cDaemon::OnUEvents()
+{
+  std::vector<cUEvent> events;
+  if (!ueventSocket.ReadEvents(events)) {
+    return;
+  }
+
+  for (auto& event : events) {
+    HandleUEvent(event);
+  }
+}
+
+void cDaemon::OnKernelLog()
+{
+  kernelLogReader.ReadRecords([this](const cKernelLogRecord& record) {
+    HandleKernelLogMessage(record.message, GetTimeSinceBootMS());
+  });
+}
+
+bool cDaemon::HandleUEvent(const cUEvent& event)
+{
+  if (!event.IsBlockDevice() || event.sDevName.empty()) {
+    return false;
+  }
+
+  // Anything being added or removed could change which devices are in the auto discovered groups
+  // A new device needs to be resolved before we look for it, a removed device needs to be looked for while we still know about it
+  const bool bIsAdd = (event.sAction == "add");
+  const bool bIsRemove = (event.sAction == "remove");
+  if (bIsAdd) {
+    topology.Invalidate();
+    ResolveGroups();
+  }
+
+  bool bIsMonitored = false;
+
+  for (size_t g = 0; g < groups.size(); g++) {
+    for (size_t d = 0; d < groups[g].devices.size(); d++) {
+      if (deviceNodes[g][d] != event.sDevName) continue;
+
+      bIsMonitored = true;
+
+      const cGroup& group = groups[g];
+      const cDevice& device = group.devices[d];
+
+      // Log the event straight away, then collect the stats for just this device
+      LogDriveEventToSyslog(event.sAction, group.sMountPoint, device.sName, device.sPath);
+      // The query gets its own copy of the group, hotplug events can change the groups while it runs
+      std::shared_ptr<const cGroup> queryGroup = std::make_shared<const cGroup>(group);
+      StartDeviceQuery(device.sPath, [this, queryGroup, d]() {
+        QueryAndLogDevice(settings, *queryGroup, queryGroup->devices[d], collectorState);
+      });
+    }
+  }
+
+  if (bIsRemove) {
+    topology.Invalidate();
+    ResolveGroups();
+  }
+
+  return bIsMonitored;
+}
+
+bool cDaemon::HandleKernelLogMessage(std::string_view message, uint64_t nNowMS)
+{
+  cKernelError error;
+  if (!kernelErrorMatcher.Match(message, error)) {
+    return false;
+  }
+
+  // Errors about a partition count against the disk it is on
+  auto iter = mapKernelNameToDevices.find(error.sName);
+  if (iter == mapKernelNameToDevices.end()) {
+    iter = mapKernelNameToDevices.find(GetDiskNameFromPartitionName(error.sName));
+    if (iter == mapKernelNameToDevices.end()) {
+      return false;
+    }
+  }
+
+  for (auto& [g, d] : iter->second) {
+    const cGroup& group = groups[g];
+    const cDevice& device = group.devices[d];
+
+    if (!kernelErrorTracker.Record(device.sPath, error.type, nNowMS)) continue;
+
+    // Log the errors straight away, then collect the stats for just this device
+    cKernelErrorStats kernelErrorStats;
+    kernelErrorTracker.GetStats(device.sPath, nNowMS, kernelErrorStats);
+    LogKernelErrorsToSyslog(group.sMountPoint, device.sName, device.sPath, kernelErrorStats, std::string(message));
+
+    // Like hotplug events the query runs on its own thread with its own copy of the group
+    std::shared_ptr<const cGroup> queryGroup = std::make_shared<const cGroup>(group);
+    StartDeviceQuery(device.sPath, [this, queryGroup, d = d]() {
+      QueryAndLogDeviceErrors(settings, *queryGroup, queryGroup->devices[d], mountQueryPool, collectorState);
+    });
+  }
+
+  return true;
+}
+
+}
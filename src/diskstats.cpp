@@ -0,0 +1,290 @@
+#include <cerrno>
+#include <cstring>
+
+#include <algorithm>
+#include <charconv>
+#include <iostream>
+
+#include <fcntl.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "diskstats.h"
+#include "utils.h"
+
+namespace lumberjill {
+
+namespace {
+
+const char* DEFAULT_DISKSTATS_FILE_PATH = "/proc/diskstats";
+
+// The kernel always counts in 512 byte sectors
+const uint64_t SECTOR_SIZE_BYTES = 512;
+
+// Big enough for a few hundred devices, this grows if it needs to
+const size_t INITIAL_BUFFER_SIZE_BYTES = 64 * 1024;
+
+// Get the next space separated token on a line, returns an empty view at the end of the line
+std::string_view NextToken(const char*& p, const char* end)
+{
+  while ((p < end) && (*p == ' ')) p++;
+
+  const char* start = p;
+  while ((p < end) && (*p != ' ')) p++;
+
+  return std::string_view(start, size_t(p - start));
+}
+
+bool NextValue(const char*& p, const char* end, uint64_t& value)
+{
+  const std::string_view token = NextToken(p, end);
+  if (token.empty()) {
+    return false;
+  }
+
+  const std::from_chars_result result = std::from_chars(token.data(), token.data() + token.length(), value);
+  return (result.ec == std::errc());
+}
+
+// Parse a line such as "   8      16 sdb 4212 1305 391522 30133 1185 2026 65584 8120 0 19080 38866 0 0 0 0 112 612"
+bool ParseDiskStatsLine(const char* p, const char* end, const std::vector<std::string>& nodes, std::vector<cDiskStatsCounters>& counters)
+{
+  uint64_t nMajor = 0;
+  uint64_t nMinor = 0;
+  if (!NextValue(p, end, nMajor) || !NextValue(p, end, nMinor)) {
+    return false;
+  }
+
+  const std::string_view name = NextToken(p, end);
+  if (name.empty()) {
+    return false;
+  }
+
+  // Skip the devices that we aren't interested in before parsing the rest of the line
+  const auto found = std::lower_bound(nodes.begin(), nodes.end(), name, [](const std::string& a, std::string_view b) { return std::string_view(a) < b; });
+  if ((found == nodes.end()) || (std::string_view(*found) != name)) {
+    return true;
+  }
+
+  cDiskStatsCounters& c = counters[size_t(found - nodes.begin())];
+
+  // Fields 1 to 11 have been there since 2.6, newer kernels add discard and flush fields which we ignore
+  uint64_t nReadsMerged = 0;
+  uint64_t nWritesMerged = 0;
+  c.bIsValid = (
+    NextValue(p, end, c.nReadsCompleted) &&
+    NextValue(p, end, nReadsMerged) &&
+    NextValue(p, end, c.nSectorsRead) &&
+    NextValue(p, end, c.nReadTimeMS) &&
+    NextValue(p, end, c.nWritesCompleted) &&
+    NextValue(p, end, nWritesMerged) &&
+    NextValue(p, end, c.nSectorsWritten) &&
+    NextValue(p, end, c.nWriteTimeMS) &&
+    NextValue(p, end, c.nInFlight) &&
+    NextValue(p, end, c.nIOTimeMS) &&
+    NextValue(p, end, c.nWeightedIOTimeMS)
+  );
+
+  return true;
+}
+
+}
+
+bool ParseDiskStats(std::string_view contents, const std::vector<std::string>& nodes, std::vector<cDiskStatsCounters>& counters)
+{
+  counters.resize(nodes.size());
+  for (auto& c : counters) {
+    c.Clear();
+  }
+
+  bool bParsedAny = false;
+
+  const char* p = contents.data();
+  const char* end = p + contents.length();
+  while (p < end) {
+    const char* line_end = static_cast<const char*>(memchr(p, '\n', size_t(end - p)));
+    if (line_end == nullptr) {
+      line_end = end;
+    }
+
+    if (ParseDiskStatsLine(p, line_end, nodes, counters)) {
+      bParsedAny = true;
+    }
+
+    p = line_end + 1;
+  }
+
+  return bParsedAny;
+}
+
+bool GetDiskIOStats(const cDiskStatsCounters& before, const cDiskStatsCounters& after, uint64_t nIntervalMS, cDiskIOStats& outStats)
+{
+  outStats = cDiskIOStats();
+
+  if (!before.bIsValid || !after.bIsValid || (nIntervalMS == 0)) {
+    return false;
+  }
+
+  if (
+    (after.nReadsCompleted < before.nReadsCompleted) ||
+    (after.nSectorsRead < before.nSectorsRead) ||
+    (after.nReadTimeMS < before.nReadTimeMS) ||
+    (after.nWritesCompleted < before.nWritesCompleted) ||
+    (after.nSectorsWritten < before.nSectorsWritten) ||
+    (after.nWriteTimeMS < before.nWriteTimeMS) ||
+    (after.nIOTimeMS < before.nIOTimeMS) ||
+    (after.nWeightedIOTimeMS < before.nWeightedIOTimeMS)
+  ) {
+    return false;
+  }
+
+  const uint64_t nReads = after.nReadsCompleted - before.nReadsCompleted;
+  const uint64_t nWrites = after.nWritesCompleted - before.nWritesCompleted;
+  const double dIntervalSeconds = double(nIntervalMS) / 1000.0;
+
+  outStats.dReadIOPS = double(nReads) / dIntervalSeconds;
+  outStats.dWriteIOPS = double(nWrites) / dIntervalSeconds;
+  outStats.dReadBytesPerSecond = double((after.nSectorsRead - before.nSectorsRead) * SECTOR_SIZE_BYTES) / dIntervalSeconds;
+  outStats.dWriteBytesPerSecond = double((after.nSectorsWritten - before.nSectorsWritten) * SECTOR_SIZE_BYTES) / dIntervalSeconds;
+  outStats.dReadAwaitMS = (nReads != 0) ? (double(after.nReadTimeMS - before.nReadTimeMS) / double(nReads)) : 0.0;
+  outStats.dWriteAwaitMS = (nWrites != 0) ? (double(after.nWriteTimeMS - before.nWriteTimeMS) / double(nWrites)) : 0.0;
+  outStats.dQueueDepth = double(after.nWeightedIOTimeMS - before.nWeightedIOTimeMS) / double(nIntervalMS);
+
+  // The io ticks can run slightly ahead of our clock
+  outStats.dUtilisationPercent = std::min(100.0, (100.0 * double(after.nIOTimeMS - before.nIOTimeMS)) / double(nIntervalMS));
+
+  return true;
+}
+
+
+cDiskStatsCollector::cDiskStatsCollector() :
+  sDiskStatsFilePath(DEFAULT_DISKSTATS_FILE_PATH),
+  fd(-1)
+{
+}
+
+cDiskStatsCollector::cDiskStatsCollector(const std::string& _sDiskStatsFilePath) :
+  sDiskStatsFilePath(_sDiskStatsFilePath),
+  fd(-1)
+{
+}
+
+cDiskStatsCollector::~cDiskStatsCollector()
+{
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+bool cDiskStatsCollector::ReadDiskStats()
+{
+  // Keep the file open between samples, reading from the start again gives us a fresh copy
+  if (fd < 0) {
+    fd = open(sDiskStatsFilePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      std::cerr<<"cDiskStatsCollector::ReadDiskStats Error opening \""<<sDiskStatsFilePath<<"\": "<<strerror(errno)<<std::endl;
+      syslog(LOG_ERR, "cDiskStatsCollector::ReadDiskStats Error opening \"%s\": %s", sDiskStatsFilePath.c_str(), strerror(errno));
+      return false;
+    }
+  }
+
+  if (buffer.size() < INITIAL_BUFFER_SIZE_BYTES) {
+    buffer.resize(INITIAL_BUFFER_SIZE_BYTES);
+  }
+
+  // Use the whole capacity, the size is only shrunk to the contents once we have finished reading
+  buffer.resize(buffer.capacity());
+
+  size_t nTotalBytes = 0;
+  while (true) {
+    if (nTotalBytes == buffer.size()) {
+      buffer.resize(buffer.size() * 2);
+    }
+
+    const ssize_t len = pread(fd, &buffer[nTotalBytes], buffer.size() - nTotalBytes, off_t(nTotalBytes));
+    if (len < 0) {
+      if (errno == EINTR) continue;
+
+      std::cerr<<"cDiskStatsCollector::ReadDiskStats Error reading \""<<sDiskStatsFilePath<<"\": "<<strerror(errno)<<std::endl;
+      syslog(LOG_ERR, "cDiskStatsCollector::ReadDiskStats Error reading \"%s\": %s", sDiskStatsFilePath.c_str(), strerror(errno));
+      buffer.clear();
+      return false;
+    } else if (len == 0) {
+      break;
+    }
+
+    nTotalBytes += size_t(len);
+  }
+
+  buffer.resize(nTotalBytes);
+  return true;
+}
+
+bool cDiskStatsCollector::Sample(std::span<const std::string> nodes)
+{
+  return Sample(nodes, GetTimeSinceBootMS());
+}
+
+bool cDiskStatsCollector::Sample(std::span<const std::string> nodes, uint64_t nNowMS)
+{
+  sortedNodes.assign(nodes.begin(), nodes.end());
+  std::sort(sortedNodes.begin(), sortedNodes.end());
+  sortedNodes.erase(std::unique(sortedNodes.begin(), sortedNodes.end()), sortedNodes.end());
+
+  if (!ReadDiskStats() || !ParseDiskStats(buffer, sortedNodes, counters)) {
+    for (auto& item : devices) {
+      item.second.bHasStats = false;
+    }
+    return false;
+  }
+
+  // Only the devices in this sample get stats
+  for (auto& item : devices) {
+    item.second.bHasStats = false;
+  }
+
+  for (size_t i = 0; i < sortedNodes.size(); i++) {
+    auto found = devices.find(sortedNodes[i]);
+    if (found == devices.end()) {
+      found = devices.emplace(sortedNodes[i], cDevice()).first;
+    }
+
+    cDevice& device = found->second;
+    const cDiskStatsCounters& current = counters[i];
+
+    if (!current.bIsValid) {
+      // The device has gone, start again if it comes back
+      device.counters.Clear();
+      device.bHasStats = false;
+      continue;
+    }
+
+    if (device.counters.bIsValid) {
+      const uint64_t nIntervalMS = (nNowMS > device.nTimeMS) ? (nNowMS - device.nTimeMS) : 0;
+      device.bHasStats = lumberjill::GetDiskIOStats(device.counters, current, nIntervalMS, device.stats);
+    } else {
+      // The counters were zero when the machine booted
+      cDiskStatsCounters boot;
+      boot.bIsValid = true;
+      device.bHasStats = lumberjill::GetDiskIOStats(boot, current, nNowMS, device.stats);
+    }
+
+    device.counters = current;
+    device.nTimeMS = nNowMS;
+  }
+
+  return true;
+}
+
+bool cDiskStatsCollector::GetDiskIOStats(const std::string& sNode, cDiskIOStats& outStats) const
+{
+  const auto found = devices.find(sNode);
+  if ((found == devices.end()) || !found->second.bHasStats) {
+    return false;
+  }
+
+  outStats = found->second.stats;
+  return true;
+}
+
+}
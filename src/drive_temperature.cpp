@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <system_error>
+
+#include <fcntl.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "drive_temperature.h"
+#include "utils.h"
+
+namespace lumberjill {
+
+namespace {
+
+const char* DEFAULT_SYS_FOLDER = "/sys";
+
+// A tempN_input file is a number of millidegrees and a new line
+const size_t TEMPERATURE_INPUT_MAX_BYTES = 32;
+
+// Return the temp1_input of the first hwmon device in this folder
+bool FindHwmonTemperatureInput(const std::filesystem::path& folder, std::string& sInputPath)
+{
+  std::error_code ec;
+  std::filesystem::directory_iterator iter(folder, ec);
+  if (ec) {
+    return false;
+  }
+
+  std::vector<std::string> candidates;
+  for (const auto& entry : iter) {
+    const std::string sName = entry.path().filename().string();
+    if (sName.starts_with("hwmon") && (sName.length() > 5)) {
+      candidates.push_back(entry.path().string());
+    }
+  }
+
+  // Be consistent if there is more than one
+  std::sort(candidates.begin(), candidates.end());
+
+  for (auto& sCandidate : candidates) {
+    const std::string sPath = sCandidate + "/temp1_input";
+    if (TestFileExists(sPath)) {
+      sInputPath = sPath;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+}
+
+bool FindDriveTemperatureInput(const std::string& sSysFolder, const std::string& sNode, std::string& sInputPath)
+{
+  sInputPath.clear();
+
+  // drivetemp puts it under the SCSI device, device/hwmon/hwmonN
+  // NVMe puts it under the controller, which is the device of the namespace, device/hwmonN
+  const std::filesystem::path device = std::filesystem::path(sSysFolder) / "class/block" / sNode / "device";
+  return FindHwmonTemperatureInput(device / "hwmon", sInputPath) || FindHwmonTemperatureInput(device, sInputPath);
+}
+
+bool ParseTemperatureInput(std::string_view contents, int32_t& nMilliCelsius)
+{
+  nMilliCelsius = 0;
+
+  const char* first = contents.data();
+  const char* last = contents.data() + contents.length();
+  const std::from_chars_result result = std::from_chars(first, last, nMilliCelsius);
+  return ((result.ec == std::errc()) && (result.ptr != first) && ((result.ptr == last) || (*result.ptr == '\n')));
+}
+
+
+cTemperatureRing::cTemperatureRing()
+{
+  Clear();
+}
+
+void cTemperatureRing::Clear()
+{
+  samples.fill(0);
+  nNext = 0;
+  nCount = 0;
+}
+
+void cTemperatureRing::Record(int32_t nMilliCelsius)
+{
+  samples[nNext] = nMilliCelsius;
+  nNext = (nNext + 1) % CAPACITY;
+  nCount = std::min(nCount + 1, CAPACITY);
+}
+
+bool cTemperatureRing::GetStats(cDriveTemperatureStats& outStats) const
+{
+  outStats = cDriveTemperatureStats();
+
+  if (nCount == 0) {
+    return false;
+  }
+
+  // The samples are the last nCount entries before nNext
+  const size_t nFirst = (nNext + CAPACITY - nCount) % CAPACITY;
+  int32_t nMin = samples[nFirst];
+  int32_t nMax = samples[nFirst];
+  int64_t nTotal = 0;
+  for (size_t i = 0; i < nCount; i++) {
+    const int32_t nValue = samples[(nFirst + i) % CAPACITY];
+    nMin = std::min(nMin, nValue);
+    nMax = std::max(nMax, nValue);
+    nTotal += nValue;
+  }
+
+  outStats.source = TEMPERATURE_SOURCE::HWMON;
+  outStats.nSamples = nCount;
+  outStats.dCurrentCelsius = double(samples[(nNext + CAPACITY - 1) % CAPACITY]) / 1000.0;
+  outStats.dMinCelsius = double(nMin) / 1000.0;
+  outStats.dMaxCelsius = double(nMax) / 1000.0;
+  outStats.dAverageCelsius = (double(nTotal) / double(nCount)) / 1000.0;
+  return true;
+}
+
+
+cDriveTemperatureCollector::cDriveTemperatureCollector() :
+  sSysFolder(DEFAULT_SYS_FOLDER),
+  reader(TEMPERATURE_INPUT_MAX_BYTES)
+{
+}
+
+cDriveTemperatureCollector::cDriveTemperatureCollector(const std::string& _sSysFolder) :
+  sSysFolder(_sSysFolder),
+  reader(TEMPERATURE_INPUT_MAX_BYTES)
+{
+}
+
+cDriveTemperatureCollector::~cDriveTemperatureCollector()
+{
+  for (auto& item : devices) {
+    CloseDevice(item.second);
+  }
+}
+
+void cDriveTemperatureCollector::CloseDevice(cDevice& device)
+{
+  if (device.fd >= 0) {
+    reader.Remove(device.nSlot);
+    close(device.fd);
+    device.fd = -1;
+  }
+}
+
+void cDriveTemperatureCollector::Update(std::span<const std::string> nodes)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  // Forget devices we aren't monitoring any more
+  for (auto iter = devices.begin(); iter != devices.end();) {
+    if (std::find(nodes.begin(), nodes.end(), iter->first) == nodes.end()) {
+      CloseDevice(iter->second);
+      iter = devices.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+
+  for (auto& sNode : nodes) {
+    cDevice& device = devices[sNode];
+    if (device.fd >= 0) continue;
+
+    std::string sInputPath;
+    if (!FindDriveTemperatureInput(sSysFolder, sNode, sInputPath)) continue;
+
+    device.fd = open(sInputPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (device.fd < 0) {
+      syslog(LOG_WARNING, "cDriveTemperatureCollector::Update Unable to open \"%s\"", sInputPath.c_str());
+      continue;
+    }
+
+    device.nSlot = reader.Add(device.fd);
+  }
+}
+
+void cDriveTemperatureCollector::SetStandby(const std::string& sNode, bool bIsInStandby)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  const auto found = devices.find(sNode);
+  if (found != devices.end()) {
+    found->second.bIsInStandby = bIsInStandby;
+  }
+}
+
+void cDriveTemperatureCollector::SetUseIOUring(bool bUseIOUring)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  reader.SetUseIOUring(bUseIOUring);
+}
+
+void cDriveTemperatureCollector::Sample()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  readSlots.clear();
+  for (auto& item : devices) {
+    const cDevice& device = item.second;
+    if ((device.fd >= 0) && !device.bIsInStandby) readSlots.push_back(device.nSlot);
+  }
+
+  if (readSlots.empty()) return;
+
+  reader.Read(readSlots);
+
+  for (auto& item : devices) {
+    cDevice& device = item.second;
+    if ((device.fd < 0) || device.bIsInStandby) continue;
+
+    std::string_view contents;
+    int32_t nMilliCelsius = 0;
+    if (!reader.GetContents(device.nSlot, contents) || !ParseTemperatureInput(contents, nMilliCelsius)) {
+      // The drive has probably gone or been put to sleep, look for it again on the next update
+      CloseDevice(device);
+      continue;
+    }
+
+    device.ring.Record(nMilliCelsius);
+  }
+}
+
+bool cDriveTemperatureCollector::GetStatsAndReset(const std::string& sNode, cDriveTemperatureStats& outStats)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  const auto found = devices.find(sNode);
+  if (found == devices.end()) {
+    outStats = cDriveTemperatureStats();
+    return false;
+  }
+
+  const bool result = found->second.ring.GetStats(outStats);
+  found->second.ring.Clear();
+  return result;
+}
+
+}
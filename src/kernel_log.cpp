@@ -0,0 +1,470 @@
+#include <cerrno>
+#include <cstring>
+
+#include <algorithm>
+#include <iostream>
+#include <queue>
+
+#include <fcntl.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "kernel_log.h"
+
+namespace lumberjill {
+
+namespace {
+
+// Where the device name is in a message once the pattern has been found
+enum class DEVICE_NAME {
+  FOLLOWS,  // Straight after the pattern, "I/O error, dev sdc, sector 1234"
+  BRACKETS, // The first [name] before the pattern, "sd 2:0:0:0: [sdc] tag#0 Sense Key : Medium Error"
+  PREFIX    // The start of the message up to the first ':', "ata3.00: exception Emask 0x0", "nvme nvme0: I/O 24 QID 1 timeout, aborting"
+};
+
+class cKernelErrorPattern {
+public:
+  std::string_view sPattern;
+  KERNEL_ERROR type;
+  DEVICE_NAME name;
+};
+
+const cKernelErrorPattern KERNEL_ERROR_PATTERNS[] = {
+  { "I/O error, dev ", KERNEL_ERROR::IO_ERROR, DEVICE_NAME::FOLLOWS },
+  { "Buffer I/O error on dev ", KERNEL_ERROR::IO_ERROR, DEVICE_NAME::FOLLOWS },
+  { "critical medium error, dev ", KERNEL_ERROR::MEDIUM_ERROR, DEVICE_NAME::FOLLOWS },
+  { "Sense Key : Medium Error", KERNEL_ERROR::MEDIUM_ERROR, DEVICE_NAME::BRACKETS },
+  { "exception Emask", KERNEL_ERROR::ATA_ERROR, DEVICE_NAME::PREFIX },
+  { "hard resetting link", KERNEL_ERROR::LINK_RESET, DEVICE_NAME::PREFIX },
+  { "timing out command", KERNEL_ERROR::TIMEOUT, DEVICE_NAME::BRACKETS },
+  { " timeout, aborting", KERNEL_ERROR::TIMEOUT, DEVICE_NAME::PREFIX },
+  { "I/O Cmd(", KERNEL_ERROR::IO_ERROR, DEVICE_NAME::PREFIX },
+  { "BTRFS error (device ", KERNEL_ERROR::BTRFS_ERROR, DEVICE_NAME::FOLLOWS },
+  { "BTRFS critical (device ", KERNEL_ERROR::BTRFS_ERROR, DEVICE_NAME::FOLLOWS },
+};
+
+std::vector<std::string_view> GetKernelErrorPatterns()
+{
+  std::vector<std::string_view> patterns;
+  for (auto& pattern : KERNEL_ERROR_PATTERNS) {
+    patterns.push_back(pattern.sPattern);
+  }
+
+  return patterns;
+}
+
+bool IsDeviceNameCharacter(char c)
+{
+  return ((c != ' ') && (c != ',') && (c != ':') && (c != ')') && (c != ']') && (c != '\t'));
+}
+
+std::string_view GetDeviceNameFollowing(std::string_view message, size_t start)
+{
+  size_t end = start;
+  while ((end < message.length()) && IsDeviceNameCharacter(message[end])) {
+    end++;
+  }
+
+  return message.substr(start, end - start);
+}
+
+std::string_view GetDeviceNameInBrackets(std::string_view message, size_t nPatternStart)
+{
+  const size_t open = message.rfind('[', nPatternStart);
+  if (open == std::string_view::npos) return std::string_view();
+
+  return GetDeviceNameFollowing(message, open + 1);
+}
+
+std::string_view GetDeviceNameFromPrefix(std::string_view message)
+{
+  const size_t colon = message.find(':');
+  if (colon == std::string_view::npos) return std::string_view();
+
+  std::string_view prefix = message.substr(0, colon);
+
+  // "nvme nvme0" is the driver followed by the device
+  const size_t space = prefix.rfind(' ');
+  if (space != std::string_view::npos) {
+    prefix.remove_prefix(space + 1);
+  }
+
+  // "ata3.00" is a device on a port, we only track the port
+  if (prefix.substr(0, 3) == "ata") {
+    const size_t dot = prefix.find('.');
+    if (dot != std::string_view::npos) {
+      prefix = prefix.substr(0, dot);
+    }
+  }
+
+  return prefix;
+}
+
+bool ParseUnsigned(std::string_view text, uint64_t& value)
+{
+  if (text.empty()) return false;
+
+  value = 0;
+  for (const char c : text) {
+    if ((c < '0') || (c > '9')) return false;
+    value = (value * 10) + uint64_t(c - '0');
+  }
+
+  return true;
+}
+
+}
+
+cMultiPatternMatcher::cMultiPatternMatcher(const std::vector<std::string_view>& patterns) :
+  nClasses(1),
+  nStates(1)
+{
+  // Class 0 is every byte that isn't in a pattern
+  byteClass.fill(0);
+  for (auto& pattern : patterns) {
+    for (const char c : pattern) {
+      uint8_t& byte_class = byteClass[static_cast<unsigned char>(c)];
+      if (byte_class == 0) {
+        byte_class = uint8_t(nClasses++);
+      }
+    }
+  }
+
+  // Build the trie, 0 means there is no edge yet as nothing goes back to the root state while building
+  size_t nMaxStates = 1;
+  for (auto& pattern : patterns) {
+    nMaxStates += pattern.length();
+  }
+
+  std::vector<uint32_t> trie(nMaxStates * nClasses, 0);
+  matches.assign(nMaxStates, NO_MATCH);
+
+  for (size_t p = 0; p < patterns.size(); p++) {
+    size_t state = 0;
+    for (const char c : patterns[p]) {
+      uint32_t& next = trie[(state * nClasses) + byteClass[static_cast<unsigned char>(c)]];
+      if (next == 0) {
+        next = uint32_t(nStates++);
+      }
+      state = next;
+    }
+
+    // If one pattern is repeated the first one wins
+    if (!patterns[p].empty() && (matches[state] == NO_MATCH)) {
+      matches[state] = int32_t(p);
+    }
+  }
+
+  trie.resize(nStates * nClasses);
+  matches.resize(nStates);
+
+  // Turn the trie into a DFA by following the failure links breadth first
+  std::vector<uint32_t> dfa(nStates * nClasses, 0);
+  std::vector<uint32_t> failure(nStates, 0);
+  std::queue<uint32_t> pending;
+
+  for (size_t c = 0; c < nClasses; c++) {
+    dfa[c] = trie[c];
+    if (trie[c] != 0) {
+      pending.push(trie[c]);
+    }
+  }
+
+  while (!pending.empty()) {
+    const uint32_t state = pending.front();
+    pending.pop();
+
+    // A state that doesn't end a pattern itself still matches if a shorter suffix does
+    if (matches[state] == NO_MATCH) {
+      matches[state] = matches[failure[state]];
+    }
+
+    for (size_t c = 0; c < nClasses; c++) {
+      const uint32_t next = trie[(size_t(state) * nClasses) + c];
+      if (next != 0) {
+        failure[next] = dfa[(size_t(failure[state]) * nClasses) + c];
+        dfa[(size_t(state) * nClasses) + c] = next;
+        pending.push(next);
+      } else {
+        dfa[(size_t(state) * nClasses) + c] = dfa[(size_t(failure[state]) * nClasses) + c];
+      }
+    }
+  }
+
+  transitions.resize(dfa.size());
+  for (size_t i = 0; i < dfa.size(); i++) {
+    transitions[i] = uint32_t(dfa[i] * nClasses) | ((matches[dfa[i]] != NO_MATCH) ? MATCH_FLAG : 0);
+  }
+}
+
+cMultiPatternMatcher::~cMultiPatternMatcher()
+{
+}
+
+bool cMultiPatternMatcher::FindFirst(std::string_view text, size_t& outPattern, size_t& outEnd) const
+{
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(text.data());
+  const size_t len = text.length();
+  const uint32_t* table = transitions.data();
+
+  uint32_t offset = 0;
+  for (size_t i = 0; i < len; i++) {
+    offset = table[offset + byteClass[p[i]]];
+    if ((offset & MATCH_FLAG) != 0) {
+      outPattern = size_t(matches[(offset & ~MATCH_FLAG) / nClasses]);
+      outEnd = i + 1;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+bool ParseKernelLogRecord(std::string_view buffer, cKernelLogRecord& record)
+{
+  // "priority,sequence,timestamp,flags[,more fields];message\n"
+  const size_t semicolon = buffer.find(';');
+  if (semicolon == std::string_view::npos) return false;
+
+  std::string_view header = buffer.substr(0, semicolon);
+  std::string_view fields[3];
+  for (size_t i = 0; i < 3; i++) {
+    const size_t comma = header.find(',');
+    if (comma == std::string_view::npos) return false;
+
+    fields[i] = header.substr(0, comma);
+    header.remove_prefix(comma + 1);
+  }
+
+  uint64_t nPriority = 0;
+  if (!ParseUnsigned(fields[0], nPriority) || !ParseUnsigned(fields[1], record.nSequence) || !ParseUnsigned(fields[2], record.nTimestampUS)) {
+    return false;
+  }
+
+  // The facility is in the upper bits
+  record.nPriority = int(nPriority & 7);
+
+  std::string_view message = buffer.substr(semicolon + 1);
+  const size_t newline = message.find('\n');
+  if (newline != std::string_view::npos) {
+    message = message.substr(0, newline);
+  }
+
+  record.message = message;
+  return true;
+}
+
+
+cKernelErrorMatcher::cKernelErrorMatcher() :
+  matcher(GetKernelErrorPatterns())
+{
+}
+
+bool cKernelErrorMatcher::Match(std::string_view message, cKernelError& error) const
+{
+  size_t index = 0;
+  size_t end = 0;
+  if (!matcher.FindFirst(message, index, end)) {
+    return false;
+  }
+
+  const cKernelErrorPattern& pattern = KERNEL_ERROR_PATTERNS[index];
+  const size_t start = end - pattern.sPattern.length();
+
+  std::string_view sName;
+  switch (pattern.name) {
+    case DEVICE_NAME::FOLLOWS: sName = GetDeviceNameFollowing(message, end); break;
+    case DEVICE_NAME::BRACKETS: sName = GetDeviceNameInBrackets(message, start); break;
+    case DEVICE_NAME::PREFIX: sName = GetDeviceNameFromPrefix(message.substr(0, start)); break;
+  }
+
+  if (sName.empty()) {
+    return false;
+  }
+
+  error.type = pattern.type;
+  error.sName = sName;
+  return true;
+}
+
+const char* GetKernelErrorName(KERNEL_ERROR type)
+{
+  switch (type) {
+    case KERNEL_ERROR::IO_ERROR: return "io error";
+    case KERNEL_ERROR::MEDIUM_ERROR: return "medium error";
+    case KERNEL_ERROR::ATA_ERROR: return "ata error";
+    case KERNEL_ERROR::LINK_RESET: return "link reset";
+    case KERNEL_ERROR::TIMEOUT: return "timeout";
+    case KERNEL_ERROR::BTRFS_ERROR: return "btrfs error";
+  }
+
+  return "unknown";
+}
+
+std::string_view GetDiskNameFromPartitionName(std::string_view sName)
+{
+  size_t digits = sName.length();
+  while ((digits > 0) && (sName[digits - 1] >= '0') && (sName[digits - 1] <= '9')) {
+    digits--;
+  }
+
+  if ((digits == 0) || (digits == sName.length())) {
+    return sName;
+  }
+
+  // "nvme0n1p2", "mmcblk0p1"
+  if ((digits >= 2) && (sName[digits - 1] == 'p') && (sName[digits - 2] >= '0') && (sName[digits - 2] <= '9')) {
+    return sName.substr(0, digits - 1);
+  }
+
+  // "sdc1", "vdb2", "xvda1", the disk name is all letters
+  for (const std::string_view prefix : { "sd", "vd", "hd", "xvd" }) {
+    if ((sName.substr(0, prefix.length()) == prefix) && std::all_of(sName.begin(), sName.begin() + digits, [](char c) { return (c >= 'a') && (c <= 'z'); })) {
+      return sName.substr(0, digits);
+    }
+  }
+
+  return sName;
+}
+
+
+cKernelErrorTracker::cKernelErrorTracker(size_t _nThreshold, uint64_t _nWindowMS, uint64_t _nCooldownMS) :
+  nThreshold(std::max<size_t>(1, _nThreshold)),
+  nWindowMS(_nWindowMS),
+  nCooldownMS(_nCooldownMS)
+{
+}
+
+void cKernelErrorTracker::ExpireOld(cDevice& device, uint64_t nNowMS) const
+{
+  // Drop the seconds that ended before the window started
+  while (!device.recent.empty() && (((device.recent.front().first + 1) * 1000) + nWindowMS <= nNowMS)) {
+    device.nRecent -= device.recent.front().second;
+    device.recent.pop_front();
+  }
+}
+
+bool cKernelErrorTracker::Record(const std::string& sDevicePath, KERNEL_ERROR type, uint64_t nNowMS)
+{
+  cDevice& device = devices[sDevicePath];
+  device.totals[size_t(type)]++;
+
+  ExpireOld(device, nNowMS);
+
+  const uint64_t nSecond = nNowMS / 1000;
+  if (!device.recent.empty() && (device.recent.back().first == nSecond)) {
+    device.recent.back().second++;
+  } else {
+    device.recent.push_back(std::make_pair(nSecond, 1));
+  }
+  device.nRecent++;
+
+  if (device.nRecent < nThreshold) {
+    return false;
+  }
+
+  if (device.bHasTriggered && (nNowMS < device.nLastTriggerMS + nCooldownMS)) {
+    return false;
+  }
+
+  device.bHasTriggered = true;
+  device.nLastTriggerMS = nNowMS;
+  return true;
+}
+
+bool cKernelErrorTracker::GetStats(const std::string& sDevicePath, uint64_t nNowMS, cKernelErrorStats& outStats)
+{
+  outStats = cKernelErrorStats();
+  outStats.nWindowSeconds = nWindowMS / 1000;
+
+  auto iter = devices.find(sDevicePath);
+  if (iter == devices.end()) {
+    return false;
+  }
+
+  cDevice& device = iter->second;
+  ExpireOld(device, nNowMS);
+
+  outStats.nIOErrors = device.totals[size_t(KERNEL_ERROR::IO_ERROR)];
+  outStats.nMediumErrors = device.totals[size_t(KERNEL_ERROR::MEDIUM_ERROR)];
+  outStats.nATAErrors = device.totals[size_t(KERNEL_ERROR::ATA_ERROR)];
+  outStats.nLinkResets = device.totals[size_t(KERNEL_ERROR::LINK_RESET)];
+  outStats.nTimeouts = device.totals[size_t(KERNEL_ERROR::TIMEOUT)];
+  outStats.nBtrfsErrors = device.totals[size_t(KERNEL_ERROR::BTRFS_ERROR)];
+  outStats.nErrorsInWindow = device.nRecent;
+  return true;
+}
+
+
+cKernelLogReader::cKernelLogReader() :
+  fd(-1)
+{
+}
+
+cKernelLogReader::~cKernelLogReader()
+{
+  Close();
+}
+
+bool cKernelLogReader::Open(const std::string& sFilePath)
+{
+  Close();
+
+  fd = open(sFilePath.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) {
+    std::cerr<<"cKernelLogReader::Open Error opening \""<<sFilePath<<"\": "<<strerror(errno)<<std::endl;
+    syslog(LOG_ERR, "cKernelLogReader::Open Error opening \"%s\": %s", sFilePath.c_str(), strerror(errno));
+    return false;
+  }
+
+  // Skip the messages from before we started, the regular collections already cover those
+  if (lseek(fd, 0, SEEK_END) < 0) {
+    syslog(LOG_WARNING, "cKernelLogReader::Open Unable to skip to the end of \"%s\": %s", sFilePath.c_str(), strerror(errno));
+  }
+
+  return true;
+}
+
+void cKernelLogReader::Attach(int _fd)
+{
+  Close();
+  fd = _fd;
+}
+
+void cKernelLogReader::Close()
+{
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+}
+
+ssize_t cKernelLogReader::ReadRecord()
+{
+  if (fd < 0) return -1;
+
+  while (true) {
+    // Each read returns exactly one record
+    const ssize_t len = read(fd, buffer.data(), buffer.size());
+    if (len >= 0) {
+      return len;
+    }
+
+    if (errno == EINTR) {
+      continue;
+    } else if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+      return 0;
+    } else if (errno == EPIPE) {
+      // The kernel's ring buffer wrapped before we got to some records, the next read continues from the oldest one left
+      syslog(LOG_WARNING, "cKernelLogReader::ReadRecord Kernel log records were overwritten before they were read");
+      continue;
+    }
+
+    std::cerr<<"cKernelLogReader::ReadRecord Error: "<<strerror(errno)<<std::endl;
+    syslog(LOG_ERR, "cKernelLogReader::ReadRecord Error: %s", strerror(errno));
+    return -1;
+  }
+}
+
+}
@@ -0,0 +1,293 @@
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "latency_probe.h"
+#include "low_impact.h"
+
+namespace lumberjill {
+
+namespace {
+
+// With the default of 32 reads per collection this is the last 32 collections or so
+const size_t DEFAULT_MAX_READS = 1024;
+
+// Regular files such as a loop back file are read in 4 KiB blocks which suits any underlying drive
+const size_t DEFAULT_BLOCK_SIZE_BYTES = 4096;
+
+bool GetSizeAndBlockSize(int fd, uint64_t& nSizeBytes, size_t& nBlockSizeBytes)
+{
+  struct stat s;
+  if (fstat(fd, &s) != 0) {
+    return false;
+  }
+
+  if (S_ISBLK(s.st_mode)) {
+    int nLogicalBlockSize = 0;
+    if ((ioctl(fd, BLKGETSIZE64, &nSizeBytes) != 0) || (ioctl(fd, BLKSSZGET, &nLogicalBlockSize) != 0) || (nLogicalBlockSize <= 0)) {
+      return false;
+    }
+
+    nBlockSizeBytes = size_t(nLogicalBlockSize);
+    return true;
+  } else if (S_ISREG(s.st_mode)) {
+    nSizeBytes = uint64_t(s.st_size);
+    nBlockSizeBytes = DEFAULT_BLOCK_SIZE_BYTES;
+    return true;
+  }
+
+  return false;
+}
+
+// splitmix64, we just need the offsets to be spread across the drive
+uint64_t NextRandom(uint64_t& state)
+{
+  uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+uint64_t GetMedian(std::vector<uint64_t>& values)
+{
+  const size_t middle = values.size() / 2;
+  std::nth_element(values.begin(), values.begin() + middle, values.end());
+  return values[middle];
+}
+
+}
+
+cLatencyHistogram::cLatencyHistogram()
+{
+  Clear();
+}
+
+void cLatencyHistogram::Clear()
+{
+  buckets.fill(0);
+  nCount = 0;
+  nMaxUS = 0;
+}
+
+size_t cLatencyHistogram::GetBucketIndex(uint64_t nValueUS)
+{
+  if (nValueUS < SUB_BUCKET_COUNT) {
+    return size_t(nValueUS);
+  }
+
+  const size_t exponent = size_t(63 - __builtin_clzll(nValueUS));
+  if (exponent > MAX_EXPONENT) {
+    return BUCKET_COUNT - 1;
+  }
+
+  const size_t sub_bucket = size_t(nValueUS >> (exponent - SUB_BUCKET_BITS)) - SUB_BUCKET_COUNT;
+  return SUB_BUCKET_COUNT + ((exponent - SUB_BUCKET_BITS) * SUB_BUCKET_COUNT) + sub_bucket;
+}
+
+uint64_t cLatencyHistogram::GetBucketHighestValue(size_t index)
+{
+  if (index < SUB_BUCKET_COUNT) {
+    return uint64_t(index);
+  }
+
+  const size_t exponent = ((index - SUB_BUCKET_COUNT) / SUB_BUCKET_COUNT) + SUB_BUCKET_BITS;
+  const size_t sub_bucket = (index - SUB_BUCKET_COUNT) % SUB_BUCKET_COUNT;
+  return (uint64_t(SUB_BUCKET_COUNT + sub_bucket + 1) << (exponent - SUB_BUCKET_BITS)) - 1;
+}
+
+void cLatencyHistogram::Record(uint64_t nValueUS)
+{
+  buckets[GetBucketIndex(nValueUS)]++;
+  nCount++;
+  nMaxUS = std::max(nMaxUS, nValueUS);
+}
+
+void cLatencyHistogram::Add(const cLatencyHistogram& other)
+{
+  for (size_t i = 0; i < BUCKET_COUNT; i++) {
+    buckets[i] += other.buckets[i];
+  }
+
+  nCount += other.nCount;
+  nMaxUS = std::max(nMaxUS, other.nMaxUS);
+}
+
+void cLatencyHistogram::Halve()
+{
+  // Rounding down lets a single old outlier drop out
+  nCount = 0;
+  uint64_t nHighestUS = 0;
+  for (size_t i = 0; i < BUCKET_COUNT; i++) {
+    buckets[i] /= 2;
+    nCount += buckets[i];
+    if (buckets[i] != 0) nHighestUS = GetBucketHighestValue(i);
+  }
+
+  nMaxUS = std::min(nMaxUS, nHighestUS);
+}
+
+uint64_t cLatencyHistogram::GetPercentileUS(double percentile) const
+{
+  if (nCount == 0) {
+    return 0;
+  }
+
+  const size_t nTarget = std::max<size_t>(1, size_t(std::ceil((std::clamp(percentile, 0.0, 100.0) / 100.0) * double(nCount))));
+
+  size_t nSeen = 0;
+  for (size_t i = 0; i < BUCKET_COUNT; i++) {
+    nSeen += buckets[i];
+    if (nSeen >= nTarget) {
+      return std::min(GetBucketHighestValue(i), nMaxUS);
+    }
+  }
+
+  return nMaxUS;
+}
+
+cDeviceLatencyHistograms::cDeviceLatencyHistograms() :
+  cDeviceLatencyHistograms(DEFAULT_MAX_READS)
+{
+}
+
+cDeviceLatencyHistograms::cDeviceLatencyHistograms(size_t _nMaxReads) :
+  nMaxReads(_nMaxReads)
+{
+}
+
+const cLatencyHistogram& cDeviceLatencyHistograms::Add(const std::string& sDevicePath, const cLatencyHistogram& probe)
+{
+  cLatencyHistogram& histogram = mapDevicePathToHistogram[sDevicePath];
+  histogram.Add(probe);
+
+  while (histogram.GetCount() > nMaxReads) {
+    histogram.Halve();
+  }
+
+  return histogram;
+}
+
+bool ProbeDeviceLatency(const std::string& sDevicePath, const cLatencyProbeSettings& settings, cLatencyHistogram& histogram)
+{
+  histogram.Clear();
+
+  const int fd = open(sDevicePath.c_str(), O_RDONLY | O_DIRECT | O_CLOEXEC);
+  if (fd < 0) {
+    std::cerr<<"ProbeDeviceLatency Error opening \""<<sDevicePath<<"\": "<<strerror(errno)<<std::endl;
+    syslog(LOG_ERR, "ProbeDeviceLatency Error opening \"%s\": %s", sDevicePath.c_str(), strerror(errno));
+    return false;
+  }
+
+  uint64_t nSizeBytes = 0;
+  size_t nBlockSizeBytes = 0;
+  if (!GetSizeAndBlockSize(fd, nSizeBytes, nBlockSizeBytes)) {
+    std::cerr<<"ProbeDeviceLatency Error getting the size of \""<<sDevicePath<<"\""<<std::endl;
+    syslog(LOG_ERR, "ProbeDeviceLatency Error getting the size of \"%s\"", sDevicePath.c_str());
+    close(fd);
+    return false;
+  }
+
+  // O_DIRECT reads must be a multiple of the logical block size, at an aligned offset, into an aligned buffer
+  const size_t nReadSizeBytes = ((settings.nReadSizeBytes + nBlockSizeBytes - 1) / nBlockSizeBytes) * nBlockSizeBytes;
+  if (nSizeBytes < nReadSizeBytes) {
+    std::cerr<<"ProbeDeviceLatency \""<<sDevicePath<<"\" is too small to probe"<<std::endl;
+    syslog(LOG_ERR, "ProbeDeviceLatency \"%s\" is too small to probe", sDevicePath.c_str());
+    close(fd);
+    return false;
+  }
+
+  void* buffer = nullptr;
+  if (posix_memalign(&buffer, std::max(nBlockSizeBytes, DEFAULT_BLOCK_SIZE_BYTES), nReadSizeBytes) != 0) {
+    close(fd);
+    return false;
+  }
+
+  const uint64_t nBlocks = ((nSizeBytes - nReadSizeBytes) / nBlockSizeBytes) + 1;
+  uint64_t random_state = uint64_t(std::chrono::steady_clock::now().time_since_epoch().count()) ^ std::hash<std::string>()(sDevicePath);
+
+  const std::chrono::microseconds interval(1000000 / settings.nReadsPerSecond);
+
+  bool result = true;
+
+  {
+    const cIdleIOPriority idle;
+
+    std::chrono::steady_clock::time_point next_read = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < settings.nReads; i++) {
+      std::this_thread::sleep_until(next_read);
+
+      const off_t offset = off_t((NextRandom(random_state) % nBlocks) * nBlockSizeBytes);
+
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      const ssize_t len = pread(fd, buffer, nReadSizeBytes, offset);
+      const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+      if (len != ssize_t(nReadSizeBytes)) {
+        std::cerr<<"ProbeDeviceLatency Error reading \""<<sDevicePath<<"\": "<<((len < 0) ? strerror(errno) : "Short read")<<std::endl;
+        syslog(LOG_ERR, "ProbeDeviceLatency Error reading \"%s\": %s", sDevicePath.c_str(), ((len < 0) ? strerror(errno) : "Short read"));
+        result = false;
+        break;
+      }
+
+      histogram.Record(uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()));
+
+      next_read = start + interval;
+    }
+  }
+
+  free(buffer);
+  close(fd);
+
+  return result;
+}
+
+void FlagLatencyOutliers(cMountStats& mountStats, size_t nOutlierFactor)
+{
+  std::vector<cDriveLatencyStats*> drives;
+  for (auto& item : mountStats.mapDrivePathToDriveStats) {
+    if (item.second.latencyStats.has_value()) {
+      drives.push_back(&item.second.latencyStats.value());
+    }
+  }
+
+  std::vector<uint64_t> peersP50;
+  std::vector<uint64_t> peersP99;
+
+  for (auto& pDrive : drives) {
+    pDrive->bIsOutlier = false;
+
+    peersP50.clear();
+    peersP99.clear();
+    for (auto& pPeer : drives) {
+      if (pPeer == pDrive) continue;
+
+      peersP50.push_back(pPeer->nP50US);
+      peersP99.push_back(pPeer->nP99US);
+    }
+
+    // With only one other drive we can't tell which one is slow
+    if (peersP50.size() < 2) continue;
+
+    const uint64_t nMedianP50US = std::max<uint64_t>(1, GetMedian(peersP50));
+    const uint64_t nMedianP99US = std::max<uint64_t>(1, GetMedian(peersP99));
+    pDrive->bIsOutlier = ((pDrive->nP50US > (nOutlierFactor * nMedianP50US)) || (pDrive->nP99US > (nOutlierFactor * nMedianP99US)));
+  }
+}
+
+}
@@ -0,0 +1,776 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <charconv>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include <json-c/json.h>
+#include <zlib.h>
+
+#include "log_analyzer.h"
+
+namespace lumberjill {
+
+namespace {
+
+// The text around the '@' of every record that lumber-jill writes
+const char JSON_MARKER_BEFORE[] = " json ";
+const size_t JSON_MARKER_BEFORE_LENGTH = sizeof(JSON_MARKER_BEFORE) - 1;
+const char JSON_MARKER_AFTER[] = "cee: ";
+const size_t JSON_MARKER_AFTER_LENGTH = sizeof(JSON_MARKER_AFTER) - 1;
+
+const std::string_view DRIVE_STATS_SUFFIX = " drive stats";
+const std::string_view BTRFS_STATS_SUFFIX = " btrfs stats";
+
+// How much of a compressed file is decompressed at a time
+const size_t GZIP_CHUNK_BYTES = 4 * 1024 * 1024;
+
+bool EndsWith(std::string_view text, std::string_view suffix)
+{
+  return (text.size() >= suffix.size()) && (text.substr(text.size() - suffix.size()) == suffix);
+}
+
+bool ParseDigits(std::string_view text, size_t nOffset, size_t nDigits, int& value)
+{
+  if ((nOffset + nDigits) > text.size()) return false;
+
+  value = 0;
+  for (size_t i = nOffset; i < (nOffset + nDigits); i++) {
+    const char c = text[i];
+    if ((c < '0') || (c > '9')) return false;
+    value = (value * 10) + (c - '0');
+  }
+
+  return true;
+}
+
+// Days since 1970-01-01 in the proleptic Gregorian calendar, timegm does the same but is much slower
+int64_t DaysFromCivil(int year, int month, int day)
+{
+  const int64_t y = int64_t(year) - ((month <= 2) ? 1 : 0);
+  const int64_t era = ((y >= 0) ? y : (y - 399)) / 400;
+  const int64_t yoe = y - (era * 400);
+  const int64_t doy = (((153 * (month + ((month > 2) ? -3 : 9))) + 2) / 5) + day - 1;
+  const int64_t doe = (yoe * 365) + (yoe / 4) - (yoe / 100) + doy;
+  return (era * 146097) + doe - 719468;
+}
+
+// "2026-10-19T08:15:02", optionally followed by fractional seconds, and then "Z", "+01:00" or "+0100"
+bool ParseRFC3339Timestamp(std::string_view line, int64_t& nTimestamp)
+{
+  int year = 0;
+  int month = 0;
+  int day = 0;
+  int hour = 0;
+  int minute = 0;
+  int second = 0;
+  if (
+    !ParseDigits(line, 0, 4, year) || (line[4] != '-') || !ParseDigits(line, 5, 2, month) || (line[7] != '-') || !ParseDigits(line, 8, 2, day) ||
+    ((line[10] != 'T') && (line[10] != ' ')) || !ParseDigits(line, 11, 2, hour) || (line[13] != ':') || !ParseDigits(line, 14, 2, minute) || (line[16] != ':') || !ParseDigits(line, 17, 2, second) ||
+    (month < 1) || (month > 12)
+  ) {
+    return false;
+  }
+
+  size_t i = 19;
+  if ((i < line.size()) && (line[i] == '.')) {
+    i++;
+    while ((i < line.size()) && (line[i] >= '0') && (line[i] <= '9')) i++;
+  }
+
+  int64_t nOffsetSeconds = 0;
+  if ((i < line.size()) && ((line[i] == '+') || (line[i] == '-'))) {
+    const bool bIsNegative = (line[i] == '-');
+    i++;
+    int hours = 0;
+    int minutes = 0;
+    if (!ParseDigits(line, i, 2, hours)) return false;
+    i += 2;
+    if ((i < line.size()) && (line[i] == ':')) i++;
+    if (!ParseDigits(line, i, 2, minutes)) return false;
+    nOffsetSeconds = (int64_t(hours) * 3600) + (int64_t(minutes) * 60);
+    if (bIsNegative) nOffsetSeconds = -nOffsetSeconds;
+  } else if ((i >= line.size()) || (line[i] != 'Z')) {
+    return false;
+  }
+
+  nTimestamp = (DaysFromCivil(year, month, day) * 86400) + (int64_t(hour) * 3600) + (int64_t(minute) * 60) + second - nOffsetSeconds;
+  return true;
+}
+
+// "Oct 19 08:15:02" or "Oct  9 08:15:02" in local time
+bool ParseBSDTimestamp(std::string_view line, time_t reference, int64_t& nTimestamp)
+{
+  static const char* MONTHS[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+  if ((line.size() < 15) || (line[3] != ' ') || (line[9] != ':') || (line[12] != ':')) return false;
+
+  int month = -1;
+  for (int i = 0; i < 12; i++) {
+    if (line.substr(0, 3) == MONTHS[i]) {
+      month = i;
+      break;
+    }
+  }
+  if (month < 0) return false;
+
+  struct tm t = {};
+  t.tm_mon = month;
+  const int nDayOffset = (line[4] == ' ') ? 5 : 4;
+  if (!ParseDigits(line, size_t(nDayOffset), size_t(6 - nDayOffset), t.tm_mday) || !ParseDigits(line, 7, 2, t.tm_hour) || !ParseDigits(line, 10, 2, t.tm_min) || !ParseDigits(line, 13, 2, t.tm_sec)) {
+    return false;
+  }
+
+  // The line doesn't say which year, assume it was written in the 12 months before the reference time
+  struct tm referenceTime = {};
+  localtime_r(&reference, &referenceTime);
+  t.tm_year = referenceTime.tm_year;
+  if (month > referenceTime.tm_mon) t.tm_year--;
+  t.tm_isdst = -1;
+
+  nTimestamp = int64_t(mktime(&t));
+  return true;
+}
+
+// Reads the records that GetJSONMountStats and GetJSONBtrfsStats write, building a json-c object for every record is many times slower than finding them
+// Only what the analyzer needs is understood, nested objects and arrays that it doesn't know about are skipped
+class cRecordReader {
+public:
+  enum class VALUE {
+    NUMBER,
+    STRING,
+    BOOLEAN,
+    OTHER
+  };
+
+  explicit cRecordReader(std::string_view _text) : text(_text), nPosition(0) {}
+
+  bool Consume(char c)
+  {
+    SkipWhitespace();
+    if ((nPosition >= text.size()) || (text[nPosition] != c)) return false;
+    nPosition++;
+    return true;
+  }
+
+  bool IsAtEnd()
+  {
+    SkipWhitespace();
+    return (nPosition == text.size());
+  }
+
+  // Strings without escapes point into the text, others are unescaped into sBuffer
+  bool ReadString(std::string_view& value, std::string& sBuffer)
+  {
+    if (!Consume('"')) return false;
+
+    const size_t nStart = nPosition;
+    const char* pQuote = static_cast<const char*>(memchr(text.data() + nPosition, '"', text.size() - nPosition));
+    if (pQuote == nullptr) return false;
+    nPosition = size_t(pQuote - text.data());
+
+    // The quote may be escaped, in which case look for the end of the string one character at a time
+    const bool bIsEscaped = (memchr(text.data() + nStart, '\\', nPosition - nStart) != nullptr);
+    if (bIsEscaped) {
+      nPosition = nStart;
+      while (true) {
+        if (nPosition >= text.size()) return false;
+        const char c = text[nPosition];
+        if (c == '"') break;
+        if (c == '\\') nPosition++;
+        nPosition++;
+      }
+    }
+
+    value = text.substr(nStart, nPosition - nStart);
+    nPosition++;
+
+    if (bIsEscaped) {
+      if (!Unescape(value, sBuffer)) return false;
+      value = sBuffer;
+    }
+
+    return true;
+  }
+
+  bool ReadValue(VALUE& type, double& dValue, bool& bValue, std::string_view& sValue, std::string& sBuffer)
+  {
+    SkipWhitespace();
+    if (nPosition >= text.size()) return false;
+
+    const char c = text[nPosition];
+    if (c == '"') {
+      type = VALUE::STRING;
+      return ReadString(sValue, sBuffer);
+    } else if ((c == '-') || ((c >= '0') && (c <= '9'))) {
+      type = VALUE::NUMBER;
+      const std::from_chars_result result = std::from_chars(text.data() + nPosition, text.data() + text.size(), dValue);
+      if (result.ec != std::errc()) return false;
+      nPosition = size_t(result.ptr - text.data());
+      return true;
+    } else if (c == 't') {
+      type = VALUE::BOOLEAN;
+      bValue = true;
+      return ConsumeWord("true");
+    } else if (c == 'f') {
+      type = VALUE::BOOLEAN;
+      bValue = false;
+      return ConsumeWord("false");
+    } else if (c == 'n') {
+      type = VALUE::OTHER;
+      return ConsumeWord("null");
+    } else if ((c == '{') || (c == '[')) {
+      type = VALUE::OTHER;
+      return SkipNested();
+    }
+
+    return false;
+  }
+
+private:
+  void SkipWhitespace()
+  {
+    while ((nPosition < text.size()) && ((text[nPosition] == ' ') || (text[nPosition] == '\t') || (text[nPosition] == '\r') || (text[nPosition] == '\n'))) nPosition++;
+  }
+
+  bool ConsumeWord(std::string_view word)
+  {
+    if (text.substr(nPosition, word.size()) != word) return false;
+    nPosition += word.size();
+    return true;
+  }
+
+  // Skip an object or array, only the brackets and strings matter
+  bool SkipNested()
+  {
+    size_t nDepth = 0;
+    while (nPosition < text.size()) {
+      const char c = text[nPosition];
+      if (c == '"') {
+        nPosition++;
+        while ((nPosition < text.size()) && (text[nPosition] != '"')) {
+          if (text[nPosition] == '\\') nPosition++;
+          nPosition++;
+        }
+      } else if ((c == '{') || (c == '[')) {
+        nDepth++;
+      } else if ((c == '}') || (c == ']')) {
+        nDepth--;
+        if (nDepth == 0) {
+          nPosition++;
+          return true;
+        }
+      }
+      nPosition++;
+    }
+
+    return false;
+  }
+
+  static void AppendUTF8(uint32_t nCodePoint, std::string& sOutput)
+  {
+    if (nCodePoint < 0x80) {
+      sOutput += char(nCodePoint);
+    } else if (nCodePoint < 0x800) {
+      sOutput += char(0xC0 | (nCodePoint >> 6));
+      sOutput += char(0x80 | (nCodePoint & 0x3F));
+    } else {
+      sOutput += char(0xE0 | (nCodePoint >> 12));
+      sOutput += char(0x80 | ((nCodePoint >> 6) & 0x3F));
+      sOutput += char(0x80 | (nCodePoint & 0x3F));
+    }
+  }
+
+  static bool Unescape(std::string_view value, std::string& sOutput)
+  {
+    sOutput.clear();
+    for (size_t i = 0; i < value.size(); i++) {
+      if (value[i] != '\\') {
+        sOutput += value[i];
+        continue;
+      }
+
+      i++;
+      if (i >= value.size()) return false;
+      switch (value[i]) {
+        case '"': sOutput += '"'; break;
+        case '\\': sOutput += '\\'; break;
+        case '/': sOutput += '/'; break;
+        case 'b': sOutput += '\b'; break;
+        case 'f': sOutput += '\f'; break;
+        case 'n': sOutput += '\n'; break;
+        case 'r': sOutput += '\r'; break;
+        case 't': sOutput += '\t'; break;
+        case 'u': {
+          uint32_t nCodePoint = 0;
+          if (((i + 4) >= value.size()) || (std::from_chars(value.data() + i + 1, value.data() + i + 5, nCodePoint, 16).ptr != (value.data() + i + 5))) return false;
+          AppendUTF8(nCodePoint, sOutput);
+          i += 4;
+          break;
+        }
+        default: return false;
+      }
+    }
+
+    return true;
+  }
+
+  std::string_view text;
+  size_t nPosition;
+};
+
+std::vector<cLogSample>& GetSeries(cLogHistory& history, std::string_view sName)
+{
+  auto iter = history.series.find(sName);
+  if (iter == history.series.end()) iter = history.series.emplace(std::string(sName), std::vector<cLogSample>()).first;
+  return iter->second;
+}
+
+cLogHistory& GetHistory(std::map<std::string, cLogHistory, std::less<>>& histories, std::string_view sKey)
+{
+  auto iter = histories.find(sKey);
+  if (iter == histories.end()) iter = histories.emplace(std::string(sKey), cLogHistory()).first;
+  return iter->second;
+}
+
+// Add a double rounded to 2 decimal places, json-c would otherwise print something like 0.33000000000000002
+void AddJSONDouble(json_object* parent, const char* key, double value)
+{
+  char szValue[32];
+  snprintf(szValue, sizeof(szValue), "%.2f", value);
+  json_object_object_add(parent, key, json_object_new_double_s(value, szValue));
+}
+
+json_object* CreateJSONLogHistory(const cLogHistory& history)
+{
+  json_object* counters = json_object_new_object();
+
+  for (auto& item : history.series) {
+    const cLogSeriesSummary summary = GetLogSeriesSummary(item.second);
+
+    json_object* counter = json_object_new_object();
+    json_object_object_add(counter, "samples", json_object_new_int64(int64_t(summary.nSamples)));
+    json_object_object_add(counter, "firstTimestamp", json_object_new_int64(summary.nFirstTimestamp));
+    json_object_object_add(counter, "lastTimestamp", json_object_new_int64(summary.nLastTimestamp));
+    AddJSONDouble(counter, "first", summary.dFirst);
+    AddJSONDouble(counter, "last", summary.dLast);
+    AddJSONDouble(counter, "min", summary.dMin);
+    AddJSONDouble(counter, "max", summary.dMax);
+    AddJSONDouble(counter, "growth", summary.dGrowth);
+    json_object_object_add(counter, "resets", json_object_new_int64(int64_t(summary.nResets)));
+    json_object_object_add(counters, item.first.c_str(), counter);
+  }
+
+  return counters;
+}
+
+void AppendCSVLogHistory(const char* szType, const std::string& sID, const cLogHistory& history, std::string& sOutput)
+{
+  char szValue[32];
+
+  for (auto& item : history.series) {
+    for (auto& sample : item.second) {
+      snprintf(szValue, sizeof(szValue), "%.2f", sample.dValue);
+      sOutput += std::to_string(sample.nTimestamp) + "," + szType + "," + sID + "," + item.first + "," + szValue + "\n";
+    }
+  }
+}
+
+}
+
+cLogSeriesSummary GetLogSeriesSummary(const std::vector<cLogSample>& samples)
+{
+  cLogSeriesSummary summary;
+  if (samples.empty()) return summary;
+
+  summary.nSamples = samples.size();
+  summary.nFirstTimestamp = samples.front().nTimestamp;
+  summary.nLastTimestamp = samples.back().nTimestamp;
+  summary.dFirst = samples.front().dValue;
+  summary.dLast = samples.back().dValue;
+  summary.dMin = samples.front().dValue;
+  summary.dMax = samples.front().dValue;
+
+  for (size_t i = 1; i < samples.size(); i++) {
+    const double dPrevious = samples[i - 1].dValue;
+    const double dValue = samples[i].dValue;
+    summary.dMin = std::min(summary.dMin, dValue);
+    summary.dMax = std::max(summary.dMax, dValue);
+
+    if (dValue >= dPrevious) {
+      summary.dGrowth += dValue - dPrevious;
+    } else {
+      // The counter started again from zero
+      summary.dGrowth += dValue;
+      summary.nResets++;
+    }
+  }
+
+  return summary;
+}
+
+bool ParseSyslogTimestamp(std::string_view line, time_t reference, int64_t& nTimestamp)
+{
+  if (line.empty()) return false;
+
+  // An RFC 5424 line starts with the priority and version, "<134>1 2026-10-19T08:15:02..."
+  if (line[0] == '<') {
+    const size_t nSpace = line.find(' ');
+    if (nSpace == std::string_view::npos) return false;
+    line.remove_prefix(nSpace + 1);
+  }
+
+  if ((line.size() >= 20) && (line[0] >= '0') && (line[0] <= '9')) {
+    return ParseRFC3339Timestamp(line, nTimestamp);
+  }
+
+  return ParseBSDTimestamp(line, reference, nTimestamp);
+}
+
+cLogAnalyzer::cLogAnalyzer() :
+  cachedReference(0),
+  nCachedHourTimestamp(0),
+  nRecordDrives(0)
+{
+}
+
+cLogAnalyzer::~cLogAnalyzer()
+{
+}
+
+bool cLogAnalyzer::AnalyzeFile(const std::string& sFilePath)
+{
+  const int fd = open(sFilePath.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    std::cerr<<"Failed to open log file \""<<sFilePath<<"\", error: "<<strerror(errno)<<std::endl;
+    syslog(LOG_ERR, "Failed to open log file \"%s\", error: %s", sFilePath.c_str(), strerror(errno));
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    std::cerr<<"Failed to stat log file \""<<sFilePath<<"\", error: "<<strerror(errno)<<std::endl;
+    syslog(LOG_ERR, "Failed to stat log file \"%s\", error: %s", sFilePath.c_str(), strerror(errno));
+    close(fd);
+    return false;
+  }
+
+  const time_t reference = st.st_mtime;
+
+  if (EndsWith(sFilePath, ".gz")) {
+    // zlib takes over the file descriptor
+    gzFile file = gzdopen(fd, "rb");
+    if (file == nullptr) {
+      std::cerr<<"Failed to open compressed log file \""<<sFilePath<<"\""<<std::endl;
+      syslog(LOG_ERR, "Failed to open compressed log file \"%s\"", sFilePath.c_str());
+      close(fd);
+      return false;
+    }
+
+    gzbuffer(file, 256 * 1024);
+
+    // Decompress a chunk at a time, a line that is cut off at the end of a chunk is carried over to the start of the next one
+    std::vector<char> buffer(GZIP_CHUNK_BYTES);
+    size_t nCarried = 0;
+    bool result = true;
+    while (true) {
+      if (nCarried == buffer.size()) {
+        // A single line longer than the buffer
+        buffer.resize(buffer.size() * 2);
+      }
+
+      const int nRead = gzread(file, buffer.data() + nCarried, unsigned(buffer.size() - nCarried));
+      if (nRead < 0) {
+        int nError = 0;
+        const char* szError = gzerror(file, &nError);
+        std::cerr<<"Failed to decompress log file \""<<sFilePath<<"\", error: "<<szError<<std::endl;
+        syslog(LOG_ERR, "Failed to decompress log file \"%s\", error: %s", sFilePath.c_str(), szError);
+        result = false;
+        break;
+      } else if (nRead == 0) {
+        break;
+      }
+
+      const size_t nAvailable = nCarried + size_t(nRead);
+      const char* pLastNewLine = static_cast<const char*>(memrchr(buffer.data(), '\n', nAvailable));
+      if (pLastNewLine == nullptr) {
+        nCarried = nAvailable;
+        continue;
+      }
+
+      const size_t nComplete = size_t(pLastNewLine - buffer.data()) + 1;
+      AnalyzeBuffer(std::string_view(buffer.data(), nComplete), reference);
+
+      nCarried = nAvailable - nComplete;
+      memmove(buffer.data(), buffer.data() + nComplete, nCarried);
+    }
+
+    if (result && (nCarried != 0)) {
+      // The last line didn't end with a new line
+      AnalyzeBuffer(std::string_view(buffer.data(), nCarried), reference);
+    }
+
+    gzclose(file);
+
+    if (result) analysis.nFiles++;
+    return result;
+  }
+
+  if (st.st_size != 0) {
+    const size_t nSize = size_t(st.st_size);
+    void* pData = mmap(nullptr, nSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (pData == MAP_FAILED) {
+      std::cerr<<"Failed to map log file \""<<sFilePath<<"\", error: "<<strerror(errno)<<std::endl;
+      syslog(LOG_ERR, "Failed to map log file \"%s\", error: %s", sFilePath.c_str(), strerror(errno));
+      close(fd);
+      return false;
+    }
+
+    // The file is read once from start to end, so the kernel can read ahead aggressively and drop pages behind us
+    madvise(pData, nSize, MADV_SEQUENTIAL);
+
+    AnalyzeBuffer(std::string_view(static_cast<const char*>(pData), nSize), reference);
+
+    munmap(pData, nSize);
+  }
+
+  close(fd);
+
+  analysis.nFiles++;
+  return true;
+}
+
+void cLogAnalyzer::AnalyzeBuffer(std::string_view data, time_t reference)
+{
+  analysis.nBytes += data.size();
+
+  const char* pData = data.data();
+  const size_t nSize = data.size();
+
+  // Most lines aren't ours, and an '@' is rare in other log lines, so jump from one '@' to the next with memchr, which glibc vectorises, and only look at the line around it
+  size_t nPosition = 0;
+  while (nPosition < nSize) {
+    const char* pAt = static_cast<const char*>(memchr(pData + nPosition, '@', nSize - nPosition));
+    if (pAt == nullptr) break;
+
+    const size_t nAt = size_t(pAt - pData);
+    nPosition = nAt + 1;
+
+    if (
+      (nAt < JSON_MARKER_BEFORE_LENGTH) || ((nAt + 1 + JSON_MARKER_AFTER_LENGTH) > nSize) ||
+      (memcmp(pAt - JSON_MARKER_BEFORE_LENGTH, JSON_MARKER_BEFORE, JSON_MARKER_BEFORE_LENGTH) != 0) || (memcmp(pAt + 1, JSON_MARKER_AFTER, JSON_MARKER_AFTER_LENGTH) != 0)
+    ) {
+      continue;
+    }
+
+    const char* pLineStart = static_cast<const char*>(memrchr(pData, '\n', nAt));
+    const size_t nLineStart = (pLineStart == nullptr) ? 0 : (size_t(pLineStart - pData) + 1);
+    const char* pLineEnd = static_cast<const char*>(memchr(pAt, '\n', nSize - nAt));
+    const size_t nLineEnd = (pLineEnd == nullptr) ? nSize : size_t(pLineEnd - pData);
+
+    nPosition = nLineEnd;
+
+    // Only the mount and btrfs records have counters in them, events and the collection stats are skipped
+    const std::string_view prefix = data.substr(nLineStart, nAt - JSON_MARKER_BEFORE_LENGTH - nLineStart);
+    const bool bIsDrive = EndsWith(prefix, DRIVE_STATS_SUFFIX);
+    const bool bIsBtrfs = EndsWith(prefix, BTRFS_STATS_SUFFIX);
+    if (!bIsDrive && !bIsBtrfs) continue;
+
+    const size_t nJSONStart = nAt + 1 + JSON_MARKER_AFTER_LENGTH;
+    std::string_view json = data.substr(nJSONStart, nLineEnd - nJSONStart);
+    while (!json.empty() && ((json.back() == '\r') || (json.back() == ' '))) json.remove_suffix(1);
+
+    AnalyzeRecord(data.substr(nLineStart, nLineEnd - nLineStart), json, bIsBtrfs, reference);
+  }
+}
+
+int64_t cLogAnalyzer::GetTimestamp(std::string_view line, time_t reference)
+{
+  // Traditional timestamps need mktime, which is slow, but the offset from UTC only changes on the hour so it is only called once for each hour of the log
+  int minute = 0;
+  int second = 0;
+  const bool bIsBSD = (line.size() >= 15) && (line[0] >= 'A') && (line[0] <= 'Z') && (line[9] == ':') && (line[12] == ':') && ParseDigits(line, 10, 2, minute) && ParseDigits(line, 13, 2, second);
+  if (bIsBSD && (reference == cachedReference) && (line.substr(0, 9) == sCachedHour)) {
+    return nCachedHourTimestamp + (int64_t(minute) * 60) + second;
+  }
+
+  int64_t nTimestamp = 0;
+  if (!ParseSyslogTimestamp(line, reference, nTimestamp)) return 0;
+
+  if (bIsBSD) {
+    sCachedHour.assign(line.substr(0, 9));
+    cachedReference = reference;
+    nCachedHourTimestamp = nTimestamp - ((int64_t(minute) * 60) + second);
+  }
+
+  return nTimestamp;
+}
+
+bool cLogAnalyzer::ReadRecord(std::string_view json)
+{
+  sRecordMountPoint.clear();
+  recordFields.clear();
+  nRecordDrives = 0;
+
+  cRecordReader reader(json);
+  std::string sKeyBuffer;
+  std::string sValueBuffer;
+  std::string_view key;
+  std::string_view sValue;
+  cRecordReader::VALUE type = cRecordReader::VALUE::OTHER;
+  double dValue = 0.0;
+  bool bValue = false;
+
+  if (!reader.Consume('{')) return false;
+
+  bool bIsFirst = true;
+  while (!reader.Consume('}')) {
+    if ((!bIsFirst && !reader.Consume(',')) || !reader.ReadString(key, sKeyBuffer) || !reader.Consume(':')) return false;
+    bIsFirst = false;
+
+    if (key == "drives") {
+      if (!reader.Consume('[')) return false;
+
+      bool bIsFirstDrive = true;
+      while (!reader.Consume(']')) {
+        if ((!bIsFirstDrive && !reader.Consume(',')) || !reader.Consume('{')) return false;
+        bIsFirstDrive = false;
+
+        if (recordDrives.size() <= nRecordDrives) recordDrives.resize(nRecordDrives + 1);
+        cRecordDrive& drive = recordDrives[nRecordDrives];
+        drive.sPath.clear();
+        drive.sName.clear();
+        drive.bIsPresent = true;
+
+        bool bIsFirstField = true;
+        while (!reader.Consume('}')) {
+          if ((!bIsFirstField && !reader.Consume(',')) || !reader.ReadString(key, sKeyBuffer) || !reader.Consume(':') || !reader.ReadValue(type, dValue, bValue, sValue, sValueBuffer)) return false;
+          bIsFirstField = false;
+
+          // None of our counter names need escaping, a key that did would point into the buffer that the next key overwrites
+          if ((type == cRecordReader::VALUE::NUMBER) && (key.data() != sKeyBuffer.data())) recordFields.push_back({ nRecordDrives, key, dValue });
+          else if ((type == cRecordReader::VALUE::STRING) && (key == "path")) drive.sPath = sValue;
+          else if ((type == cRecordReader::VALUE::STRING) && (key == "name")) drive.sName = sValue;
+          else if ((type == cRecordReader::VALUE::BOOLEAN) && (key == "present")) drive.bIsPresent = bValue;
+        }
+
+        nRecordDrives++;
+      }
+    } else {
+      if (!reader.ReadValue(type, dValue, bValue, sValue, sValueBuffer)) return false;
+
+      if ((type == cRecordReader::VALUE::NUMBER) && (key.data() != sKeyBuffer.data())) recordFields.push_back({ SIZE_MAX, key, dValue });
+      else if ((type == cRecordReader::VALUE::STRING) && (key == "mountPoint")) sRecordMountPoint = sValue;
+    }
+  }
+
+  return reader.IsAtEnd() && !sRecordMountPoint.empty();
+}
+
+void cLogAnalyzer::AnalyzeRecord(std::string_view line, std::string_view json, bool bIsBtrfs, time_t reference)
+{
+  if (!ReadRecord(json)) {
+    analysis.nInvalidRecords++;
+    return;
+  }
+
+  const int64_t nTimestamp = GetTimestamp(line, reference);
+
+  // Look up each drive once rather than for every field
+  cLogHistory* pMountHistory = nullptr;
+  if (!bIsBtrfs) {
+    pMountHistory = &GetHistory(analysis.mounts, sRecordMountPoint);
+    pMountHistory->sName = sRecordMountPoint;
+    pMountHistory->sMountPoint = sRecordMountPoint;
+  }
+
+  for (size_t i = 0; i < nRecordDrives; i++) {
+    cRecordDrive& drive = recordDrives[i];
+    drive.pHistory = nullptr;
+
+    // A missing drive has no stats
+    if (drive.sPath.empty() || !drive.bIsPresent) continue;
+
+    drive.pHistory = &GetHistory(analysis.drives, drive.sPath);
+    if (!drive.sName.empty()) drive.pHistory->sName = drive.sName;
+    drive.pHistory->sMountPoint = sRecordMountPoint;
+  }
+
+  for (auto& field : recordFields) {
+    cLogHistory* pHistory = (field.nDrive == SIZE_MAX) ? pMountHistory : recordDrives[field.nDrive].pHistory;
+    if (pHistory != nullptr) GetSeries(*pHistory, field.sName).push_back(cLogSample(nTimestamp, field.dValue));
+  }
+
+  analysis.nRecords++;
+}
+
+void cLogAnalyzer::Finish()
+{
+  const auto compare = [](const cLogSample& lhs, const cLogSample& rhs) { return (lhs.nTimestamp < rhs.nTimestamp); };
+
+  for (auto& mount : analysis.mounts) {
+    for (auto& item : mount.second.series) std::stable_sort(item.second.begin(), item.second.end(), compare);
+  }
+
+  for (auto& drive : analysis.drives) {
+    for (auto& item : drive.second.series) std::stable_sort(item.second.begin(), item.second.end(), compare);
+  }
+}
+
+std::string GetJSONLogAnalysis(const cLogAnalysis& analysis)
+{
+  json_object* root = json_object_new_object();
+  if (root == nullptr) return "";
+
+  json_object_object_add(root, "files", json_object_new_int64(int64_t(analysis.nFiles)));
+  json_object_object_add(root, "bytes", json_object_new_int64(int64_t(analysis.nBytes)));
+  json_object_object_add(root, "records", json_object_new_int64(int64_t(analysis.nRecords)));
+  json_object_object_add(root, "invalidRecords", json_object_new_int64(int64_t(analysis.nInvalidRecords)));
+
+  json_object* mounts = json_object_new_array();
+  for (auto& item : analysis.mounts) {
+    json_object* mount = json_object_new_object();
+    json_object_object_add(mount, "mountPoint", json_object_new_string(item.first.c_str()));
+    json_object_object_add(mount, "counters", CreateJSONLogHistory(item.second));
+    json_object_array_add(mounts, mount);
+  }
+  json_object_object_add(root, "mounts", mounts);
+
+  json_object* drives = json_object_new_array();
+  for (auto& item : analysis.drives) {
+    json_object* drive = json_object_new_object();
+    json_object_object_add(drive, "name", json_object_new_string(item.second.sName.c_str()));
+    json_object_object_add(drive, "path", json_object_new_string(item.first.c_str()));
+    json_object_object_add(drive, "mountPoint", json_object_new_string(item.second.sMountPoint.c_str()));
+    json_object_object_add(drive, "counters", CreateJSONLogHistory(item.second));
+    json_object_array_add(drives, drive);
+  }
+  json_object_object_add(root, "drives", drives);
+
+  const std::string json_output = json_object_to_json_string_ext(root, JSON_C_TO_STRING_PRETTY);
+
+  // Clean up
+  json_object_put(root);
+
+  return json_output + "\n";
+}
+
+std::string GetCSVLogAnalysis(const cLogAnalysis& analysis)
+{
+  std::string sOutput = "timestamp,type,id,counter,value\n";
+
+  for (auto& item : analysis.mounts) AppendCSVLogHistory("mount", item.first, item.second, sOutput);
+  for (auto& item : analysis.drives) AppendCSVLogHistory("drive", item.first, item.second, sOutput);
+
+  return sOutput;
+}
+
+}
@@ -0,0 +1,216 @@
+#include <cerrno>
+#include <cstring>
+
+#include <atomic>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "low_impact.h"
+
+namespace lumberjill {
+
+namespace {
+
+// From linux/ioprio.h, which older kernel headers don't have
+const int IOPRIO_WHO_PROCESS_VALUE = 1;
+const int IOPRIO_CLASS_IDLE_VALUE = 3;
+const int IOPRIO_CLASS_SHIFT_VALUE = 13;
+const int IOPRIO_IDLE = (IOPRIO_CLASS_IDLE_VALUE << IOPRIO_CLASS_SHIFT_VALUE);
+
+std::atomic<const cLowImpact*> g_pChildProcessLowImpact(nullptr);
+
+int GetIOPriority()
+{
+  return int(syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS_VALUE, 0));
+}
+
+bool SetIOPriority(int nIOPriority)
+{
+  return (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS_VALUE, 0, nIOPriority) == 0);
+}
+
+// Write a short string to a cgroup or sysfs file in a single write call, which is what the kernel expects
+bool WriteSmallFile(const std::string& sFilePath, const std::string& contents)
+{
+  const int fd = open(sFilePath.c_str(), O_WRONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+
+  const ssize_t len = write(fd, contents.c_str(), contents.length());
+  const int error_code = errno;
+  close(fd);
+
+  errno = error_code;
+  return (len == ssize_t(contents.length()));
+}
+
+}
+
+cIdleIOPriority::cIdleIOPriority() :
+  nPreviousIOPriority(GetIOPriority())
+{
+  if (!SetIOPriority(IOPRIO_IDLE)) {
+    syslog(LOG_WARNING, "lumber-jill Unable to set idle I/O priority: %s", strerror(errno));
+  }
+}
+
+cIdleIOPriority::~cIdleIOPriority()
+{
+  if (nPreviousIOPriority >= 0) {
+    SetIOPriority(nPreviousIOPriority);
+  }
+}
+
+
+cLowImpact::cLowImpact() :
+  bEnabled(false),
+  bSchedIdle(false),
+  nNice(0),
+  bRestrictCPUs(false)
+{
+  CPU_ZERO(&cpus);
+}
+
+cLowImpact::~cLowImpact()
+{
+}
+
+bool cLowImpact::Prepare(const cLowImpactSettings& settings)
+{
+  bEnabled = settings.bEnabled;
+  bSchedIdle = settings.bSchedIdle;
+  nNice = int(settings.nNice);
+
+  CPU_ZERO(&cpus);
+  bRestrictCPUs = false;
+  for (const size_t cpu : settings.cpus) {
+    if (cpu >= CPU_SETSIZE) {
+      std::cerr<<"cLowImpact::Prepare Invalid CPU "<<cpu<<std::endl;
+      syslog(LOG_ERR, "cLowImpact::Prepare Invalid CPU %zu", cpu);
+      return false;
+    }
+
+    CPU_SET(cpu, &cpus);
+    bRestrictCPUs = true;
+  }
+
+  sCgroupProcsFilePath.clear();
+
+  if (!bEnabled || settings.sCgroupPath.empty()) {
+    return true;
+  }
+
+  // Create our cgroup, the io controller has to be enabled in the parent for io.max to exist
+  if ((mkdir(settings.sCgroupPath.c_str(), 0755) != 0) && (errno != EEXIST)) {
+    std::cerr<<"cLowImpact::Prepare Error creating cgroup \""<<settings.sCgroupPath<<"\": "<<strerror(errno)<<std::endl;
+    syslog(LOG_ERR, "cLowImpact::Prepare Error creating cgroup \"%s\": %s", settings.sCgroupPath.c_str(), strerror(errno));
+    return false;
+  }
+
+  if (!settings.ioMax.empty()) {
+    const std::string sParentFolder = settings.sCgroupPath.substr(0, settings.sCgroupPath.find_last_of('/'));
+    if (!WriteSmallFile(sParentFolder + "/cgroup.subtree_control", "+io")) {
+      syslog(LOG_WARNING, "cLowImpact::Prepare Unable to enable the io controller in \"%s\": %s", sParentFolder.c_str(), strerror(errno));
+    }
+
+    for (auto& sLine : settings.ioMax) {
+      if (!WriteSmallFile(settings.sCgroupPath + "/io.max", sLine)) {
+        std::cerr<<"cLowImpact::Prepare Error writing io.max \""<<sLine<<"\": "<<strerror(errno)<<std::endl;
+        syslog(LOG_ERR, "cLowImpact::Prepare Error writing io.max \"%s\": %s", sLine.c_str(), strerror(errno));
+        return false;
+      }
+    }
+  }
+
+  sCgroupProcsFilePath = settings.sCgroupPath + "/cgroup.procs";
+  return true;
+}
+
+bool cLowImpact::ApplyPriorityAndAffinity(int& error_code) const
+{
+  // NOTE: This is called between fork and exec so it must only make system calls
+  error_code = 0;
+
+  if (!SetIOPriority(IOPRIO_IDLE)) {
+    error_code = errno;
+    return false;
+  }
+
+  if (bSchedIdle) {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    if (sched_setscheduler(0, SCHED_IDLE, &param) != 0) {
+      error_code = errno;
+      return false;
+    }
+  }
+
+  if ((nNice != 0) && (setpriority(PRIO_PROCESS, 0, nNice) != 0)) {
+    error_code = errno;
+    return false;
+  }
+
+  if (bRestrictCPUs && (sched_setaffinity(0, sizeof(cpus), &cpus) != 0)) {
+    error_code = errno;
+    return false;
+  }
+
+  return true;
+}
+
+bool cLowImpact::ApplyToCurrentProcess() const
+{
+  if (!bEnabled) {
+    return true;
+  }
+
+  int error_code = 0;
+  if (!ApplyPriorityAndAffinity(error_code)) {
+    std::cerr<<"cLowImpact::ApplyToCurrentProcess Error: "<<strerror(error_code)<<std::endl;
+    syslog(LOG_ERR, "cLowImpact::ApplyToCurrentProcess Error: %s", strerror(error_code));
+    return false;
+  }
+
+  return true;
+}
+
+void cLowImpact::ApplyToChildProcess() const
+{
+  if (!bEnabled) {
+    return;
+  }
+
+  // We can't report errors from here, the child still runs, just with less restrictions
+  int error_code = 0;
+  ApplyPriorityAndAffinity(error_code);
+
+  // Writing 0 to cgroup.procs moves the writing process
+  if (!sCgroupProcsFilePath.empty()) {
+    const int fd = open(sCgroupProcsFilePath.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd >= 0) {
+      const ssize_t len = write(fd, "0", 1);
+      (void)len;
+      close(fd);
+    }
+  }
+}
+
+
+void SetChildProcessLowImpact(const cLowImpact* pLowImpact)
+{
+  g_pChildProcessLowImpact = pLowImpact;
+}
+
+const cLowImpact* GetChildProcessLowImpact()
+{
+  return g_pChildProcessLowImpact;
+}
+
+}
@@ -3,18 +3,26 @@
 #include <cstdint>
 #include <cstring>
 
+#include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <filesystem>
-
-#include <sys/statvfs.h>
+#include <optional>
+#include <system_error>
+#include <vector>
 
 #include <syslog.h>
 
-#include "btrfs.h"
-#include "run_command.h"
+#include "collector.h"
+#include "daemon.h"
+#include "log_analyzer.h"
+#include "low_impact.h"
+#include "output.h"
+#include "query_server.h"
+#include "result_cache.h"
 #include "settings.h"
-#include "smartctl.h"
+#include "topology.h"
 #include "utils.h"
 
 namespace lumberjill {
@@ -30,13 +38,23 @@ void PrintVersion()
 void PrintUsage()
 {
   std::cout<<"Usage:"<<std::endl;
-  std::cout<<"lumber-jill [-v|--v|--version] [-h|--h|--help]"<<std::endl;
+  std::cout<<"lumber-jill [-v|--v|--version] [-h|--h|--help] [-s|--settings <settings.json>] [-d|--daemon] [-q|--query snapshot|<device path>] [-f|--format json|openmetrics|csv] [-m|--max-age <seconds>] [-a|--analyze <log file> ...]"<<std::endl;
   std::cout<<"-v|--v|--version:\tPrint the version information"<<std::endl;
   std::cout<<"-h|--h|--help:\tPrint this usage information"<<std::endl;
+  std::cout<<"-s|--settings:\tLoad the settings from this file instead of ~/.config/lumber-jill/settings.json"<<std::endl;
+  std::cout<<"-d|--daemon:\tKeep running, collecting at the daemon interval and straight away when a drive is added or removed"<<std::endl;
+  std::cout<<"-q|--query:\tPrint the latest stats from the running daemon, for every group or for a single device"<<std::endl;
+  std::cout<<"-f|--format:\tThe format for --query, json (The default) or openmetrics, or for --analyze, json (The default) or csv"<<std::endl;
+  std::cout<<"-m|--max-age:\tReuse smartctl results that another run collected within this many seconds, cached in "<<lumberjill::RESULT_CACHE_FOLDER<<std::endl;
+  std::cout<<"-a|--analyze:\tRead the drive and btrfs stats records in these syslog files, plain or .gz, and print how each counter changed over time"<<std::endl;
   std::cout<<std::endl;
   std::cout<<"Example settings.json file"<<std::endl;
   std::cout<<"{"<<std::endl;
   std::cout<<"  \"settings\": {"<<std::endl;
+  std::cout<<"    \"tools\": {"<<std::endl;
+  std::cout<<"      \"smartctl\": \"/usr/sbin/smartctl\","<<std::endl;
+  std::cout<<"      \"btrfs\": \"/usr/sbin/btrfs\""<<std::endl;
+  std::cout<<"    },"<<std::endl;
   std::cout<<"    \"groups\": ["<<std::endl;
   std::cout<<"      {"<<std::endl;
   std::cout<<"        \"type\": \"single\","<<std::endl;
@@ -61,69 +79,12 @@ void PrintUsage()
   std::cout<<"}"<<std::endl;
 }
 
-bool GetMountTotalAndFreeSpace(const std::string& sMountPoint, cMountStats& outStats)
-{
-  outStats.ClearSpaceStats();
-
-  // Something similar to "df -h /data1"
-  // https://stackoverflow.com/questions/1449055/disk-space-used-free-total-how-do-i-get-this-in-c
-
-  struct statvfs data;
-  const int result = statvfs(sMountPoint.c_str(), &data);
-  if (result < 0 ) {
-    return false;
-  }
-
-
-  outStats.nTotalBytes = data.f_bsize * data.f_blocks;
-  outStats.nFreeBytes = data.f_bsize * data.f_bfree;
-  return true;
-}
-
-bool IsDrivePresent(const std::string& sDevicePath)
-{
-  const std::filesystem::path p(sDevicePath);
-  return std::filesystem::exists(p);
 }
 
-bool QueryAndLogGroups(const cSettings& settings)
-{
-  bool result = true;
-
-  for (auto& group : settings.GetGroups()) {
-    // Get mount usage stats
-    cMountStats mountStats;
-    mountStats.sMountPoint = group.sMountPoint;
-    GetMountTotalAndFreeSpace(group.sMountPoint, mountStats);
-
-    // Now check each drive
-    for (auto& device : group.devices) {
-      cDriveStats deviceStats;
-      deviceStats.sName = device.sName;
-      deviceStats.bIsPresent = IsDrivePresent(device.sPath);
+namespace {
 
-      smartctl::GetDriveSmartControlData(device.sPath, deviceStats.smartCtlStats);
-
-      mountStats.mapDrivePathToDriveStats[device.sPath] = deviceStats;
-    }
-
-    // Log output
-    if (group.type == GROUP_TYPE::BTRFS) {
-      // For BTRFS mounts we can print out additional stats
-      cBtrfsVolumeStats btrfsVolumeStats;
-      btrfs::GetBtrfsVolumeDeviceStats(group.sMountPoint, group.devices, btrfsVolumeStats);
-
-      // Log BTRFS output
-      if (!LogStatsToSyslogMountStatsAndBtrfsStats(mountStats, btrfsVolumeStats)) {
-        result = false;
-      }
-    } else if (!LogStatsToSyslogMountStats(mountStats)) {
-      result = false;
-    }
-  }
-
-  return result;
-}
+// Long enough for another run to finish a whole collection, but a run that is stuck won't hold up the rest forever
+const std::chrono::milliseconds RESULT_CACHE_LOCK_TIMEOUT(10 * 60 * 1000);
 
 }
 
@@ -131,13 +92,56 @@ int main(int argc, char **argv)
 {
   openlog(nullptr, LOG_PID | LOG_CONS, LOG_USER | LOG_LOCAL0);
 
+  std::string sSettingsFilePath;
+  bool bIsDaemon = false;
+  bool bIsQuery = false;
+  std::optional<uint64_t> nMaxAgeSeconds;
+  lumberjill::cQueryRequest queryRequest;
+  std::vector<std::string> analyzeFilePaths;
+  bool bIsCSV = false;
+
   if (argc >= 2) {
+    bool bPrintedInformation = false;
+
     for (size_t i = 1; i < size_t(argc); i++) {
       if (argv[i] != nullptr) {
         const std::string sAction = argv[i];
-        if ((sAction == "-v") || (sAction == "-version") || (sAction == "--version")) lumberjill::PrintVersion();
-        else if ((sAction == "-h") || (sAction == "-help") || (sAction == "--help")) lumberjill::PrintUsage();
-        else {
+        if ((sAction == "-v") || (sAction == "-version") || (sAction == "--version")) {
+          lumberjill::PrintVersion();
+          bPrintedInformation = true;
+        } else if ((sAction == "-h") || (sAction == "-help") || (sAction == "--help")) {
+          lumberjill::PrintUsage();
+          bPrintedInformation = true;
+        } else if ((sAction == "-d") || (sAction == "-daemon") || (sAction == "--daemon")) {
+          bIsDaemon = true;
+        } else if (((sAction == "-s") || (sAction == "-settings") || (sAction == "--settings")) && ((i + 1) < size_t(argc)) && (argv[i + 1] != nullptr)) {
+          i++;
+          sSettingsFilePath = argv[i];
+        } else if (((sAction == "-q") || (sAction == "-query") || (sAction == "--query")) && ((i + 1) < size_t(argc)) && (argv[i + 1] != nullptr)) {
+          i++;
+          bIsQuery = true;
+          const std::string sWhat = argv[i];
+          if (sWhat != "snapshot") queryRequest.sDevicePath = sWhat;
+        } else if (((sAction == "-f") || (sAction == "-format") || (sAction == "--format")) && ((i + 1) < size_t(argc)) && (argv[i + 1] != nullptr) && ((strcmp(argv[i + 1], "json") == 0) || (strcmp(argv[i + 1], "openmetrics") == 0) || (strcmp(argv[i + 1], "csv") == 0))) {
+          i++;
+          queryRequest.format = (strcmp(argv[i], "openmetrics") == 0) ? lumberjill::QUERY_FORMAT::OPENMETRICS : lumberjill::QUERY_FORMAT::JSON;
+          bIsCSV = (strcmp(argv[i], "csv") == 0);
+        } else if (((sAction == "-m") || (sAction == "-max-age") || (sAction == "--max-age")) && ((i + 1) < size_t(argc)) && (argv[i + 1] != nullptr)) {
+          i++;
+          size_t value = 0;
+          if (!lumberjill::StringParseValue(argv[i], value)) {
+            std::cerr<<"Invalid --max-age \""<<argv[i]<<"\", exiting"<<std::endl;
+            syslog(LOG_ERR, "Invalid --max-age \"%s\", exiting", argv[i]);
+            return -1;
+          }
+          nMaxAgeSeconds = uint64_t(value);
+        } else if (((sAction == "-a") || (sAction == "-analyze") || (sAction == "--analyze")) && ((i + 1) < size_t(argc)) && (argv[i + 1] != nullptr) && (argv[i + 1][0] != '-')) {
+          // Every following parameter up to the next option is a log file
+          while (((i + 1) < size_t(argc)) && (argv[i + 1] != nullptr) && (argv[i + 1][0] != '-')) {
+            i++;
+            analyzeFilePaths.push_back(argv[i]);
+          }
+        } else {
           std::cerr<<"Unknown command line parameter \""<<sAction<<"\", exiting"<<std::endl;
           syslog(LOG_ERR, "Unknown command line parameter \"%s\", exiting", sAction.c_str());
           lumberjill::PrintUsage();
@@ -146,19 +150,53 @@ int main(int argc, char **argv)
       }
     }
 
-    return 0;
+    if (bPrintedInformation) {
+      return 0;
+    }
+
+    // Each format is only supported by one of the modes, don't silently print JSON instead
+    if (bIsCSV && analyzeFilePaths.empty()) {
+      std::cerr<<"--format csv is only supported with --analyze, exiting"<<std::endl;
+      syslog(LOG_ERR, "--format csv is only supported with --analyze, exiting");
+      lumberjill::PrintUsage();
+      return -1;
+    } else if ((queryRequest.format == lumberjill::QUERY_FORMAT::OPENMETRICS) && (!bIsQuery || !analyzeFilePaths.empty())) {
+      std::cerr<<"--format openmetrics is only supported with --query, exiting"<<std::endl;
+      syslog(LOG_ERR, "--format openmetrics is only supported with --query, exiting");
+      lumberjill::PrintUsage();
+      return -1;
+    }
   }
 
-  const std::string sConfigFolder = lumberjill::GetConfigFolder("lumber-jill");
-  if (sConfigFolder.empty()) {
-    std::cerr<<"lumber-jill Failed to get config folder for lumber-jill, exiting"<<std::endl;
-    syslog(LOG_ERR, "lumber-jill Failed to get config folder for lumber-jill, exiting");
-    return EXIT_FAILURE;
+  // Analyzing old logs doesn't need the settings or any of the tools
+  if (!analyzeFilePaths.empty()) {
+    bool result = true;
+    lumberjill::cLogAnalyzer analyzer;
+    for (auto& sFilePath : analyzeFilePaths) {
+      if (!analyzer.AnalyzeFile(sFilePath)) result = false;
+    }
+
+    analyzer.Finish();
+
+    std::cout<<(bIsCSV ? lumberjill::GetCSVLogAnalysis(analyzer.GetAnalysis()) : lumberjill::GetJSONLogAnalysis(analyzer.GetAnalysis()));
+    closelog();
+
+    return (result ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
+  if (sSettingsFilePath.empty()) {
+    const std::string sConfigFolder = lumberjill::GetConfigFolder("lumber-jill");
+    if (sConfigFolder.empty()) {
+      std::cerr<<"lumber-jill Failed to get config folder for lumber-jill, exiting"<<std::endl;
+      syslog(LOG_ERR, "lumber-jill Failed to get config folder for lumber-jill, exiting");
+      return EXIT_FAILURE;
+    }
+
+    // Something like /root/.config/lumber-jill/settings.json
+    sSettingsFilePath = sConfigFolder + "/settings.json";
   }
 
   // Read the configuration
-  // Something like /root/.config/lumber-jill/settings.json
-  const std::string sSettingsFilePath = sConfigFolder + "/settings.json";
   lumberjill::cSettings settings;
   if (!settings.LoadFromFile(sSettingsFilePath)) {
     std::cerr<<"lumber-jill Failed to load JSON configuration from \""<<sSettingsFilePath<<"\", exiting"<<std::endl;
@@ -166,7 +204,100 @@ int main(int argc, char **argv)
     return EXIT_FAILURE;
   }
 
-  const bool result = lumberjill::QueryAndLogGroups(settings);
+  // Ask the running daemon for its latest stats instead of collecting them ourselves
+  if (bIsQuery) {
+    std::string sResponse;
+    const bool result = lumberjill::QueryDaemon(settings.GetQuerySettings().sSocketPath, queryRequest, sResponse);
+    std::cout<<sResponse;
+    closelog();
+
+    return (result ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
+  // The daemon handles SIGINT and SIGTERM through its event loop, they have to be blocked before any thread is started so that none of them gets the signal instead
+  if (bIsDaemon && !lumberjill::BlockDaemonSignals()) {
+    syslog(LOG_ERR, "lumber-jill Failed to block signals, exiting");
+    closelog();
+    return EXIT_FAILURE;
+  }
+
+  // Drop our priority before starting any threads so that they inherit it, child processes get it applied again between fork and exec
+  lumberjill::cLowImpact lowImpact;
+  if (settings.GetLowImpactSettings().bEnabled) {
+    if (!lowImpact.Prepare(settings.GetLowImpactSettings())) {
+      std::cerr<<"lumber-jill Failed to prepare low impact mode, continuing"<<std::endl;
+      syslog(LOG_WARNING, "lumber-jill Failed to prepare low impact mode, continuing");
+    }
+
+    lowImpact.ApplyToCurrentProcess();
+    lumberjill::SetChildProcessLowImpact(&lowImpact);
+  }
+
+  // Log records are written by their own thread so that a slow syslog doesn't hold up a collection
+  lumberjill::cOutputPipeline outputPipeline;
+  if (outputPipeline.Start(settings.GetOutputSettings())) {
+    lumberjill::SetOutputPipeline(&outputPipeline);
+  } else {
+    std::cerr<<"lumber-jill Failed to start the output pipeline, logging synchronously"<<std::endl;
+    syslog(LOG_WARNING, "lumber-jill Failed to start the output pipeline, logging synchronously");
+  }
+
+  if (bIsDaemon) {
+    lumberjill::cDaemon daemon(settings);
+    const bool result = daemon.Run();
+
+    lumberjill::SetOutputPipeline(nullptr);
+    outputPipeline.Stop();
+
+    std::cout<<"lumber-jill Finished, exiting"<<std::endl;
+    closelog();
+
+    return (result ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
+  // Find the devices for any groups that have "devices": "auto"
+  bool result = true;
+  std::vector<lumberjill::cGroup> groups = settings.GetGroups();
+  const bool bAutoDiscoverDevices = std::any_of(groups.begin(), groups.end(), [](const lumberjill::cGroup& group) { return group.bAutoDiscoverDevices; });
+  if (bAutoDiscoverDevices) {
+    lumberjill::cTopology topology;
+    if (!topology.Scan() || !topology.ResolveGroups(settings.GetGroups(), groups)) {
+      result = false;
+    }
+  }
+
+  lumberjill::cMountQueryPool mountQueryPool;
+
+  // With a single collection the I/O stats are the averages since boot, there are no previous SMART values for drives in standby, and there is one temperature sample
+  lumberjill::cCollectorState collectorState;
+
+  // When several runs start close together the first one to get the lock collects, the others wait for it and then only collect what is still missing or stale
+  lumberjill::cResultCacheLock resultCacheLock;
+  lumberjill::cResultCache resultCache;
+  if (nMaxAgeSeconds.has_value()) {
+    std::error_code ec;
+    std::filesystem::create_directories(lumberjill::RESULT_CACHE_FOLDER, ec);
+    if (!resultCacheLock.Lock(lumberjill::RESULT_CACHE_LOCK_FILE_PATH, RESULT_CACHE_LOCK_TIMEOUT)) {
+      std::cerr<<"lumber-jill Failed to lock the result cache, collecting everything"<<std::endl;
+      syslog(LOG_WARNING, "lumber-jill Failed to lock the result cache, collecting everything");
+    } else {
+      resultCache.Load(lumberjill::RESULT_CACHE_FILE_PATH);
+      collectorState.pResultCache = &resultCache;
+      collectorState.nResultCacheMaxAgeSeconds = nMaxAgeSeconds.value();
+    }
+  }
+
+  if (!lumberjill::QueryAndLogGroups(settings, groups, mountQueryPool, collectorState)) {
+    result = false;
+  }
+
+  if (collectorState.pResultCache != nullptr) {
+    resultCache.Save(lumberjill::RESULT_CACHE_FILE_PATH);
+    resultCacheLock.Unlock();
+  }
+
+  lumberjill::SetOutputPipeline(nullptr);
+  outputPipeline.Stop();
 
   std::cout<<"lumber-jill Finished, exiting"<<std::endl;
   closelog();
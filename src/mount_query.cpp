@@ -0,0 +1,167 @@
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include <syslog.h>
+
+#include "mount_query.h"
+
+namespace lumberjill {
+
+namespace {
+
+class cMountQueryJob {
+public:
+  cMountQueryJob() : bDone(false), bResult(false), nTotalBytes(0), nFreeBytes(0) {}
+
+  std::string sMountPoint;
+
+  bool bDone;
+  bool bResult;
+  size_t nTotalBytes;
+  size_t nFreeBytes;
+};
+
+}
+
+class cMountQueryPool::cState {
+public:
+  explicit cState(StatVFSFunction _pStatVFS) : pStatVFS(_pStatVFS), nThreads(0), nIdleThreads(0), bStop(false) {}
+
+  void Run();
+
+  const StatVFSFunction pStatVFS;
+
+  mutable std::mutex mutex;
+  std::condition_variable cvJobQueued;
+  std::condition_variable cvJobDone;
+
+  std::deque<std::shared_ptr<cMountQueryJob>> queue;
+
+  // Mounts with a statvfs call queued or in progress
+  std::set<std::string> busyMounts;
+
+  size_t nThreads;
+  size_t nIdleThreads;
+  bool bStop;
+};
+
+void cMountQueryPool::cState::Run()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+
+  while (true) {
+    cvJobQueued.wait(lock, [this] { return (bStop || !queue.empty()); });
+    if (bStop) {
+      break;
+    }
+
+    std::shared_ptr<cMountQueryJob> job = queue.front();
+    queue.pop_front();
+    nIdleThreads--;
+
+    lock.unlock();
+
+    // This is the call that can block forever
+    struct statvfs data;
+    const int result = pStatVFS(job->sMountPoint.c_str(), &data);
+
+    lock.lock();
+
+    job->bDone = true;
+    job->bResult = (result >= 0);
+    if (job->bResult) {
+      job->nTotalBytes = data.f_bsize * data.f_blocks;
+      job->nFreeBytes = data.f_bsize * data.f_bfree;
+    }
+
+    busyMounts.erase(job->sMountPoint);
+    nIdleThreads++;
+
+    cvJobDone.notify_all();
+  }
+
+  nThreads--;
+  nIdleThreads--;
+}
+
+
+cMountQueryPool::cMountQueryPool() :
+  state(std::make_shared<cState>(::statvfs))
+{
+}
+
+cMountQueryPool::cMountQueryPool(StatVFSFunction pStatVFS) :
+  state(std::make_shared<cState>(pStatVFS))
+{
+}
+
+cMountQueryPool::~cMountQueryPool()
+{
+  // Idle threads exit straight away, stuck threads keep the state alive until their statvfs call returns
+  std::lock_guard<std::mutex> lock(state->mutex);
+  state->bStop = true;
+  state->cvJobQueued.notify_all();
+}
+
+MOUNT_QUERY_RESULT cMountQueryPool::GetMountTotalAndFreeSpace(const std::string& sMountPoint, std::chrono::milliseconds timeout, cMountStats& outStats)
+{
+  outStats.ClearSpaceStats();
+
+  std::shared_ptr<cMountQueryJob> job = std::make_shared<cMountQueryJob>();
+  job->sMountPoint = sMountPoint;
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+
+  // If the last call for this mount is still stuck then don't pile another thread up behind it
+  if (state->busyMounts.find(sMountPoint) != state->busyMounts.end()) {
+    std::cerr<<"lumber-jill Mount \""<<sMountPoint<<"\" is still unresponsive, skipping"<<std::endl;
+    syslog(LOG_ERR, "lumber-jill Mount \"%s\" is still unresponsive, skipping", sMountPoint.c_str());
+    return MOUNT_QUERY_RESULT::UNRESPONSIVE;
+  }
+
+  state->busyMounts.insert(sMountPoint);
+  state->queue.push_back(job);
+
+  // Start another thread if all of the existing ones are busy or stuck, this is bounded by the number of mounts
+  if (state->nIdleThreads < state->queue.size()) {
+    state->nThreads++;
+    state->nIdleThreads++;
+
+    std::shared_ptr<cState> threadState = state;
+    std::thread([threadState] { threadState->Run(); }).detach();
+  }
+
+  state->cvJobQueued.notify_one();
+
+  if (!state->cvJobDone.wait_for(lock, timeout, [&job] { return job->bDone; })) {
+    std::cerr<<"lumber-jill Mount \""<<sMountPoint<<"\" did not respond within "<<timeout.count()<<" ms"<<std::endl;
+    syslog(LOG_ERR, "lumber-jill Mount \"%s\" did not respond within %ld ms", sMountPoint.c_str(), long(timeout.count()));
+    return MOUNT_QUERY_RESULT::UNRESPONSIVE;
+  }
+
+  if (!job->bResult) {
+    return MOUNT_QUERY_RESULT::ERROR;
+  }
+
+  outStats.nTotalBytes = job->nTotalBytes;
+  outStats.nFreeBytes = job->nFreeBytes;
+  return MOUNT_QUERY_RESULT::OK;
+}
+
+bool cMountQueryPool::IsMountBusy(const std::string& sMountPoint) const
+{
+  std::lock_guard<std::mutex> lock(state->mutex);
+  return (state->busyMounts.find(sMountPoint) != state->busyMounts.end());
+}
+
+size_t cMountQueryPool::GetThreadCount() const
+{
+  std::lock_guard<std::mutex> lock(state->mutex);
+  return state->nThreads;
+}
+
+}
@@ -0,0 +1,410 @@
+#include <cerrno>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+
+#include <fcntl.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "output.h"
+
+namespace lumberjill {
+
+namespace {
+
+std::atomic<cOutputPipeline*> g_pOutputPipeline(nullptr);
+
+// The facility main opens syslog with, so that the remote collector gets the same records rsyslog used to forward
+const int REMOTE_FACILITY = LOG_USER | LOG_LOCAL0;
+
+uint64_t GetMicrosecondsSince(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+  return uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+}
+
+// Write the whole buffer, retrying short writes
+bool WriteAll(int fd, const std::string& data)
+{
+  size_t nWritten = 0;
+  while (nWritten < data.length()) {
+    const ssize_t result = write(fd, data.data() + nWritten, data.length() - nWritten);
+    if (result < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+
+    nWritten += size_t(result);
+  }
+
+  return true;
+}
+
+// The original synchronous output, used when there is no pipeline running
+bool WriteRecordNow(const cOutputRecord& record)
+{
+  const std::string json_output_single_line = record.fnGetJSON();
+
+  std::cout<<"Json output: "<<json_output_single_line<<std::endl;
+
+  if (json_output_single_line.empty()) {
+    syslog(LOG_ERR, "Error creating JSON");
+    return false;
+  }
+
+  syslog(record.nPriority, "%s json @cee: %s", record.sMessage.c_str(), json_output_single_line.c_str());
+  return true;
+}
+
+}
+
+cOutputPipeline::cOutputPipeline() :
+  fdFile(-1),
+  bRunning(false),
+  bStop(false),
+  nPushed(0),
+  nDone(0)
+{
+}
+
+cOutputPipeline::~cOutputPipeline()
+{
+  Stop();
+}
+
+bool cOutputPipeline::Start(const cOutputSettings& _settings)
+{
+  if (bRunning) return false;
+
+  settings = _settings;
+
+  sinks.clear();
+  stats = cOutputStats();
+  stats.bEnabled = true;
+
+  if (settings.bStdout) {
+    sinks.push_back(SINK::STDOUT);
+    stats.sinks.push_back(cOutputSinkStats());
+    stats.sinks.back().sName = "stdout";
+  }
+
+  if (settings.bSyslog) {
+    sinks.push_back(SINK::SYSLOG);
+    stats.sinks.push_back(cOutputSinkStats());
+    stats.sinks.back().sName = "syslog";
+  }
+
+  if (!settings.sFilePath.empty()) {
+    fdFile = open(settings.sFilePath.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0640);
+    if (fdFile < 0) {
+      const int error_code = errno;
+      std::cerr<<"lumber-jill Failed to open output file \""<<settings.sFilePath<<"\", error: "<<strerror(error_code)<<std::endl;
+      syslog(LOG_ERR, "lumber-jill Failed to open output file \"%s\", error: %s", settings.sFilePath.c_str(), strerror(error_code));
+      return false;
+    }
+
+    sinks.push_back(SINK::FILE);
+    stats.sinks.push_back(cOutputSinkStats());
+    stats.sinks.back().sName = "file";
+  }
+
+  if (settings.remote.bEnabled) {
+    remoteSink.Open(settings.remote);
+    sinks.push_back(SINK::REMOTE);
+    stats.sinks.push_back(cOutputSinkStats());
+    stats.sinks.back().sName = "remote";
+    stats.sinks.back().nSpooled = remoteSink.GetSpooledCount();
+  }
+
+  bRunning = true;
+  bStop = false;
+  thread = std::thread(&cOutputPipeline::Run, this);
+
+  return true;
+}
+
+void cOutputPipeline::Stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!bRunning) return;
+    bStop = true;
+  }
+
+  cvQueued.notify_one();
+  thread.join();
+
+  // Anything pushed between the sink thread finishing and now is written here
+  std::vector<cOutputRecord> batch;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    bRunning = false;
+    batch.assign(std::make_move_iterator(queue.begin()), std::make_move_iterator(queue.end()));
+    queue.clear();
+  }
+
+  if (!batch.empty()) {
+    WriteBatch(batch);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    nDone += batch.size();
+  }
+  cvWritten.notify_all();
+
+  if (fdFile >= 0) {
+    close(fdFile);
+    fdFile = -1;
+  }
+
+  // Anything still spooled is sent by the next run
+  remoteSink.Close();
+}
+
+void cOutputPipeline::Push(cOutputRecord&& record)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  if (!bRunning) {
+    lock.unlock();
+    WriteRecordNow(record);
+    return;
+  }
+
+  record.queued = std::chrono::steady_clock::now();
+  record.created = std::chrono::system_clock::now();
+  nPushed++;
+  stats.nQueued++;
+
+  if ((settings.policy == OUTPUT_POLICY::COALESCE) && !record.sCoalesceKey.empty()) {
+    auto iter = std::find_if(queue.begin(), queue.end(), [&record](const cOutputRecord& queued) { return (queued.sCoalesceKey == record.sCoalesceKey); });
+    if (iter != queue.end()) {
+      // Take over the older record's place, and its queued time so the latency still covers the whole wait
+      record.queued = iter->queued;
+      *iter = std::move(record);
+      stats.nCoalesced++;
+      nDone++;
+      return;
+    }
+  }
+
+  if (queue.size() >= settings.nQueueSize) {
+    if (settings.policy == OUTPUT_POLICY::BLOCK) {
+      const std::chrono::steady_clock::time_point blocked = std::chrono::steady_clock::now();
+      cvWritten.wait(lock, [this] { return (bStop || (queue.size() < settings.nQueueSize)); });
+      stats.nBlockedUS += GetMicrosecondsSince(blocked, std::chrono::steady_clock::now());
+    } else {
+      queue.pop_front();
+      stats.nDropped++;
+      nDone++;
+    }
+  }
+
+  queue.push_back(std::move(record));
+  stats.nMaxQueueDepth = std::max<uint64_t>(stats.nMaxQueueDepth, queue.size());
+
+  lock.unlock();
+  cvQueued.notify_one();
+}
+
+void cOutputPipeline::Flush()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  const uint64_t nTarget = nPushed;
+  cvWritten.wait(lock, [this, nTarget] { return (!bRunning || (nDone >= nTarget)); });
+}
+
+void cOutputPipeline::GetStatsAndReset(cOutputStats& outputStats)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  outputStats = stats;
+
+  cOutputStats reset;
+  reset.bEnabled = stats.bEnabled;
+  for (auto& sinkStats : stats.sinks) {
+    reset.sinks.push_back(cOutputSinkStats());
+    reset.sinks.back().sName = sinkStats.sName;
+    reset.sinks.back().nSpooled = sinkStats.nSpooled;
+  }
+  stats = reset;
+}
+
+void cOutputPipeline::Run()
+{
+  std::vector<cOutputRecord> batch;
+
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    // Wake up to reconnect to the remote collector while records are spooled for it
+    if (remoteSink.HasSpooled()) {
+      cvQueued.wait_until(lock, remoteSink.GetNextRetry(), [this] { return (bStop || !queue.empty()); });
+    } else {
+      cvQueued.wait(lock, [this] { return (bStop || !queue.empty()); });
+    }
+
+    if (queue.empty()) {
+      // Stopping and everything has been written
+      if (bStop) break;
+
+      lock.unlock();
+      remoteSink.Retry();
+      lock.lock();
+      UpdateRemoteSpooledStats();
+      continue;
+    }
+
+    batch.clear();
+    const size_t nRecords = std::min(queue.size(), settings.nBatchSize);
+    for (size_t i = 0; i < nRecords; i++) {
+      batch.push_back(std::move(queue.front()));
+      queue.pop_front();
+    }
+
+    // Let any blocked collectors in while we write
+    lock.unlock();
+    cvWritten.notify_all();
+
+    WriteBatch(batch);
+
+    lock.lock();
+    nDone += batch.size();
+    cvWritten.notify_all();
+  }
+}
+
+void cOutputPipeline::WriteBatch(std::vector<cOutputRecord>& batch)
+{
+  // Serialise each record once, every sink gets the same JSON
+  const std::chrono::steady_clock::time_point serialiseStart = std::chrono::steady_clock::now();
+  std::vector<std::string> json(batch.size());
+  for (size_t i = 0; i < batch.size(); i++) {
+    json[i] = batch[i].fnGetJSON();
+  }
+  const uint64_t nSerialiseUS = GetMicrosecondsSince(serialiseStart, std::chrono::steady_clock::now());
+
+  std::vector<cOutputSinkStats> sinkStats(sinks.size());
+  for (size_t s = 0; s < sinks.size(); s++) {
+    switch (sinks[s]) {
+      case SINK::STDOUT: {
+        std::string sOutput;
+        for (auto& sJSON : json) {
+          sOutput += "Json output: " + sJSON + "\n";
+        }
+        std::cout<<sOutput<<std::flush;
+        break;
+      }
+      case SINK::SYSLOG: {
+        for (size_t i = 0; i < batch.size(); i++) {
+          if (json[i].empty()) {
+            syslog(LOG_ERR, "Error creating JSON");
+            sinkStats[s].nErrors++;
+            continue;
+          }
+
+          syslog(batch[i].nPriority, "%s json @cee: %s", batch[i].sMessage.c_str(), json[i].c_str());
+        }
+        break;
+      }
+      case SINK::FILE: {
+        // One JSON object per line, the whole batch in a single write
+        std::string sOutput;
+        for (auto& sJSON : json) {
+          if (sJSON.empty()) {
+            sinkStats[s].nErrors++;
+            continue;
+          }
+
+          sOutput += sJSON + "\n";
+        }
+
+        if (!WriteAll(fdFile, sOutput)) {
+          const int error_code = errno;
+          std::cerr<<"lumber-jill Failed to write to output file \""<<settings.sFilePath<<"\", error: "<<strerror(error_code)<<std::endl;
+          syslog(LOG_ERR, "lumber-jill Failed to write to output file \"%s\", error: %s", settings.sFilePath.c_str(), strerror(error_code));
+          sinkStats[s].nErrors++;
+        }
+        break;
+      }
+      case SINK::REMOTE: {
+        // The same line syslog gets, as an RFC 5424 message with the time the record was created
+        std::vector<std::string> messages;
+        for (size_t i = 0; i < batch.size(); i++) {
+          if (json[i].empty()) {
+            sinkStats[s].nErrors++;
+            continue;
+          }
+
+          messages.push_back(remoteSink.FormatMessage(REMOTE_FACILITY | LOG_PRI(batch[i].nPriority), batch[i].created, batch[i].sMessage + " json @cee: " + json[i]));
+        }
+
+        // Records that had to be spooled are sent later, they still count as written here
+        if (!remoteSink.Write(messages)) {
+          sinkStats[s].nErrors++;
+        }
+        break;
+      }
+    }
+
+    const std::chrono::steady_clock::time_point written = std::chrono::steady_clock::now();
+    sinkStats[s].nBatches = 1;
+    sinkStats[s].nRecords = batch.size();
+    for (auto& record : batch) {
+      const uint64_t nLatencyUS = GetMicrosecondsSince(record.queued, written);
+      sinkStats[s].nTotalLatencyUS += nLatencyUS;
+      sinkStats[s].nMaxLatencyUS = std::max(sinkStats[s].nMaxLatencyUS, nLatencyUS);
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  stats.nSerialiseUS += nSerialiseUS;
+  for (size_t s = 0; s < sinks.size(); s++) {
+    cOutputSinkStats& total = stats.sinks[s];
+    total.nRecords += sinkStats[s].nRecords;
+    total.nBatches += sinkStats[s].nBatches;
+    total.nErrors += sinkStats[s].nErrors;
+    total.nTotalLatencyUS += sinkStats[s].nTotalLatencyUS;
+    total.nMaxLatencyUS = std::max(total.nMaxLatencyUS, sinkStats[s].nMaxLatencyUS);
+  }
+
+  UpdateRemoteSpooledStats();
+}
+
+void cOutputPipeline::UpdateRemoteSpooledStats()
+{
+  for (size_t s = 0; s < sinks.size(); s++) {
+    if (sinks[s] == SINK::REMOTE) {
+      stats.sinks[s].nSpooled = remoteSink.GetSpooledCount();
+    }
+  }
+}
+
+void SetOutputPipeline(cOutputPipeline* pPipeline)
+{
+  g_pOutputPipeline = pPipeline;
+}
+
+cOutputPipeline* GetOutputPipeline()
+{
+  return g_pOutputPipeline;
+}
+
+bool WriteOutput(int nPriority, const std::string& sMessage, const std::string& sCoalesceKey, std::function<std::string()>&& fnGetJSON)
+{
+  cOutputRecord record;
+  record.nPriority = nPriority;
+  record.sMessage = sMessage;
+  record.sCoalesceKey = sCoalesceKey;
+  record.fnGetJSON = std::move(fnGetJSON);
+
+  cOutputPipeline* pPipeline = g_pOutputPipeline;
+  if (pPipeline == nullptr) {
+    return WriteRecordNow(record);
+  }
+
+  pPipeline->Push(std::move(record));
+  return true;
+}
+
+}
@@ -0,0 +1,532 @@
+#include <cerrno>
+#include <cstring>
+
+#include <chrono>
+#include <iostream>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "query_server.h"
+
+namespace lumberjill {
+
+namespace {
+
+// Requests are a single short line
+const size_t MAX_REQUEST_BYTES = 4096;
+
+// Clients that are this slow to send a request or read the response are dropped so they can't hold a connection open, and QueryDaemon gives up on a daemon that is this slow to answer
+const std::chrono::seconds CONNECTION_TIMEOUT(5);
+
+// More than enough for a handful of local tools, anything past this is closed straight away
+const size_t MAX_CONNECTIONS = 128;
+
+bool FillSocketAddress(const std::string& sSocketPath, struct sockaddr_un& address)
+{
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (sSocketPath.empty() || (sSocketPath.length() >= sizeof(address.sun_path))) {
+    return false;
+  }
+
+  memcpy(address.sun_path, sSocketPath.c_str(), sSocketPath.length());
+  return true;
+}
+
+}
+
+bool ParseQueryRequest(std::string_view line, cQueryRequest& request)
+{
+  request = cQueryRequest();
+
+  while (!line.empty() && ((line.back() == '\n') || (line.back() == '\r'))) {
+    line.remove_suffix(1);
+  }
+
+  const size_t space = line.find(' ');
+  if (space == std::string_view::npos) return false;
+
+  const std::string_view format = line.substr(0, space);
+  if (format == "json") request.format = QUERY_FORMAT::JSON;
+  else if (format == "openmetrics") request.format = QUERY_FORMAT::OPENMETRICS;
+  else return false;
+
+  const std::string_view what = line.substr(space + 1);
+  if (what == "snapshot") {
+    return true;
+  } else if (what.starts_with("device ") && (what.length() > strlen("device "))) {
+    request.sDevicePath = what.substr(strlen("device "));
+    return true;
+  }
+
+  return false;
+}
+
+std::string GetQueryRequestLine(const cQueryRequest& request)
+{
+  std::string sLine = (request.format == QUERY_FORMAT::OPENMETRICS) ? "openmetrics" : "json";
+  if (request.sDevicePath.empty()) {
+    sLine += " snapshot";
+  } else {
+    sLine += " device " + request.sDevicePath;
+  }
+
+  return sLine + "\n";
+}
+
+bool GetQueryResponse(const cPublishedSnapshot* pSnapshot, const cQueryRequest& request, std::string& sStatus, std::string& sBody, std::string_view& body)
+{
+  sBody.clear();
+  body = std::string_view();
+
+  if (pSnapshot == nullptr) {
+    sStatus = "ERROR The first collection hasn't finished yet\n";
+    return false;
+  }
+
+  if (request.sDevicePath.empty()) {
+    body = (request.format == QUERY_FORMAT::OPENMETRICS) ? pSnapshot->sOpenMetrics : pSnapshot->sJSON;
+  } else {
+    sBody = (request.format == QUERY_FORMAT::OPENMETRICS) ? GetOpenMetricsStatsSnapshot(pSnapshot->snapshot, request.sDevicePath) : GetJSONStatsSnapshotDrive(pSnapshot->snapshot, request.sDevicePath);
+    if (sBody.empty()) {
+      sStatus = "ERROR Unknown device " + request.sDevicePath + "\n";
+      return false;
+    }
+    body = sBody;
+  }
+
+  sStatus = "OK\n";
+  return true;
+}
+
+
+class cQueryServer::cConnection {
+public:
+  cConnection() : fd(-1), bIsWriting(false), nWritten(0) {}
+
+  int fd;
+  std::chrono::steady_clock::time_point start;
+
+  std::string request;
+  bool bIsWriting;
+
+  // Holding on to the snapshot keeps the body valid while we write it, even if a newer one is published
+  std::shared_ptr<const cPublishedSnapshot> snapshot;
+  std::string sStatus;
+  std::string sBody;
+  std::string_view body;
+  size_t nWritten; // Across the status line and the body
+};
+
+cQueryServer::cQueryServer(const cSnapshotStore& _store) :
+  snapshotReader(_store),
+  listen_fd(-1),
+  epoll_fd(-1),
+  stop_fd(-1)
+{
+}
+
+cQueryServer::~cQueryServer()
+{
+  Stop();
+}
+
+bool cQueryServer::Start(const std::string& _sSocketPath)
+{
+  Stop();
+
+  sSocketPath = _sSocketPath;
+
+  struct sockaddr_un address;
+  if (!FillSocketAddress(sSocketPath, address)) {
+    std::cerr<<"cQueryServer::Start Invalid socket path \""<<sSocketPath<<"\""<<std::endl;
+    syslog(LOG_ERR, "cQueryServer::Start Invalid socket path \"%s\"", sSocketPath.c_str());
+    return false;
+  }
+
+  // Create the folder if it is missing, /run is usually a tmpfs so /run/lumber-jill won't survive a reboot
+  // The socket is bound in this folder and then renamed, so it has to be the real folder, rename can't move it between file systems
+  const size_t separator = sSocketPath.find_last_of('/');
+  const std::string sFolder = (separator == std::string::npos) ? "." : ((separator == 0) ? "/" : sSocketPath.substr(0, separator));
+  if ((mkdir(sFolder.c_str(), 0755) != 0) && (errno != EEXIST)) {
+    std::cerr<<"cQueryServer::Start Error creating folder \""<<sFolder<<"\": "<<strerror(errno)<<std::endl;
+    syslog(LOG_ERR, "cQueryServer::Start Error creating folder \"%s\": %s", sFolder.c_str(), strerror(errno));
+    return false;
+  }
+
+  // Remove a socket left behind by a previous run, but never anything else
+  struct stat s;
+  if ((lstat(sSocketPath.c_str(), &s) == 0) && S_ISSOCK(s.st_mode)) {
+    unlink(sSocketPath.c_str());
+  }
+
+  listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listen_fd < 0) {
+    std::cerr<<"cQueryServer::Start socket failed: "<<strerror(errno)<<std::endl;
+    syslog(LOG_ERR, "cQueryServer::Start socket failed: %s", strerror(errno));
+    Stop();
+    return false;
+  }
+
+  // The stats include drive serial numbers, so only root and our group can connect
+  // bind creates the socket with the permissions from the umask, so we bind it in a private folder, set its permissions and then move it into place
+  if (!BindPrivately(sFolder)) {
+    Stop();
+    return false;
+  }
+
+  if (listen(listen_fd, 64) != 0) {
+    std::cerr<<"cQueryServer::Start listen failed: "<<strerror(errno)<<std::endl;
+    syslog(LOG_ERR, "cQueryServer::Start listen failed: %s", strerror(errno));
+    Stop();
+    return false;
+  }
+
+  stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if ((stop_fd < 0) || (epoll_fd < 0)) {
+    std::cerr<<"cQueryServer::Start Error creating the event loop: "<<strerror(errno)<<std::endl;
+    syslog(LOG_ERR, "cQueryServer::Start Error creating the event loop: %s", strerror(errno));
+    Stop();
+    return false;
+  }
+
+  for (const int fd : { listen_fd, stop_fd }) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+      std::cerr<<"cQueryServer::Start epoll_ctl failed: "<<strerror(errno)<<std::endl;
+      syslog(LOG_ERR, "cQueryServer::Start epoll_ctl failed: %s", strerror(errno));
+      Stop();
+      return false;
+    }
+  }
+
+  thread = std::thread([this]() { Run(); });
+
+  return true;
+}
+
+bool cQueryServer::BindPrivately(const std::string& sFolder)
+{
+  std::string sBindFolder = ((sFolder == "/") ? "" : sFolder) + "/.query-XXXXXX";
+  if (mkdtemp(sBindFolder.data()) == nullptr) {
+    std::cerr<<"cQueryServer::BindPrivately Error creating a folder in \""<<sFolder<<"\": "<<strerror(errno)<<std::endl;
+    syslog(LOG_ERR, "cQueryServer::BindPrivately Error creating a folder in \"%s\": %s", sFolder.c_str(), strerror(errno));
+    return false;
+  }
+
+  const std::string sBindPath = sBindFolder + "/socket";
+
+  bool result = false;
+  struct sockaddr_un address;
+  if (!FillSocketAddress(sBindPath, address)) {
+    std::cerr<<"cQueryServer::BindPrivately Socket path \""<<sBindPath<<"\" is too long"<<std::endl;
+    syslog(LOG_ERR, "cQueryServer::BindPrivately Socket path \"%s\" is too long", sBindPath.c_str());
+  } else if (bind(listen_fd, reinterpret_cast<const struct sockaddr*>(&address), sizeof(address)) != 0) {
+    std::cerr<<"cQueryServer::BindPrivately Error binding to \""<<sBindPath<<"\": "<<strerror(errno)<<std::endl;
+    syslog(LOG_ERR, "cQueryServer::BindPrivately Error binding to \"%s\": %s", sBindPath.c_str(), strerror(errno));
+  } else if (chmod(sBindPath.c_str(), 0660) != 0) {
+    std::cerr<<"cQueryServer::BindPrivately Error setting the permissions of \""<<sBindPath<<"\": "<<strerror(errno)<<std::endl;
+    syslog(LOG_ERR, "cQueryServer::BindPrivately Error setting the permissions of \"%s\": %s", sBindPath.c_str(), strerror(errno));
+  } else if (rename(sBindPath.c_str(), sSocketPath.c_str()) != 0) {
+    std::cerr<<"cQueryServer::BindPrivately Error moving the socket to \""<<sSocketPath<<"\": "<<strerror(errno)<<std::endl;
+    syslog(LOG_ERR, "cQueryServer::BindPrivately Error moving the socket to \"%s\": %s", sSocketPath.c_str(), strerror(errno));
+  } else {
+    result = true;
+  }
+
+  if (!result) unlink(sBindPath.c_str());
+  rmdir(sBindFolder.c_str());
+
+  return result;
+}
+
+void cQueryServer::Stop()
+{
+  if (thread.joinable()) {
+    const uint64_t value = 1;
+    const ssize_t len = write(stop_fd, &value, sizeof(value));
+    (void)len;
+    thread.join();
+  }
+
+  while (!connections.empty()) {
+    CloseConnection(connections.begin()->first);
+  }
+
+  for (int* pFD : { &listen_fd, &epoll_fd, &stop_fd }) {
+    if (*pFD >= 0) {
+      close(*pFD);
+      *pFD = -1;
+    }
+  }
+
+  if (!sSocketPath.empty()) {
+    struct stat s;
+    if ((lstat(sSocketPath.c_str(), &s) == 0) && S_ISSOCK(s.st_mode)) {
+      unlink(sSocketPath.c_str());
+    }
+    sSocketPath.clear();
+  }
+}
+
+void cQueryServer::Run()
+{
+  while (true) {
+    struct epoll_event events[16];
+    const int nEvents = epoll_wait(epoll_fd, events, 16, 1000);
+    if (nEvents < 0) {
+      if (errno == EINTR) continue;
+
+      syslog(LOG_ERR, "cQueryServer::Run epoll_wait failed: %s", strerror(errno));
+      break;
+    }
+
+    for (int i = 0; i < nEvents; i++) {
+      const int fd = events[i].data.fd;
+      if (fd == stop_fd) {
+        return;
+      } else if (fd == listen_fd) {
+        AcceptConnections();
+      } else {
+        OnConnectionReady(fd);
+      }
+    }
+
+    CloseIdleConnections();
+  }
+}
+
+void cQueryServer::AcceptConnections()
+{
+  while (true) {
+    const int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+
+    if (connections.size() >= MAX_CONNECTIONS) {
+      close(fd);
+      continue;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+      close(fd);
+      continue;
+    }
+
+    std::unique_ptr<cConnection> connection = std::make_unique<cConnection>();
+    connection->fd = fd;
+    connection->start = std::chrono::steady_clock::now();
+    connections[fd] = std::move(connection);
+
+    // The request has usually arrived already, try it now rather than going around the event loop again
+    OnConnectionReady(fd);
+  }
+}
+
+void cQueryServer::OnConnectionReady(int fd)
+{
+  auto iter = connections.find(fd);
+  if (iter == connections.end()) return;
+
+  cConnection& connection = *iter->second;
+
+  const bool bKeepOpen = connection.bIsWriting ? WriteResponse(connection) : ReadRequest(connection);
+  if (!bKeepOpen) {
+    CloseConnection(fd);
+  }
+}
+
+bool cQueryServer::ReadRequest(cConnection& connection)
+{
+  char buffer[1024];
+  while (true) {
+    const ssize_t len = read(connection.fd, buffer, sizeof(buffer));
+    if (len < 0) {
+      if (errno == EINTR) continue;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) return true;
+      return false;
+    }
+
+    // The client went away or sent the request without a new line
+    const bool bIsEnd = (len == 0);
+    connection.request.append(buffer, size_t(len));
+
+    const size_t newline = connection.request.find('\n');
+    if ((newline == std::string::npos) && !bIsEnd) {
+      if (connection.request.length() > MAX_REQUEST_BYTES) return false;
+      continue;
+    }
+
+    if (connection.request.empty()) return false;
+
+    cQueryRequest request;
+    if (!ParseQueryRequest(std::string_view(connection.request).substr(0, newline), request)) {
+      connection.sStatus = "ERROR Invalid request\n";
+    } else {
+      connection.snapshot = snapshotReader.Get();
+      GetQueryResponse(connection.snapshot.get(), request, connection.sStatus, connection.sBody, connection.body);
+    }
+
+    connection.bIsWriting = true;
+
+    if (!WriteResponse(connection)) return false;
+
+    // The socket buffer is full, carry on when there is room
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLOUT;
+    event.data.fd = connection.fd;
+    return (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection.fd, &event) == 0);
+  }
+}
+
+bool cQueryServer::WriteResponse(cConnection& connection)
+{
+  while (true) {
+    struct iovec parts[2];
+    int nParts = 0;
+
+    const size_t nStatusBytes = connection.sStatus.length();
+    if (connection.nWritten < nStatusBytes) {
+      parts[nParts].iov_base = connection.sStatus.data() + connection.nWritten;
+      parts[nParts].iov_len = nStatusBytes - connection.nWritten;
+      nParts++;
+    }
+
+    const size_t nBodyOffset = (connection.nWritten > nStatusBytes) ? (connection.nWritten - nStatusBytes) : 0;
+    if (nBodyOffset < connection.body.length()) {
+      parts[nParts].iov_base = const_cast<char*>(connection.body.data() + nBodyOffset);
+      parts[nParts].iov_len = connection.body.length() - nBodyOffset;
+      nParts++;
+    }
+
+    // All written
+    if (nParts == 0) return false;
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = parts;
+    message.msg_iovlen = size_t(nParts);
+
+    const ssize_t len = sendmsg(connection.fd, &message, MSG_NOSIGNAL);
+    if (len < 0) {
+      if (errno == EINTR) continue;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) return true;
+      return false;
+    }
+
+    connection.nWritten += size_t(len);
+  }
+}
+
+void cQueryServer::CloseConnection(int fd)
+{
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+  close(fd);
+  connections.erase(fd);
+}
+
+void cQueryServer::CloseIdleConnections()
+{
+  const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+  std::vector<int> expired;
+  for (auto& item : connections) {
+    if ((now - item.second->start) > CONNECTION_TIMEOUT) {
+      expired.push_back(item.first);
+    }
+  }
+
+  for (const int fd : expired) {
+    CloseConnection(fd);
+  }
+}
+
+
+bool QueryDaemon(const std::string& sSocketPath, const cQueryRequest& request, std::string& sResponse)
+{
+  sResponse.clear();
+
+  struct sockaddr_un address;
+  if (!FillSocketAddress(sSocketPath, address)) {
+    std::cerr<<"QueryDaemon Invalid socket path \""<<sSocketPath<<"\""<<std::endl;
+    return false;
+  }
+
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    std::cerr<<"QueryDaemon socket failed: "<<strerror(errno)<<std::endl;
+    return false;
+  }
+
+  struct timeval timeout;
+  timeout.tv_sec = time_t(CONNECTION_TIMEOUT.count());
+  timeout.tv_usec = 0;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  if (connect(fd, reinterpret_cast<const struct sockaddr*>(&address), sizeof(address)) != 0) {
+    std::cerr<<"QueryDaemon Error connecting to \""<<sSocketPath<<"\", is the daemon running? "<<strerror(errno)<<std::endl;
+    close(fd);
+    return false;
+  }
+
+  const std::string sLine = GetQueryRequestLine(request);
+  if (send(fd, sLine.data(), sLine.length(), MSG_NOSIGNAL) != ssize_t(sLine.length())) {
+    std::cerr<<"QueryDaemon Error sending the request: "<<strerror(errno)<<std::endl;
+    close(fd);
+    return false;
+  }
+
+  std::string sReceived;
+  char buffer[16 * 1024];
+  while (true) {
+    const ssize_t len = read(fd, buffer, sizeof(buffer));
+    if (len < 0) {
+      if (errno == EINTR) continue;
+
+      std::cerr<<"QueryDaemon Error reading the response: "<<strerror(errno)<<std::endl;
+      close(fd);
+      return false;
+    } else if (len == 0) {
+      break;
+    }
+
+    sReceived.append(buffer, size_t(len));
+  }
+
+  close(fd);
+
+  const size_t newline = sReceived.find('\n');
+  if (newline == std::string::npos) {
+    std::cerr<<"QueryDaemon Incomplete response"<<std::endl;
+    return false;
+  }
+
+  if (sReceived.compare(0, newline, "OK") != 0) {
+    std::cerr<<"QueryDaemon "<<sReceived.substr(0, newline)<<std::endl;
+    return false;
+  }
+
+  sResponse = sReceived.substr(newline + 1);
+  return true;
+}
+
+}
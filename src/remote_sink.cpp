@@ -0,0 +1,517 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <system_error>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "remote_sink.h"
+
+namespace lumberjill {
+
+namespace {
+
+const char SPOOL_MAGIC[8] = { 'L', 'J', 'S', 'P', 'O', 'O', 'L', '\0' };
+const uint32_t SPOOL_VERSION = 1;
+
+// Magic, version, reserved, capacity, start, used, count
+const size_t SPOOL_HEADER_SIZE = 48;
+
+// How many spooled messages are read and sent at a time when draining the spool
+const size_t SPOOL_SEND_MESSAGES = 64;
+
+// Bounds how long connecting and sending can hold up the sink thread when the collector stops responding
+const std::chrono::seconds SEND_TIMEOUT(5);
+
+// The most that fits in a UDP datagram over IPv4
+const size_t MAX_UDP_MESSAGE_BYTES = 65507;
+
+const char* GetProtocolName(REMOTE_PROTOCOL protocol)
+{
+  return (protocol == REMOTE_PROTOCOL::UDP) ? "udp" : "tcp";
+}
+
+bool SendAll(int fd, const std::string& data)
+{
+  size_t nSent = 0;
+  while (nSent < data.length()) {
+    const ssize_t result = send(fd, data.data() + nSent, data.length() - nSent, MSG_NOSIGNAL);
+    if (result < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+
+    nSent += size_t(result);
+  }
+
+  return true;
+}
+
+}
+
+std::string FormatRFC5424Message(int nPRI, std::chrono::system_clock::time_point time, const std::string& sHostName, const std::string& sAppName, int nProcessID, const std::string& sMessage)
+{
+  const time_t seconds = std::chrono::system_clock::to_time_t(time);
+  struct tm utc;
+  gmtime_r(&seconds, &utc);
+
+  char szDateTime[32];
+  strftime(szDateTime, sizeof(szDateTime), "%Y-%m-%dT%H:%M:%S", &utc);
+
+  const int64_t nMicroseconds = int64_t(std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count() % 1000000);
+
+  // The header, with no message ID or structured data
+  char szHeader[512];
+  snprintf(szHeader, sizeof(szHeader), "<%d>1 %s.%06dZ %s %s %d - - ", nPRI, szDateTime, int(nMicroseconds), sHostName.empty() ? "-" : sHostName.c_str(), sAppName.empty() ? "-" : sAppName.c_str(), nProcessID);
+
+  return szHeader + sMessage;
+}
+
+std::string GetOctetCountedFrame(const std::string& sMessage)
+{
+  return std::to_string(sMessage.length()) + " " + sMessage;
+}
+
+
+cRemoteSpool::cRemoteSpool() :
+  fd(-1),
+  nCapacity(0),
+  nStart(0),
+  nUsed(0),
+  nCount(0)
+{
+}
+
+cRemoteSpool::~cRemoteSpool()
+{
+  Close();
+}
+
+bool cRemoteSpool::Open(const std::string& sFilePath, size_t nCapacityBytes)
+{
+  Close();
+
+  fd = open(sFilePath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    const int error_code = errno;
+    std::cerr<<"cRemoteSpool::Open Failed to open \""<<sFilePath<<"\", error: "<<strerror(error_code)<<std::endl;
+    syslog(LOG_ERR, "cRemoteSpool::Open Failed to open \"%s\", error: %s", sFilePath.c_str(), strerror(error_code));
+    return false;
+  }
+
+  nCapacity = nCapacityBytes;
+
+  // Pick up where the last run left off if the header makes sense and every message length adds up
+  uint8_t header[SPOOL_HEADER_SIZE];
+  struct stat st;
+  if ((fstat(fd, &st) == 0) && (uint64_t(st.st_size) == (SPOOL_HEADER_SIZE + nCapacity)) && (pread(fd, header, sizeof(header), 0) == ssize_t(sizeof(header))) && (memcmp(header, SPOOL_MAGIC, sizeof(SPOOL_MAGIC)) == 0)) {
+    uint32_t nVersion = 0;
+    uint64_t nFileCapacity = 0;
+    memcpy(&nVersion, header + 8, sizeof(nVersion));
+    memcpy(&nFileCapacity, header + 16, sizeof(nFileCapacity));
+    memcpy(&nStart, header + 24, sizeof(nStart));
+    memcpy(&nUsed, header + 32, sizeof(nUsed));
+    memcpy(&nCount, header + 40, sizeof(nCount));
+
+    if ((nVersion == SPOOL_VERSION) && (nFileCapacity == nCapacity) && (nStart < nCapacity) && (nUsed <= nCapacity)) {
+      uint64_t nPosition = nStart;
+      uint64_t nTotal = 0;
+      bool bIsValid = true;
+      for (uint64_t i = 0; bIsValid && (i < nCount); i++) {
+        uint32_t nLength = 0;
+        bIsValid = ReadAt(nPosition, &nLength, sizeof(nLength));
+        nPosition += sizeof(nLength) + nLength;
+        nTotal += sizeof(nLength) + nLength;
+        bIsValid = bIsValid && (nTotal <= nUsed);
+      }
+
+      if (bIsValid && (nTotal == nUsed)) return true;
+    }
+  }
+
+  // Start a new spool
+  nStart = 0;
+  nUsed = 0;
+  nCount = 0;
+  if ((ftruncate(fd, off_t(SPOOL_HEADER_SIZE + nCapacity)) != 0) || !WriteHeader()) {
+    const int error_code = errno;
+    std::cerr<<"cRemoteSpool::Open Failed to create \""<<sFilePath<<"\", error: "<<strerror(error_code)<<std::endl;
+    syslog(LOG_ERR, "cRemoteSpool::Open Failed to create \"%s\", error: %s", sFilePath.c_str(), strerror(error_code));
+    Close();
+    return false;
+  }
+
+  return true;
+}
+
+void cRemoteSpool::Close()
+{
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+
+  nCapacity = 0;
+  nStart = 0;
+  nUsed = 0;
+  nCount = 0;
+}
+
+size_t cRemoteSpool::Push(const std::vector<std::string>& messages)
+{
+  if (fd < 0) return messages.size();
+
+  size_t nDropped = 0;
+  for (auto& sMessage : messages) {
+    const uint64_t nRecordBytes = sizeof(uint32_t) + sMessage.length();
+    if ((nRecordBytes > nCapacity) || (sMessage.length() > UINT32_MAX)) {
+      nDropped++;
+      continue;
+    }
+
+    // Make room by dropping the oldest messages
+    while ((nUsed + nRecordBytes) > nCapacity) {
+      if (!PopOne()) break;
+      nDropped++;
+    }
+
+    const uint32_t nLength = uint32_t(sMessage.length());
+    const uint64_t nEnd = nStart + nUsed;
+    if (!WriteAt(nEnd, &nLength, sizeof(nLength)) || !WriteAt(nEnd + sizeof(nLength), sMessage.data(), sMessage.length())) {
+      nDropped++;
+      continue;
+    }
+
+    nUsed += nRecordBytes;
+    nCount++;
+  }
+
+  // The header is written last so a crash part way through loses the new messages rather than corrupting the old ones
+  WriteHeader();
+
+  return nDropped;
+}
+
+bool cRemoteSpool::Peek(size_t nMaxMessages, std::vector<std::string>& messages) const
+{
+  messages.clear();
+
+  uint64_t nPosition = nStart;
+  for (uint64_t i = 0; (i < nCount) && (messages.size() < nMaxMessages); i++) {
+    uint32_t nLength = 0;
+    if (!ReadAt(nPosition, &nLength, sizeof(nLength))) return false;
+
+    std::string sMessage(nLength, '\0');
+    if (!ReadAt(nPosition + sizeof(nLength), sMessage.data(), nLength)) return false;
+
+    messages.push_back(std::move(sMessage));
+    nPosition += sizeof(nLength) + nLength;
+  }
+
+  return true;
+}
+
+void cRemoteSpool::Pop(size_t nMessages)
+{
+  for (size_t i = 0; i < nMessages; i++) {
+    if (!PopOne()) break;
+  }
+
+  WriteHeader();
+}
+
+bool cRemoteSpool::ReadAt(uint64_t nPosition, void* pData, size_t nBytes) const
+{
+  nPosition %= nCapacity;
+
+  // The read may wrap around from the end of the ring to the start
+  const size_t nFirstBytes = size_t(std::min<uint64_t>(nBytes, nCapacity - nPosition));
+  if (pread(fd, pData, nFirstBytes, off_t(SPOOL_HEADER_SIZE + nPosition)) != ssize_t(nFirstBytes)) return false;
+
+  const size_t nSecondBytes = nBytes - nFirstBytes;
+  if ((nSecondBytes != 0) && (pread(fd, static_cast<uint8_t*>(pData) + nFirstBytes, nSecondBytes, off_t(SPOOL_HEADER_SIZE)) != ssize_t(nSecondBytes))) return false;
+
+  return true;
+}
+
+bool cRemoteSpool::WriteAt(uint64_t nPosition, const void* pData, size_t nBytes)
+{
+  nPosition %= nCapacity;
+
+  const size_t nFirstBytes = size_t(std::min<uint64_t>(nBytes, nCapacity - nPosition));
+  if (pwrite(fd, pData, nFirstBytes, off_t(SPOOL_HEADER_SIZE + nPosition)) != ssize_t(nFirstBytes)) return false;
+
+  const size_t nSecondBytes = nBytes - nFirstBytes;
+  if ((nSecondBytes != 0) && (pwrite(fd, static_cast<const uint8_t*>(pData) + nFirstBytes, nSecondBytes, off_t(SPOOL_HEADER_SIZE)) != ssize_t(nSecondBytes))) return false;
+
+  return true;
+}
+
+bool cRemoteSpool::WriteHeader()
+{
+  uint8_t header[SPOOL_HEADER_SIZE];
+  memset(header, 0, sizeof(header));
+  memcpy(header, SPOOL_MAGIC, sizeof(SPOOL_MAGIC));
+  memcpy(header + 8, &SPOOL_VERSION, sizeof(SPOOL_VERSION));
+  memcpy(header + 16, &nCapacity, sizeof(nCapacity));
+  memcpy(header + 24, &nStart, sizeof(nStart));
+  memcpy(header + 32, &nUsed, sizeof(nUsed));
+  memcpy(header + 40, &nCount, sizeof(nCount));
+
+  return (pwrite(fd, header, sizeof(header), 0) == ssize_t(sizeof(header)));
+}
+
+bool cRemoteSpool::PopOne()
+{
+  if (nCount == 0) return false;
+
+  uint32_t nLength = 0;
+  if (!ReadAt(nStart, &nLength, sizeof(nLength)) || ((sizeof(nLength) + nLength) > nUsed)) {
+    // Something is badly wrong with the file, throw everything away rather than send garbage
+    nStart = 0;
+    nUsed = 0;
+    nCount = 0;
+    return true;
+  }
+
+  nStart = (nStart + sizeof(nLength) + nLength) % nCapacity;
+  nUsed -= sizeof(nLength) + nLength;
+  nCount--;
+
+  if (nCount == 0) {
+    nStart = 0;
+    nUsed = 0;
+  }
+
+  return true;
+}
+
+
+cRemoteSink::cRemoteSink() :
+  nProcessID(0),
+  fd(-1),
+  reconnectDelay(0),
+  bIsUnreachable(false)
+{
+}
+
+cRemoteSink::~cRemoteSink()
+{
+  Close();
+}
+
+bool cRemoteSink::Open(const cRemoteSettings& _settings)
+{
+  Close();
+
+  settings = _settings;
+
+  char szHostName[256] = "";
+  gethostname(szHostName, sizeof(szHostName) - 1);
+  sHostName = szHostName;
+  nProcessID = int(getpid());
+
+  reconnectDelay = std::chrono::milliseconds(settings.nReconnectMinMS);
+  nextRetry = std::chrono::steady_clock::now();
+  bIsUnreachable = false;
+
+  // Without a spool records are still shipped, they are just lost while the collector is unreachable
+  if (!settings.sSpoolFilePath.empty()) {
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(settings.sSpoolFilePath).parent_path(), ec);
+    if (!spool.Open(settings.sSpoolFilePath, settings.nSpoolSizeBytes)) {
+      std::cerr<<"lumber-jill Failed to open the remote log spool, continuing without it"<<std::endl;
+      syslog(LOG_WARNING, "lumber-jill Failed to open the remote log spool, continuing without it");
+    }
+  }
+
+  return true;
+}
+
+void cRemoteSink::Close()
+{
+  Disconnect();
+  spool.Close();
+}
+
+std::string cRemoteSink::FormatMessage(int nPRI, std::chrono::system_clock::time_point time, const std::string& sMessage) const
+{
+  return FormatRFC5424Message(nPRI, time, sHostName, "lumber-jill", nProcessID, sMessage);
+}
+
+bool cRemoteSink::Write(const std::vector<std::string>& messages)
+{
+  if (messages.empty()) return true;
+
+  if (!IsConnected() && !Connect()) {
+    Spool(messages);
+    return false;
+  }
+
+  // Anything spooled goes first so the collector gets everything in order
+  // NOTE: If a send fails part way the whole batch is spooled and sent again, so the collector may see some messages twice but never misses one
+  if (!SendSpool() || !Send(messages)) {
+    Disconnect();
+    Spool(messages);
+    return false;
+  }
+
+  reconnectDelay = std::chrono::milliseconds(settings.nReconnectMinMS);
+  return true;
+}
+
+void cRemoteSink::Retry()
+{
+  if (!HasSpooled()) return;
+
+  if (!IsConnected() && !Connect()) return;
+
+  if (!SendSpool()) {
+    Disconnect();
+    return;
+  }
+
+  reconnectDelay = std::chrono::milliseconds(settings.nReconnectMinMS);
+}
+
+bool cRemoteSink::IsConnected()
+{
+  if (fd < 0) return false;
+
+  if (settings.protocol == REMOTE_PROTOCOL::TCP) {
+    // A collector that has closed the connection reads as end of file, a send would still appear to work and the records would be lost
+    char c = 0;
+    const ssize_t result = recv(fd, &c, sizeof(c), MSG_PEEK | MSG_DONTWAIT);
+    if ((result == 0) || ((result < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))) {
+      Disconnect();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool cRemoteSink::Connect()
+{
+  if (std::chrono::steady_clock::now() < nextRetry) return false;
+
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = (settings.protocol == REMOTE_PROTOCOL::UDP) ? SOCK_DGRAM : SOCK_STREAM;
+
+  struct addrinfo* pResults = nullptr;
+  const std::string sPort = std::to_string(settings.nPort);
+  if (getaddrinfo(settings.sHost.c_str(), sPort.c_str(), &hints, &pResults) == 0) {
+    for (struct addrinfo* pResult = pResults; pResult != nullptr; pResult = pResult->ai_next) {
+      fd = socket(pResult->ai_family, pResult->ai_socktype | SOCK_CLOEXEC, pResult->ai_protocol);
+      if (fd < 0) continue;
+
+      // This also limits how long connect waits
+      struct timeval timeout;
+      timeout.tv_sec = time_t(SEND_TIMEOUT.count());
+      timeout.tv_usec = 0;
+      setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+      if (connect(fd, pResult->ai_addr, pResult->ai_addrlen) == 0) break;
+
+      close(fd);
+      fd = -1;
+    }
+
+    freeaddrinfo(pResults);
+  }
+
+  if (fd < 0) {
+    if (!bIsUnreachable) {
+      std::cerr<<"lumber-jill Remote log collector "<<settings.sHost<<":"<<settings.nPort<<" ("<<GetProtocolName(settings.protocol)<<") is unreachable, spooling records"<<std::endl;
+      syslog(LOG_WARNING, "lumber-jill Remote log collector %s:%zu (%s) is unreachable, spooling records", settings.sHost.c_str(), settings.nPort, GetProtocolName(settings.protocol));
+      bIsUnreachable = true;
+    }
+
+    Disconnect();
+    return false;
+  }
+
+  if (bIsUnreachable) {
+    std::cout<<"lumber-jill Connected to remote log collector "<<settings.sHost<<":"<<settings.nPort<<", sending "<<spool.GetMessageCount()<<" spooled records"<<std::endl;
+    syslog(LOG_INFO, "lumber-jill Connected to remote log collector %s:%zu, sending %zu spooled records", settings.sHost.c_str(), settings.nPort, spool.GetMessageCount());
+    bIsUnreachable = false;
+  }
+
+  return true;
+}
+
+void cRemoteSink::Disconnect()
+{
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+
+  // Back off before trying again
+  nextRetry = std::chrono::steady_clock::now() + reconnectDelay;
+  reconnectDelay = std::min(reconnectDelay * 2, std::chrono::milliseconds(settings.nReconnectMaxMS));
+}
+
+bool cRemoteSink::Send(const std::vector<std::string>& messages)
+{
+  if (settings.protocol == REMOTE_PROTOCOL::TCP) {
+    // The whole batch in as few writes as possible
+    std::string sFrames;
+    for (auto& sMessage : messages) {
+      sFrames += GetOctetCountedFrame(sMessage);
+    }
+
+    return SendAll(fd, sFrames);
+  }
+
+  for (auto& sMessage : messages) {
+    if (sMessage.length() > MAX_UDP_MESSAGE_BYTES) {
+      // It will never fit, so don't let it hold up the rest
+      std::cerr<<"lumber-jill Dropping a "<<sMessage.length()<<" byte record that is too big for UDP"<<std::endl;
+      syslog(LOG_ERR, "lumber-jill Dropping a %zu byte record that is too big for UDP", sMessage.length());
+      continue;
+    }
+
+    if (send(fd, sMessage.data(), sMessage.length(), MSG_NOSIGNAL) < 0) return false;
+  }
+
+  return true;
+}
+
+bool cRemoteSink::SendSpool()
+{
+  std::vector<std::string> messages;
+  while (spool.GetMessageCount() != 0) {
+    if (!spool.Peek(SPOOL_SEND_MESSAGES, messages) || !Send(messages)) return false;
+
+    spool.Pop(messages.size());
+  }
+
+  return true;
+}
+
+void cRemoteSink::Spool(const std::vector<std::string>& messages)
+{
+  if (!spool.IsOpen()) return;
+
+  const size_t nDropped = spool.Push(messages);
+  if (nDropped != 0) {
+    std::cerr<<"lumber-jill Remote log spool is full, dropped "<<nDropped<<" records"<<std::endl;
+    syslog(LOG_WARNING, "lumber-jill Remote log spool is full, dropped %zu records", nDropped);
+  }
+}
+
+}
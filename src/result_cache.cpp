@@ -0,0 +1,301 @@
+#include <cerrno>
+#include <cstring>
+
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "result_cache.h"
+#include "utils.h"
+
+namespace lumberjill {
+
+namespace {
+
+const char RESULT_CACHE_MAGIC[8] = { 'L', 'J', 'C', 'A', 'C', 'H', 'E', '\0' };
+
+// Bump this whenever the header or entry layout changes, older files are then ignored and replaced
+const uint32_t RESULT_CACHE_VERSION = 1;
+
+const size_t MAX_DEVICE_PATH_LENGTH = 223;
+
+// Which of the optional values an entry has
+const uint32_t FLAG_STANDBY = 0x01;
+const uint32_t FLAG_SAMPLE_AGE = 0x02;
+const uint32_t FLAG_RAW_READ_ERROR_RATE = 0x04;
+const uint32_t FLAG_SEEK_ERROR_RATE = 0x08;
+const uint32_t FLAG_OFFLINE_UNCORRECTABLE = 0x10;
+const uint32_t FLAG_TEMPERATURE_CELSIUS = 0x20;
+
+}
+
+// Plain data so that it can be used straight out of the mapping
+class cResultCache::cEntry {
+public:
+  char szDevicePath[MAX_DEVICE_PATH_LENGTH + 1];
+  int64_t nTimestamp;
+  uint32_t nFlags;
+  uint32_t nReserved;
+  uint64_t nSampleAgeSeconds;
+  uint64_t nRaw_Read_Error_Rate;
+  uint64_t nSeek_Error_Rate;
+  uint64_t nOffline_Uncorrectable;
+  uint64_t nTemperature_Celsius;
+};
+
+static_assert(sizeof(cResultCache::cEntry) == 280);
+
+namespace {
+
+void EntryToStats(const cResultCache::cEntry& entry, cSmartCtlStats& smartctlStats)
+{
+  smartctlStats.Clear();
+  smartctlStats.bIsInStandby = ((entry.nFlags & FLAG_STANDBY) != 0);
+  if ((entry.nFlags & FLAG_SAMPLE_AGE) != 0) smartctlStats.nSampleAgeSeconds = entry.nSampleAgeSeconds;
+  if ((entry.nFlags & FLAG_RAW_READ_ERROR_RATE) != 0) smartctlStats.nRaw_Read_Error_Rate = size_t(entry.nRaw_Read_Error_Rate);
+  if ((entry.nFlags & FLAG_SEEK_ERROR_RATE) != 0) smartctlStats.nSeek_Error_Rate = size_t(entry.nSeek_Error_Rate);
+  if ((entry.nFlags & FLAG_OFFLINE_UNCORRECTABLE) != 0) smartctlStats.nOffline_Uncorrectable = size_t(entry.nOffline_Uncorrectable);
+  if ((entry.nFlags & FLAG_TEMPERATURE_CELSIUS) != 0) smartctlStats.nTemperature_Celsius = size_t(entry.nTemperature_Celsius);
+}
+
+void StatsToEntry(const std::string& sDevicePath, int64_t nTimestamp, const cSmartCtlStats& smartctlStats, cResultCache::cEntry& entry)
+{
+  memset(&entry, 0, sizeof(entry));
+  memcpy(entry.szDevicePath, sDevicePath.c_str(), sDevicePath.length());
+  entry.nTimestamp = nTimestamp;
+  if (smartctlStats.bIsInStandby) entry.nFlags |= FLAG_STANDBY;
+  if (smartctlStats.nSampleAgeSeconds.has_value()) {
+    entry.nFlags |= FLAG_SAMPLE_AGE;
+    entry.nSampleAgeSeconds = smartctlStats.nSampleAgeSeconds.value();
+  }
+  if (smartctlStats.nRaw_Read_Error_Rate.has_value()) {
+    entry.nFlags |= FLAG_RAW_READ_ERROR_RATE;
+    entry.nRaw_Read_Error_Rate = smartctlStats.nRaw_Read_Error_Rate.value();
+  }
+  if (smartctlStats.nSeek_Error_Rate.has_value()) {
+    entry.nFlags |= FLAG_SEEK_ERROR_RATE;
+    entry.nSeek_Error_Rate = smartctlStats.nSeek_Error_Rate.value();
+  }
+  if (smartctlStats.nOffline_Uncorrectable.has_value()) {
+    entry.nFlags |= FLAG_OFFLINE_UNCORRECTABLE;
+    entry.nOffline_Uncorrectable = smartctlStats.nOffline_Uncorrectable.value();
+  }
+  if (smartctlStats.nTemperature_Celsius.has_value()) {
+    entry.nFlags |= FLAG_TEMPERATURE_CELSIUS;
+    entry.nTemperature_Celsius = smartctlStats.nTemperature_Celsius.value();
+  }
+}
+
+}
+
+cResultCache::cResultCache() :
+  pMapping(nullptr),
+  nMappingSizeBytes(0),
+  pEntries(nullptr),
+  nEntries(0)
+{
+}
+
+cResultCache::~cResultCache()
+{
+  Unmap();
+}
+
+void cResultCache::Unmap()
+{
+  if (pMapping != nullptr) {
+    munmap(const_cast<uint8_t*>(pMapping), nMappingSizeBytes);
+  }
+
+  pMapping = nullptr;
+  nMappingSizeBytes = 0;
+  pEntries = nullptr;
+  nEntries = 0;
+}
+
+bool cResultCache::Load(const std::string& sFilePath)
+{
+  Unmap();
+
+  const int fd = open(sFilePath.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    // Nothing has been cached yet
+    return false;
+  }
+
+  struct stat s;
+  if ((fstat(fd, &s) != 0) || (size_t(s.st_size) < sizeof(cStateFileHeader))) {
+    close(fd);
+    return false;
+  }
+
+  const size_t nSizeBytes = size_t(s.st_size);
+  void* p = mmap(nullptr, nSizeBytes, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    std::cerr<<"cResultCache::Load mmap failed for \""<<sFilePath<<"\": "<<strerror(errno)<<std::endl;
+    return false;
+  }
+
+  pMapping = static_cast<const uint8_t*>(p);
+  nMappingSizeBytes = nSizeBytes;
+
+  const cStateFileHeader* pHeader = reinterpret_cast<const cStateFileHeader*>(pMapping);
+  if (!IsStateFileHeaderValid(*pHeader, RESULT_CACHE_MAGIC, RESULT_CACHE_VERSION, sizeof(cEntry), nSizeBytes)) {
+    syslog(LOG_WARNING, "cResultCache::Load Ignoring invalid cache file \"%s\"", sFilePath.c_str());
+    Unmap();
+    return false;
+  }
+
+  pEntries = reinterpret_cast<const cEntry*>(pMapping + sizeof(cStateFileHeader));
+  nEntries = size_t(pHeader->nEntries);
+
+  return true;
+}
+
+const cResultCache::cEntry* cResultCache::Find(const std::string& sDevicePath) const
+{
+  if (sDevicePath.length() > MAX_DEVICE_PATH_LENGTH) return nullptr;
+
+  // The entries are sorted by device path
+  size_t low = 0;
+  size_t high = nEntries;
+  while (low < high) {
+    const size_t middle = low + ((high - low) / 2);
+    const int compare = strncmp(pEntries[middle].szDevicePath, sDevicePath.c_str(), MAX_DEVICE_PATH_LENGTH + 1);
+    if (compare == 0) return &pEntries[middle];
+    else if (compare < 0) low = middle + 1;
+    else high = middle;
+  }
+
+  return nullptr;
+}
+
+bool cResultCache::Get(const std::string& sDevicePath, int64_t nNow, uint64_t nMaxAgeSeconds, cSmartCtlStats& smartctlStats) const
+{
+  int64_t nTimestamp = 0;
+
+  const auto found = updates.find(sDevicePath);
+  if (found != updates.end()) {
+    nTimestamp = found->second.first;
+    smartctlStats = found->second.second;
+  } else {
+    const cEntry* pEntry = Find(sDevicePath);
+    if (pEntry == nullptr) return false;
+
+    nTimestamp = pEntry->nTimestamp;
+    EntryToStats(*pEntry, smartctlStats);
+  }
+
+  // Entries from the future mean the clock has gone backwards, don't trust them
+  if ((nTimestamp > nNow) || (uint64_t(nNow - nTimestamp) > nMaxAgeSeconds)) {
+    smartctlStats.Clear();
+    return false;
+  }
+
+  // Values kept from before a drive went into standby are now older still
+  if (smartctlStats.bIsInStandby && smartctlStats.nSampleAgeSeconds.has_value()) {
+    smartctlStats.nSampleAgeSeconds = smartctlStats.nSampleAgeSeconds.value() + uint64_t(nNow - nTimestamp);
+  }
+
+  return true;
+}
+
+void cResultCache::Set(const std::string& sDevicePath, int64_t nTimestamp, const cSmartCtlStats& smartctlStats)
+{
+  // Not worth handling, device paths are never anywhere near this long
+  if (sDevicePath.empty() || (sDevicePath.length() > MAX_DEVICE_PATH_LENGTH)) return;
+
+  updates[sDevicePath] = std::make_pair(nTimestamp, smartctlStats);
+}
+
+size_t cResultCache::GetEntryCount() const
+{
+  size_t nCount = updates.size();
+  for (size_t i = 0; i < nEntries; i++) {
+    if (updates.find(std::string(pEntries[i].szDevicePath, strnlen(pEntries[i].szDevicePath, sizeof(pEntries[i].szDevicePath)))) == updates.end()) nCount++;
+  }
+
+  return nCount;
+}
+
+bool cResultCache::Save(const std::string& sFilePath) const
+{
+  // Merge the new results into the loaded ones, both are sorted so this is a single pass
+  std::vector<cEntry> entries;
+  entries.reserve(nEntries + updates.size());
+
+  size_t i = 0;
+  auto iter = updates.begin();
+  while ((i < nEntries) || (iter != updates.end())) {
+    const int compare = (i >= nEntries) ? 1 : ((iter == updates.end()) ? -1 : strncmp(pEntries[i].szDevicePath, iter->first.c_str(), MAX_DEVICE_PATH_LENGTH + 1));
+    if (compare < 0) {
+      entries.push_back(pEntries[i]);
+      i++;
+    } else {
+      cEntry entry;
+      StatsToEntry(iter->first, iter->second.first, iter->second.second, entry);
+      entries.push_back(entry);
+      if (compare == 0) i++;
+      iter++;
+    }
+  }
+
+  // No fsync, /run is a tmpfs and the cache is only worth anything until the next reboot anyway
+  return SaveStateFile(sFilePath, RESULT_CACHE_MAGIC, RESULT_CACHE_VERSION, entries, false);
+}
+
+
+cResultCacheLock::cResultCacheLock() :
+  fd(-1)
+{
+}
+
+cResultCacheLock::~cResultCacheLock()
+{
+  Unlock();
+}
+
+bool cResultCacheLock::Lock(const std::string& sFilePath, std::chrono::milliseconds timeout)
+{
+  Unlock();
+
+  fd = open(sFilePath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0640);
+  if (fd < 0) {
+    std::cerr<<"cResultCacheLock::Lock Error opening \""<<sFilePath<<"\": "<<strerror(errno)<<std::endl;
+    syslog(LOG_ERR, "cResultCacheLock::Lock Error opening \"%s\": %s", sFilePath.c_str(), strerror(errno));
+    return false;
+  }
+
+  // Poll rather than block so that a run that is stuck can't hold up every run after it forever
+  const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+  while (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+    if (((errno != EWOULDBLOCK) && (errno != EINTR)) || (std::chrono::steady_clock::now() >= deadline)) {
+      close(fd);
+      fd = -1;
+      return false;
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+
+  return true;
+}
+
+void cResultCacheLock::Unlock()
+{
+  if (fd >= 0) {
+    // Closing the file releases the lock
+    close(fd);
+    fd = -1;
+  }
+}
+
+}
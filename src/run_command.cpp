@@ -9,12 +9,15 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <signal.h>
 #include <syslog.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 
+#include "low_impact.h"
 #include "utils.h"
 
 namespace lumberjill {
@@ -44,16 +47,36 @@ bool cPipeIn::Run(const std::string& executable, const std::vector<std::string>&
 {
   out_result = -1;
 
-  int stdin_fd[2];
-  int stdout_fd[2];
-  int stderr_fd[2];
+  // Create C-style array for arguments, this is done before forking because the child can only make async-signal-safe calls
+  std::vector<std::string> argument_storage;
+  argument_storage.reserve(arguments.size() + 1);
+  argument_storage.push_back(executable);
+  argument_storage.insert(argument_storage.end(), arguments.begin(), arguments.end());
 
-  // FIXME: Bad, we potentially leak file descriptors
-  if (pipe(stdout_fd) < 0 || pipe(stderr_fd) < 0 || pipe(stdin_fd) < 0) {
+  std::vector<char*> c_arguments;
+  c_arguments.reserve(argument_storage.size() + 1);
+  for (auto& argument : argument_storage) {
+    c_arguments.push_back(argument.data());
+  }
+  c_arguments.push_back(nullptr);
+
+  // The pipes are close on exec so that commands run concurrently from other threads don't inherit each other's pipes
+  // dup2 clears the flag on the copies the child uses
+  int stdin_fd[2] = { -1, -1 };
+  int stdout_fd[2] = { -1, -1 };
+  int stderr_fd[2] = { -1, -1 };
+
+  if (pipe2(stdout_fd, O_CLOEXEC) < 0 || pipe2(stderr_fd, O_CLOEXEC) < 0 || pipe2(stdin_fd, O_CLOEXEC) < 0) {
     std::cerr<<"cPipeIn:Run pipe failed"<<std::endl;
+    for (const int fd : { stdout_fd[0], stdout_fd[1], stderr_fd[0], stderr_fd[1], stdin_fd[0], stdin_fd[1] }) {
+      if (fd >= 0) close(fd);
+    }
     return false;
   }
 
+  // Read this before forking, the child can only make async-signal-safe calls
+  const cLowImpact* pLowImpact = GetChildProcessLowImpact();
+
   const pid_t pid = fork();
   if (pid < 0)
   { // error
@@ -72,6 +95,16 @@ bool cPipeIn::Run(const std::string& executable, const std::vector<std::string>&
   }
   else if (pid == 0)
   { // child
+    // The daemon blocks some signals to handle them in its event loop, the child should get the default behaviour
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigprocmask(SIG_SETMASK, &mask, nullptr);
+
+    // Run the tool at idle priority and in the low impact cgroup if required
+    if (pLowImpact != nullptr) {
+      pLowImpact->ApplyToChildProcess();
+    }
+
     close(stdin_fd[1]);
     close(stdout_fd[0]);
     close(stderr_fd[0]);
@@ -85,15 +118,6 @@ bool cPipeIn::Run(const std::string& executable, const std::vector<std::string>&
     dup2(stderr_fd[1], STDERR_FILENO);
     close(stderr_fd[1]);
 
-    // Create C-style array for arguments
-    std::vector<char*> c_arguments(arguments.size() + 2);
-    c_arguments[0] = strdup(executable.c_str());
-    for(std::vector<std::string>::size_type i = 0; i < arguments.size(); ++i) {
-      c_arguments[i+1] = strdup(arguments[i].c_str());
-    }
-
-    c_arguments[arguments.size()+1] = nullptr;
-
     // Execute the program
     execv(c_arguments[0], c_arguments.data());
 
@@ -238,4 +262,67 @@ bool RunCommand(const std::string& executable, const std::vector<std::string>& a
   return (success && (result == 0));
 }
 
+bool RunCommandDetached(const std::string& executable, const std::vector<std::string>& arguments)
+{
+  // We only allow absolute executable paths
+  if (!IsFilePathAbsolute(executable)) {
+    syslog(LOG_ERR, "RunCommandDetached Executable \"%s\" not found", executable.c_str());
+    return false;
+  }
+
+  // Create C-style array for arguments, this is done before forking because the child can only make async-signal-safe calls
+  std::vector<std::string> argument_storage;
+  argument_storage.reserve(arguments.size() + 1);
+  argument_storage.push_back(executable);
+  argument_storage.insert(argument_storage.end(), arguments.begin(), arguments.end());
+
+  std::vector<char*> c_arguments;
+  c_arguments.reserve(argument_storage.size() + 1);
+  for (auto& argument : argument_storage) {
+    c_arguments.push_back(argument.data());
+  }
+  c_arguments.push_back(nullptr);
+
+  const cLowImpact* pLowImpact = GetChildProcessLowImpact();
+
+  const pid_t pid = fork();
+  if (pid < 0) {
+    std::cerr<<"RunCommandDetached fork failed: "<<strerror(errno)<<std::endl;
+    return false;
+  } else if (pid == 0) {
+    // The daemon blocks some signals to handle them in its event loop, the child should get the default behaviour
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigprocmask(SIG_SETMASK, &mask, nullptr);
+
+    if (pLowImpact != nullptr) {
+      pLowImpact->ApplyToChildProcess();
+    }
+
+    // Keep the background process out of our session so that a Ctrl+C on the daemon's terminal doesn't reach it
+    setsid();
+
+    const int null_fd = open("/dev/null", O_RDWR);
+    if (null_fd >= 0) {
+      dup2(null_fd, STDIN_FILENO);
+      dup2(null_fd, STDOUT_FILENO);
+      dup2(null_fd, STDERR_FILENO);
+      if (null_fd > STDERR_FILENO) close(null_fd);
+    }
+
+    execv(c_arguments[0], c_arguments.data());
+    _exit(EXIT_FAILURE);
+  }
+
+  int child_status = 0;
+  while (waitpid(pid, &child_status, 0) < 0) {
+    if (errno != EINTR) {
+      std::cerr<<"RunCommandDetached waitpid failed: "<<strerror(errno)<<std::endl;
+      return false;
+    }
+  }
+
+  return (WIFEXITED(child_status) && (WEXITSTATUS(child_status) == 0));
+}
+
 }
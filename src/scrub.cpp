@@ -0,0 +1,415 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include <fcntl.h>
+#include <linux/btrfs.h>
+#include <sys/ioctl.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "collector.h"
+#include "run_command.h"
+#include "scrub.h"
+#include "utils.h"
+
+namespace lumberjill {
+
+namespace {
+
+const int64_t SECONDS_PER_DAY = 24 * 60 * 60;
+
+const size_t MAX_STATUS_FILE_SIZE_BYTES = 1024 * 1024;
+
+// The fsid as it appears in sysfs and the btrfs-progs status file names, "1b2e3f4a-..."
+std::string FormatUUID(const uint8_t* pUUID)
+{
+  char szUUID[37];
+  snprintf(szUUID, sizeof(szUUID), "%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+    pUUID[0], pUUID[1], pUUID[2], pUUID[3], pUUID[4], pUUID[5], pUUID[6], pUUID[7],
+    pUUID[8], pUUID[9], pUUID[10], pUUID[11], pUUID[12], pUUID[13], pUUID[14], pUUID[15]
+  );
+  return szUUID;
+}
+
+void SetProgressCounters(const btrfs_scrub_progress& scrubProgress, cScrubDeviceProgress& progress)
+{
+  progress.nBytesScrubbed = scrubProgress.data_bytes_scrubbed + scrubProgress.tree_bytes_scrubbed;
+  progress.nReadErrors = scrubProgress.read_errors;
+  progress.nCsumErrors = scrubProgress.csum_errors;
+  progress.nVerifyErrors = scrubProgress.verify_errors;
+  progress.nSuperErrors = scrubProgress.super_errors;
+  progress.nUncorrectableErrors = scrubProgress.uncorrectable_errors;
+  progress.nCorrectedErrors = scrubProgress.corrected_errors;
+}
+
+const cScrubDeviceProgress* FindDevice(const std::vector<cScrubDeviceProgress>& devices, uint64_t nDeviceId)
+{
+  for (auto& device : devices) {
+    if (device.nDeviceId == nDeviceId) return &device;
+  }
+
+  return nullptr;
+}
+
+}
+
+bool ParseScrubStatusFile(std::string_view contents, const std::string& sFSID, cScrubStatusFile& status)
+{
+  status = cScrubStatusFile();
+
+  // "scrub status:1" followed by a line per device of "<fsid>:<devid>|key:value|key:value..."
+  const std::string_view header = "scrub status:";
+  if (contents.substr(0, header.length()) != header) return false;
+
+  bool bAllFinished = true;
+  bool bAnyCanceled = false;
+
+  while (!contents.empty()) {
+    const size_t eol = contents.find('\n');
+    std::string_view line = contents.substr(0, eol);
+    contents = (eol == std::string_view::npos) ? std::string_view() : contents.substr(eol + 1);
+
+    const size_t separator = line.find('|');
+    if (separator == std::string_view::npos) continue;
+
+    // Other volumes can share the file in older versions of btrfs-progs
+    const std::string_view device = line.substr(0, separator);
+    if ((device.length() <= sFSID.length()) || (device.substr(0, sFSID.length()) != sFSID) || (device[sFSID.length()] != ':')) continue;
+
+    status.bFound = true;
+
+    bool bFinished = false;
+    line.remove_prefix(separator + 1);
+    while (!line.empty()) {
+      const size_t end = line.find('|');
+      const std::string_view field = line.substr(0, end);
+      line = (end == std::string_view::npos) ? std::string_view() : line.substr(end + 1);
+
+      const size_t colon = field.find(':');
+      if (colon == std::string_view::npos) continue;
+
+      const std::string_view key = field.substr(0, colon);
+      size_t value = 0;
+      if (!StringParseValue(field.substr(colon + 1), value)) continue;
+
+      if (key == "t_start") status.nStartTimestamp = std::max(status.nStartTimestamp, int64_t(value));
+      else if (key == "finished") bFinished = (value != 0);
+      else if (key == "canceled") bAnyCanceled = bAnyCanceled || (value != 0);
+    }
+
+    bAllFinished = bAllFinished && bFinished;
+  }
+
+  status.bIsFinished = status.bFound && bAllFinished;
+  status.bIsCanceled = status.bFound && !bAllFinished && bAnyCanceled;
+
+  return true;
+}
+
+bool IsInScrubWindow(const std::vector<cScrubWindow>& windows, size_t nMinuteOfDay)
+{
+  if (windows.empty()) return true;
+
+  for (auto& window : windows) {
+    if (window.nStartMinute < window.nEndMinute) {
+      if ((nMinuteOfDay >= window.nStartMinute) && (nMinuteOfDay < window.nEndMinute)) return true;
+    } else {
+      // Spans midnight
+      if ((nMinuteOfDay >= window.nStartMinute) || (nMinuteOfDay < window.nEndMinute)) return true;
+    }
+  }
+
+  return false;
+}
+
+void UpdateScrubThroughput(const cScrubDeviceProgress& previous, uint64_t nIntervalMS, cScrubDeviceProgress& progress)
+{
+  progress.dBytesPerSecond.reset();
+  progress.dETASeconds.reset();
+
+  // A resumed scrub starts counting again, everything it has found is new
+  const bool bIsReset = (progress.nBytesScrubbed < previous.nBytesScrubbed) || (progress.GetErrors() < previous.GetErrors());
+  if (bIsReset) {
+    progress.nNewErrors = progress.GetErrors();
+    return;
+  }
+
+  progress.nNewErrors = progress.GetErrors() - previous.GetErrors();
+
+  if (nIntervalMS == 0) return;
+
+  const double dBytesPerSecond = double(progress.nBytesScrubbed - previous.nBytesScrubbed) * 1000.0 / double(nIntervalMS);
+  progress.dBytesPerSecond = dBytesPerSecond;
+
+  if ((dBytesPerSecond > 0.0) && (progress.nBytesToScrub >= progress.nBytesScrubbed)) {
+    progress.dETASeconds = double(progress.nBytesToScrub - progress.nBytesScrubbed) / dBytesPerSecond;
+  }
+}
+
+SCRUB_ACTION DecideScrubAction(const cScrubSettings& settings, int64_t nNow, size_t nMinuteOfDay, const cScrubGroupState& state, bool bIsRunning, const cScrubStatusFile& status, double dMaxAwaitMS, std::string& sReason)
+{
+  sReason.clear();
+
+  const bool bIsInWindow = IsInScrubWindow(settings.windows, nMinuteOfDay);
+  const bool bIsBusy = (settings.nMaxAwaitMS != 0) && (dMaxAwaitMS > double(settings.nMaxAwaitMS));
+
+  if (bIsRunning) {
+    // Scrubs started by hand are left alone
+    if (!state.bIsOurs) return SCRUB_ACTION::NONE;
+
+    if (!bIsInWindow) {
+      sReason = "outside window";
+      return SCRUB_ACTION::PAUSE;
+    } else if (bIsBusy) {
+      sReason = "latency";
+      return SCRUB_ACTION::PAUSE;
+    }
+
+    return SCRUB_ACTION::NONE;
+  }
+
+  if (!bIsInWindow || bIsBusy) return SCRUB_ACTION::NONE;
+
+  // Give the other work a chance to finish before trying again
+  if ((state.nPausedTimestamp != 0) && ((nNow - state.nPausedTimestamp) < (int64_t(settings.nPauseMinutes) * 60))) return SCRUB_ACTION::NONE;
+
+  // Only resume a scrub that we paused, one cancelled by hand stays cancelled until the next one is due
+  if (status.bIsCanceled && state.bIsOurs && (state.nPausedTimestamp != 0)) return SCRUB_ACTION::RESUME;
+
+  if (!status.bFound || ((nNow - status.nStartTimestamp) >= (int64_t(settings.nIntervalDays) * SECONDS_PER_DAY))) return SCRUB_ACTION::START;
+
+  return SCRUB_ACTION::NONE;
+}
+
+cScrubOrchestrator::cScrubOrchestrator() :
+  sSysFolder("/sys"),
+  sStatusFolder("/var/lib/btrfs")
+{
+}
+
+cScrubOrchestrator::cScrubOrchestrator(const std::string& _sSysFolder, const std::string& _sStatusFolder) :
+  sSysFolder(_sSysFolder),
+  sStatusFolder(_sStatusFolder)
+{
+}
+
+cScrubOrchestrator::~cScrubOrchestrator()
+{
+}
+
+double cScrubOrchestrator::GetMaxAwaitMS(const cGroup& group) const
+{
+  double dMaxAwaitMS = 0.0;
+  for (auto& device : group.devices) {
+    std::string sNode;
+    cDiskIOStats stats;
+    if (GetDeviceNode(device.sPath, sNode) && diskStatsCollector.GetDiskIOStats(sNode, stats)) {
+      dMaxAwaitMS = std::max(dMaxAwaitMS, std::max(stats.dReadAwaitMS, stats.dWriteAwaitMS));
+    }
+  }
+
+  return dMaxAwaitMS;
+}
+
+void cScrubOrchestrator::SetSpeedLimit(const std::string& sMountPoint, const std::string& sFSID, const std::vector<cScrubDeviceProgress>& devices, size_t nBytesPerSecond)
+{
+  const std::string sValue = std::to_string(nBytesPerSecond);
+
+  for (auto& device : devices) {
+    // Added in Linux 5.14
+    const std::string sFilePath = sSysFolder + "/fs/btrfs/" + sFSID + "/devinfo/" + std::to_string(device.nDeviceId) + "/scrub_speed_max";
+    const int fd = open(sFilePath.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+      if (speedLimitUnsupportedMounts.insert(sMountPoint).second) {
+        std::cerr<<"cScrubOrchestrator::SetSpeedLimit Unable to limit the scrub speed of \""<<sMountPoint<<"\", error opening \""<<sFilePath<<"\": "<<strerror(errno)<<std::endl;
+        syslog(LOG_WARNING, "cScrubOrchestrator::SetSpeedLimit Unable to limit the scrub speed of \"%s\", error opening \"%s\": %s", sMountPoint.c_str(), sFilePath.c_str(), strerror(errno));
+      }
+      return;
+    }
+
+    if (write(fd, sValue.c_str(), sValue.length()) != ssize_t(sValue.length())) {
+      syslog(LOG_ERR, "cScrubOrchestrator::SetSpeedLimit Error writing \"%s\": %s", sFilePath.c_str(), strerror(errno));
+    }
+    close(fd);
+  }
+}
+
+void cScrubOrchestrator::PollGroup(const cSettings& settings, const cGroup& group, int64_t nNow, size_t nMinuteOfDay, uint64_t nNowMS, cScrubGroupState& state)
+{
+  const cScrubSettings& scrubSettings = settings.GetScrubSettings();
+
+  const int fd = open(group.sMountPoint.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    std::cerr<<"cScrubOrchestrator::PollGroup Error opening \""<<group.sMountPoint<<"\": "<<strerror(errno)<<std::endl;
+    syslog(LOG_ERR, "cScrubOrchestrator::PollGroup Error opening \"%s\": %s", group.sMountPoint.c_str(), strerror(errno));
+    return;
+  }
+
+  btrfs_ioctl_fs_info_args fsInfo;
+  memset(&fsInfo, 0, sizeof(fsInfo));
+  if (ioctl(fd, BTRFS_IOC_FS_INFO, &fsInfo) != 0) {
+    std::cerr<<"cScrubOrchestrator::PollGroup Error getting the btrfs info of \""<<group.sMountPoint<<"\": "<<strerror(errno)<<std::endl;
+    syslog(LOG_ERR, "cScrubOrchestrator::PollGroup Error getting the btrfs info of \"%s\": %s", group.sMountPoint.c_str(), strerror(errno));
+    close(fd);
+    return;
+  }
+
+  const std::string sFSID = FormatUUID(fsInfo.fsid);
+
+  // The device ids can have gaps where devices have been removed
+  bool bIsRunning = false;
+  std::vector<cScrubDeviceProgress> devices;
+  for (uint64_t nDeviceId = 1; nDeviceId <= fsInfo.max_id; nDeviceId++) {
+    btrfs_ioctl_dev_info_args devInfo;
+    memset(&devInfo, 0, sizeof(devInfo));
+    devInfo.devid = nDeviceId;
+    if (ioctl(fd, BTRFS_IOC_DEV_INFO, &devInfo) != 0) continue;
+
+    cScrubDeviceProgress progress;
+    progress.nDeviceId = nDeviceId;
+    progress.sPath.assign(reinterpret_cast<const char*>(devInfo.path), strnlen(reinterpret_cast<const char*>(devInfo.path), sizeof(devInfo.path)));
+    progress.nBytesToScrub = devInfo.bytes_used;
+
+    const cScrubDeviceProgress* pPrevious = FindDevice(state.devices, nDeviceId);
+
+    btrfs_ioctl_scrub_args scrubArgs;
+    memset(&scrubArgs, 0, sizeof(scrubArgs));
+    scrubArgs.devid = nDeviceId;
+    if (ioctl(fd, BTRFS_IOC_SCRUB_PROGRESS, &scrubArgs) == 0) {
+      bIsRunning = true;
+      SetProgressCounters(scrubArgs.progress, progress);
+      if (pPrevious != nullptr) {
+        UpdateScrubThroughput(*pPrevious, state.bIsRunning ? (nNowMS - state.nLastPollMS) : 0, progress);
+      } else {
+        progress.nNewErrors = progress.GetErrors();
+      }
+    } else if (pPrevious != nullptr) {
+      // ENOTCONN, there is no scrub running on this device, keep what it had got to
+      progress.nBytesScrubbed = pPrevious->nBytesScrubbed;
+      progress.nReadErrors = pPrevious->nReadErrors;
+      progress.nCsumErrors = pPrevious->nCsumErrors;
+      progress.nVerifyErrors = pPrevious->nVerifyErrors;
+      progress.nSuperErrors = pPrevious->nSuperErrors;
+      progress.nUncorrectableErrors = pPrevious->nUncorrectableErrors;
+      progress.nCorrectedErrors = pPrevious->nCorrectedErrors;
+    }
+
+    devices.push_back(progress);
+  }
+
+  cScrubStatusFile status;
+  const std::string sStatusFilePath = sStatusFolder + "/scrub.status." + sFSID;
+  std::string contents;
+  if (TestFileExists(sStatusFilePath) && ReadFileIntoString(sStatusFilePath, MAX_STATUS_FILE_SIZE_BYTES, contents)) {
+    ParseScrubStatusFile(contents, sFSID, status);
+  }
+
+  cScrubStats scrubStats;
+  scrubStats.devices = devices;
+
+  std::string sReason;
+  const SCRUB_ACTION action = DecideScrubAction(scrubSettings, nNow, nMinuteOfDay, state, bIsRunning, status, GetMaxAwaitMS(group), sReason);
+  if (action == SCRUB_ACTION::PAUSE) {
+    // btrfs-progs records how far each device got so that it can be resumed
+    if (ioctl(fd, BTRFS_IOC_SCRUB_CANCEL) == 0) {
+      state.nPausedTimestamp = nNow;
+      bIsRunning = false;
+      scrubStats.state = SCRUB_STATE::PAUSED;
+      scrubStats.sReason = sReason;
+      LogScrubStatsToSyslog(group.sMountPoint, scrubStats);
+    } else {
+      syslog(LOG_ERR, "cScrubOrchestrator::PollGroup Error pausing the scrub of \"%s\": %s", group.sMountPoint.c_str(), strerror(errno));
+    }
+  } else if ((action == SCRUB_ACTION::START) || (action == SCRUB_ACTION::RESUME)) {
+    if (scrubSettings.nBandwidthLimitBytesPerSecond != 0) SetSpeedLimit(group.sMountPoint, sFSID, devices, scrubSettings.nBandwidthLimitBytesPerSecond);
+
+    // Without -B this returns once the scrub is running in the background, which keeps stdout and stderr open until it is done so we don't capture them
+    bool bStarted = false;
+    if (action == SCRUB_ACTION::RESUME) {
+      bStarted = RunCommandDetached(settings.GetBtrfsPath(), std::vector<std::string> { "scrub", "resume", group.sMountPoint });
+    }
+
+    // There may be nothing left to resume if the status file is out of date
+    if (!bStarted) {
+      bStarted = RunCommandDetached(settings.GetBtrfsPath(), std::vector<std::string> { "scrub", "start", group.sMountPoint });
+    }
+
+    if (bStarted) {
+      syslog(LOG_INFO, "lumber-jill %s the scrub of \"%s\"", (action == SCRUB_ACTION::RESUME) ? "Resumed" : "Started", group.sMountPoint.c_str());
+      state.bIsOurs = true;
+      state.nPausedTimestamp = 0;
+
+      // The kernel's counters start again
+      devices.clear();
+    } else {
+      std::cerr<<"cScrubOrchestrator::PollGroup Error starting the scrub of \""<<group.sMountPoint<<"\""<<std::endl;
+      syslog(LOG_ERR, "cScrubOrchestrator::PollGroup Error starting the scrub of \"%s\"", group.sMountPoint.c_str());
+    }
+  } else if (bIsRunning) {
+    LogScrubStatsToSyslog(group.sMountPoint, scrubStats);
+  } else if (state.bIsRunning) {
+    // It ended on its own or was cancelled by hand, either way it is no longer ours to resume
+    scrubStats.state = status.bIsFinished ? SCRUB_STATE::FINISHED : SCRUB_STATE::PAUSED;
+    if (!status.bIsFinished) scrubStats.sReason = "cancelled";
+    LogScrubStatsToSyslog(group.sMountPoint, scrubStats);
+
+    // Leave scrubs started by hand unlimited
+    if (state.bIsOurs && (scrubSettings.nBandwidthLimitBytesPerSecond != 0)) SetSpeedLimit(group.sMountPoint, sFSID, devices, 0);
+    state.bIsOurs = false;
+    state.nPausedTimestamp = 0;
+  }
+
+  close(fd);
+
+  state.bIsRunning = bIsRunning;
+  state.nLastPollMS = nNowMS;
+  state.devices.swap(devices);
+}
+
+void cScrubOrchestrator::Poll(const cSettings& settings, const std::vector<cGroup>& groups, cMountQueryPool& mountQueryPool)
+{
+  // Sample the I/O of every btrfs drive first, the await since the last poll is what decides whether the scrubs should back off
+  std::vector<std::string> nodes;
+  for (auto& group : groups) {
+    if (group.type != GROUP_TYPE::BTRFS) continue;
+
+    for (auto& device : group.devices) {
+      std::string sNode;
+      if (GetDeviceNode(device.sPath, sNode)) nodes.push_back(sNode);
+    }
+  }
+
+  diskStatsCollector.Sample(nodes);
+
+  const time_t now = time(nullptr);
+  struct tm local;
+  localtime_r(&now, &local);
+  const size_t nMinuteOfDay = size_t((local.tm_hour * 60) + local.tm_min);
+  const uint64_t nNowMS = GetTimeSinceBootMS();
+
+  for (auto& group : groups) {
+    if (group.type != GROUP_TYPE::BTRFS) continue;
+
+    // NOTE: The ioctls and "btrfs scrub" would hang on an unresponsive mount, so we check it on a helper thread first like the btrfs stats do
+    cMountStats spaceStats;
+    if (mountQueryPool.GetMountTotalAndFreeSpace(group.sMountPoint, std::chrono::milliseconds(group.nMountTimeoutMS), spaceStats) == MOUNT_QUERY_RESULT::UNRESPONSIVE) {
+      if (unresponsiveMounts.insert(group.sMountPoint).second) {
+        std::cerr<<"cScrubOrchestrator::Poll \""<<group.sMountPoint<<"\" is not responding, skipping its scrub"<<std::endl;
+        syslog(LOG_WARNING, "cScrubOrchestrator::Poll \"%s\" is not responding, skipping its scrub", group.sMountPoint.c_str());
+      }
+      continue;
+    }
+
+    unresponsiveMounts.erase(group.sMountPoint);
+
+    PollGroup(settings, group, int64_t(now), nMinuteOfDay, nNowMS, mapMountPointToState[group.sMountPoint]);
+  }
+}
+
+}
@@ -0,0 +1,221 @@
+#include <cstring>
+#include <ctime>
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+#include "self_test.h"
+#include "utils.h"
+
+namespace lumberjill {
+
+namespace {
+
+const char SELF_TEST_STATE_MAGIC[8] = { 'L', 'J', 'S', 'T', 'E', 'S', 'T', '\0' };
+
+// Bump this whenever the header or the entry layout changes, older files are then ignored and every drive is due again
+const uint32_t SELF_TEST_STATE_VERSION = 1;
+
+const size_t MAX_DEVICE_PATH_LENGTH = 239;
+
+// Drives that haven't been seen for this long are dropped from the state file
+const int64_t EXPIRE_SECONDS = 90 * 24 * 60 * 60;
+
+const int64_t SECONDS_PER_DAY = 24 * 60 * 60;
+
+// A long test on a large and busy drive can take a day, if it still hasn't finished after this we assume we lost track of it and try again
+const int64_t MAX_RUNNING_SECONDS = 72 * 60 * 60;
+
+// One drive in the file
+class cEntry {
+public:
+  char szDevicePath[MAX_DEVICE_PATH_LENGTH + 1];
+  cSelfTestDriveState state;
+};
+
+static_assert(sizeof(cEntry) == (240 + 40));
+
+// A drive that is due for a test and how long it is overdue
+class cDueDrive {
+public:
+  const cSelfTestRequest* pRequest;
+  SELF_TEST_TYPE type;
+  int64_t nOverdueSeconds;
+};
+
+}
+
+SELF_TEST_RESULT GetSelfTestResult(const std::string& sStatus)
+{
+  if (sStatus.starts_with("Completed without error")) return SELF_TEST_RESULT::PASSED;
+
+  // ATA "Aborted by host" and "Interrupted (host reset)", NVMe "Aborted: Self-test command" and friends
+  if ((sStatus.find("Aborted") != std::string::npos) || (sStatus.find("Interrupted") != std::string::npos)) return SELF_TEST_RESULT::ABORTED;
+
+  return SELF_TEST_RESULT::FAILED;
+}
+
+cSelfTestScheduler::cSelfTestScheduler() :
+  bIsLoaded(false)
+{
+}
+
+cSelfTestScheduler::~cSelfTestScheduler()
+{
+}
+
+bool cSelfTestScheduler::Load(const std::string& sFilePath)
+{
+  drives.clear();
+
+  // Even if there is nothing to load we don't want to try again and forget the tests started since
+  bIsLoaded = true;
+
+  std::vector<cEntry> entries;
+  if (!LoadStateFile(sFilePath, SELF_TEST_STATE_MAGIC, SELF_TEST_STATE_VERSION, entries)) {
+    return false;
+  }
+
+  for (auto& entry : entries) {
+    drives[std::string(entry.szDevicePath, strnlen(entry.szDevicePath, sizeof(entry.szDevicePath)))] = entry.state;
+  }
+
+  return true;
+}
+
+bool cSelfTestScheduler::Save(const std::string& sFilePath) const
+{
+  const int64_t nNow = int64_t(time(nullptr));
+
+  std::vector<cEntry> entries;
+  entries.reserve(drives.size());
+  for (auto& item : drives) {
+    if (item.first.empty() || (item.first.length() > MAX_DEVICE_PATH_LENGTH)) continue;
+
+    if ((nNow - item.second.nLastSeenTimestamp) > EXPIRE_SECONDS) continue;
+
+    cEntry entry {};
+    memcpy(entry.szDevicePath, item.first.c_str(), item.first.length());
+    entry.state = item.second;
+    entries.push_back(entry);
+  }
+
+  return SaveStateFile(sFilePath, SELF_TEST_STATE_MAGIC, SELF_TEST_STATE_VERSION, entries, true);
+}
+
+void cSelfTestScheduler::Update(const cSelfTestSettings& settings, int64_t nNow, const std::vector<cSelfTestRequest>& requests, const StartFunction& start, const PollFunction& poll, std::map<std::string, cDriveSelfTestStats>& results)
+{
+  results.clear();
+
+  // A drive in more than one group is only counted against the first
+  std::vector<const cSelfTestRequest*> drivesToCheck;
+  std::set<std::string> seen;
+  for (auto& request : requests) {
+    if (request.sDevicePath.empty() || !seen.insert(request.sDevicePath).second) continue;
+    drivesToCheck.push_back(&request);
+  }
+
+  std::map<size_t, size_t> mapGroupToRunning;
+  std::map<std::string, size_t> mapControllerToRunning;
+
+  // Check on the tests that are running
+  for (const cSelfTestRequest* pRequest : drivesToCheck) {
+    cSelfTestDriveState& state = drives[pRequest->sDevicePath];
+    state.nLastSeenTimestamp = nNow;
+
+    if (state.nRunningStartTimestamp == 0) continue;
+
+    cDriveSelfTestStats stats;
+    stats.type = SELF_TEST_TYPE(state.nRunningType);
+    stats.nStartTimestamp = state.nRunningStartTimestamp;
+
+    cSmartSelfTestStatus status;
+    if (!poll(pRequest->sDevicePath, status)) {
+      // The drive didn't answer, it still counts as testing so that we don't start another test next to it
+      if ((nNow - state.nRunningStartTimestamp) <= MAX_RUNNING_SECONDS) {
+        mapGroupToRunning[pRequest->nGroup]++;
+        if (!pRequest->sController.empty()) mapControllerToRunning[pRequest->sController]++;
+        results[pRequest->sDevicePath] = stats;
+        continue;
+      }
+
+      stats.result = SELF_TEST_RESULT::ABORTED;
+      stats.sStatus = "Timed out";
+    } else if (status.bIsInProgress && ((nNow - state.nRunningStartTimestamp) <= MAX_RUNNING_SECONDS)) {
+      stats.nRemainingPercent = status.nRemainingPercent;
+      mapGroupToRunning[pRequest->nGroup]++;
+      if (!pRequest->sController.empty()) mapControllerToRunning[pRequest->sController]++;
+      results[pRequest->sDevicePath] = stats;
+      continue;
+    } else if (status.bIsInProgress) {
+      stats.result = SELF_TEST_RESULT::ABORTED;
+      stats.sStatus = "Timed out";
+    } else if (status.bHasLastEntry) {
+      stats.result = GetSelfTestResult(status.sLastStatus);
+      stats.sStatus = status.sLastStatus;
+      stats.nPowerOnHours = status.nLastPowerOnHours;
+      stats.nFirstErrorLBA = status.nLastFirstErrorLBA;
+    } else {
+      // The log is empty, the test never ran
+      stats.result = SELF_TEST_RESULT::ABORTED;
+    }
+
+    if (stats.result == SELF_TEST_RESULT::ABORTED) {
+      // Try again the next time the drive is free
+      if (stats.type == SELF_TEST_TYPE::LONG) state.nLastLongTimestamp = 0;
+      else state.nLastShortTimestamp = 0;
+    }
+
+    state.nRunningStartTimestamp = 0;
+    results[pRequest->sDevicePath] = stats;
+  }
+
+  // Find the drives that are due, a long test covers a short test too
+  const int64_t nShortIntervalSeconds = int64_t(settings.nShortIntervalDays) * SECONDS_PER_DAY;
+  const int64_t nLongIntervalSeconds = int64_t(settings.nLongIntervalDays) * SECONDS_PER_DAY;
+
+  std::vector<cDueDrive> due;
+  for (const cSelfTestRequest* pRequest : drivesToCheck) {
+    const cSelfTestDriveState& state = drives[pRequest->sDevicePath];
+    if ((state.nRunningStartTimestamp != 0) || pRequest->bIsInStandby) continue;
+
+    // Report how a test went before starting the next one on the same drive
+    if (results.find(pRequest->sDevicePath) != results.end()) continue;
+
+    const int64_t nLongOverdue = nNow - state.nLastLongTimestamp - nLongIntervalSeconds;
+    const int64_t nShortOverdue = nNow - state.nLastShortTimestamp - nShortIntervalSeconds;
+    if (nLongOverdue >= 0) due.push_back({ pRequest, SELF_TEST_TYPE::LONG, nLongOverdue });
+    else if (nShortOverdue >= 0) due.push_back({ pRequest, SELF_TEST_TYPE::SHORT, nShortOverdue });
+  }
+
+  std::sort(due.begin(), due.end(), [](const cDueDrive& lhs, const cDueDrive& rhs) {
+    if (lhs.nOverdueSeconds != rhs.nOverdueSeconds) return (lhs.nOverdueSeconds > rhs.nOverdueSeconds);
+    return (lhs.pRequest->sDevicePath < rhs.pRequest->sDevicePath);
+  });
+
+  // Start as many as the limits allow, the rest wait for a later collection
+  for (auto& drive : due) {
+    const cSelfTestRequest& request = *drive.pRequest;
+    if (mapGroupToRunning[request.nGroup] >= settings.nMaxPerGroup) continue;
+    if (!request.sController.empty() && (mapControllerToRunning[request.sController] >= settings.nMaxPerController)) continue;
+
+    if (!start(request.sDevicePath, drive.type)) continue;
+
+    cSelfTestDriveState& state = drives[request.sDevicePath];
+    state.nRunningStartTimestamp = nNow;
+    state.nRunningType = uint32_t(drive.type);
+    state.nLastShortTimestamp = nNow;
+    if (drive.type == SELF_TEST_TYPE::LONG) state.nLastLongTimestamp = nNow;
+
+    mapGroupToRunning[request.nGroup]++;
+    if (!request.sController.empty()) mapControllerToRunning[request.sController]++;
+
+    cDriveSelfTestStats stats;
+    stats.type = drive.type;
+    stats.nStartTimestamp = nNow;
+    results[request.sDevicePath] = stats;
+  }
+}
+
+}
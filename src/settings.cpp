@@ -20,7 +20,293 @@ namespace lumberjill {
 
 namespace {
 
-bool ParseJSONSettings(json_object& jobj, std::vector<cGroup>& groups)
+const std::string DEFAULT_SMARTCTL_PATH = "/usr/sbin/smartctl";
+const std::string DEFAULT_BTRFS_PATH = "/usr/sbin/btrfs";
+
+const size_t DEFAULT_DAEMON_INTERVAL_SECONDS = 24 * 60 * 60;
+
+const size_t MAX_LATENCY_PROBE_READ_SIZE_BYTES = 1024 * 1024;
+
+bool ParseJSONAbsolutePath(json_object& parent_obj, const char* key, std::string& sPath)
+{
+  struct json_object* path_obj = json_object_object_get(&parent_obj, key);
+  if (path_obj == nullptr) {
+    // Not specified, keep the default
+    return true;
+  }
+
+  enum json_type type = json_object_get_type(path_obj);
+  if (type != json_type_string) {
+    return false;
+  }
+
+  const char* value = json_object_get_string(path_obj);
+  if (value == nullptr) {
+    return false;
+  }
+
+  const std::string sPathValue(value);
+  if (!IsFilePathAbsolute(sPathValue)) {
+    std::cerr<<"lumber-jill Invalid "<<key<<" path \""<<sPathValue<<"\", it must be absolute"<<std::endl;
+    syslog(LOG_ERR, "lumber-jill Invalid %s path \"%s\", it must be absolute", key, sPathValue.c_str());
+    return false;
+  }
+
+  sPath = sPathValue;
+  return true;
+}
+
+bool ParseJSONPositiveInteger(json_object& parent_obj, const char* key, size_t& value)
+{
+  struct json_object* value_obj = json_object_object_get(&parent_obj, key);
+  if (value_obj == nullptr) {
+    // Not specified, keep the default
+    return true;
+  }
+
+  enum json_type type = json_object_get_type(value_obj);
+  if (type != json_type_int) {
+    return false;
+  }
+
+  const int64_t parsed = json_object_get_int64(value_obj);
+  if (parsed <= 0) {
+    std::cerr<<"lumber-jill Invalid "<<key<<" "<<parsed<<std::endl;
+    syslog(LOG_ERR, "lumber-jill Invalid %s %ld", key, long(parsed));
+    return false;
+  }
+
+  value = size_t(parsed);
+  return true;
+}
+
+bool ParseJSONBoolean(json_object& parent_obj, const char* key, bool& value)
+{
+  struct json_object* value_obj = json_object_object_get(&parent_obj, key);
+  if (value_obj == nullptr) {
+    // Not specified, keep the default
+    return true;
+  }
+
+  enum json_type type = json_object_get_type(value_obj);
+  if (type != json_type_boolean) {
+    return false;
+  }
+
+  value = (json_object_get_boolean(value_obj) != 0);
+  return true;
+}
+
+bool ParseJSONLowImpact(json_object& low_impact_obj, cLowImpactSettings& lowImpactSettings)
+{
+  lowImpactSettings.bEnabled = true;
+
+  if (!ParseJSONBoolean(low_impact_obj, "sched_idle", lowImpactSettings.bSchedIdle)) return false;
+
+  struct json_object* nice_obj = json_object_object_get(&low_impact_obj, "nice");
+  if (nice_obj != nullptr) {
+    if (json_object_get_type(nice_obj) != json_type_int) {
+      return false;
+    }
+
+    const int64_t nice = json_object_get_int64(nice_obj);
+    if ((nice < 0) || (nice > 19)) {
+      std::cerr<<"lumber-jill Invalid nice "<<nice<<", it must be 0 to 19"<<std::endl;
+      syslog(LOG_ERR, "lumber-jill Invalid nice %ld, it must be 0 to 19", long(nice));
+      return false;
+    }
+
+    lowImpactSettings.nNice = size_t(nice);
+  }
+
+  struct json_object* cpus_obj = json_object_object_get(&low_impact_obj, "cpus");
+  if (cpus_obj != nullptr) {
+    if (json_object_get_type(cpus_obj) != json_type_array) {
+      return false;
+    }
+
+    const size_t nCPUs = json_object_array_length(cpus_obj);
+    for (size_t i = 0; i < nCPUs; i++) {
+      struct json_object* cpu_obj = json_object_array_get_idx(cpus_obj, i);
+      if ((cpu_obj == nullptr) || (json_object_get_type(cpu_obj) != json_type_int) || (json_object_get_int64(cpu_obj) < 0)) {
+        return false;
+      }
+
+      lowImpactSettings.cpus.push_back(size_t(json_object_get_int64(cpu_obj)));
+    }
+  }
+
+  struct json_object* cgroup_obj = json_object_object_get(&low_impact_obj, "cgroup");
+  if (cgroup_obj != nullptr) {
+    if (json_object_get_type(cgroup_obj) != json_type_string) {
+      return false;
+    }
+
+    const std::string sCgroupPath(json_object_get_string(cgroup_obj));
+    if (!IsFilePathAbsolute(sCgroupPath)) {
+      std::cerr<<"lumber-jill Invalid cgroup path \""<<sCgroupPath<<"\", it must be absolute"<<std::endl;
+      syslog(LOG_ERR, "lumber-jill Invalid cgroup path \"%s\", it must be absolute", sCgroupPath.c_str());
+      return false;
+    }
+
+    lowImpactSettings.sCgroupPath = sCgroupPath;
+  }
+
+  struct json_object* io_max_obj = json_object_object_get(&low_impact_obj, "io_max");
+  if (io_max_obj != nullptr) {
+    if (json_object_get_type(io_max_obj) != json_type_array) {
+      return false;
+    }
+
+    const size_t nLines = json_object_array_length(io_max_obj);
+    for (size_t i = 0; i < nLines; i++) {
+      struct json_object* line_obj = json_object_array_get_idx(io_max_obj, i);
+      if ((line_obj == nullptr) || (json_object_get_type(line_obj) != json_type_string)) {
+        return false;
+      }
+
+      lowImpactSettings.ioMax.push_back(json_object_get_string(line_obj));
+    }
+  }
+
+  return true;
+}
+
+// Parse a time of day such as "01:30"
+bool ParseTimeOfDay(std::string_view view, size_t& nMinuteOfDay)
+{
+  const size_t colon = view.find(':');
+  if ((colon == std::string_view::npos) || (colon == 0) || (colon > 2) || ((view.length() - colon) != 3)) return false;
+
+  size_t nHour = 0;
+  size_t nMinute = 0;
+  if (!StringParseValue(view.substr(0, colon), nHour) || !StringParseValue(view.substr(colon + 1), nMinute)) return false;
+  if ((nHour > 23) || (nMinute > 59)) return false;
+
+  nMinuteOfDay = (nHour * 60) + nMinute;
+  return true;
+}
+
+bool ParseJSONScrub(json_object& scrub_obj, cScrubSettings& scrubSettings)
+{
+  scrubSettings.bEnabled = true;
+
+  if (!ParseJSONPositiveInteger(scrub_obj, "interval_days", scrubSettings.nIntervalDays)) return false;
+  if (!ParseJSONPositiveInteger(scrub_obj, "bandwidth_limit_bytes_per_second", scrubSettings.nBandwidthLimitBytesPerSecond)) return false;
+  if (!ParseJSONPositiveInteger(scrub_obj, "max_await_ms", scrubSettings.nMaxAwaitMS)) return false;
+  if (!ParseJSONPositiveInteger(scrub_obj, "pause_minutes", scrubSettings.nPauseMinutes)) return false;
+  if (!ParseJSONPositiveInteger(scrub_obj, "poll_interval_seconds", scrubSettings.nPollIntervalSeconds)) return false;
+
+  struct json_object* windows_obj = json_object_object_get(&scrub_obj, "windows");
+  if (windows_obj != nullptr) {
+    if (json_object_get_type(windows_obj) != json_type_array) {
+      return false;
+    }
+
+    const size_t nWindows = json_object_array_length(windows_obj);
+    for (size_t i = 0; i < nWindows; i++) {
+      struct json_object* window_obj = json_object_array_get_idx(windows_obj, i);
+      if ((window_obj == nullptr) || (json_object_get_type(window_obj) != json_type_object)) {
+        return false;
+      }
+
+      struct json_object* start_obj = json_object_object_get(window_obj, "start");
+      struct json_object* end_obj = json_object_object_get(window_obj, "end");
+      if ((start_obj == nullptr) || (json_object_get_type(start_obj) != json_type_string) || (end_obj == nullptr) || (json_object_get_type(end_obj) != json_type_string)) {
+        return false;
+      }
+
+      cScrubWindow window;
+      const std::string sStart(json_object_get_string(start_obj));
+      const std::string sEnd(json_object_get_string(end_obj));
+      if (!ParseTimeOfDay(sStart, window.nStartMinute) || !ParseTimeOfDay(sEnd, window.nEndMinute)) {
+        std::cerr<<"lumber-jill Invalid scrub window \""<<sStart<<"\" to \""<<sEnd<<"\", the times must be HH:MM"<<std::endl;
+        syslog(LOG_ERR, "lumber-jill Invalid scrub window \"%s\" to \"%s\", the times must be HH:MM", sStart.c_str(), sEnd.c_str());
+        return false;
+      }
+
+      scrubSettings.windows.push_back(window);
+    }
+  }
+
+  return true;
+}
+
+bool ParseJSONRemote(json_object& remote_obj, cRemoteSettings& remoteSettings)
+{
+  remoteSettings.bEnabled = true;
+
+  struct json_object* host_obj = json_object_object_get(&remote_obj, "host");
+  if ((host_obj == nullptr) || (json_object_get_type(host_obj) != json_type_string)) {
+    return false;
+  }
+  remoteSettings.sHost = json_object_get_string(host_obj);
+
+  if (!ParseJSONPositiveInteger(remote_obj, "port", remoteSettings.nPort)) return false;
+
+  struct json_object* protocol_obj = json_object_object_get(&remote_obj, "protocol");
+  if (protocol_obj != nullptr) {
+    if (json_object_get_type(protocol_obj) != json_type_string) {
+      return false;
+    }
+
+    const std::string sProtocol(json_object_get_string(protocol_obj));
+    if (sProtocol == "tcp") remoteSettings.protocol = REMOTE_PROTOCOL::TCP;
+    else if (sProtocol == "udp") remoteSettings.protocol = REMOTE_PROTOCOL::UDP;
+    else {
+      std::cerr<<"lumber-jill Invalid remote protocol \""<<sProtocol<<"\", it must be tcp or udp"<<std::endl;
+      syslog(LOG_ERR, "lumber-jill Invalid remote protocol \"%s\", it must be tcp or udp", sProtocol.c_str());
+      return false;
+    }
+  }
+
+  if (!ParseJSONAbsolutePath(remote_obj, "spool_file", remoteSettings.sSpoolFilePath)) return false;
+  if (!ParseJSONPositiveInteger(remote_obj, "spool_size_bytes", remoteSettings.nSpoolSizeBytes)) return false;
+  if (!ParseJSONPositiveInteger(remote_obj, "reconnect_min_ms", remoteSettings.nReconnectMinMS)) return false;
+  if (!ParseJSONPositiveInteger(remote_obj, "reconnect_max_ms", remoteSettings.nReconnectMaxMS)) return false;
+
+  return true;
+}
+
+bool ParseJSONOutput(json_object& output_obj, cOutputSettings& outputSettings)
+{
+  if (!ParseJSONPositiveInteger(output_obj, "queue_size", outputSettings.nQueueSize)) return false;
+  if (!ParseJSONPositiveInteger(output_obj, "batch_size", outputSettings.nBatchSize)) return false;
+  if (!ParseJSONBoolean(output_obj, "stdout", outputSettings.bStdout)) return false;
+  if (!ParseJSONBoolean(output_obj, "syslog", outputSettings.bSyslog)) return false;
+  if (!ParseJSONAbsolutePath(output_obj, "file", outputSettings.sFilePath)) return false;
+
+  // Parse the optional "remote", records are only shipped if this is present
+  struct json_object* remote_obj = json_object_object_get(&output_obj, "remote");
+  if (remote_obj != nullptr) {
+    if (json_object_get_type(remote_obj) != json_type_object) {
+      return false;
+    }
+
+    if (!ParseJSONRemote(*remote_obj, outputSettings.remote)) return false;
+  }
+
+  struct json_object* policy_obj = json_object_object_get(&output_obj, "policy");
+  if (policy_obj != nullptr) {
+    if (json_object_get_type(policy_obj) != json_type_string) {
+      return false;
+    }
+
+    const std::string sPolicy(json_object_get_string(policy_obj));
+    if (sPolicy == "block") outputSettings.policy = OUTPUT_POLICY::BLOCK;
+    else if (sPolicy == "drop_oldest") outputSettings.policy = OUTPUT_POLICY::DROP_OLDEST;
+    else if (sPolicy == "coalesce") outputSettings.policy = OUTPUT_POLICY::COALESCE;
+    else {
+      std::cerr<<"lumber-jill Invalid output policy \""<<sPolicy<<"\", it must be block, drop_oldest or coalesce"<<std::endl;
+      syslog(LOG_ERR, "lumber-jill Invalid output policy \"%s\", it must be block, drop_oldest or coalesce", sPolicy.c_str());
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool ParseJSONSettings(json_object& jobj, std::vector<cGroup>& groups, std::string& sSmartCtlPath, std::string& sBtrfsPath, size_t& nDaemonIntervalSeconds, cLatencyProbeSettings& latencyProbeSettings, cLowImpactSettings& lowImpactSettings, cSmartScheduleSettings& smartScheduleSettings, cSelfTestSettings& selfTestSettings, cTemperatureSettings& temperatureSettings, cKernelLogSettings& kernelLogSettings, cAnomalySettings& anomalySettings, cCapacitySettings& capacitySettings, cQgroupSettings& qgroupSettings, cScrubSettings& scrubSettings, cQuerySettings& querySettings, cOutputSettings& outputSettings)
 {
   groups.clear();
 
@@ -31,6 +317,186 @@ bool ParseJSONSettings(json_object& jobj, std::vector<cGroup>& groups)
       return false;
     }
 
+    // Parse the optional "tools"
+    struct json_object* tools_obj = json_object_object_get(settings_val, "tools");
+    if (tools_obj != nullptr) {
+      enum json_type type_tools = json_object_get_type(tools_obj);
+      if (type_tools != json_type_object) {
+        return false;
+      }
+
+      if (!ParseJSONAbsolutePath(*tools_obj, "smartctl", sSmartCtlPath)) return false;
+      if (!ParseJSONAbsolutePath(*tools_obj, "btrfs", sBtrfsPath)) return false;
+    }
+
+    // Parse the optional "daemon"
+    struct json_object* daemon_obj = json_object_object_get(settings_val, "daemon");
+    if (daemon_obj != nullptr) {
+      enum json_type type_daemon = json_object_get_type(daemon_obj);
+      if (type_daemon != json_type_object) {
+        return false;
+      }
+
+      if (!ParseJSONPositiveInteger(*daemon_obj, "interval_seconds", nDaemonIntervalSeconds)) return false;
+    }
+
+    // Parse the optional "latency_probe", the probe is only enabled if this is present
+    struct json_object* latency_probe_obj = json_object_object_get(settings_val, "latency_probe");
+    if (latency_probe_obj != nullptr) {
+      enum json_type type_latency_probe = json_object_get_type(latency_probe_obj);
+      if (type_latency_probe != json_type_object) {
+        return false;
+      }
+
+      latencyProbeSettings.bEnabled = true;
+      if (!ParseJSONPositiveInteger(*latency_probe_obj, "reads", latencyProbeSettings.nReads)) return false;
+      if (!ParseJSONPositiveInteger(*latency_probe_obj, "read_size_bytes", latencyProbeSettings.nReadSizeBytes)) return false;
+      if (!ParseJSONPositiveInteger(*latency_probe_obj, "reads_per_second", latencyProbeSettings.nReadsPerSecond)) return false;
+      if (!ParseJSONPositiveInteger(*latency_probe_obj, "outlier_factor", latencyProbeSettings.nOutlierFactor)) return false;
+    }
+
+    // Parse the optional "low_impact", low impact mode is only enabled if this is present
+    struct json_object* low_impact_obj = json_object_object_get(settings_val, "low_impact");
+    if (low_impact_obj != nullptr) {
+      enum json_type type_low_impact = json_object_get_type(low_impact_obj);
+      if (type_low_impact != json_type_object) {
+        return false;
+      }
+
+      if (!ParseJSONLowImpact(*low_impact_obj, lowImpactSettings)) return false;
+    }
+
+    // Parse the optional "smart_schedule"
+    struct json_object* smart_schedule_obj = json_object_object_get(settings_val, "smart_schedule");
+    if (smart_schedule_obj != nullptr) {
+      enum json_type type_smart_schedule = json_object_get_type(smart_schedule_obj);
+      if (type_smart_schedule != json_type_object) {
+        return false;
+      }
+
+      if (!ParseJSONPositiveInteger(*smart_schedule_obj, "window_seconds", smartScheduleSettings.nWindowSeconds)) return false;
+      if (!ParseJSONPositiveInteger(*smart_schedule_obj, "max_per_controller", smartScheduleSettings.nMaxPerController)) return false;
+      if (!ParseJSONPositiveInteger(*smart_schedule_obj, "deadline_seconds", smartScheduleSettings.nDeadlineSeconds)) return false;
+      if (!ParseJSONBoolean(*smart_schedule_obj, "skip_standby", smartScheduleSettings.bSkipStandby)) return false;
+    }
+
+    // Parse the optional "self_test", self-tests are only run if this is present
+    struct json_object* self_test_obj = json_object_object_get(settings_val, "self_test");
+    if (self_test_obj != nullptr) {
+      enum json_type type_self_test = json_object_get_type(self_test_obj);
+      if (type_self_test != json_type_object) {
+        return false;
+      }
+
+      selfTestSettings.bEnabled = true;
+      if (!ParseJSONAbsolutePath(*self_test_obj, "state_file", selfTestSettings.sStateFilePath)) return false;
+      if (!ParseJSONPositiveInteger(*self_test_obj, "short_interval_days", selfTestSettings.nShortIntervalDays)) return false;
+      if (!ParseJSONPositiveInteger(*self_test_obj, "long_interval_days", selfTestSettings.nLongIntervalDays)) return false;
+      if (!ParseJSONPositiveInteger(*self_test_obj, "max_per_group", selfTestSettings.nMaxPerGroup)) return false;
+      if (!ParseJSONPositiveInteger(*self_test_obj, "max_per_controller", selfTestSettings.nMaxPerController)) return false;
+    }
+
+    // Parse the optional "temperature"
+    struct json_object* temperature_obj = json_object_object_get(settings_val, "temperature");
+    if (temperature_obj != nullptr) {
+      enum json_type type_temperature = json_object_get_type(temperature_obj);
+      if (type_temperature != json_type_object) {
+        return false;
+      }
+
+      if (!ParseJSONPositiveInteger(*temperature_obj, "sample_interval_seconds", temperatureSettings.nSampleIntervalSeconds)) return false;
+      if (!ParseJSONBoolean(*temperature_obj, "io_uring", temperatureSettings.bUseIOUring)) return false;
+    }
+
+    // Parse the optional "kernel_log", the kernel log is only watched if this is present
+    struct json_object* kernel_log_obj = json_object_object_get(settings_val, "kernel_log");
+    if (kernel_log_obj != nullptr) {
+      enum json_type type_kernel_log = json_object_get_type(kernel_log_obj);
+      if (type_kernel_log != json_type_object) {
+        return false;
+      }
+
+      kernelLogSettings.bEnabled = true;
+      if (!ParseJSONPositiveInteger(*kernel_log_obj, "threshold", kernelLogSettings.nThreshold)) return false;
+      if (!ParseJSONPositiveInteger(*kernel_log_obj, "window_seconds", kernelLogSettings.nWindowSeconds)) return false;
+      if (!ParseJSONPositiveInteger(*kernel_log_obj, "cooldown_seconds", kernelLogSettings.nCooldownSeconds)) return false;
+    }
+
+    // Parse the optional "anomaly", anomaly detection is only enabled if this is present
+    struct json_object* anomaly_obj = json_object_object_get(settings_val, "anomaly");
+    if (anomaly_obj != nullptr) {
+      enum json_type type_anomaly = json_object_get_type(anomaly_obj);
+      if (type_anomaly != json_type_object) {
+        return false;
+      }
+
+      anomalySettings.bEnabled = true;
+      if (!ParseJSONAbsolutePath(*anomaly_obj, "state_file", anomalySettings.sStateFilePath)) return false;
+      if (!ParseJSONPositiveInteger(*anomaly_obj, "half_life_samples", anomalySettings.nHalfLifeSamples)) return false;
+      if (!ParseJSONPositiveInteger(*anomaly_obj, "warmup_samples", anomalySettings.nWarmupSamples)) return false;
+      if (!ParseJSONPositiveInteger(*anomaly_obj, "threshold_sigma", anomalySettings.nThresholdSigma)) return false;
+    }
+
+    // Parse the optional "capacity", capacity forecasting is only enabled if this is present
+    struct json_object* capacity_obj = json_object_object_get(settings_val, "capacity");
+    if (capacity_obj != nullptr) {
+      enum json_type type_capacity = json_object_get_type(capacity_obj);
+      if (type_capacity != json_type_object) {
+        return false;
+      }
+
+      capacitySettings.bEnabled = true;
+      if (!ParseJSONAbsolutePath(*capacity_obj, "state_file", capacitySettings.sStateFilePath)) return false;
+      if (!ParseJSONPositiveInteger(*capacity_obj, "horizon_days", capacitySettings.nHorizonDays)) return false;
+      if (!ParseJSONPositiveInteger(*capacity_obj, "trend_half_life_hours", capacitySettings.nTrendHalfLifeHours)) return false;
+    }
+
+    // Parse the optional "qgroup", subvolume usage is only collected if this is present
+    struct json_object* qgroup_obj = json_object_object_get(settings_val, "qgroup");
+    if (qgroup_obj != nullptr) {
+      enum json_type type_qgroup = json_object_get_type(qgroup_obj);
+      if (type_qgroup != json_type_object) {
+        return false;
+      }
+
+      qgroupSettings.bEnabled = true;
+      if (!ParseJSONPositiveInteger(*qgroup_obj, "top", qgroupSettings.nTop)) return false;
+    }
+
+    // Parse the optional "scrub", the daemon only scrubs if this is present
+    struct json_object* scrub_obj = json_object_object_get(settings_val, "scrub");
+    if (scrub_obj != nullptr) {
+      enum json_type type_scrub = json_object_get_type(scrub_obj);
+      if (type_scrub != json_type_object) {
+        return false;
+      }
+
+      if (!ParseJSONScrub(*scrub_obj, scrubSettings)) return false;
+    }
+
+    // Parse the optional "query", the query socket is only created if this is present
+    struct json_object* query_obj = json_object_object_get(settings_val, "query");
+    if (query_obj != nullptr) {
+      enum json_type type_query = json_object_get_type(query_obj);
+      if (type_query != json_type_object) {
+        return false;
+      }
+
+      querySettings.bEnabled = true;
+      if (!ParseJSONAbsolutePath(*query_obj, "socket_path", querySettings.sSocketPath)) return false;
+    }
+
+    // Parse the optional "output"
+    struct json_object* output_obj = json_object_object_get(settings_val, "output");
+    if (output_obj != nullptr) {
+      enum json_type type_output = json_object_get_type(output_obj);
+      if (type_output != json_type_object) {
+        return false;
+      }
+
+      if (!ParseJSONOutput(*output_obj, outputSettings)) return false;
+    }
+
     // Parse "group"
     struct json_object* groups_array = json_object_object_get(settings_val, "groups");
     if (groups_array == nullptr) {
@@ -113,6 +579,10 @@ bool ParseJSONSettings(json_object& jobj, std::vector<cGroup>& groups)
         //std::cout<<"lumber-jill Group mount point found \""<<group.sMountPoint<<"\""<<std::endl;
       }
 
+      if (!ParseJSONPositiveInteger(*group_obj, "mount_timeout_ms", group.nMountTimeoutMS)) {
+        return false;
+      }
+
       {
         struct json_object* devices_obj = json_object_object_get(group_obj, "devices");
         if (devices_obj == nullptr) {
@@ -120,7 +590,17 @@ bool ParseJSONSettings(json_object& jobj, std::vector<cGroup>& groups)
         }
 
         enum json_type devices_type = json_object_get_type(devices_obj);
-        if (devices_type != json_type_array) {
+        if (devices_type == json_type_string) {
+          // "devices": "auto" means find the devices from the mount point
+          const char* value = json_object_get_string(devices_obj);
+          if ((value == nullptr) || (strcmp(value, "auto") != 0)) {
+            return false;
+          }
+
+          group.bAutoDiscoverDevices = true;
+          groups.push_back(group);
+          continue;
+        } else if (devices_type != json_type_array) {
           return false;
         }
 
@@ -206,6 +686,15 @@ bool ParseJSONSettings(json_object& jobj, std::vector<cGroup>& groups)
 
 }
 
+cSettings::cSettings()
+{
+  Clear();
+}
+
+cSettings::~cSettings()
+{
+}
+
 bool cSettings::LoadFromFile(const std::string& sFilePath)
 {
   Clear();
@@ -222,7 +711,7 @@ bool cSettings::LoadFromFile(const std::string& sFilePath)
   }
 
   // Parse the JSON tree
-  if (!ParseJSONSettings(*jobj, groups)) return false;
+  if (!ParseJSONSettings(*jobj, groups, sSmartCtlPath, sBtrfsPath, nDaemonIntervalSeconds, latencyProbeSettings, lowImpactSettings, smartScheduleSettings, selfTestSettings, temperatureSettings, kernelLogSettings, anomalySettings, capacitySettings, qgroupSettings, scrubSettings, querySettings, outputSettings)) return false;
 
   return IsValid();
 }
@@ -232,10 +721,64 @@ bool cSettings::IsValid() const
   // We need at least one group to monitor
   if (groups.empty()) return false;
 
+  // We only run executables with absolute paths
+  if (!IsFilePathAbsolute(sSmartCtlPath) || !IsFilePathAbsolute(sBtrfsPath)) return false;
+
+  if (nDaemonIntervalSeconds == 0) return false;
+
+  if (latencyProbeSettings.bEnabled) {
+    // Keep the reads small, this is a probe not a benchmark
+    if ((latencyProbeSettings.nReads == 0) || (latencyProbeSettings.nReadSizeBytes == 0) || (latencyProbeSettings.nReadSizeBytes > MAX_LATENCY_PROBE_READ_SIZE_BYTES)) return false;
+    if ((latencyProbeSettings.nReadsPerSecond == 0) || (latencyProbeSettings.nOutlierFactor == 0)) return false;
+  }
+
+  if (lowImpactSettings.bEnabled) {
+    if (lowImpactSettings.nNice > 19) return false;
+
+    // io.max limits need a cgroup to go in
+    if (!lowImpactSettings.ioMax.empty() && lowImpactSettings.sCgroupPath.empty()) return false;
+  }
+
+  if (smartScheduleSettings.nMaxPerController == 0) return false;
+
+  if (selfTestSettings.bEnabled && (selfTestSettings.sStateFilePath.empty() || (selfTestSettings.nShortIntervalDays == 0) || (selfTestSettings.nLongIntervalDays == 0) || (selfTestSettings.nMaxPerGroup == 0) || (selfTestSettings.nMaxPerController == 0))) return false;
+
+  if (temperatureSettings.nSampleIntervalSeconds == 0) return false;
+
+  if (kernelLogSettings.bEnabled && ((kernelLogSettings.nThreshold == 0) || (kernelLogSettings.nWindowSeconds == 0))) return false;
+
+  if (anomalySettings.bEnabled && (anomalySettings.sStateFilePath.empty() || (anomalySettings.nHalfLifeSamples == 0) || (anomalySettings.nThresholdSigma == 0))) return false;
+
+  if (capacitySettings.bEnabled && (capacitySettings.sStateFilePath.empty() || (capacitySettings.nHorizonDays == 0) || (capacitySettings.nTrendHalfLifeHours == 0))) return false;
+
+  if (scrubSettings.bEnabled) {
+    if ((scrubSettings.nIntervalDays == 0) || (scrubSettings.nPollIntervalSeconds == 0)) return false;
+
+    // An empty window would never scrub
+    for (auto& window : scrubSettings.windows) {
+      if (window.nStartMinute == window.nEndMinute) return false;
+    }
+  }
+
+  const cRemoteSettings& remoteSettings = outputSettings.remote;
+  if (remoteSettings.bEnabled) {
+    if (remoteSettings.sHost.empty() || (remoteSettings.nPort > 65535)) return false;
+    if (remoteSettings.nReconnectMinMS > remoteSettings.nReconnectMaxMS) return false;
+  }
+
+  // The queries have to be able to start within the deadline
+  if ((smartScheduleSettings.nDeadlineSeconds != 0) && (smartScheduleSettings.nWindowSeconds > smartScheduleSettings.nDeadlineSeconds)) return false;
+
   for (auto& group : groups) {
     // Every group must have a mount point to monitor
     if (group.sMountPoint.empty()) return false;
 
+    // We need some time to query the mount
+    if (group.nMountTimeoutMS == 0) return false;
+
+    // Auto discovered devices are filled in later
+    if (group.bAutoDiscoverDevices) continue;
+
     // Each group must have at least one device
     if (group.devices.empty()) return false;
 
@@ -257,6 +800,24 @@ bool cSettings::IsValid() const
 void cSettings::Clear()
 {
   groups.clear();
+
+  sSmartCtlPath = DEFAULT_SMARTCTL_PATH;
+  sBtrfsPath = DEFAULT_BTRFS_PATH;
+
+  nDaemonIntervalSeconds = DEFAULT_DAEMON_INTERVAL_SECONDS;
+
+  latencyProbeSettings = cLatencyProbeSettings();
+  lowImpactSettings = cLowImpactSettings();
+  smartScheduleSettings = cSmartScheduleSettings();
+  selfTestSettings = cSelfTestSettings();
+  temperatureSettings = cTemperatureSettings();
+  kernelLogSettings = cKernelLogSettings();
+  anomalySettings = cAnomalySettings();
+  capacitySettings = cCapacitySettings();
+  qgroupSettings = cQgroupSettings();
+  scrubSettings = cScrubSettings();
+  querySettings = cQuerySettings();
+  outputSettings = cOutputSettings();
 }
 
 }
@@ -0,0 +1,329 @@
+#include <algorithm>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+#include <syslog.h>
+
+#include "smart_scheduler.h"
+
+namespace lumberjill {
+
+namespace {
+
+// FNV-1a, unlike std::hash this gives the same offsets on every machine and every run
+uint64_t StableHash(std::string_view value)
+{
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (const char c : value) {
+    hash ^= uint64_t(static_cast<unsigned char>(c));
+    hash *= 0x100000001b3ull;
+  }
+
+  return hash;
+}
+
+uint64_t GetElapsedMS(std::chrono::steady_clock::time_point start)
+{
+  return uint64_t(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+// How often a run that can be stopped checks whether it has been
+const std::chrono::milliseconds STOP_POLL_INTERVAL(100);
+
+enum class QUERY_STATE {
+  WAITING,
+  RUNNING,
+  FINISHED  // Or skipped or abandoned
+};
+
+// Shared by RunSmartCall and its thread
+class cSmartCall {
+public:
+  cSmartCall() : bDone(false), bResult(false) {}
+
+  std::mutex mutex;
+  std::condition_variable finished;
+  bool bDone;
+  bool bResult;
+};
+
+// Shared by a run and its query threads, an abandoned query thread keeps it alive until its smartctl call returns
+class cSmartRunState {
+public:
+  explicit cSmartRunState(const std::vector<cSmartScheduleEntry>& _entries) : entries(_entries), entryResults(_entries.size()), queryStates(_entries.size(), QUERY_STATE::WAITING), nFinished(0) {}
+
+  std::mutex mutex;
+  std::condition_variable finished;
+
+  std::vector<cSmartScheduleEntry> entries;
+  std::vector<cSmartCtlStats> entryResults;
+  std::vector<QUERY_STATE> queryStates;
+  std::map<std::string, size_t> mapControllerToActive;
+  size_t nFinished;
+};
+
+}
+
+cSmartDevicesInFlight::cSmartDevicesInFlight()
+{
+}
+
+cSmartDevicesInFlight::~cSmartDevicesInFlight()
+{
+}
+
+bool cSmartDevicesInFlight::TryAdd(const std::string& sDevicePath)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return devices.insert(sDevicePath).second;
+}
+
+void cSmartDevicesInFlight::Remove(const std::string& sDevicePath)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  devices.erase(sDevicePath);
+}
+
+bool cSmartDevicesInFlight::IsInFlight(const std::string& sDevicePath) const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return (devices.find(sDevicePath) != devices.end());
+}
+
+
+SMART_QUERY_RESULT RunSmartCall(const std::shared_ptr<cSmartDevicesInFlight>& devicesInFlight, const std::string& sDevicePath, std::chrono::milliseconds timeout, const std::atomic<bool>& bStopRequested, std::function<bool()> call)
+{
+  if (!devicesInFlight->TryAdd(sDevicePath)) {
+    std::cerr<<"lumber-jill SMART query for \""<<sDevicePath<<"\" is still running, skipping"<<std::endl;
+    syslog(LOG_ERR, "lumber-jill SMART query for \"%s\" is still running, skipping", sDevicePath.c_str());
+    return SMART_QUERY_RESULT::SKIPPED;
+  }
+
+  std::shared_ptr<cSmartCall> pending = std::make_shared<cSmartCall>();
+
+  std::thread([pending, devicesInFlight, sDevicePath, call]() {
+    const bool bResult = call();
+    devicesInFlight->Remove(sDevicePath);
+
+    std::lock_guard<std::mutex> lock(pending->mutex);
+    pending->bDone = true;
+    pending->bResult = bResult;
+    pending->finished.notify_all();
+  }).detach();
+
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  std::unique_lock<std::mutex> lock(pending->mutex);
+  while (!pending->bDone) {
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (bStopRequested || ((timeout.count() != 0) && (now >= (start + timeout)))) {
+      std::cerr<<"lumber-jill SMART query for \""<<sDevicePath<<"\" did not finish in time"<<std::endl;
+      syslog(LOG_ERR, "lumber-jill SMART query for \"%s\" did not finish in time", sDevicePath.c_str());
+      return SMART_QUERY_RESULT::TIMED_OUT;
+    }
+
+    // Check for a stop request now and then
+    std::chrono::steady_clock::time_point next_wakeup = now + STOP_POLL_INTERVAL;
+    if (timeout.count() != 0) {
+      next_wakeup = std::min(next_wakeup, start + timeout);
+    }
+
+    pending->finished.wait_until(lock, next_wakeup);
+  }
+
+  return pending->bResult ? SMART_QUERY_RESULT::OK : SMART_QUERY_RESULT::ERROR;
+}
+
+
+cSmartScheduler::cSmartScheduler(std::chrono::milliseconds _window, size_t _nMaxPerController, std::chrono::milliseconds _deadline, QueryFunction _query) :
+  window(_window),
+  nMaxPerController(std::max<size_t>(1, _nMaxPerController)),
+  deadline(_deadline),
+  query(_query),
+  devicesInFlight(std::make_shared<cSmartDevicesInFlight>())
+{
+}
+
+cSmartScheduler::cSmartScheduler(std::chrono::milliseconds _window, size_t _nMaxPerController, std::chrono::milliseconds _deadline, QueryFunction _query, std::shared_ptr<cSmartDevicesInFlight> _devicesInFlight) :
+  window(_window),
+  nMaxPerController(std::max<size_t>(1, _nMaxPerController)),
+  deadline(_deadline),
+  query(_query),
+  devicesInFlight(_devicesInFlight)
+{
+}
+
+cSmartScheduler::~cSmartScheduler()
+{
+}
+
+void cSmartScheduler::Plan(const std::vector<cSmartQueryRequest>& requests, cSmartSchedule& schedule) const
+{
+  schedule = cSmartSchedule();
+  schedule.nWindowMS = uint64_t(window.count());
+  schedule.nDeadlineMS = uint64_t(deadline.count());
+  schedule.nMaxPerController = nMaxPerController;
+
+  std::map<std::string, std::vector<const cSmartQueryRequest*>> mapControllerToRequests;
+  for (auto& request : requests) {
+    mapControllerToRequests[request.sController].push_back(&request);
+  }
+
+  for (auto& item : mapControllerToRequests) {
+    std::vector<const cSmartQueryRequest*>& controllerRequests = item.second;
+    std::sort(controllerRequests.begin(), controllerRequests.end(), [](const cSmartQueryRequest* a, const cSmartQueryRequest* b) {
+      const uint64_t hash_a = StableHash(a->sDevicePath);
+      const uint64_t hash_b = StableHash(b->sDevicePath);
+      return (hash_a != hash_b) ? (hash_a < hash_b) : (a->sDevicePath < b->sDevicePath);
+    });
+
+    // Evenly space this controller's queries, each controller starts at a different point in its first slot so that the controllers don't all start together
+    const uint64_t nSlotMS = schedule.nWindowMS / controllerRequests.size();
+    const uint64_t nPhaseMS = (nSlotMS != 0) ? (StableHash(item.first) % nSlotMS) : 0;
+
+    for (size_t i = 0; i < controllerRequests.size(); i++) {
+      cSmartScheduleEntry entry;
+      entry.sDevicePath = controllerRequests[i]->sDevicePath;
+      entry.sController = controllerRequests[i]->sController;
+      entry.nOffsetMS = nPhaseMS + (i * nSlotMS);
+      schedule.entries.push_back(entry);
+    }
+  }
+
+  std::stable_sort(schedule.entries.begin(), schedule.entries.end(), [](const cSmartScheduleEntry& a, const cSmartScheduleEntry& b) {
+    return (a.nOffsetMS < b.nOffsetMS);
+  });
+}
+
+void cSmartScheduler::Run(cSmartSchedule& schedule, std::map<std::string, cSmartCtlStats>& results) const
+{
+  RunUntil(schedule, results, nullptr);
+}
+
+void cSmartScheduler::Run(cSmartSchedule& schedule, std::map<std::string, cSmartCtlStats>& results, const std::atomic<bool>& bStopRequested) const
+{
+  RunUntil(schedule, results, &bStopRequested);
+}
+
+void cSmartScheduler::RunUntil(cSmartSchedule& schedule, std::map<std::string, cSmartCtlStats>& results, const std::atomic<bool>* pStopRequested) const
+{
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  // The query threads only use the shared state so that a query that is still running at the deadline can be left behind
+  std::shared_ptr<cSmartRunState> state = std::make_shared<cSmartRunState>(schedule.entries);
+
+  {
+    std::unique_lock<std::mutex> lock(state->mutex);
+
+    while (state->nFinished < state->entries.size()) {
+      const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      const bool bIsPastDeadline = ((deadline.count() != 0) && (now >= (start + deadline)));
+      const bool bIsStopping = ((pStopRequested != nullptr) && *pStopRequested);
+
+      if (bIsPastDeadline || bIsStopping) {
+        // Queries that haven't started are skipped, queries that are still running are abandoned and their results are ignored when they do finish
+        for (size_t i = 0; i < state->entries.size(); i++) {
+          cSmartScheduleEntry& entry = state->entries[i];
+          if (state->queryStates[i] == QUERY_STATE::WAITING) {
+            entry.result = SMART_QUERY_RESULT::SKIPPED;
+          } else if (state->queryStates[i] == QUERY_STATE::RUNNING) {
+            entry.nDurationMS = GetElapsedMS(start) - entry.nStartMS;
+            entry.result = SMART_QUERY_RESULT::TIMED_OUT;
+          } else {
+            continue;
+          }
+
+          state->queryStates[i] = QUERY_STATE::FINISHED;
+          state->nFinished++;
+        }
+
+        break;
+      }
+
+      std::chrono::steady_clock::time_point next_wakeup = std::chrono::steady_clock::time_point::max();
+
+      for (size_t i = 0; i < state->entries.size(); i++) {
+        if (state->queryStates[i] != QUERY_STATE::WAITING) continue;
+
+        cSmartScheduleEntry& entry = state->entries[i];
+
+        const std::chrono::steady_clock::time_point due = start + std::chrono::milliseconds(entry.nOffsetMS);
+        if (due > now) {
+          next_wakeup = std::min(next_wakeup, due);
+          continue;
+        }
+
+        size_t& nActive = state->mapControllerToActive[entry.sController];
+        if (nActive >= nMaxPerController) continue;
+
+        // A call that an earlier run abandoned is still stuck on this drive, don't pile another one up behind it
+        if (!devicesInFlight->TryAdd(entry.sDevicePath)) {
+          std::cerr<<"lumber-jill SMART query for \""<<entry.sDevicePath<<"\" is still running, skipping"<<std::endl;
+          syslog(LOG_ERR, "lumber-jill SMART query for \"%s\" is still running, skipping", entry.sDevicePath.c_str());
+          entry.result = SMART_QUERY_RESULT::SKIPPED;
+          state->queryStates[i] = QUERY_STATE::FINISHED;
+          state->nFinished++;
+          continue;
+        }
+
+        nActive++;
+        state->queryStates[i] = QUERY_STATE::RUNNING;
+        entry.nStartMS = GetElapsedMS(start);
+
+        std::thread([threadState = state, threadQuery = query, threadDevicesInFlight = devicesInFlight, i, start, sDevicePath = entry.sDevicePath]() {
+          cSmartCtlStats smartctlStats;
+          const bool bResult = threadQuery(sDevicePath, smartctlStats);
+          threadDevicesInFlight->Remove(sDevicePath);
+
+          std::lock_guard<std::mutex> query_lock(threadState->mutex);
+
+          // Run has already given up on this query
+          if (threadState->queryStates[i] == QUERY_STATE::FINISHED) return;
+
+          cSmartScheduleEntry& threadEntry = threadState->entries[i];
+          threadState->entryResults[i] = smartctlStats;
+          threadEntry.nDurationMS = GetElapsedMS(start) - threadEntry.nStartMS;
+          threadEntry.result = !bResult ? SMART_QUERY_RESULT::ERROR : smartctlStats.bIsInStandby ? SMART_QUERY_RESULT::STANDBY : SMART_QUERY_RESULT::OK;
+          threadState->queryStates[i] = QUERY_STATE::FINISHED;
+          threadState->mapControllerToActive[threadEntry.sController]--;
+          threadState->nFinished++;
+          threadState->finished.notify_all();
+        }).detach();
+      }
+
+      if (state->nFinished == state->entries.size()) break;
+
+      // Wake up when a query finishes, when the next query is due, or at the deadline
+      if (deadline.count() != 0) {
+        next_wakeup = std::min(next_wakeup, start + deadline);
+      }
+
+      // Check for a stop request now and then
+      if (pStopRequested != nullptr) {
+        next_wakeup = std::min(next_wakeup, std::chrono::steady_clock::now() + STOP_POLL_INTERVAL);
+      }
+
+      if (next_wakeup == std::chrono::steady_clock::time_point::max()) {
+        state->finished.wait(lock);
+      } else {
+        state->finished.wait_until(lock, next_wakeup);
+      }
+    }
+
+    schedule.entries = state->entries;
+    schedule.nDurationMS = GetElapsedMS(start);
+
+    for (size_t i = 0; i < schedule.entries.size(); i++) {
+      const SMART_QUERY_RESULT result = schedule.entries[i].result;
+      if ((result != SMART_QUERY_RESULT::SKIPPED) && (result != SMART_QUERY_RESULT::TIMED_OUT)) {
+        results[schedule.entries[i].sDevicePath] = state->entryResults[i];
+      }
+    }
+  }
+}
+
+}
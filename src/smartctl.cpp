@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <cstring>
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <filesystem>
@@ -30,6 +31,42 @@ bool ParseSmartCtlRawValue(std::string_view line, size_t& value)
   return true;
 }
 
+// Get the first run of digits in a string
+std::string_view GetFirstNumber(std::string_view text)
+{
+  const size_t start = text.find_first_of("0123456789");
+  if (start == std::string_view::npos) {
+    return std::string_view();
+  }
+
+  const size_t end = text.find_first_not_of("0123456789", start);
+  return text.substr(start, (end == std::string_view::npos) ? std::string_view::npos : (end - start));
+}
+
+// The temperature raw value can have extra information after it, "194 Temperature_Celsius ... -       35 (Min/Max 20/45)"
+// so we take the 10th column instead of the last one
+bool ParseSmartCtlTemperature(std::string_view line, size_t& value)
+{
+  value = 0;
+
+  const size_t RAW_VALUE_COLUMN = 9;
+  size_t column = 0;
+  size_t position = line.find_first_not_of(" \t");
+  while ((position != std::string_view::npos) && (column < RAW_VALUE_COLUMN)) {
+    position = line.find_first_of(" \t", position);
+    if (position == std::string_view::npos) break;
+    position = line.find_first_not_of(" \t", position);
+    column++;
+  }
+
+  if (position == std::string_view::npos) {
+    return false;
+  }
+
+  const size_t end = line.find_first_not_of("0123456789", position);
+  return StringParseValue(line.substr(position, (end == std::string_view::npos) ? std::string_view::npos : (end - position)), value);
+}
+
 //$ smartctl -A /dev/sdf
 //smartctl 7.1 2019-12-30 r5022 [x86_64-linux-5.8.18-100.fc31.x86_64] (local build)
 //Copyright (C) 2002-19, Bruce Allen, Christian Franke, www.smartmontools.org
@@ -68,7 +105,10 @@ bool ParseDriveSmartControlData(std::string_view view, cSmartCtlStats& smartctlS
 
       size_t value = 0;
 
-      if (line.find("Raw_Read_Error_Rate") != std::string_view::npos) {
+      if (line.starts_with("Device is in ")) {
+        // "Device is in STANDBY mode, exit(2)", smartctl didn't send any other commands to the drive
+        smartctlStats.bIsInStandby = true;
+      } else if (line.find("Raw_Read_Error_Rate") != std::string_view::npos) {
         if (ParseSmartCtlRawValue(line, value)) {
           smartctlStats.nRaw_Read_Error_Rate = value;
           //std::cout<<"nRaw_Read_Error_Rate: "<<smartctlStats.nRaw_Read_Error_Rate.value()<<std::endl;
@@ -78,6 +118,15 @@ bool ParseDriveSmartControlData(std::string_view view, cSmartCtlStats& smartctlS
           smartctlStats.nSeek_Error_Rate = value;
           //std::cout<<"nSeek_Error_Rate: "<<smartctlStats.nSeek_Error_Rate.value()<<std::endl;
         }
+      } else if (line.find("Temperature_Celsius") != std::string_view::npos) {
+        if (ParseSmartCtlTemperature(line, value)) {
+          smartctlStats.nTemperature_Celsius = value;
+        }
+      } else if (line.starts_with("Temperature:")) {
+        // NVMe drives, "Temperature:                        35 Celsius"
+        if (StringParseValue(GetFirstNumber(line), value)) {
+          smartctlStats.nTemperature_Celsius = value;
+        }
       } else if (line.find("Offline_Uncorrectable") != std::string_view::npos) {
         if (ParseSmartCtlRawValue(line, value)) {
           smartctlStats.nOffline_Uncorrectable = value;
@@ -92,15 +141,29 @@ bool ParseDriveSmartControlData(std::string_view view, cSmartCtlStats& smartctlS
   return true;
 }
 
-bool GetDriveSmartControlData(const std::string& sDevicePath, cSmartCtlStats& smartctlStats)
+bool GetDriveSmartControlData(const std::string& sSmartCtlPath, const std::string& sDevicePath, bool bSkipStandby, cSmartCtlStats& smartctlStats)
 {
   smartctlStats.Clear();
 
-  // Run "smartctl -A /dev/sdf"
+  // Run "smartctl -A /dev/sdf", or "smartctl -n standby -A /dev/sdf"
+  std::vector<std::string> arguments;
+  if (bSkipStandby) {
+    arguments.push_back("-n");
+    arguments.push_back("standby");
+  }
+  arguments.push_back("-A");
+  arguments.push_back(sDevicePath);
+
   std::string out_standard;
   std::string out_error;
-  const bool result = RunCommand("/usr/sbin/smartctl", std::vector<std::string> { "-A", sDevicePath }, out_standard, out_error);
+  const bool result = RunCommand(sSmartCtlPath, arguments, out_standard, out_error);
   if (!result) {
+    // smartctl exits with 2 when it leaves a drive in standby, that isn't an error
+    if (bSkipStandby && ParseDriveSmartControlData(out_standard, smartctlStats) && smartctlStats.bIsInStandby) {
+      return true;
+    }
+
+    smartctlStats.Clear();
     return false;
   }
 
@@ -108,6 +171,144 @@ bool GetDriveSmartControlData(const std::string& sDevicePath, cSmartCtlStats& sm
   return ParseDriveSmartControlData(out_standard, smartctlStats);
 }
 
+// Split a self-test log line into its columns, which are separated by two or more spaces because the descriptions and statuses have single spaces in them
+void SplitSelfTestLogColumns(std::string_view line, std::vector<std::string_view>& columns)
+{
+  columns.clear();
+
+  size_t position = line.find_first_not_of(" \t");
+  while (position != std::string_view::npos) {
+    size_t end = line.find("  ", position);
+    if (end == std::string_view::npos) end = line.length();
+
+    std::string_view column = line.substr(position, end - position);
+    while (!column.empty() && ((column.back() == ' ') || (column.back() == '\t') || (column.back() == '\r'))) column.remove_suffix(1);
+    columns.push_back(column);
+
+    position = line.find_first_not_of(" \t", end);
+  }
+}
+
+//$ smartctl -c -l selftest /dev/sdf
+//Self-test execution status:      ( 249)	Self-test routine in progress...
+//					90% of test remaining.
+//...
+//SMART Self-test log structure revision number 1
+//Num  Test_Description    Status                  Remaining  LifeTime(hours)  LBA_of_first_error
+//# 1  Short offline       Completed without error       00%     35210         -
+//
+//NVMe drives:
+//Self-test status: Extended self-test in progress (28% completed)
+//Num  Test_Description  Status                       Power_on_Hours  Failing_LBA  NSID Seg SCT Code
+// 0   Short             Completed without error                 4127            -     -   -   -    -
+
+bool ParseDriveSelfTestStatus(std::string_view view, cSmartSelfTestStatus& status)
+{
+  status = cSmartSelfTestStatus();
+
+  bool bFound = false;
+  bool bIsInLog = false;
+  std::vector<std::string_view> columns;
+
+  while (!view.empty()) {
+    const size_t new_line = view.find('\n');
+    const std::string_view line = view.substr(0, new_line);
+    view = (new_line == std::string_view::npos) ? std::string_view() : view.substr(new_line + 1);
+
+    size_t value = 0;
+
+    if (line.starts_with("Self-test execution status:")) {
+      // ATA, the top 4 bits of the status byte are 15 while a test is running and the bottom 4 are the tenths remaining
+      bFound = true;
+      const size_t open = line.find('(');
+      const size_t close = line.find(')', open);
+      if ((open != std::string_view::npos) && (close != std::string_view::npos)) {
+        std::string_view number = line.substr(open + 1, close - (open + 1));
+        number.remove_prefix(std::min(number.find_first_not_of(' '), number.length()));
+        if (StringParseValue(number, value) && ((value >> 4) == 15)) {
+          status.bIsInProgress = true;
+          status.nRemainingPercent = (value & 0xf) * 10;
+        }
+      }
+    } else if (line.starts_with("Self-test status:")) {
+      // NVMe
+      bFound = true;
+      if (line.find("in progress") != std::string_view::npos) {
+        status.bIsInProgress = true;
+        const size_t completed = line.find("% completed");
+        const size_t open = line.rfind('(', completed);
+        if ((completed != std::string_view::npos) && (open != std::string_view::npos) && StringParseValue(line.substr(open + 1, completed - (open + 1)), value) && (value <= 100)) {
+          status.nRemainingPercent = 100 - value;
+        }
+      }
+    } else if (line.starts_with("Num") && (line.find("Test_Description") != std::string_view::npos)) {
+      bFound = true;
+      bIsInLog = true;
+    } else if (bIsInLog) {
+      // The newest entry comes first
+      bIsInLog = false;
+
+      SplitSelfTestLogColumns(line, columns);
+      if (columns.size() < 4) continue;
+
+      status.bHasLastEntry = true;
+      status.sLastDescription = columns[1];
+      status.sLastStatus = columns[2];
+
+      // ATA has a Remaining column before the hours
+      const size_t nHoursColumn = columns[3].ends_with('%') ? 4 : 3;
+      if ((columns.size() > nHoursColumn) && StringParseValue(columns[nHoursColumn], value)) {
+        status.nLastPowerOnHours = value;
+      }
+      if ((columns.size() > (nHoursColumn + 1)) && (columns[nHoursColumn + 1] != "-") && StringParseValue(columns[nHoursColumn + 1], value)) {
+        status.nLastFirstErrorLBA = value;
+      }
+    }
+  }
+
+  return bFound;
+}
+
+bool GetDriveSelfTestStatus(const std::string& sSmartCtlPath, const std::string& sDevicePath, cSmartSelfTestStatus& status)
+{
+  // smartctl sets bits in its exit status when the log has errors in it, so the output is parsed either way
+  std::string out_standard;
+  std::string out_error;
+  RunCommand(sSmartCtlPath, std::vector<std::string> { "-c", "-l", "selftest", sDevicePath }, out_standard, out_error);
+
+  return ParseDriveSelfTestStatus(out_standard, status);
+}
+
+bool StartDriveSelfTest(const std::string& sSmartCtlPath, const std::string& sDevicePath, SELF_TEST_TYPE type)
+{
+  std::string out_standard;
+  std::string out_error;
+  return RunCommand(sSmartCtlPath, std::vector<std::string> { "-t", (type == SELF_TEST_TYPE::LONG) ? "long" : "short", sDevicePath }, out_standard, out_error);
+}
+
+}
+
+
+void cSmartCtlSampleCache::Update(const std::string& sDevicePath, uint64_t nNowMS, cSmartCtlStats& smartctlStats)
+{
+  if (!smartctlStats.bIsInStandby) {
+    if (smartctlStats.HasValues()) {
+      cSample& sample = mapDrivePathToSample[sDevicePath];
+      sample.stats = smartctlStats;
+      sample.nTimeMS = nNowMS;
+    }
+    return;
+  }
+
+  const auto found = mapDrivePathToSample.find(sDevicePath);
+  if (found == mapDrivePathToSample.end()) {
+    return;
+  }
+
+  const cSample& sample = found->second;
+  smartctlStats = sample.stats;
+  smartctlStats.bIsInStandby = true;
+  smartctlStats.nSampleAgeSeconds = ((nNowMS > sample.nTimeMS) ? (nNowMS - sample.nTimeMS) : 0) / 1000;
 }
 
 }
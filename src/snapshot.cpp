@@ -0,0 +1,75 @@
+#include "snapshot.h"
+
+namespace lumberjill {
+
+cPublishedSnapshot::cPublishedSnapshot(cStatsSnapshot&& _snapshot) :
+  snapshot(std::move(_snapshot)),
+  sJSON(GetJSONStatsSnapshot(snapshot)),
+  sOpenMetrics(GetOpenMetricsStatsSnapshot(snapshot, ""))
+{
+}
+
+cPublishedSnapshot::~cPublishedSnapshot()
+{
+}
+
+
+cSnapshotStore::cSnapshotStore() :
+  nLatestSequence(0),
+  nNextSequence(1)
+{
+}
+
+cSnapshotStore::~cSnapshotStore()
+{
+}
+
+bool cSnapshotStore::Publish(cStatsSnapshot&& snapshot)
+{
+  // Serialising is the expensive part, it all happens before anyone else can see the snapshot
+  snapshot.nSequence = nNextSequence.fetch_add(1, std::memory_order_relaxed);
+  const std::shared_ptr<const cPublishedSnapshot> published = std::make_shared<const cPublishedSnapshot>(std::move(snapshot));
+
+  // Another collector may have finished a later collection while we were serialising, never replace a newer snapshot with an older one
+  std::shared_ptr<const cPublishedSnapshot> current = latest.load(std::memory_order_acquire);
+  do {
+    if ((current != nullptr) && (current->snapshot.nSequence > published->snapshot.nSequence)) return false;
+  } while (!latest.compare_exchange_weak(current, published, std::memory_order_release, std::memory_order_acquire));
+
+  // Let the readers know, this is also only ever moved forward
+  const uint64_t nSequence = published->snapshot.nSequence;
+  uint64_t nLatest = nLatestSequence.load(std::memory_order_relaxed);
+  while ((nLatest < nSequence) && !nLatestSequence.compare_exchange_weak(nLatest, nSequence, std::memory_order_release, std::memory_order_relaxed)) {
+  }
+
+  return true;
+}
+
+std::shared_ptr<const cPublishedSnapshot> cSnapshotStore::GetLatest() const
+{
+  return latest.load(std::memory_order_acquire);
+}
+
+
+cSnapshotReader::cSnapshotReader(const cSnapshotStore& _store) :
+  store(_store),
+  nCurrentSequence(0)
+{
+}
+
+cSnapshotReader::~cSnapshotReader()
+{
+}
+
+const std::shared_ptr<const cPublishedSnapshot>& cSnapshotReader::Get()
+{
+  // Usually nothing has changed and this is a single load of a value that is only written once per collection
+  if (store.GetLatestSequence() > nCurrentSequence) {
+    current = store.GetLatest();
+    nCurrentSequence = (current != nullptr) ? current->snapshot.nSequence : 0;
+  }
+
+  return current;
+}
+
+}
@@ -1,9 +1,14 @@
-#include <iostream>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
 
 #include <syslog.h>
 
 #include <json-c/json.h>
 
+#include "output.h"
 #include "stats.h"
 
 namespace {
@@ -18,51 +23,239 @@ int32_t SizeTToInt32(size_t value)
   return ((value > INT32_MAX) ? INT32_MAX : int32_t(value));
 }
 
+// Add a double rounded to 2 decimal places, json-c would otherwise print something like 0.33000000000000002
+void AddJSONDouble(json_object* parent, const char* key, double value)
+{
+  char szValue[32];
+  snprintf(szValue, sizeof(szValue), "%.2f", value);
+  json_object_object_add(parent, key, json_object_new_double_s(value, szValue));
+}
+
 }
 
 namespace lumberjill {
 
-std::string GetJSONMountStats(const cMountStats& mountStats)
+// These are out of line so that the compiler doesn't try to inline copying every optional member
+cDriveStats::cDriveStats() :
+  bIsPresent(true)
 {
-  if (mountStats.sMountPoint.empty()) {
-    return "";
+}
+
+cDriveStats::cDriveStats(const cDriveStats& rhs) = default;
+cDriveStats::cDriveStats(cDriveStats&& rhs) = default;
+cDriveStats::~cDriveStats() = default;
+
+cDriveStats& cDriveStats::operator=(const cDriveStats& rhs) = default;
+cDriveStats& cDriveStats::operator=(cDriveStats&& rhs) = default;
+
+namespace {
+
+json_object* CreateJSONDriveAnomalies(const std::vector<cDriveAnomaly>& anomalies)
+{
+  json_object* children = json_object_new_array();
+
+  for (auto& anomaly : anomalies) {
+    json_object* child = json_object_new_object();
+    json_object_object_add(child, "metric", json_object_new_string(anomaly.sMetric.c_str()));
+    json_object_object_add(child, "kind", json_object_new_string((anomaly.kind == ANOMALY_KIND::SELF) ? "self" : "peers"));
+    AddJSONDouble(child, "value", anomaly.dValue);
+    AddJSONDouble(child, "expected", anomaly.dExpected);
+    AddJSONDouble(child, "score", anomaly.dScore);
+    json_object_array_add(children, child);
   }
 
+  return children;
+}
+
+const char* GetSelfTestResultName(SELF_TEST_RESULT result)
+{
+  switch (result) {
+    case SELF_TEST_RESULT::RUNNING: return "running";
+    case SELF_TEST_RESULT::PASSED: return "passed";
+    case SELF_TEST_RESULT::FAILED: return "failed";
+    case SELF_TEST_RESULT::ABORTED: return "aborted";
+  }
+
+  return "unknown";
+}
+
+json_object* CreateJSONDriveSelfTest(const cDriveSelfTestStats& selfTestStats)
+{
+  json_object* selfTest = json_object_new_object();
+  json_object_object_add(selfTest, "type", json_object_new_string((selfTestStats.type == SELF_TEST_TYPE::LONG) ? "long" : "short"));
+  json_object_object_add(selfTest, "result", json_object_new_string(GetSelfTestResultName(selfTestStats.result)));
+  json_object_object_add(selfTest, "started", json_object_new_int64(selfTestStats.nStartTimestamp));
+  if (selfTestStats.nRemainingPercent.has_value()) {
+    json_object_object_add(selfTest, "remainingPercent", json_object_new_int64(int64_t(selfTestStats.nRemainingPercent.value())));
+  }
+  if (!selfTestStats.sStatus.empty()) {
+    json_object_object_add(selfTest, "status", json_object_new_string(selfTestStats.sStatus.c_str()));
+  }
+  if (selfTestStats.nPowerOnHours.has_value()) {
+    json_object_object_add(selfTest, "powerOnHours", json_object_new_int64(int64_t(selfTestStats.nPowerOnHours.value())));
+  }
+  if (selfTestStats.nFirstErrorLBA.has_value()) {
+    json_object_object_add(selfTest, "firstErrorLBA", json_object_new_int64(int64_t(selfTestStats.nFirstErrorLBA.value())));
+  }
+
+  return selfTest;
+}
+
+json_object* CreateJSONDriveStats(const std::string& sDrivePath, const cDriveStats& driveStats)
+{
+  json_object* drive = json_object_new_object();
+  json_object_object_add(drive, "name", json_object_new_string(driveStats.sName.c_str()));
+  json_object_object_add(drive, "path", json_object_new_string(sDrivePath.c_str()));
+  json_object_object_add(drive, "present", json_object_new_boolean(driveStats.bIsPresent));
+
+  if (driveStats.smartCtlStats.bIsInStandby) {
+    json_object_object_add(drive, "smartPowerMode", json_object_new_string("standby"));
+    if (driveStats.smartCtlStats.nSampleAgeSeconds.has_value()) {
+      json_object_object_add(drive, "smartSampleAgeSeconds", json_object_new_int64(int64_t(driveStats.smartCtlStats.nSampleAgeSeconds.value())));
+    }
+  }
+  if (driveStats.smartCtlStats.nRaw_Read_Error_Rate.has_value()) {
+    json_object_object_add(drive, "smartRaw_Read_Error_Rate", json_object_new_int(SizeTToInt32(driveStats.smartCtlStats.nRaw_Read_Error_Rate.value())));
+  }
+  if (driveStats.smartCtlStats.nSeek_Error_Rate.has_value()) {
+    json_object_object_add(drive, "smartSeek_Error_Rate", json_object_new_int(SizeTToInt32(driveStats.smartCtlStats.nSeek_Error_Rate.value())));
+  }
+  if (driveStats.smartCtlStats.nOffline_Uncorrectable.has_value()) {
+    json_object_object_add(drive, "smartOffline_Uncorrectable", json_object_new_int(SizeTToInt32(driveStats.smartCtlStats.nOffline_Uncorrectable.value())));
+  }
+
+  if (driveStats.diskIOStats.has_value()) {
+    const cDiskIOStats& io = driveStats.diskIOStats.value();
+    AddJSONDouble(drive, "readIOPS", io.dReadIOPS);
+    AddJSONDouble(drive, "writeIOPS", io.dWriteIOPS);
+    AddJSONDouble(drive, "readBytesPerSecond", io.dReadBytesPerSecond);
+    AddJSONDouble(drive, "writeBytesPerSecond", io.dWriteBytesPerSecond);
+    AddJSONDouble(drive, "readAwaitMS", io.dReadAwaitMS);
+    AddJSONDouble(drive, "writeAwaitMS", io.dWriteAwaitMS);
+    AddJSONDouble(drive, "queueDepth", io.dQueueDepth);
+    AddJSONDouble(drive, "utilisationPercent", io.dUtilisationPercent);
+  }
+
+  if (driveStats.latencyStats.has_value()) {
+    const cDriveLatencyStats& latency = driveStats.latencyStats.value();
+    json_object_object_add(drive, "latencyP50US", json_object_new_int64(int64_t(latency.nP50US)));
+    json_object_object_add(drive, "latencyP99US", json_object_new_int64(int64_t(latency.nP99US)));
+    json_object_object_add(drive, "latencyMaxUS", json_object_new_int64(int64_t(latency.nMaxUS)));
+    json_object_object_add(drive, "latencyOutlier", json_object_new_boolean(latency.bIsOutlier));
+  }
+
+  if (driveStats.temperatureStats.has_value()) {
+    const cDriveTemperatureStats& temperature = driveStats.temperatureStats.value();
+    AddJSONDouble(drive, "temperatureCelsius", temperature.dCurrentCelsius);
+    AddJSONDouble(drive, "temperatureMinCelsius", temperature.dMinCelsius);
+    AddJSONDouble(drive, "temperatureMaxCelsius", temperature.dMaxCelsius);
+    AddJSONDouble(drive, "temperatureAverageCelsius", temperature.dAverageCelsius);
+    json_object_object_add(drive, "temperatureSamples", json_object_new_int64(int64_t(temperature.nSamples)));
+    json_object_object_add(drive, "temperatureSource", json_object_new_string((temperature.source == TEMPERATURE_SOURCE::HWMON) ? "hwmon" : "smart"));
+  }
+
+  if (!driveStats.anomalies.empty()) {
+    json_object_object_add(drive, "anomalies", CreateJSONDriveAnomalies(driveStats.anomalies));
+  }
+
+  if (driveStats.selfTestStats.has_value()) {
+    json_object_object_add(drive, "selfTest", CreateJSONDriveSelfTest(driveStats.selfTestStats.value()));
+  }
+
+  return drive;
+}
+
+void AddJSONCapacityForecast(json_object* parent, const cCapacityForecast& forecast)
+{
+  json_object_object_add(parent, "capacityBasis", json_object_new_string((forecast.basis == CAPACITY_BASIS::UNALLOCATED) ? "unallocated" : "free"));
+  AddJSONDouble(parent, "fillRateGBPerDay", forecast.dFillRateBytesPerDay / 1000000000.0);
+  if (forecast.dDaysToFull.has_value()) {
+    AddJSONDouble(parent, "daysToFull", forecast.dDaysToFull.value());
+  }
+  json_object_object_add(parent, "capacityAlert", json_object_new_boolean(forecast.bIsAlert));
+}
+
+json_object* CreateJSONMountStats(const cMountStats& mountStats)
+{
   json_object* root = json_object_new_object();
-  if (root == nullptr) return "";
+  if (root == nullptr) return nullptr;
 
   // Information
   json_object_object_add(root, "mountPoint", json_object_new_string(mountStats.sMountPoint.c_str()));
+  if (!mountStats.bIsResponsive) {
+    json_object_object_add(root, "unresponsive", json_object_new_boolean(true));
+  }
   if (mountStats.nFreeBytes.has_value()) {
     json_object_object_add(root, "freeSpaceGB", json_object_new_int(SizeTToInt32(BytesToGB(mountStats.nFreeBytes.value()))));
   }
   if (mountStats.nTotalBytes.has_value()) {
     json_object_object_add(root, "totalSpaceGB", json_object_new_int(SizeTToInt32(BytesToGB(mountStats.nTotalBytes.value()))));
   }
+  if (mountStats.nUnallocatedBytes.has_value()) {
+    json_object_object_add(root, "unallocatedSpaceGB", json_object_new_int(SizeTToInt32(BytesToGB(mountStats.nUnallocatedBytes.value()))));
+  }
+  if (mountStats.capacityForecast.has_value()) {
+    AddJSONCapacityForecast(root, mountStats.capacityForecast.value());
+  }
 
   json_object* children = json_object_new_array();
 
   for (auto& item : mountStats.mapDrivePathToDriveStats) {
-    json_object* drive = json_object_new_object();
-    json_object_object_add(drive, "name", json_object_new_string(item.second.sName.c_str()));
-    json_object_object_add(drive, "path", json_object_new_string(item.first.c_str()));
-    json_object_object_add(drive, "present", json_object_new_boolean(item.second.bIsPresent));
+    json_object_array_add(children, CreateJSONDriveStats(item.first, item.second));
+  }
 
-    if (item.second.smartCtlStats.nRaw_Read_Error_Rate.has_value()) {
-      json_object_object_add(drive, "smartRaw_Read_Error_Rate", json_object_new_int(SizeTToInt32(item.second.smartCtlStats.nRaw_Read_Error_Rate.value())));
-    }
-    if (item.second.smartCtlStats.nSeek_Error_Rate.has_value()) {
-      json_object_object_add(drive, "smartSeek_Error_Rate", json_object_new_int(SizeTToInt32(item.second.smartCtlStats.nSeek_Error_Rate.value())));
-    }
-    if (item.second.smartCtlStats.nOffline_Uncorrectable.has_value()) {
-      json_object_object_add(drive, "smartOffline_Uncorrectable", json_object_new_int(SizeTToInt32(item.second.smartCtlStats.nOffline_Uncorrectable.value())));
-    }
+  json_object_object_add(root, "drives", children);
 
-    json_object_array_add(children, drive);
+  return root;
+}
+
+json_object* CreateJSONBtrfsDriveStats(const std::string& sDrivePath, const cBtrfsDriveStats& btrfsDriveStats)
+{
+  json_object* drive = json_object_new_object();
+  json_object_object_add(drive, "name", json_object_new_string(btrfsDriveStats.sName.c_str()));
+  json_object_object_add(drive, "path", json_object_new_string(sDrivePath.c_str()));
+
+  if (btrfsDriveStats.nWrite_io_errs.has_value()) {
+    json_object_object_add(drive, "write_io_errs", json_object_new_int(SizeTToInt32(btrfsDriveStats.nWrite_io_errs.value())));
+  }
+  if (btrfsDriveStats.nRead_io_errs.has_value()) {
+    json_object_object_add(drive, "read_io_errs", json_object_new_int(SizeTToInt32(btrfsDriveStats.nRead_io_errs.value())));
+  }
+  if (btrfsDriveStats.nFlush_io_errs.has_value()) {
+    json_object_object_add(drive, "flush_io_errs", json_object_new_int(SizeTToInt32(btrfsDriveStats.nFlush_io_errs.value())));
+  }
+  if (btrfsDriveStats.nCorruption_errs.has_value()) {
+    json_object_object_add(drive, "corruption_errs", json_object_new_int(SizeTToInt32(btrfsDriveStats.nCorruption_errs.value())));
+  }
+  if (btrfsDriveStats.nGeneration_errs.has_value()) {
+    json_object_object_add(drive, "generation_errs", json_object_new_int(SizeTToInt32(btrfsDriveStats.nGeneration_errs.value())));
+  }
+
+  return drive;
+}
+
+json_object* CreateJSONBtrfsStats(const cMountStats& mountStats, const cBtrfsVolumeStats& btrfsVolumeStats)
+{
+  json_object* root = json_object_new_object();
+  if (root == nullptr) return nullptr;
+
+  // Information
+  json_object_object_add(root, "mountPoint", json_object_new_string(mountStats.sMountPoint.c_str()));
+
+  json_object* children = json_object_new_array();
+
+  for (auto& item : btrfsVolumeStats.mapDrivePathToBtrfsDriveStats) {
+    json_object_array_add(children, CreateJSONBtrfsDriveStats(item.first, item.second));
   }
 
   json_object_object_add(root, "drives", children);
 
+  return root;
+}
+
+std::string ToJSONStringAndFree(json_object* root)
+{
+  if (root == nullptr) return "";
 
   const std::string json_output_single_line = json_object_to_json_string_ext(root, JSON_C_TO_STRING_SPACED);
 
@@ -72,46 +265,489 @@ std::string GetJSONMountStats(const cMountStats& mountStats)
   return json_output_single_line;
 }
 
+}
+
+std::string GetJSONMountStats(const cMountStats& mountStats)
+{
+  if (mountStats.sMountPoint.empty()) {
+    return "";
+  }
+
+  return ToJSONStringAndFree(CreateJSONMountStats(mountStats));
+}
+
 std::string GetJSONBtrfsStats(const cMountStats& mountStats, const cBtrfsVolumeStats& btrfsVolumeStats)
 {
   if (mountStats.sMountPoint.empty()) {
     return "";
   }
 
+  return ToJSONStringAndFree(CreateJSONBtrfsStats(mountStats, btrfsVolumeStats));
+}
+
+std::string GetJSONDriveEvent(const std::string& sEvent, const std::string& sMountPoint, const std::string& sName, const std::string& sDevicePath)
+{
+  if (sEvent.empty()) {
+    return "";
+  }
+
   json_object* root = json_object_new_object();
   if (root == nullptr) return "";
 
-  // Information
-  json_object_object_add(root, "mountPoint", json_object_new_string(mountStats.sMountPoint.c_str()));
+  json_object_object_add(root, "event", json_object_new_string(sEvent.c_str()));
+  json_object_object_add(root, "mountPoint", json_object_new_string(sMountPoint.c_str()));
+  json_object_object_add(root, "name", json_object_new_string(sName.c_str()));
+  json_object_object_add(root, "path", json_object_new_string(sDevicePath.c_str()));
+
+  const std::string json_output_single_line = json_object_to_json_string_ext(root, JSON_C_TO_STRING_SPACED);
+
+  // Clean up
+  json_object_put(root);
+
+  return json_output_single_line;
+}
+
+std::string GetJSONCollectionStats(const cCollectionStats& collectionStats)
+{
+  json_object* root = json_object_new_object();
+  if (root == nullptr) return "";
+
+  json_object_object_add(root, "lowImpact", json_object_new_boolean(collectionStats.bIsLowImpact));
+  json_object_object_add(root, "durationMS", json_object_new_int64(int64_t(collectionStats.nDurationMS)));
+  json_object_object_add(root, "cpuMS", json_object_new_int64(int64_t(collectionStats.nCPUMS)));
+  json_object_object_add(root, "childCPUMS", json_object_new_int64(int64_t(collectionStats.nChildCPUMS)));
+  json_object_object_add(root, "childReadBytes", json_object_new_int64(int64_t(collectionStats.nChildReadBytes)));
+  json_object_object_add(root, "childWriteBytes", json_object_new_int64(int64_t(collectionStats.nChildWriteBytes)));
+
+  const cOutputStats& outputStats = collectionStats.outputStats;
+  if (outputStats.bEnabled) {
+    json_object* output = json_object_new_object();
+    json_object_object_add(output, "queued", json_object_new_int64(int64_t(outputStats.nQueued)));
+    json_object_object_add(output, "dropped", json_object_new_int64(int64_t(outputStats.nDropped)));
+    json_object_object_add(output, "coalesced", json_object_new_int64(int64_t(outputStats.nCoalesced)));
+    json_object_object_add(output, "maxQueueDepth", json_object_new_int64(int64_t(outputStats.nMaxQueueDepth)));
+    json_object_object_add(output, "blockedUS", json_object_new_int64(int64_t(outputStats.nBlockedUS)));
+    json_object_object_add(output, "serialiseUS", json_object_new_int64(int64_t(outputStats.nSerialiseUS)));
+
+    json_object* sinks = json_object_new_array();
+    for (auto& sinkStats : outputStats.sinks) {
+      json_object* sink = json_object_new_object();
+      json_object_object_add(sink, "name", json_object_new_string(sinkStats.sName.c_str()));
+      json_object_object_add(sink, "records", json_object_new_int64(int64_t(sinkStats.nRecords)));
+      json_object_object_add(sink, "batches", json_object_new_int64(int64_t(sinkStats.nBatches)));
+      json_object_object_add(sink, "errors", json_object_new_int64(int64_t(sinkStats.nErrors)));
+      json_object_object_add(sink, "averageLatencyUS", json_object_new_int64((sinkStats.nRecords == 0) ? 0 : int64_t(sinkStats.nTotalLatencyUS / sinkStats.nRecords)));
+      json_object_object_add(sink, "maxLatencyUS", json_object_new_int64(int64_t(sinkStats.nMaxLatencyUS)));
+      if (sinkStats.sName == "remote") json_object_object_add(sink, "spooled", json_object_new_int64(int64_t(sinkStats.nSpooled)));
+      json_object_array_add(sinks, sink);
+    }
+    json_object_object_add(output, "sinks", sinks);
+
+    json_object_object_add(root, "output", output);
+  }
+
+  const std::string json_output_single_line = json_object_to_json_string_ext(root, JSON_C_TO_STRING_SPACED);
+
+  // Clean up
+  json_object_put(root);
+
+  return json_output_single_line;
+}
+
+std::string GetJSONSmartSchedule(const cSmartSchedule& schedule)
+{
+  json_object* root = json_object_new_object();
+  if (root == nullptr) return "";
+
+  json_object_object_add(root, "windowMS", json_object_new_int64(int64_t(schedule.nWindowMS)));
+  json_object_object_add(root, "deadlineMS", json_object_new_int64(int64_t(schedule.nDeadlineMS)));
+  json_object_object_add(root, "maxPerController", json_object_new_int64(int64_t(schedule.nMaxPerController)));
+  json_object_object_add(root, "durationMS", json_object_new_int64(int64_t(schedule.nDurationMS)));
 
   json_object* children = json_object_new_array();
 
-  for (auto& item : btrfsVolumeStats.mapDrivePathToBtrfsDriveStats) {
-    json_object* drive = json_object_new_object();
-    json_object_object_add(drive, "name", json_object_new_string(item.second.sName.c_str()));
-    json_object_object_add(drive, "path", json_object_new_string(item.first.c_str()));
+  for (auto& entry : schedule.entries) {
+    json_object* query = json_object_new_object();
+    json_object_object_add(query, "path", json_object_new_string(entry.sDevicePath.c_str()));
+    json_object_object_add(query, "controller", json_object_new_string(entry.sController.c_str()));
+    json_object_object_add(query, "offsetMS", json_object_new_int64(int64_t(entry.nOffsetMS)));
+
+    if (entry.result == SMART_QUERY_RESULT::SKIPPED) {
+      json_object_object_add(query, "result", json_object_new_string("skipped"));
+    } else {
+      json_object_object_add(query, "startMS", json_object_new_int64(int64_t(entry.nStartMS)));
+      json_object_object_add(query, "durationMS", json_object_new_int64(int64_t(entry.nDurationMS)));
+      json_object_object_add(query, "result", json_object_new_string((entry.result == SMART_QUERY_RESULT::OK) ? "ok" : (entry.result == SMART_QUERY_RESULT::STANDBY) ? "standby" : (entry.result == SMART_QUERY_RESULT::TIMED_OUT) ? "timedOut" : "error"));
+    }
+
+    json_object_array_add(children, query);
+  }
+
+  json_object_object_add(root, "queries", children);
+
+  const std::string json_output_single_line = json_object_to_json_string_ext(root, JSON_C_TO_STRING_SPACED);
+
+  // Clean up
+  json_object_put(root);
+
+  return json_output_single_line;
+}
 
-    if (item.second.nWrite_io_errs.has_value()) {
-      json_object_object_add(drive, "write_io_errs", json_object_new_int(SizeTToInt32(item.second.nWrite_io_errs.value())));
+std::string GetJSONStatsSnapshot(const cStatsSnapshot& snapshot)
+{
+  json_object* root = json_object_new_object();
+  if (root == nullptr) return "";
+
+  json_object_object_add(root, "sequence", json_object_new_int64(int64_t(snapshot.nSequence)));
+  json_object_object_add(root, "timestamp", json_object_new_int64(snapshot.nTimestamp));
+
+  json_object* mounts = json_object_new_array();
+
+  for (auto& group : snapshot.groups) {
+    json_object* mount = CreateJSONMountStats(group.mountStats);
+
+    if (group.bHasBtrfsStats) {
+      json_object* btrfs_drives = json_object_new_array();
+      for (auto& item : group.btrfsVolumeStats.mapDrivePathToBtrfsDriveStats) {
+        json_object_array_add(btrfs_drives, CreateJSONBtrfsDriveStats(item.first, item.second));
+      }
+      json_object_object_add(mount, "btrfsDrives", btrfs_drives);
     }
-    if (item.second.nRead_io_errs.has_value()) {
-      json_object_object_add(drive, "read_io_errs", json_object_new_int(SizeTToInt32(item.second.nRead_io_errs.value())));
+
+    json_object_array_add(mounts, mount);
+  }
+
+  json_object_object_add(root, "mounts", mounts);
+
+  return ToJSONStringAndFree(root);
+}
+
+std::string GetJSONStatsSnapshotDrive(const cStatsSnapshot& snapshot, const std::string& sDrivePath)
+{
+  for (auto& group : snapshot.groups) {
+    const auto found = group.mountStats.mapDrivePathToDriveStats.find(sDrivePath);
+    if (found == group.mountStats.mapDrivePathToDriveStats.end()) continue;
+
+    json_object* root = json_object_new_object();
+    if (root == nullptr) return "";
+
+    json_object_object_add(root, "sequence", json_object_new_int64(int64_t(snapshot.nSequence)));
+    json_object_object_add(root, "timestamp", json_object_new_int64(snapshot.nTimestamp));
+    json_object_object_add(root, "mountPoint", json_object_new_string(group.mountStats.sMountPoint.c_str()));
+    json_object_object_add(root, "drive", CreateJSONDriveStats(found->first, found->second));
+
+    if (group.bHasBtrfsStats) {
+      const auto found_btrfs = group.btrfsVolumeStats.mapDrivePathToBtrfsDriveStats.find(sDrivePath);
+      if (found_btrfs != group.btrfsVolumeStats.mapDrivePathToBtrfsDriveStats.end()) {
+        json_object_object_add(root, "btrfs", CreateJSONBtrfsDriveStats(found_btrfs->first, found_btrfs->second));
+      }
+    }
+
+    return ToJSONStringAndFree(root);
+  }
+
+  return "";
+}
+
+namespace {
+
+template <class T>
+class cOpenMetric {
+public:
+  const char* szName;
+  const char* szType;  // "gauge" or "counter", counter samples get a "_total" suffix
+  const char* szHelp;
+  std::optional<double> (*pGetValue)(const T& stats);
+};
+
+std::optional<double> GetOptionalValue(const std::optional<size_t>& value)
+{
+  if (!value.has_value()) return std::nullopt;
+  return double(value.value());
+}
+
+const cOpenMetric<cMountStats> MOUNT_METRICS[] = {
+  { "lumberjill_mount_responsive", "gauge", "1 if the mount responded to statvfs in time", [](const cMountStats& stats) -> std::optional<double> { return stats.bIsResponsive ? 1.0 : 0.0; } },
+  { "lumberjill_mount_free_bytes", "gauge", "Free space", [](const cMountStats& stats) { return GetOptionalValue(stats.nFreeBytes); } },
+  { "lumberjill_mount_size_bytes", "gauge", "Total space", [](const cMountStats& stats) { return GetOptionalValue(stats.nTotalBytes); } },
+  { "lumberjill_mount_unallocated_bytes", "gauge", "Space on the btrfs devices not allocated to a chunk", [](const cMountStats& stats) { return GetOptionalValue(stats.nUnallocatedBytes); } },
+  { "lumberjill_mount_fill_rate_bytes_per_second", "gauge", "How fast the free or unallocated space is going down", [](const cMountStats& stats) -> std::optional<double> { if (!stats.capacityForecast.has_value()) return std::nullopt; return stats.capacityForecast->dFillRateBytesPerDay / (24.0 * 60.0 * 60.0); } },
+  { "lumberjill_mount_time_to_full_seconds", "gauge", "When the mount will be full at the current fill rate", [](const cMountStats& stats) -> std::optional<double> { if (!stats.capacityForecast.has_value() || !stats.capacityForecast->dDaysToFull.has_value()) return std::nullopt; return stats.capacityForecast->dDaysToFull.value() * 24.0 * 60.0 * 60.0; } },
+};
+
+const cOpenMetric<cDriveStats> DRIVE_METRICS[] = {
+  { "lumberjill_drive_present", "gauge", "1 if the drive is present", [](const cDriveStats& stats) -> std::optional<double> { return stats.bIsPresent ? 1.0 : 0.0; } },
+  { "lumberjill_drive_smart_standby", "gauge", "1 if the drive was in standby and the SMART values are from when it was last active", [](const cDriveStats& stats) -> std::optional<double> { return stats.smartCtlStats.bIsInStandby ? 1.0 : 0.0; } },
+  { "lumberjill_drive_smart_raw_read_error_rate", "gauge", "SMART Raw_Read_Error_Rate raw value", [](const cDriveStats& stats) { return GetOptionalValue(stats.smartCtlStats.nRaw_Read_Error_Rate); } },
+  { "lumberjill_drive_smart_seek_error_rate", "gauge", "SMART Seek_Error_Rate raw value", [](const cDriveStats& stats) { return GetOptionalValue(stats.smartCtlStats.nSeek_Error_Rate); } },
+  { "lumberjill_drive_smart_offline_uncorrectable", "gauge", "SMART Offline_Uncorrectable raw value", [](const cDriveStats& stats) { return GetOptionalValue(stats.smartCtlStats.nOffline_Uncorrectable); } },
+  { "lumberjill_drive_read_iops", "gauge", "Reads per second", [](const cDriveStats& stats) -> std::optional<double> { if (!stats.diskIOStats.has_value()) return std::nullopt; return stats.diskIOStats->dReadIOPS; } },
+  { "lumberjill_drive_write_iops", "gauge", "Writes per second", [](const cDriveStats& stats) -> std::optional<double> { if (!stats.diskIOStats.has_value()) return std::nullopt; return stats.diskIOStats->dWriteIOPS; } },
+  { "lumberjill_drive_read_bytes_per_second", "gauge", "Bytes read per second", [](const cDriveStats& stats) -> std::optional<double> { if (!stats.diskIOStats.has_value()) return std::nullopt; return stats.diskIOStats->dReadBytesPerSecond; } },
+  { "lumberjill_drive_write_bytes_per_second", "gauge", "Bytes written per second", [](const cDriveStats& stats) -> std::optional<double> { if (!stats.diskIOStats.has_value()) return std::nullopt; return stats.diskIOStats->dWriteBytesPerSecond; } },
+  { "lumberjill_drive_read_await_seconds", "gauge", "Average time for a read to complete", [](const cDriveStats& stats) -> std::optional<double> { if (!stats.diskIOStats.has_value()) return std::nullopt; return stats.diskIOStats->dReadAwaitMS / 1000.0; } },
+  { "lumberjill_drive_write_await_seconds", "gauge", "Average time for a write to complete", [](const cDriveStats& stats) -> std::optional<double> { if (!stats.diskIOStats.has_value()) return std::nullopt; return stats.diskIOStats->dWriteAwaitMS / 1000.0; } },
+  { "lumberjill_drive_queue_depth", "gauge", "Average number of requests in flight", [](const cDriveStats& stats) -> std::optional<double> { if (!stats.diskIOStats.has_value()) return std::nullopt; return stats.diskIOStats->dQueueDepth; } },
+  { "lumberjill_drive_utilisation_ratio", "gauge", "Fraction of the interval that the drive was busy", [](const cDriveStats& stats) -> std::optional<double> { if (!stats.diskIOStats.has_value()) return std::nullopt; return stats.diskIOStats->dUtilisationPercent / 100.0; } },
+  { "lumberjill_drive_latency_p50_seconds", "gauge", "Median latency of the probe reads", [](const cDriveStats& stats) -> std::optional<double> { if (!stats.latencyStats.has_value()) return std::nullopt; return double(stats.latencyStats->nP50US) / 1000000.0; } },
+  { "lumberjill_drive_latency_p99_seconds", "gauge", "99th percentile latency of the probe reads", [](const cDriveStats& stats) -> std::optional<double> { if (!stats.latencyStats.has_value()) return std::nullopt; return double(stats.latencyStats->nP99US) / 1000000.0; } },
+  { "lumberjill_drive_latency_outlier", "gauge", "1 if the drive is much slower than the others in its group", [](const cDriveStats& stats) -> std::optional<double> { if (!stats.latencyStats.has_value()) return std::nullopt; return stats.latencyStats->bIsOutlier ? 1.0 : 0.0; } },
+  { "lumberjill_drive_temperature_celsius", "gauge", "Latest temperature", [](const cDriveStats& stats) -> std::optional<double> { if (!stats.temperatureStats.has_value()) return std::nullopt; return stats.temperatureStats->dCurrentCelsius; } },
+  { "lumberjill_drive_temperature_max_celsius", "gauge", "Highest temperature since the previous collection", [](const cDriveStats& stats) -> std::optional<double> { if (!stats.temperatureStats.has_value()) return std::nullopt; return stats.temperatureStats->dMaxCelsius; } },
+  { "lumberjill_drive_anomalies", "gauge", "Number of metrics that are rising much faster than the drive's own history or its group", [](const cDriveStats& stats) -> std::optional<double> { return double(stats.anomalies.size()); } },
+};
+
+const cOpenMetric<cBtrfsDriveStats> BTRFS_METRICS[] = {
+  { "lumberjill_btrfs_write_io_errors", "counter", "btrfs device stats write_io_errs", [](const cBtrfsDriveStats& stats) { return GetOptionalValue(stats.nWrite_io_errs); } },
+  { "lumberjill_btrfs_read_io_errors", "counter", "btrfs device stats read_io_errs", [](const cBtrfsDriveStats& stats) { return GetOptionalValue(stats.nRead_io_errs); } },
+  { "lumberjill_btrfs_flush_io_errors", "counter", "btrfs device stats flush_io_errs", [](const cBtrfsDriveStats& stats) { return GetOptionalValue(stats.nFlush_io_errs); } },
+  { "lumberjill_btrfs_corruption_errors", "counter", "btrfs device stats corruption_errs", [](const cBtrfsDriveStats& stats) { return GetOptionalValue(stats.nCorruption_errs); } },
+  { "lumberjill_btrfs_generation_errors", "counter", "btrfs device stats generation_errs", [](const cBtrfsDriveStats& stats) { return GetOptionalValue(stats.nGeneration_errs); } },
+};
+
+// Label values escape backslashes, double quotes and new lines
+void AppendOpenMetricsLabel(std::string& output, const char* szName, const std::string& value)
+{
+  if (output.back() != '{') output += ',';
+  output += szName;
+  output += "=\"";
+  for (const char c : value) {
+    if (c == '\\') output += "\\\\";
+    else if (c == '"') output += "\\\"";
+    else if (c == '\n') output += "\\n";
+    else output += c;
+  }
+  output += '"';
+}
+
+void AppendOpenMetricsValue(std::string& output, double value)
+{
+  // Most of our values are counts, byte sizes and timestamps, print those in full rather than rounding them to an exponent
+  char szValue[32];
+  if ((value == std::floor(value)) && (std::fabs(value) < 9007199254740992.0)) {
+    snprintf(szValue, sizeof(szValue), " %lld\n", static_cast<long long>(value));
+  } else {
+    snprintf(szValue, sizeof(szValue), " %.15g\n", value);
+  }
+  output += szValue;
+}
+
+template <class T>
+void AppendOpenMetricsFamily(std::string& output, const cOpenMetric<T>& metric)
+{
+  output += "# TYPE ";
+  output += metric.szName;
+  output += ' ';
+  output += metric.szType;
+  output += "\n# HELP ";
+  output += metric.szName;
+  output += ' ';
+  output += metric.szHelp;
+  output += '\n';
+}
+
+template <class T>
+void AppendOpenMetricsSampleName(std::string& output, const cOpenMetric<T>& metric)
+{
+  output += metric.szName;
+  if (strcmp(metric.szType, "counter") == 0) output += "_total";
+  output += '{';
+}
+
+}
+
+std::string GetOpenMetricsStatsSnapshot(const cStatsSnapshot& snapshot, const std::string& sDrivePath)
+{
+  const bool bIsFiltered = !sDrivePath.empty();
+
+  // Just the mount with the drive on it if we were asked for one drive
+  std::vector<const cGroupStats*> groups;
+  for (auto& group : snapshot.groups) {
+    if (!bIsFiltered || (group.mountStats.mapDrivePathToDriveStats.count(sDrivePath) != 0)) {
+      groups.push_back(&group);
     }
-    if (item.second.nFlush_io_errs.has_value()) {
-      json_object_object_add(drive, "flush_io_errs", json_object_new_int(SizeTToInt32(item.second.nFlush_io_errs.value())));
+  }
+
+  // Unknown drive
+  if (bIsFiltered && groups.empty()) return "";
+
+  std::string output;
+  output += "# TYPE lumberjill_snapshot_timestamp_seconds gauge\n# HELP lumberjill_snapshot_timestamp_seconds When the collection finished\nlumberjill_snapshot_timestamp_seconds";
+  AppendOpenMetricsValue(output, double(snapshot.nTimestamp));
+  output += "# TYPE lumberjill_snapshot_sequence gauge\n# HELP lumberjill_snapshot_sequence Counts up with each collection\nlumberjill_snapshot_sequence";
+  AppendOpenMetricsValue(output, double(snapshot.nSequence));
+
+  for (auto& metric : MOUNT_METRICS) {
+    bool bHasFamily = false;
+    for (auto& pGroup : groups) {
+      const std::optional<double> value = metric.pGetValue(pGroup->mountStats);
+      if (!value.has_value()) continue;
+
+      if (!bHasFamily) {
+        AppendOpenMetricsFamily(output, metric);
+        bHasFamily = true;
+      }
+      AppendOpenMetricsSampleName(output, metric);
+      AppendOpenMetricsLabel(output, "mount_point", pGroup->mountStats.sMountPoint);
+      output += '}';
+      AppendOpenMetricsValue(output, value.value());
     }
-    if (item.second.nCorruption_errs.has_value()) {
-      json_object_object_add(drive, "corruption_errs", json_object_new_int(SizeTToInt32(item.second.nCorruption_errs.value())));
+  }
+
+  for (auto& metric : DRIVE_METRICS) {
+    bool bHasFamily = false;
+    for (auto& pGroup : groups) {
+      for (auto& item : pGroup->mountStats.mapDrivePathToDriveStats) {
+        if (bIsFiltered && (item.first != sDrivePath)) continue;
+
+        const std::optional<double> value = metric.pGetValue(item.second);
+        if (!value.has_value()) continue;
+
+        if (!bHasFamily) {
+          AppendOpenMetricsFamily(output, metric);
+          bHasFamily = true;
+        }
+        AppendOpenMetricsSampleName(output, metric);
+        AppendOpenMetricsLabel(output, "mount_point", pGroup->mountStats.sMountPoint);
+        AppendOpenMetricsLabel(output, "path", item.first);
+        AppendOpenMetricsLabel(output, "name", item.second.sName);
+        output += '}';
+        AppendOpenMetricsValue(output, value.value());
+      }
     }
-    if (item.second.nGeneration_errs.has_value()) {
-      json_object_object_add(drive, "generation_errs", json_object_new_int(SizeTToInt32(item.second.nGeneration_errs.value())));
+  }
+
+  for (auto& metric : BTRFS_METRICS) {
+    bool bHasFamily = false;
+    for (auto& pGroup : groups) {
+      if (!pGroup->bHasBtrfsStats) continue;
+
+      for (auto& item : pGroup->btrfsVolumeStats.mapDrivePathToBtrfsDriveStats) {
+        if (bIsFiltered && (item.first != sDrivePath)) continue;
+
+        const std::optional<double> value = metric.pGetValue(item.second);
+        if (!value.has_value()) continue;
+
+        if (!bHasFamily) {
+          AppendOpenMetricsFamily(output, metric);
+          bHasFamily = true;
+        }
+        AppendOpenMetricsSampleName(output, metric);
+        AppendOpenMetricsLabel(output, "mount_point", pGroup->mountStats.sMountPoint);
+        AppendOpenMetricsLabel(output, "path", item.first);
+        AppendOpenMetricsLabel(output, "name", item.second.sName);
+        output += '}';
+        AppendOpenMetricsValue(output, value.value());
+      }
     }
+  }
 
-    json_object_array_add(children, drive);
+  output += "# EOF\n";
+  return output;
+}
+
+std::string GetJSONKernelErrors(const std::string& sMountPoint, const std::string& sName, const std::string& sDevicePath, const cKernelErrorStats& kernelErrorStats, const std::string& sMessage)
+{
+  json_object* root = json_object_new_object();
+  if (root == nullptr) return "";
+
+  json_object_object_add(root, "mountPoint", json_object_new_string(sMountPoint.c_str()));
+  json_object_object_add(root, "name", json_object_new_string(sName.c_str()));
+  json_object_object_add(root, "path", json_object_new_string(sDevicePath.c_str()));
+  json_object_object_add(root, "ioErrors", json_object_new_int64(int64_t(kernelErrorStats.nIOErrors)));
+  json_object_object_add(root, "mediumErrors", json_object_new_int64(int64_t(kernelErrorStats.nMediumErrors)));
+  json_object_object_add(root, "ataErrors", json_object_new_int64(int64_t(kernelErrorStats.nATAErrors)));
+  json_object_object_add(root, "linkResets", json_object_new_int64(int64_t(kernelErrorStats.nLinkResets)));
+  json_object_object_add(root, "timeouts", json_object_new_int64(int64_t(kernelErrorStats.nTimeouts)));
+  json_object_object_add(root, "btrfsErrors", json_object_new_int64(int64_t(kernelErrorStats.nBtrfsErrors)));
+  json_object_object_add(root, "errorsInWindow", json_object_new_int64(int64_t(kernelErrorStats.nErrorsInWindow)));
+  json_object_object_add(root, "windowSeconds", json_object_new_int64(int64_t(kernelErrorStats.nWindowSeconds)));
+  json_object_object_add(root, "lastMessage", json_object_new_string(sMessage.c_str()));
+
+  const std::string json_output_single_line = json_object_to_json_string_ext(root, JSON_C_TO_STRING_SPACED);
+
+  // Clean up
+  json_object_put(root);
+
+  return json_output_single_line;
+}
+
+std::string GetJSONDriveAnomalies(const std::string& sMountPoint, const std::string& sName, const std::string& sDevicePath, const std::vector<cDriveAnomaly>& anomalies)
+{
+  json_object* root = json_object_new_object();
+  if (root == nullptr) return "";
+
+  json_object_object_add(root, "mountPoint", json_object_new_string(sMountPoint.c_str()));
+  json_object_object_add(root, "name", json_object_new_string(sName.c_str()));
+  json_object_object_add(root, "path", json_object_new_string(sDevicePath.c_str()));
+  json_object_object_add(root, "anomalies", CreateJSONDriveAnomalies(anomalies));
+
+  const std::string json_output_single_line = json_object_to_json_string_ext(root, JSON_C_TO_STRING_SPACED);
+
+  // Clean up
+  json_object_put(root);
+
+  return json_output_single_line;
+}
+
+std::string GetJSONCapacityAlert(const cMountStats& mountStats, size_t nHorizonDays)
+{
+  json_object* root = json_object_new_object();
+  if (root == nullptr) return "";
+
+  json_object_object_add(root, "mountPoint", json_object_new_string(mountStats.sMountPoint.c_str()));
+  if (mountStats.capacityForecast.has_value()) {
+    const cCapacityForecast& forecast = mountStats.capacityForecast.value();
+    json_object_object_add(root, "availableSpaceGB", json_object_new_int(SizeTToInt32(BytesToGB(forecast.nAvailableBytes))));
+    AddJSONCapacityForecast(root, forecast);
   }
+  json_object_object_add(root, "horizonDays", json_object_new_int64(int64_t(nHorizonDays)));
 
-  json_object_object_add(root, "drives", children);
+  const std::string json_output_single_line = json_object_to_json_string_ext(root, JSON_C_TO_STRING_SPACED);
+
+  // Clean up
+  json_object_put(root);
+
+  return json_output_single_line;
+}
+
+json_object* CreateJSONBtrfsSubvolumeUsage(const std::vector<cBtrfsSubvolumeUsage>& subvolumes)
+{
+  json_object* children = json_object_new_array();
+
+  for (auto& usage : subvolumes) {
+    json_object* child = json_object_new_object();
+    json_object_object_add(child, "id", json_object_new_int64(int64_t(usage.nSubvolumeId)));
+    json_object_object_add(child, "name", json_object_new_string(usage.sName.c_str()));
+    json_object_object_add(child, "referencedBytes", json_object_new_int64(int64_t(usage.nReferencedBytes)));
+    json_object_object_add(child, "exclusiveBytes", json_object_new_int64(int64_t(usage.nExclusiveBytes)));
+    if (usage.nReferencedChangeBytes.has_value()) {
+      json_object_object_add(child, "referencedChangeBytes", json_object_new_int64(usage.nReferencedChangeBytes.value()));
+    }
+    if (usage.nExclusiveChangeBytes.has_value()) {
+      json_object_object_add(child, "exclusiveChangeBytes", json_object_new_int64(usage.nExclusiveChangeBytes.value()));
+    }
+    if (usage.nMaxReferencedBytes != 0) {
+      json_object_object_add(child, "maxReferencedBytes", json_object_new_int64(int64_t(usage.nMaxReferencedBytes)));
+    }
+    if (usage.nMaxExclusiveBytes != 0) {
+      json_object_object_add(child, "maxExclusiveBytes", json_object_new_int64(int64_t(usage.nMaxExclusiveBytes)));
+    }
+    json_object_array_add(children, child);
+  }
+
+  return children;
+}
+
+std::string GetJSONBtrfsQgroupStats(const std::string& sMountPoint, const cBtrfsQgroupStats& qgroupStats)
+{
+  json_object* root = json_object_new_object();
+  if (root == nullptr) return "";
 
+  json_object_object_add(root, "mountPoint", json_object_new_string(sMountPoint.c_str()));
+  json_object_object_add(root, "subvolumes", json_object_new_int64(int64_t(qgroupStats.nSubvolumes)));
+  json_object_object_add(root, "topReferenced", CreateJSONBtrfsSubvolumeUsage(qgroupStats.topReferenced));
+  json_object_object_add(root, "topExclusive", CreateJSONBtrfsSubvolumeUsage(qgroupStats.topExclusive));
 
   const std::string json_output_single_line = json_object_to_json_string_ext(root, JSON_C_TO_STRING_SPACED);
 
@@ -121,38 +757,173 @@ std::string GetJSONBtrfsStats(const cMountStats& mountStats, const cBtrfsVolumeS
   return json_output_single_line;
 }
 
-bool LogStatsToSyslogMountStats(const cMountStats& mountStats)
+std::string GetJSONDriveSelfTest(const std::string& sMountPoint, const std::string& sName, const std::string& sDevicePath, const cDriveSelfTestStats& selfTestStats)
 {
-  const std::string json_output_single_line = GetJSONMountStats(mountStats);
+  json_object* root = json_object_new_object();
+  if (root == nullptr) return "";
+
+  json_object_object_add(root, "mountPoint", json_object_new_string(sMountPoint.c_str()));
+  json_object_object_add(root, "name", json_object_new_string(sName.c_str()));
+  json_object_object_add(root, "path", json_object_new_string(sDevicePath.c_str()));
+  json_object_object_add(root, "selfTest", CreateJSONDriveSelfTest(selfTestStats));
 
-  std::cout<<"Json output: "<<json_output_single_line<<std::endl;
+  const std::string json_output_single_line = json_object_to_json_string_ext(root, JSON_C_TO_STRING_SPACED);
+
+  // Clean up
+  json_object_put(root);
+
+  return json_output_single_line;
+}
 
-  if (json_output_single_line.empty()) {
-    syslog(LOG_ERR, "Error creating JSON");
-    return false;
+const char* GetScrubStateName(SCRUB_STATE state)
+{
+  switch (state) {
+    case SCRUB_STATE::RUNNING: return "running";
+    case SCRUB_STATE::PAUSED: return "paused";
+    case SCRUB_STATE::FINISHED: return "finished";
   }
 
-  syslog(LOG_INFO, "Mount %s drive stats json @cee: %s", mountStats.sMountPoint.c_str(), json_output_single_line.c_str());
-  return true;
+  return "unknown";
 }
 
-bool LogStatsToSyslogMountStatsAndBtrfsStats(const cMountStats& mountStats, const cBtrfsVolumeStats& btrfsVolumeStats)
+std::string GetJSONScrubStats(const std::string& sMountPoint, const cScrubStats& scrubStats)
+{
+  json_object* root = json_object_new_object();
+  if (root == nullptr) return "";
+
+  json_object_object_add(root, "mountPoint", json_object_new_string(sMountPoint.c_str()));
+  json_object_object_add(root, "state", json_object_new_string(GetScrubStateName(scrubStats.state)));
+  if (!scrubStats.sReason.empty()) {
+    json_object_object_add(root, "reason", json_object_new_string(scrubStats.sReason.c_str()));
+  }
+
+  json_object* devices = json_object_new_array();
+  for (auto& progress : scrubStats.devices) {
+    json_object* device = json_object_new_object();
+    json_object_object_add(device, "id", json_object_new_int64(int64_t(progress.nDeviceId)));
+    json_object_object_add(device, "path", json_object_new_string(progress.sPath.c_str()));
+    json_object_object_add(device, "bytesScrubbed", json_object_new_int64(int64_t(progress.nBytesScrubbed)));
+    json_object_object_add(device, "bytesToScrub", json_object_new_int64(int64_t(progress.nBytesToScrub)));
+    if (progress.nBytesToScrub != 0) {
+      AddJSONDouble(device, "percentComplete", std::min(100.0, 100.0 * double(progress.nBytesScrubbed) / double(progress.nBytesToScrub)));
+    }
+    if (progress.dBytesPerSecond.has_value()) {
+      AddJSONDouble(device, "bytesPerSecond", progress.dBytesPerSecond.value());
+    }
+    if (progress.dETASeconds.has_value()) {
+      AddJSONDouble(device, "etaSeconds", progress.dETASeconds.value());
+    }
+    json_object_object_add(device, "readErrors", json_object_new_int64(int64_t(progress.nReadErrors)));
+    json_object_object_add(device, "csumErrors", json_object_new_int64(int64_t(progress.nCsumErrors)));
+    json_object_object_add(device, "verifyErrors", json_object_new_int64(int64_t(progress.nVerifyErrors)));
+    json_object_object_add(device, "superErrors", json_object_new_int64(int64_t(progress.nSuperErrors)));
+    json_object_object_add(device, "uncorrectableErrors", json_object_new_int64(int64_t(progress.nUncorrectableErrors)));
+    json_object_object_add(device, "correctedErrors", json_object_new_int64(int64_t(progress.nCorrectedErrors)));
+    json_object_object_add(device, "newErrors", json_object_new_int64(int64_t(progress.nNewErrors)));
+    json_object_array_add(devices, device);
+  }
+  json_object_object_add(root, "devices", devices);
+
+  const std::string json_output_single_line = json_object_to_json_string_ext(root, JSON_C_TO_STRING_SPACED);
+
+  // Clean up
+  json_object_put(root);
+
+  return json_output_single_line;
+}
+
+namespace {
+
+// A record of the whole mount only replaces an older one of the whole mount, and a record of a single device only replaces an older one of the same device
+std::string GetMountStatsCoalesceKey(const std::string& sKind, const std::string& sMountPoint, const std::string& sDevicePath)
+{
+  return sDevicePath.empty() ? (sKind + " " + sMountPoint) : (sKind + " " + sMountPoint + " " + sDevicePath);
+}
+
+bool LogMountStats(const cMountStats& mountStats, const std::string& sDevicePath)
+{
+  return WriteOutput(LOG_INFO, "Mount " + mountStats.sMountPoint + " drive stats", GetMountStatsCoalesceKey("mount", mountStats.sMountPoint, sDevicePath), [mountStats]() { return GetJSONMountStats(mountStats); });
+}
+
+bool LogMountStatsAndBtrfsStats(const cMountStats& mountStats, const cBtrfsVolumeStats& btrfsVolumeStats, const std::string& sDevicePath)
 {
   // Log the regular mount stats
-  const bool log_mount_result = LogStatsToSyslogMountStats(mountStats);
+  const bool log_mount_result = LogMountStats(mountStats, sDevicePath);
 
   // Now log the BTRFS stats
-  const std::string json_output_single_line = GetJSONBtrfsStats(mountStats, btrfsVolumeStats);
+  if (!WriteOutput(LOG_INFO, "Mount " + mountStats.sMountPoint + " btrfs stats", GetMountStatsCoalesceKey("btrfs", mountStats.sMountPoint, sDevicePath), [mountStats, btrfsVolumeStats]() { return GetJSONBtrfsStats(mountStats, btrfsVolumeStats); })) return false;
 
-  std::cout<<"Json output: "<<json_output_single_line<<std::endl;
+  return log_mount_result;
+}
 
-  if (json_output_single_line.empty()) {
-    syslog(LOG_ERR, "Error creating JSON");
-    return false;
-  }
+}
 
-  syslog(LOG_INFO, "Mount %s btrfs stats json @cee: %s", mountStats.sMountPoint.c_str(), json_output_single_line.c_str());
-  return log_mount_result;
+bool LogStatsToSyslogMountStats(const cMountStats& mountStats)
+{
+  return LogMountStats(mountStats, "");
+}
+
+bool LogStatsToSyslogMountStatsAndBtrfsStats(const cMountStats& mountStats, const cBtrfsVolumeStats& btrfsVolumeStats)
+{
+  return LogMountStatsAndBtrfsStats(mountStats, btrfsVolumeStats, "");
+}
+
+bool LogStatsToSyslogDeviceStats(const cMountStats& mountStats, const std::string& sDevicePath)
+{
+  return LogMountStats(mountStats, sDevicePath);
+}
+
+bool LogStatsToSyslogDeviceStatsAndBtrfsStats(const cMountStats& mountStats, const cBtrfsVolumeStats& btrfsVolumeStats, const std::string& sDevicePath)
+{
+  return LogMountStatsAndBtrfsStats(mountStats, btrfsVolumeStats, sDevicePath);
+}
+
+bool LogDriveEventToSyslog(const std::string& sEvent, const std::string& sMountPoint, const std::string& sName, const std::string& sDevicePath)
+{
+  // Events are never coalesced, each one matters
+  return WriteOutput(LOG_WARNING, "Drive " + sDevicePath + " " + sEvent, "", [sEvent, sMountPoint, sName, sDevicePath]() { return GetJSONDriveEvent(sEvent, sMountPoint, sName, sDevicePath); });
+}
+
+bool LogCollectionStatsToSyslog(const cCollectionStats& collectionStats)
+{
+  return WriteOutput(LOG_INFO, "lumber-jill Collection stats", "collection stats", [collectionStats]() { return GetJSONCollectionStats(collectionStats); });
+}
+
+bool LogSmartScheduleToSyslog(const cSmartSchedule& schedule)
+{
+  return WriteOutput(LOG_INFO, "lumber-jill SMART schedule", "smart schedule", [schedule]() { return GetJSONSmartSchedule(schedule); });
+}
+
+bool LogKernelErrorsToSyslog(const std::string& sMountPoint, const std::string& sName, const std::string& sDevicePath, const cKernelErrorStats& kernelErrorStats, const std::string& sMessage)
+{
+  return WriteOutput(LOG_WARNING, "Drive " + sDevicePath + " kernel errors", "", [sMountPoint, sName, sDevicePath, kernelErrorStats, sMessage]() { return GetJSONKernelErrors(sMountPoint, sName, sDevicePath, kernelErrorStats, sMessage); });
+}
+
+bool LogDriveAnomaliesToSyslog(const std::string& sMountPoint, const std::string& sName, const std::string& sDevicePath, const std::vector<cDriveAnomaly>& anomalies)
+{
+  return WriteOutput(LOG_WARNING, "Drive " + sDevicePath + " anomalies", "", [sMountPoint, sName, sDevicePath, anomalies]() { return GetJSONDriveAnomalies(sMountPoint, sName, sDevicePath, anomalies); });
+}
+
+bool LogCapacityAlertToSyslog(const cMountStats& mountStats, size_t nHorizonDays)
+{
+  return WriteOutput(LOG_WARNING, "Mount " + mountStats.sMountPoint + " capacity", "", [mountStats, nHorizonDays]() { return GetJSONCapacityAlert(mountStats, nHorizonDays); });
+}
+
+bool LogBtrfsQgroupStatsToSyslog(const std::string& sMountPoint, const cBtrfsQgroupStats& qgroupStats)
+{
+  return WriteOutput(LOG_INFO, "Mount " + sMountPoint + " qgroup stats", "qgroup " + sMountPoint, [sMountPoint, qgroupStats]() { return GetJSONBtrfsQgroupStats(sMountPoint, qgroupStats); });
+}
+
+bool LogDriveSelfTestToSyslog(const std::string& sMountPoint, const std::string& sName, const std::string& sDevicePath, const cDriveSelfTestStats& selfTestStats)
+{
+  return WriteOutput(LOG_WARNING, "Drive " + sDevicePath + " self-test", "", [sMountPoint, sName, sDevicePath, selfTestStats]() { return GetJSONDriveSelfTest(sMountPoint, sName, sDevicePath, selfTestStats); });
+}
+
+bool LogScrubStatsToSyslog(const std::string& sMountPoint, const cScrubStats& scrubStats)
+{
+  // Newly found errors are worth a warning, the regular progress updates are just information
+  const bool bHasNewErrors = std::any_of(scrubStats.devices.begin(), scrubStats.devices.end(), [](const cScrubDeviceProgress& progress) { return (progress.nNewErrors != 0); });
+  return WriteOutput(bHasNewErrors ? LOG_WARNING : LOG_INFO, "Mount " + sMountPoint + " scrub", bHasNewErrors ? "" : ("scrub " + sMountPoint), [sMountPoint, scrubStats]() { return GetJSONScrubStats(sMountPoint, scrubStats); });
 }
 
 }
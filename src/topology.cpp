@@ -0,0 +1,526 @@
+#include <cctype>
+#include <cstring>
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <system_error>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "topology.h"
+#include "utils.h"
+
+namespace lumberjill {
+
+namespace {
+
+// Read a small file such as a sysfs attribute into a buffer, this avoids the overhead of a std::ifstream per attribute
+bool ReadSmallFile(const std::string& sFilePath, std::string& contents)
+{
+  contents.clear();
+
+  const int fd = open(sFilePath.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+
+  char buffer[4096];
+  while (true) {
+    const ssize_t len = read(fd, buffer, sizeof(buffer));
+    if (len < 0) {
+      close(fd);
+      return false;
+    } else if (len == 0) {
+      break;
+    }
+
+    contents.append(buffer, size_t(len));
+  }
+
+  close(fd);
+  return true;
+}
+
+// List the entries in a folder, skipping "." and ".."
+bool ListFolder(const std::string& sFolderPath, std::vector<std::string>& entries)
+{
+  entries.clear();
+
+  DIR* dir = opendir(sFolderPath.c_str());
+  if (dir == nullptr) {
+    return false;
+  }
+
+  while (const struct dirent* entry = readdir(dir)) {
+    if ((strcmp(entry->d_name, ".") == 0) || (strcmp(entry->d_name, "..") == 0)) continue;
+
+    entries.push_back(entry->d_name);
+  }
+
+  closedir(dir);
+  return true;
+}
+
+std::string_view GetFileName(std::string_view path)
+{
+  const size_t last_slash = path.find_last_of('/');
+  return (last_slash == std::string_view::npos) ? path : path.substr(last_slash + 1);
+}
+
+// "0000:03:00.0"
+bool IsPCIAddress(std::string_view name)
+{
+  if ((name.length() != 12) || (name[4] != ':') || (name[7] != ':') || (name[10] != '.')) {
+    return false;
+  }
+
+  for (size_t i = 0; i < name.length(); i++) {
+    if ((i == 4) || (i == 7) || (i == 10)) continue;
+    if (!isxdigit(static_cast<unsigned char>(name[i]))) return false;
+  }
+
+  return true;
+}
+
+// "ata3", "nvme0"
+bool IsNameFollowedByNumber(std::string_view component, std::string_view name)
+{
+  if ((component.length() <= name.length()) || !component.starts_with(name)) {
+    return false;
+  }
+
+  for (size_t i = name.length(); i < component.length(); i++) {
+    if (!isdigit(static_cast<unsigned char>(component[i]))) return false;
+  }
+
+  return true;
+}
+
+bool ReadLink(const std::string& sPath, std::string& sTarget)
+{
+  char szTarget[PATH_MAX];
+  const ssize_t len = readlink(sPath.c_str(), szTarget, sizeof(szTarget) - 1);
+  if (len <= 0) {
+    return false;
+  }
+
+  sTarget.assign(szTarget, size_t(len));
+  return true;
+}
+
+// Lower numbers are better, we prefer names that describe the drive over names that are just serial numbers
+int GetStableNamePriority(std::string_view name)
+{
+  if (name.starts_with("nvme-eui.")) return 2;
+  if (name.starts_with("ata-") || name.starts_with("nvme-") || name.starts_with("usb-")) return 0;
+  if (name.starts_with("scsi-")) return 1;
+  if (name.starts_with("wwn-")) return 2;
+  return 3;
+}
+
+}
+
+std::string UnescapeMountInfoPath(std::string_view path)
+{
+  std::string result;
+  result.reserve(path.length());
+
+  for (size_t i = 0; i < path.length(); i++) {
+    if ((path[i] == '\\') && ((i + 3) < path.length()) && (path[i + 1] >= '0') && (path[i + 1] <= '3') && (path[i + 2] >= '0') && (path[i + 2] <= '7') && (path[i + 3] >= '0') && (path[i + 3] <= '7')) {
+      result.push_back(char(((path[i + 1] - '0') * 64) + ((path[i + 2] - '0') * 8) + (path[i + 3] - '0')));
+      i += 3;
+    } else {
+      result.push_back(path[i]);
+    }
+  }
+
+  return result;
+}
+
+std::string GetControllerFromSysfsPath(std::string_view path)
+{
+  std::string_view pci_address;
+  std::string_view host;
+
+  while (!path.empty()) {
+    const size_t slash = path.find('/');
+    const std::string_view component = path.substr(0, slash);
+
+    if (IsPCIAddress(component)) {
+      pci_address = component;
+    } else if (host.empty() && component.starts_with("host") && (component.length() > 4) && isdigit(static_cast<unsigned char>(component[4]))) {
+      host = component;
+    }
+
+    if (slash == std::string_view::npos) break;
+    path.remove_prefix(slash + 1);
+  }
+
+  return std::string(!pci_address.empty() ? pci_address : host);
+}
+
+std::string GetBlockDeviceController(const std::string& sSysFolder, const std::string& sNode)
+{
+  std::string sTarget;
+  if (!ReadLink(sSysFolder + "/class/block/" + sNode, sTarget) && !ReadLink(sSysFolder + "/block/" + sNode, sTarget)) {
+    return "";
+  }
+
+  return GetControllerFromSysfsPath(sTarget);
+}
+
+std::vector<std::string> GetKernelNamesFromSysfsPath(std::string_view path)
+{
+  std::vector<std::string> names;
+
+  std::string_view previous;
+  while (!path.empty()) {
+    const size_t slash = path.find('/');
+    const std::string_view component = path.substr(0, slash);
+
+    if (IsNameFollowedByNumber(component, "ata") || ((previous == "nvme") && IsNameFollowedByNumber(component, "nvme"))) {
+      names.push_back(std::string(component));
+    }
+
+    previous = component;
+
+    if (slash == std::string_view::npos) break;
+    path.remove_prefix(slash + 1);
+  }
+
+  return names;
+}
+
+std::vector<std::string> GetBlockDeviceKernelNames(const std::string& sSysFolder, const std::string& sNode)
+{
+  std::string sTarget;
+  if (!ReadLink(sSysFolder + "/class/block/" + sNode, sTarget) && !ReadLink(sSysFolder + "/block/" + sNode, sTarget)) {
+    return std::vector<std::string>();
+  }
+
+  return GetKernelNamesFromSysfsPath(sTarget);
+}
+
+cTopology::cTopology() :
+  sSysFolder("/sys"),
+  sDevFolder("/dev"),
+  sMountInfoFilePath("/proc/self/mountinfo"),
+  bIsStale(true)
+{
+}
+
+cTopology::cTopology(const std::string& _sSysFolder, const std::string& _sDevFolder, const std::string& _sMountInfoFilePath) :
+  sSysFolder(_sSysFolder),
+  sDevFolder(_sDevFolder),
+  sMountInfoFilePath(_sMountInfoFilePath),
+  bIsStale(true)
+{
+}
+
+cTopology::~cTopology()
+{
+}
+
+void cTopology::Clear()
+{
+  blockDevices.clear();
+  mapNodeToBlockDeviceIndex.clear();
+  mapMountPointToMountInfo.clear();
+}
+
+bool cTopology::Scan()
+{
+  Clear();
+
+  if (!ScanBlockDevices()) {
+    std::cerr<<"lumber-jill Failed to scan block devices in \""<<sSysFolder<<"/block\""<<std::endl;
+    syslog(LOG_ERR, "lumber-jill Failed to scan block devices in \"%s/block\"", sSysFolder.c_str());
+    return false;
+  }
+
+  // These are optional, there may be no by-id links or no btrfs file systems
+  ScanStableNames();
+  ScanBtrfsFileSystems();
+
+  if (!ScanMountInfo()) {
+    std::cerr<<"lumber-jill Failed to read mounts from \""<<sMountInfoFilePath<<"\""<<std::endl;
+    syslog(LOG_ERR, "lumber-jill Failed to read mounts from \"%s\"", sMountInfoFilePath.c_str());
+    return false;
+  }
+
+  bIsStale = false;
+  return true;
+}
+
+bool cTopology::RefreshIfStale()
+{
+  if (!bIsStale) {
+    return true;
+  }
+
+  return Scan();
+}
+
+bool cTopology::ScanBlockDevices()
+{
+  //$ ls /sys/block
+  //loop0 sda sdb sdc
+  //$ ls /sys/block/sda
+  //... queue sda1 sda2 size ...
+  std::vector<std::string> disks;
+  if (!ListFolder(sSysFolder + "/block", disks)) {
+    return false;
+  }
+
+  std::sort(disks.begin(), disks.end());
+
+  std::vector<std::string> entries;
+  std::string contents;
+
+  for (auto& sDisk : disks) {
+    // Skip virtual devices that can't have SMART data
+    if (sDisk.starts_with("loop") || sDisk.starts_with("ram") || sDisk.starts_with("zram")) continue;
+
+    const std::string sDiskFolder = sSysFolder + "/block/" + sDisk;
+
+    cBlockDevice disk;
+    disk.sNode = sDisk;
+    disk.sDiskNode = sDisk;
+    if (ReadSmallFile(sDiskFolder + "/queue/rotational", contents)) {
+      disk.bIsRotational = contents.starts_with('1');
+    }
+    if (ReadLink(sDiskFolder, contents)) {
+      disk.sController = GetControllerFromSysfsPath(contents);
+    }
+
+    mapNodeToBlockDeviceIndex[disk.sNode] = blockDevices.size();
+    blockDevices.push_back(disk);
+
+    // Partitions are sub folders named after the disk
+    ListFolder(sDiskFolder, entries);
+    std::sort(entries.begin(), entries.end());
+    for (auto& sEntry : entries) {
+      if (!sEntry.starts_with(sDisk) || (sEntry == sDisk)) continue;
+
+      cBlockDevice partition;
+      partition.sNode = sEntry;
+      partition.sDiskNode = sDisk;
+      partition.bIsPartition = true;
+      partition.bIsRotational = disk.bIsRotational;
+      partition.sController = disk.sController;
+
+      mapNodeToBlockDeviceIndex[partition.sNode] = blockDevices.size();
+      blockDevices.push_back(partition);
+    }
+  }
+
+  return true;
+}
+
+void cTopology::ScanStableNames()
+{
+  //$ ls -l /dev/disk/by-id
+  //ata-ST6000VN001-2BB186_ZR10KNTX -> ../../sdb
+  //wwn-0x5000c500c3d1a2b3 -> ../../sdb
+  const std::string sByIDFolder = sDevFolder + "/disk/by-id";
+
+  std::vector<std::string> links;
+  if (!ListFolder(sByIDFolder, links)) {
+    return;
+  }
+
+  std::sort(links.begin(), links.end());
+
+  char szTarget[PATH_MAX];
+  for (auto& sLink : links) {
+    const ssize_t len = readlink((sByIDFolder + "/" + sLink).c_str(), szTarget, sizeof(szTarget) - 1);
+    if (len <= 0) continue;
+
+    const std::string_view node = GetFileName(std::string_view(szTarget, size_t(len)));
+
+    auto iter = mapNodeToBlockDeviceIndex.find(node);
+    if (iter == mapNodeToBlockDeviceIndex.end()) continue;
+
+    cBlockDevice& blockDevice = blockDevices[iter->second];
+    if (blockDevice.sStableName.empty() || (GetStableNamePriority(sLink) < GetStableNamePriority(blockDevice.sStableName))) {
+      blockDevice.sStableName = sLink;
+    }
+  }
+}
+
+void cTopology::ScanBtrfsFileSystems()
+{
+  //$ ls /sys/fs/btrfs/
+  //features  6f2ae1b4-2a5e-4a8a-9a2c-4d6f0c6a3d52
+  //$ ls /sys/fs/btrfs/6f2ae1b4-2a5e-4a8a-9a2c-4d6f0c6a3d52/devices
+  //sdb  sdc  sdd
+  const std::string sBtrfsFolder = sSysFolder + "/fs/btrfs";
+
+  std::vector<std::string> fsids;
+  if (!ListFolder(sBtrfsFolder, fsids)) {
+    return;
+  }
+
+  std::vector<std::string> nodes;
+  for (auto& sFSID : fsids) {
+    if (!ListFolder(sBtrfsFolder + "/" + sFSID + "/devices", nodes)) continue;
+
+    for (auto& sNode : nodes) {
+      auto iter = mapNodeToBlockDeviceIndex.find(sNode);
+      if (iter != mapNodeToBlockDeviceIndex.end()) {
+        blockDevices[iter->second].sBtrfsFSID = sFSID;
+      }
+    }
+  }
+}
+
+bool cTopology::ScanMountInfo()
+{
+  //$ cat /proc/self/mountinfo
+  //36 35 98:0 /mnt1 /mnt/parent rw,noatime master:1 - ext3 /dev/root rw,errors=continue
+  //(1)(2)(3)   (4)   (5)      (6)      (7)   (8) (9)   (10)         (11)
+  std::string contents;
+  if (!ReadSmallFile(sMountInfoFilePath, contents)) {
+    return false;
+  }
+
+  std::string_view view(contents);
+  while (!view.empty()) {
+    size_t new_line = view.find('\n');
+    if (new_line == std::string_view::npos) {
+      new_line = view.length();
+    }
+
+    std::string_view line = view.substr(0, new_line);
+    view.remove_prefix(std::min(new_line + 1, view.length()));
+
+    // Skip to the mount point, the 5th field
+    std::string_view mount_point;
+    for (size_t field = 0; field < 5; field++) {
+      const size_t space = line.find(' ');
+      if (space == std::string_view::npos) {
+        line = std::string_view();
+        break;
+      }
+
+      mount_point = line.substr(0, space);
+      line.remove_prefix(space + 1);
+    }
+
+    // The optional fields end with a single "-"
+    const size_t separator = line.find(" - ");
+    if (mount_point.empty() || (separator == std::string_view::npos)) continue;
+
+    line.remove_prefix(separator + 3);
+
+    const size_t type_end = line.find(' ');
+    if (type_end == std::string_view::npos) continue;
+
+    cMountInfo mountInfo;
+    mountInfo.sFileSystemType = line.substr(0, type_end);
+    line.remove_prefix(type_end + 1);
+
+    const size_t source_end = line.find(' ');
+    mountInfo.sSource = UnescapeMountInfoPath(line.substr(0, source_end));
+
+    // Later mounts on the same mount point hide the earlier ones
+    mapMountPointToMountInfo[UnescapeMountInfoPath(mount_point)] = mountInfo;
+  }
+
+  return true;
+}
+
+const cBlockDevice* cTopology::FindBlockDevice(std::string_view node) const
+{
+  auto iter = mapNodeToBlockDeviceIndex.find(node);
+  if (iter == mapNodeToBlockDeviceIndex.end()) {
+    return nullptr;
+  }
+
+  return &blockDevices[iter->second];
+}
+
+std::string cTopology::GetDevicePath(const cBlockDevice& blockDevice) const
+{
+  // The sdX names can be handed out in a different order after a reboot, and the anomaly baselines and self-test times are saved by path
+  if (!blockDevice.sStableName.empty()) {
+    return sDevFolder + "/disk/by-id/" + blockDevice.sStableName;
+  }
+
+  return sDevFolder + "/" + blockDevice.sNode;
+}
+
+bool cTopology::GetDevicesForMountPoint(const std::string& sMountPoint, GROUP_TYPE type, std::vector<cDevice>& devices) const
+{
+  devices.clear();
+
+  auto iter = mapMountPointToMountInfo.find(sMountPoint);
+  if (iter == mapMountPointToMountInfo.end()) {
+    return false;
+  }
+
+  // Resolve symlinks like /dev/mapper/data -> /dev/dm-0
+  std::string_view node = GetFileName(iter->second.sSource);
+  std::error_code ec;
+  const std::filesystem::path canonical = std::filesystem::canonical(iter->second.sSource, ec);
+  const std::string sCanonicalNode = ec ? "" : canonical.filename().string();
+  if ((FindBlockDevice(node) == nullptr) && !sCanonicalNode.empty()) {
+    node = sCanonicalNode;
+  }
+
+  const cBlockDevice* pSource = FindBlockDevice(node);
+  if (pSource == nullptr) {
+    return false;
+  }
+
+  if ((type == GROUP_TYPE::BTRFS) && !pSource->sBtrfsFSID.empty()) {
+    // Every device in the btrfs file system, named the way "btrfs device stats" names them
+    for (auto& blockDevice : blockDevices) {
+      if (blockDevice.sBtrfsFSID != pSource->sBtrfsFSID) continue;
+
+      cDevice device;
+      device.sName = "BTRFS " + (blockDevice.sStableName.empty() ? blockDevice.sNode : blockDevice.sStableName);
+      device.sPath = GetDevicePath(blockDevice);
+      devices.push_back(device);
+    }
+  } else {
+    // The whole disk that this mount is on
+    const cBlockDevice* pDisk = FindBlockDevice(pSource->sDiskNode);
+    if (pDisk == nullptr) {
+      return false;
+    }
+
+    cDevice device;
+    device.sName = pDisk->sStableName.empty() ? pDisk->sNode : pDisk->sStableName;
+    device.sPath = GetDevicePath(*pDisk);
+    devices.push_back(device);
+  }
+
+  return !devices.empty();
+}
+
+bool cTopology::ResolveGroups(const std::vector<cGroup>& groups, std::vector<cGroup>& outGroups) const
+{
+  outGroups = groups;
+
+  bool result = true;
+
+  for (auto& group : outGroups) {
+    if (!group.bAutoDiscoverDevices) continue;
+
+    if (!GetDevicesForMountPoint(group.sMountPoint, group.type, group.devices)) {
+      std::cerr<<"lumber-jill Failed to discover the devices for mount \""<<group.sMountPoint<<"\""<<std::endl;
+      syslog(LOG_ERR, "lumber-jill Failed to discover the devices for mount \"%s\"", group.sMountPoint.c_str());
+      result = false;
+    }
+  }
+
+  return result;
+}
+
+}
@@ -0,0 +1,165 @@
+#include <cerrno>
+#include <cstring>
+
+#include <iostream>
+#include <utility>
+
+#include <linux/netlink.h>
+#include <sys/socket.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "uevent.h"
+
+namespace lumberjill {
+
+// These are defaulted out of line so that they stay memberwise, including the moves, without the compiler trying to inline copying every string
+cUEvent::cUEvent()
+{
+}
+
+cUEvent::cUEvent(const cUEvent& rhs) = default;
+cUEvent::cUEvent(cUEvent&& rhs) = default;
+cUEvent::~cUEvent() = default;
+
+cUEvent& cUEvent::operator=(const cUEvent& rhs) = default;
+cUEvent& cUEvent::operator=(cUEvent&& rhs) = default;
+
+void cUEvent::Clear()
+{
+  sAction.clear();
+  sDevPath.clear();
+  sSubsystem.clear();
+  sDevName.clear();
+  sDevType.clear();
+}
+
+bool ParseUEvent(std::string_view message, cUEvent& event)
+{
+  event.Clear();
+
+  // Messages from udev rather than the kernel start with "libudev" and a binary header, we only want the kernel ones
+  if (message.starts_with("libudev")) {
+    return false;
+  }
+
+  // The first field is the "action@devpath" summary, the rest are KEY=value pairs
+  bool bIsFirstField = true;
+  while (!message.empty()) {
+    size_t end = message.find('\0');
+    if (end == std::string_view::npos) {
+      end = message.length();
+    }
+
+    const std::string_view field = message.substr(0, end);
+    message.remove_prefix(std::min(end + 1, message.length()));
+
+    if (bIsFirstField) {
+      bIsFirstField = false;
+      if (field.find('@') == std::string_view::npos) {
+        return false;
+      }
+
+      continue;
+    }
+
+    if (field.starts_with("ACTION=")) event.sAction = field.substr(strlen("ACTION="));
+    else if (field.starts_with("DEVPATH=")) event.sDevPath = field.substr(strlen("DEVPATH="));
+    else if (field.starts_with("SUBSYSTEM=")) event.sSubsystem = field.substr(strlen("SUBSYSTEM="));
+    else if (field.starts_with("DEVNAME=")) event.sDevName = field.substr(strlen("DEVNAME="));
+    else if (field.starts_with("DEVTYPE=")) event.sDevType = field.substr(strlen("DEVTYPE="));
+  }
+
+  return (!event.sAction.empty() && !event.sDevPath.empty());
+}
+
+cUEventSocket::cUEventSocket() :
+  fd(-1)
+{
+}
+
+cUEventSocket::~cUEventSocket()
+{
+  Close();
+}
+
+bool cUEventSocket::Open()
+{
+  Close();
+
+  fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+  if (fd < 0) {
+    std::cerr<<"cUEventSocket::Open socket failed: "<<strerror(errno)<<std::endl;
+    syslog(LOG_ERR, "cUEventSocket::Open socket failed: %s", strerror(errno));
+    return false;
+  }
+
+  struct sockaddr_nl address;
+  memset(&address, 0, sizeof(address));
+  address.nl_family = AF_NETLINK;
+  address.nl_pid = 0; // Let the kernel pick
+  address.nl_groups = 1; // Kernel events, udev events are group 2
+
+  if (bind(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0) {
+    std::cerr<<"cUEventSocket::Open bind failed: "<<strerror(errno)<<std::endl;
+    syslog(LOG_ERR, "cUEventSocket::Open bind failed: %s", strerror(errno));
+    Close();
+    return false;
+  }
+
+  return true;
+}
+
+void cUEventSocket::Attach(int _fd)
+{
+  Close();
+
+  fd = _fd;
+}
+
+void cUEventSocket::Close()
+{
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+}
+
+bool cUEventSocket::ReadEvents(std::vector<cUEvent>& events)
+{
+  events.clear();
+
+  if (fd < 0) {
+    return false;
+  }
+
+  // uevent messages are limited to 2048 bytes of environment plus the summary
+  char buffer[8192];
+
+  cUEvent event;
+  while (true) {
+    const ssize_t len = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (len < 0) {
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) break;
+      else if (errno == EINTR) continue;
+      else if (errno == ENOBUFS) {
+        // The kernel dropped some events because we were too slow, carry on with the ones we have
+        syslog(LOG_WARNING, "cUEventSocket::ReadEvents uevents were dropped");
+        continue;
+      }
+
+      std::cerr<<"cUEventSocket::ReadEvents recv failed: "<<strerror(errno)<<std::endl;
+      return false;
+    } else if (len == 0) {
+      break;
+    }
+
+    if (ParseUEvent(std::string_view(buffer, size_t(len)), event)) {
+      events.push_back(std::move(event));
+    }
+  }
+
+  return true;
+}
+
+}
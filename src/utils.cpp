@@ -1,10 +1,14 @@
+#include <cerrno>
 #include <charconv>
+#include <ctime>
 #include <cstring>
 #include <limits>
 #include <iostream>
 #include <fstream>
 #include <filesystem>
+#include <system_error>
 
+#include <fcntl.h>
 #include <poll.h>
 #include <pwd.h>
 #include <sys/stat.h>
@@ -33,6 +37,16 @@ std::string GetHomeFolder()
   return "";
 }
 
+uint64_t GetTimeSinceBootMS()
+{
+  struct timespec now;
+  if (clock_gettime(CLOCK_BOOTTIME, &now) != 0) {
+    return 0;
+  }
+
+  return (uint64_t(now.tv_sec) * 1000) + (uint64_t(now.tv_nsec) / 1000000);
+}
+
 std::string GetConfigFolder(const std::string& sApplicationNameLower)
 {
   const std::string sHomeFolder = GetHomeFolder();
@@ -173,4 +187,131 @@ POLL_READ_RESULT PollRead(int timeout_ms, int fd0, int fd1, bool& fd0_ready, boo
   return POLL_READ_RESULT::TIMED_OUT;
 }
 
+
+namespace {
+
+bool WriteAll(int fd, const void* pData, size_t nBytes)
+{
+  const uint8_t* p = static_cast<const uint8_t*>(pData);
+  while (nBytes != 0) {
+    const ssize_t len = write(fd, p, nBytes);
+    if (len < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    p += len;
+    nBytes -= size_t(len);
+  }
+
+  return true;
+}
+
+bool ReadAll(int fd, void* pData, size_t nBytes)
+{
+  uint8_t* p = static_cast<uint8_t*>(pData);
+  while (nBytes != 0) {
+    const ssize_t len = read(fd, p, nBytes);
+    if (len < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    } else if (len == 0) {
+      return false;
+    }
+    p += len;
+    nBytes -= size_t(len);
+  }
+
+  return true;
+}
+
+}
+
+bool IsStateFileHeaderValid(const cStateFileHeader& header, const char szMagic[8], uint32_t nVersion, size_t nEntrySizeBytes, size_t nFileSizeBytes)
+{
+  return (
+    (nFileSizeBytes >= sizeof(cStateFileHeader)) &&
+    (memcmp(header.szMagic, szMagic, sizeof(header.szMagic)) == 0) &&
+    (header.nVersion == nVersion) &&
+    (header.nEntrySizeBytes == nEntrySizeBytes) &&
+    (header.nEntries <= ((nFileSizeBytes - sizeof(cStateFileHeader)) / nEntrySizeBytes)) &&
+    (nFileSizeBytes == (sizeof(cStateFileHeader) + (size_t(header.nEntries) * nEntrySizeBytes)))
+  );
+}
+
+int OpenStateFile(const std::string& sFilePath, const char szMagic[8], uint32_t nVersion, size_t nEntrySizeBytes, size_t& nEntries)
+{
+  nEntries = 0;
+
+  const int fd = open(sFilePath.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    // Nothing has been saved yet
+    return -1;
+  }
+
+  struct stat s;
+  cStateFileHeader header;
+  if ((fstat(fd, &s) != 0) || (size_t(s.st_size) < sizeof(cStateFileHeader)) || !ReadAll(fd, &header, sizeof(header))) {
+    close(fd);
+    return -1;
+  }
+
+  // Anything that doesn't look exactly right is ignored and will be replaced on the next save
+  if (!IsStateFileHeaderValid(header, szMagic, nVersion, nEntrySizeBytes, size_t(s.st_size))) {
+    syslog(LOG_WARNING, "OpenStateFile Ignoring invalid state file \"%s\"", sFilePath.c_str());
+    close(fd);
+    return -1;
+  }
+
+  nEntries = size_t(header.nEntries);
+  return fd;
+}
+
+bool ReadStateFileEntries(int fd, const std::string& sFilePath, void* pEntries, size_t nSizeBytes)
+{
+  const bool bRead = ReadAll(fd, pEntries, nSizeBytes);
+  close(fd);
+  if (!bRead) {
+    std::cerr<<"ReadStateFileEntries Error reading \""<<sFilePath<<"\""<<std::endl;
+    syslog(LOG_ERR, "ReadStateFileEntries Error reading \"%s\"", sFilePath.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+bool SaveStateFile(const std::string& sFilePath, const char szMagic[8], uint32_t nVersion, size_t nEntrySizeBytes, const void* pEntries, size_t nEntries, bool bSync)
+{
+  cStateFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.szMagic, szMagic, sizeof(header.szMagic));
+  header.nVersion = nVersion;
+  header.nEntrySizeBytes = uint32_t(nEntrySizeBytes);
+  header.nEntries = nEntries;
+
+  std::error_code ec;
+  std::filesystem::create_directories(std::filesystem::path(sFilePath).parent_path(), ec);
+
+  const std::string sTemporaryFilePath = sFilePath + ".tmp." + std::to_string(getpid());
+  const int fd = open(sTemporaryFilePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+  if (fd < 0) {
+    std::cerr<<"SaveStateFile Error creating \""<<sTemporaryFilePath<<"\": "<<strerror(errno)<<std::endl;
+    syslog(LOG_ERR, "SaveStateFile Error creating \"%s\": %s", sTemporaryFilePath.c_str(), strerror(errno));
+    return false;
+  }
+
+  const bool bWritten = WriteAll(fd, &header, sizeof(header)) && WriteAll(fd, pEntries, nEntries * nEntrySizeBytes) && (!bSync || (fsync(fd) == 0));
+  const int nWriteErrno = errno;
+  close(fd);
+
+  if (!bWritten || (rename(sTemporaryFilePath.c_str(), sFilePath.c_str()) != 0)) {
+    const int nErrno = bWritten ? errno : nWriteErrno;
+    std::cerr<<"SaveStateFile Error writing \""<<sFilePath<<"\": "<<strerror(nErrno)<<std::endl;
+    syslog(LOG_ERR, "SaveStateFile Error writing \"%s\": %s", sFilePath.c_str(), strerror(nErrno));
+    unlink(sTemporaryFilePath.c_str());
+    return false;
+  }
+
+  return true;
+}
+
 }
@@ -0,0 +1,227 @@
+#include <ctime>
+#include <fstream>
+#include <random>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "anomaly.h"
+
+#include "temporary_folder.h"
+
+namespace {
+
+const int64_t COLLECTION_INTERVAL_SECONDS = 60 * 60;
+
+lumberjill::cAnomalySettings CreateSettings()
+{
+  lumberjill::cAnomalySettings settings;
+  settings.bEnabled = true;
+  settings.nHalfLifeSamples = 14;
+  settings.nWarmupSamples = 5;
+  settings.nThresholdSigma = 4;
+  return settings;
+}
+
+void SetReadErrors(lumberjill::cMountStats& mountStats, lumberjill::cBtrfsVolumeStats& btrfsVolumeStats, const std::string& sDevicePath, size_t nReadErrors)
+{
+  mountStats.mapDrivePathToDriveStats[sDevicePath].sName = sDevicePath;
+  btrfsVolumeStats.mapDrivePathToBtrfsDriveStats[sDevicePath].nRead_io_errs = nReadErrors;
+}
+
+const lumberjill::cDriveAnomaly* FindAnomaly(const lumberjill::cMountStats& mountStats, const std::string& sDevicePath, const std::string& sMetric, lumberjill::ANOMALY_KIND kind)
+{
+  const auto found = mountStats.mapDrivePathToDriveStats.find(sDevicePath);
+  if (found == mountStats.mapDrivePathToDriveStats.end()) return nullptr;
+
+  for (auto& anomaly : found->second.anomalies) {
+    if ((anomaly.sMetric == sMetric) && (anomaly.kind == kind)) return &anomaly;
+  }
+
+  return nullptr;
+}
+
+}
+
+TEST(Anomaly, TestBaselineWarmup)
+{
+  lumberjill::cAnomalyBaseline baseline;
+
+  // Nothing is flagged until there is enough history, however big the jump
+  EXPECT_EQ(0.0, baseline.Add(1.0, 0.1, 1.0, 3));
+  EXPECT_EQ(0.0, baseline.Add(1000.0, 0.1, 1.0, 3));
+  EXPECT_EQ(0.0, baseline.Add(1.0, 0.1, 1.0, 3));
+  EXPECT_EQ(3u, baseline.nSamples);
+
+  // Now it is
+  EXPECT_GT(baseline.Add(10000.0, 0.1, 1.0, 3), 4.0);
+
+  // Going down is never flagged
+  EXPECT_EQ(0.0, baseline.Add(0.0, 0.1, 1.0, 3));
+}
+
+TEST(Anomaly, TestNoisyDriveIsNotFlaggedButQuietDriveIs)
+{
+  const lumberjill::cAnomalySettings settings = CreateSettings();
+  lumberjill::cAnomalyDetector detector;
+
+  std::mt19937 generator(42);
+  std::uniform_int_distribution<size_t> noise(0, 20);
+
+  size_t nNoisyErrors = 0;
+  size_t nQuietErrors = 0;
+  int64_t nTimestamp = 1700000000;
+
+  for (size_t i = 0; i < 100; i++) {
+    // The noisy drive has always had a steady trickle of errors
+    nNoisyErrors += noise(generator);
+    nTimestamp += COLLECTION_INTERVAL_SECONDS;
+
+    lumberjill::cMountStats mountStats;
+    lumberjill::cBtrfsVolumeStats btrfsVolumeStats;
+    SetReadErrors(mountStats, btrfsVolumeStats, "/dev/sda", nNoisyErrors);
+    SetReadErrors(mountStats, btrfsVolumeStats, "/dev/sdb", nQuietErrors);
+    detector.Update(settings, nTimestamp, mountStats, &btrfsVolumeStats);
+
+    EXPECT_TRUE(FindAnomaly(mountStats, "/dev/sda", "read_io_errs", lumberjill::ANOMALY_KIND::SELF) == nullptr);
+    EXPECT_TRUE(FindAnomaly(mountStats, "/dev/sdb", "read_io_errs", lumberjill::ANOMALY_KIND::SELF) == nullptr);
+  }
+
+  // The quiet drive starts getting errors, fewer than the noisy drive gets normally
+  nNoisyErrors += 10;
+  nQuietErrors += 5;
+  nTimestamp += COLLECTION_INTERVAL_SECONDS;
+
+  lumberjill::cMountStats mountStats;
+  lumberjill::cBtrfsVolumeStats btrfsVolumeStats;
+  SetReadErrors(mountStats, btrfsVolumeStats, "/dev/sda", nNoisyErrors);
+  SetReadErrors(mountStats, btrfsVolumeStats, "/dev/sdb", nQuietErrors);
+  detector.Update(settings, nTimestamp, mountStats, &btrfsVolumeStats);
+
+  EXPECT_TRUE(FindAnomaly(mountStats, "/dev/sda", "read_io_errs", lumberjill::ANOMALY_KIND::SELF) == nullptr);
+
+  const lumberjill::cDriveAnomaly* pAnomaly = FindAnomaly(mountStats, "/dev/sdb", "read_io_errs", lumberjill::ANOMALY_KIND::SELF);
+  ASSERT_TRUE(pAnomaly != nullptr);
+  EXPECT_NEAR(120.0, pAnomaly->dValue, 0.001);  // 5 errors in an hour is 120 per day
+  EXPECT_NEAR(0.0, pAnomaly->dExpected, 0.001);
+  EXPECT_GE(pAnomaly->dScore, 4.0);
+}
+
+TEST(Anomaly, TestCounterReset)
+{
+  const lumberjill::cAnomalySettings settings = CreateSettings();
+  lumberjill::cAnomalyDetector detector;
+
+  int64_t nTimestamp = 1700000000;
+  for (size_t i = 0; i < 20; i++) {
+    nTimestamp += COLLECTION_INTERVAL_SECONDS;
+
+    lumberjill::cMountStats mountStats;
+    lumberjill::cBtrfsVolumeStats btrfsVolumeStats;
+    SetReadErrors(mountStats, btrfsVolumeStats, "/dev/sda", 1000);
+    detector.Update(settings, nTimestamp, mountStats, &btrfsVolumeStats);
+  }
+
+  // "btrfs device stats --reset" or a replaced drive, the counter going back to 0 isn't a rate
+  nTimestamp += COLLECTION_INTERVAL_SECONDS;
+  lumberjill::cMountStats mountStats;
+  lumberjill::cBtrfsVolumeStats btrfsVolumeStats;
+  SetReadErrors(mountStats, btrfsVolumeStats, "/dev/sda", 0);
+  detector.Update(settings, nTimestamp, mountStats, &btrfsVolumeStats);
+  EXPECT_TRUE(mountStats.mapDrivePathToDriveStats["/dev/sda"].anomalies.empty());
+
+  // And counting again from 0 is back to normal
+  nTimestamp += COLLECTION_INTERVAL_SECONDS;
+  SetReadErrors(mountStats, btrfsVolumeStats, "/dev/sda", 0);
+  detector.Update(settings, nTimestamp, mountStats, &btrfsVolumeStats);
+  EXPECT_TRUE(mountStats.mapDrivePathToDriveStats["/dev/sda"].anomalies.empty());
+}
+
+TEST(Anomaly, TestPeerOutlier)
+{
+  const lumberjill::cAnomalySettings settings = CreateSettings();
+  lumberjill::cAnomalyDetector detector;
+
+  // Same model, same enclosure, one of them has always been slow
+  lumberjill::cMountStats mountStats;
+  for (size_t i = 0; i < 20; i++) {
+    mountStats.mapDrivePathToDriveStats.clear();
+    for (size_t d = 0; d < 6; d++) {
+      lumberjill::cDriveStats& driveStats = mountStats.mapDrivePathToDriveStats["/dev/sd" + std::string(1, char('a' + d))];
+      lumberjill::cDiskIOStats diskIOStats;
+      diskIOStats.dReadAwaitMS = (d == 3) ? 80.0 : 8.0 + double(d);
+      diskIOStats.dWriteAwaitMS = 10.0;
+      diskIOStats.dUtilisationPercent = 20.0;
+      driveStats.diskIOStats = diskIOStats;
+    }
+
+    detector.Update(settings, 1700000000 + (int64_t(i) * COLLECTION_INTERVAL_SECONDS), mountStats, nullptr);
+  }
+
+  // Its own history says it is fine, but it is much slower than the rest of its group
+  EXPECT_TRUE(FindAnomaly(mountStats, "/dev/sdd", "readAwaitMS", lumberjill::ANOMALY_KIND::SELF) == nullptr);
+
+  const lumberjill::cDriveAnomaly* pAnomaly = FindAnomaly(mountStats, "/dev/sdd", "readAwaitMS", lumberjill::ANOMALY_KIND::PEERS);
+  ASSERT_TRUE(pAnomaly != nullptr);
+  EXPECT_NEAR(80.0, pAnomaly->dValue, 0.001);
+  EXPECT_GE(pAnomaly->dScore, 4.0);
+
+  for (auto& item : mountStats.mapDrivePathToDriveStats) {
+    if (item.first != "/dev/sdd") {
+      EXPECT_TRUE(item.second.anomalies.empty()) << item.first;
+    }
+  }
+}
+
+TEST(Anomaly, TestSaveAndLoad)
+{
+  const cTemporaryFolder folder("anomaly");
+  const std::string sFilePath = folder.GetFilePath("state/anomaly.state");
+
+  const lumberjill::cAnomalySettings settings = CreateSettings();
+
+  // Recent enough not to be expired when saving
+  int64_t nTimestamp = int64_t(time(nullptr)) - (100 * COLLECTION_INTERVAL_SECONDS);
+
+  {
+    lumberjill::cAnomalyDetector detector;
+    EXPECT_FALSE(detector.Load(sFilePath));
+    EXPECT_TRUE(detector.IsLoaded());
+
+    for (size_t i = 0; i < 10; i++) {
+      nTimestamp += COLLECTION_INTERVAL_SECONDS;
+
+      lumberjill::cMountStats mountStats;
+      lumberjill::cBtrfsVolumeStats btrfsVolumeStats;
+      SetReadErrors(mountStats, btrfsVolumeStats, "/dev/sda", 0);
+      SetReadErrors(mountStats, btrfsVolumeStats, "/dev/sdb", 0);
+      detector.Update(settings, nTimestamp, mountStats, &btrfsVolumeStats);
+    }
+
+    EXPECT_EQ(2u, detector.GetDriveCount());
+    EXPECT_TRUE(detector.Save(sFilePath));
+  }
+
+  // A second run picks up where the first left off, so the very next sample can be flagged
+  lumberjill::cAnomalyDetector detector;
+  EXPECT_TRUE(detector.Load(sFilePath));
+  EXPECT_EQ(2u, detector.GetDriveCount());
+
+  nTimestamp += COLLECTION_INTERVAL_SECONDS;
+  lumberjill::cMountStats mountStats;
+  lumberjill::cBtrfsVolumeStats btrfsVolumeStats;
+  SetReadErrors(mountStats, btrfsVolumeStats, "/dev/sda", 0);
+  SetReadErrors(mountStats, btrfsVolumeStats, "/dev/sdb", 50);
+  detector.Update(settings, nTimestamp, mountStats, &btrfsVolumeStats);
+
+  EXPECT_TRUE(FindAnomaly(mountStats, "/dev/sda", "read_io_errs", lumberjill::ANOMALY_KIND::SELF) == nullptr);
+  EXPECT_TRUE(FindAnomaly(mountStats, "/dev/sdb", "read_io_errs", lumberjill::ANOMALY_KIND::SELF) != nullptr);
+
+  // A file from something else is ignored
+  {
+    std::ofstream file(sFilePath, std::ios::binary | std::ios::trunc);
+    file<<"not an anomaly state file";
+  }
+  EXPECT_FALSE(detector.Load(sFilePath));
+  EXPECT_EQ(0u, detector.GetDriveCount());
+}
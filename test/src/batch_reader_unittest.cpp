@@ -0,0 +1,178 @@
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "batch_reader.h"
+
+namespace {
+
+// A folder of small files like the sysfs attributes that we read
+class cFakeSysFolder {
+public:
+  cFakeSysFolder()
+  {
+    char szFolder[] = "/tmp/lumber-jill-batch-reader-XXXXXX";
+    if (mkdtemp(szFolder) != nullptr) sFolder = szFolder;
+  }
+
+  ~cFakeSysFolder()
+  {
+    for (int fd : fds) close(fd);
+
+    std::error_code ec;
+    std::filesystem::remove_all(sFolder, ec);
+  }
+
+  // Write a file and open it
+  int Open(const std::string& sFileName, const std::string& contents)
+  {
+    const std::string sFilePath = sFolder + "/" + sFileName;
+    std::ofstream(sFilePath)<<contents;
+
+    const int fd = open(sFilePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) fds.push_back(fd);
+    return fd;
+  }
+
+  void Write(const std::string& sFileName, const std::string& contents)
+  {
+    std::ofstream(sFolder + "/" + sFileName)<<contents;
+  }
+
+  const std::string& GetFolder() const { return sFolder; }
+
+private:
+  std::string sFolder;
+  std::vector<int> fds;
+};
+
+void TestReadFiles(bool bUseIOUring)
+{
+  cFakeSysFolder folder;
+  ASSERT_FALSE(folder.GetFolder().empty());
+
+  lumberjill::cBatchFileReader reader(8, bUseIOUring);
+
+  const size_t slot0 = reader.Add(folder.Open("temp0", "35000\n"));
+  const size_t slot1 = reader.Add(folder.Open("temp1", "41850\n"));
+  const size_t slot2 = reader.Add(folder.Open("long", "123456789012\n"));
+
+  // A folder can be opened but not read
+  const int fdFolder = open(folder.GetFolder().c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  ASSERT_GE(fdFolder, 0);
+  const size_t slot3 = reader.Add(fdFolder);
+
+  const std::vector<size_t> slots = { slot0, slot1, slot2, slot3 };
+  EXPECT_GE(reader.Read(slots), 1);
+
+  std::string_view contents;
+  ASSERT_TRUE(reader.GetContents(slot0, contents));
+  EXPECT_EQ("35000\n", contents);
+  ASSERT_TRUE(reader.GetContents(slot1, contents));
+  EXPECT_EQ("41850\n", contents);
+
+  // Longer files are cut short
+  ASSERT_TRUE(reader.GetContents(slot2, contents));
+  EXPECT_EQ("12345678", contents);
+
+  EXPECT_FALSE(reader.GetContents(slot3, contents));
+  EXPECT_TRUE(contents.empty());
+
+  // Each read starts from the beginning again and sees the new value
+  folder.Write("temp0", "36000\n");
+  EXPECT_GE(reader.Read(std::vector<size_t> { slot0 }), 1);
+  ASSERT_TRUE(reader.GetContents(slot0, contents));
+  EXPECT_EQ("36000\n", contents);
+
+  // A removed slot is reused by the next file that is added
+  reader.Remove(slot3);
+  close(fdFolder);
+  const size_t slot4 = reader.Add(folder.Open("temp4", "29000\n"));
+  EXPECT_EQ(slot3, slot4);
+
+  EXPECT_GE(reader.Read(std::vector<size_t> { slot1, slot4 }), 1);
+  ASSERT_TRUE(reader.GetContents(slot1, contents));
+  EXPECT_EQ("41850\n", contents);
+  ASSERT_TRUE(reader.GetContents(slot4, contents));
+  EXPECT_EQ("29000\n", contents);
+
+  if (!bUseIOUring) {
+    EXPECT_FALSE(reader.IsUsingIOUring());
+  }
+}
+
+}
+
+TEST(BatchReader, TestReadFilesPread)
+{
+  TestReadFiles(false);
+}
+
+TEST(BatchReader, TestReadFilesIOUring)
+{
+  // This falls back to pread if io_uring isn't available, the results are the same either way
+  TestReadFiles(true);
+}
+
+TEST(BatchReader, TestDefaultsToPread)
+{
+  cFakeSysFolder folder;
+  ASSERT_FALSE(folder.GetFolder().empty());
+
+  lumberjill::cBatchFileReader reader(8);
+  std::vector<size_t> slots;
+  for (size_t i = 0; i < 3; i++) {
+    slots.push_back(reader.Add(folder.Open("temp" + std::to_string(i), "35000\n")));
+  }
+
+  // One pread per file
+  EXPECT_EQ(3, reader.Read(slots));
+  EXPECT_FALSE(reader.IsUsingIOUring());
+
+  // io_uring is opt in, and switching back goes back to pread
+  reader.SetUseIOUring(true);
+  EXPECT_GE(reader.Read(slots), 1);
+  reader.SetUseIOUring(false);
+  EXPECT_EQ(3, reader.Read(slots));
+  EXPECT_FALSE(reader.IsUsingIOUring());
+
+  std::string_view contents;
+  ASSERT_TRUE(reader.GetContents(slots[2], contents));
+  EXPECT_EQ("35000\n", contents);
+}
+
+TEST(BatchReader, TestIOUringBatch)
+{
+  cFakeSysFolder folder;
+  ASSERT_FALSE(folder.GetFolder().empty());
+
+  // More files than fit in the ring at once
+  lumberjill::cBatchFileReader reader(16, true);
+  std::vector<size_t> slots;
+  for (size_t i = 0; i < 100; i++) {
+    slots.push_back(reader.Add(folder.Open("temp" + std::to_string(i), std::to_string(i * 1000) + "\n")));
+  }
+
+  const size_t nFirstSyscalls = reader.Read(slots);
+  if (!reader.IsUsingIOUring()) {
+    GTEST_SKIP()<<"io_uring is not available";
+  }
+
+  // Registering the files and then one call for each batch of 64
+  EXPECT_EQ(3, nFirstSyscalls);
+  EXPECT_EQ(2, reader.Read(slots));
+
+  std::string_view contents;
+  for (size_t i = 0; i < slots.size(); i++) {
+    ASSERT_TRUE(reader.GetContents(slots[i], contents));
+    EXPECT_EQ(std::to_string(i * 1000) + "\n", contents);
+  }
+}
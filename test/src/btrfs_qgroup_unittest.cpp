@@ -0,0 +1,178 @@
+#include <cstring>
+#include <vector>
+
+#include <endian.h>
+#include <linux/btrfs.h>
+#include <linux/btrfs_tree.h>
+
+#include <gtest/gtest.h>
+
+#include "btrfs_qgroup.h"
+
+namespace {
+
+const uint64_t MB = 1024 * 1024;
+
+// Build what BTRFS_IOC_TREE_SEARCH_V2 returns for the quota tree
+class cSearchResultBuilder {
+public:
+  cSearchResultBuilder() : nItems(0) {}
+
+  void AddInfo(uint64_t nQgroupId, uint64_t nReferencedBytes, uint64_t nExclusiveBytes)
+  {
+    btrfs_qgroup_info_item item;
+    memset(&item, 0, sizeof(item));
+    item.rfer = htole64(nReferencedBytes);
+    item.excl = htole64(nExclusiveBytes);
+    Add(nQgroupId, BTRFS_QGROUP_INFO_KEY, &item, sizeof(item));
+  }
+
+  void AddLimit(uint64_t nQgroupId, uint64_t nMaxReferencedBytes, uint64_t nMaxExclusiveBytes)
+  {
+    btrfs_qgroup_limit_item item;
+    memset(&item, 0, sizeof(item));
+    if (nMaxReferencedBytes != 0) item.flags |= BTRFS_QGROUP_LIMIT_MAX_RFER;
+    if (nMaxExclusiveBytes != 0) item.flags |= BTRFS_QGROUP_LIMIT_MAX_EXCL;
+    item.flags = htole64(item.flags);
+    item.max_rfer = htole64(nMaxReferencedBytes);
+    item.max_excl = htole64(nMaxExclusiveBytes);
+    Add(nQgroupId, BTRFS_QGROUP_LIMIT_KEY, &item, sizeof(item));
+  }
+
+  const std::vector<uint8_t>& GetBuffer() const { return buffer; }
+  size_t GetItemCount() const { return nItems; }
+
+private:
+  void Add(uint64_t nQgroupId, uint32_t nType, const void* pItem, size_t nItemBytes)
+  {
+    btrfs_ioctl_search_header header;
+    memset(&header, 0, sizeof(header));
+    header.objectid = 0;
+    header.type = nType;
+    header.offset = nQgroupId;
+    header.len = uint32_t(nItemBytes);
+
+    const uint8_t* pHeader = reinterpret_cast<const uint8_t*>(&header);
+    buffer.insert(buffer.end(), pHeader, pHeader + sizeof(header));
+    const uint8_t* pItemBytes = static_cast<const uint8_t*>(pItem);
+    buffer.insert(buffer.end(), pItemBytes, pItemBytes + nItemBytes);
+    nItems++;
+  }
+
+  std::vector<uint8_t> buffer;
+  size_t nItems;
+};
+
+lumberjill::cBtrfsQgroup CreateQgroup(uint64_t nSubvolumeId, uint64_t nReferencedBytes, uint64_t nExclusiveBytes)
+{
+  lumberjill::cBtrfsQgroup qgroup;
+  qgroup.nSubvolumeId = nSubvolumeId;
+  qgroup.nReferencedBytes = nReferencedBytes;
+  qgroup.nExclusiveBytes = nExclusiveBytes;
+  qgroup.nMaxReferencedBytes = 0;
+  qgroup.nMaxExclusiveBytes = 0;
+  return qgroup;
+}
+
+}
+
+TEST(BtrfsQgroup, TestDecodeSearchResult)
+{
+  // A level 1 qgroup is a group of subvolumes, 1/100
+  const uint64_t nLevel1QgroupId = (uint64_t(1) << 48) | 100;
+
+  cSearchResultBuilder builder;
+  builder.AddInfo(5, 16 * MB, 16 * MB);
+  builder.AddInfo(256, 300 * MB, 20 * MB);
+  builder.AddInfo(257, 280 * MB, 1 * MB);
+  builder.AddInfo(nLevel1QgroupId, 580 * MB, 21 * MB);
+  builder.AddLimit(256, 1024 * MB, 0);
+  builder.AddLimit(257, 0, 512 * MB);
+  builder.AddLimit(nLevel1QgroupId, 2048 * MB, 0);
+
+  std::vector<lumberjill::cBtrfsQgroup> qgroups;
+  lumberjill::cBtrfsSearchKey lastKey;
+  EXPECT_TRUE(lumberjill::DecodeBtrfsQgroupSearchResult(builder.GetBuffer().data(), builder.GetBuffer().size(), builder.GetItemCount(), qgroups, lastKey));
+
+  ASSERT_EQ(3, qgroups.size());
+
+  EXPECT_EQ(5, qgroups[0].nSubvolumeId);
+  EXPECT_EQ(16 * MB, qgroups[0].nReferencedBytes);
+  EXPECT_EQ(0, qgroups[0].nMaxReferencedBytes);
+  EXPECT_EQ(0, qgroups[0].nMaxExclusiveBytes);
+
+  EXPECT_EQ(256, qgroups[1].nSubvolumeId);
+  EXPECT_EQ(300 * MB, qgroups[1].nReferencedBytes);
+  EXPECT_EQ(20 * MB, qgroups[1].nExclusiveBytes);
+  EXPECT_EQ(1024 * MB, qgroups[1].nMaxReferencedBytes);
+  EXPECT_EQ(0, qgroups[1].nMaxExclusiveBytes);
+
+  EXPECT_EQ(257, qgroups[2].nSubvolumeId);
+  EXPECT_EQ(0, qgroups[2].nMaxReferencedBytes);
+  EXPECT_EQ(512 * MB, qgroups[2].nMaxExclusiveBytes);
+
+  // The search carries on from the last item, even though it was skipped
+  EXPECT_EQ(0, lastKey.nObjectId);
+  EXPECT_EQ(BTRFS_QGROUP_LIMIT_KEY, lastKey.nType);
+  EXPECT_EQ(nLevel1QgroupId, lastKey.nOffset);
+}
+
+TEST(BtrfsQgroup, TestDecodeSearchResultTruncated)
+{
+  cSearchResultBuilder builder;
+  builder.AddInfo(256, 300 * MB, 20 * MB);
+  builder.AddInfo(257, 280 * MB, 1 * MB);
+
+  // The second item is cut short
+  std::vector<lumberjill::cBtrfsQgroup> qgroups;
+  lumberjill::cBtrfsSearchKey lastKey;
+  EXPECT_FALSE(lumberjill::DecodeBtrfsQgroupSearchResult(builder.GetBuffer().data(), builder.GetBuffer().size() - 8, builder.GetItemCount(), qgroups, lastKey));
+  EXPECT_EQ(1, qgroups.size());
+
+  // Only the second item's header is there
+  qgroups.clear();
+  const size_t nFirstItemBytes = sizeof(btrfs_ioctl_search_header) + sizeof(btrfs_qgroup_info_item);
+  EXPECT_FALSE(lumberjill::DecodeBtrfsQgroupSearchResult(builder.GetBuffer().data(), nFirstItemBytes + 4, builder.GetItemCount(), qgroups, lastKey));
+  EXPECT_EQ(1, qgroups.size());
+}
+
+TEST(BtrfsQgroup, TestGetStats)
+{
+  std::vector<lumberjill::cBtrfsQgroup> previous;
+  previous.push_back(CreateQgroup(256, 100 * MB, 90 * MB));
+  previous.push_back(CreateQgroup(258, 400 * MB, 10 * MB));
+
+  std::vector<lumberjill::cBtrfsQgroup> qgroups;
+  qgroups.push_back(CreateQgroup(5, 16 * MB, 16 * MB));
+  qgroups.push_back(CreateQgroup(256, 150 * MB, 80 * MB));
+  qgroups.push_back(CreateQgroup(257, 500 * MB, 5 * MB));
+  qgroups.push_back(CreateQgroup(258, 450 * MB, 30 * MB));
+  qgroups[1].nMaxReferencedBytes = 200 * MB;
+
+  lumberjill::cBtrfsQgroupStats qgroupStats;
+  lumberjill::GetBtrfsQgroupStats(qgroups, previous, 2, qgroupStats);
+
+  EXPECT_EQ(4, qgroupStats.nSubvolumes);
+
+  ASSERT_EQ(2, qgroupStats.topReferenced.size());
+  EXPECT_EQ(257, qgroupStats.topReferenced[0].nSubvolumeId);
+  EXPECT_EQ(500 * MB, qgroupStats.topReferenced[0].nReferencedBytes);
+  // 257 is new since the previous collection
+  EXPECT_FALSE(qgroupStats.topReferenced[0].nReferencedChangeBytes.has_value());
+  EXPECT_EQ(258, qgroupStats.topReferenced[1].nSubvolumeId);
+  EXPECT_EQ(int64_t(50 * MB), qgroupStats.topReferenced[1].nReferencedChangeBytes.value());
+  EXPECT_EQ(int64_t(20 * MB), qgroupStats.topReferenced[1].nExclusiveChangeBytes.value());
+
+  ASSERT_EQ(2, qgroupStats.topExclusive.size());
+  EXPECT_EQ(256, qgroupStats.topExclusive[0].nSubvolumeId);
+  EXPECT_EQ(80 * MB, qgroupStats.topExclusive[0].nExclusiveBytes);
+  EXPECT_EQ(-int64_t(10 * MB), qgroupStats.topExclusive[0].nExclusiveChangeBytes.value());
+  EXPECT_EQ(200 * MB, qgroupStats.topExclusive[0].nMaxReferencedBytes);
+  EXPECT_EQ(258, qgroupStats.topExclusive[1].nSubvolumeId);
+
+  // Asking for more than there are returns them all
+  lumberjill::GetBtrfsQgroupStats(qgroups, std::vector<lumberjill::cBtrfsQgroup>(), 10, qgroupStats);
+  EXPECT_EQ(4, qgroupStats.topReferenced.size());
+  EXPECT_EQ(4, qgroupStats.topExclusive.size());
+  EXPECT_FALSE(qgroupStats.topExclusive[0].nExclusiveChangeBytes.has_value());
+}
@@ -0,0 +1,205 @@
+#include <ctime>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "capacity_forecast.h"
+
+#include "temporary_folder.h"
+
+namespace {
+
+const int64_t SECONDS_PER_HOUR = 60 * 60;
+const int64_t SECONDS_PER_DAY = 24 * SECONDS_PER_HOUR;
+const size_t GB = 1000000000;
+
+lumberjill::cCapacitySettings CreateSettings()
+{
+  lumberjill::cCapacitySettings settings;
+  settings.bEnabled = true;
+  settings.nHorizonDays = 30;
+  settings.nTrendHalfLifeHours = 72;
+  return settings;
+}
+
+lumberjill::cMountStats CreateMountStats(size_t nFreeBytes)
+{
+  lumberjill::cMountStats mountStats;
+  mountStats.sMountPoint = "/data1";
+  mountStats.nFreeBytes = nFreeBytes;
+  mountStats.nTotalBytes = 4000 * GB;
+  return mountStats;
+}
+
+}
+
+TEST(CapacityForecast, TestSteadyFill)
+{
+  const lumberjill::cCapacitySettings settings = CreateSettings();
+  lumberjill::cCapacityForecaster forecaster;
+
+  // 10 GB a day with 1000 GB free
+  int64_t nTimestamp = 1700000000;
+  size_t nFreeBytes = 1000 * GB;
+  for (size_t i = 0; i < 3; i++) {
+    lumberjill::cMountStats mountStats = CreateMountStats(nFreeBytes);
+    forecaster.Update(settings, nTimestamp, mountStats);
+
+    // Not enough samples for a forecast yet
+    EXPECT_FALSE(mountStats.capacityForecast.has_value());
+
+    nTimestamp += SECONDS_PER_DAY;
+    nFreeBytes -= 10 * GB;
+  }
+
+  lumberjill::cMountStats mountStats = CreateMountStats(nFreeBytes);
+  forecaster.Update(settings, nTimestamp, mountStats);
+  ASSERT_TRUE(mountStats.capacityForecast.has_value());
+
+  const lumberjill::cCapacityForecast& forecast = mountStats.capacityForecast.value();
+  EXPECT_EQ(lumberjill::CAPACITY_BASIS::FREE, forecast.basis);
+  EXPECT_EQ(970 * GB, forecast.nAvailableBytes);
+  EXPECT_NEAR(10.0 * double(GB), forecast.dFillRateBytesPerDay, 1.0);
+  ASSERT_TRUE(forecast.dDaysToFull.has_value());
+  EXPECT_NEAR(97.0, forecast.dDaysToFull.value(), 0.001);
+  EXPECT_FALSE(forecast.bIsAlert);
+}
+
+TEST(CapacityForecast, TestSamplingIntervalDoesNotMatter)
+{
+  const lumberjill::cCapacitySettings settings = CreateSettings();
+
+  // The same steady fill, then a burst of writes, sampled hourly by the daemon and daily from cron
+  lumberjill::cCapacityForecaster hourly;
+  lumberjill::cCapacityForecaster daily;
+
+  const int64_t nStart = 1700000000;
+  const double dStartBytes = 2000.0 * double(GB);
+  auto GetFreeBytes = [&](int64_t nTimestamp) -> size_t
+  {
+    const double dDays = double(nTimestamp - nStart) / double(SECONDS_PER_DAY);
+    const double dUsed = (dDays <= 20.0) ? (dDays * 5.0) : (100.0 + ((dDays - 20.0) * 50.0));
+    return size_t(dStartBytes - (dUsed * double(GB)));
+  };
+
+  lumberjill::cMountStats hourlyStats;
+  lumberjill::cMountStats dailyStats;
+  for (int64_t nTimestamp = nStart; nTimestamp <= (nStart + (30 * SECONDS_PER_DAY)); nTimestamp += SECONDS_PER_HOUR) {
+    hourlyStats = CreateMountStats(GetFreeBytes(nTimestamp));
+    hourly.Update(settings, nTimestamp, hourlyStats);
+
+    if (((nTimestamp - nStart) % SECONDS_PER_DAY) == 0) {
+      dailyStats = CreateMountStats(GetFreeBytes(nTimestamp));
+      daily.Update(settings, nTimestamp, dailyStats);
+    }
+  }
+
+  ASSERT_TRUE(hourlyStats.capacityForecast.has_value());
+  ASSERT_TRUE(dailyStats.capacityForecast.has_value());
+
+  // Ten days into the burst the trend has mostly caught up to 50 GB a day
+  const double dHourlyRate = hourlyStats.capacityForecast->dFillRateBytesPerDay / double(GB);
+  const double dDailyRate = dailyStats.capacityForecast->dFillRateBytesPerDay / double(GB);
+  EXPECT_GT(dHourlyRate, 40.0);
+  EXPECT_LT(dHourlyRate, 50.0);
+  EXPECT_NEAR(dHourlyRate, dDailyRate, 1.0);
+}
+
+TEST(CapacityForecast, TestAlertAndFreeing)
+{
+  const lumberjill::cCapacitySettings settings = CreateSettings();
+  lumberjill::cCapacityForecaster forecaster;
+
+  // 10 GB a day with 200 GB free is full in 20 days, inside the horizon
+  int64_t nTimestamp = 1700000000;
+  size_t nFreeBytes = 230 * GB;
+  lumberjill::cMountStats mountStats;
+  for (size_t i = 0; i < 4; i++) {
+    mountStats = CreateMountStats(nFreeBytes);
+    forecaster.Update(settings, nTimestamp, mountStats);
+    nTimestamp += SECONDS_PER_DAY;
+    nFreeBytes -= 10 * GB;
+  }
+
+  ASSERT_TRUE(mountStats.capacityForecast.has_value());
+  ASSERT_TRUE(mountStats.capacityForecast->dDaysToFull.has_value());
+  EXPECT_NEAR(20.0, mountStats.capacityForecast->dDaysToFull.value(), 0.001);
+  EXPECT_TRUE(mountStats.capacityForecast->bIsAlert);
+
+  // Old snapshots are deleted, space is being freed so it will never be full
+  nFreeBytes += 1000 * GB;
+  mountStats = CreateMountStats(nFreeBytes);
+  forecaster.Update(settings, nTimestamp, mountStats);
+
+  ASSERT_TRUE(mountStats.capacityForecast.has_value());
+  EXPECT_LT(mountStats.capacityForecast->dFillRateBytesPerDay, 0.0);
+  EXPECT_FALSE(mountStats.capacityForecast->dDaysToFull.has_value());
+  EXPECT_FALSE(mountStats.capacityForecast->bIsAlert);
+}
+
+TEST(CapacityForecast, TestBtrfsUnallocated)
+{
+  const lumberjill::cCapacitySettings settings = CreateSettings();
+  lumberjill::cCapacityForecaster forecaster;
+
+  // Plenty free according to statvfs, but the unallocated space is nearly gone
+  int64_t nTimestamp = 1700000000;
+  size_t nUnallocatedBytes = 40 * GB;
+  lumberjill::cMountStats mountStats;
+  for (size_t i = 0; i < 4; i++) {
+    mountStats = CreateMountStats(1000 * GB);
+    mountStats.nUnallocatedBytes = nUnallocatedBytes;
+    forecaster.Update(settings, nTimestamp, mountStats);
+    nTimestamp += SECONDS_PER_DAY;
+    nUnallocatedBytes -= 2 * GB;
+  }
+
+  ASSERT_TRUE(mountStats.capacityForecast.has_value());
+  EXPECT_EQ(lumberjill::CAPACITY_BASIS::UNALLOCATED, mountStats.capacityForecast->basis);
+  ASSERT_TRUE(mountStats.capacityForecast->dDaysToFull.has_value());
+  EXPECT_NEAR(17.0, mountStats.capacityForecast->dDaysToFull.value(), 0.001);
+  EXPECT_TRUE(mountStats.capacityForecast->bIsAlert);
+
+  // Switching to the free space starts the trend again rather than mixing the two
+  mountStats = CreateMountStats(1000 * GB);
+  forecaster.Update(settings, nTimestamp, mountStats);
+  EXPECT_FALSE(mountStats.capacityForecast.has_value());
+}
+
+TEST(CapacityForecast, TestSaveAndLoad)
+{
+  const cTemporaryFolder folder("capacity");
+  const std::string sFilePath = folder.GetFilePath("state/capacity.state");
+
+  const lumberjill::cCapacitySettings settings = CreateSettings();
+
+  // Recent enough not to be expired when saving
+  int64_t nTimestamp = int64_t(time(nullptr)) - (10 * SECONDS_PER_DAY);
+  size_t nFreeBytes = 1000 * GB;
+
+  {
+    lumberjill::cCapacityForecaster forecaster;
+    EXPECT_FALSE(forecaster.Load(sFilePath));
+    EXPECT_TRUE(forecaster.IsLoaded());
+
+    for (size_t i = 0; i < 3; i++) {
+      lumberjill::cMountStats mountStats = CreateMountStats(nFreeBytes);
+      forecaster.Update(settings, nTimestamp, mountStats);
+      nTimestamp += SECONDS_PER_DAY;
+      nFreeBytes -= 10 * GB;
+    }
+
+    EXPECT_EQ(1u, forecaster.GetMountCount());
+    EXPECT_TRUE(forecaster.Save(sFilePath));
+  }
+
+  // The next run from cron carries on with the same trend
+  lumberjill::cCapacityForecaster forecaster;
+  EXPECT_TRUE(forecaster.Load(sFilePath));
+  EXPECT_EQ(1u, forecaster.GetMountCount());
+
+  lumberjill::cMountStats mountStats = CreateMountStats(nFreeBytes);
+  forecaster.Update(settings, nTimestamp, mountStats);
+  ASSERT_TRUE(mountStats.capacityForecast.has_value());
+  EXPECT_NEAR(10.0 * double(GB), mountStats.capacityForecast->dFillRateBytesPerDay, 1.0);
+}
@@ -0,0 +1,225 @@
+#include <cstdlib>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <memory_resource>
+#include <new>
+#include <set>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "cycle_arena.h"
+#include "diskstats.h"
+#include "drive_temperature.h"
+
+// Count the heap allocations made by this thread, so that the tests can check that the daemon's steady state doesn't allocate
+// Other threads left running by earlier tests don't affect the count
+namespace {
+
+thread_local size_t nThreadAllocations = 0;
+
+void* Allocate(size_t nBytes)
+{
+  nThreadAllocations++;
+  void* p = malloc((nBytes == 0) ? 1 : nBytes);
+  if (p == nullptr) abort();
+  return p;
+}
+
+void* AllocateAligned(size_t nBytes, std::align_val_t alignment)
+{
+  nThreadAllocations++;
+  const size_t nAlignment = std::max(size_t(alignment), sizeof(void*));
+  const size_t nRoundedBytes = ((nBytes + nAlignment - 1) / nAlignment) * nAlignment;
+  void* p = aligned_alloc(nAlignment, (nRoundedBytes == 0) ? nAlignment : nRoundedBytes);
+  if (p == nullptr) abort();
+  return p;
+}
+
+}
+
+void* operator new(size_t nBytes) { return Allocate(nBytes); }
+void* operator new[](size_t nBytes) { return Allocate(nBytes); }
+void* operator new(size_t nBytes, std::align_val_t alignment) { return AllocateAligned(nBytes, alignment); }
+void* operator new[](size_t nBytes, std::align_val_t alignment) { return AllocateAligned(nBytes, alignment); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { free(p); }
+
+namespace {
+
+// Counts the allocations made by this thread while it is in scope
+class cAllocationCounter {
+public:
+  cAllocationCounter() : nStart(nThreadAllocations) {}
+
+  size_t GetCount() const { return nThreadAllocations - nStart; }
+
+private:
+  const size_t nStart;
+};
+
+void WriteFile(const std::string& sFilePath, const std::string& contents)
+{
+  std::filesystem::create_directories(std::filesystem::path(sFilePath).parent_path());
+  std::ofstream f(sFilePath);
+  f<<contents;
+}
+
+// The scratch containers of a collection, like QueryAndLogGroups builds them
+size_t RunCycle(lumberjill::cCycleArena& arena, size_t nGroups, size_t nDevices)
+{
+  std::pmr::vector<std::pmr::vector<std::string>> deviceNodes(nGroups, &arena);
+  std::pmr::vector<std::string> nodes(&arena);
+  std::pmr::set<std::string> devicePaths(&arena);
+  for (size_t g = 0; g < nGroups; g++) {
+    deviceNodes[g].resize(nDevices);
+    for (size_t d = 0; d < nDevices; d++) {
+      deviceNodes[g][d] = "sd" + std::to_string(d);
+      nodes.push_back(deviceNodes[g][d]);
+      devicePaths.insert(deviceNodes[g][d]);
+    }
+  }
+
+  return nodes.size() + devicePaths.size();
+}
+
+}
+
+TEST(CycleArena, TestAllocate)
+{
+  lumberjill::cCycleArena arena(1024);
+  EXPECT_EQ(1024, arena.GetCapacityBytes());
+
+  void* p1 = arena.allocate(10, 1);
+  void* p2 = arena.allocate(8, 8);
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(p2) % 8);
+  EXPECT_LT(static_cast<char*>(p1), static_cast<char*>(p2));
+  EXPECT_GE(arena.GetUsedBytes(), 18);
+  EXPECT_EQ(0, arena.GetOverflowCount());
+
+  // Too big for what is left, it goes to the heap for now
+  void* p3 = arena.allocate(2000, 16);
+  EXPECT_NE(nullptr, p3);
+  EXPECT_EQ(1, arena.GetOverflowCount());
+  EXPECT_GT(arena.GetHighWaterBytes(), 2000);
+
+  // The next cycle has room for all of it
+  arena.Reset();
+  EXPECT_EQ(0, arena.GetUsedBytes());
+  EXPECT_EQ(0, arena.GetOverflowCount());
+  EXPECT_GE(arena.GetCapacityBytes(), arena.GetHighWaterBytes());
+
+  EXPECT_NE(nullptr, arena.allocate(10, 1));
+  EXPECT_NE(nullptr, arena.allocate(8, 8));
+  EXPECT_NE(nullptr, arena.allocate(2000, 16));
+  EXPECT_EQ(0, arena.GetOverflowCount());
+}
+
+TEST(CycleArena, TestSteadyStateCycle)
+{
+  // Start small so that the first cycles have to grow the arena
+  lumberjill::cCycleArena arena(256);
+
+  // Warm up
+  for (size_t i = 0; i < 3; i++) {
+    arena.Reset();
+    RunCycle(arena, 4, 60);
+  }
+
+  EXPECT_EQ(0, arena.GetOverflowCount());
+
+  const cAllocationCounter counter;
+  for (size_t i = 0; i < 10; i++) {
+    arena.Reset();
+    EXPECT_EQ(300, RunCycle(arena, 4, 60));
+  }
+  EXPECT_EQ(0, counter.GetCount());
+}
+
+TEST(CycleArena, TestSteadyStateDiskStats)
+{
+  char szFolder[] = "/tmp/lumber-jill-cycle-arena-XXXXXX";
+  ASSERT_NE(nullptr, mkdtemp(szFolder));
+  const std::string sFolder(szFolder);
+  const std::string sDiskStatsFilePath = sFolder + "/diskstats";
+  std::filesystem::copy_file("test/data/diskstats_after.txt", sDiskStatsFilePath, std::filesystem::copy_options::overwrite_existing);
+
+  lumberjill::cCycleArena arena;
+  lumberjill::cDiskStatsCollector collector(sDiskStatsFilePath);
+
+  uint64_t nNowMS = 1000;
+  for (size_t i = 0; i < 3; i++) {
+    arena.Reset();
+    std::pmr::vector<std::string> nodes(&arena);
+    nodes.push_back("sdb");
+    nodes.push_back("nvme0n1");
+    nodes.push_back("sda");
+    EXPECT_TRUE(collector.Sample(nodes, nNowMS));
+    nNowMS += 1000;
+  }
+
+  // Once the buffers have grown to fit a sample is read and parsed without going to the heap
+  {
+    const cAllocationCounter counter;
+    for (size_t i = 0; i < 10; i++) {
+      arena.Reset();
+      std::pmr::vector<std::string> nodes(&arena);
+      nodes.push_back("sdb");
+      nodes.push_back("nvme0n1");
+      nodes.push_back("sda");
+      const bool bResult = collector.Sample(nodes, nNowMS);
+      EXPECT_TRUE(bResult);
+      nNowMS += 1000;
+    }
+    EXPECT_EQ(0, counter.GetCount());
+  }
+
+  lumberjill::cDiskIOStats stats;
+  EXPECT_TRUE(collector.GetDiskIOStats("sdb", stats));
+
+  std::error_code ec;
+  std::filesystem::remove_all(sFolder, ec);
+}
+
+TEST(CycleArena, TestSteadyStateTemperature)
+{
+  char szFolder[] = "/tmp/lumber-jill-cycle-arena-XXXXXX";
+  ASSERT_NE(nullptr, mkdtemp(szFolder));
+  const std::string sFolder(szFolder);
+
+  const std::vector<std::string> nodes = { "sdb", "sdc", "sdd" };
+  for (size_t i = 0; i < nodes.size(); i++) {
+    WriteFile(sFolder + "/class/block/" + nodes[i] + "/device/hwmon/hwmon" + std::to_string(i) + "/name", "drivetemp\n");
+    WriteFile(sFolder + "/class/block/" + nodes[i] + "/device/hwmon/hwmon" + std::to_string(i) + "/temp1_input", "35000\n");
+  }
+
+  lumberjill::cDriveTemperatureCollector collector(sFolder);
+  collector.Update(nodes);
+  collector.Sample();
+
+  // The daemon's temperature timer
+  {
+    const cAllocationCounter counter;
+    for (size_t i = 0; i < 10; i++) {
+      collector.Sample();
+    }
+    EXPECT_EQ(0, counter.GetCount());
+  }
+
+  lumberjill::cDriveTemperatureStats stats;
+  ASSERT_TRUE(collector.GetStatsAndReset("sdb", stats));
+  EXPECT_EQ(11, stats.nSamples);
+
+  std::error_code ec;
+  std::filesystem::remove_all(sFolder, ec);
+}
@@ -0,0 +1,159 @@
+#include <cstdlib>
+#include <filesystem>
+#include <system_error>
+
+#include <gtest/gtest.h>
+
+#include "diskstats.h"
+#include "utils.h"
+
+namespace {
+
+std::string ReadDiskStatsFile(const std::string& sFilePath)
+{
+  const size_t nMaxFileSizeBytes = 100000;
+
+  std::string contents;
+  EXPECT_TRUE(lumberjill::ReadFileIntoString(sFilePath, nMaxFileSizeBytes, contents));
+  return contents;
+}
+
+}
+
+TEST(DiskStats, TestParseDiskStats)
+{
+  const std::string contents = ReadDiskStatsFile("test/data/diskstats_before.txt");
+
+  // Sorted, with a device that isn't in the file
+  const std::vector<std::string> nodes = { "nvme0n1", "sda", "sdb", "sdz" };
+
+  std::vector<lumberjill::cDiskStatsCounters> counters;
+  ASSERT_TRUE(lumberjill::ParseDiskStats(contents, nodes, counters));
+  ASSERT_EQ(4, counters.size());
+
+  EXPECT_TRUE(counters[0].bIsValid);
+  EXPECT_EQ(152301, counters[0].nReadsCompleted);
+  EXPECT_EQ(9204310, counters[0].nSectorsRead);
+  EXPECT_EQ(31530, counters[0].nReadTimeMS);
+  EXPECT_EQ(281123, counters[0].nWritesCompleted);
+  EXPECT_EQ(14228736, counters[0].nSectorsWritten);
+  EXPECT_EQ(188120, counters[0].nWriteTimeMS);
+  EXPECT_EQ(0, counters[0].nInFlight);
+  EXPECT_EQ(121640, counters[0].nIOTimeMS);
+  EXPECT_EQ(223384, counters[0].nWeightedIOTimeMS);
+
+  // Older kernels only have 11 fields
+  EXPECT_TRUE(counters[1].bIsValid);
+  EXPECT_EQ(4212, counters[1].nReadsCompleted);
+  EXPECT_EQ(38866, counters[1].nWeightedIOTimeMS);
+
+  // The partition sdb1 must not be confused with sdb
+  EXPECT_TRUE(counters[2].bIsValid);
+  EXPECT_EQ(100000, counters[2].nReadsCompleted);
+  EXPECT_EQ(1, counters[2].nInFlight);
+
+  EXPECT_FALSE(counters[3].bIsValid);
+}
+
+TEST(DiskStats, TestParseDiskStatsInvalid)
+{
+  const std::vector<std::string> nodes = { "sda" };
+  std::vector<lumberjill::cDiskStatsCounters> counters;
+
+  EXPECT_FALSE(lumberjill::ParseDiskStats("", nodes, counters));
+  EXPECT_FALSE(lumberjill::ParseDiskStats("garbage\n\n", nodes, counters));
+
+  // A truncated line is not valid
+  EXPECT_TRUE(lumberjill::ParseDiskStats("   8       0 sda 4212 1305 391522\n", nodes, counters));
+  ASSERT_EQ(1, counters.size());
+  EXPECT_FALSE(counters[0].bIsValid);
+}
+
+TEST(DiskStats, TestGetDiskIOStats)
+{
+  const std::vector<std::string> nodes = { "sdb", "sdc" };
+
+  std::vector<lumberjill::cDiskStatsCounters> before;
+  ASSERT_TRUE(lumberjill::ParseDiskStats(ReadDiskStatsFile("test/data/diskstats_before.txt"), nodes, before));
+  std::vector<lumberjill::cDiskStatsCounters> after;
+  ASSERT_TRUE(lumberjill::ParseDiskStats(ReadDiskStatsFile("test/data/diskstats_after.txt"), nodes, after));
+
+  lumberjill::cDiskIOStats stats;
+  ASSERT_TRUE(lumberjill::GetDiskIOStats(before[0], after[0], 10000, stats));
+  EXPECT_DOUBLE_EQ(50.0, stats.dReadIOPS);
+  EXPECT_DOUBLE_EQ(25.0, stats.dWriteIOPS);
+  EXPECT_DOUBLE_EQ(1048576.0, stats.dReadBytesPerSecond);
+  EXPECT_DOUBLE_EQ(524288.0, stats.dWriteBytesPerSecond);
+  EXPECT_DOUBLE_EQ(5.0, stats.dReadAwaitMS);
+  EXPECT_DOUBLE_EQ(10.0, stats.dWriteAwaitMS);
+  EXPECT_DOUBLE_EQ(1.0, stats.dQueueDepth);
+  EXPECT_DOUBLE_EQ(50.0, stats.dUtilisationPercent);
+
+  // A struggling drive, very slow reads and busy the whole time
+  ASSERT_TRUE(lumberjill::GetDiskIOStats(before[1], after[1], 10000, stats));
+  EXPECT_DOUBLE_EQ(10.0, stats.dReadIOPS);
+  EXPECT_DOUBLE_EQ(0.0, stats.dWriteIOPS);
+  EXPECT_DOUBLE_EQ(2000.0, stats.dReadAwaitMS);
+  EXPECT_DOUBLE_EQ(0.0, stats.dWriteAwaitMS);
+  EXPECT_DOUBLE_EQ(20.0, stats.dQueueDepth);
+  EXPECT_DOUBLE_EQ(100.0, stats.dUtilisationPercent);
+
+  // No time has passed
+  EXPECT_FALSE(lumberjill::GetDiskIOStats(before[0], after[0], 0, stats));
+
+  // The counters went backwards
+  EXPECT_FALSE(lumberjill::GetDiskIOStats(after[0], before[0], 10000, stats));
+}
+
+TEST(DiskStats, TestDiskStatsCollector)
+{
+  char szFolder[] = "/tmp/lumber-jill-diskstats-XXXXXX";
+  ASSERT_TRUE(mkdtemp(szFolder) != nullptr);
+  const std::string sFolder(szFolder);
+  const std::string sDiskStatsFilePath = sFolder + "/diskstats";
+
+  std::filesystem::copy_file("test/data/diskstats_before.txt", sDiskStatsFilePath);
+
+  lumberjill::cDiskStatsCollector collector(sDiskStatsFilePath);
+
+  const std::vector<std::string> nodes = { "sdc", "sdb", "sdz" };
+
+  lumberjill::cDiskIOStats stats;
+
+  // The first sample is the average since boot, 1000 seconds ago
+  ASSERT_TRUE(collector.Sample(nodes, 1000000));
+  ASSERT_TRUE(collector.GetDiskIOStats("sdb", stats));
+  EXPECT_DOUBLE_EQ(100.0, stats.dReadIOPS);
+  EXPECT_DOUBLE_EQ(50.0, stats.dWriteIOPS);
+  EXPECT_FALSE(collector.GetDiskIOStats("sdz", stats));
+  EXPECT_FALSE(collector.GetDiskIOStats("sda", stats));
+
+  // The second sample covers the 10 seconds since the first one
+  std::filesystem::copy_file("test/data/diskstats_after.txt", sDiskStatsFilePath, std::filesystem::copy_options::overwrite_existing);
+
+  ASSERT_TRUE(collector.Sample(nodes, 1010000));
+  ASSERT_TRUE(collector.GetDiskIOStats("sdb", stats));
+  EXPECT_DOUBLE_EQ(50.0, stats.dReadIOPS);
+  EXPECT_DOUBLE_EQ(1.0, stats.dQueueDepth);
+  ASSERT_TRUE(collector.GetDiskIOStats("sdc", stats));
+  EXPECT_DOUBLE_EQ(100.0, stats.dUtilisationPercent);
+
+  // A device replaced with a new one with the same name starts again
+  std::filesystem::copy_file("test/data/diskstats_before.txt", sDiskStatsFilePath, std::filesystem::copy_options::overwrite_existing);
+
+  ASSERT_TRUE(collector.Sample(nodes, 1020000));
+  EXPECT_FALSE(collector.GetDiskIOStats("sdb", stats));
+
+  std::error_code ec;
+  std::filesystem::remove_all(sFolder, ec);
+}
+
+TEST(DiskStats, TestDiskStatsCollectorMissingFile)
+{
+  lumberjill::cDiskStatsCollector collector("/tmp/lumber-jill-this-file-does-not-exist");
+
+  EXPECT_FALSE(collector.Sample(std::vector<std::string> { "sda" }, 1000));
+
+  lumberjill::cDiskIOStats stats;
+  EXPECT_FALSE(collector.GetDiskIOStats("sda", stats));
+}
@@ -0,0 +1,187 @@
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+
+#include <gtest/gtest.h>
+
+#include "drive_temperature.h"
+#include "smartctl.h"
+
+namespace {
+
+void WriteFile(const std::string& sFilePath, const std::string& contents)
+{
+  std::filesystem::create_directories(std::filesystem::path(sFilePath).parent_path());
+  std::ofstream f(sFilePath);
+  f<<contents;
+}
+
+// Create a fake /sys with these drives:
+// sdb: SATA drive with drivetemp loaded
+// nvme0n1: NVMe drive
+// sdc: SATA drive without drivetemp
+std::string CreateFakeSys()
+{
+  char szFolder[] = "/tmp/lumber-jill-temperature-XXXXXX";
+  if (mkdtemp(szFolder) == nullptr) return "";
+
+  const std::string sFolder(szFolder);
+
+  WriteFile(sFolder + "/class/block/sdb/device/hwmon/hwmon3/name", "drivetemp\n");
+  WriteFile(sFolder + "/class/block/sdb/device/hwmon/hwmon3/temp1_input", "35000\n");
+  WriteFile(sFolder + "/class/block/nvme0n1/device/hwmon1/name", "nvme\n");
+  WriteFile(sFolder + "/class/block/nvme0n1/device/hwmon1/temp1_input", "41850\n");
+  WriteFile(sFolder + "/class/block/sdc/device/model", "ST4000VN008-2DR1\n");
+
+  return sFolder;
+}
+
+}
+
+TEST(DriveTemperature, TestParseTemperatureInput)
+{
+  int32_t nMilliCelsius = 0;
+  EXPECT_TRUE(lumberjill::ParseTemperatureInput("35000\n", nMilliCelsius));
+  EXPECT_EQ(35000, nMilliCelsius);
+  EXPECT_TRUE(lumberjill::ParseTemperatureInput("-5000", nMilliCelsius));
+  EXPECT_EQ(-5000, nMilliCelsius);
+
+  EXPECT_FALSE(lumberjill::ParseTemperatureInput("", nMilliCelsius));
+  EXPECT_FALSE(lumberjill::ParseTemperatureInput("\n", nMilliCelsius));
+  EXPECT_FALSE(lumberjill::ParseTemperatureInput("35C\n", nMilliCelsius));
+}
+
+TEST(DriveTemperature, TestRing)
+{
+  lumberjill::cTemperatureRing ring;
+  lumberjill::cDriveTemperatureStats stats;
+  EXPECT_FALSE(ring.GetStats(stats));
+
+  ring.Record(30000);
+  ring.Record(34000);
+  ring.Record(32000);
+  ASSERT_TRUE(ring.GetStats(stats));
+  EXPECT_EQ(lumberjill::TEMPERATURE_SOURCE::HWMON, stats.source);
+  EXPECT_EQ(3, stats.nSamples);
+  EXPECT_DOUBLE_EQ(32.0, stats.dCurrentCelsius);
+  EXPECT_DOUBLE_EQ(30.0, stats.dMinCelsius);
+  EXPECT_DOUBLE_EQ(34.0, stats.dMaxCelsius);
+  EXPECT_DOUBLE_EQ(32.0, stats.dAverageCelsius);
+
+  // Once it is full only the most recent samples are kept
+  ring.Clear();
+  ring.Record(90000);
+  for (size_t i = 0; i < lumberjill::cTemperatureRing::CAPACITY; i++) {
+    ring.Record(int32_t(40000 + i));
+  }
+  ASSERT_TRUE(ring.GetStats(stats));
+  EXPECT_EQ(lumberjill::cTemperatureRing::CAPACITY, stats.nSamples);
+  EXPECT_DOUBLE_EQ(40.0, stats.dMinCelsius);
+  EXPECT_DOUBLE_EQ(40.063, stats.dMaxCelsius);
+  EXPECT_DOUBLE_EQ(40.063, stats.dCurrentCelsius);
+}
+
+TEST(DriveTemperature, TestFindDriveTemperatureInput)
+{
+  const std::string sFolder = CreateFakeSys();
+  ASSERT_FALSE(sFolder.empty());
+
+  std::string sInputPath;
+  EXPECT_TRUE(lumberjill::FindDriveTemperatureInput(sFolder, "sdb", sInputPath));
+  EXPECT_EQ(sFolder + "/class/block/sdb/device/hwmon/hwmon3/temp1_input", sInputPath);
+
+  EXPECT_TRUE(lumberjill::FindDriveTemperatureInput(sFolder, "nvme0n1", sInputPath));
+  EXPECT_EQ(sFolder + "/class/block/nvme0n1/device/hwmon1/temp1_input", sInputPath);
+
+  EXPECT_FALSE(lumberjill::FindDriveTemperatureInput(sFolder, "sdc", sInputPath));
+  EXPECT_FALSE(lumberjill::FindDriveTemperatureInput(sFolder, "sdz", sInputPath));
+
+  std::error_code ec;
+  std::filesystem::remove_all(sFolder, ec);
+}
+
+TEST(DriveTemperature, TestCollector)
+{
+  const std::string sFolder = CreateFakeSys();
+  ASSERT_FALSE(sFolder.empty());
+
+  const std::string sInputPath = sFolder + "/class/block/sdb/device/hwmon/hwmon3/temp1_input";
+
+  lumberjill::cDriveTemperatureCollector collector(sFolder);
+  collector.Update(std::vector<std::string> { "sdb", "nvme0n1", "sdc" });
+
+  collector.Sample();
+  WriteFile(sInputPath, "37000\n");
+  collector.Sample();
+  WriteFile(sInputPath, "36000\n");
+  collector.Sample();
+
+  lumberjill::cDriveTemperatureStats stats;
+  ASSERT_TRUE(collector.GetStatsAndReset("sdb", stats));
+  EXPECT_EQ(3, stats.nSamples);
+  EXPECT_DOUBLE_EQ(36.0, stats.dCurrentCelsius);
+  EXPECT_DOUBLE_EQ(35.0, stats.dMinCelsius);
+  EXPECT_DOUBLE_EQ(37.0, stats.dMaxCelsius);
+  EXPECT_DOUBLE_EQ(36.0, stats.dAverageCelsius);
+
+  ASSERT_TRUE(collector.GetStatsAndReset("nvme0n1", stats));
+  EXPECT_EQ(3, stats.nSamples);
+  EXPECT_DOUBLE_EQ(41.85, stats.dAverageCelsius);
+
+  // No hwmon device
+  EXPECT_FALSE(collector.GetStatsAndReset("sdc", stats));
+
+  // A new window starts after each report
+  EXPECT_FALSE(collector.GetStatsAndReset("sdb", stats));
+
+  // Drives in standby are left alone
+  collector.SetStandby("sdb", true);
+  collector.Sample();
+  EXPECT_FALSE(collector.GetStatsAndReset("sdb", stats));
+  EXPECT_TRUE(collector.GetStatsAndReset("nvme0n1", stats));
+
+  collector.SetStandby("sdb", false);
+  collector.Sample();
+  EXPECT_TRUE(collector.GetStatsAndReset("sdb", stats));
+
+  // Loading drivetemp later is picked up on the next update
+  WriteFile(sFolder + "/class/block/sdc/device/hwmon/hwmon4/temp1_input", "29000\n");
+  collector.Update(std::vector<std::string> { "sdb", "sdc" });
+  collector.Sample();
+  ASSERT_TRUE(collector.GetStatsAndReset("sdc", stats));
+  EXPECT_DOUBLE_EQ(29.0, stats.dCurrentCelsius);
+
+  // Devices that aren't monitored any more are dropped
+  EXPECT_FALSE(collector.GetStatsAndReset("nvme0n1", stats));
+
+  std::error_code ec;
+  std::filesystem::remove_all(sFolder, ec);
+}
+
+TEST(DriveTemperature, TestParseSmartCtlTemperature)
+{
+  // The raw value can have the min and max after it
+  {
+    const std::string sCommandOutput = "194 Temperature_Celsius     0x0022   035   045   000    Old_age   Always       -       35 (Min/Max 20/45)\n";
+    lumberjill::cSmartCtlStats smartctlStats;
+    EXPECT_TRUE(lumberjill::smartctl::ParseDriveSmartControlData(sCommandOutput, smartctlStats));
+    EXPECT_EQ(35, smartctlStats.nTemperature_Celsius.value());
+  }
+
+  // NVMe
+  {
+    const std::string sCommandOutput = "=== START OF SMART DATA SECTION ===\nSMART/Health Information (NVMe Log 0x02)\nCritical Warning:                   0x00\nTemperature:                        42 Celsius\n";
+    lumberjill::cSmartCtlStats smartctlStats;
+    EXPECT_TRUE(lumberjill::smartctl::ParseDriveSmartControlData(sCommandOutput, smartctlStats));
+    EXPECT_EQ(42, smartctlStats.nTemperature_Celsius.value());
+  }
+
+  // Airflow temperature is a different attribute
+  {
+    const std::string sCommandOutput = "190 Airflow_Temperature_Cel 0x0022   065   055   040    Old_age   Always       -       35 (Min/Max 20/45)\n";
+    lumberjill::cSmartCtlStats smartctlStats;
+    EXPECT_TRUE(lumberjill::smartctl::ParseDriveSmartControlData(sCommandOutput, smartctlStats));
+    EXPECT_FALSE(smartctlStats.nTemperature_Celsius.has_value());
+  }
+}
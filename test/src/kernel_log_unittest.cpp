@@ -0,0 +1,242 @@
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "daemon.h"
+#include "kernel_log.h"
+#include "topology.h"
+#include "utils.h"
+
+namespace {
+
+std::vector<std::string> ReadSampleRecords()
+{
+  const size_t nMaxFileSizeBytes = 64 * 1024;
+  std::string contents;
+  EXPECT_TRUE(lumberjill::ReadFileIntoString("test/data/kmsg_sample.txt", nMaxFileSizeBytes, contents));
+
+  std::vector<std::string> records;
+  size_t start = 0;
+  while (start < contents.length()) {
+    size_t end = contents.find('\n', start);
+    if (end == std::string::npos) end = contents.length();
+    records.push_back(contents.substr(start, end + 1 - start));
+    start = end + 1;
+  }
+
+  return records;
+}
+
+}
+
+TEST(KernelLog, TestMultiPatternMatcher)
+{
+  // The classic overlapping example, "she" ends before "hers"
+  const lumberjill::cMultiPatternMatcher matcher({ "he", "she", "his", "hers" });
+
+  size_t pattern = 0;
+  size_t end = 0;
+  EXPECT_TRUE(matcher.FindFirst("ushers", pattern, end));
+  EXPECT_EQ(1, pattern);
+  EXPECT_EQ(4, end);
+
+  EXPECT_TRUE(matcher.FindFirst("ahis", pattern, end));
+  EXPECT_EQ(2, pattern);
+  EXPECT_EQ(4, end);
+
+  // Restarting after a partial match
+  EXPECT_TRUE(matcher.FindFirst("hhhhe", pattern, end));
+  EXPECT_EQ(0, pattern);
+  EXPECT_EQ(5, end);
+
+  EXPECT_FALSE(matcher.FindFirst("", pattern, end));
+  EXPECT_FALSE(matcher.FindFirst("hs is h", pattern, end));
+
+  // The root, h, he, her, hers, hi, his, s, sh, she
+  EXPECT_EQ(10, matcher.GetStateCount());
+}
+
+TEST(KernelLog, TestParseKernelLogRecord)
+{
+  lumberjill::cKernelLogRecord record;
+
+  // Error priority with the kernel facility, and a dictionary after the message
+  EXPECT_TRUE(lumberjill::ParseKernelLogRecord("3,1028,5123610030,-;I/O error, dev sdc, sector 1953520\n SUBSYSTEM=block\n DEVICE=b8:32\n", record));
+  EXPECT_EQ(3, record.nPriority);
+  EXPECT_EQ(1028, record.nSequence);
+  EXPECT_EQ(5123610030, record.nTimestampUS);
+  EXPECT_EQ("I/O error, dev sdc, sector 1953520", record.message);
+
+  // A facility other than kern, and the caller id field that newer kernels add
+  EXPECT_TRUE(lumberjill::ParseKernelLogRecord("30,77,123,c,caller=T1;systemd[1]: Started something.\n", record));
+  EXPECT_EQ(6, record.nPriority);
+  EXPECT_EQ(77, record.nSequence);
+  EXPECT_EQ("systemd[1]: Started something.", record.message);
+
+  EXPECT_FALSE(lumberjill::ParseKernelLogRecord("", record));
+  EXPECT_FALSE(lumberjill::ParseKernelLogRecord("no header here\n", record));
+  EXPECT_FALSE(lumberjill::ParseKernelLogRecord("3,x,5,-;message\n", record));
+}
+
+TEST(KernelLog, TestKernelErrorMatcher)
+{
+  const std::vector<std::string> records = ReadSampleRecords();
+  ASSERT_EQ(15, records.size());
+
+  const lumberjill::cKernelErrorMatcher matcher;
+
+  std::vector<std::string> matched;
+  for (auto& sRecord : records) {
+    lumberjill::cKernelLogRecord record;
+    ASSERT_TRUE(lumberjill::ParseKernelLogRecord(sRecord, record));
+
+    lumberjill::cKernelError error;
+    if (matcher.Match(record.message, error)) {
+      matched.push_back(std::string(lumberjill::GetKernelErrorName(error.type)) + " " + std::string(error.sName));
+    }
+  }
+
+  const std::vector<std::string> expected = {
+    "ata error ata3",
+    "link reset ata3",
+    "medium error sdc",
+    "medium error sdc",
+    "io error sdc",
+    "io error sdc1",
+    "btrfs error sdc1",
+    "timeout nvme0",
+    "io error nvme0n1",
+    "timeout sdd",
+    "btrfs error sdb",
+  };
+  EXPECT_EQ(expected, matched);
+}
+
+TEST(KernelLog, TestGetDiskNameFromPartitionName)
+{
+  EXPECT_EQ("sdc", lumberjill::GetDiskNameFromPartitionName("sdc1"));
+  EXPECT_EQ("sdab", lumberjill::GetDiskNameFromPartitionName("sdab12"));
+  EXPECT_EQ("nvme0n1", lumberjill::GetDiskNameFromPartitionName("nvme0n1p2"));
+  EXPECT_EQ("mmcblk0", lumberjill::GetDiskNameFromPartitionName("mmcblk0p1"));
+  EXPECT_EQ("xvda", lumberjill::GetDiskNameFromPartitionName("xvda1"));
+
+  // Already a disk or not a partition at all
+  EXPECT_EQ("sdc", lumberjill::GetDiskNameFromPartitionName("sdc"));
+  EXPECT_EQ("nvme0n1", lumberjill::GetDiskNameFromPartitionName("nvme0n1"));
+  EXPECT_EQ("ata3", lumberjill::GetDiskNameFromPartitionName("ata3"));
+  EXPECT_EQ("md0", lumberjill::GetDiskNameFromPartitionName("md0"));
+}
+
+TEST(KernelLog, TestGetKernelNamesFromSysfsPath)
+{
+  EXPECT_EQ(std::vector<std::string>({ "ata3" }), lumberjill::GetKernelNamesFromSysfsPath("../../devices/pci0000:00/0000:00:17.0/ata3/host2/target2:0:0/2:0:0:0/block/sdc"));
+  EXPECT_EQ(std::vector<std::string>({ "nvme0" }), lumberjill::GetKernelNamesFromSysfsPath("../../devices/pci0000:00/0000:00:1d.0/0000:01:00.0/nvme/nvme0/nvme0n1"));
+
+  // SAS drives behind an HBA have neither
+  EXPECT_TRUE(lumberjill::GetKernelNamesFromSysfsPath("../../devices/pci0000:00/0000:00:01.0/0000:03:00.0/host0/port-0:0/end_device-0:0:4/target0:0:4/0:0:4:0/block/sdb").empty());
+}
+
+TEST(KernelLog, TestKernelErrorTracker)
+{
+  // 3 errors in 10 seconds, then not again for a minute
+  lumberjill::cKernelErrorTracker tracker(3, 10000, 60000);
+
+  lumberjill::cKernelErrorStats stats;
+  EXPECT_FALSE(tracker.GetStats("/dev/sdc", 0, stats));
+
+  EXPECT_FALSE(tracker.Record("/dev/sdc", lumberjill::KERNEL_ERROR::IO_ERROR, 1000));
+  EXPECT_FALSE(tracker.Record("/dev/sdc", lumberjill::KERNEL_ERROR::MEDIUM_ERROR, 2000));
+
+  // The first two have left the window
+  EXPECT_FALSE(tracker.Record("/dev/sdc", lumberjill::KERNEL_ERROR::IO_ERROR, 13000));
+  EXPECT_FALSE(tracker.Record("/dev/sdc", lumberjill::KERNEL_ERROR::IO_ERROR, 14000));
+  EXPECT_TRUE(tracker.Record("/dev/sdc", lumberjill::KERNEL_ERROR::LINK_RESET, 15000));
+
+  // Other devices are counted separately
+  EXPECT_FALSE(tracker.Record("/dev/sdd", lumberjill::KERNEL_ERROR::IO_ERROR, 15000));
+
+  // Still over the threshold but within the cool down
+  EXPECT_FALSE(tracker.Record("/dev/sdc", lumberjill::KERNEL_ERROR::IO_ERROR, 16000));
+
+  EXPECT_TRUE(tracker.GetStats("/dev/sdc", 16000, stats));
+  EXPECT_EQ(4, stats.nIOErrors);
+  EXPECT_EQ(1, stats.nMediumErrors);
+  EXPECT_EQ(1, stats.nLinkResets);
+  EXPECT_EQ(0, stats.nBtrfsErrors);
+  EXPECT_EQ(4, stats.nErrorsInWindow);
+  EXPECT_EQ(10, stats.nWindowSeconds);
+
+  // After the cool down it can trigger again
+  EXPECT_FALSE(tracker.Record("/dev/sdc", lumberjill::KERNEL_ERROR::IO_ERROR, 80000));
+  EXPECT_FALSE(tracker.Record("/dev/sdc", lumberjill::KERNEL_ERROR::IO_ERROR, 80100));
+  EXPECT_TRUE(tracker.Record("/dev/sdc", lumberjill::KERNEL_ERROR::IO_ERROR, 80200));
+
+  // A flood within the same second is counted in one bucket
+  for (size_t i = 0; i < 10000; i++) {
+    tracker.Record("/dev/sdd", lumberjill::KERNEL_ERROR::TIMEOUT, 90000);
+  }
+  EXPECT_TRUE(tracker.GetStats("/dev/sdd", 90500, stats));
+  EXPECT_EQ(10000, stats.nTimeouts);
+  EXPECT_EQ(10000, stats.nErrorsInWindow);
+
+  EXPECT_TRUE(tracker.GetStats("/dev/sdd", 200000, stats));
+  EXPECT_EQ(0, stats.nErrorsInWindow);
+}
+
+TEST(KernelLog, TestKernelLogReader)
+{
+  // /dev/kmsg returns one record per read, which a sequenced packet socket does as well
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, fds));
+
+  lumberjill::cKernelLogReader reader;
+  reader.Attach(fds[0]);
+
+  std::vector<std::string> messages;
+  auto onRecord = [&messages](const lumberjill::cKernelLogRecord& record) {
+    messages.push_back(std::string(record.message));
+  };
+
+  // Nothing to read yet
+  EXPECT_TRUE(reader.ReadRecords(onRecord));
+  EXPECT_TRUE(messages.empty());
+
+  const std::vector<std::string> records = ReadSampleRecords();
+  for (auto& sRecord : records) {
+    ASSERT_EQ(ssize_t(sRecord.length()), send(fds[1], sRecord.data(), sRecord.length(), 0));
+  }
+
+  EXPECT_TRUE(reader.ReadRecords(onRecord));
+  ASSERT_EQ(records.size(), messages.size());
+  EXPECT_STREQ("usb 1-4: new high-speed USB device number 5 using xhci_hcd", messages[0].c_str());
+  EXPECT_STREQ("ata3.00: exception Emask 0x0 SAct 0x800000 SErr 0x0 action 0x0", messages[1].c_str());
+
+  close(fds[1]);
+}
+
+TEST(KernelLog, TestDaemonHandleKernelLogMessage)
+{
+  lumberjill::cSettings settings;
+  ASSERT_TRUE(settings.LoadFromFile("test/data/valid_settings_kernel_log.json"));
+
+  lumberjill::cDaemon daemon(settings);
+
+  const uint64_t nNowMS = 1000000;
+
+  // Monitored drives, the third error on sdc reaches the threshold and collects its stats
+  EXPECT_TRUE(daemon.HandleKernelLogMessage("I/O error, dev sdc, sector 1953520 op 0x0:(READ) flags 0x0 phys_seg 1 prio class 0", nNowMS));
+  EXPECT_TRUE(daemon.HandleKernelLogMessage("Buffer I/O error on dev sdc1, logical block 244190, async page read", nNowMS + 100));
+  EXPECT_TRUE(daemon.HandleKernelLogMessage("BTRFS error (device sdc1): bdev /dev/sdc1 errs: wr 0, rd 1, flush 0, corrupt 0, gen 0", nNowMS + 200));
+  EXPECT_TRUE(daemon.HandleKernelLogMessage("nvme0n1: I/O Cmd(0x2) @ LBA 2048, 8 blocks, I/O Error (sct 0x2 / sc 0x81) DNR", nNowMS + 300));
+
+  // A drive we don't monitor
+  EXPECT_FALSE(daemon.HandleKernelLogMessage("I/O error, dev sdz, sector 0 op 0x0:(READ) flags 0x0 phys_seg 1 prio class 0", nNowMS + 400));
+
+  // Not a storage error
+  EXPECT_FALSE(daemon.HandleKernelLogMessage("usb 1-4: new high-speed USB device number 5 using xhci_hcd", nNowMS + 500));
+}
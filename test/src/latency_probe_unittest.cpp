@@ -0,0 +1,212 @@
+#include <cstdlib>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "latency_probe.h"
+
+namespace {
+
+lumberjill::cDriveStats CreateDriveWithLatency(uint64_t nP50US, uint64_t nP99US)
+{
+  lumberjill::cDriveLatencyStats latencyStats;
+  latencyStats.nReads = 32;
+  latencyStats.nP50US = nP50US;
+  latencyStats.nP99US = nP99US;
+  latencyStats.nMaxUS = nP99US;
+
+  lumberjill::cDriveStats driveStats;
+  driveStats.latencyStats = latencyStats;
+  return driveStats;
+}
+
+}
+
+TEST(LatencyProbe, TestHistogramBuckets)
+{
+  // Small values are exact
+  for (uint64_t i = 0; i < 16; i++) {
+    EXPECT_EQ(i, lumberjill::cLatencyHistogram::GetBucketIndex(i));
+    EXPECT_EQ(i, lumberjill::cLatencyHistogram::GetBucketHighestValue(i));
+  }
+
+  // Every value falls in a bucket whose highest value is within 1/16th of it
+  for (uint64_t value : { 16, 17, 31, 32, 33, 100, 1000, 4567, 12345, 999999, 123456789 }) {
+    const size_t index = lumberjill::cLatencyHistogram::GetBucketIndex(value);
+    const uint64_t highest = lumberjill::cLatencyHistogram::GetBucketHighestValue(index);
+    EXPECT_GE(highest, value);
+    EXPECT_LE(highest - value, value / 16);
+
+    // The buckets are in order
+    EXPECT_LT(lumberjill::cLatencyHistogram::GetBucketHighestValue(index - 1), value);
+  }
+
+  // Huge values go in the last bucket
+  EXPECT_EQ(lumberjill::cLatencyHistogram::BUCKET_COUNT - 1, lumberjill::cLatencyHistogram::GetBucketIndex(UINT64_MAX));
+}
+
+TEST(LatencyProbe, TestHistogramPercentiles)
+{
+  lumberjill::cLatencyHistogram histogram;
+  EXPECT_EQ(0, histogram.GetCount());
+  EXPECT_EQ(0, histogram.GetPercentileUS(50.0));
+
+  // 98 fast reads of 100us, then 2 slow reads
+  for (size_t i = 0; i < 98; i++) {
+    histogram.Record(100);
+  }
+  histogram.Record(20000);
+  histogram.Record(50000);
+
+  EXPECT_EQ(100, histogram.GetCount());
+  EXPECT_EQ(50000, histogram.GetMaxUS());
+
+  // Reported as the highest value of the bucket, so within 1/16th
+  EXPECT_GE(histogram.GetPercentileUS(50.0), 100);
+  EXPECT_LE(histogram.GetPercentileUS(50.0), 106);
+  EXPECT_GE(histogram.GetPercentileUS(99.0), 20000);
+  EXPECT_LE(histogram.GetPercentileUS(99.0), 21250);
+
+  // Never more than the max
+  EXPECT_EQ(50000, histogram.GetPercentileUS(100.0));
+
+  histogram.Clear();
+  EXPECT_EQ(0, histogram.GetCount());
+  EXPECT_EQ(0, histogram.GetMaxUS());
+}
+
+TEST(LatencyProbe, TestDeviceLatencyHistograms)
+{
+  lumberjill::cDeviceLatencyHistograms histograms(100);
+
+  // Each probe has 32 reads, one of them slow, so a single probe's p99 is its slowest read
+  lumberjill::cLatencyHistogram probe;
+  for (size_t i = 0; i < 31; i++) {
+    probe.Record(100);
+  }
+  probe.Record(30000);
+  EXPECT_EQ(30000, probe.GetPercentileUS(99.0));
+
+  // Over a few probes the tail is a real percentile
+  lumberjill::cLatencyHistogram probeWithoutSlowRead;
+  for (size_t i = 0; i < 32; i++) {
+    probeWithoutSlowRead.Record(200);
+  }
+
+  histograms.Add("/dev/sdb", probe);
+  const lumberjill::cLatencyHistogram& distribution = histograms.Add("/dev/sdb", probeWithoutSlowRead);
+  EXPECT_EQ(64, distribution.GetCount());
+  EXPECT_EQ(30000, distribution.GetMaxUS());
+  EXPECT_LE(distribution.GetPercentileUS(40.0), 106);
+  EXPECT_GE(distribution.GetPercentileUS(98.0), 200);
+  EXPECT_LE(distribution.GetPercentileUS(98.0), 212);
+
+  // Other drives have their own distribution
+  EXPECT_EQ(32, histograms.Add("/dev/sdc", probeWithoutSlowRead).GetCount());
+
+  // Going over the limit halves the counts and the single slow read drops out
+  histograms.Add("/dev/sdb", probeWithoutSlowRead);
+  const lumberjill::cLatencyHistogram& decayed = histograms.Add("/dev/sdb", probeWithoutSlowRead);
+  EXPECT_EQ(63, decayed.GetCount());
+  EXPECT_GE(decayed.GetMaxUS(), 200);
+  EXPECT_LE(decayed.GetMaxUS(), 207);
+}
+
+TEST(LatencyProbe, TestProbeLoopBackFile)
+{
+  char szFolder[] = "/tmp/lumber-jill-latency-probe-XXXXXX";
+  ASSERT_TRUE(mkdtemp(szFolder) != nullptr);
+  const std::string sFolder(szFolder);
+  const std::string sFilePath = sFolder + "/loop.img";
+
+  // A 4 MiB file standing in for a drive
+  {
+    std::ofstream f(sFilePath, std::ios::binary);
+    const std::string block(4096, 'x');
+    for (size_t i = 0; i < 1024; i++) {
+      f<<block;
+    }
+  }
+
+  // Some file systems such as tmpfs don't support O_DIRECT
+  const int fd = open(sFilePath.c_str(), O_RDONLY | O_DIRECT);
+  if (fd < 0) {
+    std::error_code ec;
+    std::filesystem::remove_all(sFolder, ec);
+    GTEST_SKIP()<<"O_DIRECT is not supported in /tmp";
+  }
+  close(fd);
+
+  lumberjill::cLatencyProbeSettings settings;
+  settings.bEnabled = true;
+  settings.nReads = 20;
+  settings.nReadSizeBytes = 1000; // Rounded up to 4096
+  settings.nReadsPerSecond = 200;
+
+  lumberjill::cLatencyHistogram histogram;
+
+  const auto start = std::chrono::steady_clock::now();
+  EXPECT_TRUE(lumberjill::ProbeDeviceLatency(sFilePath, settings, histogram));
+  const auto duration = std::chrono::steady_clock::now() - start;
+
+  EXPECT_EQ(20, histogram.GetCount());
+  EXPECT_LE(histogram.GetPercentileUS(50.0), histogram.GetPercentileUS(99.0));
+  EXPECT_LE(histogram.GetPercentileUS(99.0), histogram.GetMaxUS());
+
+  // Rate limited to 200 reads per second, so 20 reads take at least 19 * 5ms
+  EXPECT_GE(std::chrono::duration_cast<std::chrono::milliseconds>(duration).count(), 95);
+
+  // A file smaller than a read can't be probed
+  const std::string sSmallFilePath = sFolder + "/small.img";
+  std::ofstream(sSmallFilePath)<<"small";
+  EXPECT_FALSE(lumberjill::ProbeDeviceLatency(sSmallFilePath, settings, histogram));
+
+  EXPECT_FALSE(lumberjill::ProbeDeviceLatency(sFolder + "/missing.img", settings, histogram));
+
+  std::error_code ec;
+  std::filesystem::remove_all(sFolder, ec);
+}
+
+TEST(LatencyProbe, TestFlagLatencyOutliers)
+{
+  lumberjill::cMountStats mountStats;
+  mountStats.sMountPoint = "/data1";
+  mountStats.mapDrivePathToDriveStats["/dev/sdb"] = CreateDriveWithLatency(8000, 20000);
+  mountStats.mapDrivePathToDriveStats["/dev/sdc"] = CreateDriveWithLatency(9000, 22000);
+  mountStats.mapDrivePathToDriveStats["/dev/sdd"] = CreateDriveWithLatency(8500, 21000);
+  mountStats.mapDrivePathToDriveStats["/dev/sde"] = CreateDriveWithLatency(40000, 90000); // Slow but not failing
+  mountStats.mapDrivePathToDriveStats["/dev/sdf"] = CreateDriveWithLatency(8000, 150000); // Usually fine but with a long tail
+
+  // A drive without latency stats is ignored
+  mountStats.mapDrivePathToDriveStats["/dev/sdg"] = lumberjill::cDriveStats();
+
+  lumberjill::FlagLatencyOutliers(mountStats, 3);
+
+  EXPECT_FALSE(mountStats.mapDrivePathToDriveStats["/dev/sdb"].latencyStats->bIsOutlier);
+  EXPECT_FALSE(mountStats.mapDrivePathToDriveStats["/dev/sdc"].latencyStats->bIsOutlier);
+  EXPECT_FALSE(mountStats.mapDrivePathToDriveStats["/dev/sdd"].latencyStats->bIsOutlier);
+  EXPECT_TRUE(mountStats.mapDrivePathToDriveStats["/dev/sde"].latencyStats->bIsOutlier);
+  EXPECT_TRUE(mountStats.mapDrivePathToDriveStats["/dev/sdf"].latencyStats->bIsOutlier);
+  EXPECT_FALSE(mountStats.mapDrivePathToDriveStats["/dev/sdg"].latencyStats.has_value());
+}
+
+TEST(LatencyProbe, TestFlagLatencyOutliersTooFewPeers)
+{
+  // With two drives we can't tell which one is the slow one
+  lumberjill::cMountStats mountStats;
+  mountStats.sMountPoint = "/data1";
+  mountStats.mapDrivePathToDriveStats["/dev/sdb"] = CreateDriveWithLatency(8000, 20000);
+  mountStats.mapDrivePathToDriveStats["/dev/sdc"] = CreateDriveWithLatency(80000, 200000);
+
+  lumberjill::FlagLatencyOutliers(mountStats, 3);
+
+  EXPECT_FALSE(mountStats.mapDrivePathToDriveStats["/dev/sdb"].latencyStats->bIsOutlier);
+  EXPECT_FALSE(mountStats.mapDrivePathToDriveStats["/dev/sdc"].latencyStats->bIsOutlier);
+}
@@ -27,12 +27,17 @@ TEST(Settings, TestLoadSettings)
     lumberjill::cSettings settings;
     EXPECT_TRUE(settings.LoadFromFile(sSettingsFilePath));
 
+    // The tools were not specified so we should get the defaults
+    EXPECT_STREQ("/usr/sbin/smartctl", settings.GetSmartCtlPath().c_str());
+    EXPECT_STREQ("/usr/sbin/btrfs", settings.GetBtrfsPath().c_str());
+
     const std::vector<lumberjill::cGroup>& groups = settings.GetGroups();
     ASSERT_EQ(3, groups.size());
 
     {
       EXPECT_EQ(lumberjill::GROUP_TYPE::SINGLE, groups[0].type);
       EXPECT_STREQ("/", groups[0].sMountPoint.c_str());
+      EXPECT_EQ(5000, groups[0].nMountTimeoutMS);
 
       const std::vector<lumberjill::cDevice>& devices = groups[0].devices;
       ASSERT_EQ(1, devices.size());
@@ -43,6 +48,7 @@ TEST(Settings, TestLoadSettings)
     {
       EXPECT_EQ(lumberjill::GROUP_TYPE::SINGLE, groups[1].type);
       EXPECT_STREQ("/mnt/externalusb", groups[1].sMountPoint.c_str());
+      EXPECT_EQ(1000, groups[1].nMountTimeoutMS);
 
       const std::vector<lumberjill::cDevice>& devices = groups[1].devices;
       ASSERT_EQ(1, devices.size());
@@ -69,3 +75,373 @@ TEST(Settings, TestLoadSettings)
     }
   }
 }
+
+TEST(Settings, TestLoadSettingsAutoDiscoverDevices)
+{
+  const std::string sSettingsFilePath = "test/data/valid_settings_auto.json";
+  lumberjill::cSettings settings;
+  EXPECT_TRUE(settings.LoadFromFile(sSettingsFilePath));
+
+  const std::vector<lumberjill::cGroup>& groups = settings.GetGroups();
+  ASSERT_EQ(2, groups.size());
+
+  EXPECT_EQ(lumberjill::GROUP_TYPE::SINGLE, groups[0].type);
+  EXPECT_STREQ("/", groups[0].sMountPoint.c_str());
+  EXPECT_TRUE(groups[0].bAutoDiscoverDevices);
+  EXPECT_TRUE(groups[0].devices.empty());
+
+  EXPECT_EQ(lumberjill::GROUP_TYPE::BTRFS, groups[1].type);
+  EXPECT_STREQ("/data1", groups[1].sMountPoint.c_str());
+  EXPECT_TRUE(groups[1].bAutoDiscoverDevices);
+  EXPECT_TRUE(groups[1].devices.empty());
+}
+
+TEST(Settings, TestLoadSettingsTools)
+{
+  // Relative tool paths are not allowed
+  {
+    const std::string sSettingsFilePath = "test/data/invalid_settings_tools.json";
+    lumberjill::cSettings settings;
+    EXPECT_FALSE(settings.LoadFromFile(sSettingsFilePath));
+  }
+
+  // Valid tool paths
+  {
+    const std::string sSettingsFilePath = "test/data/valid_settings_tools.json";
+    lumberjill::cSettings settings;
+    EXPECT_TRUE(settings.LoadFromFile(sSettingsFilePath));
+
+    EXPECT_STREQ("/opt/fleet/bin/smartctl", settings.GetSmartCtlPath().c_str());
+    EXPECT_STREQ("/opt/fleet/bin/btrfs", settings.GetBtrfsPath().c_str());
+
+    ASSERT_EQ(1, settings.GetGroups().size());
+  }
+}
+
+TEST(Settings, TestLoadSettingsLatencyProbe)
+{
+  // The probe is off unless it is configured
+  {
+    const std::string sSettingsFilePath = "test/data/valid_settings_tools.json";
+    lumberjill::cSettings settings;
+    EXPECT_TRUE(settings.LoadFromFile(sSettingsFilePath));
+    EXPECT_FALSE(settings.GetLatencyProbeSettings().bEnabled);
+  }
+
+  {
+    const std::string sSettingsFilePath = "test/data/valid_settings_latency_probe.json";
+    lumberjill::cSettings settings;
+    EXPECT_TRUE(settings.LoadFromFile(sSettingsFilePath));
+
+    const lumberjill::cLatencyProbeSettings& latencyProbeSettings = settings.GetLatencyProbeSettings();
+    EXPECT_TRUE(latencyProbeSettings.bEnabled);
+    EXPECT_EQ(16, latencyProbeSettings.nReads);
+    EXPECT_EQ(8192, latencyProbeSettings.nReadSizeBytes);
+    EXPECT_EQ(20, latencyProbeSettings.nReadsPerSecond);
+
+    // Not specified so this is the default
+    EXPECT_EQ(3, latencyProbeSettings.nOutlierFactor);
+  }
+}
+
+TEST(Settings, TestLoadSettingsTemperature)
+{
+  // pread unless io_uring is asked for
+  {
+    const std::string sSettingsFilePath = "test/data/valid_settings.json";
+    lumberjill::cSettings settings;
+    EXPECT_TRUE(settings.LoadFromFile(sSettingsFilePath));
+    EXPECT_EQ(10, settings.GetTemperatureSettings().nSampleIntervalSeconds);
+    EXPECT_FALSE(settings.GetTemperatureSettings().bUseIOUring);
+  }
+
+  {
+    const std::string sSettingsFilePath = "test/data/valid_settings_temperature.json";
+    lumberjill::cSettings settings;
+    EXPECT_TRUE(settings.LoadFromFile(sSettingsFilePath));
+    EXPECT_EQ(5, settings.GetTemperatureSettings().nSampleIntervalSeconds);
+    EXPECT_TRUE(settings.GetTemperatureSettings().bUseIOUring);
+  }
+}
+
+TEST(Settings, TestLoadSettingsAnomaly)
+{
+  {
+    const std::string sSettingsFilePath = "test/data/valid_settings.json";
+    lumberjill::cSettings settings;
+    EXPECT_TRUE(settings.LoadFromFile(sSettingsFilePath));
+
+    // Off unless it is configured
+    EXPECT_FALSE(settings.GetAnomalySettings().bEnabled);
+  }
+
+  {
+    const std::string sSettingsFilePath = "test/data/valid_settings_anomaly.json";
+    lumberjill::cSettings settings;
+    EXPECT_TRUE(settings.LoadFromFile(sSettingsFilePath));
+
+    const lumberjill::cAnomalySettings& anomalySettings = settings.GetAnomalySettings();
+    EXPECT_TRUE(anomalySettings.bEnabled);
+    EXPECT_STREQ("/tmp/lumber-jill/anomaly.state", anomalySettings.sStateFilePath.c_str());
+    EXPECT_EQ(5, anomalySettings.nThresholdSigma);
+
+    // Not specified so these are the defaults
+    EXPECT_EQ(14, anomalySettings.nHalfLifeSamples);
+    EXPECT_EQ(5, anomalySettings.nWarmupSamples);
+  }
+}
+
+TEST(Settings, TestLoadSettingsCapacity)
+{
+  {
+    const std::string sSettingsFilePath = "test/data/valid_settings.json";
+    lumberjill::cSettings settings;
+    EXPECT_TRUE(settings.LoadFromFile(sSettingsFilePath));
+
+    // Off unless it is configured
+    EXPECT_FALSE(settings.GetCapacitySettings().bEnabled);
+  }
+
+  {
+    const std::string sSettingsFilePath = "test/data/valid_settings_capacity.json";
+    lumberjill::cSettings settings;
+    EXPECT_TRUE(settings.LoadFromFile(sSettingsFilePath));
+
+    const lumberjill::cCapacitySettings& capacitySettings = settings.GetCapacitySettings();
+    EXPECT_TRUE(capacitySettings.bEnabled);
+    EXPECT_STREQ("/tmp/lumber-jill/capacity.state", capacitySettings.sStateFilePath.c_str());
+    EXPECT_EQ(14, capacitySettings.nHorizonDays);
+
+    // Not specified so this is the default
+    EXPECT_EQ(72, capacitySettings.nTrendHalfLifeHours);
+  }
+}
+
+TEST(Settings, TestLoadSettingsQgroup)
+{
+  {
+    const std::string sSettingsFilePath = "test/data/valid_settings.json";
+    lumberjill::cSettings settings;
+    EXPECT_TRUE(settings.LoadFromFile(sSettingsFilePath));
+
+    // Off unless it is configured
+    EXPECT_FALSE(settings.GetQgroupSettings().bEnabled);
+  }
+
+  {
+    const std::string sSettingsFilePath = "test/data/valid_settings_qgroup.json";
+    lumberjill::cSettings settings;
+    EXPECT_TRUE(settings.LoadFromFile(sSettingsFilePath));
+
+    const lumberjill::cQgroupSettings& qgroupSettings = settings.GetQgroupSettings();
+    EXPECT_TRUE(qgroupSettings.bEnabled);
+    EXPECT_EQ(5, qgroupSettings.nTop);
+  }
+}
+
+TEST(Settings, TestLoadSettingsScrub)
+{
+  {
+    const std::string sSettingsFilePath = "test/data/valid_settings.json";
+    lumberjill::cSettings settings;
+    EXPECT_TRUE(settings.LoadFromFile(sSettingsFilePath));
+
+    // Off unless it is configured
+    EXPECT_FALSE(settings.GetScrubSettings().bEnabled);
+  }
+
+  {
+    const std::string sSettingsFilePath = "test/data/valid_settings_scrub.json";
+    lumberjill::cSettings settings;
+    EXPECT_TRUE(settings.LoadFromFile(sSettingsFilePath));
+
+    const lumberjill::cScrubSettings& scrubSettings = settings.GetScrubSettings();
+    EXPECT_TRUE(scrubSettings.bEnabled);
+    EXPECT_EQ(14, scrubSettings.nIntervalDays);
+    EXPECT_EQ(104857600, scrubSettings.nBandwidthLimitBytesPerSecond);
+    EXPECT_EQ(50, scrubSettings.nMaxAwaitMS);
+    ASSERT_EQ(2, scrubSettings.windows.size());
+    EXPECT_EQ((22 * 60) + 30, scrubSettings.windows[0].nStartMinute);
+    EXPECT_EQ(6 * 60, scrubSettings.windows[0].nEndMinute);
+    EXPECT_EQ(12 * 60, scrubSettings.windows[1].nStartMinute);
+    EXPECT_EQ(13 * 60, scrubSettings.windows[1].nEndMinute);
+
+    // Not specified so these are the defaults
+    EXPECT_EQ(15, scrubSettings.nPauseMinutes);
+    EXPECT_EQ(60, scrubSettings.nPollIntervalSeconds);
+  }
+
+  // 24:30 isn't a time of day
+  {
+    const std::string sSettingsFilePath = "test/data/invalid_settings_scrub.json";
+    lumberjill::cSettings settings;
+    EXPECT_FALSE(settings.LoadFromFile(sSettingsFilePath));
+  }
+}
+
+TEST(Settings, TestLoadSettingsSelfTest)
+{
+  {
+    const std::string sSettingsFilePath = "test/data/valid_settings.json";
+    lumberjill::cSettings settings;
+    EXPECT_TRUE(settings.LoadFromFile(sSettingsFilePath));
+
+    // Off unless it is configured
+    EXPECT_FALSE(settings.GetSelfTestSettings().bEnabled);
+  }
+
+  {
+    const std::string sSettingsFilePath = "test/data/valid_settings_self_test.json";
+    lumberjill::cSettings settings;
+    EXPECT_TRUE(settings.LoadFromFile(sSettingsFilePath));
+
+    const lumberjill::cSelfTestSettings& selfTestSettings = settings.GetSelfTestSettings();
+    EXPECT_TRUE(selfTestSettings.bEnabled);
+    EXPECT_EQ(14, selfTestSettings.nShortIntervalDays);
+    EXPECT_EQ(60, selfTestSettings.nLongIntervalDays);
+    EXPECT_EQ(2, selfTestSettings.nMaxPerGroup);
+
+    // Not specified so these are the defaults
+    EXPECT_EQ(1, selfTestSettings.nMaxPerController);
+    EXPECT_STREQ("/var/lib/lumber-jill/self_test.state", selfTestSettings.sStateFilePath.c_str());
+  }
+}
+
+TEST(Settings, TestLoadSettingsLowImpact)
+{
+  // io.max limits without a cgroup to put them in
+  {
+    const std::string sSettingsFilePath = "test/data/invalid_settings_low_impact.json";
+    lumberjill::cSettings settings;
+    EXPECT_FALSE(settings.LoadFromFile(sSettingsFilePath));
+  }
+
+  {
+    const std::string sSettingsFilePath = "test/data/valid_settings_low_impact.json";
+    lumberjill::cSettings settings;
+    EXPECT_TRUE(settings.LoadFromFile(sSettingsFilePath));
+
+    const lumberjill::cLowImpactSettings& lowImpactSettings = settings.GetLowImpactSettings();
+    EXPECT_TRUE(lowImpactSettings.bEnabled);
+    EXPECT_TRUE(lowImpactSettings.bSchedIdle);
+    EXPECT_EQ(10, lowImpactSettings.nNice);
+    ASSERT_EQ(2, lowImpactSettings.cpus.size());
+    EXPECT_EQ(0, lowImpactSettings.cpus[0]);
+    EXPECT_EQ(1, lowImpactSettings.cpus[1]);
+    EXPECT_STREQ("/sys/fs/cgroup/lumber-jill", lowImpactSettings.sCgroupPath.c_str());
+    ASSERT_EQ(1, lowImpactSettings.ioMax.size());
+    EXPECT_STREQ("8:16 rbps=10485760 riops=200", lowImpactSettings.ioMax[0].c_str());
+  }
+}
+
+TEST(Settings, TestLoadSettingsSmartSchedule)
+{
+  // The window ends after the deadline
+  {
+    const std::string sSettingsFilePath = "test/data/invalid_settings_smart_schedule.json";
+    lumberjill::cSettings settings;
+    EXPECT_FALSE(settings.LoadFromFile(sSettingsFilePath));
+  }
+
+  {
+    const std::string sSettingsFilePath = "test/data/valid_settings_smart_schedule.json";
+    lumberjill::cSettings settings;
+    EXPECT_TRUE(settings.LoadFromFile(sSettingsFilePath));
+
+    const lumberjill::cSmartScheduleSettings& smartScheduleSettings = settings.GetSmartScheduleSettings();
+    EXPECT_EQ(60, smartScheduleSettings.nWindowSeconds);
+    EXPECT_EQ(2, smartScheduleSettings.nMaxPerController);
+    EXPECT_EQ(120, smartScheduleSettings.nDeadlineSeconds);
+    EXPECT_TRUE(smartScheduleSettings.bSkipStandby);
+  }
+}
+
+TEST(Settings, TestLoadSettingsKernelLog)
+{
+  {
+    const std::string sSettingsFilePath = "test/data/valid_settings.json";
+    lumberjill::cSettings settings;
+    EXPECT_TRUE(settings.LoadFromFile(sSettingsFilePath));
+
+    EXPECT_FALSE(settings.GetKernelLogSettings().bEnabled);
+  }
+
+  {
+    const std::string sSettingsFilePath = "test/data/valid_settings_kernel_log.json";
+    lumberjill::cSettings settings;
+    EXPECT_TRUE(settings.LoadFromFile(sSettingsFilePath));
+
+    const lumberjill::cKernelLogSettings& kernelLogSettings = settings.GetKernelLogSettings();
+    EXPECT_TRUE(kernelLogSettings.bEnabled);
+    EXPECT_EQ(3, kernelLogSettings.nThreshold);
+    EXPECT_EQ(10, kernelLogSettings.nWindowSeconds);
+    EXPECT_EQ(600, kernelLogSettings.nCooldownSeconds);
+  }
+}
+
+TEST(Settings, TestLoadSettingsQuery)
+{
+  {
+    const std::string sSettingsFilePath = "test/data/valid_settings.json";
+    lumberjill::cSettings settings;
+    EXPECT_TRUE(settings.LoadFromFile(sSettingsFilePath));
+
+    EXPECT_FALSE(settings.GetQuerySettings().bEnabled);
+    EXPECT_STREQ("/run/lumber-jill/query.sock", settings.GetQuerySettings().sSocketPath.c_str());
+  }
+
+  {
+    const std::string sSettingsFilePath = "test/data/valid_settings_query.json";
+    lumberjill::cSettings settings;
+    EXPECT_TRUE(settings.LoadFromFile(sSettingsFilePath));
+
+    EXPECT_TRUE(settings.GetQuerySettings().bEnabled);
+    EXPECT_STREQ("/tmp/lumber-jill-test/query.sock", settings.GetQuerySettings().sSocketPath.c_str());
+  }
+}
+
+TEST(Settings, TestLoadSettingsOutput)
+{
+  {
+    const std::string sSettingsFilePath = "test/data/valid_settings.json";
+    lumberjill::cSettings settings;
+    EXPECT_TRUE(settings.LoadFromFile(sSettingsFilePath));
+
+    const lumberjill::cOutputSettings& outputSettings = settings.GetOutputSettings();
+    EXPECT_EQ(1024, outputSettings.nQueueSize);
+    EXPECT_EQ(64, outputSettings.nBatchSize);
+    EXPECT_EQ(lumberjill::OUTPUT_POLICY::BLOCK, outputSettings.policy);
+    EXPECT_TRUE(outputSettings.bStdout);
+    EXPECT_TRUE(outputSettings.bSyslog);
+    EXPECT_TRUE(outputSettings.sFilePath.empty());
+    EXPECT_FALSE(outputSettings.remote.bEnabled);
+  }
+
+  {
+    const std::string sSettingsFilePath = "test/data/valid_settings_output.json";
+    lumberjill::cSettings settings;
+    EXPECT_TRUE(settings.LoadFromFile(sSettingsFilePath));
+
+    const lumberjill::cOutputSettings& outputSettings = settings.GetOutputSettings();
+    EXPECT_EQ(16, outputSettings.nQueueSize);
+    EXPECT_EQ(4, outputSettings.nBatchSize);
+    EXPECT_EQ(lumberjill::OUTPUT_POLICY::COALESCE, outputSettings.policy);
+    EXPECT_FALSE(outputSettings.bStdout);
+    EXPECT_TRUE(outputSettings.bSyslog);
+    EXPECT_STREQ("/var/log/lumber-jill/records.json", outputSettings.sFilePath.c_str());
+
+    EXPECT_TRUE(outputSettings.remote.bEnabled);
+    EXPECT_STREQ("logs.example.com", outputSettings.remote.sHost.c_str());
+    EXPECT_EQ(6514, outputSettings.remote.nPort);
+    EXPECT_EQ(lumberjill::REMOTE_PROTOCOL::UDP, outputSettings.remote.protocol);
+    EXPECT_STREQ("/var/spool/lumber-jill/remote.spool", outputSettings.remote.sSpoolFilePath.c_str());
+    EXPECT_EQ(1048576, outputSettings.remote.nSpoolSizeBytes);
+  }
+
+  // Unknown policy
+  {
+    const std::string sSettingsFilePath = "test/data/invalid_settings_output.json";
+    lumberjill::cSettings settings;
+    EXPECT_FALSE(settings.LoadFromFile(sSettingsFilePath));
+  }
+}
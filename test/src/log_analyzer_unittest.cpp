@@ -0,0 +1,274 @@
+#include <ctime>
+#include <filesystem>
+#include <string>
+#include <system_error>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <json-c/json.h>
+#include <zlib.h>
+
+#include "log_analyzer.h"
+#include "utils.h"
+
+namespace {
+
+const std::string SAMPLE_FILE_PATH = "test/data/syslog_sample.txt";
+const std::string DRIVE_PATH = "/dev/disk/by-id/ata-ST6000VN001-2BB186_ZR10KNTX";
+
+std::string ReadSample()
+{
+  const size_t nMaxFileSizeBytes = 64 * 1024;
+  std::string contents;
+  EXPECT_TRUE(lumberjill::ReadFileIntoString(SAMPLE_FILE_PATH, nMaxFileSizeBytes, contents));
+  return contents;
+}
+
+time_t GetUTCTime(int year, int month, int day, int hour, int minute, int second)
+{
+  struct tm t = {};
+  t.tm_year = year - 1900;
+  t.tm_mon = month - 1;
+  t.tm_mday = day;
+  t.tm_hour = hour;
+  t.tm_min = minute;
+  t.tm_sec = second;
+  return timegm(&t);
+}
+
+time_t GetLocalTime(int year, int month, int day, int hour, int minute, int second)
+{
+  struct tm t = {};
+  t.tm_year = year - 1900;
+  t.tm_mon = month - 1;
+  t.tm_mday = day;
+  t.tm_hour = hour;
+  t.tm_min = minute;
+  t.tm_sec = second;
+  t.tm_isdst = -1;
+  return mktime(&t);
+}
+
+std::vector<double> GetValues(const lumberjill::cLogHistory& history, const std::string& sCounter)
+{
+  std::vector<double> values;
+  auto iter = history.series.find(sCounter);
+  if (iter != history.series.end()) {
+    for (auto& sample : iter->second) values.push_back(sample.dValue);
+  }
+  return values;
+}
+
+}
+
+TEST(LogAnalyzer, TestParseSyslogTimestamp)
+{
+  const time_t reference = GetLocalTime(2026, 10, 19, 12, 0, 0);
+  int64_t nTimestamp = 0;
+
+  EXPECT_TRUE(lumberjill::ParseSyslogTimestamp("2026-10-19T08:15:02Z nas1 lumber-jill[1]: Mount /data1 drive stats", reference, nTimestamp));
+  EXPECT_EQ(GetUTCTime(2026, 10, 19, 8, 15, 2), nTimestamp);
+
+  EXPECT_TRUE(lumberjill::ParseSyslogTimestamp("2026-10-19T08:15:02.123456+01:00 nas1 lumber-jill[1]: Mount /data1 drive stats", reference, nTimestamp));
+  EXPECT_EQ(GetUTCTime(2026, 10, 19, 7, 15, 2), nTimestamp);
+
+  // journalctl -o short-iso
+  EXPECT_TRUE(lumberjill::ParseSyslogTimestamp("2026-10-19T08:15:02-0230 nas1 lumber-jill[1]: Mount /data1 drive stats", reference, nTimestamp));
+  EXPECT_EQ(GetUTCTime(2026, 10, 19, 10, 45, 2), nTimestamp);
+
+  // As sent to a remote collector
+  EXPECT_TRUE(lumberjill::ParseSyslogTimestamp("<134>1 2026-10-19T08:15:02.123456Z nas1 lumber-jill 1234 - - Mount /data1 drive stats", reference, nTimestamp));
+  EXPECT_EQ(GetUTCTime(2026, 10, 19, 8, 15, 2), nTimestamp);
+
+  EXPECT_TRUE(lumberjill::ParseSyslogTimestamp("Oct 19 08:15:02 nas1 lumber-jill[1]: Mount /data1 drive stats", reference, nTimestamp));
+  EXPECT_EQ(GetLocalTime(2026, 10, 19, 8, 15, 2), nTimestamp);
+
+  EXPECT_TRUE(lumberjill::ParseSyslogTimestamp("Oct  9 08:15:02 nas1 lumber-jill[1]: Mount /data1 drive stats", reference, nTimestamp));
+  EXPECT_EQ(GetLocalTime(2026, 10, 9, 8, 15, 2), nTimestamp);
+
+  // A file last written in January has December's lines from the year before
+  EXPECT_TRUE(lumberjill::ParseSyslogTimestamp("Dec 31 23:59:59 nas1 lumber-jill[1]: Mount /data1 drive stats", GetLocalTime(2027, 1, 2, 0, 0, 0), nTimestamp));
+  EXPECT_EQ(GetLocalTime(2026, 12, 31, 23, 59, 59), nTimestamp);
+
+  // Written to stdout without a timestamp
+  EXPECT_FALSE(lumberjill::ParseSyslogTimestamp("Mount /data1 drive stats json @cee: {}", reference, nTimestamp));
+  EXPECT_FALSE(lumberjill::ParseSyslogTimestamp("2026-10-19 nas1", reference, nTimestamp));
+  EXPECT_FALSE(lumberjill::ParseSyslogTimestamp("", reference, nTimestamp));
+}
+
+TEST(LogAnalyzer, TestAnalyzeSample)
+{
+  const std::string contents = ReadSample();
+
+  lumberjill::cLogAnalyzer analyzer;
+  analyzer.AnalyzeBuffer(contents, GetLocalTime(2026, 10, 21, 0, 0, 0));
+  analyzer.Finish();
+
+  const lumberjill::cLogAnalysis& analysis = analyzer.GetAnalysis();
+  EXPECT_EQ(contents.length(), analysis.nBytes);
+
+  // The event and collection stats records are skipped, the record that was cut short is invalid
+  EXPECT_EQ(5, analysis.nRecords);
+  EXPECT_EQ(1, analysis.nInvalidRecords);
+
+  ASSERT_EQ(1, analysis.mounts.size());
+  const lumberjill::cLogHistory& mount = analysis.mounts.at("/data1");
+  EXPECT_EQ(std::vector<double>({ 1200.0, 1190.0, 1180.0 }), GetValues(mount, "freeSpaceGB"));
+  EXPECT_EQ(std::vector<double>({ 6000.0, 6000.0, 6000.0 }), GetValues(mount, "totalSpaceGB"));
+
+  // The drive that isn't present has no stats
+  ASSERT_EQ(1, analysis.drives.size());
+  const lumberjill::cLogHistory& drive = analysis.drives.at(DRIVE_PATH);
+  EXPECT_STREQ("sdb", drive.sName.c_str());
+  EXPECT_STREQ("/data1", drive.sMountPoint.c_str());
+  EXPECT_EQ(std::vector<double>({ 10.0, 14.0, 2.0 }), GetValues(drive, "smartRaw_Read_Error_Rate"));
+  EXPECT_EQ(std::vector<double>({ 4.25, 6.5, 5.0 }), GetValues(drive, "readAwaitMS"));
+  EXPECT_EQ(std::vector<double>({ 1.0, 3.0 }), GetValues(drive, "read_io_errs"));
+
+  // Only numbers become time series
+  EXPECT_TRUE(drive.series.find("temperatureSource") == drive.series.end());
+  EXPECT_TRUE(drive.series.find("present") == drive.series.end());
+
+  // Traditional timestamps are local time, the last record has an RFC 3339 timestamp
+  const std::vector<lumberjill::cLogSample>& samples = drive.series.at("smartRaw_Read_Error_Rate");
+  EXPECT_EQ(GetLocalTime(2026, 10, 18, 23, 59, 59), samples[0].nTimestamp);
+  EXPECT_EQ(GetLocalTime(2026, 10, 19, 0, 0, 1), samples[1].nTimestamp);
+  EXPECT_EQ(GetUTCTime(2026, 10, 20, 11, 0, 3), samples[2].nTimestamp);
+}
+
+TEST(LogAnalyzer, TestLogSeriesSummary)
+{
+  const std::vector<lumberjill::cLogSample> samples = {
+    lumberjill::cLogSample(100, 10.0),
+    lumberjill::cLogSample(200, 14.0),
+    lumberjill::cLogSample(300, 2.0),  // The drive was replaced
+    lumberjill::cLogSample(400, 5.0),
+  };
+
+  const lumberjill::cLogSeriesSummary summary = lumberjill::GetLogSeriesSummary(samples);
+  EXPECT_EQ(4, summary.nSamples);
+  EXPECT_EQ(100, summary.nFirstTimestamp);
+  EXPECT_EQ(400, summary.nLastTimestamp);
+  EXPECT_DOUBLE_EQ(10.0, summary.dFirst);
+  EXPECT_DOUBLE_EQ(5.0, summary.dLast);
+  EXPECT_DOUBLE_EQ(2.0, summary.dMin);
+  EXPECT_DOUBLE_EQ(14.0, summary.dMax);
+  EXPECT_DOUBLE_EQ(4.0 + 2.0 + 3.0, summary.dGrowth);
+  EXPECT_EQ(1, summary.nResets);
+
+  EXPECT_EQ(0, lumberjill::GetLogSeriesSummary({}).nSamples);
+}
+
+TEST(LogAnalyzer, TestAnalyzeFile)
+{
+  const std::string contents = ReadSample();
+
+  // Plain files are mapped
+  lumberjill::cLogAnalyzer plainAnalyzer;
+  ASSERT_TRUE(plainAnalyzer.AnalyzeFile(SAMPLE_FILE_PATH));
+  plainAnalyzer.Finish();
+  EXPECT_EQ(1, plainAnalyzer.GetAnalysis().nFiles);
+  EXPECT_EQ(5, plainAnalyzer.GetAnalysis().nRecords);
+
+  // A rotated file, long enough that lines are cut off between the chunks that are decompressed
+  const size_t nCopies = 4000;
+  const std::filesystem::path path = std::filesystem::temp_directory_path() / ("lumber-jill-unittest-syslog-" + std::to_string(getpid()) + ".gz");
+  gzFile file = gzopen(path.c_str(), "wb");
+  ASSERT_TRUE(file != nullptr);
+  for (size_t i = 0; i < nCopies; i++) {
+    ASSERT_EQ(int(contents.length()), gzwrite(file, contents.data(), unsigned(contents.length())));
+  }
+  ASSERT_EQ(Z_OK, gzclose(file));
+
+  lumberjill::cLogAnalyzer gzipAnalyzer;
+  EXPECT_TRUE(gzipAnalyzer.AnalyzeFile(path.string()));
+  gzipAnalyzer.Finish();
+
+  std::error_code ec;
+  std::filesystem::remove(path, ec);
+
+  const lumberjill::cLogAnalysis& analysis = gzipAnalyzer.GetAnalysis();
+  EXPECT_EQ(1, analysis.nFiles);
+  EXPECT_EQ(nCopies * contents.length(), analysis.nBytes);
+  EXPECT_EQ(nCopies * 5, analysis.nRecords);
+  EXPECT_EQ(nCopies, analysis.nInvalidRecords);
+  ASSERT_EQ(1, analysis.drives.size());
+  EXPECT_EQ(nCopies * 3, analysis.drives.at(DRIVE_PATH).series.at("smartRaw_Read_Error_Rate").size());
+
+  // A file that doesn't exist
+  lumberjill::cLogAnalyzer missingAnalyzer;
+  EXPECT_FALSE(missingAnalyzer.AnalyzeFile("test/data/does_not_exist.log"));
+}
+
+TEST(LogAnalyzer, TestOutput)
+{
+  const std::string contents = ReadSample();
+
+  lumberjill::cLogAnalyzer analyzer;
+  analyzer.AnalyzeBuffer(contents, GetLocalTime(2026, 10, 21, 0, 0, 0));
+  analyzer.Finish();
+
+  const std::string sJSON = lumberjill::GetJSONLogAnalysis(analyzer.GetAnalysis());
+  json_object* root = json_tokener_parse(sJSON.c_str());
+  ASSERT_TRUE(root != nullptr);
+
+  EXPECT_EQ(5, json_object_get_int(json_object_object_get(root, "records")));
+  EXPECT_EQ(1, json_object_get_int(json_object_object_get(root, "invalidRecords")));
+
+  json_object* drives = json_object_object_get(root, "drives");
+  ASSERT_EQ(1, json_object_array_length(drives));
+  json_object* drive = json_object_array_get_idx(drives, 0);
+  EXPECT_STREQ(DRIVE_PATH.c_str(), json_object_get_string(json_object_object_get(drive, "path")));
+
+  json_object* counter = json_object_object_get(json_object_object_get(drive, "counters"), "smartRaw_Read_Error_Rate");
+  ASSERT_TRUE(counter != nullptr);
+  EXPECT_EQ(3, json_object_get_int(json_object_object_get(counter, "samples")));
+  EXPECT_DOUBLE_EQ(6.0, json_object_get_double(json_object_object_get(counter, "growth")));
+  EXPECT_EQ(1, json_object_get_int(json_object_object_get(counter, "resets")));
+
+  json_object_put(root);
+
+  const std::string sCSV = lumberjill::GetCSVLogAnalysis(analyzer.GetAnalysis());
+  EXPECT_EQ(0, sCSV.find("timestamp,type,id,counter,value\n"));
+  EXPECT_NE(std::string::npos, sCSV.find(std::to_string(GetUTCTime(2026, 10, 20, 11, 0, 3)) + ",mount,/data1,freeSpaceGB,1180.00\n"));
+  EXPECT_NE(std::string::npos, sCSV.find("drive," + DRIVE_PATH + ",read_io_errs,3.00\n"));
+}
+
+TEST(LogAnalyzer, TestAnalyzeRecordVariants)
+{
+  const std::string contents =
+    // Escapes, fields the analyzer doesn't know about and numbers in any JSON form
+    "Mount /data2 drive stats json @cee: { \"mountPoint\": \"\\/data2\", \"extra\": { \"nested\": [ 1, \"}\", { \"a\": null } ] }, \"drives\": [ { \"name\": \"caf\\u00e9 \\\"1\\\"\", \"path\": \"\\/dev\\/sdx\", \"present\": true, \"note\": null, \"offset\": -1.5e2 } ] }\r\n"
+    // Not JSON after all
+    "Mount /data2 drive stats json @cee: not json\n"
+    "Mount /data2 drive stats json @cee: { \"mountPoint\": \"/data2\" } trailing\n"
+    "Mount /data2 drive stats json @cee: { \"drives\": [] }\n"
+    // Not one of ours
+    "Mount /data2 drive stats json@cee: { \"mountPoint\": \"/data2\" }\n"
+    "Mount /data2 drive stats json @cee:{ \"mountPoint\": \"/data2\" }\n"
+    "@\n"
+    "Mount /data2 drive stats json @cee: { \"mountPoint\": \"/data2\", \"freeSpaceGB\": 7 }";
+
+  lumberjill::cLogAnalyzer analyzer;
+  analyzer.AnalyzeBuffer(contents, GetLocalTime(2026, 10, 21, 0, 0, 0));
+  analyzer.Finish();
+
+  const lumberjill::cLogAnalysis& analysis = analyzer.GetAnalysis();
+  EXPECT_EQ(2, analysis.nRecords);
+  EXPECT_EQ(3, analysis.nInvalidRecords);
+
+  ASSERT_EQ(1, analysis.mounts.size());
+  EXPECT_EQ(std::vector<double>({ 7.0 }), GetValues(analysis.mounts.at("/data2"), "freeSpaceGB"));
+
+  ASSERT_EQ(1, analysis.drives.size());
+  const lumberjill::cLogHistory& drive = analysis.drives.at("/dev/sdx");
+  EXPECT_STREQ("caf\xC3\xA9 \"1\"", drive.sName.c_str());
+  EXPECT_STREQ("/data2", drive.sMountPoint.c_str());
+  EXPECT_EQ(std::vector<double>({ -150.0 }), GetValues(drive, "offset"));
+  EXPECT_EQ(1, drive.series.size());
+
+  // Without a timestamp
+  EXPECT_EQ(0, drive.series.at("offset")[0].nTimestamp);
+}
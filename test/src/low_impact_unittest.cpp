@@ -0,0 +1,106 @@
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "low_impact.h"
+#include "run_command.h"
+
+namespace {
+
+// Get the fields of /proc/self/stat for a child process, starting at field 3 (state)
+std::vector<std::string> GetChildProcessStatFields()
+{
+  std::string out_standard;
+  std::string out_error;
+  EXPECT_TRUE(lumberjill::RunCommand("/bin/cat", { "/proc/self/stat" }, out_standard, out_error));
+
+  // Skip past the command name, which could contain spaces
+  std::istringstream stream(out_standard.substr(out_standard.rfind(')') + 1));
+
+  std::vector<std::string> fields;
+  std::string field;
+  while (stream>>field) {
+    fields.push_back(field);
+  }
+
+  return fields;
+}
+
+// Field numbers from "man 5 proc", relative to the state field
+const size_t STAT_FIELD_NICE = 19 - 3;
+const size_t STAT_FIELD_POLICY = 41 - 3;
+
+const long SCHED_IDLE_POLICY = 5;
+
+}
+
+TEST(LowImpact, TestIdleIOPriority)
+{
+  const long nBefore = syscall(SYS_ioprio_get, 1, 0);
+
+  {
+    const lumberjill::cIdleIOPriority idle;
+
+    // The idle class is 3, shifted up by 13 bits
+    EXPECT_EQ(3, syscall(SYS_ioprio_get, 1, 0) >> 13);
+  }
+
+  EXPECT_EQ(nBefore, syscall(SYS_ioprio_get, 1, 0));
+}
+
+TEST(LowImpact, TestChildProcessLowImpact)
+{
+  // Nothing is applied until it is enabled
+  std::vector<std::string> fields = GetChildProcessStatFields();
+  ASSERT_GT(fields.size(), STAT_FIELD_POLICY);
+  EXPECT_EQ(std::to_string(getpriority(PRIO_PROCESS, 0)), fields[STAT_FIELD_NICE]);
+  EXPECT_NE(std::to_string(SCHED_IDLE_POLICY), fields[STAT_FIELD_POLICY]);
+
+  lumberjill::cLowImpactSettings settings;
+  settings.bEnabled = true;
+  settings.nNice = 15;
+  settings.cpus = { 0 };
+
+  lumberjill::cLowImpact lowImpact;
+  ASSERT_TRUE(lowImpact.Prepare(settings));
+  EXPECT_TRUE(lowImpact.IsEnabled());
+
+  lumberjill::SetChildProcessLowImpact(&lowImpact);
+
+  fields = GetChildProcessStatFields();
+  ASSERT_GT(fields.size(), STAT_FIELD_POLICY);
+  EXPECT_EQ("15", fields[STAT_FIELD_NICE]);
+  EXPECT_EQ(std::to_string(SCHED_IDLE_POLICY), fields[STAT_FIELD_POLICY]);
+
+  std::string out_standard;
+  std::string out_error;
+  EXPECT_TRUE(lumberjill::RunCommand("/bin/cat", { "/proc/self/status" }, out_standard, out_error));
+  EXPECT_NE(std::string::npos, out_standard.find("Cpus_allowed_list:\t0\n"));
+
+  EXPECT_TRUE(lumberjill::RunCommand("/usr/bin/ionice", {}, out_standard, out_error));
+  EXPECT_STREQ("idle\n", out_standard.c_str());
+
+  lumberjill::SetChildProcessLowImpact(nullptr);
+
+  // Back to normal, and this process was not changed
+  fields = GetChildProcessStatFields();
+  ASSERT_GT(fields.size(), STAT_FIELD_POLICY);
+  EXPECT_NE(std::to_string(SCHED_IDLE_POLICY), fields[STAT_FIELD_POLICY]);
+  EXPECT_NE(15, getpriority(PRIO_PROCESS, 0));
+}
+
+TEST(LowImpact, TestPrepareInvalidCPU)
+{
+  lumberjill::cLowImpactSettings settings;
+  settings.bEnabled = true;
+  settings.cpus = { CPU_SETSIZE };
+
+  lumberjill::cLowImpact lowImpact;
+  EXPECT_FALSE(lowImpact.Prepare(settings));
+}
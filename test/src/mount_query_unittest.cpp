@@ -0,0 +1,92 @@
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "mount_query.h"
+
+namespace {
+
+std::atomic<bool> bHungMountReleased(false);
+
+// Pretends that "/hung" is a dead network mount and returns fixed sizes for everything else
+int FakeStatVFS(const char* path, struct statvfs* buf)
+{
+  if (strcmp(path, "/hung") == 0) {
+    while (!bHungMountReleased) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  } else if (strcmp(path, "/missing") == 0) {
+    return -1;
+  }
+
+  memset(buf, 0, sizeof(*buf));
+  buf->f_bsize = 4096;
+  buf->f_blocks = 1000;
+  buf->f_bfree = 250;
+  return 0;
+}
+
+}
+
+TEST(MountQuery, TestMountQuery)
+{
+  // A real mount
+  {
+    lumberjill::cMountQueryPool pool;
+    lumberjill::cMountStats mountStats;
+    EXPECT_EQ(lumberjill::MOUNT_QUERY_RESULT::OK, pool.GetMountTotalAndFreeSpace("/", std::chrono::milliseconds(5000), mountStats));
+    EXPECT_TRUE(mountStats.nTotalBytes.has_value());
+    EXPECT_TRUE(mountStats.nFreeBytes.has_value());
+  }
+
+  lumberjill::cMountQueryPool pool(FakeStatVFS);
+
+  // Normal mount
+  {
+    lumberjill::cMountStats mountStats;
+    EXPECT_EQ(lumberjill::MOUNT_QUERY_RESULT::OK, pool.GetMountTotalAndFreeSpace("/data1", std::chrono::milliseconds(5000), mountStats));
+    EXPECT_EQ(4096 * 1000, mountStats.nTotalBytes.value());
+    EXPECT_EQ(4096 * 250, mountStats.nFreeBytes.value());
+  }
+
+  // Failing mount
+  {
+    lumberjill::cMountStats mountStats;
+    EXPECT_EQ(lumberjill::MOUNT_QUERY_RESULT::ERROR, pool.GetMountTotalAndFreeSpace("/missing", std::chrono::milliseconds(5000), mountStats));
+    EXPECT_FALSE(mountStats.nTotalBytes.has_value());
+    EXPECT_FALSE(mountStats.nFreeBytes.has_value());
+  }
+
+  // Hung mount, this should time out and then be skipped while the first call is still stuck
+  {
+    lumberjill::cMountStats mountStats;
+    EXPECT_EQ(lumberjill::MOUNT_QUERY_RESULT::UNRESPONSIVE, pool.GetMountTotalAndFreeSpace("/hung", std::chrono::milliseconds(50), mountStats));
+    EXPECT_FALSE(mountStats.nTotalBytes.has_value());
+    EXPECT_TRUE(pool.IsMountBusy("/hung"));
+
+    const size_t nThreads = pool.GetThreadCount();
+    for (size_t i = 0; i < 10; i++) {
+      EXPECT_EQ(lumberjill::MOUNT_QUERY_RESULT::UNRESPONSIVE, pool.GetMountTotalAndFreeSpace("/hung", std::chrono::milliseconds(50), mountStats));
+    }
+    EXPECT_EQ(nThreads, pool.GetThreadCount());
+
+    // Other mounts still work while one thread is stuck
+    EXPECT_EQ(lumberjill::MOUNT_QUERY_RESULT::OK, pool.GetMountTotalAndFreeSpace("/data1", std::chrono::milliseconds(5000), mountStats));
+  }
+
+  // Once the stuck call returns the mount can be queried again
+  {
+    bHungMountReleased = true;
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while (pool.IsMountBusy("/hung") && ((std::chrono::steady_clock::now() - start) < std::chrono::seconds(5))) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    lumberjill::cMountStats mountStats;
+    EXPECT_EQ(lumberjill::MOUNT_QUERY_RESULT::OK, pool.GetMountTotalAndFreeSpace("/hung", std::chrono::milliseconds(5000), mountStats));
+  }
+}
@@ -0,0 +1,306 @@
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "output.h"
+#include "stats.h"
+
+#include "temporary_folder.h"
+
+namespace {
+
+// Holds up the sink thread while it serialises a record, so that the queue fills up behind it
+class cSinkGate {
+public:
+  cSinkGate() : bEntered(false), bOpen(false) {}
+
+  void Wait()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    bEntered = true;
+    cv.notify_all();
+    cv.wait(lock, [this] { return bOpen; });
+  }
+
+  void WaitUntilEntered()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [this] { return bEntered; });
+  }
+
+  void Open()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    bOpen = true;
+    cv.notify_all();
+  }
+
+private:
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool bEntered;
+  bool bOpen;
+};
+
+lumberjill::cOutputSettings CreateFileOnlySettings(const std::string& sFilePath, lumberjill::OUTPUT_POLICY policy, size_t nQueueSize)
+{
+  lumberjill::cOutputSettings settings;
+  settings.bStdout = false;
+  settings.bSyslog = false;
+  settings.sFilePath = sFilePath;
+  settings.policy = policy;
+  settings.nQueueSize = nQueueSize;
+  return settings;
+}
+
+lumberjill::cOutputRecord CreateRecord(const std::string& sValue, const std::string& sCoalesceKey)
+{
+  lumberjill::cOutputRecord record;
+  record.sMessage = "Test";
+  record.sCoalesceKey = sCoalesceKey;
+  record.fnGetJSON = [sValue]() { return "{ \"value\": \"" + sValue + "\" }"; };
+  return record;
+}
+
+// Push a record that holds up the sink thread until the gate is opened
+void PushGatedRecord(lumberjill::cOutputPipeline& pipeline, cSinkGate& gate)
+{
+  lumberjill::cOutputRecord record;
+  record.fnGetJSON = [&gate]() { gate.Wait(); return std::string("{ \"value\": \"gate\" }"); };
+  pipeline.Push(std::move(record));
+  gate.WaitUntilEntered();
+}
+
+std::vector<std::string> ReadLines(const std::string& sFilePath)
+{
+  std::vector<std::string> lines;
+  std::ifstream file(sFilePath);
+  std::string sLine;
+  while (std::getline(file, sLine)) {
+    lines.push_back(sLine);
+  }
+  return lines;
+}
+
+}
+
+TEST(Output, TestSerialiseOnce)
+{
+  const cTemporaryFolder folder("output");
+  const std::string sFilePath = folder.GetFilePath("records.json");
+
+  lumberjill::cOutputSettings settings = CreateFileOnlySettings(sFilePath, lumberjill::OUTPUT_POLICY::BLOCK, 16);
+  settings.bStdout = true;
+
+  lumberjill::cOutputPipeline pipeline;
+  ASSERT_TRUE(pipeline.Start(settings));
+
+  // Every sink gets the same JSON from a single call
+  std::atomic<size_t> nSerialised(0);
+  for (size_t i = 0; i < 10; i++) {
+    lumberjill::cOutputRecord record;
+    record.fnGetJSON = [&nSerialised, i]() { nSerialised++; return "{ \"index\": " + std::to_string(i) + " }"; };
+    pipeline.Push(std::move(record));
+  }
+
+  pipeline.Flush();
+  EXPECT_EQ(10, nSerialised.load());
+
+  const std::vector<std::string> lines = ReadLines(sFilePath);
+  ASSERT_EQ(10, lines.size());
+  EXPECT_STREQ("{ \"index\": 0 }", lines[0].c_str());
+  EXPECT_STREQ("{ \"index\": 9 }", lines[9].c_str());
+
+  lumberjill::cOutputStats stats;
+  pipeline.GetStatsAndReset(stats);
+  EXPECT_TRUE(stats.bEnabled);
+  EXPECT_EQ(10, stats.nQueued);
+  EXPECT_EQ(0, stats.nDropped);
+  ASSERT_EQ(2, stats.sinks.size());
+  EXPECT_STREQ("stdout", stats.sinks[0].sName.c_str());
+  EXPECT_STREQ("file", stats.sinks[1].sName.c_str());
+  EXPECT_EQ(10, stats.sinks[0].nRecords);
+  EXPECT_EQ(10, stats.sinks[1].nRecords);
+  EXPECT_EQ(0, stats.sinks[1].nErrors);
+  EXPECT_LE(stats.sinks[1].nMaxLatencyUS, stats.sinks[1].nTotalLatencyUS);
+
+  // The stats start again from zero
+  pipeline.GetStatsAndReset(stats);
+  EXPECT_EQ(0, stats.nQueued);
+  ASSERT_EQ(2, stats.sinks.size());
+  EXPECT_EQ(0, stats.sinks[1].nRecords);
+}
+
+TEST(Output, TestDropOldest)
+{
+  const cTemporaryFolder folder("output");
+  const std::string sFilePath = folder.GetFilePath("records.json");
+
+  lumberjill::cOutputPipeline pipeline;
+  ASSERT_TRUE(pipeline.Start(CreateFileOnlySettings(sFilePath, lumberjill::OUTPUT_POLICY::DROP_OLDEST, 2)));
+
+  cSinkGate gate;
+  PushGatedRecord(pipeline, gate);
+
+  pipeline.Push(CreateRecord("a", ""));
+  pipeline.Push(CreateRecord("b", ""));
+  pipeline.Push(CreateRecord("c", ""));
+
+  gate.Open();
+  pipeline.Flush();
+
+  const std::vector<std::string> lines = ReadLines(sFilePath);
+  ASSERT_EQ(3, lines.size());
+  EXPECT_STREQ("{ \"value\": \"gate\" }", lines[0].c_str());
+  EXPECT_STREQ("{ \"value\": \"b\" }", lines[1].c_str());
+  EXPECT_STREQ("{ \"value\": \"c\" }", lines[2].c_str());
+
+  lumberjill::cOutputStats stats;
+  pipeline.GetStatsAndReset(stats);
+  EXPECT_EQ(4, stats.nQueued);
+  EXPECT_EQ(1, stats.nDropped);
+  EXPECT_EQ(2, stats.nMaxQueueDepth);
+}
+
+TEST(Output, TestCoalesce)
+{
+  const cTemporaryFolder folder("output");
+  const std::string sFilePath = folder.GetFilePath("records.json");
+
+  lumberjill::cOutputPipeline pipeline;
+  ASSERT_TRUE(pipeline.Start(CreateFileOnlySettings(sFilePath, lumberjill::OUTPUT_POLICY::COALESCE, 8)));
+
+  cSinkGate gate;
+  PushGatedRecord(pipeline, gate);
+
+  pipeline.Push(CreateRecord("data1 first", "mount /data1"));
+  pipeline.Push(CreateRecord("event", ""));
+  pipeline.Push(CreateRecord("data2", "mount /data2"));
+  pipeline.Push(CreateRecord("event", ""));
+  pipeline.Push(CreateRecord("data1 second", "mount /data1"));
+
+  gate.Open();
+  pipeline.Flush();
+
+  // The newer /data1 record takes the place of the older one, records without a key are all kept
+  const std::vector<std::string> lines = ReadLines(sFilePath);
+  ASSERT_EQ(5, lines.size());
+  EXPECT_STREQ("{ \"value\": \"data1 second\" }", lines[1].c_str());
+  EXPECT_STREQ("{ \"value\": \"event\" }", lines[2].c_str());
+  EXPECT_STREQ("{ \"value\": \"data2\" }", lines[3].c_str());
+  EXPECT_STREQ("{ \"value\": \"event\" }", lines[4].c_str());
+
+  lumberjill::cOutputStats stats;
+  pipeline.GetStatsAndReset(stats);
+  EXPECT_EQ(1, stats.nCoalesced);
+  EXPECT_EQ(0, stats.nDropped);
+}
+
+TEST(Output, TestCoalesceDeviceRecords)
+{
+  const cTemporaryFolder folder("output");
+  const std::string sFilePath = folder.GetFilePath("device_records.json");
+
+  lumberjill::cOutputPipeline pipeline;
+  ASSERT_TRUE(pipeline.Start(CreateFileOnlySettings(sFilePath, lumberjill::OUTPUT_POLICY::COALESCE, 8)));
+  lumberjill::SetOutputPipeline(&pipeline);
+
+  cSinkGate gate;
+  PushGatedRecord(pipeline, gate);
+
+  lumberjill::cMountStats mountStats;
+  mountStats.sMountPoint = "/data1";
+  mountStats.mapDrivePathToDriveStats["/dev/sdb"].sName = "Drive 1";
+  mountStats.mapDrivePathToDriveStats["/dev/sdc"].sName = "Drive 2";
+
+  lumberjill::cMountStats deviceStats;
+  deviceStats.sMountPoint = "/data1";
+  deviceStats.mapDrivePathToDriveStats["/dev/sdb"].sName = "Drive 1";
+
+  // A record for a single drive doesn't replace the record for the whole mount or the other way round
+  EXPECT_TRUE(lumberjill::LogStatsToSyslogMountStats(mountStats));
+  EXPECT_TRUE(lumberjill::LogStatsToSyslogDeviceStats(deviceStats, "/dev/sdb"));
+  EXPECT_TRUE(lumberjill::LogStatsToSyslogDeviceStats(deviceStats, "/dev/sdc"));
+
+  // But a newer one for the same drive does
+  EXPECT_TRUE(lumberjill::LogStatsToSyslogDeviceStats(deviceStats, "/dev/sdb"));
+
+  gate.Open();
+  pipeline.Flush();
+  lumberjill::SetOutputPipeline(nullptr);
+
+  EXPECT_EQ(4, ReadLines(sFilePath).size());
+
+  lumberjill::cOutputStats stats;
+  pipeline.GetStatsAndReset(stats);
+  EXPECT_EQ(1, stats.nCoalesced);
+}
+
+TEST(Output, TestBlock)
+{
+  const cTemporaryFolder folder("output");
+  const std::string sFilePath = folder.GetFilePath("records.json");
+
+  lumberjill::cOutputPipeline pipeline;
+  ASSERT_TRUE(pipeline.Start(CreateFileOnlySettings(sFilePath, lumberjill::OUTPUT_POLICY::BLOCK, 1)));
+
+  cSinkGate gate;
+  PushGatedRecord(pipeline, gate);
+  pipeline.Push(CreateRecord("a", ""));
+
+  // The queue is full so this waits for the sink thread
+  std::atomic<bool> bPushed(false);
+  std::thread collector([&pipeline, &bPushed]() {
+    pipeline.Push(CreateRecord("b", ""));
+    bPushed = true;
+  });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(bPushed.load());
+
+  gate.Open();
+  collector.join();
+  EXPECT_TRUE(bPushed.load());
+
+  pipeline.Flush();
+  EXPECT_EQ(3, ReadLines(sFilePath).size());
+
+  lumberjill::cOutputStats stats;
+  pipeline.GetStatsAndReset(stats);
+  EXPECT_EQ(0, stats.nDropped);
+  EXPECT_LT(0, stats.nBlockedUS);
+}
+
+TEST(Output, TestStopWritesEverything)
+{
+  const cTemporaryFolder folder("output");
+  const std::string sFilePath = folder.GetFilePath("records.json");
+
+  lumberjill::cOutputSettings settings = CreateFileOnlySettings(sFilePath, lumberjill::OUTPUT_POLICY::BLOCK, 1000);
+  settings.nBatchSize = 7;
+
+  lumberjill::cOutputPipeline pipeline;
+  ASSERT_TRUE(pipeline.Start(settings));
+
+  for (size_t i = 0; i < 100; i++) {
+    pipeline.Push(CreateRecord(std::to_string(i), ""));
+  }
+
+  pipeline.Stop();
+
+  const std::vector<std::string> lines = ReadLines(sFilePath);
+  ASSERT_EQ(100, lines.size());
+  EXPECT_STREQ("{ \"value\": \"99\" }", lines[99].c_str());
+
+  lumberjill::cOutputStats stats;
+  pipeline.GetStatsAndReset(stats);
+  ASSERT_EQ(1, stats.sinks.size());
+  EXPECT_EQ(100, stats.sinks[0].nRecords);
+  EXPECT_LE(100 / 7, stats.sinks[0].nBatches);
+}
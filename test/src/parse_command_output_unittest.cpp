@@ -1,5 +1,10 @@
 #include <iostream>
 #include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+
+#include <stdlib.h>
 
 #include <gtest/gtest.h>
 
@@ -28,9 +33,65 @@ TEST(ParseCommand, TestParseSmartCtlOutput)
     EXPECT_EQ(19215, smartctlStats.nRaw_Read_Error_Rate.value());
     EXPECT_EQ(1234, smartctlStats.nSeek_Error_Rate.value());
     EXPECT_EQ(5678, smartctlStats.nOffline_Uncorrectable.value());
+    EXPECT_EQ(21, smartctlStats.nTemperature_Celsius.value());
+    EXPECT_FALSE(smartctlStats.bIsInStandby);
+  }
+
+  // "smartctl -n standby" leaving a drive spun down
+  {
+    const size_t nMaxFileSizeBytes = 100000;
+
+    std::string sCommandOutput;
+    ASSERT_TRUE(lumberjill::ReadFileIntoString("test/data/smartctl_standby.txt", nMaxFileSizeBytes, sCommandOutput));
+    lumberjill::cSmartCtlStats smartctlStats;
+    EXPECT_TRUE(lumberjill::smartctl::ParseDriveSmartControlData(sCommandOutput, smartctlStats));
+
+    EXPECT_TRUE(smartctlStats.bIsInStandby);
+    EXPECT_FALSE(smartctlStats.HasValues());
   }
 }
 
+TEST(ParseCommand, TestSmartCtlSampleCache)
+{
+  const size_t nMaxFileSizeBytes = 100000;
+
+  std::string sActiveOutput;
+  ASSERT_TRUE(lumberjill::ReadFileIntoString("test/data/smartctl_dying_drive.txt", nMaxFileSizeBytes, sActiveOutput));
+  std::string sStandbyOutput;
+  ASSERT_TRUE(lumberjill::ReadFileIntoString("test/data/smartctl_standby.txt", nMaxFileSizeBytes, sStandbyOutput));
+
+  lumberjill::cSmartCtlSampleCache cache;
+
+  // In standby before we have ever seen it active, there is nothing to fill in
+  lumberjill::cSmartCtlStats smartctlStats;
+  EXPECT_TRUE(lumberjill::smartctl::ParseDriveSmartControlData(sStandbyOutput, smartctlStats));
+  cache.Update("/dev/sdb", 1000, smartctlStats);
+  EXPECT_TRUE(smartctlStats.bIsInStandby);
+  EXPECT_FALSE(smartctlStats.HasValues());
+  EXPECT_FALSE(smartctlStats.nSampleAgeSeconds.has_value());
+
+  // Active, the values are left alone
+  EXPECT_TRUE(lumberjill::smartctl::ParseDriveSmartControlData(sActiveOutput, smartctlStats));
+  cache.Update("/dev/sdb", 2000, smartctlStats);
+  EXPECT_FALSE(smartctlStats.bIsInStandby);
+  EXPECT_EQ(19215, smartctlStats.nRaw_Read_Error_Rate.value());
+  EXPECT_FALSE(smartctlStats.nSampleAgeSeconds.has_value());
+
+  // Back in standby, we get the last values and how old they are
+  EXPECT_TRUE(lumberjill::smartctl::ParseDriveSmartControlData(sStandbyOutput, smartctlStats));
+  cache.Update("/dev/sdb", 3602000, smartctlStats);
+  EXPECT_TRUE(smartctlStats.bIsInStandby);
+  EXPECT_EQ(19215, smartctlStats.nRaw_Read_Error_Rate.value());
+  EXPECT_EQ(1234, smartctlStats.nSeek_Error_Rate.value());
+  EXPECT_EQ(5678, smartctlStats.nOffline_Uncorrectable.value());
+  EXPECT_EQ(3600, smartctlStats.nSampleAgeSeconds.value());
+
+  // Other drives are separate
+  EXPECT_TRUE(lumberjill::smartctl::ParseDriveSmartControlData(sStandbyOutput, smartctlStats));
+  cache.Update("/dev/sdc", 3602000, smartctlStats);
+  EXPECT_FALSE(smartctlStats.HasValues());
+}
+
 TEST(ParseCommand, TestParseBtrfsOutput)
 {
   // Empty string should fail
@@ -106,4 +167,53 @@ TEST(ParseCommand, TestParseBtrfsOutput)
     EXPECT_EQ(3456, btrfsVolumeStats.mapDrivePathToBtrfsDriveStats["/dev/sdf"].nCorruption_errs.value());
     EXPECT_EQ(7890, btrfsVolumeStats.mapDrivePathToBtrfsDriveStats["/dev/sdf"].nGeneration_errs.value());
   }
+
+  // A device given by its by-id link is matched to the kernel's path that btrfs prints
+  {
+    char szFolder[] = "/tmp/lumber-jill-btrfs-XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(szFolder));
+    const std::string sFolder(szFolder);
+
+    std::filesystem::create_directories(sFolder + "/disk/by-id");
+    std::ofstream(sFolder + "/sdb").close();
+    std::filesystem::create_symlink("../../sdb", sFolder + "/disk/by-id/ata-ST6000VN001-2BB186_ZR10KNTX");
+
+    std::vector<lumberjill::cDevice> devices;
+    devices.push_back(lumberjill::cDevice { "BTRFS ata-ST6000VN001-2BB186_ZR10KNTX", sFolder + "/disk/by-id/ata-ST6000VN001-2BB186_ZR10KNTX" });
+
+    const std::string sCommandOutput = "[" + sFolder + "/sdb].write_io_errs    0\n[" + sFolder + "/sdb].read_io_errs     44\n";
+
+    lumberjill::cBtrfsVolumeStats btrfsVolumeStats;
+    EXPECT_TRUE(lumberjill::btrfs::ParseBtrfsVolumeDeviceStats(sCommandOutput, devices, btrfsVolumeStats));
+
+    ASSERT_EQ(1, btrfsVolumeStats.mapDrivePathToBtrfsDriveStats.size());
+    const lumberjill::cBtrfsDriveStats& btrfsDriveStats = btrfsVolumeStats.mapDrivePathToBtrfsDriveStats[devices[0].sPath];
+    EXPECT_STREQ("BTRFS ata-ST6000VN001-2BB186_ZR10KNTX", btrfsDriveStats.sName.c_str());
+    EXPECT_EQ(0, btrfsDriveStats.nWrite_io_errs.value());
+    EXPECT_EQ(44, btrfsDriveStats.nRead_io_errs.value());
+
+    std::error_code ec;
+    std::filesystem::remove_all(sFolder, ec);
+  }
+}
+
+TEST(ParseCommand, TestParseBtrfsFilesystemUsageOutput)
+{
+  // Empty string should fail
+  {
+    size_t nUnallocatedBytes = 0;
+    EXPECT_FALSE(lumberjill::btrfs::ParseBtrfsFilesystemUsage("", nUnallocatedBytes));
+  }
+
+  // Test against actual output from btrfs
+  {
+    const size_t nMaxFileSizeBytes = 100000;
+
+    std::string sCommandOutput;
+    ASSERT_TRUE(lumberjill::ReadFileIntoString("test/data/btrfs_filesystem_usage_output.txt", nMaxFileSizeBytes, sCommandOutput));
+
+    size_t nUnallocatedBytes = 0;
+    EXPECT_TRUE(lumberjill::btrfs::ParseBtrfsFilesystemUsage(sCommandOutput, nUnallocatedBytes));
+    EXPECT_EQ(2158650834944, nUnallocatedBytes);
+  }
 }
@@ -0,0 +1,233 @@
+#include <atomic>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "query_server.h"
+#include "snapshot.h"
+#include "stats.h"
+
+namespace {
+
+lumberjill::cStatsSnapshot CreateSnapshot()
+{
+  lumberjill::cStatsSnapshot snapshot;
+  snapshot.nTimestamp = 1700000000;
+
+  {
+    lumberjill::cGroupStats group;
+    group.mountStats.sMountPoint = "/";
+    group.mountStats.nFreeBytes = 567 * size_t(1000000000); // 567 GB
+    group.mountStats.nTotalBytes = 1234 * size_t(1000000000); // 1.234 TB
+
+    lumberjill::cDriveStats driveStats;
+    driveStats.sName = "OS";
+    driveStats.bIsPresent = true;
+    driveStats.smartCtlStats.nRaw_Read_Error_Rate = 0;
+    driveStats.smartCtlStats.nSeek_Error_Rate = 0;
+    driveStats.smartCtlStats.nOffline_Uncorrectable = 0;
+    group.mountStats.mapDrivePathToDriveStats["/dev/sda"] = driveStats;
+
+    snapshot.groups.push_back(group);
+  }
+
+  {
+    lumberjill::cGroupStats group;
+    group.mountStats.sMountPoint = "/data1";
+    group.mountStats.nFreeBytes = 100 * size_t(1000000000); // 100 GB
+    group.mountStats.nTotalBytes = 4000 * size_t(1000000000); // 4 TB
+
+    lumberjill::cDriveStats driveStats;
+    driveStats.sName = "BTRFS ata-ST4000VN008-2DR166_ZGY9A4L9";
+    driveStats.bIsPresent = true;
+    driveStats.smartCtlStats.nRaw_Read_Error_Rate = 12;
+    driveStats.smartCtlStats.nSeek_Error_Rate = 34;
+    driveStats.smartCtlStats.nOffline_Uncorrectable = 56;
+    group.mountStats.mapDrivePathToDriveStats["/dev/sdc"] = driveStats;
+
+    group.bHasBtrfsStats = true;
+    lumberjill::cBtrfsDriveStats btrfsDriveStats;
+    btrfsDriveStats.sName = driveStats.sName;
+    btrfsDriveStats.nWrite_io_errs = 1;
+    btrfsDriveStats.nRead_io_errs = 2;
+    btrfsDriveStats.nFlush_io_errs = 3;
+    btrfsDriveStats.nCorruption_errs = 4;
+    btrfsDriveStats.nGeneration_errs = 5;
+    group.btrfsVolumeStats.mapDrivePathToBtrfsDriveStats["/dev/sdc"] = btrfsDriveStats;
+
+    snapshot.groups.push_back(group);
+  }
+
+  return snapshot;
+}
+
+std::string GetTestSocketPath()
+{
+  return "/tmp/lumber-jill-unittest-" + std::to_string(getpid()) + "/query.sock";
+}
+
+}
+
+TEST(QueryServer, TestParseQueryRequest)
+{
+  lumberjill::cQueryRequest request;
+
+  EXPECT_TRUE(lumberjill::ParseQueryRequest("json snapshot\n", request));
+  EXPECT_EQ(lumberjill::QUERY_FORMAT::JSON, request.format);
+  EXPECT_TRUE(request.sDevicePath.empty());
+
+  EXPECT_TRUE(lumberjill::ParseQueryRequest("openmetrics device /dev/disk/by-id/ata-ST6000VN001-2BB186_ZR10KNTX\r\n", request));
+  EXPECT_EQ(lumberjill::QUERY_FORMAT::OPENMETRICS, request.format);
+  EXPECT_STREQ("/dev/disk/by-id/ata-ST6000VN001-2BB186_ZR10KNTX", request.sDevicePath.c_str());
+
+  // Round trip
+  lumberjill::cQueryRequest parsed;
+  EXPECT_TRUE(lumberjill::ParseQueryRequest(lumberjill::GetQueryRequestLine(request), parsed));
+  EXPECT_EQ(request.format, parsed.format);
+  EXPECT_EQ(request.sDevicePath, parsed.sDevicePath);
+
+  EXPECT_FALSE(lumberjill::ParseQueryRequest("", request));
+  EXPECT_FALSE(lumberjill::ParseQueryRequest("json\n", request));
+  EXPECT_FALSE(lumberjill::ParseQueryRequest("xml snapshot\n", request));
+  EXPECT_FALSE(lumberjill::ParseQueryRequest("json device \n", request));
+  EXPECT_FALSE(lumberjill::ParseQueryRequest("json everything\n", request));
+}
+
+TEST(QueryServer, TestSnapshotFormats)
+{
+  lumberjill::cSnapshotStore store;
+  EXPECT_EQ(nullptr, store.GetLatest());
+
+  store.Publish(CreateSnapshot());
+  const std::shared_ptr<const lumberjill::cPublishedSnapshot> published = store.GetLatest();
+  ASSERT_NE(nullptr, published);
+  EXPECT_EQ(1, published->snapshot.nSequence);
+
+  EXPECT_STREQ("{ \"sequence\": 1, \"timestamp\": 1700000000, \"mounts\": [ { \"mountPoint\": \"\\/\", \"freeSpaceGB\": 567, \"totalSpaceGB\": 1234, \"drives\": [ { \"name\": \"OS\", \"path\": \"\\/dev\\/sda\", \"present\": true, \"smartRaw_Read_Error_Rate\": 0, \"smartSeek_Error_Rate\": 0, \"smartOffline_Uncorrectable\": 0 } ] }, { \"mountPoint\": \"\\/data1\", \"freeSpaceGB\": 100, \"totalSpaceGB\": 4000, \"drives\": [ { \"name\": \"BTRFS ata-ST4000VN008-2DR166_ZGY9A4L9\", \"path\": \"\\/dev\\/sdc\", \"present\": true, \"smartRaw_Read_Error_Rate\": 12, \"smartSeek_Error_Rate\": 34, \"smartOffline_Uncorrectable\": 56 } ], \"btrfsDrives\": [ { \"name\": \"BTRFS ata-ST4000VN008-2DR166_ZGY9A4L9\", \"path\": \"\\/dev\\/sdc\", \"write_io_errs\": 1, \"read_io_errs\": 2, \"flush_io_errs\": 3, \"corruption_errs\": 4, \"generation_errs\": 5 } ] } ] }", published->sJSON.c_str());
+
+  // Counters get the _total suffix, and the whole thing ends with the EOF marker
+  const std::string& sOpenMetrics = published->sOpenMetrics;
+  EXPECT_TRUE(sOpenMetrics.starts_with("# TYPE lumberjill_snapshot_timestamp_seconds gauge\n"));
+  EXPECT_NE(std::string::npos, sOpenMetrics.find("\nlumberjill_mount_free_bytes{mount_point=\"/data1\"} 100000000000\n"));
+  EXPECT_NE(std::string::npos, sOpenMetrics.find("\n# TYPE lumberjill_btrfs_write_io_errors counter\n"));
+  EXPECT_NE(std::string::npos, sOpenMetrics.find("\nlumberjill_btrfs_write_io_errors_total{mount_point=\"/data1\",path=\"/dev/sdc\",name=\"BTRFS ata-ST4000VN008-2DR166_ZGY9A4L9\"} 1\n"));
+  EXPECT_TRUE(sOpenMetrics.ends_with("\n# EOF\n"));
+
+  // Just the one drive and its mount
+  EXPECT_STREQ("{ \"sequence\": 1, \"timestamp\": 1700000000, \"mountPoint\": \"\\/data1\", \"drive\": { \"name\": \"BTRFS ata-ST4000VN008-2DR166_ZGY9A4L9\", \"path\": \"\\/dev\\/sdc\", \"present\": true, \"smartRaw_Read_Error_Rate\": 12, \"smartSeek_Error_Rate\": 34, \"smartOffline_Uncorrectable\": 56 }, \"btrfs\": { \"name\": \"BTRFS ata-ST4000VN008-2DR166_ZGY9A4L9\", \"path\": \"\\/dev\\/sdc\", \"write_io_errs\": 1, \"read_io_errs\": 2, \"flush_io_errs\": 3, \"corruption_errs\": 4, \"generation_errs\": 5 } }", lumberjill::GetJSONStatsSnapshotDrive(published->snapshot, "/dev/sdc").c_str());
+  EXPECT_STREQ("# TYPE lumberjill_snapshot_timestamp_seconds gauge\n# HELP lumberjill_snapshot_timestamp_seconds When the collection finished\nlumberjill_snapshot_timestamp_seconds 1700000000\n# TYPE lumberjill_snapshot_sequence gauge\n# HELP lumberjill_snapshot_sequence Counts up with each collection\nlumberjill_snapshot_sequence 1\n# TYPE lumberjill_mount_responsive gauge\n# HELP lumberjill_mount_responsive 1 if the mount responded to statvfs in time\nlumberjill_mount_responsive{mount_point=\"/\"} 1\n# TYPE lumberjill_mount_free_bytes gauge\n# HELP lumberjill_mount_free_bytes Free space\nlumberjill_mount_free_bytes{mount_point=\"/\"} 567000000000\n# TYPE lumberjill_mount_size_bytes gauge\n# HELP lumberjill_mount_size_bytes Total space\nlumberjill_mount_size_bytes{mount_point=\"/\"} 1234000000000\n# TYPE lumberjill_drive_present gauge\n# HELP lumberjill_drive_present 1 if the drive is present\nlumberjill_drive_present{mount_point=\"/\",path=\"/dev/sda\",name=\"OS\"} 1\n# TYPE lumberjill_drive_smart_standby gauge\n# HELP lumberjill_drive_smart_standby 1 if the drive was in standby and the SMART values are from when it was last active\nlumberjill_drive_smart_standby{mount_point=\"/\",path=\"/dev/sda\",name=\"OS\"} 0\n# TYPE lumberjill_drive_smart_raw_read_error_rate gauge\n# HELP lumberjill_drive_smart_raw_read_error_rate SMART Raw_Read_Error_Rate raw value\nlumberjill_drive_smart_raw_read_error_rate{mount_point=\"/\",path=\"/dev/sda\",name=\"OS\"} 0\n# TYPE lumberjill_drive_smart_seek_error_rate gauge\n# HELP lumberjill_drive_smart_seek_error_rate SMART Seek_Error_Rate raw value\nlumberjill_drive_smart_seek_error_rate{mount_point=\"/\",path=\"/dev/sda\",name=\"OS\"} 0\n# TYPE lumberjill_drive_smart_offline_uncorrectable gauge\n# HELP lumberjill_drive_smart_offline_uncorrectable SMART Offline_Uncorrectable raw value\nlumberjill_drive_smart_offline_uncorrectable{mount_point=\"/\",path=\"/dev/sda\",name=\"OS\"} 0\n# TYPE lumberjill_drive_anomalies gauge\n# HELP lumberjill_drive_anomalies Number of metrics that are rising much faster than the drive's own history or its group\nlumberjill_drive_anomalies{mount_point=\"/\",path=\"/dev/sda\",name=\"OS\"} 0\n# EOF\n", lumberjill::GetOpenMetricsStatsSnapshot(published->snapshot, "/dev/sda").c_str());
+
+  EXPECT_TRUE(lumberjill::GetJSONStatsSnapshotDrive(published->snapshot, "/dev/sdz").empty());
+  EXPECT_TRUE(lumberjill::GetOpenMetricsStatsSnapshot(published->snapshot, "/dev/sdz").empty());
+
+  // Each publish gets the next sequence number, and readers holding the previous one still have it
+  store.Publish(CreateSnapshot());
+  EXPECT_EQ(2, store.GetLatest()->snapshot.nSequence);
+  EXPECT_EQ(1, published->snapshot.nSequence);
+}
+
+TEST(QueryServer, TestQueryServer)
+{
+  lumberjill::cSnapshotStore store;
+  lumberjill::cQueryServer server(store);
+
+  const std::string sSocketPath = GetTestSocketPath();
+  ASSERT_TRUE(server.Start(sSocketPath));
+  EXPECT_TRUE(server.IsRunning());
+
+  // Only root and our group can connect, and the private folder it was bound in has gone
+  struct stat s;
+  ASSERT_EQ(0, stat(sSocketPath.c_str(), &s));
+  EXPECT_TRUE(S_ISSOCK(s.st_mode));
+  EXPECT_EQ(0660, s.st_mode & 0777);
+
+  size_t nFiles = 0;
+  for (auto& entry : std::filesystem::directory_iterator(sSocketPath.substr(0, sSocketPath.find_last_of('/')))) {
+    EXPECT_EQ(sSocketPath, entry.path().string());
+    nFiles++;
+  }
+  EXPECT_EQ(1, nFiles);
+
+  lumberjill::cQueryRequest request;
+  std::string sResponse;
+
+  // Nothing collected yet
+  EXPECT_FALSE(lumberjill::QueryDaemon(sSocketPath, request, sResponse));
+
+  store.Publish(CreateSnapshot());
+  const std::shared_ptr<const lumberjill::cPublishedSnapshot> published = store.GetLatest();
+
+  EXPECT_TRUE(lumberjill::QueryDaemon(sSocketPath, request, sResponse));
+  EXPECT_EQ(published->sJSON, sResponse);
+
+  request.format = lumberjill::QUERY_FORMAT::OPENMETRICS;
+  EXPECT_TRUE(lumberjill::QueryDaemon(sSocketPath, request, sResponse));
+  EXPECT_EQ(published->sOpenMetrics, sResponse);
+
+  request.sDevicePath = "/dev/sdc";
+  EXPECT_TRUE(lumberjill::QueryDaemon(sSocketPath, request, sResponse));
+  EXPECT_EQ(lumberjill::GetOpenMetricsStatsSnapshot(published->snapshot, "/dev/sdc"), sResponse);
+
+  request.format = lumberjill::QUERY_FORMAT::JSON;
+  EXPECT_TRUE(lumberjill::QueryDaemon(sSocketPath, request, sResponse));
+  EXPECT_EQ(lumberjill::GetJSONStatsSnapshotDrive(published->snapshot, "/dev/sdc"), sResponse);
+
+  request.sDevicePath = "/dev/sdz";
+  EXPECT_FALSE(lumberjill::QueryDaemon(sSocketPath, request, sResponse));
+
+  server.Stop();
+  EXPECT_FALSE(server.IsRunning());
+  EXPECT_NE(0, access(sSocketPath.c_str(), F_OK));
+
+  rmdir(sSocketPath.substr(0, sSocketPath.find_last_of('/')).c_str());
+}
+
+TEST(QueryServer, TestQueryServerConcurrentClients)
+{
+  lumberjill::cSnapshotStore store;
+  lumberjill::cQueryServer server(store);
+
+  const std::string sSocketPath = GetTestSocketPath();
+  ASSERT_TRUE(server.Start(sSocketPath));
+
+  store.Publish(CreateSnapshot());
+
+  // Clients query while new snapshots are published, every response has to be a complete snapshot
+  const size_t nClients = 8;
+  const size_t nRequestsPerClient = 50;
+  std::atomic<size_t> nSuccesses(0);
+
+  std::vector<std::thread> clients;
+  for (size_t i = 0; i < nClients; i++) {
+    clients.push_back(std::thread([&sSocketPath, &nSuccesses]() {
+      lumberjill::cQueryRequest request;
+      request.format = lumberjill::QUERY_FORMAT::OPENMETRICS;
+      for (size_t r = 0; r < nRequestsPerClient; r++) {
+        std::string sResponse;
+        if (lumberjill::QueryDaemon(sSocketPath, request, sResponse) && sResponse.starts_with("# TYPE lumberjill_snapshot_timestamp_seconds") && sResponse.ends_with("# EOF\n")) {
+          nSuccesses++;
+        }
+      }
+    }));
+  }
+
+  for (size_t i = 0; i < 20; i++) {
+    store.Publish(CreateSnapshot());
+  }
+
+  for (auto& client : clients) {
+    client.join();
+  }
+
+  EXPECT_EQ(nClients * nRequestsPerClient, nSuccesses.load());
+
+  server.Stop();
+
+  rmdir(sSocketPath.substr(0, sSocketPath.find_last_of('/')).c_str());
+}
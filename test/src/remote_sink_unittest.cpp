@@ -0,0 +1,337 @@
+#include <cstring>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "output.h"
+#include "remote_sink.h"
+
+#include "temporary_folder.h"
+
+namespace {
+
+// A collector on the loopback interface, TCP or UDP, on a free port or a given one
+class cLoopbackCollector {
+public:
+  cLoopbackCollector(int type, uint16_t port) :
+    listen_fd(socket(AF_INET, type | SOCK_CLOEXEC, 0)),
+    connection_fd(-1)
+  {
+    const int nReuse = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &nReuse, sizeof(nReuse));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    bIsOpen = (bind(listen_fd, reinterpret_cast<const struct sockaddr*>(&address), sizeof(address)) == 0) && ((type != SOCK_STREAM) || (listen(listen_fd, 4) == 0));
+  }
+
+  ~cLoopbackCollector()
+  {
+    if (connection_fd >= 0) close(connection_fd);
+    close(listen_fd);
+  }
+
+  bool IsOpen() const { return bIsOpen; }
+
+  uint16_t GetPort() const
+  {
+    struct sockaddr_in address;
+    socklen_t length = sizeof(address);
+    getsockname(listen_fd, reinterpret_cast<struct sockaddr*>(&address), &length);
+    return ntohs(address.sin_port);
+  }
+
+  // Read octet counted frames from the TCP connection until there are nFrames or it times out
+  std::vector<std::string> ReadFrames(size_t nFrames)
+  {
+    std::vector<std::string> frames;
+    if ((connection_fd < 0) && WaitUntilReadable(listen_fd)) {
+      connection_fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    }
+
+    while ((connection_fd >= 0) && (frames.size() < nFrames)) {
+      // Take any whole frames out of what has arrived so far
+      const size_t space = buffer.find(' ');
+      if (space != std::string::npos) {
+        const size_t nLength = std::stoul(buffer.substr(0, space));
+        if (buffer.length() >= (space + 1 + nLength)) {
+          frames.push_back(buffer.substr(space + 1, nLength));
+          buffer.erase(0, space + 1 + nLength);
+          continue;
+        }
+      }
+
+      if (!WaitUntilReadable(connection_fd)) break;
+
+      char data[4096];
+      const ssize_t len = read(connection_fd, data, sizeof(data));
+      if (len <= 0) break;
+      buffer.append(data, size_t(len));
+    }
+
+    return frames;
+  }
+
+  std::vector<std::string> ReadDatagrams(size_t nDatagrams)
+  {
+    std::vector<std::string> datagrams;
+    while ((datagrams.size() < nDatagrams) && WaitUntilReadable(listen_fd)) {
+      char data[65536];
+      const ssize_t len = recv(listen_fd, data, sizeof(data), 0);
+      if (len < 0) break;
+      datagrams.push_back(std::string(data, size_t(len)));
+    }
+
+    return datagrams;
+  }
+
+  // Drop the connection, like a collector restarting
+  void CloseConnection()
+  {
+    if (connection_fd >= 0) {
+      close(connection_fd);
+      connection_fd = -1;
+    }
+  }
+
+private:
+  static bool WaitUntilReadable(int fd)
+  {
+    struct pollfd p;
+    p.fd = fd;
+    p.events = POLLIN;
+    p.revents = 0;
+    return (poll(&p, 1, 2000) == 1);
+  }
+
+  const int listen_fd;
+  int connection_fd;
+  bool bIsOpen;
+  std::string buffer;
+};
+
+lumberjill::cRemoteSettings CreateRemoteSettings(lumberjill::REMOTE_PROTOCOL protocol, uint16_t port, const std::string& sSpoolFilePath)
+{
+  lumberjill::cRemoteSettings settings;
+  settings.bEnabled = true;
+  settings.sHost = "127.0.0.1";
+  settings.nPort = port;
+  settings.protocol = protocol;
+  settings.sSpoolFilePath = sSpoolFilePath;
+  settings.nSpoolSizeBytes = 4096;
+  settings.nReconnectMinMS = 1;
+  settings.nReconnectMaxMS = 10;
+  return settings;
+}
+
+}
+
+TEST(RemoteSink, TestFormatRFC5424Message)
+{
+  const std::chrono::system_clock::time_point time = std::chrono::system_clock::from_time_t(1700000000) + std::chrono::microseconds(123456);
+
+  EXPECT_STREQ("<134>1 2023-11-14T22:13:20.123456Z nas1 lumber-jill 42 - - Mount /data1 drive stats json @cee: { }", lumberjill::FormatRFC5424Message(134, time, "nas1", "lumber-jill", 42, "Mount /data1 drive stats json @cee: { }").c_str());
+
+  // Unknown fields are a dash
+  EXPECT_STREQ("<12>1 2023-11-14T22:13:20.123456Z - lumber-jill 42 - - Hi", lumberjill::FormatRFC5424Message(12, time, "", "lumber-jill", 42, "Hi").c_str());
+
+  EXPECT_STREQ("5 Hello", lumberjill::GetOctetCountedFrame("Hello").c_str());
+  EXPECT_STREQ("12 Two\nlines\tok", lumberjill::GetOctetCountedFrame("Two\nlines\tok").c_str());
+}
+
+TEST(RemoteSink, TestSpool)
+{
+  const cTemporaryFolder folder("remote");
+  const std::string sFilePath = folder.GetFilePath("remote.spool");
+
+  {
+    lumberjill::cRemoteSpool spool;
+    ASSERT_TRUE(spool.Open(sFilePath, 64));
+    EXPECT_EQ(0, spool.GetMessageCount());
+
+    EXPECT_EQ(0, spool.Push({ "first", "second" }));
+    spool.Pop(1);
+    EXPECT_EQ(0, spool.Push({ "third" }));
+    EXPECT_EQ(2, spool.GetMessageCount());
+    EXPECT_EQ(4 + 6 + 4 + 5, spool.GetUsedBytes());
+  }
+
+  // A later run picks up where this one left off
+  {
+    lumberjill::cRemoteSpool spool;
+    ASSERT_TRUE(spool.Open(sFilePath, 64));
+    EXPECT_EQ(2, spool.GetMessageCount());
+
+    std::vector<std::string> messages;
+    ASSERT_TRUE(spool.Peek(10, messages));
+    ASSERT_EQ(2, messages.size());
+    EXPECT_STREQ("second", messages[0].c_str());
+    EXPECT_STREQ("third", messages[1].c_str());
+
+    // Fill it up so that it wraps around the end and the oldest are dropped
+    EXPECT_EQ(2, spool.Push({ "0123456789abcdef", "0123456789ABCDEF", "fedcba9876543210" }));
+    ASSERT_TRUE(spool.Peek(10, messages));
+    ASSERT_EQ(3, messages.size());
+    EXPECT_STREQ("0123456789abcdef", messages[0].c_str());
+    EXPECT_STREQ("fedcba9876543210", messages[2].c_str());
+
+    // Too big to ever fit
+    EXPECT_EQ(1, spool.Push({ std::string(100, 'x') }));
+    EXPECT_EQ(3, spool.GetMessageCount());
+
+    spool.Pop(3);
+    EXPECT_EQ(0, spool.GetMessageCount());
+    EXPECT_EQ(0, spool.GetUsedBytes());
+  }
+
+  // A different size starts again
+  {
+    lumberjill::cRemoteSpool spool;
+    ASSERT_TRUE(spool.Open(sFilePath, 64));
+    EXPECT_EQ(0, spool.Push({ "kept" }));
+  }
+  {
+    lumberjill::cRemoteSpool spool;
+    ASSERT_TRUE(spool.Open(sFilePath, 128));
+    EXPECT_EQ(0, spool.GetMessageCount());
+  }
+}
+
+TEST(RemoteSink, TestTCP)
+{
+  const cTemporaryFolder folder("remote");
+
+  cLoopbackCollector collector(SOCK_STREAM, 0);
+  ASSERT_TRUE(collector.IsOpen());
+
+  lumberjill::cRemoteSink sink;
+  ASSERT_TRUE(sink.Open(CreateRemoteSettings(lumberjill::REMOTE_PROTOCOL::TCP, collector.GetPort(), folder.GetFilePath("remote.spool"))));
+
+  EXPECT_TRUE(sink.Write({ "one", "two\nlines" }));
+  EXPECT_TRUE(sink.Write({ "three" }));
+
+  const std::vector<std::string> frames = collector.ReadFrames(3);
+  ASSERT_EQ(3, frames.size());
+  EXPECT_STREQ("one", frames[0].c_str());
+  EXPECT_STREQ("two\nlines", frames[1].c_str());
+  EXPECT_STREQ("three", frames[2].c_str());
+  EXPECT_FALSE(sink.HasSpooled());
+}
+
+TEST(RemoteSink, TestSpoolWhileUnreachable)
+{
+  const cTemporaryFolder folder("remote");
+
+  // Find a free port and leave nothing listening on it
+  uint16_t port = 0;
+  {
+    cLoopbackCollector collector(SOCK_STREAM, 0);
+    ASSERT_TRUE(collector.IsOpen());
+    port = collector.GetPort();
+  }
+
+  lumberjill::cRemoteSink sink;
+  ASSERT_TRUE(sink.Open(CreateRemoteSettings(lumberjill::REMOTE_PROTOCOL::TCP, port, folder.GetFilePath("remote.spool"))));
+
+  EXPECT_FALSE(sink.Write({ "1" }));
+  EXPECT_FALSE(sink.Write({ "2", "3" }));
+  EXPECT_EQ(3, sink.GetSpooledCount());
+
+  // The collector comes back, the spool is sent in order before anything new
+  cLoopbackCollector collector(SOCK_STREAM, port);
+  ASSERT_TRUE(collector.IsOpen());
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  sink.Retry();
+  EXPECT_FALSE(sink.HasSpooled());
+  EXPECT_TRUE(sink.Write({ "4" }));
+
+  std::vector<std::string> frames = collector.ReadFrames(4);
+  ASSERT_EQ(4, frames.size());
+  EXPECT_STREQ("1", frames[0].c_str());
+  EXPECT_STREQ("2", frames[1].c_str());
+  EXPECT_STREQ("3", frames[2].c_str());
+  EXPECT_STREQ("4", frames[3].c_str());
+
+  // The collector drops the connection, the sink notices and reconnects
+  collector.CloseConnection();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  sink.Write({ "5" });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_TRUE(sink.Write({ "6" }));
+
+  frames = collector.ReadFrames(2);
+  ASSERT_EQ(2, frames.size());
+  EXPECT_STREQ("5", frames[0].c_str());
+  EXPECT_STREQ("6", frames[1].c_str());
+}
+
+TEST(RemoteSink, TestUDP)
+{
+  cLoopbackCollector collector(SOCK_DGRAM, 0);
+  ASSERT_TRUE(collector.IsOpen());
+
+  // No spool
+  lumberjill::cRemoteSink sink;
+  ASSERT_TRUE(sink.Open(CreateRemoteSettings(lumberjill::REMOTE_PROTOCOL::UDP, collector.GetPort(), "")));
+
+  EXPECT_TRUE(sink.Write({ "one", "two" }));
+
+  // One message per datagram, no framing
+  const std::vector<std::string> datagrams = collector.ReadDatagrams(2);
+  ASSERT_EQ(2, datagrams.size());
+  EXPECT_STREQ("one", datagrams[0].c_str());
+  EXPECT_STREQ("two", datagrams[1].c_str());
+}
+
+TEST(RemoteSink, TestOutputPipeline)
+{
+  const cTemporaryFolder folder("remote");
+
+  cLoopbackCollector collector(SOCK_STREAM, 0);
+  ASSERT_TRUE(collector.IsOpen());
+
+  lumberjill::cOutputSettings settings;
+  settings.bStdout = false;
+  settings.bSyslog = false;
+  settings.remote = CreateRemoteSettings(lumberjill::REMOTE_PROTOCOL::TCP, collector.GetPort(), folder.GetFilePath("remote.spool"));
+
+  lumberjill::cOutputPipeline pipeline;
+  ASSERT_TRUE(pipeline.Start(settings));
+
+  lumberjill::cOutputRecord record;
+  record.nPriority = LOG_WARNING;
+  record.sMessage = "Drive /dev/sdc remove";
+  record.fnGetJSON = []() { return std::string("{ \"event\": \"remove\" }"); };
+  pipeline.Push(std::move(record));
+  pipeline.Flush();
+
+  const std::vector<std::string> frames = collector.ReadFrames(1);
+  ASSERT_EQ(1, frames.size());
+
+  // local1.warning, then the same line that goes to syslog
+  EXPECT_TRUE(frames[0].starts_with("<140>1 ")) << frames[0];
+  EXPECT_TRUE(frames[0].ends_with(" lumber-jill " + std::to_string(getpid()) + " - - Drive /dev/sdc remove json @cee: { \"event\": \"remove\" }")) << frames[0];
+
+  lumberjill::cOutputStats stats;
+  pipeline.GetStatsAndReset(stats);
+  ASSERT_EQ(1, stats.sinks.size());
+  EXPECT_STREQ("remote", stats.sinks[0].sName.c_str());
+  EXPECT_EQ(1, stats.sinks[0].nRecords);
+  EXPECT_EQ(0, stats.sinks[0].nErrors);
+  EXPECT_EQ(0, stats.sinks[0].nSpooled);
+}
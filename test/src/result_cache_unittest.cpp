@@ -0,0 +1,164 @@
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "result_cache.h"
+
+#include "temporary_folder.h"
+
+namespace {
+
+lumberjill::cSmartCtlStats CreateStats(size_t value)
+{
+  lumberjill::cSmartCtlStats smartctlStats;
+  smartctlStats.nRaw_Read_Error_Rate = value;
+  smartctlStats.nSeek_Error_Rate = value + 1;
+  smartctlStats.nOffline_Uncorrectable = value + 2;
+  return smartctlStats;
+}
+
+}
+
+TEST(ResultCache, TestSaveAndLoad)
+{
+  const cTemporaryFolder folder("cache");
+  const std::string sFilePath = folder.GetFilePath("smartctl.cache");
+
+  const int64_t nNow = 1700000000;
+
+  {
+    lumberjill::cResultCache cache;
+    EXPECT_FALSE(cache.Load(sFilePath));
+
+    cache.Set("/dev/sdc", nNow - 100, CreateStats(10));
+    cache.Set("/dev/sda", nNow - 5000, CreateStats(20));
+
+    // A drive in standby with the values from an hour before it was cached
+    lumberjill::cSmartCtlStats standbyStats = CreateStats(30);
+    standbyStats.bIsInStandby = true;
+    standbyStats.nSampleAgeSeconds = 3600;
+    standbyStats.nTemperature_Celsius = 35;
+    cache.Set("/dev/disk/by-id/ata-ST4000VN008-2DR166_ZGY9A4L9", nNow - 60, standbyStats);
+
+    EXPECT_TRUE(cache.Save(sFilePath));
+  }
+
+  lumberjill::cResultCache cache;
+  ASSERT_TRUE(cache.Load(sFilePath));
+  EXPECT_EQ(3, cache.GetEntryCount());
+
+  lumberjill::cSmartCtlStats smartctlStats;
+  EXPECT_TRUE(cache.Get("/dev/sdc", nNow, 300, smartctlStats));
+  EXPECT_FALSE(smartctlStats.bIsInStandby);
+  EXPECT_EQ(10, smartctlStats.nRaw_Read_Error_Rate);
+  EXPECT_EQ(11, smartctlStats.nSeek_Error_Rate);
+  EXPECT_EQ(12, smartctlStats.nOffline_Uncorrectable);
+  EXPECT_FALSE(smartctlStats.nTemperature_Celsius.has_value());
+
+  // Too old for this run
+  EXPECT_FALSE(cache.Get("/dev/sda", nNow, 300, smartctlStats));
+  EXPECT_TRUE(cache.Get("/dev/sda", nNow, 6000, smartctlStats));
+
+  // The standby values are now another minute older
+  EXPECT_TRUE(cache.Get("/dev/disk/by-id/ata-ST4000VN008-2DR166_ZGY9A4L9", nNow, 300, smartctlStats));
+  EXPECT_TRUE(smartctlStats.bIsInStandby);
+  EXPECT_EQ(3660, smartctlStats.nSampleAgeSeconds);
+  EXPECT_EQ(35, smartctlStats.nTemperature_Celsius);
+
+  EXPECT_FALSE(cache.Get("/dev/sdz", nNow, 300, smartctlStats));
+
+  // Entries from the future are not trusted
+  EXPECT_FALSE(cache.Get("/dev/sdc", nNow - 1000, 300, smartctlStats));
+}
+
+TEST(ResultCache, TestMerge)
+{
+  const cTemporaryFolder folder("cache");
+  const std::string sFilePath = folder.GetFilePath("smartctl.cache");
+
+  const int64_t nNow = 1700000000;
+
+  {
+    lumberjill::cResultCache cache;
+    cache.Set("/dev/sdb", nNow - 1000, CreateStats(1));
+    cache.Set("/dev/sdd", nNow - 1000, CreateStats(2));
+    EXPECT_TRUE(cache.Save(sFilePath));
+  }
+
+  // A later run collects a stale drive again and a new one, the rest are kept as they were
+  {
+    lumberjill::cResultCache cache;
+    ASSERT_TRUE(cache.Load(sFilePath));
+    cache.Set("/dev/sdd", nNow, CreateStats(3));
+    cache.Set("/dev/sdc", nNow, CreateStats(4));
+    EXPECT_EQ(3, cache.GetEntryCount());
+
+    lumberjill::cSmartCtlStats smartctlStats;
+    EXPECT_TRUE(cache.Get("/dev/sdd", nNow, 10, smartctlStats));
+    EXPECT_EQ(3, smartctlStats.nRaw_Read_Error_Rate);
+
+    EXPECT_TRUE(cache.Save(sFilePath));
+  }
+
+  lumberjill::cResultCache cache;
+  ASSERT_TRUE(cache.Load(sFilePath));
+  EXPECT_EQ(3, cache.GetEntryCount());
+
+  lumberjill::cSmartCtlStats smartctlStats;
+  EXPECT_TRUE(cache.Get("/dev/sdb", nNow, 1000, smartctlStats));
+  EXPECT_EQ(1, smartctlStats.nRaw_Read_Error_Rate);
+  EXPECT_TRUE(cache.Get("/dev/sdc", nNow, 10, smartctlStats));
+  EXPECT_EQ(4, smartctlStats.nRaw_Read_Error_Rate);
+  EXPECT_TRUE(cache.Get("/dev/sdd", nNow, 10, smartctlStats));
+  EXPECT_EQ(3, smartctlStats.nRaw_Read_Error_Rate);
+
+  // No temporary files left behind
+  size_t nFiles = 0;
+  for (auto& entry : std::filesystem::directory_iterator(std::filesystem::path(sFilePath).parent_path())) {
+    (void)entry;
+    nFiles++;
+  }
+  EXPECT_EQ(1, nFiles);
+}
+
+TEST(ResultCache, TestInvalidFile)
+{
+  const cTemporaryFolder folder("cache");
+  const std::string sFilePath = folder.GetFilePath("smartctl.cache");
+
+  {
+    std::ofstream file(sFilePath);
+    file<<"{ \"not\": \"a cache file\" }";
+  }
+
+  lumberjill::cResultCache cache;
+  EXPECT_FALSE(cache.Load(sFilePath));
+  EXPECT_EQ(0, cache.GetEntryCount());
+
+  // It gets replaced with a valid one
+  cache.Set("/dev/sdc", 1700000000, CreateStats(1));
+  EXPECT_TRUE(cache.Save(sFilePath));
+  EXPECT_TRUE(cache.Load(sFilePath));
+
+  // Truncated
+  std::filesystem::resize_file(sFilePath, std::filesystem::file_size(sFilePath) - 1);
+  EXPECT_FALSE(cache.Load(sFilePath));
+}
+
+TEST(ResultCache, TestLock)
+{
+  const cTemporaryFolder folder("cache");
+  const std::string sFilePath = folder.GetFilePath("smartctl.lock");
+
+  lumberjill::cResultCacheLock first;
+  EXPECT_TRUE(first.Lock(sFilePath, std::chrono::milliseconds(0)));
+
+  // Another run has to wait, and gives up after the timeout
+  lumberjill::cResultCacheLock second;
+  EXPECT_FALSE(second.Lock(sFilePath, std::chrono::milliseconds(200)));
+
+  first.Unlock();
+  EXPECT_TRUE(second.Lock(sFilePath, std::chrono::milliseconds(200)));
+}
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <cmath>
+#include <chrono>
 
 #include <gtest/gtest.h>
 
@@ -21,3 +22,15 @@ TEST(RunCommand, TestRunCommand)
   EXPECT_STREQ("a b\n", out_standard.c_str());
   EXPECT_STREQ("", out_error.c_str());
 }
+
+TEST(RunCommand, TestRunCommandDetached)
+{
+  EXPECT_FALSE(lumberjill::RunCommandDetached("true", std::vector<std::string> {}));
+  EXPECT_TRUE(lumberjill::RunCommandDetached("/usr/bin/true", std::vector<std::string> {}));
+  EXPECT_FALSE(lumberjill::RunCommandDetached("/usr/bin/false", std::vector<std::string> {}));
+
+  // Like "btrfs scrub start" the command exits straight away but leaves a process running that still has its stdout and stderr
+  const auto start = std::chrono::steady_clock::now();
+  EXPECT_TRUE(lumberjill::RunCommandDetached("/bin/sh", std::vector<std::string> { "-c", "sleep 3 & exit 0" }));
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+}
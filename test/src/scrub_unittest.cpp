@@ -0,0 +1,189 @@
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "scrub.h"
+#include "utils.h"
+
+namespace {
+
+const int64_t SECONDS_PER_DAY = 24 * 60 * 60;
+const uint64_t GB = 1000000000;
+
+const std::string FSID = "1b2e3f4a-5c6d-4e7f-8091-a2b3c4d5e6f7";
+
+lumberjill::cScrubSettings CreateSettings()
+{
+  lumberjill::cScrubSettings settings;
+  settings.bEnabled = true;
+  settings.nIntervalDays = 30;
+  settings.nMaxAwaitMS = 50;
+  settings.nPauseMinutes = 15;
+
+  // 01:00 to 06:00
+  lumberjill::cScrubWindow window;
+  window.nStartMinute = 60;
+  window.nEndMinute = 6 * 60;
+  settings.windows.push_back(window);
+
+  return settings;
+}
+
+}
+
+TEST(Scrub, TestParseScrubStatusFile)
+{
+  const size_t nMaxFileSizeBytes = 10 * 1024;
+  std::string contents;
+  ASSERT_TRUE(lumberjill::ReadFileIntoString("test/data/btrfs_scrub_status.txt", nMaxFileSizeBytes, contents));
+
+  // Device 1 was cancelled part way through, device 2 finished
+  lumberjill::cScrubStatusFile status;
+  EXPECT_TRUE(lumberjill::ParseScrubStatusFile(contents, FSID, status));
+  EXPECT_TRUE(status.bFound);
+  EXPECT_EQ(1760918400, status.nStartTimestamp);
+  EXPECT_FALSE(status.bIsFinished);
+  EXPECT_TRUE(status.bIsCanceled);
+
+  // A different volume
+  EXPECT_TRUE(lumberjill::ParseScrubStatusFile(contents, "00000000-0000-0000-0000-000000000000", status));
+  EXPECT_FALSE(status.bFound);
+  EXPECT_FALSE(status.bIsCanceled);
+
+  // Every device finished
+  const std::string sFinished = "scrub status:1\n" + FSID + ":1|t_start:100|canceled:0|finished:1\n" + FSID + ":2|t_start:100|canceled:0|finished:1\n";
+  EXPECT_TRUE(lumberjill::ParseScrubStatusFile(sFinished, FSID, status));
+  EXPECT_TRUE(status.bFound);
+  EXPECT_EQ(100, status.nStartTimestamp);
+  EXPECT_TRUE(status.bIsFinished);
+  EXPECT_FALSE(status.bIsCanceled);
+
+  EXPECT_FALSE(lumberjill::ParseScrubStatusFile("not a status file\n", FSID, status));
+}
+
+TEST(Scrub, TestIsInScrubWindow)
+{
+  std::vector<lumberjill::cScrubWindow> windows;
+
+  // No windows means any time
+  EXPECT_TRUE(lumberjill::IsInScrubWindow(windows, 0));
+  EXPECT_TRUE(lumberjill::IsInScrubWindow(windows, 12 * 60));
+
+  // 22:30 to 06:00 spans midnight
+  lumberjill::cScrubWindow window;
+  window.nStartMinute = (22 * 60) + 30;
+  window.nEndMinute = 6 * 60;
+  windows.push_back(window);
+
+  EXPECT_TRUE(lumberjill::IsInScrubWindow(windows, (22 * 60) + 30));
+  EXPECT_TRUE(lumberjill::IsInScrubWindow(windows, (23 * 60) + 59));
+  EXPECT_TRUE(lumberjill::IsInScrubWindow(windows, 0));
+  EXPECT_TRUE(lumberjill::IsInScrubWindow(windows, (5 * 60) + 59));
+  EXPECT_FALSE(lumberjill::IsInScrubWindow(windows, 6 * 60));
+  EXPECT_FALSE(lumberjill::IsInScrubWindow(windows, 12 * 60));
+
+  // 12:00 to 13:00
+  window.nStartMinute = 12 * 60;
+  window.nEndMinute = 13 * 60;
+  windows.push_back(window);
+
+  EXPECT_TRUE(lumberjill::IsInScrubWindow(windows, 12 * 60));
+  EXPECT_FALSE(lumberjill::IsInScrubWindow(windows, 13 * 60));
+}
+
+TEST(Scrub, TestUpdateScrubThroughput)
+{
+  lumberjill::cScrubDeviceProgress previous;
+  previous.nBytesToScrub = 1000 * GB;
+  previous.nBytesScrubbed = 100 * GB;
+  previous.nCsumErrors = 1;
+
+  lumberjill::cScrubDeviceProgress progress;
+  progress.nBytesToScrub = 1000 * GB;
+  progress.nBytesScrubbed = 106 * GB;
+  progress.nCsumErrors = 3;
+  progress.nReadErrors = 1;
+
+  // 6 GB in a minute
+  lumberjill::UpdateScrubThroughput(previous, 60 * 1000, progress);
+  ASSERT_TRUE(progress.dBytesPerSecond.has_value());
+  EXPECT_NEAR(0.1 * double(GB), progress.dBytesPerSecond.value(), 1.0);
+  ASSERT_TRUE(progress.dETASeconds.has_value());
+  EXPECT_NEAR(8940.0, progress.dETASeconds.value(), 0.001);
+  EXPECT_EQ(3, progress.nNewErrors);
+
+  // Resumed, the kernel's counters have started again
+  lumberjill::cScrubDeviceProgress resumed;
+  resumed.nBytesToScrub = 1000 * GB;
+  resumed.nBytesScrubbed = 2 * GB;
+  resumed.nCsumErrors = 1;
+  lumberjill::UpdateScrubThroughput(progress, 60 * 1000, resumed);
+  EXPECT_FALSE(resumed.dBytesPerSecond.has_value());
+  EXPECT_FALSE(resumed.dETASeconds.has_value());
+  EXPECT_EQ(1, resumed.nNewErrors);
+
+  // Nothing scrubbed since the last poll
+  lumberjill::cScrubDeviceProgress stalled = progress;
+  lumberjill::UpdateScrubThroughput(progress, 60 * 1000, stalled);
+  EXPECT_DOUBLE_EQ(0.0, stalled.dBytesPerSecond.value());
+  EXPECT_FALSE(stalled.dETASeconds.has_value());
+  EXPECT_EQ(0, stalled.nNewErrors);
+}
+
+TEST(Scrub, TestDecideScrubAction)
+{
+  const lumberjill::cScrubSettings settings = CreateSettings();
+  const int64_t nNow = 1760918400;
+  const size_t nInWindow = 2 * 60;
+  const size_t nOutsideWindow = 12 * 60;
+
+  lumberjill::cScrubGroupState state;
+  std::string sReason;
+
+  // Never scrubbed
+  lumberjill::cScrubStatusFile status;
+  EXPECT_EQ(lumberjill::SCRUB_ACTION::START, lumberjill::DecideScrubAction(settings, nNow, nInWindow, state, false, status, 5.0, sReason));
+  EXPECT_EQ(lumberjill::SCRUB_ACTION::NONE, lumberjill::DecideScrubAction(settings, nNow, nOutsideWindow, state, false, status, 5.0, sReason));
+
+  // Too busy to start
+  EXPECT_EQ(lumberjill::SCRUB_ACTION::NONE, lumberjill::DecideScrubAction(settings, nNow, nInWindow, state, false, status, 80.0, sReason));
+
+  // Scrubbed recently, and then long enough ago
+  status.bFound = true;
+  status.bIsFinished = true;
+  status.nStartTimestamp = nNow - (10 * SECONDS_PER_DAY);
+  EXPECT_EQ(lumberjill::SCRUB_ACTION::NONE, lumberjill::DecideScrubAction(settings, nNow, nInWindow, state, false, status, 5.0, sReason));
+  status.nStartTimestamp = nNow - (30 * SECONDS_PER_DAY);
+  EXPECT_EQ(lumberjill::SCRUB_ACTION::START, lumberjill::DecideScrubAction(settings, nNow, nInWindow, state, false, status, 5.0, sReason));
+
+  // Our scrub is paused when the drives get busy or the window closes
+  state.bIsOurs = true;
+  EXPECT_EQ(lumberjill::SCRUB_ACTION::NONE, lumberjill::DecideScrubAction(settings, nNow, nInWindow, state, true, status, 5.0, sReason));
+  EXPECT_EQ(lumberjill::SCRUB_ACTION::PAUSE, lumberjill::DecideScrubAction(settings, nNow, nInWindow, state, true, status, 80.0, sReason));
+  EXPECT_STREQ("latency", sReason.c_str());
+  EXPECT_EQ(lumberjill::SCRUB_ACTION::PAUSE, lumberjill::DecideScrubAction(settings, nNow, nOutsideWindow, state, true, status, 5.0, sReason));
+  EXPECT_STREQ("outside window", sReason.c_str());
+
+  // A scrub started by hand is left alone
+  state.bIsOurs = false;
+  EXPECT_EQ(lumberjill::SCRUB_ACTION::NONE, lumberjill::DecideScrubAction(settings, nNow, nOutsideWindow, state, true, status, 80.0, sReason));
+
+  // Cancelled by hand, it isn't resumed and a new one isn't due yet
+  status.bIsFinished = false;
+  status.bIsCanceled = true;
+  status.nStartTimestamp = nNow - SECONDS_PER_DAY;
+  EXPECT_EQ(lumberjill::SCRUB_ACTION::NONE, lumberjill::DecideScrubAction(settings, nNow, nInWindow, state, false, status, 5.0, sReason));
+
+  // Paused by us, it is resumed once the pause is over
+  state.bIsOurs = true;
+  state.nPausedTimestamp = nNow - (10 * 60);
+  EXPECT_EQ(lumberjill::SCRUB_ACTION::NONE, lumberjill::DecideScrubAction(settings, nNow, nInWindow, state, false, status, 5.0, sReason));
+  state.nPausedTimestamp = nNow - (15 * 60);
+  EXPECT_EQ(lumberjill::SCRUB_ACTION::RESUME, lumberjill::DecideScrubAction(settings, nNow, nInWindow, state, false, status, 5.0, sReason));
+
+  // Without a latency limit it doesn't matter how busy the drives are
+  lumberjill::cScrubSettings noLatencySettings = settings;
+  noLatencySettings.nMaxAwaitMS = 0;
+  EXPECT_EQ(lumberjill::SCRUB_ACTION::RESUME, lumberjill::DecideScrubAction(noLatencySettings, nNow, nInWindow, state, false, status, 500.0, sReason));
+}
@@ -0,0 +1,274 @@
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "self_test.h"
+#include "smartctl.h"
+#include "utils.h"
+
+#include "temporary_folder.h"
+
+namespace {
+
+const int64_t SECONDS_PER_DAY = 24 * 60 * 60;
+const int64_t NOW = 1700000000;
+
+lumberjill::cSelfTestSettings CreateSettings()
+{
+  lumberjill::cSelfTestSettings settings;
+  settings.bEnabled = true;
+  settings.nShortIntervalDays = 7;
+  settings.nLongIntervalDays = 30;
+  settings.nMaxPerGroup = 1;
+  settings.nMaxPerController = 1;
+  return settings;
+}
+
+lumberjill::cSelfTestRequest CreateRequest(const std::string& sDevicePath, size_t nGroup, const std::string& sController)
+{
+  lumberjill::cSelfTestRequest request;
+  request.sDevicePath = sDevicePath;
+  request.nGroup = nGroup;
+  request.sController = sController;
+  return request;
+}
+
+// Pretends to be the drives, tests run until they are told to finish
+class cFakeDrives {
+public:
+  cFakeDrives();
+  ~cFakeDrives();
+
+  lumberjill::cSelfTestScheduler::StartFunction GetStartFunction()
+  {
+    return [this](const std::string& sDevicePath, lumberjill::SELF_TEST_TYPE type) {
+      started.push_back(sDevicePath);
+      types[sDevicePath] = type;
+      mapDevicePathToStatus[sDevicePath].bIsInProgress = true;
+      mapDevicePathToStatus[sDevicePath].nRemainingPercent = 90;
+      return true;
+    };
+  }
+
+  lumberjill::cSelfTestScheduler::PollFunction GetPollFunction()
+  {
+    return [this](const std::string& sDevicePath, lumberjill::cSmartSelfTestStatus& status) {
+      polled.push_back(sDevicePath);
+      status = mapDevicePathToStatus[sDevicePath];
+      return true;
+    };
+  }
+
+  void Finish(const std::string& sDevicePath, const std::string& sStatus)
+  {
+    lumberjill::cSmartSelfTestStatus& status = mapDevicePathToStatus[sDevicePath];
+    status.bIsInProgress = false;
+    status.nRemainingPercent.reset();
+    status.bHasLastEntry = true;
+    status.sLastStatus = sStatus;
+  }
+
+  std::vector<std::string> started;
+  std::vector<std::string> polled;
+  std::map<std::string, lumberjill::SELF_TEST_TYPE> types;
+  std::map<std::string, lumberjill::cSmartSelfTestStatus> mapDevicePathToStatus;
+};
+
+cFakeDrives::cFakeDrives()
+{
+}
+
+cFakeDrives::~cFakeDrives()
+{
+}
+
+}
+
+TEST(SelfTest, TestParseSelfTestStatusATA)
+{
+  const size_t nMaxFileSizeBytes = 100000;
+
+  std::string sCommandOutput;
+  ASSERT_TRUE(lumberjill::ReadFileIntoString("test/data/smartctl_self_test_ata.txt", nMaxFileSizeBytes, sCommandOutput));
+
+  lumberjill::cSmartSelfTestStatus status;
+  EXPECT_TRUE(lumberjill::smartctl::ParseDriveSelfTestStatus(sCommandOutput, status));
+
+  EXPECT_TRUE(status.bIsInProgress);
+  EXPECT_EQ(90, status.nRemainingPercent.value());
+
+  // Only the newest entry
+  EXPECT_TRUE(status.bHasLastEntry);
+  EXPECT_STREQ("Extended offline", status.sLastDescription.c_str());
+  EXPECT_STREQ("Completed: read failure", status.sLastStatus.c_str());
+  EXPECT_EQ(35210, status.nLastPowerOnHours.value());
+  EXPECT_EQ(1953521664, status.nLastFirstErrorLBA.value());
+
+  EXPECT_FALSE(lumberjill::smartctl::ParseDriveSelfTestStatus("", status));
+}
+
+TEST(SelfTest, TestParseSelfTestStatusNVMe)
+{
+  const size_t nMaxFileSizeBytes = 100000;
+
+  std::string sCommandOutput;
+  ASSERT_TRUE(lumberjill::ReadFileIntoString("test/data/smartctl_self_test_nvme.txt", nMaxFileSizeBytes, sCommandOutput));
+
+  lumberjill::cSmartSelfTestStatus status;
+  EXPECT_TRUE(lumberjill::smartctl::ParseDriveSelfTestStatus(sCommandOutput, status));
+
+  EXPECT_TRUE(status.bIsInProgress);
+  EXPECT_EQ(72, status.nRemainingPercent.value());
+
+  EXPECT_TRUE(status.bHasLastEntry);
+  EXPECT_STREQ("Short", status.sLastDescription.c_str());
+  EXPECT_STREQ("Completed without error", status.sLastStatus.c_str());
+  EXPECT_EQ(4127, status.nLastPowerOnHours.value());
+  EXPECT_FALSE(status.nLastFirstErrorLBA.has_value());
+}
+
+TEST(SelfTest, TestGetSelfTestResult)
+{
+  EXPECT_EQ(lumberjill::SELF_TEST_RESULT::PASSED, lumberjill::GetSelfTestResult("Completed without error"));
+  EXPECT_EQ(lumberjill::SELF_TEST_RESULT::FAILED, lumberjill::GetSelfTestResult("Completed: read failure"));
+  EXPECT_EQ(lumberjill::SELF_TEST_RESULT::ABORTED, lumberjill::GetSelfTestResult("Aborted by host"));
+  EXPECT_EQ(lumberjill::SELF_TEST_RESULT::ABORTED, lumberjill::GetSelfTestResult("Interrupted (host reset)"));
+  EXPECT_EQ(lumberjill::SELF_TEST_RESULT::ABORTED, lumberjill::GetSelfTestResult("Aborted: Controller Reset"));
+}
+
+TEST(SelfTest, TestLimits)
+{
+  const lumberjill::cSelfTestSettings settings = CreateSettings();
+
+  // Two drives in each group, /dev/sdb and /dev/sdd share a controller, /dev/sdb is in both groups
+  std::vector<lumberjill::cSelfTestRequest> requests;
+  requests.push_back(CreateRequest("/dev/sdb", 0, "0000:00:17.0"));
+  requests.push_back(CreateRequest("/dev/sdc", 0, "0000:03:00.0"));
+  requests.push_back(CreateRequest("/dev/sdd", 1, "0000:00:17.0"));
+  requests.push_back(CreateRequest("/dev/sde", 1, ""));
+  requests.push_back(CreateRequest("/dev/sdb", 1, "0000:00:17.0"));
+
+  cFakeDrives drives;
+  lumberjill::cSelfTestScheduler scheduler;
+  std::map<std::string, lumberjill::cDriveSelfTestStats> results;
+  scheduler.Update(settings, NOW, requests, drives.GetStartFunction(), drives.GetPollFunction(), results);
+
+  // Every drive is due for a long test, one per group and /dev/sdd has to wait for the controller
+  ASSERT_EQ(2, drives.started.size());
+  EXPECT_STREQ("/dev/sdb", drives.started[0].c_str());
+  EXPECT_STREQ("/dev/sde", drives.started[1].c_str());
+  EXPECT_EQ(lumberjill::SELF_TEST_TYPE::LONG, drives.types["/dev/sdb"]);
+  EXPECT_EQ(2, results.size());
+  EXPECT_EQ(lumberjill::SELF_TEST_RESULT::RUNNING, results["/dev/sdb"].result);
+
+  // Nothing else starts while they run
+  scheduler.Update(settings, NOW + 600, requests, drives.GetStartFunction(), drives.GetPollFunction(), results);
+  EXPECT_EQ(2, drives.started.size());
+  EXPECT_EQ(2, drives.polled.size());
+  EXPECT_EQ(90, results["/dev/sdb"].nRemainingPercent.value());
+
+  // Once /dev/sdb finishes the rest of its group gets a turn, it is reported before anything new starts on it
+  drives.Finish("/dev/sdb", "Completed without error");
+  scheduler.Update(settings, NOW + 1200, requests, drives.GetStartFunction(), drives.GetPollFunction(), results);
+  ASSERT_EQ(3, drives.started.size());
+  EXPECT_STREQ("/dev/sdc", drives.started[2].c_str());
+  EXPECT_EQ(lumberjill::SELF_TEST_RESULT::PASSED, results["/dev/sdb"].result);
+  EXPECT_EQ(lumberjill::SELF_TEST_TYPE::LONG, results["/dev/sdb"].type);
+  EXPECT_EQ(lumberjill::SELF_TEST_RESULT::RUNNING, results["/dev/sdc"].result);
+
+  // A long test counts as a short test, so /dev/sdb isn't due again until next week
+  scheduler.Update(settings, NOW + 1800, requests, drives.GetStartFunction(), drives.GetPollFunction(), results);
+  EXPECT_EQ(3, drives.started.size());
+  EXPECT_TRUE(results.find("/dev/sdb") == results.end());
+}
+
+TEST(SelfTest, TestAbortedIsRetried)
+{
+  lumberjill::cSelfTestSettings settings = CreateSettings();
+  settings.nMaxPerGroup = 2;
+
+  std::vector<lumberjill::cSelfTestRequest> requests;
+  requests.push_back(CreateRequest("/dev/sdb", 0, ""));
+  requests.push_back(CreateRequest("/dev/sdc", 0, ""));
+  requests[1].bIsInStandby = true;
+
+  cFakeDrives drives;
+  lumberjill::cSelfTestScheduler scheduler;
+  std::map<std::string, lumberjill::cDriveSelfTestStats> results;
+  scheduler.Update(settings, NOW, requests, drives.GetStartFunction(), drives.GetPollFunction(), results);
+
+  // Drives in standby are left alone
+  ASSERT_EQ(1, drives.started.size());
+  EXPECT_STREQ("/dev/sdb", drives.started[0].c_str());
+
+  drives.Finish("/dev/sdb", "Aborted by host");
+  scheduler.Update(settings, NOW + 600, requests, drives.GetStartFunction(), drives.GetPollFunction(), results);
+  EXPECT_EQ(1, drives.started.size());
+  EXPECT_EQ(lumberjill::SELF_TEST_RESULT::ABORTED, results["/dev/sdb"].result);
+  EXPECT_STREQ("Aborted by host", results["/dev/sdb"].sStatus.c_str());
+
+  // The next collection starts it again
+  scheduler.Update(settings, NOW + 1200, requests, drives.GetStartFunction(), drives.GetPollFunction(), results);
+  ASSERT_EQ(2, drives.started.size());
+  EXPECT_STREQ("/dev/sdb", drives.started[1].c_str());
+  EXPECT_EQ(lumberjill::SELF_TEST_TYPE::LONG, drives.types["/dev/sdb"]);
+}
+
+TEST(SelfTest, TestSaveAndLoad)
+{
+  const cTemporaryFolder folder("self-test");
+  const std::string sFilePath = folder.GetFilePath("self_test.state");
+
+  const lumberjill::cSelfTestSettings settings = CreateSettings();
+
+  std::vector<lumberjill::cSelfTestRequest> requests;
+  requests.push_back(CreateRequest("/dev/sdb", 0, ""));
+
+  cFakeDrives drives;
+  std::map<std::string, lumberjill::cDriveSelfTestStats> results;
+
+  const int64_t nNow = int64_t(time(nullptr));
+
+  {
+    lumberjill::cSelfTestScheduler scheduler;
+    EXPECT_FALSE(scheduler.Load(sFilePath));
+    EXPECT_TRUE(scheduler.IsLoaded());
+
+    scheduler.Update(settings, nNow, requests, drives.GetStartFunction(), drives.GetPollFunction(), results);
+    EXPECT_EQ(1, drives.started.size());
+    EXPECT_TRUE(scheduler.Save(sFilePath));
+  }
+
+  // After a restart the running test is polled rather than started again
+  {
+    lumberjill::cSelfTestScheduler scheduler;
+    EXPECT_TRUE(scheduler.Load(sFilePath));
+
+    scheduler.Update(settings, nNow + 600, requests, drives.GetStartFunction(), drives.GetPollFunction(), results);
+    EXPECT_EQ(1, drives.started.size());
+    EXPECT_EQ(1, drives.polled.size());
+    EXPECT_EQ(lumberjill::SELF_TEST_RESULT::RUNNING, results["/dev/sdb"].result);
+    EXPECT_EQ(nNow, results["/dev/sdb"].nStartTimestamp);
+
+    drives.Finish("/dev/sdb", "Completed without error");
+    scheduler.Update(settings, nNow + 1200, requests, drives.GetStartFunction(), drives.GetPollFunction(), results);
+    EXPECT_EQ(lumberjill::SELF_TEST_RESULT::PASSED, results["/dev/sdb"].result);
+    EXPECT_TRUE(scheduler.Save(sFilePath));
+  }
+
+  // And the finished test isn't due again until the short interval is up
+  {
+    lumberjill::cSelfTestScheduler scheduler;
+    EXPECT_TRUE(scheduler.Load(sFilePath));
+
+    scheduler.Update(settings, nNow + (6 * SECONDS_PER_DAY), requests, drives.GetStartFunction(), drives.GetPollFunction(), results);
+    EXPECT_EQ(1, drives.started.size());
+
+    scheduler.Update(settings, nNow + (7 * SECONDS_PER_DAY), requests, drives.GetStartFunction(), drives.GetPollFunction(), results);
+    ASSERT_EQ(2, drives.started.size());
+    EXPECT_EQ(lumberjill::SELF_TEST_TYPE::SHORT, drives.types["/dev/sdb"]);
+  }
+}
@@ -0,0 +1,357 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "smart_scheduler.h"
+#include "stats.h"
+#include "topology.h"
+
+namespace {
+
+std::vector<lumberjill::cSmartQueryRequest> CreateRequests(const std::vector<std::string>& controllers, size_t nDrivesPerController)
+{
+  std::vector<lumberjill::cSmartQueryRequest> requests;
+  for (auto& sController : controllers) {
+    for (size_t i = 0; i < nDrivesPerController; i++) {
+      lumberjill::cSmartQueryRequest request;
+      request.sDevicePath = "/dev/disk/by-id/" + sController + "-drive" + std::to_string(i);
+      request.sController = sController;
+      requests.push_back(request);
+    }
+  }
+
+  return requests;
+}
+
+}
+
+TEST(SmartScheduler, TestGetControllerFromSysfsPath)
+{
+  // SAS drive behind an expander, the HBA is the deepest PCI address
+  EXPECT_STREQ("0000:03:00.0", lumberjill::GetControllerFromSysfsPath("../../devices/pci0000:00/0000:00:01.0/0000:03:00.0/host0/port-0:0/expander-0:0/port-0:0:4/end_device-0:0:4/target0:0:4/0:0:4:0/block/sdb").c_str());
+
+  // AHCI
+  EXPECT_STREQ("0000:00:17.0", lumberjill::GetControllerFromSysfsPath("../../devices/pci0000:00/0000:00:17.0/ata3/host2/target2:0:0/2:0:0:0/block/sda").c_str());
+
+  // NVMe, each drive is its own controller
+  EXPECT_STREQ("0000:01:00.0", lumberjill::GetControllerFromSysfsPath("../../devices/pci0000:00/0000:00:1d.0/0000:01:00.0/nvme/nvme0/nvme0n1").c_str());
+
+  // virtio
+  EXPECT_STREQ("0000:00:05.0", lumberjill::GetControllerFromSysfsPath("../../devices/pci0000:00/0000:00:05.0/virtio2/block/vda").c_str());
+
+  // No PCI device, fall back to the SCSI host
+  EXPECT_STREQ("host7", lumberjill::GetControllerFromSysfsPath("../../devices/platform/host7/target7:0:0/7:0:0:0/block/sdc").c_str());
+
+  // Virtual devices don't have a controller
+  EXPECT_STREQ("", lumberjill::GetControllerFromSysfsPath("../../devices/virtual/block/loop0").c_str());
+}
+
+TEST(SmartScheduler, TestPlan)
+{
+  const std::vector<lumberjill::cSmartQueryRequest> requests = CreateRequests({ "0000:03:00.0", "0000:04:00.0" }, 4);
+
+  const lumberjill::cSmartScheduler scheduler(std::chrono::seconds(60), 1, std::chrono::seconds(0), [](const std::string&, lumberjill::cSmartCtlStats&) { return true; });
+
+  lumberjill::cSmartSchedule schedule;
+  scheduler.Plan(requests, schedule);
+  EXPECT_EQ(60000, schedule.nWindowMS);
+  EXPECT_EQ(1, schedule.nMaxPerController);
+  ASSERT_EQ(requests.size(), schedule.entries.size());
+
+  // The entries are in start order
+  for (size_t i = 1; i < schedule.entries.size(); i++) {
+    EXPECT_LE(schedule.entries[i - 1].nOffsetMS, schedule.entries[i].nOffsetMS);
+  }
+
+  // Each controller's drives are evenly spaced within the window
+  std::map<std::string, std::vector<uint64_t>> mapControllerToOffsets;
+  for (auto& entry : schedule.entries) {
+    EXPECT_LT(entry.nOffsetMS, schedule.nWindowMS);
+    mapControllerToOffsets[entry.sController].push_back(entry.nOffsetMS);
+  }
+
+  ASSERT_EQ(2, mapControllerToOffsets.size());
+  for (auto& item : mapControllerToOffsets) {
+    ASSERT_EQ(4, item.second.size());
+    for (size_t i = 1; i < item.second.size(); i++) {
+      EXPECT_EQ(15000, item.second[i] - item.second[i - 1]);
+    }
+  }
+
+  // Planning again, with the requests in a different order, gives the same schedule
+  std::vector<lumberjill::cSmartQueryRequest> reversed(requests.rbegin(), requests.rend());
+  lumberjill::cSmartSchedule schedule2;
+  scheduler.Plan(reversed, schedule2);
+  ASSERT_EQ(schedule.entries.size(), schedule2.entries.size());
+  for (size_t i = 0; i < schedule.entries.size(); i++) {
+    EXPECT_EQ(schedule.entries[i].sDevicePath, schedule2.entries[i].sDevicePath);
+    EXPECT_EQ(schedule.entries[i].nOffsetMS, schedule2.entries[i].nOffsetMS);
+  }
+}
+
+TEST(SmartScheduler, TestRunMaxPerController)
+{
+  const std::vector<lumberjill::cSmartQueryRequest> requests = CreateRequests({ "0000:03:00.0", "0000:04:00.0" }, 6);
+
+  std::mutex mutex;
+  std::map<std::string, size_t> mapControllerToActive;
+  std::map<std::string, size_t> mapControllerToMaxActive;
+  std::atomic<size_t> nActive(0);
+  std::atomic<size_t> nMaxActive(0);
+
+  const auto query = [&](const std::string& sDevicePath, lumberjill::cSmartCtlStats& smartctlStats) {
+    const std::string sController = sDevicePath.substr(sDevicePath.find_last_of('/') + 1, 12);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      const size_t nControllerActive = ++mapControllerToActive[sController];
+      mapControllerToMaxActive[sController] = std::max(mapControllerToMaxActive[sController], nControllerActive);
+    }
+
+    const size_t nNowActive = ++nActive;
+    size_t nPreviousMax = nMaxActive;
+    while ((nNowActive > nPreviousMax) && !nMaxActive.compare_exchange_weak(nPreviousMax, nNowActive)) {
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    nActive--;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      mapControllerToActive[sController]--;
+    }
+
+    smartctlStats.nRaw_Read_Error_Rate = 0;
+    return true;
+  };
+
+  // A zero window starts everything straight away so only the controller limit holds the queries back
+  const lumberjill::cSmartScheduler scheduler(std::chrono::milliseconds(0), 2, std::chrono::seconds(0), query);
+
+  lumberjill::cSmartSchedule schedule;
+  scheduler.Plan(requests, schedule);
+
+  std::map<std::string, lumberjill::cSmartCtlStats> results;
+  scheduler.Run(schedule, results);
+
+  EXPECT_EQ(requests.size(), results.size());
+  for (auto& entry : schedule.entries) {
+    EXPECT_EQ(lumberjill::SMART_QUERY_RESULT::OK, entry.result);
+    EXPECT_GE(entry.nDurationMS, 19);
+  }
+
+  ASSERT_EQ(2, mapControllerToMaxActive.size());
+  for (auto& item : mapControllerToMaxActive) {
+    EXPECT_EQ(2, item.second);
+  }
+
+  // The controllers are queried in parallel with each other
+  EXPECT_GT(nMaxActive, 2);
+  EXPECT_LE(nMaxActive, 4);
+}
+
+TEST(SmartScheduler, TestRunDeadline)
+{
+  const std::vector<lumberjill::cSmartQueryRequest> requests = CreateRequests({ "0000:03:00.0" }, 4);
+
+  // The abandoned query finishes after the test has returned, so it can't use anything on the stack
+  std::shared_ptr<std::atomic<size_t>> nQueries = std::make_shared<std::atomic<size_t>>(0);
+  const auto query = [nQueries](const std::string&, lumberjill::cSmartCtlStats&) {
+    (*nQueries)++;
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    return true;
+  };
+
+  // One at a time, so only the first query can start before the deadline
+  const lumberjill::cSmartScheduler scheduler(std::chrono::milliseconds(0), 1, std::chrono::milliseconds(50), query);
+
+  lumberjill::cSmartSchedule schedule;
+  scheduler.Plan(requests, schedule);
+
+  std::map<std::string, lumberjill::cSmartCtlStats> results;
+  scheduler.Run(schedule, results);
+
+  // The running query is not waited for
+  EXPECT_EQ(1, *nQueries);
+  EXPECT_TRUE(results.empty());
+  EXPECT_GE(schedule.nDurationMS, 50);
+  EXPECT_LT(schedule.nDurationMS, 400);
+
+  ASSERT_EQ(4, schedule.entries.size());
+  EXPECT_EQ(lumberjill::SMART_QUERY_RESULT::TIMED_OUT, schedule.entries[0].result);
+  EXPECT_GE(schedule.entries[0].nDurationMS, 49);
+  for (size_t i = 1; i < schedule.entries.size(); i++) {
+    EXPECT_EQ(lumberjill::SMART_QUERY_RESULT::SKIPPED, schedule.entries[i].result);
+  }
+
+  const std::string sJSON = lumberjill::GetJSONSmartSchedule(schedule);
+  EXPECT_NE(std::string::npos, sJSON.find("\"result\": \"timedOut\""));
+}
+
+TEST(SmartScheduler, TestRunInFlight)
+{
+  const std::vector<lumberjill::cSmartQueryRequest> requests = CreateRequests({ "0000:03:00.0" }, 1);
+
+  std::shared_ptr<std::atomic<size_t>> nQueries = std::make_shared<std::atomic<size_t>>(0);
+  const auto query = [nQueries](const std::string&, lumberjill::cSmartCtlStats&) {
+    (*nQueries)++;
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    return true;
+  };
+
+  // Each collection makes its own scheduler, the devices in flight are shared between them
+  std::shared_ptr<lumberjill::cSmartDevicesInFlight> devicesInFlight = std::make_shared<lumberjill::cSmartDevicesInFlight>();
+
+  // The first run abandons the query
+  {
+    const lumberjill::cSmartScheduler scheduler(std::chrono::milliseconds(0), 1, std::chrono::milliseconds(50), query, devicesInFlight);
+
+    lumberjill::cSmartSchedule schedule;
+    scheduler.Plan(requests, schedule);
+
+    std::map<std::string, lumberjill::cSmartCtlStats> results;
+    scheduler.Run(schedule, results);
+
+    ASSERT_EQ(1, schedule.entries.size());
+    EXPECT_EQ(lumberjill::SMART_QUERY_RESULT::TIMED_OUT, schedule.entries[0].result);
+    EXPECT_TRUE(devicesInFlight->IsInFlight(requests[0].sDevicePath));
+  }
+
+  // The next run doesn't start another query on the drive while that one is still stuck
+  {
+    const lumberjill::cSmartScheduler scheduler(std::chrono::milliseconds(0), 1, std::chrono::milliseconds(50), query, devicesInFlight);
+
+    lumberjill::cSmartSchedule schedule;
+    scheduler.Plan(requests, schedule);
+
+    std::map<std::string, lumberjill::cSmartCtlStats> results;
+    scheduler.Run(schedule, results);
+
+    ASSERT_EQ(1, schedule.entries.size());
+    EXPECT_EQ(lumberjill::SMART_QUERY_RESULT::SKIPPED, schedule.entries[0].result);
+    EXPECT_TRUE(results.empty());
+    EXPECT_EQ(1, *nQueries);
+  }
+
+  // Once it has returned the drive is queried again
+  std::this_thread::sleep_for(std::chrono::milliseconds(400));
+  EXPECT_FALSE(devicesInFlight->IsInFlight(requests[0].sDevicePath));
+
+  {
+    const lumberjill::cSmartScheduler scheduler(std::chrono::milliseconds(0), 1, std::chrono::seconds(0), query, devicesInFlight);
+
+    lumberjill::cSmartSchedule schedule;
+    scheduler.Plan(requests, schedule);
+
+    std::map<std::string, lumberjill::cSmartCtlStats> results;
+    scheduler.Run(schedule, results);
+
+    ASSERT_EQ(1, schedule.entries.size());
+    EXPECT_EQ(lumberjill::SMART_QUERY_RESULT::OK, schedule.entries[0].result);
+    EXPECT_EQ(2, *nQueries);
+  }
+}
+
+TEST(SmartScheduler, TestRunStop)
+{
+  const std::vector<lumberjill::cSmartQueryRequest> requests = CreateRequests({ "0000:03:00.0", "0000:04:00.0" }, 2);
+
+  std::shared_ptr<std::atomic<size_t>> nQueries = std::make_shared<std::atomic<size_t>>(0);
+  const auto query = [nQueries](const std::string&, lumberjill::cSmartCtlStats&) {
+    (*nQueries)++;
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    return true;
+  };
+
+  // Without a stop this would take most of a minute
+  const lumberjill::cSmartScheduler scheduler(std::chrono::seconds(60), 1, std::chrono::seconds(0), query);
+
+  lumberjill::cSmartSchedule schedule;
+  scheduler.Plan(requests, schedule);
+
+  std::atomic<bool> bStopRequested(false);
+  std::thread stopper([&bStopRequested]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    bStopRequested = true;
+  });
+
+  std::map<std::string, lumberjill::cSmartCtlStats> results;
+  scheduler.Run(schedule, results, bStopRequested);
+  stopper.join();
+
+  EXPECT_TRUE(results.empty());
+  EXPECT_LT(schedule.nDurationMS, 400);
+
+  for (auto& entry : schedule.entries) {
+    EXPECT_TRUE((entry.result == lumberjill::SMART_QUERY_RESULT::SKIPPED) || (entry.result == lumberjill::SMART_QUERY_RESULT::TIMED_OUT));
+  }
+}
+
+TEST(SmartScheduler, TestRunStandby)
+{
+  const std::vector<lumberjill::cSmartQueryRequest> requests = CreateRequests({ "0000:03:00.0" }, 2);
+
+  // The first drive is spun down
+  const auto query = [&](const std::string& sDevicePath, lumberjill::cSmartCtlStats& smartctlStats) {
+    smartctlStats.bIsInStandby = (sDevicePath == requests[0].sDevicePath);
+    return true;
+  };
+
+  const lumberjill::cSmartScheduler scheduler(std::chrono::milliseconds(0), 1, std::chrono::seconds(0), query);
+
+  lumberjill::cSmartSchedule schedule;
+  scheduler.Plan(requests, schedule);
+
+  std::map<std::string, lumberjill::cSmartCtlStats> results;
+  scheduler.Run(schedule, results);
+
+  ASSERT_EQ(2, results.size());
+  EXPECT_TRUE(results[requests[0].sDevicePath].bIsInStandby);
+  EXPECT_FALSE(results[requests[1].sDevicePath].bIsInStandby);
+
+  for (auto& entry : schedule.entries) {
+    EXPECT_EQ((entry.sDevicePath == requests[0].sDevicePath) ? lumberjill::SMART_QUERY_RESULT::STANDBY : lumberjill::SMART_QUERY_RESULT::OK, entry.result);
+  }
+}
+
+TEST(SmartScheduler, TestRunSmartCall)
+{
+  std::shared_ptr<lumberjill::cSmartDevicesInFlight> devicesInFlight = std::make_shared<lumberjill::cSmartDevicesInFlight>();
+  const std::atomic<bool> bStopRequested(false);
+
+  EXPECT_EQ(lumberjill::SMART_QUERY_RESULT::OK, lumberjill::RunSmartCall(devicesInFlight, "/dev/sdb", std::chrono::seconds(0), bStopRequested, []() { return true; }));
+  EXPECT_EQ(lumberjill::SMART_QUERY_RESULT::ERROR, lumberjill::RunSmartCall(devicesInFlight, "/dev/sdb", std::chrono::seconds(1), bStopRequested, []() { return false; }));
+  EXPECT_FALSE(devicesInFlight->IsInFlight("/dev/sdb"));
+
+  // A call that doesn't return in time is abandoned, and the drive is left alone until it does return
+  const auto start = std::chrono::steady_clock::now();
+  EXPECT_EQ(lumberjill::SMART_QUERY_RESULT::TIMED_OUT, lumberjill::RunSmartCall(devicesInFlight, "/dev/sdb", std::chrono::milliseconds(50), bStopRequested, []() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    return true;
+  }));
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(250));
+
+  EXPECT_TRUE(devicesInFlight->IsInFlight("/dev/sdb"));
+  EXPECT_EQ(lumberjill::SMART_QUERY_RESULT::SKIPPED, lumberjill::RunSmartCall(devicesInFlight, "/dev/sdb", std::chrono::seconds(0), bStopRequested, []() { return true; }));
+
+  // Other drives aren't held up
+  EXPECT_EQ(lumberjill::SMART_QUERY_RESULT::OK, lumberjill::RunSmartCall(devicesInFlight, "/dev/sdc", std::chrono::seconds(0), bStopRequested, []() { return true; }));
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(400));
+  EXPECT_FALSE(devicesInFlight->IsInFlight("/dev/sdb"));
+
+  // Without a timeout a stop request ends the wait
+  const std::atomic<bool> bStopped(true);
+  EXPECT_EQ(lumberjill::SMART_QUERY_RESULT::TIMED_OUT, lumberjill::RunSmartCall(devicesInFlight, "/dev/sdd", std::chrono::seconds(0), bStopped, []() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    return true;
+  }));
+}
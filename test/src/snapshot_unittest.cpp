@@ -0,0 +1,144 @@
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "snapshot.h"
+#include "stats.h"
+
+namespace {
+
+// Each snapshot records how many groups it has in its timestamp, so a reader can tell if it ever sees one that is half built
+lumberjill::cStatsSnapshot CreateSnapshot(size_t nGroups)
+{
+  lumberjill::cStatsSnapshot snapshot;
+  snapshot.nTimestamp = int64_t(nGroups);
+
+  for (size_t g = 0; g < nGroups; g++) {
+    lumberjill::cGroupStats group;
+    group.mountStats.sMountPoint = "/data" + std::to_string(g);
+    group.mountStats.nFreeBytes = g * size_t(1000000000);
+    group.mountStats.nTotalBytes = 4000 * size_t(1000000000);
+
+    lumberjill::cDriveStats driveStats;
+    driveStats.sName = "Drive " + std::to_string(g);
+    driveStats.bIsPresent = true;
+    driveStats.smartCtlStats.nRaw_Read_Error_Rate = g;
+    group.mountStats.mapDrivePathToDriveStats["/dev/sd" + std::string(1, char('a' + (g % 26)))] = driveStats;
+
+    snapshot.groups.push_back(group);
+  }
+
+  return snapshot;
+}
+
+bool IsConsistent(const lumberjill::cPublishedSnapshot& published)
+{
+  const std::string sPrefix = "{ \"sequence\": " + std::to_string(published.snapshot.nSequence) + ",";
+  return (published.snapshot.groups.size() == size_t(published.snapshot.nTimestamp)) &&
+    published.sJSON.starts_with(sPrefix) &&
+    published.sOpenMetrics.ends_with("# EOF\n");
+}
+
+}
+
+TEST(Snapshot, TestPublishOrdering)
+{
+  lumberjill::cSnapshotStore store;
+  EXPECT_EQ(nullptr, store.GetLatest());
+
+  EXPECT_TRUE(store.Publish(CreateSnapshot(1)));
+  const std::shared_ptr<const lumberjill::cPublishedSnapshot> first = store.GetLatest();
+  ASSERT_NE(nullptr, first);
+  EXPECT_EQ(1, first->snapshot.nSequence);
+
+  EXPECT_TRUE(store.Publish(CreateSnapshot(2)));
+  EXPECT_EQ(2, store.GetLatest()->snapshot.nSequence);
+  EXPECT_EQ(2, store.GetLatest()->snapshot.groups.size());
+
+  // A reader keeps the snapshot it has even after it is replaced
+  EXPECT_EQ(1, first->snapshot.nSequence);
+  EXPECT_EQ(1, first->snapshot.groups.size());
+  EXPECT_TRUE(IsConsistent(*first));
+}
+
+TEST(Snapshot, TestSnapshotReader)
+{
+  lumberjill::cSnapshotStore store;
+  lumberjill::cSnapshotReader reader(store);
+
+  EXPECT_EQ(nullptr, reader.Get());
+  EXPECT_EQ(0, store.GetLatestSequence());
+
+  store.Publish(CreateSnapshot(1));
+  ASSERT_NE(nullptr, reader.Get());
+  EXPECT_EQ(1, reader.Get()->snapshot.nSequence);
+
+  // The reader hands out the same snapshot until a new one is published
+  const lumberjill::cPublishedSnapshot* pFirst = reader.Get().get();
+  EXPECT_EQ(pFirst, reader.Get().get());
+
+  store.Publish(CreateSnapshot(3));
+  EXPECT_EQ(2, store.GetLatestSequence());
+  EXPECT_EQ(2, reader.Get()->snapshot.nSequence);
+  EXPECT_EQ(3, reader.Get()->snapshot.groups.size());
+}
+
+// Run this under ThreadSanitizer as well, cmake -DSANITIZE_THREAD=ON
+TEST(Snapshot, TestConcurrentPublishAndRead)
+{
+  lumberjill::cSnapshotStore store;
+
+  const size_t nPublishers = 2;
+  const size_t nSnapshotsPerPublisher = 200;
+  const size_t nReaders = 6;
+
+  std::atomic<size_t> nPublishersRunning(nPublishers);
+  std::atomic<size_t> nInconsistent(0);
+  std::atomic<size_t> nOutOfOrder(0);
+  std::atomic<size_t> nReads(0);
+
+  std::vector<std::thread> threads;
+  for (size_t p = 0; p < nPublishers; p++) {
+    threads.push_back(std::thread([&store, &nPublishersRunning, p]() {
+      for (size_t i = 0; i < nSnapshotsPerPublisher; i++) {
+        store.Publish(CreateSnapshot(1 + ((i + p) % 8)));
+      }
+      nPublishersRunning--;
+    }));
+  }
+
+  // Half of the readers go straight to the store, the other half use a reader
+  for (size_t r = 0; r < nReaders; r++) {
+    threads.push_back(std::thread([&store, &nPublishersRunning, &nInconsistent, &nOutOfOrder, &nReads, r]() {
+      lumberjill::cSnapshotReader reader(store);
+      uint64_t nLastSequence = 0;
+      while (nPublishersRunning.load() != 0) {
+        const std::shared_ptr<const lumberjill::cPublishedSnapshot> published = ((r % 2) == 0) ? store.GetLatest() : reader.Get();
+        if (published == nullptr) continue;
+
+        nReads++;
+        if (!IsConsistent(*published)) nInconsistent++;
+
+        // The latest snapshot can only ever move forward
+        if (published->snapshot.nSequence < nLastSequence) nOutOfOrder++;
+        nLastSequence = published->snapshot.nSequence;
+      }
+    }));
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(0, nInconsistent.load());
+  EXPECT_EQ(0, nOutOfOrder.load());
+  EXPECT_LT(0, nReads.load());
+
+  // The last sequence number handed out can't have been dropped, nothing is newer than it
+  ASSERT_NE(nullptr, store.GetLatest());
+  EXPECT_EQ(nPublishers * nSnapshotsPerPublisher, store.GetLatest()->snapshot.nSequence);
+  EXPECT_EQ(nPublishers * nSnapshotsPerPublisher, store.GetLatestSequence());
+}
@@ -43,6 +43,190 @@ TEST(StatsToJSON, TestJSONMountStats)
   EXPECT_STREQ("{ \"mountPoint\": \"\\/\", \"freeSpaceGB\": 567, \"totalSpaceGB\": 1234, \"drives\": [ { \"name\": \"OS\", \"path\": \"\\/dev\\/sda\", \"present\": true, \"smartRaw_Read_Error_Rate\": 19215, \"smartSeek_Error_Rate\": 1234, \"smartOffline_Uncorrectable\": 5678 } ] }", output.c_str());
 }
 
+TEST(StatsToJSON, TestJSONMountStatsStandby)
+{
+  lumberjill::cMountStats mountStats;
+  mountStats.sMountPoint = "/mnt/archive";
+  mountStats.ClearSpaceStats();
+
+  lumberjill::cDriveStats driveStats;
+  driveStats.sName = "Archive";
+  driveStats.bIsPresent = true;
+  driveStats.smartCtlStats.bIsInStandby = true;
+  driveStats.smartCtlStats.nSampleAgeSeconds = 3600;
+  driveStats.smartCtlStats.nRaw_Read_Error_Rate = 0;
+  driveStats.smartCtlStats.nSeek_Error_Rate = 0;
+  driveStats.smartCtlStats.nOffline_Uncorrectable = 0;
+  mountStats.mapDrivePathToDriveStats["/dev/sdh"] = driveStats;
+
+  const std::string output = lumberjill::GetJSONMountStats(mountStats);
+  EXPECT_STREQ("{ \"mountPoint\": \"\\/mnt\\/archive\", \"drives\": [ { \"name\": \"Archive\", \"path\": \"\\/dev\\/sdh\", \"present\": true, \"smartPowerMode\": \"standby\", \"smartSampleAgeSeconds\": 3600, \"smartRaw_Read_Error_Rate\": 0, \"smartSeek_Error_Rate\": 0, \"smartOffline_Uncorrectable\": 0 } ] }", output.c_str());
+}
+
+TEST(StatsToJSON, TestJSONMountStatsTemperature)
+{
+  lumberjill::cMountStats mountStats;
+  mountStats.sMountPoint = "/";
+  mountStats.ClearSpaceStats();
+
+  lumberjill::cDriveStats driveStats;
+  driveStats.sName = "OS";
+  driveStats.bIsPresent = true;
+
+  lumberjill::cDriveTemperatureStats temperatureStats;
+  temperatureStats.nSamples = 6;
+  temperatureStats.dCurrentCelsius = 36.0;
+  temperatureStats.dMinCelsius = 35.0;
+  temperatureStats.dMaxCelsius = 38.5;
+  temperatureStats.dAverageCelsius = 36.25;
+  driveStats.temperatureStats = temperatureStats;
+  mountStats.mapDrivePathToDriveStats["/dev/sda"] = driveStats;
+
+  const std::string output = lumberjill::GetJSONMountStats(mountStats);
+  EXPECT_STREQ("{ \"mountPoint\": \"\\/\", \"drives\": [ { \"name\": \"OS\", \"path\": \"\\/dev\\/sda\", \"present\": true, \"temperatureCelsius\": 36.00, \"temperatureMinCelsius\": 35.00, \"temperatureMaxCelsius\": 38.50, \"temperatureAverageCelsius\": 36.25, \"temperatureSamples\": 6, \"temperatureSource\": \"hwmon\" } ] }", output.c_str());
+}
+
+TEST(StatsToJSON, TestJSONMountStatsUnresponsive)
+{
+  lumberjill::cMountStats mountStats;
+  mountStats.sMountPoint = "/mnt/externalusb";
+  mountStats.bIsResponsive = false;
+  mountStats.ClearSpaceStats();
+
+  lumberjill::cDriveStats driveStats;
+  driveStats.sName = "External USB";
+  driveStats.bIsPresent = true;
+  mountStats.mapDrivePathToDriveStats["/dev/sdg"] = driveStats;
+
+  const std::string output = lumberjill::GetJSONMountStats(mountStats);
+  EXPECT_STREQ("{ \"mountPoint\": \"\\/mnt\\/externalusb\", \"unresponsive\": true, \"drives\": [ { \"name\": \"External USB\", \"path\": \"\\/dev\\/sdg\", \"present\": true } ] }", output.c_str());
+}
+
+TEST(StatsToJSON, TestJSONMountStatsDiskIO)
+{
+  lumberjill::cMountStats mountStats;
+  mountStats.sMountPoint = "/data1";
+  mountStats.ClearSpaceStats();
+
+  lumberjill::cDiskIOStats diskIOStats;
+  diskIOStats.dReadIOPS = 50.0;
+  diskIOStats.dWriteIOPS = 1.0 / 3.0;
+  diskIOStats.dReadBytesPerSecond = 1048576.0;
+  diskIOStats.dWriteBytesPerSecond = 0.0;
+  diskIOStats.dReadAwaitMS = 5.0;
+  diskIOStats.dWriteAwaitMS = 12.345;
+  diskIOStats.dQueueDepth = 1.0;
+  diskIOStats.dUtilisationPercent = 100.0;
+
+  lumberjill::cDriveStats driveStats;
+  driveStats.sName = "Data 1";
+  driveStats.bIsPresent = true;
+  driveStats.diskIOStats = diskIOStats;
+  mountStats.mapDrivePathToDriveStats["/dev/sdb"] = driveStats;
+
+  const std::string output = lumberjill::GetJSONMountStats(mountStats);
+  EXPECT_STREQ("{ \"mountPoint\": \"\\/data1\", \"drives\": [ { \"name\": \"Data 1\", \"path\": \"\\/dev\\/sdb\", \"present\": true, \"readIOPS\": 50.00, \"writeIOPS\": 0.33, \"readBytesPerSecond\": 1048576.00, \"writeBytesPerSecond\": 0.00, \"readAwaitMS\": 5.00, \"writeAwaitMS\": 12.35, \"queueDepth\": 1.00, \"utilisationPercent\": 100.00 } ] }", output.c_str());
+}
+
+TEST(StatsToJSON, TestJSONMountStatsCapacityForecast)
+{
+  lumberjill::cMountStats mountStats;
+  mountStats.sMountPoint = "/data1";
+  mountStats.nFreeBytes = 900 * size_t(1000000000);
+  mountStats.nTotalBytes = 4000 * size_t(1000000000);
+  mountStats.nUnallocatedBytes = 45 * size_t(1000000000);
+
+  lumberjill::cCapacityForecast forecast;
+  forecast.basis = lumberjill::CAPACITY_BASIS::UNALLOCATED;
+  forecast.nAvailableBytes = mountStats.nUnallocatedBytes.value();
+  forecast.dFillRateBytesPerDay = 2.5 * 1000000000.0;
+  forecast.dDaysToFull = 18.0;
+  forecast.bIsAlert = true;
+  mountStats.capacityForecast = forecast;
+
+  const std::string output = lumberjill::GetJSONMountStats(mountStats);
+  EXPECT_STREQ("{ \"mountPoint\": \"\\/data1\", \"freeSpaceGB\": 900, \"totalSpaceGB\": 4000, \"unallocatedSpaceGB\": 45, \"capacityBasis\": \"unallocated\", \"fillRateGBPerDay\": 2.50, \"daysToFull\": 18.00, \"capacityAlert\": true, \"drives\": [ ] }", output.c_str());
+
+  const std::string alert = lumberjill::GetJSONCapacityAlert(mountStats, 30);
+  EXPECT_STREQ("{ \"mountPoint\": \"\\/data1\", \"availableSpaceGB\": 45, \"capacityBasis\": \"unallocated\", \"fillRateGBPerDay\": 2.50, \"daysToFull\": 18.00, \"capacityAlert\": true, \"horizonDays\": 30 }", alert.c_str());
+}
+
+TEST(StatsToJSON, TestJSONBtrfsQgroupStats)
+{
+  lumberjill::cBtrfsSubvolumeUsage usage;
+  usage.nSubvolumeId = 257;
+  usage.sName = "backups";
+  usage.nReferencedBytes = 5000;
+  usage.nExclusiveBytes = 4000;
+  usage.nMaxReferencedBytes = 10000;
+  usage.nMaxExclusiveBytes = 0;
+
+  lumberjill::cBtrfsQgroupStats qgroupStats;
+  qgroupStats.nSubvolumes = 3;
+  qgroupStats.topReferenced.push_back(usage);
+
+  // The change is only known from the second collection
+  usage.nReferencedChangeBytes = -100;
+  usage.nExclusiveChangeBytes = 200;
+  qgroupStats.topExclusive.push_back(usage);
+
+  const std::string output = lumberjill::GetJSONBtrfsQgroupStats("/data1", qgroupStats);
+  EXPECT_STREQ("{ \"mountPoint\": \"\\/data1\", \"subvolumes\": 3, \"topReferenced\": [ { \"id\": 257, \"name\": \"backups\", \"referencedBytes\": 5000, \"exclusiveBytes\": 4000, \"maxReferencedBytes\": 10000 } ], \"topExclusive\": [ { \"id\": 257, \"name\": \"backups\", \"referencedBytes\": 5000, \"exclusiveBytes\": 4000, \"referencedChangeBytes\": -100, \"exclusiveChangeBytes\": 200, \"maxReferencedBytes\": 10000 } ] }", output.c_str());
+}
+
+TEST(StatsToJSON, TestJSONScrubStats)
+{
+  lumberjill::cScrubDeviceProgress progress;
+  progress.nDeviceId = 1;
+  progress.sPath = "/dev/sdb";
+  progress.nBytesScrubbed = 250;
+  progress.nBytesToScrub = 1000;
+  progress.dBytesPerSecond = 5.0;
+  progress.dETASeconds = 150.0;
+  progress.nCsumErrors = 2;
+  progress.nCorrectedErrors = 2;
+  progress.nNewErrors = 1;
+
+  lumberjill::cScrubStats scrubStats;
+  scrubStats.state = lumberjill::SCRUB_STATE::PAUSED;
+  scrubStats.sReason = "latency";
+  scrubStats.devices.push_back(progress);
+
+  const std::string output = lumberjill::GetJSONScrubStats("/data1", scrubStats);
+  EXPECT_STREQ("{ \"mountPoint\": \"\\/data1\", \"state\": \"paused\", \"reason\": \"latency\", \"devices\": [ { \"id\": 1, \"path\": \"\\/dev\\/sdb\", \"bytesScrubbed\": 250, \"bytesToScrub\": 1000, \"percentComplete\": 25.00, \"bytesPerSecond\": 5.00, \"etaSeconds\": 150.00, \"readErrors\": 0, \"csumErrors\": 2, \"verifyErrors\": 0, \"superErrors\": 0, \"uncorrectableErrors\": 0, \"correctedErrors\": 2, \"newErrors\": 1 } ] }", output.c_str());
+}
+
+TEST(StatsToJSON, TestJSONDriveSelfTest)
+{
+  lumberjill::cMountStats mountStats;
+  mountStats.sMountPoint = "/data1";
+  mountStats.ClearSpaceStats();
+
+  lumberjill::cDriveSelfTestStats selfTestStats;
+  selfTestStats.type = lumberjill::SELF_TEST_TYPE::LONG;
+  selfTestStats.nStartTimestamp = 1700000000;
+  selfTestStats.nRemainingPercent = 40;
+
+  lumberjill::cDriveStats driveStats;
+  driveStats.sName = "Data 1";
+  driveStats.bIsPresent = true;
+  driveStats.selfTestStats = selfTestStats;
+  mountStats.mapDrivePathToDriveStats["/dev/sdb"] = driveStats;
+
+  const std::string output = lumberjill::GetJSONMountStats(mountStats);
+  EXPECT_STREQ("{ \"mountPoint\": \"\\/data1\", \"drives\": [ { \"name\": \"Data 1\", \"path\": \"\\/dev\\/sdb\", \"present\": true, \"selfTest\": { \"type\": \"long\", \"result\": \"running\", \"started\": 1700000000, \"remainingPercent\": 40 } } ] }", output.c_str());
+
+  // A failed test is logged on its own with the first bad sector
+  selfTestStats.result = lumberjill::SELF_TEST_RESULT::FAILED;
+  selfTestStats.nRemainingPercent.reset();
+  selfTestStats.sStatus = "Completed: read failure";
+  selfTestStats.nPowerOnHours = 35210;
+  selfTestStats.nFirstErrorLBA = 1953521664;
+
+  const std::string failed = lumberjill::GetJSONDriveSelfTest("/data1", "Data 1", "/dev/sdb", selfTestStats);
+  EXPECT_STREQ("{ \"mountPoint\": \"\\/data1\", \"name\": \"Data 1\", \"path\": \"\\/dev\\/sdb\", \"selfTest\": { \"type\": \"long\", \"result\": \"failed\", \"started\": 1700000000, \"status\": \"Completed: read failure\", \"powerOnHours\": 35210, \"firstErrorLBA\": 1953521664 } }", failed.c_str());
+}
+
 TEST(StatsToJSON, TestJSONBtrfsStats)
 {
   std::vector<lumberjill::cDevice> devices;
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <system_error>
+
+#include <unistd.h>
+
+// A folder for the files a test writes, it is removed along with everything in it when the test finishes
+class cTemporaryFolder {
+public:
+  explicit cTemporaryFolder(const std::string& sName) :
+    path(std::filesystem::temp_directory_path() / ("lumber-jill-unittest-" + sName + "-" + std::to_string(getpid())))
+  {
+    std::error_code ec;
+    std::filesystem::create_directories(path, ec);
+  }
+
+  ~cTemporaryFolder()
+  {
+    std::error_code ec;
+    std::filesystem::remove_all(path, ec);
+  }
+
+  std::string GetFilePath(const std::string& sFileName) const { return (path / sFileName).string(); }
+
+private:
+  const std::filesystem::path path;
+
+private:
+  cTemporaryFolder(const cTemporaryFolder&) = delete;
+  cTemporaryFolder& operator=(const cTemporaryFolder&) = delete;
+};
@@ -0,0 +1,182 @@
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+
+#include <gtest/gtest.h>
+
+#include "topology.h"
+
+namespace {
+
+void WriteFile(const std::string& sFilePath, const std::string& contents)
+{
+  std::filesystem::create_directories(std::filesystem::path(sFilePath).parent_path());
+  std::ofstream f(sFilePath);
+  f<<contents;
+}
+
+void CreateDisk(const std::string& sFolder, const std::string& sDisk, bool bIsRotational, const std::vector<std::string>& partitions)
+{
+  WriteFile(sFolder + "/sys/block/" + sDisk + "/queue/rotational", bIsRotational ? "1\n" : "0\n");
+  for (auto& sPartition : partitions) {
+    WriteFile(sFolder + "/sys/block/" + sDisk + "/" + sPartition + "/partition", "1\n");
+  }
+}
+
+void CreateByIDLink(const std::string& sFolder, const std::string& sName, const std::string& sNode)
+{
+  std::filesystem::create_directories(sFolder + "/dev/disk/by-id");
+  std::filesystem::create_symlink("../../" + sNode, sFolder + "/dev/disk/by-id/" + sName);
+}
+
+// Create a fake /sys, /dev and /proc/self/mountinfo that looks like this:
+// sda: SSD with the OS on sda1
+// sdb, sdc, sdd: Hard drives in a btrfs file system mounted on /data1
+// sde: Hard drive with a partition mounted on "/mnt/external usb"
+std::string CreateFakeMachine()
+{
+  char szFolder[] = "/tmp/lumber-jill-topology-XXXXXX";
+  if (mkdtemp(szFolder) == nullptr) return "";
+
+  const std::string sFolder(szFolder);
+
+  CreateDisk(sFolder, "sda", false, { "sda1", "sda2" });
+  CreateDisk(sFolder, "sdb", true, {});
+  CreateDisk(sFolder, "sdc", true, {});
+  CreateDisk(sFolder, "sdd", true, {});
+  CreateDisk(sFolder, "sde", true, { "sde1" });
+  CreateDisk(sFolder, "loop0", false, {});
+
+  const std::string sFSID = "6f2ae1b4-2a5e-4a8a-9a2c-4d6f0c6a3d52";
+  WriteFile(sFolder + "/sys/fs/btrfs/features/raid1c34", "0\n");
+  for (auto& sNode : { "sdb", "sdc", "sdd" }) {
+    WriteFile(sFolder + "/sys/fs/btrfs/" + sFSID + "/devices/" + sNode, "");
+  }
+
+  CreateByIDLink(sFolder, "ata-Samsung_SSD_860_EVO_S3Z9NB0K", "sda");
+  CreateByIDLink(sFolder, "ata-Samsung_SSD_860_EVO_S3Z9NB0K-part1", "sda1");
+  CreateByIDLink(sFolder, "wwn-0x5000c500c3d1a2b3", "sdb");
+  CreateByIDLink(sFolder, "ata-ST6000VN001-2BB186_ZR10KNTX", "sdb");
+  CreateByIDLink(sFolder, "ata-ST4000VN008-2DR166_ZGY9A4L9", "sdc");
+  CreateByIDLink(sFolder, "wwn-0x5000c500a1b2c3d4", "sdd");
+
+  WriteFile(sFolder + "/proc/self/mountinfo",
+    "22 1 0:21 / /proc rw,nosuid,nodev,noexec,relatime shared:12 - proc proc rw\n"
+    "29 1 8:1 / / rw,relatime shared:1 - ext4 /dev/sda1 rw\n"
+    "41 29 0:35 / /data1 rw,relatime shared:24 - btrfs /dev/sdc rw,space_cache=v2,subvolid=5,subvol=/\n"
+    "43 29 8:65 / /mnt/external\\040usb rw,relatime shared:25 - ext4 /dev/sde1 rw\n"
+  );
+
+  return sFolder;
+}
+
+}
+
+TEST(Topology, TestUnescapeMountInfoPath)
+{
+  EXPECT_STREQ("/data1", lumberjill::UnescapeMountInfoPath("/data1").c_str());
+  EXPECT_STREQ("/mnt/external usb", lumberjill::UnescapeMountInfoPath("/mnt/external\\040usb").c_str());
+  EXPECT_STREQ("/mnt/a\\b", lumberjill::UnescapeMountInfoPath("/mnt/a\\134b").c_str());
+  EXPECT_STREQ("/mnt/a\\", lumberjill::UnescapeMountInfoPath("/mnt/a\\").c_str());
+}
+
+TEST(Topology, TestScan)
+{
+  const std::string sFolder = CreateFakeMachine();
+  ASSERT_FALSE(sFolder.empty());
+
+  lumberjill::cTopology topology(sFolder + "/sys", sFolder + "/dev", sFolder + "/proc/self/mountinfo");
+  EXPECT_TRUE(topology.IsStale());
+  ASSERT_TRUE(topology.Scan());
+  EXPECT_FALSE(topology.IsStale());
+
+  // Disks and partitions, without the loop device
+  EXPECT_EQ(8, topology.GetBlockDevices().size());
+  EXPECT_EQ(nullptr, topology.FindBlockDevice("loop0"));
+
+  {
+    const lumberjill::cBlockDevice* pDevice = topology.FindBlockDevice("sda1");
+    ASSERT_NE(nullptr, pDevice);
+    EXPECT_STREQ("sda", pDevice->sDiskNode.c_str());
+    EXPECT_TRUE(pDevice->bIsPartition);
+    EXPECT_FALSE(pDevice->bIsRotational);
+    EXPECT_STREQ("ata-Samsung_SSD_860_EVO_S3Z9NB0K-part1", pDevice->sStableName.c_str());
+    EXPECT_TRUE(pDevice->sBtrfsFSID.empty());
+  }
+
+  {
+    // The ata- name is preferred over the wwn- name
+    const lumberjill::cBlockDevice* pDevice = topology.FindBlockDevice("sdb");
+    ASSERT_NE(nullptr, pDevice);
+    EXPECT_FALSE(pDevice->bIsPartition);
+    EXPECT_TRUE(pDevice->bIsRotational);
+    EXPECT_STREQ("ata-ST6000VN001-2BB186_ZR10KNTX", pDevice->sStableName.c_str());
+    EXPECT_STREQ("6f2ae1b4-2a5e-4a8a-9a2c-4d6f0c6a3d52", pDevice->sBtrfsFSID.c_str());
+  }
+
+  // Single drive mounts resolve to the whole disk
+  {
+    std::vector<lumberjill::cDevice> devices;
+    ASSERT_TRUE(topology.GetDevicesForMountPoint("/", lumberjill::GROUP_TYPE::SINGLE, devices));
+    ASSERT_EQ(1, devices.size());
+    EXPECT_STREQ("ata-Samsung_SSD_860_EVO_S3Z9NB0K", devices[0].sName.c_str());
+    EXPECT_STREQ((sFolder + "/dev/disk/by-id/ata-Samsung_SSD_860_EVO_S3Z9NB0K").c_str(), devices[0].sPath.c_str());
+
+    ASSERT_TRUE(topology.GetDevicesForMountPoint("/mnt/external usb", lumberjill::GROUP_TYPE::SINGLE, devices));
+    ASSERT_EQ(1, devices.size());
+    EXPECT_STREQ("sde", devices[0].sName.c_str());
+    // Without a by-id link the kernel name is all there is
+    EXPECT_STREQ((sFolder + "/dev/sde").c_str(), devices[0].sPath.c_str());
+  }
+
+  // Btrfs mounts resolve to every device in the file system
+  {
+    std::vector<lumberjill::cDevice> devices;
+    ASSERT_TRUE(topology.GetDevicesForMountPoint("/data1", lumberjill::GROUP_TYPE::BTRFS, devices));
+    ASSERT_EQ(3, devices.size());
+    EXPECT_STREQ("BTRFS ata-ST6000VN001-2BB186_ZR10KNTX", devices[0].sName.c_str());
+    EXPECT_STREQ((sFolder + "/dev/disk/by-id/ata-ST6000VN001-2BB186_ZR10KNTX").c_str(), devices[0].sPath.c_str());
+    EXPECT_STREQ("BTRFS ata-ST4000VN008-2DR166_ZGY9A4L9", devices[1].sName.c_str());
+    EXPECT_STREQ((sFolder + "/dev/disk/by-id/ata-ST4000VN008-2DR166_ZGY9A4L9").c_str(), devices[1].sPath.c_str());
+    EXPECT_STREQ("BTRFS wwn-0x5000c500a1b2c3d4", devices[2].sName.c_str());
+    EXPECT_STREQ((sFolder + "/dev/disk/by-id/wwn-0x5000c500a1b2c3d4").c_str(), devices[2].sPath.c_str());
+  }
+
+  // Unknown mount point
+  {
+    std::vector<lumberjill::cDevice> devices;
+    EXPECT_FALSE(topology.GetDevicesForMountPoint("/data2", lumberjill::GROUP_TYPE::BTRFS, devices));
+    EXPECT_TRUE(devices.empty());
+  }
+
+  // Only auto groups are resolved
+  {
+    std::vector<lumberjill::cGroup> groups(2);
+    groups[0].type = lumberjill::GROUP_TYPE::SINGLE;
+    groups[0].sMountPoint = "/";
+    groups[0].devices.push_back(lumberjill::cDevice { "OS", "/dev/sda" });
+    groups[1].type = lumberjill::GROUP_TYPE::BTRFS;
+    groups[1].sMountPoint = "/data1";
+    groups[1].bAutoDiscoverDevices = true;
+
+    std::vector<lumberjill::cGroup> resolved;
+    EXPECT_TRUE(topology.ResolveGroups(groups, resolved));
+    ASSERT_EQ(2, resolved.size());
+    ASSERT_EQ(1, resolved[0].devices.size());
+    EXPECT_STREQ("OS", resolved[0].devices[0].sName.c_str());
+    EXPECT_EQ(3, resolved[1].devices.size());
+  }
+
+  // Refreshing only scans again once invalidated
+  {
+    topology.Invalidate();
+    EXPECT_TRUE(topology.IsStale());
+    EXPECT_TRUE(topology.RefreshIfStale());
+    EXPECT_FALSE(topology.IsStale());
+    EXPECT_EQ(8, topology.GetBlockDevices().size());
+  }
+
+  std::error_code ec;
+  std::filesystem::remove_all(sFolder, ec);
+}
@@ -0,0 +1,143 @@
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "daemon.h"
+#include "settings.h"
+#include "uevent.h"
+
+namespace {
+
+// Join the fields of a uevent with null characters like the kernel does
+std::string BuildUEvent(std::initializer_list<const char*> fields)
+{
+  std::string message;
+  for (auto& field : fields) {
+    message.append(field);
+    message.push_back('\0');
+  }
+  return message;
+}
+
+// Recorded from "udevadm monitor --kernel --property" while unplugging and plugging in a drive
+const std::string sRemoveDisk = BuildUEvent({
+  "remove@/devices/pci0000:00/0000:00:17.0/ata3/host2/target2:0:0/2:0:0:0/block/sdc",
+  "ACTION=remove",
+  "DEVPATH=/devices/pci0000:00/0000:00:17.0/ata3/host2/target2:0:0/2:0:0:0/block/sdc",
+  "SUBSYSTEM=block",
+  "DEVNAME=sdc",
+  "DEVTYPE=disk",
+  "SEQNUM=4123",
+  "MAJOR=8",
+  "MINOR=32"
+});
+
+const std::string sAddPartition = BuildUEvent({
+  "add@/devices/pci0000:00/0000:00:17.0/ata3/host2/target2:0:0/2:0:0:0/block/sdc/sdc1",
+  "ACTION=add",
+  "DEVPATH=/devices/pci0000:00/0000:00:17.0/ata3/host2/target2:0:0/2:0:0:0/block/sdc/sdc1",
+  "SUBSYSTEM=block",
+  "DEVNAME=sdc1",
+  "DEVTYPE=partition",
+  "SEQNUM=4130"
+});
+
+const std::string sAddUSB = BuildUEvent({
+  "add@/devices/pci0000:00/0000:00:14.0/usb1/1-2",
+  "ACTION=add",
+  "DEVPATH=/devices/pci0000:00/0000:00:14.0/usb1/1-2",
+  "SUBSYSTEM=usb",
+  "SEQNUM=4131"
+});
+
+// udev rebroadcasts events with a binary header, we should ignore these
+const std::string sUdevMessage = std::string("libudev\0\xfe\xed\xca\xfe", 12) + "garbage";
+
+}
+
+TEST(UEvent, TestParseUEvent)
+{
+  lumberjill::cUEvent event;
+
+  EXPECT_FALSE(lumberjill::ParseUEvent("", event));
+  EXPECT_FALSE(lumberjill::ParseUEvent(sUdevMessage, event));
+  EXPECT_FALSE(lumberjill::ParseUEvent(BuildUEvent({ "ACTION=add" }), event));
+
+  ASSERT_TRUE(lumberjill::ParseUEvent(sRemoveDisk, event));
+  EXPECT_STREQ("remove", event.sAction.c_str());
+  EXPECT_STREQ("/devices/pci0000:00/0000:00:17.0/ata3/host2/target2:0:0/2:0:0:0/block/sdc", event.sDevPath.c_str());
+  EXPECT_STREQ("block", event.sSubsystem.c_str());
+  EXPECT_STREQ("sdc", event.sDevName.c_str());
+  EXPECT_STREQ("disk", event.sDevType.c_str());
+  EXPECT_TRUE(event.IsBlockDevice());
+
+  ASSERT_TRUE(lumberjill::ParseUEvent(sAddUSB, event));
+  EXPECT_STREQ("add", event.sAction.c_str());
+  EXPECT_FALSE(event.IsBlockDevice());
+  EXPECT_TRUE(event.sDevName.empty());
+}
+
+TEST(UEvent, TestUEventSocket)
+{
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0, fds));
+
+  lumberjill::cUEventSocket ueventSocket;
+  ueventSocket.Attach(fds[0]);
+
+  // Nothing to read yet
+  std::vector<lumberjill::cUEvent> events;
+  EXPECT_TRUE(ueventSocket.ReadEvents(events));
+  EXPECT_TRUE(events.empty());
+
+  for (auto& sMessage : { sRemoveDisk, sUdevMessage, sAddPartition, sAddUSB }) {
+    ASSERT_EQ(ssize_t(sMessage.length()), send(fds[1], sMessage.data(), sMessage.length(), 0));
+  }
+
+  // The udev message is skipped
+  EXPECT_TRUE(ueventSocket.ReadEvents(events));
+  ASSERT_EQ(3, events.size());
+  EXPECT_STREQ("sdc", events[0].sDevName.c_str());
+  EXPECT_STREQ("remove", events[0].sAction.c_str());
+  EXPECT_STREQ("sdc1", events[1].sDevName.c_str());
+  EXPECT_STREQ("partition", events[1].sDevType.c_str());
+  EXPECT_STREQ("usb", events[2].sSubsystem.c_str());
+
+  close(fds[1]);
+}
+
+TEST(UEvent, TestDaemonHandleUEvent)
+{
+  lumberjill::cSettings settings;
+  ASSERT_TRUE(settings.LoadFromFile("test/data/valid_settings.json"));
+
+  lumberjill::cDaemon daemon(settings);
+
+  lumberjill::cUEvent event;
+  event.sAction = "remove";
+  event.sSubsystem = "block";
+  event.sDevType = "disk";
+
+  // A monitored drive
+  event.sDevName = "sdc";
+  EXPECT_TRUE(daemon.HandleUEvent(event));
+
+  // A drive we don't monitor
+  event.sDevName = "sdz";
+  EXPECT_FALSE(daemon.HandleUEvent(event));
+
+  // A partition on a monitored drive
+  event.sDevName = "sdc1";
+  event.sDevType = "partition";
+  EXPECT_FALSE(daemon.HandleUEvent(event));
+
+  // Not a block device
+  event.sDevName = "sdc";
+  event.sSubsystem = "usb";
+  EXPECT_FALSE(daemon.HandleUEvent(event));
+}